@@ -254,8 +254,9 @@ static int dgrm_open(mrp_transport_t *mu)
 {
     dgrm_t *u = (dgrm_t *)mu;
 
-    u->sock   = -1;
-    u->family = -1;
+    u->sock      = -1;
+    u->family    = -1;
+    u->batchable = TRUE;
 
     return TRUE;
 }
@@ -267,7 +268,8 @@ static int dgrm_createfrom(mrp_transport_t *mu, void *conn)
     int             on;
     mrp_io_event_t  events;
 
-    u->sock = *(int *)conn;
+    u->sock      = *(int *)conn;
+    u->batchable = TRUE;
 
     if (u->sock >= 0) {
         if (mu->flags & MRP_TRANSPORT_REUSEADDR) {
@@ -716,7 +718,8 @@ static int sendnativeto(mrp_transport_t *mu, void *data, uint32_t type_id,
 
     reserve = sizeof(*lenp);
 
-    if (mrp_encode_native(data, type_id, reserve, &buf, &size, map) > 0) {
+    if (mrp_encode_native_as(data, type_id, reserve, &buf, &size, map,
+                             MRP_TRANSPORT_ENCODING(mu)) == 0) {
         lenp  = buf;
         *lenp = htobe32(size - sizeof(*lenp));
 
@@ -0,0 +1,887 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Intel Corporation nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <murphy/common/macros.h>
+#include <murphy/common/mm.h>
+#include <murphy/common/json-stream.h>
+
+/*
+ * streaming parser state
+ */
+
+typedef struct {
+    const char     *p;                   /* current parsing position */
+    const char     *end;                 /* end of input */
+    mrp_json_sax_t *sax;                 /* event callbacks */
+    void           *user_data;           /* opaque callback data */
+    int             depth;               /* current nesting depth */
+    char           *scratch;             /* buffer for unescaping strings */
+    size_t          ssize;               /* scratch buffer size */
+    char            sbuf[256];           /* initial scratch buffer */
+} parser_t;
+
+
+#define EMIT(ps, cb, ...)                                               \
+    ((ps)->sax->cb == NULL || (ps)->sax->cb((ps)->user_data, ## __VA_ARGS__) \
+     ? 0 : (errno = ECANCELED, -1))
+
+static int parse_value(parser_t *ps);
+
+
+static inline int invalid(void)
+{
+    errno = EINVAL;
+    return -1;
+}
+
+
+static inline void skip_whitespace(parser_t *ps)
+{
+    while (ps->p < ps->end &&
+           (*ps->p == ' ' || *ps->p == '\n' || *ps->p == '\t' ||
+            *ps->p == '\r'))
+        ps->p++;
+}
+
+
+static int ensure_scratch(parser_t *ps, size_t size)
+{
+    char   *buf;
+    size_t  nsize;
+
+    if (size <= ps->ssize)
+        return 0;
+
+    nsize = ps->ssize * 2;
+    while (nsize < size)
+        nsize *= 2;
+
+    if (ps->scratch == ps->sbuf) {
+        if ((buf = mrp_alloc(nsize)) != NULL)
+            memcpy(buf, ps->sbuf, ps->ssize);
+    }
+    else
+        buf = mrp_realloc(ps->scratch, nsize);
+
+    if (buf == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    ps->scratch = buf;
+    ps->ssize   = nsize;
+
+    return 0;
+}
+
+
+static int hex4(const char *p, uint32_t *cp)
+{
+    uint32_t v;
+    int      i;
+
+    for (i = 0, v = 0; i < 4; i++, p++) {
+        v <<= 4;
+
+        if ('0' <= *p && *p <= '9')
+            v |= *p - '0';
+        else if ('a' <= *p && *p <= 'f')
+            v |= *p - 'a' + 10;
+        else if ('A' <= *p && *p <= 'F')
+            v |= *p - 'A' + 10;
+        else
+            return -1;
+    }
+
+    *cp = v;
+
+    return 0;
+}
+
+
+static int put_utf8(char *buf, uint32_t cp)
+{
+    if (cp < 0x80) {
+        buf[0] = cp;
+        return 1;
+    }
+
+    if (cp < 0x800) {
+        buf[0] = 0xc0 | (cp >> 6);
+        buf[1] = 0x80 | (cp & 0x3f);
+        return 2;
+    }
+
+    if (cp < 0x10000) {
+        buf[0] = 0xe0 | (cp >> 12);
+        buf[1] = 0x80 | ((cp >> 6) & 0x3f);
+        buf[2] = 0x80 | (cp & 0x3f);
+        return 3;
+    }
+
+    buf[0] = 0xf0 | (cp >> 18);
+    buf[1] = 0x80 | ((cp >> 12) & 0x3f);
+    buf[2] = 0x80 | ((cp >> 6) & 0x3f);
+    buf[3] = 0x80 | (cp & 0x3f);
+    return 4;
+}
+
+
+static int parse_string(parser_t *ps, const char **strp, size_t *lenp)
+{
+    const char *beg, *p, *end;
+    size_t      n;
+    uint32_t    cp, lo;
+    char        c;
+
+    beg = p = ps->p + 1;                 /* skip opening quote */
+    end = ps->end;
+
+    /* fast path: no escapes, return a pointer to the input */
+    while (p < end && *p != '"' && *p != '\\') {
+        if ((unsigned char)*p < 0x20)
+            return invalid();
+        p++;
+    }
+
+    if (p >= end)
+        return invalid();
+
+    if (*p == '"') {
+        *strp = beg;
+        *lenp = p - beg;
+        ps->p = p + 1;
+
+        return 0;
+    }
+
+    /* slow path: unescape into the scratch buffer */
+    n = p - beg;
+
+    if (ensure_scratch(ps, n + 8) < 0)
+        return -1;
+
+    memcpy(ps->scratch, beg, n);
+
+    while (p < end && *p != '"') {
+        if (ensure_scratch(ps, n + 8) < 0)
+            return -1;
+
+        c = *p++;
+
+        if ((unsigned char)c < 0x20)
+            return invalid();
+
+        if (c != '\\') {
+            ps->scratch[n++] = c;
+            continue;
+        }
+
+        if (p >= end)
+            return invalid();
+
+        switch ((c = *p++)) {
+        case '"':
+        case '\\':
+        case '/': ps->scratch[n++] = c;    break;
+        case 'b': ps->scratch[n++] = '\b'; break;
+        case 'f': ps->scratch[n++] = '\f'; break;
+        case 'n': ps->scratch[n++] = '\n'; break;
+        case 'r': ps->scratch[n++] = '\r'; break;
+        case 't': ps->scratch[n++] = '\t'; break;
+        case 'u':
+            if (end - p < 4 || hex4(p, &cp) < 0)
+                return invalid();
+            p += 4;
+
+            /* combine UTF-16 surrogate pairs */
+            if (0xd800 <= cp && cp <= 0xdbff) {
+                if (end - p < 6 || p[0] != '\\' || p[1] != 'u' ||
+                    hex4(p + 2, &lo) < 0 || lo < 0xdc00 || lo > 0xdfff)
+                    return invalid();
+                p  += 6;
+                cp  = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+            }
+
+            n += put_utf8(ps->scratch + n, cp);
+            break;
+        default:
+            return invalid();
+        }
+    }
+
+    if (p >= end)
+        return invalid();
+
+    *strp = ps->scratch;
+    *lenp = n;
+    ps->p = p + 1;
+
+    return 0;
+}
+
+
+static int parse_number(parser_t *ps)
+{
+    const char *beg, *p, *end;
+    char        buf[64], *e;
+    uint64_t    u;
+    int         neg, integer, overflow;
+    double      d;
+
+    beg = p = ps->p;
+    end = ps->end;
+    neg = integer = TRUE;
+    overflow = FALSE;
+    u = 0;
+
+    if (*p == '-')
+        p++;
+    else
+        neg = FALSE;
+
+    if (p >= end || *p < '0' || *p > '9')
+        return invalid();
+
+    if (*p == '0')
+        p++;
+    else {
+        while (p < end && '0' <= *p && *p <= '9') {
+            if (u > (UINT64_MAX - 9) / 10)
+                overflow = TRUE;
+            u = u * 10 + (*p++ - '0');
+        }
+    }
+
+    if (p < end && *p == '.') {
+        integer = FALSE;
+        p++;
+        if (p >= end || *p < '0' || *p > '9')
+            return invalid();
+        while (p < end && '0' <= *p && *p <= '9')
+            p++;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        integer = FALSE;
+        p++;
+        if (p < end && (*p == '+' || *p == '-'))
+            p++;
+        if (p >= end || *p < '0' || *p > '9')
+            return invalid();
+        while (p < end && '0' <= *p && *p <= '9')
+            p++;
+    }
+
+    ps->p = p;
+
+    if (integer && !overflow) {
+        if (!neg && u <= (uint64_t)INT64_MAX)
+            return EMIT(ps, integer, (int64_t)u);
+        if (neg && u <= (uint64_t)INT64_MAX + 1)
+            return EMIT(ps, integer, (int64_t)(0 - u));
+    }
+
+    if ((size_t)(p - beg) >= sizeof(buf))
+        return invalid();
+
+    memcpy(buf, beg, p - beg);
+    buf[p - beg] = '\0';
+
+    d = strtod(buf, &e);
+
+    if (*e != '\0')
+        return invalid();
+
+    return EMIT(ps, floating, d);
+}
+
+
+static int parse_literal(parser_t *ps, const char *lit, size_t len)
+{
+    if ((size_t)(ps->end - ps->p) < len || strncmp(ps->p, lit, len))
+        return invalid();
+
+    ps->p += len;
+
+    return 0;
+}
+
+
+static int parse_object(parser_t *ps)
+{
+    const char *key;
+    size_t      len;
+
+    if (++ps->depth > MRP_JSON_STREAM_MAXDEPTH) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    if (EMIT(ps, begin_object) < 0)
+        return -1;
+
+    ps->p++;
+    skip_whitespace(ps);
+
+    if (ps->p < ps->end && *ps->p == '}')
+        goto out;
+
+    while (ps->p < ps->end) {
+        if (*ps->p != '"' || parse_string(ps, &key, &len) < 0)
+            return invalid();
+
+        if (EMIT(ps, key, key, len) < 0)
+            return -1;
+
+        skip_whitespace(ps);
+
+        if (ps->p >= ps->end || *ps->p != ':')
+            return invalid();
+
+        ps->p++;
+
+        if (parse_value(ps) < 0)
+            return -1;
+
+        skip_whitespace(ps);
+
+        if (ps->p >= ps->end)
+            break;
+
+        if (*ps->p == '}')
+            goto out;
+
+        if (*ps->p != ',')
+            return invalid();
+
+        ps->p++;
+        skip_whitespace(ps);
+    }
+
+    return invalid();
+
+ out:
+    ps->p++;
+    ps->depth--;
+
+    return EMIT(ps, end_object);
+}
+
+
+static int parse_array(parser_t *ps)
+{
+    if (++ps->depth > MRP_JSON_STREAM_MAXDEPTH) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    if (EMIT(ps, begin_array) < 0)
+        return -1;
+
+    ps->p++;
+    skip_whitespace(ps);
+
+    if (ps->p < ps->end && *ps->p == ']')
+        goto out;
+
+    while (ps->p < ps->end) {
+        if (parse_value(ps) < 0)
+            return -1;
+
+        skip_whitespace(ps);
+
+        if (ps->p >= ps->end)
+            break;
+
+        if (*ps->p == ']')
+            goto out;
+
+        if (*ps->p != ',')
+            return invalid();
+
+        ps->p++;
+    }
+
+    return invalid();
+
+ out:
+    ps->p++;
+    ps->depth--;
+
+    return EMIT(ps, end_array);
+}
+
+
+static int parse_value(parser_t *ps)
+{
+    const char *str;
+    size_t      len;
+
+    skip_whitespace(ps);
+
+    if (ps->p >= ps->end)
+        return invalid();
+
+    switch (*ps->p) {
+    case '{':
+        return parse_object(ps);
+    case '[':
+        return parse_array(ps);
+    case '"':
+        if (parse_string(ps, &str, &len) < 0)
+            return -1;
+        return EMIT(ps, string, str, len);
+    case 't':
+        if (parse_literal(ps, "true", 4) < 0)
+            return -1;
+        return EMIT(ps, boolean, true);
+    case 'f':
+        if (parse_literal(ps, "false", 5) < 0)
+            return -1;
+        return EMIT(ps, boolean, false);
+    case 'n':
+        if (parse_literal(ps, "null", 4) < 0)
+            return -1;
+        return EMIT(ps, null);
+    default:
+        return parse_number(ps);
+    }
+}
+
+
+ssize_t mrp_json_sax_parse(const char *str, int len, mrp_json_sax_t *sax,
+                           void *user_data)
+{
+    parser_t ps;
+    int      status;
+
+    if (str == NULL || sax == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (len < 0)
+        len = strlen(str);
+
+    ps.p         = str;
+    ps.end       = str + len;
+    ps.sax       = sax;
+    ps.user_data = user_data;
+    ps.depth     = 0;
+    ps.scratch   = ps.sbuf;
+    ps.ssize     = sizeof(ps.sbuf);
+
+    status = parse_value(&ps);
+
+    if (ps.scratch != ps.sbuf)
+        mrp_free(ps.scratch);
+
+    if (status < 0)
+        return -1;
+
+    skip_whitespace(&ps);
+
+    return ps.p - str;
+}
+
+
+/*
+ * streaming writer
+ */
+
+#define LEVEL_BIT(w) (1ULL << ((w)->depth - 1))
+
+static int writer_error(mrp_json_writer_t *w, int error)
+{
+    if (!w->error)
+        w->error = error;
+
+    errno = w->error;
+
+    return FALSE;
+}
+
+
+static int writer_ensure(mrp_json_writer_t *w, size_t n)
+{
+    size_t  size;
+    char   *buf;
+
+    if (w->used + n + 1 <= w->size)
+        return TRUE;
+
+    size = w->size ? w->size * 2 : 256;
+    while (size < w->used + n + 1)
+        size *= 2;
+
+    if (w->dynamic)
+        buf = mrp_realloc(w->buf, size);
+    else {
+        if ((buf = mrp_alloc(size)) != NULL && w->used > 0)
+            memcpy(buf, w->buf, w->used);
+    }
+
+    if (buf == NULL)
+        return writer_error(w, ENOMEM);
+
+    w->buf     = buf;
+    w->size    = size;
+    w->dynamic = TRUE;
+
+    return TRUE;
+}
+
+
+static inline int writer_append(mrp_json_writer_t *w, const char *s, size_t n)
+{
+    if (!writer_ensure(w, n))
+        return FALSE;
+
+    memcpy(w->buf + w->used, s, n);
+    w->used += n;
+
+    return TRUE;
+}
+
+
+static inline int writer_char(mrp_json_writer_t *w, char c)
+{
+    if (!writer_ensure(w, 1))
+        return FALSE;
+
+    w->buf[w->used++] = c;
+
+    return TRUE;
+}
+
+
+static int writer_quoted(mrp_json_writer_t *w, const char *s, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    const char *beg, *end;
+    char        esc[6];
+    int         n;
+    unsigned char c;
+
+    if (!writer_char(w, '"'))
+        return FALSE;
+
+    beg = s;
+    end = s + len;
+
+    while (s < end) {
+        c = *s;
+
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            s++;
+            continue;
+        }
+
+        if (s > beg && !writer_append(w, beg, s - beg))
+            return FALSE;
+
+        esc[0] = '\\';
+        n      = 2;
+
+        switch (c) {
+        case '"':  esc[1] = '"';  break;
+        case '\\': esc[1] = '\\'; break;
+        case '\b': esc[1] = 'b';  break;
+        case '\f': esc[1] = 'f';  break;
+        case '\n': esc[1] = 'n';  break;
+        case '\r': esc[1] = 'r';  break;
+        case '\t': esc[1] = 't';  break;
+        default:
+            esc[1] = 'u';
+            esc[2] = '0';
+            esc[3] = '0';
+            esc[4] = hex[c >> 4];
+            esc[5] = hex[c & 0xf];
+            n      = 6;
+        }
+
+        if (!writer_append(w, esc, n))
+            return FALSE;
+
+        beg = ++s;
+    }
+
+    if (s > beg && !writer_append(w, beg, s - beg))
+        return FALSE;
+
+    return writer_char(w, '"');
+}
+
+
+static int writer_prefix(mrp_json_writer_t *w, const char *key)
+{
+    if (w->error) {
+        errno = w->error;
+        return FALSE;
+    }
+
+    if (w->depth == 0)
+        return TRUE;
+
+    if (w->empty & LEVEL_BIT(w))
+        w->empty &= ~LEVEL_BIT(w);
+    else {
+        if (!writer_char(w, ','))
+            return FALSE;
+    }
+
+    if (w->array & LEVEL_BIT(w))
+        return TRUE;
+
+    if (key == NULL)
+        return writer_error(w, EINVAL);
+
+    return writer_quoted(w, key, strlen(key)) && writer_char(w, ':');
+}
+
+
+void mrp_json_writer_init(mrp_json_writer_t *w, char *buf, size_t size)
+{
+    mrp_clear(w);
+
+    w->buf  = buf;
+    w->size = buf != NULL ? size : 0;
+}
+
+
+void mrp_json_writer_reset(mrp_json_writer_t *w)
+{
+    w->used  = 0;
+    w->depth = 0;
+    w->array = 0;
+    w->empty = 0;
+    w->error = 0;
+}
+
+
+void mrp_json_writer_cleanup(mrp_json_writer_t *w)
+{
+    if (w->dynamic)
+        mrp_free(w->buf);
+
+    mrp_clear(w);
+}
+
+
+static int writer_begin(mrp_json_writer_t *w, const char *key, int array)
+{
+    if (!writer_prefix(w, key))
+        return FALSE;
+
+    if (w->depth >= MRP_JSON_STREAM_MAXDEPTH)
+        return writer_error(w, EOVERFLOW);
+
+    if (!writer_char(w, array ? '[' : '{'))
+        return FALSE;
+
+    w->depth++;
+    w->empty |= LEVEL_BIT(w);
+
+    if (array)
+        w->array |= LEVEL_BIT(w);
+    else
+        w->array &= ~LEVEL_BIT(w);
+
+    return TRUE;
+}
+
+
+static int writer_end(mrp_json_writer_t *w, int array)
+{
+    if (w->error) {
+        errno = w->error;
+        return FALSE;
+    }
+
+    if (w->depth == 0 || !(w->array & LEVEL_BIT(w)) != !array)
+        return writer_error(w, EINVAL);
+
+    if (!writer_char(w, array ? ']' : '}'))
+        return FALSE;
+
+    w->depth--;
+
+    return TRUE;
+}
+
+
+int mrp_json_writer_begin_object(mrp_json_writer_t *w, const char *key)
+{
+    return writer_begin(w, key, FALSE);
+}
+
+
+int mrp_json_writer_end_object(mrp_json_writer_t *w)
+{
+    return writer_end(w, FALSE);
+}
+
+
+int mrp_json_writer_begin_array(mrp_json_writer_t *w, const char *key)
+{
+    return writer_begin(w, key, TRUE);
+}
+
+
+int mrp_json_writer_end_array(mrp_json_writer_t *w)
+{
+    return writer_end(w, TRUE);
+}
+
+
+int mrp_json_writer_string(mrp_json_writer_t *w, const char *key,
+                           const char *str, int len)
+{
+    if (str == NULL)
+        return mrp_json_writer_null(w, key);
+
+    if (!writer_prefix(w, key))
+        return FALSE;
+
+    return writer_quoted(w, str, len < 0 ? strlen(str) : (size_t)len);
+}
+
+
+int mrp_json_writer_integer(mrp_json_writer_t *w, const char *key,
+                            int64_t value)
+{
+    char     buf[24], *p;
+    uint64_t u;
+
+    if (!writer_prefix(w, key))
+        return FALSE;
+
+    p = buf + sizeof(buf);
+    u = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+
+    do {
+        *--p = '0' + (u % 10);
+        u   /= 10;
+    } while (u != 0);
+
+    if (value < 0)
+        *--p = '-';
+
+    return writer_append(w, p, buf + sizeof(buf) - p);
+}
+
+
+int mrp_json_writer_double(mrp_json_writer_t *w, const char *key,
+                           double value)
+{
+    char buf[32];
+    int  n;
+
+    if (!isfinite(value))
+        return mrp_json_writer_null(w, key);
+
+    if (!writer_prefix(w, key))
+        return FALSE;
+
+    n = snprintf(buf, sizeof(buf), "%.17g", value);
+
+    /* make sure the value is read back as a double */
+    if (strpbrk(buf, ".eE") == NULL && n < (int)sizeof(buf) - 2) {
+        buf[n++] = '.';
+        buf[n++] = '0';
+    }
+
+    return writer_append(w, buf, n);
+}
+
+
+int mrp_json_writer_boolean(mrp_json_writer_t *w, const char *key,
+                            bool value)
+{
+    if (!writer_prefix(w, key))
+        return FALSE;
+
+    if (value)
+        return writer_append(w, "true", 4);
+    else
+        return writer_append(w, "false", 5);
+}
+
+
+int mrp_json_writer_null(mrp_json_writer_t *w, const char *key)
+{
+    if (!writer_prefix(w, key))
+        return FALSE;
+
+    return writer_append(w, "null", 4);
+}
+
+
+int mrp_json_writer_raw(mrp_json_writer_t *w, const char *key,
+                        const char *json, int len)
+{
+    if (json == NULL)
+        return mrp_json_writer_null(w, key);
+
+    if (!writer_prefix(w, key))
+        return FALSE;
+
+    return writer_append(w, json, len < 0 ? strlen(json) : (size_t)len);
+}
+
+
+const char *mrp_json_writer_data(mrp_json_writer_t *w, size_t *lenp)
+{
+    if (w->error) {
+        errno = w->error;
+        return NULL;
+    }
+
+    if (w->depth != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    if (!writer_ensure(w, 0))
+        return NULL;
+
+    w->buf[w->used] = '\0';
+
+    if (lenp != NULL)
+        *lenp = w->used;
+
+    return w->buf;
+}
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Intel Corporation nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MURPHY_JSON_STREAM_H__
+#define __MURPHY_JSON_STREAM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <murphy/common/macros.h>
+
+MRP_CDECL_BEGIN
+
+/*
+ * Streaming JSON parser and writer.
+ *
+ * Unlike the json-c based API in json.h, these do not build an
+ * intermediate document object model. The parser reports the input
+ * as a stream of events to a set of callbacks (SAX-style), which lets
+ * the caller decode directly into its target data structures. The
+ * writer serializes values straight into a (growing) buffer.
+ */
+
+/** Maximum nesting depth of arrays and objects. */
+#define MRP_JSON_STREAM_MAXDEPTH 64
+
+/**
+ * Streaming parser callbacks.
+ *
+ * Every callback is optional. A callback returns TRUE to continue
+ * parsing or FALSE to abort it, in which case the parser returns an
+ * error with errno set to ECANCELED. Keys and strings are passed as
+ * pointer-length pairs. They are not NUL-terminated and they are only
+ * valid until the callback returns. Strings without escape sequences
+ * point directly into the input being parsed.
+ */
+typedef struct {
+    int (*begin_object)(void *user_data);
+    int (*end_object)(void *user_data);
+    int (*begin_array)(void *user_data);
+    int (*end_array)(void *user_data);
+    int (*key)(void *user_data, const char *key, size_t len);
+    int (*string)(void *user_data, const char *str, size_t len);
+    int (*integer)(void *user_data, int64_t value);
+    int (*floating)(void *user_data, double value);
+    int (*boolean)(void *user_data, bool value);
+    int (*null)(void *user_data);
+} mrp_json_sax_t;
+
+/**
+ * Parse a single JSON value from the given string. If len is negative
+ * the string is expected to be NUL-terminated. Returns the number of
+ * bytes consumed, or -1 on error.
+ */
+ssize_t mrp_json_sax_parse(const char *str, int len, mrp_json_sax_t *sax,
+                           void *user_data);
+
+/**
+ * Streaming writer.
+ *
+ * The writer keeps track of nesting and inserts separators as necessary.
+ * Values written to an object need a key, values written to an array or
+ * at the top level must be given a NULL key. Once an error has occured
+ * all subsequent writes fail and mrp_json_writer_data returns NULL.
+ */
+typedef struct {
+    char     *buf;                       /* output buffer */
+    size_t    size;                      /* size of output buffer */
+    size_t    used;                      /* amount of buffer used */
+    int       dynamic;                   /* whether buffer was allocated */
+    int       depth;                     /* current nesting depth */
+    uint64_t  array;                     /* per level: is an array */
+    uint64_t  empty;                     /* per level: nothing written yet */
+    int       error;                     /* errno of first error, if any */
+} mrp_json_writer_t;
+
+/** Initialize a writer, optionally with a caller-provided initial buffer. */
+void mrp_json_writer_init(mrp_json_writer_t *w, char *buf, size_t size);
+
+/** Reset a writer for writing a new value, keeping its buffer. */
+void mrp_json_writer_reset(mrp_json_writer_t *w);
+
+/** Release any resources allocated by a writer. */
+void mrp_json_writer_cleanup(mrp_json_writer_t *w);
+
+/** Begin a new object. */
+int mrp_json_writer_begin_object(mrp_json_writer_t *w, const char *key);
+
+/** End the current object. */
+int mrp_json_writer_end_object(mrp_json_writer_t *w);
+
+/** Begin a new array. */
+int mrp_json_writer_begin_array(mrp_json_writer_t *w, const char *key);
+
+/** End the current array. */
+int mrp_json_writer_end_array(mrp_json_writer_t *w);
+
+/** Write a string, if len is negative str is NUL-terminated. */
+int mrp_json_writer_string(mrp_json_writer_t *w, const char *key,
+                           const char *str, int len);
+
+/** Write an integer. */
+int mrp_json_writer_integer(mrp_json_writer_t *w, const char *key,
+                            int64_t value);
+
+/** Write a double. */
+int mrp_json_writer_double(mrp_json_writer_t *w, const char *key,
+                           double value);
+
+/** Write a boolean. */
+int mrp_json_writer_boolean(mrp_json_writer_t *w, const char *key,
+                            bool value);
+
+/** Write a null. */
+int mrp_json_writer_null(mrp_json_writer_t *w, const char *key);
+
+/** Write an already serialized JSON value as such. */
+int mrp_json_writer_raw(mrp_json_writer_t *w, const char *key,
+                        const char *json, int len);
+
+/** Get the NUL-terminated output and its length once writing is done. */
+const char *mrp_json_writer_data(mrp_json_writer_t *w, size_t *lenp);
+
+MRP_CDECL_END
+
+#endif /* __MURPHY_JSON_STREAM_H__ */
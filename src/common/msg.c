@@ -1468,7 +1468,7 @@ int mrp_msg_register_type(mrp_data_descr_t *type)
             return FALSE;
     }
 
-    if (type->tag == MRP_MSG_TAG_DEFAULT) {
+    if (type->tag == MRP_MSG_TAG_DEFAULT || type->tag == MRP_MSG_TAG_BATCH) {
         errno = EINVAL;
         return FALSE;
     }
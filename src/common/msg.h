@@ -253,13 +253,15 @@ mrp_msg_t *mrp_msg_default_decode(void *buf, size_t size);
  * The data type tag is used to identify the descriptor and consequently
  * the custom data type both during sending and receiving (ie. encoding and
  * decoding). It is assigned by the registering entity, it must be unique,
- * and it cannot be MRP_MSG_TAG_DEFAULT (0x0), or else registration will
- * fail. The size is used to allocate necessary memory for the data on the
- * receiving end. The member descriptors are used to describe the offset
- * and types of the members within the custom data type.
+ * and it cannot be MRP_MSG_TAG_DEFAULT (0x0) or MRP_MSG_TAG_BATCH (0xffff),
+ * or else registration will fail. The size is used to allocate necessary
+ * memory for the data on the receiving end. The member descriptors are
+ * used to describe the offset and types of the members within the custom
+ * data type.
  */
 
 #define MRP_MSG_TAG_DEFAULT 0x0          /* tag for default encode/decoder */
+#define MRP_MSG_TAG_BATCH   0xffff       /* reserved for transport batches */
 
 typedef struct {
     uint16_t        offs;                /* offset within structure */
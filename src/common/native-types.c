@@ -34,6 +34,8 @@
 #include <murphy/common/log.h>
 #include <murphy/common/mm.h>
 #include <murphy/common/list.h>
+#include <murphy/common/hashtbl.h>
+#include <murphy/common/utils.h>
 #include <murphy/common/tlv.h>
 #include <murphy/common/native-types.h>
 
@@ -61,6 +63,37 @@ typedef struct {
 } chunk_t;
 
 
+/*
+ * precompiled codec plans
+ *
+ * A codec plan is a flat array of operations, one for each member of a
+ * native type, with the member types, offsets, array element sizes and
+ * array size or guard locations all resolved when the type is registered.
+ * Encoding and decoding then simply run through the plan without having
+ * to look up types or interpret member descriptors over and over again.
+ */
+
+typedef struct {
+    uint32_t             type;           /* member type */
+    uint32_t             idx;            /* member index */
+    size_t               offs;           /* member offset */
+    bool                 indirect;       /* whether accessed via a pointer */
+    mrp_native_member_t *m;              /* member descriptor */
+    mrp_native_type_t   *mt;             /* struct or array element type */
+    size_t               esize;          /* array element size */
+    uint32_t             ntype;          /* array size member type */
+    size_t               noffs;          /* array size member offset */
+    bool                 nindirect;      /* whether size member is indirect */
+    size_t               goffs;          /* guard offset within an element */
+    size_t               gsize;          /* guard size, 0 if none */
+} plan_op_t;
+
+typedef struct {
+    size_t    nop;                       /* number of operations */
+    plan_op_t ops[0];                    /* operations in member order */
+} plan_t;
+
+
 static int encode_struct(mrp_tlv_t *tlv, void *data, mrp_native_type_t *t,
                          mrp_typemap_t *idmap);
 static int decode_struct(mrp_tlv_t *tlv, mrp_list_hook_t **chunks,
@@ -80,7 +113,9 @@ static void free_chunks(mrp_list_hook_t *chunks);
 static MRP_LIST_HOOK(types);
 static int           ntype;
 
-static mrp_native_type_t **typetbl;
+static mrp_native_type_t **typetbl;      /* types by id */
+static plan_t            **plantbl;      /* codec plans by type id */
+static mrp_htbl_t         *typehash;     /* types by name */
 
 
 static mrp_native_member_t *native_member(mrp_native_type_t *t, int idx)
@@ -139,40 +174,29 @@ static int copy_member(mrp_native_type_t *t, mrp_native_member_t *m)
 
 static mrp_native_type_t *find_type(const char *type_name)
 {
-    mrp_native_type_t *t;
-    mrp_list_hook_t   *p, *n;
+    if (typehash != NULL)
+        return mrp_htbl_lookup(typehash, (void *)type_name);
+    else
+        return NULL;
+}
 
-    mrp_list_foreach(&types, p, n) {
-        t = mrp_list_entry(p, typeof(*t), hook);
 
-        if (!strcmp(t->name, type_name))
-            return t;
-    }
+static inline mrp_native_type_t *lookup_type(uint32_t id)
+{
+    if (MRP_LIKELY(id < (uint32_t)ntype))
+        return typetbl[id];
 
+    errno = ENOENT;
     return NULL;
 }
 
 
-static mrp_native_type_t *lookup_type(uint32_t id)
+static inline plan_t *type_plan(mrp_native_type_t *t)
 {
-    mrp_native_type_t *t;
-    mrp_list_hook_t   *p, *n;
-
-    /* XXX TODO: turn this into a real lookup instead of linear search */
-
-    if (1 <= id && id <= (uint32_t)ntype)
-        if ((t = typetbl[id]) != NULL && t->id == id)
-            return t;
-
-    mrp_log_warning("Type lookup for %u failed, doing linear search...\n", id);
-
-    mrp_list_foreach(&types, p, n) {
-        t = mrp_list_entry(p, typeof(*t), hook);
-
-        if (t->id == id)
-            return t;
-    }
+    if (MRP_LIKELY(t->id < (uint32_t)ntype && plantbl[t->id] != NULL))
+        return plantbl[t->id];
 
+    errno = EINVAL;
     return NULL;
 }
 
@@ -281,12 +305,23 @@ static void register_default_types(void)
         .hook    = { NULL, NULL }               \
     }
 
-#define REGISTER_TYPE(_type)                    \
-    mrp_list_init(&(_type)->hook);              \
-    mrp_list_append(&types, &(_type)->hook);    \
-    typetbl[(_type)->id] = (_type)
-
-    if (mrp_reallocz(typetbl, 0, DEFAULT_NTYPE) == NULL) {
+#define REGISTER_TYPE(_type)                                    \
+    mrp_list_init(&(_type)->hook);                              \
+    mrp_list_append(&types, &(_type)->hook);                    \
+    typetbl[(_type)->id] = (_type);                             \
+    mrp_htbl_insert(typehash, (_type)->name, (_type))
+
+    mrp_htbl_config_t hcfg = {
+        .nentry  = 64,
+        .comp    = mrp_string_comp,
+        .hash    = mrp_string_hash,
+        .free    = NULL,
+        .nbucket = 0,
+    };
+
+    if (mrp_reallocz(typetbl, 0, DEFAULT_NTYPE) == NULL ||
+        mrp_reallocz(plantbl, 0, DEFAULT_NTYPE) == NULL ||
+        (typehash = mrp_htbl_create(&hcfg)) == NULL) {
         mrp_log_error("Failed to initialize native type table.");
         abort();
     }
@@ -342,6 +377,133 @@ static void register_default_types(void)
 }
 
 
+static plan_t *compile_plan(mrp_native_type_t *t)
+{
+    plan_t              *plan;
+    plan_op_t           *op;
+    mrp_native_member_t *m, *n, *g;
+    size_t               i;
+
+    plan = mrp_allocz(sizeof(*plan) + t->nmember * sizeof(plan->ops[0]));
+
+    if (plan == NULL)
+        return NULL;
+
+    plan->nop = t->nmember;
+
+    for (i = 0, m = t->members; i < t->nmember; i++, m++) {
+        op = plan->ops + i;
+
+        op->type     = m->any.type;
+        op->idx      = i;
+        op->offs     = m->any.offs;
+        op->indirect = (m->any.layout == MRP_LAYOUT_INDIRECT);
+        op->m        = m;
+
+        switch (m->any.type) {
+        case MRP_TYPE_ARRAY:
+            if ((op->mt = lookup_type(m->array.elem.id)) == NULL)
+                goto fail;
+
+            op->esize = op->mt->size;
+
+            if (m->array.kind == MRP_ARRAY_SIZE_EXPLICIT) {
+                if ((n = native_member(t, m->array.size.idx)) == NULL)
+                    goto fail;
+
+                op->ntype     = n->any.type;
+                op->noffs     = n->any.offs;
+                op->nindirect = (n->any.layout == MRP_LAYOUT_INDIRECT);
+            }
+            else if (m->array.kind == MRP_ARRAY_SIZE_GUARDED) {
+                if (op->mt->id <= MRP_TYPE_STRING) {
+                    op->goffs = 0;
+                    op->gsize = op->mt->size;
+                }
+                else if (op->mt->id > MRP_TYPE_STRUCT) {
+                    if ((g = native_member(op->mt, m->array.size.idx)) == NULL)
+                        goto fail;
+
+                    op->goffs = g->any.offs;
+                    op->gsize = type_size(g->any.type);
+                }
+            }
+            break;
+
+        case MRP_TYPE_STRUCT:
+            if ((op->mt = lookup_type(m->strct.data_type.id)) == NULL)
+                goto fail;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    return plan;
+
+ fail:
+    mrp_free(plan);
+    return NULL;
+}
+
+
+static int plan_array_size(plan_op_t *op, void *base, void *arrp)
+{
+    mrp_native_array_t *m = &op->m->array;
+    mrp_value_t        *v;
+    int                 n;
+
+    switch (m->kind) {
+    case MRP_ARRAY_SIZE_FIXED:
+        return (int)m->size.nelem;
+
+    case MRP_ARRAY_SIZE_EXPLICIT:
+        if (op->nindirect)
+            v = *(void **)(base + op->noffs);
+        else
+            v = base + op->noffs;
+
+        switch (op->ntype) {
+        case MRP_TYPE_INT8:   n = v->s8;       break;
+        case MRP_TYPE_UINT8:  n = v->u8;       break;
+        case MRP_TYPE_INT16:  n = v->s16;      break;
+        case MRP_TYPE_UINT16: n = v->u16;      break;
+        case MRP_TYPE_INT32:  n = v->s32;      break;
+        case MRP_TYPE_UINT32: n = v->u32;      break;
+        case MRP_TYPE_INT64:  n = (int)v->s64; break;
+        case MRP_TYPE_UINT64: n = (int)v->u64; break;
+
+        case MRP_TYPE_INT:    n = (int)           v->i;   break;
+        case MRP_TYPE_UINT:   n = (unsigned int)  v->ui;  break;
+        case MRP_TYPE_SHORT:  n = (short)         v->si;  break;
+        case MRP_TYPE_USHORT: n = (unsigned short)v->usi; break;
+        case MRP_TYPE_SIZET:  n = (size_t)        v->sz;  break;
+        case MRP_TYPE_SSIZET: n = (ssize_t)       v->ssz; break;
+
+        default:
+            errno = EINVAL;
+            return -1;
+        }
+        return n;
+
+    case MRP_ARRAY_SIZE_GUARDED:
+        if (op->gsize == 0) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        for (n = 0; memcmp(arrp + n * op->esize + op->goffs,
+                           &m->sentinel, op->gsize); n++)
+            ;
+        return n;
+
+    default:
+        return -1;
+    }
+}
+
+
 uint32_t mrp_register_native(mrp_native_type_t *type)
 {
     mrp_native_type_t   *existing = find_type(type->name);
@@ -502,7 +664,20 @@ uint32_t mrp_register_native(mrp_native_type_t *type)
     if (mrp_reallocz(typetbl, ntype, ntype + 1) == NULL)
         goto fail;
 
+    if (mrp_reallocz(plantbl, ntype, ntype + 1) == NULL)
+        goto fail;
+
     t->id = ntype;
+
+    if ((plantbl[ntype] = compile_plan(t)) == NULL)
+        goto fail;
+
+    if (!mrp_htbl_insert(typehash, t->name, t)) {
+        mrp_free(plantbl[ntype]);
+        plantbl[ntype] = NULL;
+        goto fail;
+    }
+
     mrp_list_append(&types, &t->hook);
     typetbl[ntype] = t;
     ntype++;
@@ -735,42 +910,21 @@ static int get_array_size(void *base, mrp_native_type_t *t, void *arrp,
 }
 
 
-static int terminate_guarded_array(void *elem, mrp_native_array_t *m,
-                                   mrp_native_type_t *mt)
-{
-    mrp_native_member_t *g;
-
-    if (m->elem.id <= MRP_TYPE_STRING)
-        memcpy(elem, &m->sentinel, mt->size);
-    else if (m->elem.id > MRP_TYPE_STRUCT) {
-        if ((g = native_member(mt, m->size.idx)) == NULL)
-            return -1;
-
-        memcpy(elem + g->any.offs, &m->sentinel, type_size(g->any.type));
-    }
-
-    return 0;
-}
-
-
-static int encode_array(mrp_tlv_t *tlv, void *arrp, mrp_native_array_t *m,
-                        size_t nelem, size_t elem_size, mrp_typemap_t *idmap)
+static int encode_array(mrp_tlv_t *tlv, void *arrp, plan_op_t *op,
+                        size_t nelem, mrp_typemap_t *idmap)
 {
-    mrp_native_type_t *t;
+    mrp_native_type_t *t = op->mt;
     mrp_value_t       *v;
     void              *elem;
     size_t             i;
 
-    if (mrp_tlv_push_uint32(tlv, TAG_ARRAY, map_type(m->elem.id, idmap)) < 0)
+    if (mrp_tlv_push_uint32(tlv, TAG_ARRAY, map_type(t->id, idmap)) < 0)
         return -1;
 
     if (mrp_tlv_push_uint32(tlv, TAG_NELEM, nelem) < 0)
         return -1;
 
-    if ((t = lookup_type(m->elem.id)) == NULL)
-        return -1;
-
-    for (i = 0, elem = arrp; i < nelem; i++, elem += elem_size) {
+    for (i = 0, elem = arrp; i < nelem; i++, elem += op->esize) {
         v = elem;
 
         switch (t->id) {
@@ -818,28 +972,28 @@ static int encode_array(mrp_tlv_t *tlv, void *arrp, mrp_native_array_t *m,
 static int encode_struct(mrp_tlv_t *tlv, void *data, mrp_native_type_t *t,
                          mrp_typemap_t *idmap)
 {
-    mrp_native_member_t *m;
-    mrp_native_type_t   *mt;
-    mrp_value_t         *v;
-    uint32_t             idx;
-    size_t               size, nelem;
+    plan_t      *plan;
+    plan_op_t   *op;
+    mrp_value_t *v;
+    size_t       i;
+    int          nelem;
 
-    if (t == NULL)
+    if (t == NULL || (plan = type_plan(t)) == NULL)
         return -1;
 
     if (mrp_tlv_push_uint32(tlv, TAG_STRUCT, map_type(t->id, idmap)) < 0)
         return -1;
 
-    for (idx = 0, m = t->members; idx < t->nmember; idx++, m++) {
-        if (mrp_tlv_push_uint32(tlv, TAG_MEMBER, idx) < 0)
+    for (i = 0, op = plan->ops; i < plan->nop; i++, op++) {
+        if (mrp_tlv_push_uint32(tlv, TAG_MEMBER, op->idx) < 0)
             return -1;
 
-        if (m->any.layout == MRP_LAYOUT_INDIRECT)
-            v = *(void **)(data + m->any.offs);
+        if (op->indirect)
+            v = *(void **)(data + op->offs);
         else
-            v = data + m->any.offs;
+            v = data + op->offs;
 
-        switch (m->any.type) {
+        switch (op->type) {
         case MRP_TYPE_INT8:
         case MRP_TYPE_UINT8:
         case MRP_TYPE_INT16:
@@ -858,27 +1012,22 @@ static int encode_struct(mrp_tlv_t *tlv, void *data, mrp_native_type_t *t,
         case MRP_TYPE_USHORT:
         case MRP_TYPE_SIZET:
         case MRP_TYPE_SSIZET:
-            if (encode_basic(tlv, m->any.type, v) < 0)
+            if (encode_basic(tlv, op->type, v) < 0)
                 return -1;
             break;
 
         case MRP_TYPE_BLOB: /* XXX TODO implement blobs */
-            if (get_blob_size(data, t, &m->blob, &size) < 0)
-                return -1;
             return -1;
 
         case MRP_TYPE_ARRAY:
-            if (get_array_size(data, t, v->ptr, &m->array, &nelem, &size) < 0)
+            if ((nelem = plan_array_size(op, data, v->ptr)) < 0)
                 return -1;
-            if (encode_array(tlv, v->ptr, &m->array, nelem,
-                             size, idmap) < 0)
+            if (encode_array(tlv, v->ptr, op, nelem, idmap) < 0)
                 return -1;
             break;
 
         case MRP_TYPE_STRUCT:
-            if ((mt = lookup_type(m->strct.data_type.id)) == NULL)
-                return -1;
-            if (encode_struct(tlv, v->ptr, mt, idmap) < 0)
+            if (encode_struct(tlv, v->ptr, op->mt, idmap) < 0)
                 return -1;
             break;
 
@@ -893,6 +1042,15 @@ static int encode_struct(mrp_tlv_t *tlv, void *data, mrp_native_type_t *t,
 
 int mrp_encode_native(void *data, uint32_t id, size_t reserve, void **bufp,
                       size_t *sizep, mrp_typemap_t *idmap)
+{
+    return mrp_encode_native_as(data, id, reserve, bufp, sizep, idmap,
+                                MRP_NATIVE_ENCODING_FIXED);
+}
+
+
+int mrp_encode_native_as(void *data, uint32_t id, size_t reserve, void **bufp,
+                         size_t *sizep, mrp_typemap_t *idmap,
+                         mrp_native_encoding_t encoding)
 {
     mrp_native_type_t *t = lookup_type(id);
     mrp_tlv_t          tlv;
@@ -910,6 +1068,13 @@ int mrp_encode_native(void *data, uint32_t id, size_t reserve, void **bufp,
         if (mrp_tlv_reserve(&tlv, reserve, 1) == NULL)
             goto fail;
 
+    if (encoding == MRP_NATIVE_ENCODING_COMPACT) {
+        if (mrp_tlv_push_uint8(&tlv, TAG_NONE, MRP_NATIVE_COMPACT_MAGIC) < 0)
+            goto fail;
+
+        mrp_tlv_set_compact(&tlv, true);
+    }
+
     if (encode_struct(&tlv, data, t, idmap) < 0)
         goto fail;
 
@@ -1035,40 +1200,33 @@ static int decode_basic(mrp_tlv_t *tlv, mrp_list_hook_t **chunks,
 
 
 static int decode_array(mrp_tlv_t *tlv, mrp_list_hook_t **chunks,
-                        void **arrp, mrp_native_array_t *m,
-                        void *data, mrp_native_type_t *t,
+                        void **arrp, plan_op_t *op, void *data,
                         mrp_typemap_t *idmap)
 {
-    mrp_native_type_t *mt;
+    mrp_native_type_t *mt = op->mt;
     mrp_value_t       *v;
     void              *elem, *base;
-    size_t             elem_size, i;
+    size_t             i;
     uint32_t           id, nelem;
     int                n, guard;
 
     if (mrp_tlv_pull_uint32(tlv, TAG_ARRAY, &id) < 0)
         return -1;
 
-    if ((id = mapped_type(id, idmap)) != m->elem.id)
-        return -1;
-
-    if ((elem_size = type_size(id)) == 0)
+    if ((id = mapped_type(id, idmap)) != mt->id)
         return -1;
 
     if (mrp_tlv_pull_uint32(tlv, TAG_NELEM, &nelem) < 0)
         return -1;
 
-    if ((mt = lookup_type(m->elem.id)) == NULL)
-        return -1;
-
-    switch (m->kind) {
+    switch (op->m->array.kind) {
     case MRP_ARRAY_SIZE_EXPLICIT:
-        if ((n = get_explicit_array_size(data, t, m)) < 0)
+        if ((n = plan_array_size(op, data, NULL)) < 0)
             return -1;
         guard = 0;
         break;
     case MRP_ARRAY_SIZE_FIXED:
-        n     = m->size.nelem;
+        n     = op->m->array.size.nelem;
         guard = 0;
         break;
     case MRP_ARRAY_SIZE_GUARDED:
@@ -1082,13 +1240,13 @@ static int decode_array(mrp_tlv_t *tlv, mrp_list_hook_t **chunks,
     if (n != (int)nelem)
         return -1;
 
-    switch (m->layout) {
+    switch (op->m->any.layout) {
     case MRP_LAYOUT_INLINED:
         base = (void *)arrp;
         break;
     case MRP_LAYOUT_INDIRECT:
     case MRP_LAYOUT_DEFAULT:
-        if ((*arrp = alloc_chunk(chunks, (nelem + guard) * elem_size)) == NULL)
+        if ((*arrp = alloc_chunk(chunks, (nelem + guard) * op->esize)) == NULL)
             return (nelem + guard) ? -1 : 0;
         base = *arrp;
         break;
@@ -1096,7 +1254,7 @@ static int decode_array(mrp_tlv_t *tlv, mrp_list_hook_t **chunks,
         return -1;
     }
 
-    for (i = 0, elem = base; i < nelem; i++, elem += elem_size) {
+    for (i = 0, elem = base; i < nelem; i++, elem += op->esize) {
         v = elem;
 
         switch (mt->id) {
@@ -1135,10 +1293,8 @@ static int decode_array(mrp_tlv_t *tlv, mrp_list_hook_t **chunks,
         }
     }
 
-    if (guard) {
-        if (terminate_guarded_array(elem, m, mt) < 0)
-            return -1;
-    }
+    if (guard && op->gsize > 0)
+        memcpy(elem + op->goffs, &op->m->array.sentinel, op->gsize);
 
     return 0;
 }
@@ -1147,12 +1303,13 @@ static int decode_array(mrp_tlv_t *tlv, mrp_list_hook_t **chunks,
 static int decode_struct(mrp_tlv_t *tlv, mrp_list_hook_t **chunks,
                          void **datap, uint32_t *idp, mrp_typemap_t *idmap)
 {
-    mrp_native_type_t   *t;
-    mrp_native_member_t *m;
-    mrp_value_t         *v;
-    char                *str, **strp;
-    size_t               max, i;
-    uint32_t             idx, id;
+    mrp_native_type_t *t;
+    plan_t            *plan;
+    plan_op_t         *op;
+    mrp_value_t       *v;
+    char              *str, **strp;
+    size_t             max, i;
+    uint32_t           idx, id;
 
     if (datap == NULL) {
         errno = EFAULT;
@@ -1173,25 +1330,25 @@ static int decode_struct(mrp_tlv_t *tlv, mrp_list_hook_t **chunks,
     else
         *idp = id;
 
-    if ((t = lookup_type(id)) == NULL)
+    if ((t = lookup_type(id)) == NULL || (plan = type_plan(t)) == NULL)
         return -1;
 
     if (*datap == NULL)
         if ((*datap = alloc_chunk(chunks, t->size)) == NULL)
             return -1;
 
-    for (i = 0, m = t->members; i < t->nmember; i++, m++) {
+    for (i = 0, op = plan->ops; i < plan->nop; i++, op++) {
         if (mrp_tlv_pull_uint32(tlv, TAG_MEMBER, &idx) < 0)
             return -1;
 
-        v = *datap + m->any.offs;
+        v = *datap + op->offs;
 
-        if (m->any.layout == MRP_LAYOUT_INDIRECT) {
-            if ((v = allocate_indirect(chunks, v, m, idmap)) == NULL)
+        if (op->indirect) {
+            if ((v = allocate_indirect(chunks, v, op->m, idmap)) == NULL)
                 return -1;
         }
 
-        switch (m->any.type) {
+        switch (op->type) {
         case MRP_TYPE_INT8:
         case MRP_TYPE_UINT8:
         case MRP_TYPE_INT16:
@@ -1209,13 +1366,13 @@ static int decode_struct(mrp_tlv_t *tlv, mrp_list_hook_t **chunks,
         case MRP_TYPE_USHORT:
         case MRP_TYPE_SIZET:
         case MRP_TYPE_SSIZET:
-            if (decode_basic(tlv, chunks, m->any.type, v) < 0)
+            if (decode_basic(tlv, chunks, op->type, v) < 0)
                 return -1;
             break;
 
         case MRP_TYPE_STRING:
-            if (m->any.layout == MRP_LAYOUT_INLINED) {
-                max  = m->str.size;
+            if (op->m->any.layout == MRP_LAYOUT_INLINED) {
+                max  = op->m->str.size;
                 str  = v->str;
                 strp = &str;
             }
@@ -1232,13 +1389,12 @@ static int decode_struct(mrp_tlv_t *tlv, mrp_list_hook_t **chunks,
             return -1;
 
         case MRP_TYPE_ARRAY:
-            if (decode_array(tlv, chunks, &v->ptr, &m->array,
-                             *datap, t, idmap) < 0)
+            if (decode_array(tlv, chunks, &v->ptr, op, *datap, idmap) < 0)
                 return -1;
             break;
 
         case MRP_TYPE_STRUCT:
-            id = m->strct.data_type.id;
+            id = op->mt->id;
             if (decode_struct(tlv, chunks, &v->ptr, &id, idmap) < 0)
                 return -1;
             break;
@@ -1259,6 +1415,7 @@ int mrp_decode_native(void **bufp, size_t *sizep, void **datap, uint32_t *idp,
     mrp_list_hook_t *chunks;
     void            *data;
     size_t           diff;
+    uint8_t          magic;
 
     chunks = NULL;
     data   = NULL;
@@ -1266,6 +1423,11 @@ int mrp_decode_native(void **bufp, size_t *sizep, void **datap, uint32_t *idp,
     if (mrp_tlv_setup_read(&tlv, *bufp, *sizep) < 0)
         return -1;
 
+    if (mrp_native_compact(*bufp, *sizep)) {
+        mrp_tlv_pull_uint8(&tlv, TAG_NONE, &magic);
+        mrp_tlv_set_compact(&tlv, true);
+    }
+
     if (decode_struct(&tlv, &chunks, &data, idp, idmap) == 0) {
         diff = mrp_tlv_offset(&tlv);
 
@@ -349,10 +349,36 @@ uint32_t mrp_register_native(mrp_native_type_t *type);
 /** Look up the type id of the given native type name. */
 uint32_t mrp_native_id(const char *type_name);
 
+/*
+ * Native types can be encoded either with fixed-width fields or with
+ * the compact varint/zigzag TLV encoding (see tlv.h). Compact encodings
+ * are prefixed with a single MRP_NATIVE_COMPACT_MAGIC byte, which never
+ * starts a fixed-width encoding, so the decoder detects the encoding
+ * automatically.
+ */
+
+#define MRP_NATIVE_COMPACT_MAGIC 0xc5
+
+typedef enum {
+    MRP_NATIVE_ENCODING_FIXED = 0,       /* fixed-width fields */
+    MRP_NATIVE_ENCODING_COMPACT,         /* varint/zigzag fields */
+} mrp_native_encoding_t;
+
 /** Encode data of the given native type. */
 int mrp_encode_native(void *data, uint32_t id, size_t reserve, void **bufp,
                       size_t *sizep, mrp_typemap_t *idmap);
 
+/** Encode data of the given native type using the given encoding. */
+int mrp_encode_native_as(void *data, uint32_t id, size_t reserve, void **bufp,
+                         size_t *sizep, mrp_typemap_t *idmap,
+                         mrp_native_encoding_t encoding);
+
+/** Check if the given encoded native data uses the compact encoding. */
+static inline int mrp_native_compact(const void *buf, size_t size)
+{
+    return size > 0 && *(const uint8_t *)buf == MRP_NATIVE_COMPACT_MAGIC;
+}
+
 /** Decode data of (the given) native type (if specified). */
 int mrp_decode_native(void **bufp, size_t *sizep, void **datap, uint32_t *idp,
                       mrp_typemap_t *idmap);
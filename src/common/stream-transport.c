@@ -246,7 +246,8 @@ static int strm_open(mrp_transport_t *mt)
 {
     strm_t *t = (strm_t *)mt;
 
-    t->sock = -1;
+    t->sock      = -1;
+    t->batchable = TRUE;
 
     return TRUE;
 }
@@ -259,7 +260,8 @@ static int strm_createfrom(mrp_transport_t *mt, void *conn)
     int              on;
     long             nb;
 
-    t->sock = *(int *)conn;
+    t->sock      = *(int *)conn;
+    t->batchable = TRUE;
 
     if (t->sock >= 0) {
         if (mt->flags & MRP_TRANSPORT_REUSEADDR) {
@@ -337,9 +339,10 @@ static int strm_accept(mrp_transport_t *mt, mrp_transport_t *mlt)
     t  = (strm_t *)mt;
     lt = (strm_t *)mlt;
 
-    addrlen = sizeof(addr);
-    t->sock = accept(lt->sock, &addr.any, &addrlen);
-    t->buf  = mrp_fragbuf_create(TRUE, 0);
+    addrlen      = sizeof(addr);
+    t->sock      = accept(lt->sock, &addr.any, &addrlen);
+    t->buf       = mrp_fragbuf_create(TRUE, 0);
+    t->batchable = TRUE;
 
     if (t->sock >= 0 && t->buf != NULL) {
         if (mt->flags & MRP_TRANSPORT_REUSEADDR) {
@@ -697,7 +700,8 @@ static int strm_sendnative(mrp_transport_t *mt, void *data, uint32_t type_id)
     if (t->connected) {
         reserve = sizeof(*lenp);
 
-        if (mrp_encode_native(data, type_id, reserve, &buf, &size, map) == 0) {
+        if (mrp_encode_native_as(data, type_id, reserve, &buf, &size, map,
+                                 MRP_TRANSPORT_ENCODING(mt)) == 0) {
             lenp  = buf;
             *lenp = htobe32(size - sizeof(*lenp));
 
@@ -0,0 +1,576 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Intel Corporation nor the names of its contributors
+ *     may be used to endorse or promote products derived from this software
+ *     without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <murphy/common/macros.h>
+#include <murphy/common/mm.h>
+#include <murphy/common/log.h>
+#include <murphy/common/debug.h>
+#include <murphy/common/json.h>
+#include <murphy/common/json-stream.h>
+
+
+#define fatal(fmt, args...) do {                \
+        mrp_log_error(fmt, ## args);            \
+        exit(1);                                \
+    } while (0)
+
+
+typedef struct {
+    int         log_mask;
+    const char *log_target;
+    int         iterations;
+} context_t;
+
+context_t ctx;
+
+
+/*
+ * message shapes typical of our websocket clients
+ */
+
+static const char *messages[] = {
+    /* resource-wrt create request */
+    "{\"type\":\"create\",\"seq\":12,\"flags\":[\"autorelease\"],"
+    "\"priority\":0,\"class\":\"player\",\"zone\":\"driver\","
+    "\"resources\":[{\"name\":\"audio_playback\",\"flags\":[\"mandatory\","
+    "\"shared\"],\"attributes\":{\"role\":\"music\",\"pid\":\"4321\","
+    "\"policy\":\"relaxed\"}},{\"name\":\"video_playback\",\"flags\":"
+    "[\"optional\"]}]}",
+
+    /* resource-wrt resource set event */
+    "{\"type\":\"event\",\"seq\":0,\"id\":3,\"state\":\"acquire\","
+    "\"grant\":3,\"advice\":3,\"resources\":[{\"name\":\"audio_playback\","
+    "\"mask\":1},{\"name\":\"video_playback\",\"mask\":2}]}",
+
+    /* domain-control table notification */
+    "{\"type\":\"notify\",\"seq\":7,\"tables\":[{\"id\":1,\"columns\":"
+    "[\"zone\",\"class\",\"state\",\"volume\"],\"rows\":[[\"driver\","
+    "\"player\",1,0.75],[\"driver\",\"navigator\",0,1.0],[\"passenger1\","
+    "\"player\",1,-0.5e-1]]}]}",
+
+    /* console output */
+    "{\"output\":\"  \\\"zone\\\" driver\\n\\tclass player\\n"
+    "\\u00e4\\u00f6\\ud83d\\ude00 done\\r\\n\",\"null\":null,"
+    "\"true\":true,\"false\":false,\"big\":-9223372036854775808}",
+};
+
+
+/*
+ * a streaming parser that simply echoes its input using a writer
+ */
+
+typedef struct {
+    mrp_json_writer_t  w;
+    char               key[256];
+    char              *keyp;
+    int                nevent;
+} echo_t;
+
+
+static const char *echo_key(echo_t *e)
+{
+    const char *key = e->keyp;
+
+    e->keyp = NULL;
+
+    return key;
+}
+
+static int echo_begin_object(void *user_data)
+{
+    echo_t *e = user_data;
+
+    e->nevent++;
+    return mrp_json_writer_begin_object(&e->w, echo_key(e));
+}
+
+static int echo_end_object(void *user_data)
+{
+    echo_t *e = user_data;
+
+    e->nevent++;
+    return mrp_json_writer_end_object(&e->w);
+}
+
+static int echo_begin_array(void *user_data)
+{
+    echo_t *e = user_data;
+
+    e->nevent++;
+    return mrp_json_writer_begin_array(&e->w, echo_key(e));
+}
+
+static int echo_end_array(void *user_data)
+{
+    echo_t *e = user_data;
+
+    e->nevent++;
+    return mrp_json_writer_end_array(&e->w);
+}
+
+static int echo_keyname(void *user_data, const char *key, size_t len)
+{
+    echo_t *e = user_data;
+
+    if (len >= sizeof(e->key))
+        return FALSE;
+
+    memcpy(e->key, key, len);
+    e->key[len] = '\0';
+    e->keyp     = e->key;
+    e->nevent++;
+
+    return TRUE;
+}
+
+static int echo_string(void *user_data, const char *str, size_t len)
+{
+    echo_t *e = user_data;
+
+    e->nevent++;
+    return mrp_json_writer_string(&e->w, echo_key(e), str, (int)len);
+}
+
+static int echo_integer(void *user_data, int64_t value)
+{
+    echo_t *e = user_data;
+
+    e->nevent++;
+    return mrp_json_writer_integer(&e->w, echo_key(e), value);
+}
+
+static int echo_floating(void *user_data, double value)
+{
+    echo_t *e = user_data;
+
+    e->nevent++;
+    return mrp_json_writer_double(&e->w, echo_key(e), value);
+}
+
+static int echo_boolean(void *user_data, bool value)
+{
+    echo_t *e = user_data;
+
+    e->nevent++;
+    return mrp_json_writer_boolean(&e->w, echo_key(e), value);
+}
+
+static int echo_null(void *user_data)
+{
+    echo_t *e = user_data;
+
+    e->nevent++;
+    return mrp_json_writer_null(&e->w, echo_key(e));
+}
+
+static mrp_json_sax_t echo_sax = {
+    .begin_object = echo_begin_object,
+    .end_object   = echo_end_object,
+    .begin_array  = echo_begin_array,
+    .end_array    = echo_end_array,
+    .key          = echo_keyname,
+    .string       = echo_string,
+    .integer      = echo_integer,
+    .floating     = echo_floating,
+    .boolean      = echo_boolean,
+    .null         = echo_null,
+};
+
+
+static char *echo(const char *msg, int *neventp)
+{
+    echo_t      e;
+    const char *out;
+    char       *copy;
+
+    mrp_clear(&e);
+    mrp_json_writer_init(&e.w, NULL, 0);
+
+    if (mrp_json_sax_parse(msg, -1, &echo_sax, &e) != (ssize_t)strlen(msg))
+        fatal("failed to parse message '%s' (%d: %s)", msg, errno,
+              strerror(errno));
+
+    if ((out = mrp_json_writer_data(&e.w, NULL)) == NULL)
+        fatal("failed to write message '%s'", msg);
+
+    copy = mrp_strdup(out);
+    mrp_json_writer_cleanup(&e.w);
+
+    if (neventp != NULL)
+        *neventp = e.nevent;
+
+    return copy;
+}
+
+
+static void test_roundtrip(void)
+{
+    mrp_json_t *o;
+    char       *first, *second;
+    int         i, n1, n2;
+
+    for (i = 0; i < (int)MRP_ARRAY_SIZE(messages); i++) {
+        first  = echo(messages[i], &n1);
+        second = echo(first, &n2);
+
+        if (strcmp(first, second) || n1 != n2)
+            fatal("round trip mismatch: '%s' vs. '%s'", first, second);
+
+        if ((o = mrp_json_string_to_object(first, -1)) == NULL)
+            fatal("json-c failed to parse written message '%s'", first);
+
+        mrp_json_unref(o);
+
+        mrp_log_info("message #%d: %d events, OK", i, n1);
+
+        mrp_free(first);
+        mrp_free(second);
+    }
+}
+
+
+static void test_invalid(void)
+{
+    const char *invalid[] = {
+        "", "{", "[1,]", "{\"a\" 1}", "{\"a\":1,}", "[01x]", "\"abc",
+        "\"\\x\"", "\"\\ud800\"", "tru", "nul", "-", "1.", "1e",
+        "{1:2}", "\"a\tb\"",
+    };
+    mrp_json_sax_t sax;
+    int            i;
+
+    mrp_clear(&sax);
+
+    for (i = 0; i < (int)MRP_ARRAY_SIZE(invalid); i++) {
+        if (mrp_json_sax_parse(invalid[i], -1, &sax, NULL) >= 0)
+            fatal("invalid input '%s' was accepted", invalid[i]);
+    }
+
+    mrp_log_info("rejected %d invalid inputs, OK", i);
+}
+
+
+/*
+ * benchmarks against json-c
+ */
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+
+static int count_cb(void *user_data)
+{
+    (*(int *)user_data)++;
+    return TRUE;
+}
+
+static int count_str_cb(void *user_data, const char *s, size_t l)
+{
+    MRP_UNUSED(s);
+    MRP_UNUSED(l);
+
+    (*(int *)user_data)++;
+    return TRUE;
+}
+
+static int count_int_cb(void *user_data, int64_t v)
+{
+    MRP_UNUSED(v);
+
+    (*(int *)user_data)++;
+    return TRUE;
+}
+
+static int count_dbl_cb(void *user_data, double v)
+{
+    MRP_UNUSED(v);
+
+    (*(int *)user_data)++;
+    return TRUE;
+}
+
+static int count_bool_cb(void *user_data, bool v)
+{
+    MRP_UNUSED(v);
+
+    (*(int *)user_data)++;
+    return TRUE;
+}
+
+
+static void bench_parse(void)
+{
+    mrp_json_sax_t sax = {
+        .begin_object = count_cb,
+        .end_object   = count_cb,
+        .begin_array  = count_cb,
+        .end_array    = count_cb,
+        .key          = count_str_cb,
+        .string       = count_str_cb,
+        .integer      = count_int_cb,
+        .floating     = count_dbl_cb,
+        .boolean      = count_bool_cb,
+        .null         = count_cb,
+    };
+    mrp_json_t *o;
+    double      start, jsonc, stream;
+    int         i, j, n, cnt;
+
+    n = ctx.iterations;
+
+    for (i = 0; i < (int)MRP_ARRAY_SIZE(messages); i++) {
+        start = now();
+        for (j = 0; j < n; j++) {
+            if ((o = mrp_json_string_to_object(messages[i], -1)) == NULL)
+                fatal("json-c failed to parse message #%d", i);
+            mrp_json_unref(o);
+        }
+        jsonc = now() - start;
+
+        start = now();
+        for (j = 0, cnt = 0; j < n; j++) {
+            if (mrp_json_sax_parse(messages[i], -1, &sax, &cnt) < 0)
+                fatal("failed to parse message #%d", i);
+        }
+        stream = now() - start;
+
+        mrp_log_info("parse message #%d: json-c %.3f us, stream %.3f us "
+                     "(%.1fx)", i, jsonc * 1000000 / n, stream * 1000000 / n,
+                     stream > 0 ? jsonc / stream : 0.0);
+    }
+}
+
+
+static void bench_write(void)
+{
+    const char *names[] = { "audio_playback", "video_playback" };
+    mrp_json_writer_t w;
+    mrp_json_t       *msg, *rarr, *r;
+    char              buf[512];
+    double            start, jsonc, stream;
+    int               i, j, n;
+
+    n = ctx.iterations;
+
+    /* a resource set event, the way resource-wrt builds it */
+    start = now();
+    for (i = 0; i < n; i++) {
+        msg  = mrp_json_create(MRP_JSON_OBJECT);
+        rarr = mrp_json_create(MRP_JSON_ARRAY);
+
+        mrp_json_add_string (msg, "type"  , "event");
+        mrp_json_add_integer(msg, "seq"   , 0);
+        mrp_json_add_integer(msg, "id"    , i);
+        mrp_json_add_string (msg, "state" , "acquire");
+        mrp_json_add_integer(msg, "grant" , 3);
+        mrp_json_add_integer(msg, "advice", 3);
+
+        for (j = 0; j < (int)MRP_ARRAY_SIZE(names); j++) {
+            r = mrp_json_create(MRP_JSON_OBJECT);
+            mrp_json_add_string (r, "name", names[j]);
+            mrp_json_add_integer(r, "mask", 1 << j);
+            mrp_json_array_append(rarr, r);
+        }
+
+        mrp_json_add(msg, "resources", rarr);
+
+        if (mrp_json_object_to_string(msg) == NULL)
+            fatal("json-c failed to serialize message");
+
+        mrp_json_unref(msg);
+    }
+    jsonc = now() - start;
+
+    start = now();
+    mrp_json_writer_init(&w, buf, sizeof(buf));
+    for (i = 0; i < n; i++) {
+        mrp_json_writer_reset(&w);
+        mrp_json_writer_begin_object(&w, NULL);
+        mrp_json_writer_string (&w, "type"  , "event", -1);
+        mrp_json_writer_integer(&w, "seq"   , 0);
+        mrp_json_writer_integer(&w, "id"    , i);
+        mrp_json_writer_string (&w, "state" , "acquire", -1);
+        mrp_json_writer_integer(&w, "grant" , 3);
+        mrp_json_writer_integer(&w, "advice", 3);
+        mrp_json_writer_begin_array(&w, "resources");
+        for (j = 0; j < (int)MRP_ARRAY_SIZE(names); j++) {
+            mrp_json_writer_begin_object(&w, NULL);
+            mrp_json_writer_string (&w, "name", names[j], -1);
+            mrp_json_writer_integer(&w, "mask", 1 << j);
+            mrp_json_writer_end_object(&w);
+        }
+        mrp_json_writer_end_array(&w);
+        mrp_json_writer_end_object(&w);
+
+        if (mrp_json_writer_data(&w, NULL) == NULL)
+            fatal("failed to write message");
+    }
+    stream = now() - start;
+    mrp_json_writer_cleanup(&w);
+
+    mrp_log_info("write event: json-c %.3f us, stream %.3f us (%.1fx)",
+                 jsonc * 1000000 / n, stream * 1000000 / n,
+                 stream > 0 ? jsonc / stream : 0.0);
+}
+
+
+static void print_usage(const char *argv0, int exit_code, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (fmt && *fmt) {
+        va_start(ap, fmt);
+        vprintf(fmt, ap);
+        printf("\n");
+        va_end(ap);
+    }
+
+    printf("usage: %s [options]\n\n"
+           "The possible options are:\n"
+           "  -t, --log-target=TARGET        log target to use\n"
+           "      TARGET is one of stderr,stdout,syslog, or a logfile path\n"
+           "  -l, --log-level=LEVELS         logging level to use\n"
+           "      LEVELS is a comma separated list of info, error and warning\n"
+           "  -v, --verbose                  increase logging verbosity\n"
+           "  -d, --debug                    enable debug messages\n"
+           "  -n, --iterations=N             number of benchmark iterations\n"
+           "  -h, --help                     show help on usage\n",
+           argv0);
+
+    if (exit_code < 0)
+        return;
+    else
+        exit(exit_code);
+}
+
+
+static void config_set_defaults(void)
+{
+    mrp_clear(&ctx);
+    ctx.log_mask   = MRP_LOG_UPTO(MRP_LOG_INFO);
+    ctx.log_target = MRP_LOG_TO_STDOUT;
+    ctx.iterations = 100000;
+}
+
+
+void parse_cmdline(int argc, char **argv)
+{
+#   define OPTIONS "l:t:vd:n:h"
+    struct option options[] = {
+        { "log-level" , required_argument, NULL, 'l' },
+        { "log-target", required_argument, NULL, 't' },
+        { "verbose"   , optional_argument, NULL, 'v' },
+        { "debug"     , required_argument, NULL, 'd' },
+        { "iterations", required_argument, NULL, 'n' },
+        { "help"      , no_argument      , NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int opt;
+
+    config_set_defaults();
+
+    while ((opt = getopt_long(argc, argv, OPTIONS, options, NULL)) != -1) {
+        switch (opt) {
+        case 'v':
+            ctx.log_mask <<= 1;
+            ctx.log_mask  |= 1;
+            break;
+
+        case 'l':
+            ctx.log_mask = mrp_log_parse_levels(optarg);
+            if (ctx.log_mask < 0)
+                print_usage(argv[0], EINVAL, "invalid log level '%s'", optarg);
+            break;
+
+        case 't':
+            ctx.log_target = mrp_log_parse_target(optarg);
+            if (!ctx.log_target)
+                print_usage(argv[0], EINVAL, "invalid log target '%s'", optarg);
+            break;
+
+        case 'd':
+            ctx.log_mask |= MRP_LOG_MASK_DEBUG;
+            mrp_debug_set_config(optarg);
+            mrp_debug_enable(TRUE);
+            break;
+
+        case 'n':
+            ctx.iterations = (int)strtol(optarg, NULL, 10);
+            if (ctx.iterations <= 0)
+                print_usage(argv[0], EINVAL, "invalid iterations '%s'",
+                            optarg);
+            break;
+
+        case 'h':
+            print_usage(argv[0], -1, "");
+            exit(0);
+            break;
+
+        case '?':
+            if (opterr)
+                print_usage(argv[0], EINVAL, "");
+            break;
+
+        default:
+            print_usage(argv[0], EINVAL, "invalid option '%c'", opt);
+        }
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    parse_cmdline(argc, argv);
+
+    mrp_log_set_mask(ctx.log_mask);
+    mrp_log_set_target(ctx.log_target);
+
+    test_roundtrip();
+    test_invalid();
+
+    bench_parse();
+    bench_write();
+
+    return 0;
+}
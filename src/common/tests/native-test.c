@@ -1,12 +1,15 @@
 #include <stdlib.h>
 #include <unistd.h>
+#include <string.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <time.h>
 
 #include <murphy/common/macros.h>
 #include <murphy/common/debug.h>
 #include <murphy/common/log.h>
+#include <murphy/common/mm.h>
 #include <murphy/common/native-types.h>
 
 
@@ -202,6 +205,66 @@ person_t tom_dick_and_harry[] = {
 family_t family = { &pap, &mom, &tom_dick_and_harry[0] };
 
 
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+
+static void benchmark(const char *name, uint32_t type_id, mrp_typemap_t *map,
+                      mrp_native_encoding_t encoding, int n)
+{
+    void     *ebuf, *p, *dbuf;
+    size_t    esize, size, total;
+    uint32_t  id;
+    double    start, enc, dec;
+    int       i;
+
+    total = 0;
+    start = now();
+    for (i = 0; i < n; i++) {
+        if (mrp_encode_native_as(&family, type_id, 0, &ebuf, &esize, map,
+                                 encoding) < 0) {
+            mrp_log_error("Failed to encode test data.");
+            exit(1);
+        }
+        total += esize;
+        mrp_free(ebuf);
+    }
+    enc = now() - start;
+
+    if (mrp_encode_native_as(&family, type_id, 0, &ebuf, &esize, map,
+                             encoding) < 0)
+        exit(1);
+
+    start = now();
+    for (i = 0; i < n; i++) {
+        p    = ebuf;
+        size = esize;
+        dbuf = NULL;
+        id   = type_id;
+
+        if (mrp_decode_native(&p, &size, &dbuf, &id, map) < 0) {
+            mrp_log_error("Failed to decode test data.");
+            exit(1);
+        }
+        mrp_free_native(dbuf, id);
+    }
+    dec = now() - start;
+
+    mrp_free(ebuf);
+
+    mrp_log_info("%s: %d x %zu bytes, encode %.0f/s (%.2f MB/s), "
+                 "decode %.0f/s (%.2f MB/s)", name, n, esize,
+                 n / enc, total / enc / (1024 * 1024),
+                 n / dec, (double)esize * n / dec / (1024 * 1024));
+}
+
+
 int main(int argc, char *argv[])
 {
     MRP_NATIVE_TYPE(art_type, art_t,
@@ -233,15 +296,12 @@ int main(int argc, char *argv[])
     mrp_typemap_t map[4];
 
     uint32_t  art_type_id, person_type_id, family_type_id;
-    void     *ebuf;
-    size_t    esize;
+    void     *ebuf, *cbuf;
+    size_t    esize, csize;
     int       fd;
     void     *dbuf;
     family_t *decoded;
-    char      dump[16 * 1024];
-
-    MRP_UNUSED(argc);
-    MRP_UNUSED(argv);
+    char      dump[16 * 1024], cdump[16 * 1024];
 
     mrp_log_set_mask(MRP_LOG_UPTO(MRP_LOG_INFO));
 
@@ -303,5 +363,42 @@ int main(int argc, char *argv[])
 
     mrp_free_native(dbuf, family_type_id);
 
+    if (mrp_encode_native_as(&family, family_type_id, 0, &cbuf, &csize, map,
+                             MRP_NATIVE_ENCODING_COMPACT) < 0) {
+        mrp_log_error("Failed to encode test data compactly.");
+        exit(1);
+    }
+    else
+        mrp_log_info("Test data successfully encoded compactly (%zd bytes).",
+                     csize);
+
+    dbuf = NULL;
+    if (mrp_decode_native(&cbuf, &csize, &dbuf, &family_type_id, map) < 0 ||
+        csize != 0) {
+        mrp_log_error("Failed to decode compact test data.");
+        exit(1);
+    }
+    else
+        mrp_log_info("Compact test data sucessfully decoded.");
+
+    if (mrp_print_native(cdump, sizeof(cdump), dbuf, family_type_id) < 0 ||
+        strcmp(dump, cdump)) {
+        mrp_log_error("Compact and fixed encodings decode differently.");
+        exit(1);
+    }
+    else
+        mrp_log_info("Compact and fixed encodings decode identically.");
+
+    mrp_free_native(dbuf, family_type_id);
+
+    if (argc > 1) {
+        int n = (int)strtol(argv[1], NULL, 10);
+
+        benchmark("fixed", family_type_id, map,
+                  MRP_NATIVE_ENCODING_FIXED, n);
+        benchmark("compact", family_type_id, map,
+                  MRP_NATIVE_ENCODING_COMPACT, n);
+    }
+
     return 0;
 }
@@ -150,6 +150,8 @@ typedef struct {
     int              buggy;
     int              connect;
     int              stream;
+    int              batch;
+    int              compact;
     int              log_mask;
     const char      *log_target;
     uint32_t         seqno;
@@ -693,15 +695,37 @@ void send_native(context_t *c)
 void send_cb(mrp_timer_t *t, void *user_data)
 {
     context_t *c = (context_t *)user_data;
+    int        i, n;
 
     MRP_UNUSED(t);
 
-    switch (c->mode) {
-    case MODE_DATA:    send_data(c);   break;
-    case MODE_RAW:     send_raw(c);    break;
-    case MODE_NATIVE:  send_native(c); break;
-    default:
-    case MODE_MESSAGE: send_msg(c);
+    if (c->batch > 0) {
+        if (!mrp_transport_begin_batch(c->t)) {
+            mrp_log_error("Failed to start message batch.");
+            exit(1);
+        }
+        n = c->batch;
+    }
+    else
+        n = 1;
+
+    for (i = 0; i < n; i++) {
+        switch (c->mode) {
+        case MODE_DATA:    send_data(c);   break;
+        case MODE_RAW:     send_raw(c);    break;
+        case MODE_NATIVE:  send_native(c); break;
+        default:
+        case MODE_MESSAGE: send_msg(c);
+        }
+    }
+
+    if (c->batch > 0) {
+        if (!mrp_transport_end_batch(c->t)) {
+            mrp_log_error("Failed to send message batch.");
+            exit(1);
+        }
+        else
+            mrp_log_info("Batch of %d messages succesfully sent.", n);
     }
 }
 
@@ -749,6 +773,14 @@ void client_init(context_t *c)
         exit(1);
     }
 
+    if (c->compact) {
+        if (!mrp_transport_setopt(c->t, MRP_TRANSPORT_OPT_COMPACT,
+                                  &c->compact)) {
+            mrp_log_error("Failed to enable compact encoding.");
+            exit(1);
+        }
+    }
+
     if (!strcmp(c->atype, "unxd")) {
         char           addrstr[] = "unxd:@stream-test-client";
         mrp_sockaddr_t addr;
@@ -804,6 +836,8 @@ static void print_usage(const char *argv0, int exit_code, const char *fmt, ...)
            "  -r, --raw                      use raw messages\n"
            "  -n, --native                   use native messages\n"
            "  -b, --buggy                    use buggy data descriptors\n"
+           "  -B, --batch=N                  send messages in batches of N\n"
+           "  -z, --compact                  use compact native encoding\n"
            "  -t, --log-target=TARGET        log target to use\n"
            "      TARGET is one of stderr,stdout,syslog, or a logfile path\n"
            "  -l, --log-level=LEVELS         logging level to use\n"
@@ -832,7 +866,7 @@ static void config_set_defaults(context_t *ctx)
 
 int parse_cmdline(context_t *ctx, int argc, char **argv)
 {
-#   define OPTIONS "scmrnbCa:l:t:v:d:h"
+#   define OPTIONS "scmrnbB:zCa:l:t:v:d:h"
     struct option options[] = {
         { "server"    , no_argument      , NULL, 's' },
         { "address"   , required_argument, NULL, 'a' },
@@ -843,6 +877,8 @@ int parse_cmdline(context_t *ctx, int argc, char **argv)
         { "connect"   , no_argument      , NULL, 'C' },
 
         { "buggy"     , no_argument      , NULL, 'b' },
+        { "batch"     , required_argument, NULL, 'B' },
+        { "compact"   , no_argument      , NULL, 'z' },
         { "log-level" , required_argument, NULL, 'l' },
         { "log-target", required_argument, NULL, 't' },
         { "verbose"   , optional_argument, NULL, 'v' },
@@ -901,6 +937,14 @@ int parse_cmdline(context_t *ctx, int argc, char **argv)
             ctx->buggy = TRUE;
             break;
 
+        case 'B':
+            ctx->batch = (int)strtoul(optarg, NULL, 10);
+            break;
+
+        case 'z':
+            ctx->compact = TRUE;
+            break;
+
         case 'C':
             ctx->connect = TRUE;
             break;
@@ -37,6 +37,7 @@
 
 #define TLV_MIN_PREALLOC 4096
 #define TLV_MIN_CHUNK      64
+#define TLV_MAX_VARINT     10            /* max. size of a 64-bit varint */
 
 int mrp_tlv_setup_write(mrp_tlv_t *tlv, size_t prealloc)
 {
@@ -46,9 +47,10 @@ int mrp_tlv_setup_write(mrp_tlv_t *tlv, size_t prealloc)
     if ((tlv->buf = mrp_allocz(prealloc)) == NULL)
         return -1;
 
-    tlv->size  = prealloc;
-    tlv->p     = tlv->buf;
-    tlv->write = 1;
+    tlv->size    = prealloc;
+    tlv->p       = tlv->buf;
+    tlv->write   = 1;
+    tlv->compact = 0;
 
     return 0;
 }
@@ -133,14 +135,21 @@ void *mrp_tlv_reserve(mrp_tlv_t *tlv, size_t size, int align)
 
 int mrp_tlv_setup_read(mrp_tlv_t *tlv, void *buf, size_t size)
 {
-    tlv->buf   = tlv->p = buf;
-    tlv->size  = size;
-    tlv->write = 0;
+    tlv->buf     = tlv->p = buf;
+    tlv->size    = size;
+    tlv->write   = 0;
+    tlv->compact = 0;
 
     return 0;
 }
 
 
+void mrp_tlv_set_compact(mrp_tlv_t *tlv, bool compact)
+{
+    tlv->compact = compact ? 1 : 0;
+}
+
+
 static void *tlv_consume(mrp_tlv_t *tlv, size_t size)
 {
     char *p;
@@ -206,10 +215,75 @@ void mrp_tlv_steal(mrp_tlv_t *tlv, void **bufp, size_t *sizep)
 }
 
 
+static inline uint64_t zigzag_encode(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+
+static inline int64_t zigzag_decode(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 0x1);
+}
+
+
+static int push_varint(mrp_tlv_t *tlv, uint64_t v)
+{
+    uint8_t *p;
+    int      n;
+
+    if ((p = mrp_tlv_reserve(tlv, TLV_MAX_VARINT, 1)) == NULL)
+        return -1;
+
+    n = 0;
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+
+    tlv->p -= TLV_MAX_VARINT - n;
+
+    return 0;
+}
+
+
+static int pull_varint(mrp_tlv_t *tlv, uint64_t *vp)
+{
+    uint8_t  *p;
+    uint64_t  v;
+    size_t    n, max;
+    int       shift;
+
+    p   = tlv->p;
+    max = tlv_data(tlv);
+
+    if (max > TLV_MAX_VARINT)
+        max = TLV_MAX_VARINT;
+
+    for (n = 0, v = 0, shift = 0; n < max; n++, shift += 7) {
+        v |= (uint64_t)(p[n] & 0x7f) << shift;
+
+        if (!(p[n] & 0x80)) {
+            tlv->p += n + 1;
+            *vp     = v;
+
+            return 0;
+        }
+    }
+
+    errno = EILSEQ;
+    return -1;
+}
+
+
 static inline int push_tag(mrp_tlv_t *tlv, uint32_t tag)
 {
     uint32_t *tagp;
 
+    if (tag && tlv->compact)
+        return push_varint(tlv, tag);
+
     if (tag) {
         if ((tagp = mrp_tlv_reserve(tlv, sizeof(*tagp), 1)) == NULL)
             return -1;
@@ -262,6 +336,9 @@ int mrp_tlv_push_int16(mrp_tlv_t *tlv, uint32_t tag, int16_t v)
     if (push_tag(tlv, tag) < 0)
         return -1;
 
+    if (tlv->compact)
+        return push_varint(tlv, zigzag_encode(v));
+
     if ((p = mrp_tlv_reserve(tlv, sizeof(*p), 1)) != NULL) {
         *p = htobe16(v);
 
@@ -279,6 +356,9 @@ int mrp_tlv_push_uint16(mrp_tlv_t *tlv, uint32_t tag, uint16_t v)
     if (push_tag(tlv, tag) < 0)
         return -1;
 
+    if (tlv->compact)
+        return push_varint(tlv, v);
+
     if ((p = mrp_tlv_reserve(tlv, sizeof(*p), 1)) != NULL) {
         *p = htobe16(v);
 
@@ -296,6 +376,9 @@ int mrp_tlv_push_int32(mrp_tlv_t *tlv, uint32_t tag, int32_t v)
     if (push_tag(tlv, tag) < 0)
         return -1;
 
+    if (tlv->compact)
+        return push_varint(tlv, zigzag_encode(v));
+
     if ((p = mrp_tlv_reserve(tlv, sizeof(*p), 1)) != NULL) {
         *p = htobe32(v);
 
@@ -313,6 +396,9 @@ int mrp_tlv_push_uint32(mrp_tlv_t *tlv, uint32_t tag, uint32_t v)
     if (push_tag(tlv, tag) < 0)
         return -1;
 
+    if (tlv->compact)
+        return push_varint(tlv, v);
+
     if ((p = mrp_tlv_reserve(tlv, sizeof(*p), 1)) != NULL) {
         *p = htobe32(v);
 
@@ -330,6 +416,9 @@ int mrp_tlv_push_int64(mrp_tlv_t *tlv, uint32_t tag, int64_t v)
     if (push_tag(tlv, tag) < 0)
         return -1;
 
+    if (tlv->compact)
+        return push_varint(tlv, zigzag_encode(v));
+
     if ((p = mrp_tlv_reserve(tlv, sizeof(*p), 1)) != NULL) {
         *p = htobe64(v);
 
@@ -347,6 +436,9 @@ int mrp_tlv_push_uint64(mrp_tlv_t *tlv, uint32_t tag, uint64_t v)
     if (push_tag(tlv, tag) < 0)
         return -1;
 
+    if (tlv->compact)
+        return push_varint(tlv, v);
+
     if ((p = mrp_tlv_reserve(tlv, sizeof(*p), 1)) != NULL) {
         *p = htobe64(v);
 
@@ -417,10 +509,16 @@ int mrp_tlv_push_string(mrp_tlv_t *tlv, uint32_t tag, const char *str)
     if (push_tag(tlv, tag) < 0)
         return -1;
 
-    if ((sizep = mrp_tlv_reserve(tlv, sizeof(*sizep), 1)) == NULL)
-        return -1;
+    if (tlv->compact) {
+        if (push_varint(tlv, len) < 0)
+            return -1;
+    }
+    else {
+        if ((sizep = mrp_tlv_reserve(tlv, sizeof(*sizep), 1)) == NULL)
+            return -1;
 
-    *sizep = htobe32((uint32_t)len);
+        *sizep = htobe32((uint32_t)len);
+    }
 
     if (len > 0) {
         if ((strp = mrp_tlv_reserve(tlv, len, 1)) == NULL)
@@ -436,6 +534,14 @@ int mrp_tlv_push_string(mrp_tlv_t *tlv, uint32_t tag, const char *str)
 int pull_tag(mrp_tlv_t *tlv, uint32_t tag)
 {
     uint32_t *tagp;
+    uint64_t  v;
+
+    if (tag && tlv->compact) {
+        if (pull_varint(tlv, &v) < 0)
+            return -1;
+
+        return v == tag ? 0 : -1;
+    }
 
     if (tag) {
         if ((tagp = tlv_consume(tlv, sizeof(*tagp))) == NULL)
@@ -483,11 +589,29 @@ int mrp_tlv_pull_uint8(mrp_tlv_t *tlv, uint32_t tag, uint8_t *v)
 
 int mrp_tlv_pull_int16(mrp_tlv_t *tlv, uint32_t tag, int16_t *v)
 {
-    int16_t *p;
+    int16_t  *p;
+    uint64_t  u;
+    int64_t   s;
 
     if (pull_tag(tlv, tag) < 0)
         return -1;
 
+    if (tlv->compact) {
+        if (pull_varint(tlv, &u) < 0)
+            return -1;
+
+        s = zigzag_decode(u);
+
+        if (s < INT16_MIN || s > INT16_MAX) {
+            errno = ERANGE;
+            return -1;
+        }
+
+        *v = (int16_t)s;
+
+        return 0;
+    }
+
     if ((p = tlv_consume(tlv, sizeof(*p))) == NULL)
         return -1;
 
@@ -500,10 +624,25 @@ int mrp_tlv_pull_int16(mrp_tlv_t *tlv, uint32_t tag, int16_t *v)
 int mrp_tlv_pull_uint16(mrp_tlv_t *tlv, uint32_t tag, uint16_t *v)
 {
     uint16_t *p;
+    uint64_t  u;
 
     if (pull_tag(tlv, tag) < 0)
         return -1;
 
+    if (tlv->compact) {
+        if (pull_varint(tlv, &u) < 0)
+            return -1;
+
+        if (u > UINT16_MAX) {
+            errno = ERANGE;
+            return -1;
+        }
+
+        *v = (uint16_t)u;
+
+        return 0;
+    }
+
     if ((p = tlv_consume(tlv, sizeof(*p))) == NULL)
         return -1;
 
@@ -515,11 +654,29 @@ int mrp_tlv_pull_uint16(mrp_tlv_t *tlv, uint32_t tag, uint16_t *v)
 
 int mrp_tlv_pull_int32(mrp_tlv_t *tlv, uint32_t tag, int32_t *v)
 {
-    int32_t *p;
+    int32_t  *p;
+    uint64_t  u;
+    int64_t   s;
 
     if (pull_tag(tlv, tag) < 0)
         return -1;
 
+    if (tlv->compact) {
+        if (pull_varint(tlv, &u) < 0)
+            return -1;
+
+        s = zigzag_decode(u);
+
+        if (s < INT32_MIN || s > INT32_MAX) {
+            errno = ERANGE;
+            return -1;
+        }
+
+        *v = (int32_t)s;
+
+        return 0;
+    }
+
     if ((p = tlv_consume(tlv, sizeof(*p))) == NULL)
         return -1;
 
@@ -532,10 +689,25 @@ int mrp_tlv_pull_int32(mrp_tlv_t *tlv, uint32_t tag, int32_t *v)
 int mrp_tlv_pull_uint32(mrp_tlv_t *tlv, uint32_t tag, uint32_t *v)
 {
     uint32_t *p;
+    uint64_t  u;
 
     if (pull_tag(tlv, tag) < 0)
         return -1;
 
+    if (tlv->compact) {
+        if (pull_varint(tlv, &u) < 0)
+            return -1;
+
+        if (u > UINT32_MAX) {
+            errno = ERANGE;
+            return -1;
+        }
+
+        *v = (uint32_t)u;
+
+        return 0;
+    }
+
     if ((p = tlv_consume(tlv, sizeof(*p))) == NULL)
         return -1;
 
@@ -548,10 +720,20 @@ int mrp_tlv_pull_uint32(mrp_tlv_t *tlv, uint32_t tag, uint32_t *v)
 int mrp_tlv_pull_int64(mrp_tlv_t *tlv, uint32_t tag, int64_t *v)
 {
     int64_t *p;
+    uint64_t  u;
 
     if (pull_tag(tlv, tag) < 0)
         return -1;
 
+    if (tlv->compact) {
+        if (pull_varint(tlv, &u) < 0)
+            return -1;
+
+        *v = zigzag_decode(u);
+
+        return 0;
+    }
+
     if ((p = tlv_consume(tlv, sizeof(*p))) == NULL)
         return -1;
 
@@ -568,6 +750,9 @@ int mrp_tlv_pull_uint64(mrp_tlv_t *tlv, uint32_t tag, uint64_t *v)
     if (pull_tag(tlv, tag) < 0)
         return -1;
 
+    if (tlv->compact)
+        return pull_varint(tlv, v);
+
     if ((p = tlv_consume(tlv, sizeof(*p))) == NULL)
         return -1;
 
@@ -629,15 +814,29 @@ int mrp_tlv_pull_string(mrp_tlv_t *tlv, uint32_t tag, char **v, size_t max,
                         void *(alloc)(size_t, void *), void *alloc_data)
 {
     uint32_t *sizep, size;
+    uint64_t  len;
     char     *str;
 
     if (pull_tag(tlv, tag) < 0)
         return -1;
 
-    if ((sizep = tlv_consume(tlv, sizeof(*sizep))) == NULL)
-        return -1;
+    if (tlv->compact) {
+        if (pull_varint(tlv, &len) < 0)
+            return -1;
 
-    size = be32toh(*sizep);
+        if (len > UINT32_MAX) {
+            errno = EOVERFLOW;
+            return -1;
+        }
+
+        size = (uint32_t)len;
+    }
+    else {
+        if ((sizep = tlv_consume(tlv, sizeof(*sizep))) == NULL)
+            return -1;
+
+        size = be32toh(*sizep);
+    }
 
     if (max != (size_t)-1 && max < size) {
         errno = EOVERFLOW;
@@ -48,14 +48,27 @@ typedef struct {
     size_t  size;                        /* allocated buffer size */
     void   *p;                           /* encoding/decoding pointer */
     int     write : 1;                   /* whether set up for writing */
+    int     compact : 1;                 /* whether using compact encoding */
 } mrp_tlv_t;
 
+/*
+ * By default tags, integers and string lengths are encoded with their
+ * full fixed width in network byte order. In compact mode tags, lengths
+ * and integers wider than 8 bits are encoded as LEB128 varints instead,
+ * with signed integers zigzag-mapped first so that small negative values
+ * stay short. The encoding mode is not recorded in the buffer, so the
+ * reader needs to be set to the same mode as the writer was.
+ */
+
 /** Set up the given TLV buffer for encoding. */
 int mrp_tlv_setup_write(mrp_tlv_t *tlv, size_t prealloc);
 
 /** Set up the given TLV buffer for decoding. */
 int mrp_tlv_setup_read(mrp_tlv_t *tlv, void *buf, size_t size);
 
+/** Switch the given TLV buffer to/from compact encoding. */
+void mrp_tlv_set_compact(mrp_tlv_t *tlv, bool compact);
+
 /** Clean up the given TLV buffer. */
 void mrp_tlv_cleanup(mrp_tlv_t *tlv);
 
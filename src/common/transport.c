@@ -39,7 +39,11 @@
 static int check_destroy(mrp_transport_t *t);
 static int recv_data(mrp_transport_t *t, void *data, size_t size,
                      mrp_sockaddr_t *addr, socklen_t addrlen);
+static int recv_frame(mrp_transport_t *t, void *data, size_t size,
+                      mrp_sockaddr_t *addr, socklen_t addrlen);
 static inline int purge_destroyed(mrp_transport_t *t);
+static int flush_batch(mrp_transport_t *t);
+static void free_batch(mrp_transport_t *t);
 
 
 static MRP_LIST_HOOK(transports);
@@ -233,6 +237,11 @@ mrp_transport_t *mrp_transport_create_from(mrp_mainloop_t *ml, const char *type,
 int mrp_transport_setopt(mrp_transport_t *t, const char *opt, const void *val)
 {
     if (t != NULL) {
+        if (!strcmp(opt, MRP_TRANSPORT_OPT_COMPACT)) {
+            t->compact = (val != NULL && *(const int *)val);
+            return TRUE;
+        }
+
         if (t->descr->req.setopt != NULL)
             return t->descr->req.setopt(t, opt, val);
         else {
@@ -334,6 +343,7 @@ mrp_transport_t *mrp_transport_accept(mrp_transport_t *lt,
         t->flags         = t->flags & ~MRP_TRANSPORT_MODE_MASK;
         t->mode          = lt->mode;
         t->map           = lt->map;
+        t->compact       = lt->compact;
 
         MRP_TRANSPORT_BUSY(t, {
                 if (!t->descr->req.accept(t, lt)) {
@@ -358,6 +368,7 @@ static inline int purge_destroyed(mrp_transport_t *t)
 {
     if (t->destroyed && !t->busy) {
         mrp_debug("destroying transport %p...", t);
+        free_batch(t);
         mrp_free(t);
         return TRUE;
     }
@@ -372,6 +383,7 @@ void mrp_transport_destroy(mrp_transport_t *t)
         t->destroyed = TRUE;
 
         MRP_TRANSPORT_BUSY(t, {
+                flush_batch(t);
                 t->descr->req.disconnect(t);
                 t->descr->req.close(t);
             });
@@ -426,6 +438,7 @@ int mrp_transport_disconnect(mrp_transport_t *t)
 
     if (t != NULL && t->connected) {
         MRP_TRANSPORT_BUSY(t, {
+                flush_batch(t);
                 if (t->descr->req.disconnect(t)) {
                     t->connected = FALSE;
                     result       = TRUE;
@@ -443,13 +456,249 @@ int mrp_transport_disconnect(mrp_transport_t *t)
 }
 
 
+/*
+ * message batching
+ */
+
+struct mrp_transport_batch_s {
+    int             depth;               /* begin_batch nesting depth */
+    char           *buf;                 /* batch frame being assembled */
+    size_t          size;                /* allocated buffer size */
+    size_t          used;                /* amount of buffer used */
+    uint16_t        cnt;                 /* number of queued messages */
+    mrp_sockaddr_t  addr;                /* destination, if unconnected */
+    socklen_t       alen;                /* destination address length */
+};
+
+#define BATCH_HDR_SIZE (sizeof(uint32_t) + 2 * sizeof(uint16_t))
+
+
+static inline int batching(mrp_transport_t *t)
+{
+    return t->batch != NULL && t->batch->depth > 0;
+}
+
+
+int mrp_transport_begin_batch(mrp_transport_t *t)
+{
+    mrp_transport_batch_t *b;
+
+    if (!t->batchable) {
+        errno = EOPNOTSUPP;
+        return FALSE;
+    }
+
+    switch (t->mode) {
+    case MRP_TRANSPORT_MODE_MSG:
+    case MRP_TRANSPORT_MODE_DATA:
+    case MRP_TRANSPORT_MODE_NATIVE:
+        break;
+    default:
+        errno = EOPNOTSUPP;
+        return FALSE;
+    }
+
+    if ((b = t->batch) == NULL) {
+        if ((b = mrp_allocz(sizeof(*b))) == NULL)
+            return FALSE;
+
+        b->used  = BATCH_HDR_SIZE;
+        t->batch = b;
+    }
+
+    b->depth++;
+
+    return TRUE;
+}
+
+
+int mrp_transport_end_batch(mrp_transport_t *t)
+{
+    mrp_transport_batch_t *b = t->batch;
+    int                    result;
+
+    if (b == NULL || b->depth <= 0) {
+        errno = EINVAL;
+        return FALSE;
+    }
+
+    if (--b->depth > 0)
+        return TRUE;
+
+    MRP_TRANSPORT_BUSY(t, {
+            result = flush_batch(t);
+        });
+
+    purge_destroyed(t);
+
+    return result;
+}
+
+
+static void free_batch(mrp_transport_t *t)
+{
+    if (t->batch != NULL) {
+        if (t->batch->cnt > 0)
+            mrp_debug("discarding %u batched messages of transport %p",
+                      t->batch->cnt, t);
+
+        mrp_free(t->batch->buf);
+        mrp_free(t->batch);
+        t->batch = NULL;
+    }
+}
+
+
+static int flush_batch(mrp_transport_t *t)
+{
+    mrp_transport_batch_t *b = t->batch;
+    uint32_t              *lenp;
+    uint16_t              *hdrp;
+    int                    result;
+
+    if (b == NULL || b->cnt == 0)
+        return TRUE;
+
+    lenp    = (uint32_t *)b->buf;
+    hdrp    = (uint16_t *)(lenp + 1);
+    *lenp   = htobe32(b->used - sizeof(*lenp));
+    hdrp[0] = htobe16(MRP_MSG_TAG_BATCH);
+    hdrp[1] = htobe16(b->cnt);
+
+    mrp_debug("flushing %u batched messages (%zu bytes) of transport %p",
+              b->cnt, b->used, t);
+
+    if (b->alen == 0)
+        result = t->descr->req.sendraw(t, b->buf, b->used);
+    else
+        result = t->descr->req.sendrawto(t, b->buf, b->used,
+                                         &b->addr, b->alen);
+
+    b->used = BATCH_HDR_SIZE;
+    b->cnt  = 0;
+    b->alen = 0;
+
+    return result;
+}
+
+
+static int batch_queue(mrp_transport_t *t, void *data, size_t size,
+                       mrp_sockaddr_t *addr, socklen_t addrlen)
+{
+    mrp_transport_batch_t *b = t->batch;
+    size_t                 need, nsize;
+    uint32_t               len;
+
+    if (b->cnt > 0) {
+        if (b->alen != addrlen ||
+            (addrlen > 0 && memcmp(&b->addr, addr, addrlen)))
+            if (!flush_batch(t))
+                return FALSE;
+    }
+
+    need = sizeof(len) + MRP_ALIGN(size, sizeof(len));
+
+    if (b->cnt > 0) {
+        if (b->used + need > MRP_TRANSPORT_BATCH_MAX || b->cnt == 0xffff)
+            if (!flush_batch(t))
+                return FALSE;
+    }
+
+    if (b->used + need > b->size) {
+        nsize = MRP_MAX(2 * b->size, b->used + need);
+
+        if (mrp_realloc(b->buf, nsize) == NULL)
+            return FALSE;
+
+        b->size = nsize;
+    }
+
+    len = htobe32(size);
+    memcpy(b->buf + b->used, &len, sizeof(len));
+    memcpy(b->buf + b->used + sizeof(len), data, size);
+    memset(b->buf + b->used + sizeof(len) + size, 0,
+           need - sizeof(len) - size);
+
+    b->used += need;
+    b->cnt++;
+
+    if (addrlen > 0 && b->cnt == 1) {
+        mrp_sockaddr_cpy(&b->addr, addr, addrlen);
+        b->alen = addrlen;
+    }
+
+    return TRUE;
+}
+
+
+static int batch_msg(mrp_transport_t *t, mrp_msg_t *msg,
+                     mrp_sockaddr_t *addr, socklen_t addrlen)
+{
+    void    *buf;
+    ssize_t  size;
+    int      result;
+
+    if ((size = mrp_msg_default_encode(msg, &buf)) < 0)
+        return FALSE;
+
+    result = batch_queue(t, buf, size, addr, addrlen);
+    mrp_free(buf);
+
+    return result;
+}
+
+
+static int batch_data(mrp_transport_t *t, void *data, uint16_t tag,
+                      mrp_sockaddr_t *addr, socklen_t addrlen)
+{
+    mrp_data_descr_t *type;
+    void             *buf;
+    size_t            size;
+    int               result;
+
+    if ((type = mrp_msg_find_type(tag)) == NULL)
+        return FALSE;
+
+    if ((size = mrp_data_encode(&buf, data, type, sizeof(tag))) == 0)
+        return FALSE;
+
+    *(uint16_t *)buf = htobe16(tag);
+
+    result = batch_queue(t, buf, size, addr, addrlen);
+    mrp_free(buf);
+
+    return result;
+}
+
+
+static int batch_native(mrp_transport_t *t, void *data, uint32_t type_id,
+                        mrp_sockaddr_t *addr, socklen_t addrlen)
+{
+    void   *buf;
+    size_t  size;
+    int     result;
+
+    if (mrp_encode_native_as(data, type_id, 0, &buf, &size, t->map,
+                             MRP_TRANSPORT_ENCODING(t)) < 0)
+        return FALSE;
+
+    result = batch_queue(t, buf, size, addr, addrlen);
+    mrp_free(buf);
+
+    return result;
+}
+
+
 int mrp_transport_send(mrp_transport_t *t, mrp_msg_t *msg)
 {
     int result;
 
     if (t->connected && t->descr->req.sendmsg) {
         MRP_TRANSPORT_BUSY(t, {
-                result = t->descr->req.sendmsg(t, msg);
+                if (batching(t))
+                    result = batch_msg(t, msg, NULL, 0);
+                else
+                    result = t->descr->req.sendmsg(t, msg);
             });
 
         purge_destroyed(t);
@@ -468,7 +717,10 @@ int mrp_transport_sendto(mrp_transport_t *t, mrp_msg_t *msg,
 
     if (t->descr->req.sendmsgto) {
         MRP_TRANSPORT_BUSY(t, {
-                result = t->descr->req.sendmsgto(t, msg, addr, addrlen);
+                if (batching(t))
+                    result = batch_msg(t, msg, addr, addrlen);
+                else
+                    result = t->descr->req.sendmsgto(t, msg, addr, addrlen);
             });
 
         purge_destroyed(t);
@@ -525,7 +777,10 @@ int mrp_transport_senddata(mrp_transport_t *t, void *data, uint16_t tag)
     if (t->connected &&
         t->mode == MRP_TRANSPORT_MODE_DATA && t->descr->req.senddata) {
         MRP_TRANSPORT_BUSY(t, {
-                result = t->descr->req.senddata(t, data, tag);
+                if (batching(t))
+                    result = batch_data(t, data, tag, NULL, 0);
+                else
+                    result = t->descr->req.senddata(t, data, tag);
             });
 
         purge_destroyed(t);
@@ -544,7 +799,11 @@ int mrp_transport_senddatato(mrp_transport_t *t, void *data, uint16_t tag,
 
     if (t->mode == MRP_TRANSPORT_MODE_DATA && t->descr->req.senddatato) {
         MRP_TRANSPORT_BUSY(t, {
-                result = t->descr->req.senddatato(t, data, tag, addr, addrlen);
+                if (batching(t))
+                    result = batch_data(t, data, tag, addr, addrlen);
+                else
+                    result = t->descr->req.senddatato(t, data, tag,
+                                                      addr, addrlen);
             });
 
         purge_destroyed(t);
@@ -599,7 +858,10 @@ int mrp_transport_sendnative(mrp_transport_t *t, void *data, uint32_t type_id)
 
     if (t->mode == MRP_TRANSPORT_MODE_NATIVE && t->descr->req.sendnative) {
         MRP_TRANSPORT_BUSY(t, {
-                result = t->descr->req.sendnative(t, data, type_id);
+                if (batching(t))
+                    result = batch_native(t, data, type_id, NULL, 0);
+                else
+                    result = t->descr->req.sendnative(t, data, type_id);
             });
 
         purge_destroyed(t);
@@ -618,8 +880,11 @@ int mrp_transport_sendnativeto(mrp_transport_t *t, void *data, uint32_t type_id,
 
     if (t->mode == MRP_TRANSPORT_MODE_NATIVE && t->descr->req.sendnativeto) {
         MRP_TRANSPORT_BUSY(t, {
-                result = t->descr->req.sendnativeto(t, data, type_id,
-                                                    addr, addrlen);
+                if (batching(t))
+                    result = batch_native(t, data, type_id, addr, addrlen);
+                else
+                    result = t->descr->req.sendnativeto(t, data, type_id,
+                                                        addr, addrlen);
             });
 
         purge_destroyed(t);
@@ -631,8 +896,8 @@ int mrp_transport_sendnativeto(mrp_transport_t *t, void *data, uint32_t type_id,
 }
 
 
-static int recv_data(mrp_transport_t *t, void *data, size_t size,
-                     mrp_sockaddr_t *addr, socklen_t addrlen)
+static int recv_frame(mrp_transport_t *t, void *data, size_t size,
+                      mrp_sockaddr_t *addr, socklen_t addrlen)
 {
     mrp_data_descr_t *type;
     uint16_t          tag;
@@ -745,6 +1010,12 @@ static int recv_data(mrp_transport_t *t, void *data, size_t size,
         return -EPROTOTYPE;
 
     case MRP_TRANSPORT_MODE_NATIVE:
+        /* answer a peer using compact encoding in kind */
+        if (t->connected && !t->compact && mrp_native_compact(data, size)) {
+            mrp_debug("switching transport %p to compact encoding", t);
+            t->compact = TRUE;
+        }
+
         type_id = 0;
         if (mrp_decode_native(&data, &size, &decoded, &type_id, t->map) < 0)
             return -EPROTO;
@@ -772,3 +1043,69 @@ static int recv_data(mrp_transport_t *t, void *data, size_t size,
     }
 }
 
+
+static inline int is_batch(mrp_transport_t *t, void *data, size_t size)
+{
+    if (t->mode == MRP_TRANSPORT_MODE_RAW ||
+        t->mode == MRP_TRANSPORT_MODE_CUSTOM)
+        return FALSE;
+
+    if (size < 2 * sizeof(uint16_t))
+        return FALSE;
+
+    return be16toh(*(uint16_t *)data) == MRP_MSG_TAG_BATCH;
+}
+
+
+static int recv_batch(mrp_transport_t *t, void *data, size_t size,
+                      mrp_sockaddr_t *addr, socklen_t addrlen)
+{
+    uint16_t cnt;
+    uint32_t len;
+    size_t   padded;
+    int      connected, error;
+
+    cnt   = be16toh(((uint16_t *)data)[1]);
+    data += 2 * sizeof(uint16_t);
+    size -= 2 * sizeof(uint16_t);
+
+    connected = t->connected;
+
+    while (cnt > 0) {
+        if (size < sizeof(len))
+            return -EPROTO;
+
+        memcpy(&len, data, sizeof(len));
+        len   = be32toh(len);
+        data += sizeof(len);
+        size -= sizeof(len);
+
+        padded = MRP_ALIGN(len, sizeof(len));
+
+        if (padded > size || is_batch(t, data, len))
+            return -EPROTO;
+
+        if ((error = recv_frame(t, data, len, addr, addrlen)) != 0)
+            return error;
+
+        /* stop delivering if the transport got disconnected or destroyed */
+        if (t->destroyed || t->connected != connected)
+            return 0;
+
+        data += padded;
+        size -= padded;
+        cnt--;
+    }
+
+    return size == 0 ? 0 : -EPROTO;
+}
+
+
+static int recv_data(mrp_transport_t *t, void *data, size_t size,
+                     mrp_sockaddr_t *addr, socklen_t addrlen)
+{
+    if (MRP_UNLIKELY(is_batch(t, data, size)))
+        return recv_batch(t, data, size, addr, addrlen);
+    else
+        return recv_frame(t, data, size, addr, addrlen);
+}
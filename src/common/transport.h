@@ -43,6 +43,7 @@
 MRP_CDECL_BEGIN
 
 typedef struct mrp_transport_s mrp_transport_t;
+typedef struct mrp_transport_batch_s mrp_transport_batch_t;
 
 
 
@@ -97,6 +98,46 @@ typedef enum {
 
 #define MRP_TRANSPORT_OPT_TYPEMAP "type-map"
 
+/*
+ * compact native encoding
+ *
+ * Setting this option (to a non-zero int) makes the transport send native
+ * types using the compact varint/zigzag encoding. Native decoding always
+ * accepts both encodings, and a connected transport switches to compact
+ * encoding itself once its peer sends it compact data. Hence it is enough
+ * for the client to turn it on for a connection; the server answers in
+ * kind on that connection only. Listening transports pass the setting on
+ * to the connections they accept.
+ */
+#define MRP_TRANSPORT_OPT_COMPACT "compact-encoding"
+
+
+/*
+ * message batching
+ *
+ * Between mrp_transport_begin_batch and mrp_transport_end_batch messages
+ * sent in message, data or native mode are not written out one by one.
+ * Instead they are encoded and queued up, then sent out as a single frame
+ * carrying all of them when the outermost batch is ended (or when the
+ * queued messages would exceed MRP_TRANSPORT_BATCH_MAX). The receiving
+ * transport unpacks such a batch frame and delivers the messages one by
+ * one, in order, so batching is invisible to the recipient.
+ *
+ * A batch frame is a normal frame with the payload
+ *
+ *     uint16_t tag;         MRP_MSG_TAG_BATCH, in network byte order
+ *     uint16_t cnt;         number of messages, in network byte order
+ *     cnt x {
+ *         uint32_t size;    message size, in network byte order
+ *         uint8_t  msg[];   message, padded to a multiple of 4 bytes
+ *     }
+ *
+ * Batching is only supported by transports that frame messages with a
+ * 32-bit size and send raw data as such (currently stream and datagram).
+ */
+
+#define MRP_TRANSPORT_BATCH_MAX (16 * 1024)
+
 /*
  * transport requests
  *
@@ -247,9 +288,12 @@ typedef struct {
     int                      flags;                                       \
     int                      mode;                                        \
     int                      busy;                                        \
+    mrp_transport_batch_t   *batch;                                       \
     int                      connected : 1;                               \
     int                      listened : 1;                                \
-    int                      destroyed : 1                                \
+    int                      destroyed : 1;                               \
+    int                      batchable : 1;                               \
+    int                      compact : 1                                  \
 
 
 struct mrp_transport_s {
@@ -376,6 +420,11 @@ struct mrp_transport_s {
 
 
 
+/** Native encoding to use for the given transport. */
+#define MRP_TRANSPORT_ENCODING(t)                                  \
+    ((t)->compact ? MRP_NATIVE_ENCODING_COMPACT : MRP_NATIVE_ENCODING_FIXED)
+
+
 /** Automatically register a transport on startup. */
 #define MRP_REGISTER_TRANSPORT(_prfx, _typename, _structtype, _resolve,   \
                                _open, _createfrom, _close, _setopt,       \
@@ -508,6 +557,12 @@ int mrp_transport_sendnative(mrp_transport_t *t, void *data, uint32_t type_id);
 int mrp_transport_sendnativeto(mrp_transport_t *t, void *data, uint32_t type_id,
                                mrp_sockaddr_t *addr, socklen_t addrlen);
 
+/** Start (or nest) a batch of messages to send in a single frame. */
+int mrp_transport_begin_batch(mrp_transport_t *t);
+
+/** End a batch, sending out all queued messages if it is the outermost. */
+int mrp_transport_end_batch(mrp_transport_t *t);
+
 MRP_CDECL_END
 
 #endif /* __MURPHY_TRANSPORT_H__ */
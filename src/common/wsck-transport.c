@@ -72,7 +72,10 @@ typedef struct {
     const char         *ssl_ca;          /* path to SSL CA */
     wsl_ssl_t           ssl;             /* SSL mode (wsl_ssl_t) */
     char               *protocol;        /* websocket protocol name */
-    wsl_proto_t         proto[2];        /* protocol setup */
+    char               *native;          /* native subprotocol name */
+    mrp_wsck_native_t  *native_cfg;      /* native type setup, if any */
+    int                 pending_native;  /* pending client wants native */
+    wsl_proto_t         proto[3];        /* protocol setup */
     mrp_list_hook_t     http_clients;    /* pure HTTP clients */
 } wsck_t;
 
@@ -123,6 +126,23 @@ static int  http_check_cb(wsl_sck_t *sck, void *user_data, void *proto_data);
 static void http_done_cb(wsl_sck_t *sck, const char *uri, void *user_data,
                          void *proto_data);
 
+static char *native_protocol(const char *protocol)
+{
+    char   *name;
+    size_t  len;
+
+    len  = strlen(protocol);
+    name = mrp_allocz(len + sizeof(MRP_WSCK_NATIVE_SUFFIX));
+
+    if (name != NULL) {
+        memcpy(name, protocol, len);
+        strcpy(name + len, MRP_WSCK_NATIVE_SUFFIX);
+    }
+
+    return name;
+}
+
+
 static socklen_t wsck_resolve(const char *str, mrp_sockaddr_t *addr,
                               socklen_t size, const char **typep)
 {
@@ -176,6 +196,8 @@ static void wsck_close(mrp_transport_t *mt)
     t->ctx = NULL;
     mrp_free(t->protocol);
     t->protocol = NULL;
+    mrp_free(t->native);
+    t->native = NULL;
 
     user_data = wsl_close(sck);
 
@@ -219,6 +241,11 @@ static int wsck_setopt(mrp_transport_t *mt, const char *opt, const void *val)
         t->ssl_ca = (const char *)val;
     else if (!strcmp(opt, MRP_WSCK_OPT_SSL))
         t->ssl = *(wsl_ssl_t *)val;
+    else if (!strcmp(opt, MRP_WSCK_OPT_NATIVE))
+        t->native_cfg = (mrp_wsck_native_t *)val;
+    else if (!strcmp(opt, MRP_TRANSPORT_OPT_TYPEMAP) &&
+             t->mode == MRP_TRANSPORT_MODE_NATIVE)
+        t->map = (mrp_typemap_t *)val;
     else
         success = FALSE;
 
@@ -257,6 +284,7 @@ static int wsck_bind(mrp_transport_t *mt, mrp_sockaddr_t *addr,
     wsl_ctx_cfg_t    cfg;
     mrp_wsckaddr_t  *wa;
     struct sockaddr *sa;
+    int              nproto;
 
     if (addr->any.sa_family != MRP_AF_WSCK || addrlen != sizeof(*wa))
         return FALSE;
@@ -277,15 +305,26 @@ static int wsck_bind(mrp_transport_t *mt, mrp_sockaddr_t *addr,
     if ((t->protocol = mrp_strdup(wa->wsck_proto)) == NULL)
         return FALSE;
 
-    t->proto[0] = proto[0];
-    t->proto[1] = proto[1];
+    if ((t->native = native_protocol(t->protocol)) == NULL)
+        return FALSE;
+
+    nproto = 0;
+    t->proto[nproto++] = proto[0];
 
-    t->proto[1].name = t->protocol;
+    if (t->mode != MRP_TRANSPORT_MODE_NATIVE) {
+        t->proto[nproto] = proto[1];
+        t->proto[nproto++].name = t->protocol;
+    }
+
+    if (t->mode == MRP_TRANSPORT_MODE_NATIVE || t->native_cfg != NULL) {
+        t->proto[nproto] = proto[1];
+        t->proto[nproto++].name = t->native;
+    }
 
     mrp_clear(&cfg);
     cfg.addr      = sa;
     cfg.protos    = &t->proto[0];
-    cfg.nproto    = MRP_ARRAY_SIZE(t->proto);
+    cfg.nproto    = nproto;
     cfg.ssl_cert  = t->ssl_cert;
     cfg.ssl_pkey  = t->ssl_pkey;
     cfg.ssl_ca    = t->ssl_ca;
@@ -332,6 +371,21 @@ static int wsck_accept(mrp_transport_t *mt, mrp_transport_t *mlt)
         t->uri_table  = lt->uri_table;
         t->mime_table = lt->mime_table;
 
+        /* switch to native types if the client negotiated binary framing */
+        if (lt->pending_native) {
+            if (lt->mode != MRP_TRANSPORT_MODE_NATIVE) {
+                t->mode           = MRP_TRANSPORT_MODE_NATIVE;
+                t->map            = lt->native_cfg->map;
+                t->evt.recvnative = lt->native_cfg->recv;
+            }
+
+            t->send_mode = WSL_SEND_BINARY;
+            wsl_set_sendmode(t->sck, t->send_mode);
+
+            mrp_debug("websocket connection %p uses binary native framing",
+                      t);
+        }
+
         return TRUE;
     }
     else {
@@ -378,7 +432,16 @@ static int wsck_connect(mrp_transport_t *mt, mrp_sockaddr_t *addr,
     if ((t->protocol = mrp_strdup(wa->wsck_proto)) == NULL)
         return FALSE;
 
-    proto.name  = t->protocol;
+    if (t->mode == MRP_TRANSPORT_MODE_NATIVE) {
+        if ((t->native = native_protocol(t->protocol)) == NULL)
+            return FALSE;
+
+        proto.name   = t->native;
+        t->send_mode = WSL_SEND_BINARY;
+    }
+    else
+        proto.name = t->protocol;
+
     t->proto[0] = proto;
 
     mrp_clear(&cfg);
@@ -397,11 +460,14 @@ static int wsck_connect(mrp_transport_t *mt, mrp_sockaddr_t *addr,
     if (t->ctx == NULL)
         return FALSE;
 
-    t->sck = wsl_connect(t->ctx, sa, t->protocol, t->ssl, t);
+    t->sck = wsl_connect(t->ctx, sa, proto.name, t->ssl, t);
 
     if (t->sck != NULL) {
         t->connected = TRUE;
 
+        if (t->send_mode)
+            wsl_set_sendmode(t->sck, t->send_mode);
+
         return TRUE;
     }
     else {
@@ -515,6 +581,26 @@ static int wsck_sendcustom(mrp_transport_t *mt, void *data)
 }
 
 
+static int wsck_sendnative(mrp_transport_t *mt, void *data, uint32_t type_id)
+{
+    wsck_t        *t   = (wsck_t *)mt;
+    mrp_typemap_t *map = t->map;
+    void          *buf;
+    size_t         size;
+    int            status;
+
+    if (mrp_encode_native_as(data, type_id, 0, &buf, &size, map,
+                             MRP_TRANSPORT_ENCODING(mt)) == 0) {
+        status = wsl_send(t->sck, buf, size);
+        mrp_free(buf);
+    }
+    else
+        status = FALSE;
+
+    return status;
+}
+
+
 static inline int looks_ipv4(const char *p)
 {
     if (isdigit(p[0])) {
@@ -728,9 +814,14 @@ static void connection_cb(wsl_ctx_t *ctx, char *addr, const char *protocol,
     mrp_debug("incoming connection (%s) for context %p", protocol, ctx);
 
     if (t->listened) {
+        t->pending_native = (t->native != NULL && protocol != NULL &&
+                             !strcmp(protocol, t->native));
+
         MRP_TRANSPORT_BUSY(t, {
                 t->evt.connection((mrp_transport_t *)t, t->user_data);
             });
+
+        t->pending_native = FALSE;
     }
     else
         mrp_log_error("connection attempt on non-listened transport %p", t);
@@ -991,4 +1082,4 @@ MRP_REGISTER_TRANSPORT(wsck, WSCKP, wsck_t, wsck_resolve,
                        wsck_sendraw, NULL,
                        wsck_senddata, NULL,
                        wsck_sendcustom, NULL,
-                       NULL, NULL);
+                       wsck_sendnative, NULL);
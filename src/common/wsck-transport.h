@@ -81,6 +81,44 @@ typedef struct {
 #define MRP_WSCK_OPT_SSL_PKEY "ssl-pkey"      /* path to SSL priv. key */
 #define MRP_WSCK_OPT_SSL_CA   "ssl-ca"        /* path to SSL CA */
 #define MRP_WSCK_OPT_SSL      "ssl"           /* whether to connect with SSL */
+#define MRP_WSCK_OPT_NATIVE   "native"        /* binary native-type frames */
+
+/*
+ * Native types can be sent over a websocket transport in binary frames
+ * using the same TLV encoding that mrp_encode_native produces for the
+ * stream and datagram transports. This is considerably cheaper than
+ * serializing to and from JSON for every message.
+ *
+ * Binary framing is negotiated per connection using the websocket
+ * subprotocol. For a transport address wsck:<address>/<proto> the
+ * subprotocol <proto> carries JSON in text frames while the subprotocol
+ * <proto>-native (see MRP_WSCK_NATIVE_SUFFIX) carries native types in
+ * binary frames.
+ *
+ * Transports created in MRP_TRANSPORT_MODE_NATIVE always use the native
+ * subprotocol, both when connecting and when listening. A transport
+ * created in MRP_TRANSPORT_MODE_CUSTOM can additionally accept native
+ * clients if you push down a mrp_wsck_native_t as the MRP_WSCK_OPT_NATIVE
+ * option before binding it. Clients that do not support binary framing,
+ * for instance browser clients, keep talking JSON over the plain
+ * subprotocol. Transports accepted from a client that negotiated binary
+ * framing are switched to MRP_TRANSPORT_MODE_NATIVE, deliver incoming
+ * messages using the callback and type map given in the option, and need
+ * to be sent to using mrp_transport_sendnative. You can check the mode
+ * of an accepted transport to decide which encoding to use for it.
+ *
+ * Like the HTTP content options below, the option value is used as such
+ * without making an internal copy.
+ */
+
+#define MRP_WSCK_NATIVE_SUFFIX "-native"      /* native subprotocol suffix */
+
+typedef struct {
+    mrp_typemap_t *map;                  /* type map for native types */
+    void         (*recv)(mrp_transport_t *t, void *data, uint32_t type_id,
+                         void *user_data);
+} mrp_wsck_native_t;
+
 
 /*
  * It is also possible to serve content over HTTP on a websocket transport.
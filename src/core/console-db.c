@@ -82,6 +82,18 @@ static void db_exec(mrp_console_t *c, void *user_data, const char *grp,
 }
 
 
+static void db_explain(mrp_console_t *c, void *user_data, const char *grp,
+                       const char *cmd, char *args)
+{
+    MRP_UNUSED(c);
+    MRP_UNUSED(user_data);
+    MRP_UNUSED(grp);
+    MRP_UNUSED(cmd);
+
+    db_cmd("EXPLAIN %s", args);
+}
+
+
 void db_source(mrp_console_t *c, void *user_data, int argc, char **argv)
 {
     mqi_handle_t tx;
@@ -111,6 +123,20 @@ void db_source(mrp_console_t *c, void *user_data, int argc, char **argv)
 }
 
 
+void db_checkpoint(mrp_console_t *c, void *user_data, int argc, char **argv)
+{
+    MRP_UNUSED(c);
+    MRP_UNUSED(user_data);
+    MRP_UNUSED(argc);
+    MRP_UNUSED(argv);
+
+    if (mqi_checkpoint() == 0)
+        printf("DB checkpoint OK\n");
+    else
+        printf("DB checkpoint error %d: %s\n", errno, strerror(errno));
+}
+
+
 #define DB_GROUP_DESCRIPTION                                                \
     "Database commands provide means to manipulate the Murphy database\n"   \
     "from the console. Commands are provided for listing, describing,\n"    \
@@ -124,14 +150,30 @@ void db_source(mrp_console_t *c, void *user_data, int argc, char **argv)
 #define DBEXEC_DESCRIPTION "Executes the given MQL command and prints the\n" \
     "result.\n"
 
+#define DBEXPL_SYNTAX      "<SELECT, UPDATE or DELETE statement>"
+#define DBEXPL_SUMMARY     "show how the database would execute a statement"
+#define DBEXPL_DESCRIPTION "Shows the access plan (full table scan, index\n" \
+    "lookup or index range scan) the database would use for the WHERE\n"   \
+    "clause of the given MQL statement without executing it.\n"
+
 #define DBSRC_SYNTAX      "source <file>"
 #define DBSRC_SUMMARY     "evaluate the MQL script in the given <file>"
 #define DBSRC_DESCRIPTION "Read and evaluate the contents of <file>.\n"
 
+#define DBCKPT_SYNTAX      "checkpoint"
+#define DBCKPT_SUMMARY     "write snapshots of all persistent tables"
+#define DBCKPT_DESCRIPTION "Writes a fresh snapshot of every persistent\n" \
+    "table and truncates its write-ahead log. Tables with changes in an\n"  \
+    "open transaction are written once the transaction ends.\n"
+
 
 MRP_CORE_CONSOLE_GROUP(db_group, "db", DB_GROUP_DESCRIPTION, NULL, {
         MRP_TOKENIZED_CMD("source", db_source, FALSE,
                           DBSRC_SYNTAX, DBSRC_SUMMARY, DBSRC_DESCRIPTION),
+        MRP_TOKENIZED_CMD("checkpoint", db_checkpoint, FALSE,
+                          DBCKPT_SYNTAX, DBCKPT_SUMMARY, DBCKPT_DESCRIPTION),
+        MRP_RAWINPUT_CMD("explain", db_explain, 0,
+                         DBEXPL_SYNTAX, DBEXPL_SUMMARY, DBEXPL_DESCRIPTION),
         MRP_RAWINPUT_CMD("eval", db_exec,
                          MRP_CONSOLE_CATCHALL | MRP_CONSOLE_SELECTABLE,
                          DBEXEC_SYNTAX, DBEXEC_SUMMARY, DBEXEC_DESCRIPTION),
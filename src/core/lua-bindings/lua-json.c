@@ -32,6 +32,7 @@
 #include <murphy/common/log.h>
 #include <murphy/common/mm.h>
 #include <murphy/common/json.h>
+#include <murphy/common/json-stream.h>
 #include <murphy/core/lua-utils/object.h>
 #include <murphy/core/lua-bindings/lua-json.h>
 
@@ -56,6 +57,8 @@ static int  json_lua_setfield(lua_State *L);
 static int  json_lua_stringify(lua_State *L);
 static json_lua_t *json_lua_get(lua_State *L, int idx);
 static mrp_json_t *json_lua_table_to_object(lua_State *L, int t);
+static int json_lua_decode(lua_State *L);
+static int json_lua_encode(lua_State *L);
 
 
 /*
@@ -150,6 +153,254 @@ int mrp_json_lua_push(lua_State *L, mrp_json_t *json)
 }
 
 
+/*
+ * decoding JSON text directly into Lua tables
+ */
+
+typedef struct {
+    lua_State *L;                        /* Lua context to push to */
+    int        depth;                    /* current nesting depth */
+    int        idx[MRP_JSON_STREAM_MAXDEPTH + 1]; /* next index, 0 for objs */
+} json_decoder_t;
+
+
+static int decoder_store(json_decoder_t *d)
+{
+    if (d->depth == 0)                   /* top level value, leave it */
+        return TRUE;
+
+    if (d->idx[d->depth] > 0)            /* array: table, value */
+        lua_rawseti(d->L, -2, d->idx[d->depth]++);
+    else                                 /* object: table, key, value */
+        lua_rawset(d->L, -3);
+
+    return TRUE;
+}
+
+
+static int decoder_begin(json_decoder_t *d, int array)
+{
+    if (!lua_checkstack(d->L, 3))
+        return FALSE;
+
+    lua_newtable(d->L);
+    d->idx[++d->depth] = array ? 1 : 0;
+
+    return TRUE;
+}
+
+
+static int decoder_begin_object(void *user_data)
+{
+    return decoder_begin((json_decoder_t *)user_data, FALSE);
+}
+
+
+static int decoder_begin_array(void *user_data)
+{
+    return decoder_begin((json_decoder_t *)user_data, TRUE);
+}
+
+
+static int decoder_end(void *user_data)
+{
+    json_decoder_t *d = (json_decoder_t *)user_data;
+
+    d->depth--;
+
+    return decoder_store(d);
+}
+
+
+static int decoder_key(void *user_data, const char *key, size_t len)
+{
+    json_decoder_t *d = (json_decoder_t *)user_data;
+
+    lua_pushlstring(d->L, key, len);
+
+    return TRUE;
+}
+
+
+static int decoder_string(void *user_data, const char *str, size_t len)
+{
+    json_decoder_t *d = (json_decoder_t *)user_data;
+
+    lua_pushlstring(d->L, str, len);
+
+    return decoder_store(d);
+}
+
+
+static int decoder_integer(void *user_data, int64_t value)
+{
+    json_decoder_t *d = (json_decoder_t *)user_data;
+
+    lua_pushnumber(d->L, (lua_Number)value);
+
+    return decoder_store(d);
+}
+
+
+static int decoder_floating(void *user_data, double value)
+{
+    json_decoder_t *d = (json_decoder_t *)user_data;
+
+    lua_pushnumber(d->L, value);
+
+    return decoder_store(d);
+}
+
+
+static int decoder_boolean(void *user_data, bool value)
+{
+    json_decoder_t *d = (json_decoder_t *)user_data;
+
+    lua_pushboolean(d->L, value);
+
+    return decoder_store(d);
+}
+
+
+static int decoder_null(void *user_data)
+{
+    json_decoder_t *d = (json_decoder_t *)user_data;
+
+    if (d->depth == 0)
+        lua_pushnil(d->L);
+    else if (d->idx[d->depth] > 0)       /* leave a hole in the array */
+        d->idx[d->depth]++;
+    else                                 /* can't store nil, drop the key */
+        lua_pop(d->L, 1);
+
+    return TRUE;
+}
+
+
+int mrp_json_lua_push_string(lua_State *L, const char *str, int len)
+{
+    static mrp_json_sax_t sax = {
+        .begin_object = decoder_begin_object,
+        .end_object   = decoder_end,
+        .begin_array  = decoder_begin_array,
+        .end_array    = decoder_end,
+        .key          = decoder_key,
+        .string       = decoder_string,
+        .integer      = decoder_integer,
+        .floating     = decoder_floating,
+        .boolean      = decoder_boolean,
+        .null         = decoder_null,
+    };
+    json_decoder_t d;
+    int            top;
+
+    top     = lua_gettop(L);
+    d.L     = L;
+    d.depth = 0;
+
+    if (mrp_json_sax_parse(str, len, &sax, &d) < 0 ||
+        lua_gettop(L) != top + 1) {
+        mrp_debug("failed to decode JSON string '%.*s'", len, str);
+
+        lua_settop(L, top);
+        lua_pushnil(L);
+    }
+
+    return 1;
+}
+
+
+/*
+ * encoding Lua values directly as JSON text
+ */
+
+int mrp_json_lua_encode(lua_State *L, int idx, const char *key,
+                        mrp_json_writer_t *w)
+{
+    json_lua_t *lson;
+    const char *str, *k;
+    size_t      len;
+    double      dbl;
+    int         i, n, success;
+
+    if (idx < 0)
+        idx = lua_gettop(L) + idx + 1;
+
+    switch (lua_type(L, idx)) {
+    case LUA_TSTRING:
+        str = lua_tolstring(L, idx, &len);
+        return mrp_json_writer_string(w, key, str, (int)len);
+
+    case LUA_TNUMBER:
+        dbl = lua_tonumber(L, idx);
+        if (-9007199254740992.0 <= dbl && dbl <= 9007199254740992.0 &&
+            dbl == (int64_t)dbl)
+            return mrp_json_writer_integer(w, key, (int64_t)dbl);
+        else
+            return mrp_json_writer_double(w, key, dbl);
+
+    case LUA_TBOOLEAN:
+        return mrp_json_writer_boolean(w, key, lua_toboolean(L, idx));
+
+    case LUA_TNIL:
+        return mrp_json_writer_null(w, key);
+
+    case LUA_TTABLE:
+        break;
+
+    default:
+        return FALSE;
+    }
+
+    if ((lson = json_lua_get(L, idx)) != NULL)
+        return mrp_json_writer_raw(w, key,
+                                   mrp_json_object_to_string(lson->json), -1);
+
+    if (!lua_checkstack(L, 3))
+        return FALSE;
+
+    if ((n = (int)lua_objlen(L, idx)) > 0) {
+        if (!mrp_json_writer_begin_array(w, key))
+            return FALSE;
+
+        for (i = 1; i <= n; i++) {
+            lua_rawgeti(L, idx, i);
+            success = mrp_json_lua_encode(L, -1, NULL, w);
+            lua_pop(L, 1);
+
+            if (!success)
+                return FALSE;
+        }
+
+        return mrp_json_writer_end_array(w);
+    }
+
+    if (!mrp_json_writer_begin_object(w, key))
+        return FALSE;
+
+    lua_pushnil(L);
+    while (lua_next(L, idx) != 0) {
+        /* convert a copy of the key, lua_next needs the original intact */
+        lua_pushvalue(L, -2);
+
+        if (lua_type(L, -1) == LUA_TSTRING || lua_type(L, -1) == LUA_TNUMBER)
+            k = lua_tostring(L, -1);
+        else
+            k = NULL;
+
+        success = k != NULL && mrp_json_lua_encode(L, -2, k, w);
+        lua_pop(L, 2);
+
+        if (!success) {
+            lua_pop(L, 1);
+            return FALSE;
+        }
+    }
+
+    return mrp_json_writer_end_object(w);
+}
+
+
 mrp_json_t *mrp_json_lua_get(lua_State *L, int idx)
 {
     json_lua_t *lson = json_lua_get(L, idx);
@@ -443,6 +694,40 @@ static int json_lua_setfield(lua_State *L)
 }
 
 
+static int json_lua_decode(lua_State *L)
+{
+    const char *str;
+    size_t      len;
+
+    str = luaL_checklstring(L, lua_gettop(L), &len);
+
+    return mrp_json_lua_push_string(L, str, (int)len);
+}
+
+
+static int json_lua_encode(lua_State *L)
+{
+    mrp_json_writer_t  w;
+    char               buf[1024];
+    const char        *str;
+    size_t             len;
+
+    mrp_json_writer_init(&w, buf, sizeof(buf));
+
+    if (mrp_json_lua_encode(L, lua_gettop(L), NULL, &w) &&
+        (str = mrp_json_writer_data(&w, &len)) != NULL) {
+        lua_pushlstring(L, str, len);
+        mrp_json_writer_cleanup(&w);
+
+        return 1;
+    }
+
+    mrp_json_writer_cleanup(&w);
+
+    return luaL_error(L, "failed to encode Lua value as JSON");
+}
+
+
 static int json_lua_stringify(lua_State *L)
 {
     json_lua_t *lson = json_lua_check(L, 1);
@@ -454,4 +739,6 @@ static int json_lua_stringify(lua_State *L)
 
 
 MURPHY_REGISTER_LUA_BINDINGS(murphy, JSON_LUA_CLASS,
-                             { "JSON", mrp_json_lua_create });
+                             { "JSON"       , mrp_json_lua_create },
+                             { "json_decode", json_lua_decode     },
+                             { "json_encode", json_lua_encode     });
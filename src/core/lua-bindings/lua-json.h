@@ -31,6 +31,7 @@
 #define __MURPHY_LUA_JSON_H__
 
 #include <murphy/common/json.h>
+#include <murphy/common/json-stream.h>
 #include <murphy/core/lua-bindings/murphy.h>
 
 /** Create a Lua JSON object with an empty JSON object. */
@@ -48,4 +49,11 @@ int mrp_json_lua_push(lua_State *L, mrp_json_t *json);
 /** Get the JSON object at the given stack position, increase refcount. */
 mrp_json_t *mrp_json_lua_get(lua_State *L, int idx);
 
+/** Decode JSON text directly into Lua tables and push it on the stack. */
+int mrp_json_lua_push_string(lua_State *L, const char *str, int len);
+
+/** Encode the Lua value at the given stack position as JSON text. */
+int mrp_json_lua_encode(lua_State *L, int idx, const char *key,
+                        mrp_json_writer_t *w);
+
 #endif /* __MURPHY_LUA_JSON_H__ */
@@ -85,6 +85,11 @@ static void event_closed(mrp_transport_t *mt, int error, void *user_data);
 static void event_recv(mrp_transport_t *mt, void *msg, void *user_data);
 static void event_recvfrom(mrp_transport_t *mt, void *msg, mrp_sockaddr_t *addr,
                            socklen_t alen, void *user_data);
+static void event_recvraw(mrp_transport_t *mt, void *data, size_t size,
+                          void *user_data);
+static void event_recvrawfrom(mrp_transport_t *mt, void *data, size_t size,
+                              mrp_sockaddr_t *addr, socklen_t alen,
+                              void *user_data);
 
 /* Lua transport handling */
 static int transport_lua_create(lua_State *L);
@@ -206,8 +211,15 @@ static int transport_create(transport_lua_t *t, char *err, size_t elen)
           .connection     = event_connect,
           .closed         = event_closed,
     };
-    const char *opt, *val;
-    int         flags;
+    static mrp_transport_evt_t rawevents = {
+        { .recvraw        = event_recvraw     },
+        { .recvrawfrom    = event_recvrawfrom },
+          .connection     = event_connect,
+          .closed         = event_closed,
+    };
+    mrp_transport_evt_t *evt;
+    const char          *opt, *val;
+    int                  flags;
 
     if (t->alen <= 0) {
         errno = EADDRNOTAVAIL;
@@ -217,8 +229,21 @@ static int transport_create(transport_lua_t *t, char *err, size_t elen)
     if (t->t != NULL)
         return 0;
 
-    flags = MRP_TRANSPORT_REUSEADDR | MRP_TRANSPORT_MODE_CUSTOM;
-    t->t  = mrp_transport_create(t->ctx->ml, t->atype, &events, t, flags);
+    /*
+     * With the table encoding we take the JSON text as such from the
+     * transport and decode it directly into Lua tables, bypassing the
+     * intermediate JSON objects altogether.
+     */
+    if (t->encoding != NULL && !strcmp(t->encoding, "table")) {
+        flags = MRP_TRANSPORT_REUSEADDR | MRP_TRANSPORT_MODE_RAW;
+        evt   = &rawevents;
+    }
+    else {
+        flags = MRP_TRANSPORT_REUSEADDR | MRP_TRANSPORT_MODE_CUSTOM;
+        evt   = &events;
+    }
+
+    t->t = mrp_transport_create(t->ctx->ml, t->atype, evt, t, flags);
 
     if (t->t == NULL)
         mrp_lua_error(-1, t->L, "failed to create transport");
@@ -356,6 +381,10 @@ static void transport_lua_changed(void *data, lua_State *L, int member)
         return;
 
     case TRANSPORT_MEMBER_ENCODING:
+        if (t->encoding != NULL &&
+            strcmp(t->encoding, "json") && strcmp(t->encoding, "table"))
+            mrp_lua_error(-1, L, "invalid transport encoding '%s'",
+                          t->encoding);
         break;
 
     default:
@@ -611,5 +640,51 @@ static void event_recvfrom(mrp_transport_t *mt, void *msg, mrp_sockaddr_t *addr,
 }
 
 
+static void event_recvraw(mrp_transport_t *mt, void *data, size_t size,
+                          void *user_data)
+{
+    transport_lua_t *t = (transport_lua_t *)user_data;
+
+    MRP_UNUSED(mt);
+
+    mrp_debug("received message on <transport <%s> %p(%p)>",
+              t->address ? t->address : "no address", t, t->t);
+
+    if (mrp_lua_object_deref_value(t, t->L, t->callback.recv, false)) {
+        mrp_lua_push_object(t->L, t);
+        mrp_json_lua_push_string(t->L, data, (int)size);
+        mrp_lua_object_deref_value(t, t->L, t->data, true);
+
+        if (lua_pcall(t->L, 3, 0, 0) != 0)
+            mrp_log_error("failed to invoke transport recv callback");
+    }
+}
+
+
+static void event_recvrawfrom(mrp_transport_t *mt, void *data, size_t size,
+                              mrp_sockaddr_t *addr, socklen_t alen,
+                              void *user_data)
+{
+    transport_lua_t *t = (transport_lua_t *)user_data;
+
+    MRP_UNUSED(mt);
+    MRP_UNUSED(addr);
+    MRP_UNUSED(alen);
+
+    mrp_debug("received message on <transport <%s> %p(%p)>",
+              t->address ? t->address : "no address", t, t->t);
+
+    if (mrp_lua_object_deref_value(t, t->L, t->callback.recvfrom, false)) {
+        mrp_lua_push_object(t->L, t);
+        mrp_json_lua_push_string(t->L, data, (int)size);
+        lua_pushliteral(t->L, "<remote address should be here>");
+        mrp_lua_object_deref_value(t, t->L, t->data, true);
+
+        if (lua_pcall(t->L, 4, 0, 0) != 0)
+            mrp_log_error("failed to invoke transport recvfrom callback");
+    }
+}
+
+
 MURPHY_REGISTER_LUA_BINDINGS(murphy, TRANSPORT_LUA_CLASS,
                              { "Transport", transport_lua_create });
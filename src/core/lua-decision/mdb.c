@@ -70,15 +70,30 @@ enum field_e {
     CONDITION,
     STATEMENT,
     SINGLEVAL,
-    CREATE
+    CREATE,
+    PERSISTENT,
+    GROUP,
+    ORDER,
+    LIMIT,
+    JOIN,
+    ON
 };
 
 
+typedef struct {
+    const char         *name;
+    mqi_index_type_t    type;
+    mrp_lua_strarray_t *columns;
+} secondary_index_t;
+
 struct mrp_lua_mdb_table_s {
     bool                builtin;
+    bool                persistent;
     mqi_handle_t        handle;
     const char         *name;
     mrp_lua_strarray_t *index;
+    secondary_index_t  *secondary;
+    size_t              nsecondary;
     size_t              ncolumn;
     mqi_column_def_t   *columns;
     size_t              nrow;
@@ -88,8 +103,13 @@ struct mrp_lua_mdb_table_s {
 struct mrp_lua_mdb_select_s {
     const char *name;
     const char *table_name;
+    const char *join_name;
+    const char *join_on;
     mrp_lua_strarray_t *columns;
     const char *condition;
+    mrp_lua_strarray_t *group;
+    mrp_lua_strarray_t *order;
+    int limit;
     struct {
         const char *string;
         mql_statement_t *precomp;
@@ -115,6 +135,13 @@ struct const_def_s {
     mqi_data_type_t value;
 };
 
+typedef struct {
+    lua_State *L;
+    mrp_lua_mdb_select_t *sel;
+    int func;                   /* stack index of the row function */
+    int error;                  /* lua_pcall() status */
+} select_visit_t;
+
 
 
 static int  table_create_from_lua(lua_State *);
@@ -123,6 +150,9 @@ static int  table_setfield(lua_State *);
 static int  table_tostring(lua_State *);
 static int  table_insert(lua_State *);
 static int  table_replace(lua_State *);
+static int  table_insert_rows(lua_State *);
+static int  table_upsert_rows(lua_State *);
+static int  table_insert_bulk(lua_State *, mqi_insert_mode_t, const char *);
 static int  table_update(lua_State *);
 static int  table_delete(lua_State *);
 static void table_destroy_from_lua(void *);
@@ -144,6 +174,8 @@ static int  select_setfield(lua_State *);
 static void select_destroy_from_lua(void *);
 static int  select_update(lua_State *, int, mrp_lua_mdb_select_t *);
 static int  select_update_from_lua(lua_State *);
+static int  select_foreach_from_lua(lua_State *);
+static bool select_visit_row(mql_result_t *, void *);
 static int  select_update_from_resolver(mrp_scriptlet_t *,mrp_context_tbl_t *);
 static void select_install(lua_State *, mrp_lua_mdb_select_t *);
 
@@ -163,6 +195,10 @@ static mqi_column_def_t *check_coldefs(lua_State *, int, size_t *);
 static int push_coldefs(lua_State *, mqi_column_def_t *, size_t);
 static void free_coldefs(mqi_column_def_t *);
 
+static void check_secondary_indexes(lua_State *, int, mrp_lua_mdb_table_t *);
+static void create_secondary_indexes(lua_State *, mrp_lua_mdb_table_t *);
+static void free_secondary_indexes(mrp_lua_mdb_table_t *);
+
 static int row_create(lua_State *, int, void *, int, const char *);
 static row_t *row_check(lua_State *, int, const char *);
 
@@ -177,6 +213,8 @@ MRP_LUA_METHOD_LIST_TABLE (
     MRP_LUA_METHOD_CONSTRUCTOR  (table_create_from_lua)
     MRP_LUA_METHOD     (insert,  table_insert         )
     MRP_LUA_METHOD     (replace, table_replace        )
+    MRP_LUA_METHOD     (insert_rows, table_insert_rows    )
+    MRP_LUA_METHOD     (upsert_rows, table_upsert_rows    )
     MRP_LUA_METHOD     (update,  table_update         )
     MRP_LUA_METHOD     (delete,  table_delete         )
 );
@@ -213,6 +251,7 @@ MRP_LUA_METHOD_LIST_TABLE (
     MRP_LUA_OVERRIDE_GETFIELD   (select_getfield)
     MRP_LUA_OVERRIDE_SETFIELD   (select_setfield)
     MRP_LUA_METHOD     (update,  select_update_from_lua)
+    MRP_LUA_METHOD     (foreach, select_foreach_from_lua)
 );
 
 MRP_LUA_METHOD_LIST_TABLE (
@@ -422,6 +461,7 @@ static int table_create_from_lua(lua_State *L)
 
         case INDEX:
             tbl->index = mrp_lua_check_strarray(L, -1);
+            check_secondary_indexes(L, -1, tbl);
             break;
 
         case COLUMNS:
@@ -436,6 +476,14 @@ static int table_create_from_lua(lua_State *L)
             tbl->builtin = !lua_toboolean(L, -1);
             break;
 
+        case PERSISTENT:
+            if (!lua_isboolean(L, -1)) {
+                luaL_error(L, "attempt to assign non-boolean "
+                           "value to 'persistent' field");
+            }
+            tbl->persistent = lua_toboolean(L, -1);
+            break;
+
         default:
             luaL_error(L, "unexpected field '%s'", fldnam);
             break;
@@ -483,6 +531,8 @@ static int table_create_from_lua(lua_State *L)
         }
     }
 
+    create_secondary_indexes(L, tbl);
+
     mrp_lua_set_object_name(L, TABLE_CLASS, tbl->name);
 
     MRP_LUA_LEAVE(1);
@@ -513,6 +563,7 @@ static int table_getfield(lua_State *L)
             case NAME:     lua_pushstring(L, tbl->name);                 break;
             case INDEX:    mrp_lua_push_strarray(L, tbl->index);         break;
             case COLUMNS:  push_coldefs(L, tbl->columns, tbl->ncolumn);  break;
+            case PERSISTENT: lua_pushboolean(L, tbl->persistent);        break;
             default:       lua_pushnil(L);                               break;
             }
         }
@@ -656,6 +707,109 @@ static int table_replace(lua_State *L)
     MRP_LUA_LEAVE(1);
 }
 
+static int table_insert_rows(lua_State *L)
+{
+    return table_insert_bulk(L, mqi_insert_strict, "insert_rows");
+}
+
+static int table_upsert_rows(lua_State *L)
+{
+    return table_insert_bulk(L, mqi_insert_upsert, "upsert_rows");
+}
+
+static int table_insert_bulk(lua_State *L, mqi_insert_mode_t mode,
+                             const char *op)
+{
+    mrp_lua_mdb_table_t *tbl;
+    mqi_column_desc_t desc[MQI_COLUMN_MAX+1];
+    mqi_column_desc_t rdesc[MQI_COLUMN_MAX+1];
+    value_t *values;
+    value_t *v;
+    mqi_handle_t th;
+    size_t ncol;
+    int nrow;
+    int inserted;
+    int error;
+    int sts;
+    int i, j;
+
+    MRP_LUA_ENTER;
+
+    tbl = mrp_lua_table_check(L, 1);
+    luaL_checktype(L, 2, LUA_TTABLE);
+
+    ncol = tbl->ncolumn;
+    nrow = lua_objlen(L, 2);
+
+    if (nrow < 1)
+        luaL_error(L, "%s failed: no rows", op);
+
+    if (!(values = mrp_allocz(sizeof(value_t) * ncol * nrow)))
+        luaL_error(L, "%s failed: %s", op, strerror(ENOMEM));
+
+    /*
+     * all rows go in with the same column descriptors, so every row
+     * must have the same set of columns; an upsert may leave out some
+     */
+    for (i = 0, sts = 1;  sts && i < nrow;  i++) {
+        v = values + i * ncol;
+
+        lua_rawgeti(L, 2, i + 1);
+
+        if (lua_type(L, -1) != LUA_TTABLE)
+            sts = 0;
+        else {
+            sts = table_row_getvalues(L, tbl, -1, mode != mqi_insert_upsert,
+                                      i ? rdesc : desc, v);
+
+            if (sts && i > 0) {
+                for (j = 0;  desc[j].cindex >= 0;  j++) {
+                    if (desc[j].cindex != rdesc[j].cindex)
+                        break;
+                }
+
+                if (desc[j].cindex != rdesc[j].cindex) {
+                    table_row_resetvalues(tbl, rdesc, v);
+                    sts = 0;
+                }
+            }
+        }
+
+        lua_pop(L, 1);
+    }
+
+    if (!sts) {
+        for (j = 0;  j < i - 1;  j++)
+            table_row_resetvalues(tbl, desc, values + j * ncol);
+        mrp_free(values);
+        luaL_error(L, "%s failed: row %d has missing or different columns",
+                   op, i);
+    }
+
+    th = mqi_begin_transaction();
+
+    inserted = mqi_insert_bulk(tbl->handle, mode, desc, values,
+                               sizeof(value_t) * ncol, nrow);
+    error    = errno;
+
+    if (inserted >= 0)
+        mqi_commit_transaction(th);
+    else
+        mqi_rollback_transaction(th);
+
+    for (j = 0;  j < nrow;  j++)
+        table_row_resetvalues(tbl, desc, values + j * ncol);
+
+    mrp_free(values);
+
+    if (inserted < 0)
+        luaL_error(L, "%s failed: %s", op, strerror(error));
+
+    lua_pushinteger(L, inserted);
+
+    MRP_LUA_LEAVE(1);
+}
+
 static int table_update(lua_State *L)
 {
     int narg;
@@ -746,6 +900,7 @@ static void table_destroy_from_lua(void *data)
     if (tbl) {
         mrp_free((void *)tbl->name);
         mrp_lua_free_strarray(tbl->index);
+        free_secondary_indexes(tbl);
         free_coldefs(tbl->columns);
     }
 
@@ -925,6 +1080,7 @@ static int select_create_from_lua(lua_State *L)
     const char *condition;
     char  cols[1024];
     char  qry[2048];
+    char *p, *e;
 
     MRP_LUA_ENTER;
 
@@ -949,6 +1105,14 @@ static int select_create_from_lua(lua_State *L)
             sel->columns = mrp_lua_check_strarray(L, -1);
             break;
 
+        case JOIN:
+            sel->join_name = mrp_strdup(luaL_checkstring(L, -1));
+            break;
+
+        case ON:
+            sel->join_on = mrp_strdup(luaL_checkstring(L, -1));
+            break;
+
         case CONDITION:
             condition = luaL_checkstring(L, -1);
 
@@ -958,6 +1122,19 @@ static int select_create_from_lua(lua_State *L)
                 sel->condition = mrp_strdup(condition);
             break;
 
+        case GROUP:
+            sel->group = mrp_lua_check_strarray(L, -1);
+            break;
+
+        case ORDER:
+            sel->order = mrp_lua_check_strarray(L, -1);
+            break;
+
+        case LIMIT:
+            if ((sel->limit = luaL_checkinteger(L, -1)) <= 0)
+                luaL_error(L, "invalid limit %d", sel->limit);
+            break;
+
         default:
             luaL_error(L, "unexpected field '%s'", fldnam);
             break;
@@ -970,18 +1147,39 @@ static int select_create_from_lua(lua_State *L)
         luaL_error(L, "mandatory 'table' field is missing");
     if (!sel->columns || !sel->columns->nstring)
         luaL_error(L, "mandatory 'column' field is missing or invalid");
+    if (!sel->join_name != !sel->join_on)
+        luaL_error(L, "'join' and 'on' fields go together");
+    if (sel->join_name && (sel->group || sel->order || sel->limit))
+        luaL_error(L, "'join' can't be used with 'group', 'order' or 'limit'");
 
     mrp_lua_print_strarray(sel->columns, cols, sizeof(cols));
 
-    if (!sel->condition) {
-        snprintf(qry, sizeof(qry), "SELECT %s FROM %s",
-                 cols, sel->table_name);
+    e = (p = qry) + sizeof(qry);
+
+    p += snprintf(p, e-p, "SELECT %s FROM %s", cols, sel->table_name);
+
+    if (sel->join_name && p < e)
+        p += snprintf(p, e-p, " JOIN %s ON %s", sel->join_name, sel->join_on);
+
+    if (sel->condition && p < e)
+        p += snprintf(p, e-p, " WHERE %s", sel->condition);
+
+    if (sel->group && p < e) {
+        mrp_lua_print_strarray(sel->group, cols, sizeof(cols));
+        p += snprintf(p, e-p, " GROUP BY %s", cols);
     }
-    else {
-        snprintf(qry, sizeof(qry), "SELECT %s FROM %s WHERE %s",
-                 cols, sel->table_name, sel->condition);
+
+    if (sel->order && p < e) {
+        mrp_lua_print_strarray(sel->order, cols, sizeof(cols));
+        p += snprintf(p, e-p, " ORDER BY %s", cols);
     }
 
+    if (sel->limit > 0 && p < e)
+        p += snprintf(p, e-p, " LIMIT %d", sel->limit);
+
+    if (p >= e)
+        luaL_error(L, "select '%s' is too long", sel->name);
+
     sel->statement.string = mrp_strdup(qry);
 
     mrp_lua_set_object_name(L, SELECT_CLASS, sel->name);
@@ -1020,8 +1218,13 @@ static int select_getfield(lua_State *L)
                 switch (fld) {
                 case NAME:      lua_pushstring(L, sel->name);            break;
                 case TABLE:     lua_pushstring(L, sel->table_name);      break;
+                case JOIN:      lua_pushstring(L, sel->join_name);       break;
+                case ON:        lua_pushstring(L, sel->join_on);         break;
                 case COLUMNS:   mrp_lua_push_strarray(L, sel->columns);  break;
                 case CONDITION: lua_pushstring(L, sel->condition);       break;
+                case GROUP:     mrp_lua_push_strarray(L, sel->group);    break;
+                case ORDER:     mrp_lua_push_strarray(L, sel->order);    break;
+                case LIMIT:     lua_pushinteger(L, sel->limit);          break;
                 case STATEMENT: lua_pushstring(L,sel->statement.string); break;
                 case SINGLEVAL: mrp_lua_push_select(L, sel, true);       break;
                 default:        lua_pushnil(L);                          break;
@@ -1059,8 +1262,12 @@ static void select_destroy_from_lua(void *data)
 
     if (sel) {
         mrp_lua_free_strarray(sel->columns);
+        mrp_lua_free_strarray(sel->group);
+        mrp_lua_free_strarray(sel->order);
         mrp_free((void *)sel->name);
         mrp_free((void *)sel->table_name);
+        mrp_free((void *)sel->join_name);
+        mrp_free((void *)sel->join_on);
         mrp_free((void *)sel->condition);
         mrp_free((void *)sel->statement.string);
     }
@@ -1123,6 +1330,86 @@ static int select_update_from_lua(lua_State *L)
     MRP_LUA_LEAVE(1);
 }
 
+/*
+ * call a function for every selected row without keeping the result;
+ * the rows are passed as tables keyed by the selected column names
+ * and returning false from the function stops the iteration
+ */
+static int select_foreach_from_lua(lua_State *L)
+{
+    mrp_lua_mdb_select_t *sel;
+    select_visit_t v;
+    int nrow;
+
+    MRP_LUA_ENTER;
+
+    sel = mrp_lua_select_check(L, 1);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+
+    if (!sel->statement.precomp)
+        sel->statement.precomp = mql_precompile(sel->statement.string);
+
+    if (!sel->statement.precomp)
+        nrow = 0;
+    else {
+        v.L     = L;
+        v.sel   = sel;
+        v.func  = 2;
+        v.error = 0;
+
+        nrow = mql_exec_statement_visit(sel->statement.precomp,
+                                        select_visit_row, &v);
+
+        /* the visitor stopped with the error message on the stack */
+        if (v.error)
+            lua_error(L);
+    }
+
+    lua_pushinteger(L, nrow < 0 ? 0 : nrow);
+
+    MRP_LUA_LEAVE(1);
+}
+
+static bool select_visit_row(mql_result_t *row, void *user_data)
+{
+    select_visit_t *v = (select_visit_t *)user_data;
+    lua_State *L = v->L;
+    mrp_lua_strarray_t *cols = v->sel->columns;
+    const char *string;
+    bool more;
+    size_t i;
+
+    lua_pushvalue(L, v->func);
+    lua_createtable(L, 0, cols->nstring);
+
+    for (i = 0;  i < cols->nstring;  i++) {
+        switch (mql_result_rows_get_row_column_type(row, i)) {
+        case mqi_string:
+            string = mql_result_rows_get_string(row, i, 0, NULL, 0);
+            lua_pushstring(L, string);
+            break;
+        case mqi_integer:
+        case mqi_unsignd:
+        case mqi_floating:
+            lua_pushnumber(L, mql_result_rows_get_floating(row, i, 0));
+            break;
+        default:
+            lua_pushnil(L);
+            break;
+        }
+
+        lua_setfield(L, -2, cols->strings[i]);
+    }
+
+    if ((v->error = lua_pcall(L, 1, 1, 0)) != 0)
+        return false;
+
+    more = lua_isnil(L, -1) || lua_toboolean(L, -1);
+    lua_pop(L, 1);
+
+    return more;
+}
+
 static int select_update_from_resolver(mrp_scriptlet_t *script,
                                        mrp_context_tbl_t *ctbl)
 {
@@ -1162,8 +1449,9 @@ static void select_install(lua_State *L, mrp_lua_mdb_select_t *sel)
     };
 
     mrp_context_t *ctx;
-    char target[1024], table[1024];
-    const char *depends;
+    char target[1024], table[1024], join[1024];
+    const char *depends[2];
+    int ndepend;
 
     MRP_LUA_ENTER;
 
@@ -1179,13 +1467,21 @@ static void select_install(lua_State *L, mrp_lua_mdb_select_t *sel)
     snprintf(target, sizeof(target), "_select_%s", sel->name);
     snprintf(table , sizeof(table) , "$%s" , sel->table_name);
 
-    depends = table;
+    depends[0] = table;
+    ndepend = 1;
 
-    printf("\n%s: %s\n\tupdate(%s)\n", target, depends, sel->name);
+    /* a join is updated when either of the tables changes */
+    if (sel->join_name) {
+        snprintf(join, sizeof(join), "$%s", sel->join_name);
+        depends[ndepend++] = join;
+    }
 
+    printf("\n%s: %s%s%s\n\tupdate(%s)\n", target, depends[0],
+           ndepend > 1 ? " " : "", ndepend > 1 ? depends[1] : "", sel->name);
 
 
-    if (!mrp_resolver_add_prepared_target(ctx->r, target, &depends, 1,
+
+    if (!mrp_resolver_add_prepared_target(ctx->r, target, depends, ndepend,
                                           &select_updater, NULL, sel))
     {
         mrp_log_error("Failed to install resolver target for element '%s'.",
@@ -1379,9 +1675,16 @@ static field_t field_name_to_type(const char *name, size_t len)
 {
     switch (len) {
 
+    case 2:
+        if (!strcmp(name, "on"))
+            return ON;
+        break;
+
     case 4:
         if (!strcmp(name, "name"))
             return NAME;
+        if (!strcmp(name, "join"))
+            return JOIN;
         break;
 
     case 5:
@@ -1389,6 +1692,12 @@ static field_t field_name_to_type(const char *name, size_t len)
             return INDEX;
         if (!strcmp(name, "table"))
             return TABLE;
+        if (!strcmp(name, "group"))
+            return GROUP;
+        if (!strcmp(name, "order"))
+            return ORDER;
+        if (!strcmp(name, "limit"))
+            return LIMIT;
         break;
 
     case 6:
@@ -1408,6 +1717,11 @@ static field_t field_name_to_type(const char *name, size_t len)
             return CONDITION;
         break;
 
+    case 10:
+        if (!strcmp(name, "persistent"))
+            return PERSISTENT;
+        break;
+
     case 12:
         if (!strcmp(name, "single_value"))
             return SINGLEVAL;
@@ -1602,7 +1916,8 @@ static void adjust_lua_table_size(lua_State *L,
 
 static bool create_mdb_table(mrp_lua_mdb_table_t *tbl)
 {
-    char **index;
+    char   **index;
+    uint32_t flags;
 
     if (!tbl->columns || !tbl->ncolumn)
         tbl->handle = MQI_HANDLE_INVALID;
@@ -1612,7 +1927,9 @@ static bool create_mdb_table(mrp_lua_mdb_table_t *tbl)
         else
             index = (char **)tbl->index->strings;
 
-        tbl->handle = mqi_create_table((char *)tbl->name, MQI_TEMPORARY,
+        flags = tbl->persistent ? MQI_PERSISTENT : MQI_TEMPORARY;
+
+        tbl->handle = mqi_create_table((char *)tbl->name, flags,
                                        index, tbl->columns);
 
         if (tbl->handle == MQI_HANDLE_INVALID)
@@ -1624,6 +1941,88 @@ static bool create_mdb_table(mrp_lua_mdb_table_t *tbl)
     return (tbl->handle != MQI_HANDLE_INVALID);
 }
 
+static void check_secondary_indexes(lua_State *L, int t,
+                                    mrp_lua_mdb_table_t *tbl)
+{
+    const char *name, *type;
+    size_t namlen;
+    secondary_index_t *six;
+
+    t = (t < 0) ? lua_gettop(L) + t + 1 : t;
+
+    MRP_LUA_FOREACH_FIELD(L, t, name, namlen) {
+        if (!namlen)            /* array part, ie. the primary index */
+            continue;
+
+        tbl->secondary = mrp_realloc(tbl->secondary, sizeof(*six) *
+                                     (tbl->nsecondary + 1));
+        six = tbl->secondary + tbl->nsecondary++;
+
+        six->name = mrp_strdup(name);
+        six->type = mqi_index_hash;
+        six->columns = NULL;
+
+        if (!lua_istable(L, -1))
+            luaL_error(L, "invalid definition for index '%s'", name);
+
+        lua_getfield(L, -1, "type");
+
+        if (!lua_isnil(L, -1)) {
+            type = luaL_checkstring(L, -1);
+
+            if (!strcmp(type, "ordered"))
+                six->type = mqi_index_ordered;
+            else if (strcmp(type, "hash"))
+                luaL_error(L, "invalid type '%s' for index '%s'", type, name);
+        }
+
+        lua_pop(L, 1);
+
+        lua_getfield(L, -1, "columns");
+
+        if (lua_isnil(L, -1))
+            six->columns = mrp_lua_check_strarray(L, -2);
+        else
+            six->columns = mrp_lua_check_strarray(L, -1);
+
+        lua_pop(L, 1);
+
+        if (!six->columns->nstring)
+            luaL_error(L, "no columns specified for index '%s'", name);
+    }
+}
+
+static void create_secondary_indexes(lua_State *L, mrp_lua_mdb_table_t *tbl)
+{
+    secondary_index_t *six;
+    size_t i;
+
+    for (i = 0;  i < tbl->nsecondary;  i++) {
+        six = tbl->secondary + i;
+
+        if (mqi_create_secondary_index(tbl->handle, six->name,
+                                       six->type,
+                                       (char **)six->columns->strings) < 0 &&
+            errno != EEXIST)
+        {
+            luaL_error(L, "failed to create index '%s' on '%s': %s",
+                       six->name, tbl->name, strerror(errno));
+        }
+    }
+}
+
+static void free_secondary_indexes(mrp_lua_mdb_table_t *tbl)
+{
+    size_t i;
+
+    for (i = 0;  i < tbl->nsecondary;  i++) {
+        mrp_free((void *)tbl->secondary[i].name);
+        mrp_lua_free_strarray(tbl->secondary[i].columns);
+    }
+
+    mrp_free(tbl->secondary);
+}
+
 static mqi_cond_entry_t *condition_check(lua_State *L,
                                          int idx,
                                          mrp_lua_mdb_table_t *tbl)
@@ -1693,10 +2092,14 @@ static mqi_cond_entry_t *condition_check(lua_State *L,
 
         switch (col->type) {
         case mqi_string:
-            if (!(s = luaL_checklstring(L,-1,&sl)) || (int)sl >= col->length) {
+            /* strings kept out of line have no length limit */
+            if (!(s = luaL_checklstring(L,-1,&sl)) ||
+                (col->length > 0 && (int)sl >= col->length)) {
                 luaL_error(L, "expect max %u character long string for '%s'",
                            col->length, col->name);
             }
+            if (pl + sizeof(void *) + sl + 1 > pool_size)
+                goto too_complex;
             *var->v.varchar = pool + (pl += sizeof(void *));
             memcpy(pool + pl, s, sl+1);
             break;
@@ -1718,7 +2121,7 @@ static mqi_cond_entry_t *condition_check(lua_State *L,
             break;
         }
 
-        pl = ALIGN(pl + col->length);
+        pl = ALIGN(pl + (col->type == mqi_string ? sl + 1 : col->length));
     }
 
     cond = conds + ncond++;
@@ -33,6 +33,8 @@
 #include <murphy-db/mqi-types.h>
 
 typedef struct mdb_table_s mdb_table_t;
+typedef struct mdb_snapshot_s mdb_snapshot_t;
+typedef struct mdb_cursor_s mdb_cursor_t;
 
 
 int mdb_trigger_add_column_callback(mdb_table_t *, int, mqi_trigger_cb_t,
@@ -42,6 +44,15 @@ int mdb_trigger_delete_column_callback(mdb_table_t *, int,
 int mdb_trigger_add_row_callback(mdb_table_t *, mqi_trigger_cb_t, void *,
                                mqi_column_desc_t *);
 int mdb_trigger_delete_row_callback(mdb_table_t *, mqi_trigger_cb_t, void *);
+int mdb_trigger_add_batched_column_callback(mdb_table_t *, int,
+                                            mqi_trigger_cb_t, void *,
+                                            mqi_column_desc_t *);
+int mdb_trigger_add_batched_row_callback(mdb_table_t *, mqi_trigger_cb_t,
+                                         void *, mqi_column_desc_t *);
+int mdb_trigger_add_changefeed_callback(mdb_table_t *, mqi_trigger_cb_t,
+                                        void *, mqi_column_desc_t *);
+int mdb_trigger_delete_changefeed_callback(mdb_table_t *, mqi_trigger_cb_t,
+                                           void *);
 int mdb_trigger_add_table_callback(mqi_trigger_cb_t, void *);
 int mdb_trigger_delete_table_callback(mqi_trigger_cb_t, void *);
 int mdb_trigger_add_transaction_callback(mqi_trigger_cb_t, void *);
@@ -51,21 +62,56 @@ uint32_t mdb_transaction_begin(void);
 int mdb_transaction_commit(uint32_t);
 int mdb_transaction_rollback(uint32_t);
 uint32_t mdb_transaction_get_depth(void);
+uint32_t mdb_transaction_get_stamp(void);
+
+mdb_snapshot_t *mdb_snapshot_open(void);
+int mdb_snapshot_close(mdb_snapshot_t *);
+uint32_t mdb_snapshot_get_stamp(mdb_snapshot_t *);
+
+int mdb_persist_set_directory(const char *);
+int mdb_persist_checkpoint(void);
 
 
 mdb_table_t *mdb_table_create(char *, char **, mqi_column_def_t *);
 int mdb_table_register_handle(mdb_table_t *, mqi_handle_t);
 int mdb_table_drop(mdb_table_t *);
 int mdb_table_create_index(mdb_table_t *, char **);
+int mdb_table_create_secondary_index(mdb_table_t *, const char *,
+                                     mqi_index_type_t, char **);
+int mdb_table_drop_secondary_index(mdb_table_t *, const char *);
+int mdb_table_set_columnar(mdb_table_t *);
+int mdb_table_set_persistent(mdb_table_t *);
+int mdb_table_checkpoint(mdb_table_t *);
 int mdb_table_describe(mdb_table_t *, mqi_column_def_t *, int);
 int mdb_table_insert(mdb_table_t *, int, mqi_column_desc_t *, void **);
+int mdb_table_insert_bulk(mdb_table_t *, int, mqi_column_desc_t *,
+                          void *, int, int);
 int mdb_table_select(mdb_table_t *, mqi_cond_entry_t *,
                      mqi_column_desc_t *, void *, int, int);
+int mdb_table_select_query(mdb_table_t *, mqi_cond_entry_t *,
+                           mqi_column_desc_t *, mqi_query_t *,
+                           void *, int, int);
+int mdb_table_select_snapshot(mdb_table_t *, mdb_snapshot_t *,
+                              mqi_cond_entry_t *, mqi_column_desc_t *,
+                              void *, int, int);
 int mdb_table_select_by_index(mdb_table_t *, mqi_variable_t *,
                               mqi_column_desc_t *, void *);
+int mdb_table_select_by_secondary_index(mdb_table_t *, const char *,
+                                        mqi_variable_t *, mqi_column_desc_t *,
+                                        void *, int, int);
+int mdb_table_select_join(mdb_table_t *, int, mdb_table_t *, int,
+                          mqi_cond_entry_t *, mqi_column_desc_t *,
+                          void *, int, int);
+mdb_cursor_t *mdb_table_cursor_open(mdb_table_t *, mqi_cond_entry_t *,
+                                    mqi_column_desc_t *);
+int mdb_cursor_next(mdb_cursor_t *, void *);
+int mdb_cursor_read(mdb_cursor_t *, void *);
+void *mdb_cursor_get_column(mdb_cursor_t *, int);
+int mdb_cursor_close(mdb_cursor_t *);
 int mdb_table_update(mdb_table_t *, mqi_cond_entry_t *,
                      mqi_column_desc_t *, void *);
 int mdb_table_delete(mdb_table_t *, mqi_cond_entry_t *);
+int mdb_table_explain(mdb_table_t *, mqi_cond_entry_t *, char *, int);
 
 
 mdb_table_t *mdb_table_find(char *);
@@ -75,6 +121,8 @@ char *mdb_table_get_column_name(mdb_table_t *, int);
 mqi_data_type_t mdb_table_get_column_type(mdb_table_t *, int);
 int mdb_table_get_column_size(mdb_table_t *, int);
 uint32_t mdb_table_get_stamp(mdb_table_t *);
+uint32_t mdb_table_get_column_stamp(mdb_table_t *, mqi_bitfld_t *);
+uint32_t mdb_table_get_key_stamp(mdb_table_t *, mqi_variable_t *);
 int mdb_table_print_rows(mdb_table_t *, char *, int);
 
 
@@ -39,7 +39,9 @@
 /** maximum number of rows a query can produce */
 #define MQI_QUERY_RESULT_MAX   8192
 /** the maximum number columns a table can have */
-#define MQI_COLUMN_MAX         ((int)(sizeof(mqi_bitfld_t) * 8))
+#define MQI_COLUMN_MAX         128
+/** number of 64-bit words in a column mask (mqi_bitfld_t) */
+#define MQI_BITFLD_WORDS       ((MQI_COLUMN_MAX + 63) / 64)
 /** maximum length of a condition table (i.e. array of mqi_cond_entry_t) */
 #define MQI_COND_MAX           64
 #define MQL_PARAMETER_MAX      16
@@ -65,8 +67,6 @@
 #define MQI_OFFSET(structure, member)  \
     ((int)((char *)((&((structure *)0)->member)) - (char *)0))
 
-#define MQI_BIT(b)            (((mqi_bitfld_t)1) << (b))
-
 #define MQL_BIND_INDEX_BITS   8
 #define MQL_BIND_INDEX_MAX    (1 << MQL_BIND_INDEX_BITS)
 #define MQL_BIND_INDEX_MASK   (MQL_BIND_INDEX_MAX - 1)
@@ -109,6 +109,26 @@ enum mqi_cond_entry_type_e {
     mqi_column
 };
 
+enum mqi_index_type_e {
+    mqi_index_hash = 0,         /* equality lookups only */
+    mqi_index_ordered,          /* equality lookups and ordered traversal */
+};
+
+enum mqi_insert_mode_e {
+    mqi_insert_strict = 0,      /* a duplicate key is an error */
+    mqi_insert_replace,         /* a duplicate replaces the existing row */
+    mqi_insert_upsert,          /* a duplicate updates the existing row */
+};
+
+enum mqi_aggregate_e {
+    mqi_aggregate_none = 0,     /* plain column value */
+    mqi_count,
+    mqi_min,
+    mqi_max,
+    mqi_sum,
+    mqi_avg,
+};
+
 enum mqi_event_type_e {
     mqi_event_unknown = 0,
     mqi_column_changed,
@@ -117,13 +137,22 @@ enum mqi_event_type_e {
     mqi_table_created,
     mqi_table_dropped,
     mqi_transaction_start,
-    mqi_transaction_end
+    mqi_transaction_end,
+    mqi_rows_changed
+};
+
+enum mqi_change_type_e {
+    mqi_change_unknown = 0,
+    mqi_change_insert,
+    mqi_change_update,
+    mqi_change_delete
 };
 
 
 
 typedef uint32_t  mqi_handle_t;
-typedef uint32_t  mqi_bitfld_t;
+
+typedef struct mqi_bitfld_s          mqi_bitfld_t;
 
 typedef enum mqi_data_type_e         mqi_data_type_t;
 typedef struct mqi_column_def_s      mqi_column_def_t;
@@ -134,23 +163,45 @@ typedef struct mqi_variable_s        mqi_variable_t;
 typedef enum mqi_cond_entry_type_e   mqi_cond_entry_type_t;
 typedef struct mqi_cond_entry_s      mqi_cond_entry_t;
 
+typedef enum mqi_index_type_e         mqi_index_type_t;
+typedef enum mqi_insert_mode_e        mqi_insert_mode_t;
+
+typedef enum mqi_aggregate_e         mqi_aggregate_t;
+typedef struct mqi_order_s           mqi_order_t;
+typedef struct mqi_query_s           mqi_query_t;
+
+typedef struct mqi_snapshot_s        mqi_snapshot_t;
+typedef struct mqi_cursor_s          mqi_cursor_t;
+
 typedef enum mqi_event_type_e        mqi_event_type_t;
 typedef union mqi_event_u            mqi_event_t;
+typedef enum mqi_change_type_e       mqi_change_type_t;
 
 typedef struct mqi_change_table_s    mqi_change_table_t;
 typedef struct mqi_change_select_s   mqi_change_select_t;
 typedef struct mqi_change_coldsc_s   mqi_change_coldsc_t;
 typedef union mqi_change_data_u      mqi_change_data_t;
 typedef struct mqi_change_value_s    mqi_change_value_t;
+typedef struct mqi_change_row_s      mqi_change_row_t;
 
 typedef struct mqi_column_event_s    mqi_column_event_t;
 typedef struct mqi_row_event_s       mqi_row_event_t;
 typedef struct mqi_table_event_s     mqi_table_event_t;
 typedef struct mqi_transact_event_s  mqi_transact_event_t;
+typedef struct mqi_changefeed_event_s mqi_changefeed_event_t;
 
 typedef void (*mqi_trigger_cb_t)(mqi_event_t *, void *);
+typedef bool (*mqi_select_cb_t)(mqi_cursor_t *, void *);
+
 
 
+/*
+ * a set of column indices; tables of up to 64 columns only ever touch
+ * the first word, so keep the word loops in the helpers below short
+ */
+struct mqi_bitfld_s {
+    uint64_t         word[MQI_BITFLD_WORDS];
+};
 
 struct mqi_column_def_s {
     const char      *name;
@@ -160,8 +211,25 @@ struct mqi_column_def_s {
 };
 
 struct mqi_column_desc_s {
-    int     cindex;              /* column index */
-    int     offset;              /* offset within the data struct */
+    int              cindex;     /* column index */
+    int              offset;     /* offset within the data struct */
+    mqi_aggregate_t  aggregate;  /* computed over the selected rows */
+};
+
+struct mqi_order_s {
+    int   column;                /* index to the column descriptors */
+    bool  descending;
+};
+
+/*
+ * Grouping, ordering and limiting of a select. Both arrays are
+ * terminated by a -1 column; either can be NULL. A zero limit
+ * means no limit.
+ */
+struct mqi_query_s {
+    int          *group_by;      /* table column indices */
+    mqi_order_t  *order_by;
+    int           limit;
 };
 
 struct mqi_variable_s {
@@ -219,18 +287,29 @@ struct mqi_change_value_s {
 };
 
 
+struct mqi_change_row_s {
+    mqi_change_type_t   change;
+    mqi_bitfld_t        colmask;   /* changed columns */
+    void               *before;    /* selected columns or NULL if inserted */
+    void               *after;     /* selected columns or NULL if deleted */
+};
+
+
 struct mqi_column_event_s {
     mqi_event_type_t    event;
     mqi_change_table_t  table;
     mqi_change_coldsc_t column;
     mqi_change_value_t  value;
     mqi_change_select_t select;
+    int                 nrow;      /* > 1 only for batched triggers */
+    mqi_change_value_t *values;    /* nrow values; select has nrow rows */
 };
 
 struct mqi_row_event_s {
     mqi_event_type_t    event;
     mqi_change_table_t  table;
     mqi_change_select_t select;
+    int                 nrow;      /* > 1 only for batched triggers */
 };
 
 struct mqi_table_event_s {
@@ -242,6 +321,14 @@ struct mqi_transact_event_s {
     mqi_event_type_t  event;
 };
 
+struct mqi_changefeed_event_s {
+    mqi_event_type_t    event;
+    mqi_change_table_t  table;
+    int                 length;    /* length of a before/after image */
+    int                 nrow;
+    mqi_change_row_t   *rows;
+};
+
 
 union mqi_event_u {
     mqi_event_type_t     event;
@@ -249,10 +336,13 @@ union mqi_event_u {
     mqi_row_event_t      row;
     mqi_table_event_t    table;
     mqi_transact_event_t transact;
+    mqi_changefeed_event_t changes;
 };
 
 
 const char *mqi_data_type_str(mqi_data_type_t);
+const char *mqi_aggregate_str(mqi_aggregate_t);
+mqi_data_type_t mqi_aggregate_type(mqi_aggregate_t, mqi_data_type_t);
 
 int mqi_data_compare_integer(int, void *, void *);
 int mqi_data_compare_unsignd(int, void *, void *);
@@ -269,6 +359,74 @@ int mqi_data_print_varchar(void *, char *, int);
 int mqi_data_print_blob(void *, char *, int);
 
 
+static inline void mqi_bitfld_clear(mqi_bitfld_t *m)
+{
+    int i;
+
+    for (i = 0;  i < MQI_BITFLD_WORDS;  i++)
+        m->word[i] = 0;
+}
+
+static inline void mqi_bitfld_set(mqi_bitfld_t *m, int bit)
+{
+    m->word[bit >> 6] |= ((uint64_t)1) << (bit & 63);
+}
+
+static inline bool mqi_bitfld_test(const mqi_bitfld_t *m, int bit)
+{
+    return (m->word[bit >> 6] >> (bit & 63)) & 1;
+}
+
+static inline bool mqi_bitfld_is_empty(const mqi_bitfld_t *m)
+{
+    int i;
+
+    for (i = 0;  i < MQI_BITFLD_WORDS;  i++) {
+        if (m->word[i])
+            return false;
+    }
+
+    return true;
+}
+
+static inline void mqi_bitfld_merge(mqi_bitfld_t       *dst,
+                                    const mqi_bitfld_t *src)
+{
+    int i;
+
+    for (i = 0;  i < MQI_BITFLD_WORDS;  i++)
+        dst->word[i] |= src->word[i];
+}
+
+/** the lowest bit set at or above bit, or -1 if there is none */
+static inline int mqi_bitfld_next(const mqi_bitfld_t *m, int bit)
+{
+    uint64_t w;
+    int      i;
+
+    if (bit < 0 || bit >= MQI_COLUMN_MAX)
+        return -1;
+
+    i = bit >> 6;
+    w = m->word[i] & (~((uint64_t)0) << (bit & 63));
+
+    while (!w) {
+        if (++i >= MQI_BITFLD_WORDS)
+            return -1;
+        w = m->word[i];
+    }
+
+    return (i << 6) + __builtin_ctzll(w);
+}
+
+#define MQI_BITFLD_NONE  ((mqi_bitfld_t){ { 0 } })
+
+#define MQI_BITFLD_FOR_EACH(m, bit)                                     \
+    for ((bit) = mqi_bitfld_next((m), 0);                               \
+         (bit) >= 0;                                                    \
+         (bit) = mqi_bitfld_next((m), (bit) + 1))
+
+
 #endif /* __MQI_TYPES_H__ */
 
 /*
@@ -40,6 +40,7 @@
 #define MQI_TEMPORARY         (1 << 1)
 #define MQI_ANY               (MQI_PERSISTENT | MQI_TEMPORARY)
 #define MQI_TABLE_TYPE_MASK   (MQI_PERSISTENT | MQI_TEMPORARY)
+#define MQI_COLUMNAR          (1 << 2)  /* keep per-page column vectors */
 
 
 #define MQI_COLUMN_DEFINITION(name, type...)  \
@@ -48,9 +49,16 @@
 #define MQI_COLUMN_SELECTOR(column_index, result_structure, result_member) \
     {column_index, MQI_OFFSET(result_structure, result_member)}
 
+#define MQI_AGGREGATE_SELECTOR(aggregate, column_index, result_structure, \
+                               result_member)                             \
+    {column_index, MQI_OFFSET(result_structure, result_member),           \
+     mqi_##aggregate}
+
 #define MQI_VARCHAR(s)    mqi_varchar, s
+#define MQI_TEXT          mqi_varchar, 0  /* any length, kept out of line */
 #define MQI_INTEGER       mqi_integer, 0
 #define MQI_UNSIGNED      mqi_unsignd, 0
+#define MQI_FLOATING      mqi_floating, 0
 #define MQI_BLOB(s)       mqi_blob,    s
 
 #define MQI_COLUMN(column_index)  \
@@ -66,17 +74,19 @@
     {.type=mqi_operator, .u.operator_=mqi_##op}
 
 
-#define MQI_EXPRESSION(seq)        MQI_OPERATOR(begin), seq, MQI_OPERATOR(end),
+#define MQI_EXPRESSION(seq)        MQI_OPERATOR(begin), seq MQI_OPERATOR(end),
 
 
 #define MQI_STRING_VAL(val)        MQI_VALUE(varchar, (char **)&val),
 #define MQI_INTEGER_VAL(val)       MQI_VALUE(integer, (int32_t *)&val),
 #define MQI_UNSIGNED_VAL(val)      MQI_VALUE(unsignd, (uint32_t *)&val),
+#define MQI_FLOATING_VAL(val)      MQI_VALUE(floating, (double *)&val),
 #define MQI_BLOB_VAL(val)          MQI_VALUE(blob,    (void **)&val),
 
 #define MQI_STRING_VAR(val)        MQI_VARIABLE(varchar, (char **)&val)
 #define MQI_INTEGER_VAR(val)       MQI_VARIABLE(integer, (int32_t *)&val)
 #define MQI_UNSIGNED_VAR(val)      MQI_VARIABLE(unsignd, (uint32_t *)&val)
+#define MQI_FLOATING_VAR(val)      MQI_VARIABLE(floating, (double *)&val)
 #define MQI_BLOB_VAR(val)          MQI_VARIABLE(blob,    (void **)&val)
 
 
@@ -89,7 +99,7 @@
 #define MQI_GREATER_OR_EQUAL(a,b)  a, MQI_OPERATOR(geq),  b,
 #define MQI_GREATER(a,b)           a, MQI_OPERATOR(gt),   b,
 
-#define MQI_NOT(val)               MQI_OPERATOR(not), val,
+#define MQI_NOT(seq)               MQI_OPERATOR(not), seq
 
 #define MQI_COLUMN_DEFINITION_LIST(name, columns...)            \
     static mqi_column_def_t name[] = {                          \
@@ -135,18 +145,41 @@
     mqi_describe(table, coldefs, MQI_DIMENSION(coldefs))
 
 #define MQI_INSERT_INTO(table, column_descs, data)              \
-    mqi_insert_into(table, 0, column_descs, (void **)data)
+    mqi_insert_into(table, mqi_insert_strict, column_descs, (void **)data)
 
 #define MQI_REPLACE(table, column_descs, data)                  \
-    mqi_insert_into(table, 1, column_descs, (void **)data)
+    mqi_insert_into(table, mqi_insert_replace, column_descs, (void **)data)
+
+#define MQI_UPSERT(table, column_descs, data)                   \
+    mqi_insert_into(table, mqi_insert_upsert, column_descs, (void **)data)
+
+#define MQI_INSERT_BULK(table, mode, column_descs, rows)        \
+    mqi_insert_bulk(table, mode, column_descs, rows,            \
+                    sizeof(rows[0]), MQI_DIMENSION(rows))
 
 #define MQI_SELECT(columns, table, where, result)               \
     mqi_select(table, where, columns, result,                   \
                sizeof(result[0]), MQI_DIMENSION(result))
 
+#define MQI_SELECT_QUERY(columns, table, where, query, result)  \
+    mqi_select_query(table, where, columns, query, result,      \
+                     sizeof(result[0]), MQI_DIMENSION(result))
+
+#define MQI_SELECT_SNAPSHOT(snapshot, columns, table, where, result) \
+    mqi_select_snapshot(snapshot, table, where, columns, result, \
+                        sizeof(result[0]), MQI_DIMENSION(result))
+
 #define MQI_SELECT_BY_INDEX(columns, table, idxvars, result)    \
     mqi_select_by_index(table, idxvars, columns, result)
 
+#define MQI_SELECT_BY_SECONDARY_INDEX(columns, table, index, idxvars, result) \
+    mqi_select_by_secondary_index(table, index, idxvars, columns, result, \
+                                  sizeof(result[0]), MQI_DIMENSION(result))
+
+#define MQI_SELECT_JOIN(columns, left, lcol, right, rcol, where, result) \
+    mqi_select_join(left, lcol, right, rcol, where, columns, result,      \
+                    sizeof(result[0]), MQI_DIMENSION(result))
+
 #define MQI_UPDATE(table, column_descs, data, where)            \
     mqi_update(table, where, column_descs, data)
 
@@ -158,6 +191,17 @@
 int mqi_open(void);
 int mqi_close(void);
 
+/*
+ * Every call below takes the database lock for its own duration. Take
+ * it explicitly to make a sequence of calls atomic against other threads.
+ * The locks nest within a thread; a thread holding only the read lock
+ * can't take the write lock (EDEADLK). A transaction holds the write lock
+ * from its beginning until it is committed or rolled back.
+ */
+int mqi_read_lock(void);
+int mqi_write_lock(void);
+int mqi_unlock(void);
+
 int mqi_show_tables(uint32_t, char **, int);
 
 int mqi_create_transaction_trigger(mqi_trigger_cb_t, void *);
@@ -166,26 +210,95 @@ int mqi_create_row_trigger(mqi_handle_t, mqi_trigger_cb_t, void *,
                            mqi_column_desc_t *);
 int mqi_create_column_trigger(mqi_handle_t, int, mqi_trigger_cb_t, void *,
                               mqi_column_desc_t *);
+int mqi_create_batched_row_trigger(mqi_handle_t, mqi_trigger_cb_t, void *,
+                                   mqi_column_desc_t *);
+int mqi_create_batched_column_trigger(mqi_handle_t, int, mqi_trigger_cb_t,
+                                      void *, mqi_column_desc_t *);
 int mqi_drop_transaction_trigger(mqi_trigger_cb_t, void *);
 int mqi_drop_table_trigger(mqi_trigger_cb_t, void *);
 int mqi_drop_row_trigger(mqi_handle_t, mqi_trigger_cb_t,void *);
 int mqi_drop_column_trigger(mqi_handle_t, int, mqi_trigger_cb_t, void *);
+int mqi_create_changefeed(mqi_handle_t, mqi_trigger_cb_t, void *,
+                          mqi_column_desc_t *);
+int mqi_drop_changefeed(mqi_handle_t, mqi_trigger_cb_t, void *);
 mqi_handle_t mqi_begin_transaction(void);
 int mqi_commit_transaction(mqi_handle_t);
 int mqi_rollback_transaction(mqi_handle_t);
 mqi_handle_t mqi_get_transaction_handle(void);
 uint32_t mqi_get_transaction_depth(void);
+int mqi_set_persist_directory(const char *);
+int mqi_checkpoint(void);
+mqi_snapshot_t *mqi_open_snapshot(void);
+int mqi_close_snapshot(mqi_snapshot_t *);
+uint32_t mqi_get_snapshot_stamp(mqi_snapshot_t *);
 mqi_handle_t mqi_create_table(char *, uint32_t, char **, mqi_column_def_t *);
 int mqi_create_index(mqi_handle_t, char **);
+int mqi_create_secondary_index(mqi_handle_t, const char *, mqi_index_type_t,
+                               char **);
+int mqi_drop_secondary_index(mqi_handle_t, const char *);
 int mqi_drop_table(mqi_handle_t);
 int mqi_describe(mqi_handle_t, mqi_column_def_t *, int);
 int mqi_insert_into(mqi_handle_t, int, mqi_column_desc_t *, void **);
+
+/*
+ * Inserts nrow consecutive rows of rowsize bytes under one lock and with
+ * one check of the column descriptors. The mode is a mqi_insert_mode_t;
+ * with mqi_insert_upsert a row with an existing index key updates only
+ * the given columns of the existing row. Returns the number of new rows
+ * plus the number of rows an upsert changed.
+ */
+int mqi_insert_bulk(mqi_handle_t, int, mqi_column_desc_t *, void *, int, int);
 int mqi_delete_from(mqi_handle_t, mqi_cond_entry_t *);
+int mqi_explain(mqi_handle_t, mqi_cond_entry_t *, char *, int);
 int mqi_update(mqi_handle_t, mqi_cond_entry_t *, mqi_column_desc_t *, void *);
 int mqi_select(mqi_handle_t, mqi_cond_entry_t *, mqi_column_desc_t *,
                void *, int, int);
+int mqi_select_query(mqi_handle_t, mqi_cond_entry_t *, mqi_column_desc_t *,
+                     mqi_query_t *, void *, int, int);
+
+/*
+ * Selects the rows of a table as they were when the snapshot was opened.
+ * The strings in the results are copies owned by the snapshot: they stay
+ * valid, however the rows change, until the snapshot is closed.
+ */
+int mqi_select_snapshot(mqi_snapshot_t *, mqi_handle_t, mqi_cond_entry_t *,
+                        mqi_column_desc_t *, void *, int, int);
 int mqi_select_by_index(mqi_handle_t, mqi_variable_t *,
                         mqi_column_desc_t *, void *);
+int mqi_select_by_secondary_index(mqi_handle_t, const char *,
+                                  mqi_variable_t *, mqi_column_desc_t *,
+                                  void *, int, int);
+
+/*
+ * An equi-join of two tables of the same database on a column of each.
+ * In the condition and in the column descriptors the columns of the
+ * right table are numbered after the columns of the left table. The
+ * matching rows of one table are looked up with an index on its join
+ * column if there is one, otherwise from a hash table built for the
+ * join. Aggregates are not supported.
+ */
+int mqi_select_join(mqi_handle_t, int, mqi_handle_t, int, mqi_cond_entry_t *,
+                    mqi_column_desc_t *, void *, int, int);
+
+/*
+ * Cursors stream the selected rows straight from the table instead of
+ * copying them into a result array. A cursor keeps the read lock until
+ * it is closed, so it must be closed by the thread that opened it, and
+ * the condition and column descriptors must stay valid until then.
+ * mqi_select_cursor_next() returns 1 for a row and 0 at the end; the
+ * row argument may be NULL. mqi_select_cursor_get_column() points into
+ * the current row without copying: to the value for fixed-width columns
+ * and to the characters for varchars. mqi_select_visit() calls back for
+ * every row until the callback returns false.
+ */
+mqi_cursor_t *mqi_select_cursor_open(mqi_handle_t, mqi_cond_entry_t *,
+                                     mqi_column_desc_t *);
+int mqi_select_cursor_next(mqi_cursor_t *, void *);
+int mqi_select_cursor_read(mqi_cursor_t *, void *);
+const void *mqi_select_cursor_get_column(mqi_cursor_t *, int);
+int mqi_select_cursor_close(mqi_cursor_t *);
+int mqi_select_visit(mqi_handle_t, mqi_cond_entry_t *, mqi_column_desc_t *,
+                     mqi_select_cb_t, void *);
 
 mqi_handle_t mqi_get_table_handle(char *);
 int mqi_get_column_index(mqi_handle_t, char *);
@@ -194,6 +307,8 @@ char *mqi_get_column_name(mqi_handle_t, int);
 mqi_data_type_t mqi_get_column_type(mqi_handle_t, int);
 int mqi_get_column_size(mqi_handle_t, int);
 uint32_t mqi_get_table_stamp(mqi_handle_t);
+uint32_t mqi_get_column_stamp(mqi_handle_t, mqi_bitfld_t *);
+uint32_t mqi_get_key_stamp(mqi_handle_t, mqi_variable_t *);
 int mqi_print_rows(mqi_handle_t, char *, int);
 
 
@@ -97,6 +97,8 @@ double           mql_result_list_get_floating(mql_result_t *, int);
 
 mqi_event_type_t mql_result_event_get_type(mql_result_t *);
 mql_result_t    *mql_result_event_get_changed_rows(mql_result_t *);
+mqi_change_type_t mql_result_event_get_change_type(mql_result_t *, int);
+mqi_bitfld_t     mql_result_event_get_change_mask(mql_result_t *, int);
 
 void             mql_result_free(mql_result_t *);
 
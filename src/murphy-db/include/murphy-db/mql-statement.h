@@ -57,8 +57,12 @@ typedef struct mql_statement_s {
     uint8_t               data[0];
 } mql_statement_t;
 
+/** gets a single-row result for every selected row; false stops */
+typedef bool (*mql_row_cb_t)(mql_result_t *, void *);
+
 
 mql_result_t *mql_exec_statement(mql_result_type_t, mql_statement_t *);
+int mql_exec_statement_visit(mql_statement_t *, mql_row_cb_t, void *);
 int mql_bind_value(mql_statement_t *, int, mqi_data_type_t, ...);
 void mql_statement_free(mql_statement_t *);
 
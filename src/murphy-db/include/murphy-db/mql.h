@@ -33,6 +33,18 @@
 #include <murphy-db/mql-statement.h>
 #include <murphy-db/mql-trigger.h>
 
+typedef struct mql_cache_stats_s  mql_cache_stats_t;
+
+/** statistics of the statement cache of mql_exec_string() */
+struct mql_cache_stats_s {
+    int       size;           /**< number of cached statements */
+    int       max;            /**< maximum number of cached statements */
+    uint64_t  hits;           /**< executions without parsing */
+    uint64_t  misses;         /**< cacheable statements that were parsed */
+    uint64_t  evictions;      /**< statements dropped to make room */
+    uint64_t  invalidations;  /**< statements dropped by table changes */
+};
+
 /**
  * @brief execute a series of MQL statements stored in a file
  *
@@ -67,6 +79,13 @@ int mql_exec_file(const char *file);
  *
  * The returned result should be freed by mql_result_free().
  *
+ * SELECT, UPDATE and DELETE statements are precompiled and kept in a
+ * bounded LRU cache. The cache key is the statement text with its
+ * whitespace collapsed and the literals of the WHERE clause replaced by
+ * parameters, so statements differing only in those literals share one
+ * precompiled statement and are executed without parsing. The cache is
+ * flushed whenever a table is created or dropped.
+ *
  * @param [in] result_type   specifies the expected type of the returned
  *                           result. However, if the execution failed for
  *                           some reason the returned result will have
@@ -156,6 +175,32 @@ mql_result_t *mql_exec_string(mql_result_type_t result_type,
  */
 mql_statement_t *mql_precompile(const char *statement);
 
+/**
+ * @brief get the statistics of the statement cache
+ *
+ * @param [out] stats  is where the statistics are copied to
+ *
+ * @return 0 on success or -1 if stats was NULL
+ */
+int mql_get_cache_stats(mql_cache_stats_t *stats);
+
+/**
+ * @brief set the maximum number of cached statements
+ *
+ * Least recently used statements are evicted if the cache holds more
+ * statements than the new maximum. Zero disables the cache.
+ *
+ * @param [in] size  is the new maximum
+ *
+ * @return 0 on success or -1 if size was negative
+ */
+int mql_set_cache_size(int size);
+
+/**
+ * @brief drop all statements from the statement cache
+ */
+void mql_flush_cache(void);
+
 
 #endif  /* __MQL_MQL_H__ */
 
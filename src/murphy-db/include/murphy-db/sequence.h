@@ -49,6 +49,8 @@ typedef struct mdb_sequence_s mdb_sequence_t;
 
 typedef int  (*mdb_sequence_compare_t)(int, void *, void *);
 typedef int  (*mdb_sequence_print_t)(void *, char *, int);
+typedef int  (*mdb_sequence_copy_t)(void *, void *);
+typedef void (*mdb_sequence_free_t)(void *);
 
 
 mdb_sequence_t *mdb_sequence_table_create(int, mdb_sequence_compare_t,
@@ -58,9 +60,19 @@ int mdb_sequence_table_get_size(mdb_sequence_t *);
 int mdb_sequence_table_reset(mdb_sequence_t *);
 int mdb_sequence_table_print(mdb_sequence_t *, char *, int);
 
+/*
+ * For keys that refer to storage which may go away with their entry.
+ * Cursors keep the key they have passed as a copy made by the copy
+ * function, which must clear the key if it fails, and release it
+ * with the free function.
+ */
+int mdb_sequence_table_set_key_copy(mdb_sequence_t *, mdb_sequence_copy_t,
+                                    mdb_sequence_free_t);
+
 int mdb_sequence_add(mdb_sequence_t *, int, void *, void *);
 void *mdb_sequence_delete(mdb_sequence_t *, int, void *);
 void *mdb_sequence_iterate(mdb_sequence_t *, void **);
+int mdb_sequence_seek(mdb_sequence_t *, int, void *, void **);
 void mdb_sequence_cursor_destroy(mdb_sequence_t *, void **);
 
 
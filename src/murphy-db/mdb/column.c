@@ -44,6 +44,7 @@
 #include "index.h"
 #include "table.h"
 
+static int write_string(mdb_column_t *, void *, const char *);
 static int print_blob(uint8_t *, int data, char *, int);
 
 int mdb_column_write(mdb_column_t      *dst_desc, void *dst_data,
@@ -64,6 +65,9 @@ int mdb_column_write(mdb_column_t      *dst_desc, void *dst_data,
             if(__builtin_expect(*((char**)src) == NULL, 0))
                 src = &empty;
 
+            if (dst_desc->heap)
+                return write_string(dst_desc, dst, *(const char **)src);
+
             if (!**(char **)src && !*(char *)dst)
                 goto identical;
 
@@ -115,6 +119,27 @@ int mdb_column_write(mdb_column_t      *dst_desc, void *dst_data,
     return 0;
 }
 
+/*
+ * index keys hold the interned pointer of out of line varchars; looking
+ * up a key must not add strings to the heap
+ */
+void mdb_column_write_key(mdb_column_t      *dst_desc, void *dst_data,
+                          mqi_column_desc_t *src_desc, void *src_data)
+{
+    const char *str;
+
+    if (!dst_desc || !dst_desc->heap) {
+        mdb_column_write(dst_desc, dst_data, src_desc, src_data);
+        return;
+    }
+
+    if (dst_data && src_desc && src_desc->offset >= 0 && src_data) {
+        str = *(const char **)(src_data + src_desc->offset);
+        *(const char **)(dst_data + dst_desc->offset) =
+            mdb_strheap_lookup(dst_desc->heap, str);
+    }
+}
+
 
 void mdb_column_read(mqi_column_desc_t *dst_desc, void *dst_data,
                      mdb_column_t      *src_desc, void *src_data)
@@ -130,7 +155,10 @@ void mdb_column_read(mqi_column_desc_t *dst_desc, void *dst_data,
         switch (src_desc->type) {
 
         case mqi_varchar:
-            *(char **)dst = (char *)src;
+            if (src_desc->heap)
+                *(char **)dst = mdb_column_string(src_desc, src_data);
+            else
+                *(char **)dst = (char *)src;
             break;
 
         case mqi_integer:
@@ -191,7 +219,7 @@ int mdb_column_print(mdb_column_t *cdesc, void *data, char *buf, int len)
     if (!cdesc || !data || !buf || len < 1)
         r = 0;
     else {
-        d = data + cdesc->offset;
+        d = mdb_column_value(cdesc, data);
         l = cdesc->length;
 
         switch (cdesc->type) {
@@ -206,6 +234,34 @@ int mdb_column_print(mdb_column_t *cdesc, void *data, char *buf, int len)
     return r;
 }
 
+/*
+ * out of line varchars are interned: equal strings share the pointer,
+ * so the value changed only if the pointer did
+ */
+static int write_string(mdb_column_t *col, void *dst, const char *str)
+{
+    const char *old = *(const char **)dst;
+    const char *new;
+
+    if (str == old)
+        return 0;
+
+    if (!str[0])
+        new = NULL;
+    else if (!(new = mdb_strheap_intern(col->heap, str)))
+        return 0;               /* out of memory, keep the old value */
+
+    if (new == old) {
+        mdb_strheap_release(col->heap, new);
+        return 0;
+    }
+
+    *(const char **)dst = new;
+    mdb_strheap_release(col->heap, old);
+
+    return 1;
+}
+
 static int print_blob(uint8_t *data, int data_len, char *buf, int buflen)
 {
     MQI_UNUSED(data);
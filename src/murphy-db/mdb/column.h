@@ -36,6 +36,7 @@
 
 
 #include <murphy-db/mqi-types.h>
+#include "strheap.h"
 
 typedef struct {
     char            *name;
@@ -43,9 +44,29 @@ typedef struct {
     int              length;
     int              offset;
     uint32_t         flags;
+    int              nindex;    /* number of secondary indexes using it */
+    mdb_strheap_t   *heap;      /* for varchars stored out of line */
 } mdb_column_t;
 
+/** the string of an out of line varchar in row data */
+static inline char *mdb_column_string(mdb_column_t *col, void *data)
+{
+    char *s = *(char **)(data + col->offset);
+
+    return s ? s : "";
+}
+
+/** the value of a column in row data; the string itself for varchars */
+static inline void *mdb_column_value(mdb_column_t *col, void *data)
+{
+    if (col->heap)
+        return mdb_column_string(col, data);
+    else
+        return data + col->offset;
+}
+
 int mdb_column_write(mdb_column_t *, void *, mqi_column_desc_t *, void *);
+void mdb_column_write_key(mdb_column_t *, void *, mqi_column_desc_t *, void *);
 void mdb_column_read(mqi_column_desc_t *, void *, mdb_column_t *, void *);
 int  mdb_column_print_header(mdb_column_t *, char *, int);
 int  mdb_column_print(mdb_column_t *, void *, char *, int);
@@ -54,6 +54,7 @@ typedef struct {
         char        *varchar;
         int32_t      integer;
         uint32_t     unsignd;
+        double       floating;
         void        *blob;
         void        *data;
     } v;
@@ -69,6 +70,27 @@ typedef struct {
     };
 } cond_stack_t;
 
+typedef struct {
+    mdb_column_t       *columns;
+    int                 ncolumn;
+    mqi_cond_entry_t   *ce;
+    mdb_cond_program_t *prog;
+    int                 nmax;
+} cond_compiler_t;
+
+static int precedence[mqi_operator_max] = {
+    [ mqi_done  ] = 0,
+    [ mqi_begin ] = 1,
+    [ mqi_and   ] = 2,
+    [ mqi_or    ] = 3,
+    [ mqi_less  ] = 4,
+    [ mqi_leq   ] = 4,
+    [ mqi_eq    ] = 4,
+    [ mqi_geq   ] = 4,
+    [ mqi_gt    ] = 4,
+    [ mqi_not   ] = 5
+};
+
 static int cond_get_data(cond_stack_t*,mqi_cond_entry_t*,mdb_column_t*,void*);
 static int cond_eval(cond_stack_t *, cond_stack_t *, int);
 static int cond_relop(mqi_operator_t, cond_stack_t *, cond_stack_t *);
@@ -76,21 +98,21 @@ static int cond_binary_logicop(mqi_operator_t, cond_stack_t *,
                                cond_stack_t *);
 static int cond_unary_logicop(mqi_operator_t, cond_stack_t *);
 
+static mdb_cond_node_t *compile_expression(cond_compiler_t *, int);
+static mdb_cond_node_t *compile_unary(cond_compiler_t *);
+static mdb_cond_node_t *compile_relop(cond_compiler_t *, mqi_operator_t,
+                                      mdb_cond_node_t *, mdb_cond_node_t *);
+static mdb_cond_node_t *compile_logicop(cond_compiler_t *, mqi_operator_t,
+                                        mdb_cond_node_t *, mdb_cond_node_t *);
+static mdb_cond_node_t *compile_not(cond_compiler_t *, mdb_cond_node_t *);
+static mdb_cond_node_t *compile_group(cond_compiler_t *, mdb_cond_node_t *);
+static mdb_cond_node_t *compile_constant(cond_compiler_t *, int);
+static mdb_cond_node_t *new_node(cond_compiler_t *, mdb_cond_func_t,
+                                 mqi_data_type_t);
+static mdb_cond_func_t leaf_function(mdb_cond_node_t *);
+
 int mdb_cond_evaluate(mdb_table_t *tbl, mqi_cond_entry_t **cond_ptr,void *data)
 {
-    static int precedence[mqi_operator_max] = {
-        [ mqi_done  ] = 0,
-        [ mqi_begin ] = 1,
-        [ mqi_and   ] = 2,
-        [ mqi_or    ] = 3,
-        [ mqi_less  ] = 4,
-        [ mqi_leq   ] = 4,
-        [ mqi_eq    ] = 4,
-        [ mqi_geq   ] = 4,
-        [ mqi_gt    ] = 4,
-        [ mqi_not   ] = 5
-    };
-
     mqi_cond_entry_t *cond       = *cond_ptr;
     cond_stack_t      stack[256] = {
         [0] = { precedence[mqi_begin], { .operator = mqi_begin } }
@@ -107,14 +129,16 @@ int mdb_cond_evaluate(mdb_table_t *tbl, mqi_cond_entry_t **cond_ptr,void *data)
 
         case mqi_operator:
             pr  = precedence[cond->u.operator_];
-            sp += cond_eval(sp, lastop, pr);
+
+            /* a parenthesized expression is an operand, not an operator */
+            if (cond->u.operator_ != mqi_begin)
+                sp += cond_eval(sp, lastop, pr);
 
             switch (cond->u.operator_) {
 
             case mqi_begin:
                 cond++;
                 result = mdb_cond_evaluate(tbl, &cond, data);
-                cond++;
 
                 sp->data.v.integer = result >= 0 ? result : 0;
                 sp->precedence   = PRECEDENCE_DATA;
@@ -190,6 +214,7 @@ static int cond_get_data(cond_stack_t     *sp,
             case mqi_varchar:  sd->v.varchar = *var->v.varchar;  ok = 1; break;
             case mqi_integer:  sd->v.integer = *var->v.integer;  ok = 1; break;
             case mqi_unsignd:  sd->v.unsignd = *var->v.unsignd;  ok = 1; break;
+            case mqi_floating: sd->v.floating= *var->v.floating; ok = 1; break;
             case mqi_blob:     sd->v.blob    = *var->v.blob;     ok = 1; break;
             default:                                             ok = 0; break;
             }
@@ -319,6 +344,15 @@ static int cond_relop(mqi_operator_t op, cond_stack_t *v1, cond_stack_t *v2)
                 cmp = -1;
             break;
 
+        case mqi_floating:
+            if (d1->v.floating > d2->v.floating)
+                cmp = 1;
+            else if (d1->v.floating == d2->v.floating)
+                cmp = 0;
+            else
+                cmp = -1;
+            break;
+
         default:
             return 0;
         }
@@ -389,6 +423,542 @@ static int cond_unary_logicop(mqi_operator_t op, cond_stack_t *v)
     return 0;
 }
 
+/*
+ * compiled conditions
+ *
+ * A condition is translated into a flat array of typed nodes where
+ * every node carries a function pointer computing its truth value for
+ * a given row. All type checks are resolved at compile time, and
+ * the common 'column <relop> variable' case is mapped to a function
+ * specialized for the column type and the operator. The semantics
+ * follow mdb_cond_evaluate(), including operator precedence and the
+ * right associativity of the binary operators.
+ */
+
+static inline int varchar_compare(const char *s1, const char *s2)
+{
+    if (!s2)
+        return 1;
+
+    return strcmp(s1, s2);
+}
+
+static inline const char *heap_string(void *slot)
+{
+    const char *s = *(const char **)slot;
+
+    return s ? s : "";
+}
+
+#define COLUMN_integer(n, d)  (*(int32_t *)((d) + (n)->offset))
+#define COLUMN_unsignd(n, d)  (*(uint32_t *)((d) + (n)->offset))
+#define COLUMN_floating(n, d) (*(double *)((d) + (n)->offset))
+#define COLUMN_varchar(n, d)  varchar_compare((d) + (n)->offset,       \
+                                              *(n)->var->v.varchar)
+#define COLUMN_heap(n, d)     varchar_compare(heap_string((d) + (n)->offset), \
+                                              *(n)->var->v.varchar)
+#define VARIABLE_integer(n)   (*(n)->var->v.integer)
+#define VARIABLE_unsignd(n)   (*(n)->var->v.unsignd)
+#define VARIABLE_floating(n)  (*(n)->var->v.floating)
+#define VARIABLE_varchar(n)   0
+#define VARIABLE_heap(n)      0
+
+#define RELOP_FUNCTION(typ, opname, op)                                 \
+    static int relop_##typ##_##opname(mdb_cond_node_t *n, void *data)   \
+    {                                                                   \
+        return COLUMN_##typ(n, data) op VARIABLE_##typ(n);              \
+    }
+
+#define RELOP_FUNCTIONS(typ)                                            \
+    RELOP_FUNCTION(typ, less, <)                                        \
+    RELOP_FUNCTION(typ, leq, <=)                                        \
+    RELOP_FUNCTION(typ, eq, ==)                                         \
+    RELOP_FUNCTION(typ, geq, >=)                                        \
+    RELOP_FUNCTION(typ, gt, >)                                          \
+                                                                        \
+    static mdb_cond_func_t relop_##typ[mqi_operator_max] = {            \
+        [ mqi_less ] = relop_##typ##_less,                              \
+        [ mqi_leq  ] = relop_##typ##_leq,                               \
+        [ mqi_eq   ] = relop_##typ##_eq,                                \
+        [ mqi_geq  ] = relop_##typ##_geq,                               \
+        [ mqi_gt   ] = relop_##typ##_gt,                                \
+    };
+
+RELOP_FUNCTIONS(varchar)
+RELOP_FUNCTIONS(heap)
+RELOP_FUNCTIONS(integer)
+RELOP_FUNCTIONS(unsignd)
+RELOP_FUNCTIONS(floating)
+
+static int column_varchar_truth(mdb_cond_node_t *n, void *data)
+{
+    return *(char *)(data + n->offset) ? 1 : 0;
+}
+
+/* the empty string is not kept in the string heap */
+static int column_heap_truth(mdb_cond_node_t *n, void *data)
+{
+    return *(char **)(data + n->offset) ? 1 : 0;
+}
+
+static int column_integer_truth(mdb_cond_node_t *n, void *data)
+{
+    return COLUMN_integer(n, data) ? 1 : 0;
+}
+
+static int column_unsignd_truth(mdb_cond_node_t *n, void *data)
+{
+    return COLUMN_unsignd(n, data) ? 1 : 0;
+}
+
+static int variable_varchar_truth(mdb_cond_node_t *n, void *data)
+{
+    char *s = *n->var->v.varchar;
+
+    MQI_UNUSED(data);
+
+    return s && s[0] ? 1 : 0;
+}
+
+static int variable_integer_truth(mdb_cond_node_t *n, void *data)
+{
+    MQI_UNUSED(data);
+
+    return VARIABLE_integer(n) ? 1 : 0;
+}
+
+static int variable_unsignd_truth(mdb_cond_node_t *n, void *data)
+{
+    MQI_UNUSED(data);
+
+    return VARIABLE_unsignd(n) ? 1 : 0;
+}
+
+static int variable_varchar_set(mdb_cond_node_t *n, void *data)
+{
+    MQI_UNUSED(data);
+
+    return *n->var->v.varchar ? 1 : 0;
+}
+
+static int constant_false(mdb_cond_node_t *n, void *data)
+{
+    MQI_UNUSED(n);
+    MQI_UNUSED(data);
+
+    return 0;
+}
+
+static int constant_true(mdb_cond_node_t *n, void *data)
+{
+    MQI_UNUSED(n);
+    MQI_UNUSED(data);
+
+    return 1;
+}
+
+static int logic_and(mdb_cond_node_t *n, void *data)
+{
+    return n->left->func(n->left, data) && n->right->func(n->right, data);
+}
+
+static int logic_or(mdb_cond_node_t *n, void *data)
+{
+    return n->left->func(n->left, data) || n->right->func(n->right, data);
+}
+
+static int logic_not(mdb_cond_node_t *n, void *data)
+{
+    return !n->left->func(n->left, data);
+}
+
+static void node_value(mdb_cond_node_t *n, void *data, cond_data_t *v)
+{
+    switch (n->kind) {
+
+    case mdb_cond_column:
+        switch (n->type) {
+        case mqi_varchar: v->v.varchar = n->heap ?
+                              (char *)heap_string(data + n->offset) :
+                              data + n->offset;                   break;
+        case mqi_integer: v->v.integer = COLUMN_integer(n, data); break;
+        case mqi_unsignd: v->v.unsignd = COLUMN_unsignd(n, data); break;
+        case mqi_floating:v->v.floating= COLUMN_floating(n, data);break;
+        default:          v->v.data    = NULL;                    break;
+        }
+        break;
+
+    case mdb_cond_variable:
+        switch (n->type) {
+        case mqi_varchar: v->v.varchar = *n->var->v.varchar;  break;
+        case mqi_integer: v->v.integer = VARIABLE_integer(n); break;
+        case mqi_unsignd: v->v.unsignd = VARIABLE_unsignd(n); break;
+        case mqi_floating:v->v.floating= VARIABLE_floating(n);break;
+        default:          v->v.data    = NULL;                break;
+        }
+        break;
+
+    default:
+        v->v.integer = n->func(n, data);
+        break;
+    }
+}
+
+static int relop_generic(mdb_cond_node_t *n, void *data)
+{
+    cond_stack_t v1, v2;
+
+    node_value(n->left,  data, &v1.data);
+    node_value(n->right, data, &v2.data);
+
+    v1.precedence = v2.precedence = PRECEDENCE_DATA;
+    v1.data.type  = v2.data.type  = n->left->type;
+
+    return cond_relop(n->op, &v1, &v2);
+}
+
+
+mdb_cond_program_t *mdb_cond_compile(mdb_table_t *tbl, mqi_cond_entry_t *cond)
+{
+    MDB_CHECKARG(tbl, NULL);
+
+    return mdb_cond_compile_columns(tbl->columns, tbl->ncolumn, cond);
+}
+
+mdb_cond_program_t *mdb_cond_compile_columns(mdb_column_t     *columns,
+                                             int               ncolumn,
+                                             mqi_cond_entry_t *cond)
+{
+    cond_compiler_t     c;
+    mdb_cond_program_t *prog;
+    mqi_cond_entry_t   *ce;
+    mdb_cond_node_t    *root;
+    int                 depth;
+    int                 nentry;
+
+    MDB_CHECKARG(columns && ncolumn > 0 && cond, NULL);
+
+    for (ce = cond, depth = 0;   ;   ce++) {
+        if (ce->type == mqi_operator) {
+            if (ce->u.operator_ == mqi_begin)
+                depth++;
+            else if (ce->u.operator_ == mqi_end && depth-- <= 0)
+                break;
+        }
+    }
+
+    /* every entry yields at most one node, groups and the root
+       might need an extra one */
+    nentry = ce - cond;
+    c.nmax = 2 * (nentry + 1);
+
+    if (!(prog = calloc(1, sizeof(*prog) + c.nmax * sizeof(prog->nodes[0]))))
+        return NULL;
+
+    c.columns = columns;
+    c.ncolumn = ncolumn;
+    c.ce      = cond;
+    c.prog    = prog;
+
+    if (!(root = compile_expression(&c, 0)) ||
+        c.ce->type != mqi_operator || c.ce->u.operator_ != mqi_end)
+    {
+        free(prog);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    /* the whole condition is evaluated as if it was parenthesized */
+    if (!(prog->root = compile_group(&c, root))) {
+        free(prog);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return prog;
+}
+
+void mdb_cond_free(mdb_cond_program_t *prog)
+{
+    free(prog);
+}
+
+static mdb_cond_node_t *compile_expression(cond_compiler_t *c, int minprec)
+{
+    mdb_cond_node_t *left, *right;
+    mqi_operator_t   op;
+    int              pr;
+
+    if (!(left = compile_unary(c)))
+        return NULL;
+
+    while (c->ce->type == mqi_operator) {
+        op = c->ce->u.operator_;
+
+        if (op < mqi_and || op > mqi_gt || (pr = precedence[op]) < minprec)
+            break;
+
+        c->ce++;
+
+        if (!(right = compile_expression(c, pr)))
+            return NULL;
+
+        if (op == mqi_and || op == mqi_or)
+            left = compile_logicop(c, op, left, right);
+        else
+            left = compile_relop(c, op, left, right);
+
+        if (!left)
+            return NULL;
+    }
+
+    return left;
+}
+
+static mdb_cond_node_t *compile_unary(cond_compiler_t *c)
+{
+    mqi_cond_entry_t *ce = c->ce;
+    mdb_cond_node_t  *node;
+    mdb_column_t     *col;
+
+    switch (ce->type) {
+
+    case mqi_operator:
+        c->ce++;
+
+        switch (ce->u.operator_) {
+        case mqi_begin:
+            if (!(node = compile_expression(c, 0)))
+                return NULL;
+            if (c->ce->type != mqi_operator || c->ce->u.operator_ != mqi_end)
+                return NULL;
+            c->ce++;
+            return compile_group(c, node);
+
+        case mqi_not:
+            if (!(node = compile_unary(c)))
+                return NULL;
+            return compile_not(c, node);
+
+        default:
+            return NULL;
+        }
+
+    case mqi_column:
+        if (ce->u.column < 0 || ce->u.column >= c->ncolumn)
+            return NULL;
+
+        col = c->columns + ce->u.column;
+
+        if (!(node = new_node(c, NULL, col->type)))
+            return NULL;
+
+        node->kind   = mdb_cond_column;
+        node->offset = col->offset;
+        node->heap   = (col->heap != NULL);
+        node->func   = leaf_function(node);
+        c->ce++;
+        return node;
+
+    case mqi_variable:
+        if (!ce->u.variable.v.generic)
+            return NULL;
+
+        if (!(node = new_node(c, NULL, ce->u.variable.type)))
+            return NULL;
+
+        node->kind = mdb_cond_variable;
+        node->var  = &ce->u.variable;
+        node->func = leaf_function(node);
+        c->ce++;
+        return node;
+
+    default:
+        return NULL;
+    }
+}
+
+static mdb_cond_node_t *compile_relop(cond_compiler_t *c,
+                                      mqi_operator_t   op,
+                                      mdb_cond_node_t *left,
+                                      mdb_cond_node_t *right)
+{
+    static mqi_operator_t flipped[mqi_operator_max] = {
+        [ mqi_less ] = mqi_gt,
+        [ mqi_leq  ] = mqi_geq,
+        [ mqi_eq   ] = mqi_eq,
+        [ mqi_geq  ] = mqi_leq,
+        [ mqi_gt   ] = mqi_less,
+    };
+
+    mdb_cond_func_t *relops;
+    mdb_cond_node_t *column, *variable, *node;
+
+    if (left->type != right->type)
+        return compile_constant(c, 0);
+
+    switch (left->type) {
+    case mqi_varchar:  relops = relop_varchar;  break;
+    case mqi_integer:  relops = relop_integer;  break;
+    case mqi_unsignd:  relops = relop_unsignd;  break;
+    case mqi_floating: relops = relop_floating; break;
+    default:           return compile_constant(c, 0);
+    }
+
+    if (left->kind == mdb_cond_column && right->kind == mdb_cond_variable) {
+        column   = left;
+        variable = right;
+    }
+    else if (left->kind == mdb_cond_variable && right->kind==mdb_cond_column){
+        column   = right;
+        variable = left;
+        op       = flipped[op];
+    }
+    else {
+        if (!(node = new_node(c, relop_generic, mqi_integer)))
+            return NULL;
+
+        node->left   = left;
+        node->right  = right;
+        node->op     = op;
+        return node;
+    }
+
+    if (column->heap)
+        relops = relop_heap;
+
+    /* the leaves are folded into the specialized node */
+    column->func = relops[op];
+    column->kind = mdb_cond_expression;
+    column->type = mqi_integer;
+    column->var  = variable->var;
+
+    return column;
+}
+
+static mdb_cond_node_t *compile_logicop(cond_compiler_t *c,
+                                        mqi_operator_t   op,
+                                        mdb_cond_node_t *left,
+                                        mdb_cond_node_t *right)
+{
+    mdb_cond_node_t *node;
+
+    if (left->type != right->type ||
+        (left->type != mqi_integer && left->type != mqi_unsignd))
+        return compile_constant(c, 0);
+
+    if (!(node = new_node(c, op == mqi_and ? logic_and : logic_or,
+                          mqi_integer)))
+        return NULL;
+
+    node->left  = left;
+    node->right = right;
+
+    return node;
+}
+
+static mdb_cond_node_t *compile_not(cond_compiler_t *c, mdb_cond_node_t *arg)
+{
+    mdb_cond_node_t *node;
+
+    switch (arg->type) {
+    case mqi_varchar:
+    case mqi_integer:
+    case mqi_unsignd:
+        break;
+    default:
+        return compile_constant(c, 0);
+    }
+
+    if (!(node = new_node(c, logic_not, mqi_integer)))
+        return NULL;
+
+    node->left = arg;
+
+    return node;
+}
+
+static mdb_cond_node_t *compile_group(cond_compiler_t *c, mdb_cond_node_t *arg)
+{
+    mdb_cond_func_t  func;
+    mdb_cond_node_t *node;
+
+    if (arg->kind == mdb_cond_expression)
+        return arg;
+
+    /*
+     * mdb_cond_evaluate() takes the integer value of whatever a
+     * parenthesized leaf holds; for strings that is the pointer
+     */
+    switch (arg->type) {
+    case mqi_integer:
+    case mqi_unsignd:
+        func = arg->func;
+        break;
+    case mqi_varchar:
+        if (arg->kind == mdb_cond_column)
+            return compile_constant(c, 1);
+        func = variable_varchar_set;
+        break;
+    default:
+        return compile_constant(c, 0);
+    }
+
+    if (!(node = new_node(c, func, mqi_integer)))
+        return NULL;
+
+    node->offset = arg->offset;
+    node->heap   = arg->heap;
+    node->var    = arg->var;
+
+    return node;
+}
+
+static mdb_cond_node_t *compile_constant(cond_compiler_t *c, int value)
+{
+    return new_node(c, value ? constant_true : constant_false, mqi_integer);
+}
+
+static mdb_cond_node_t *new_node(cond_compiler_t *c,
+                                 mdb_cond_func_t  func,
+                                 mqi_data_type_t  type)
+{
+    mdb_cond_program_t *prog = c->prog;
+    mdb_cond_node_t    *node;
+
+    if (prog->nnode >= c->nmax)
+        return NULL;
+
+    node = prog->nodes + prog->nnode++;
+
+    node->func = func;
+    node->kind = mdb_cond_expression;
+    node->type = type;
+
+    return node;
+}
+
+static mdb_cond_func_t leaf_function(mdb_cond_node_t *n)
+{
+    if (n->kind == mdb_cond_column) {
+        switch (n->type) {
+        case mqi_varchar:  return n->heap ? column_heap_truth :
+                                            column_varchar_truth;
+        case mqi_integer:  return column_integer_truth;
+        case mqi_unsignd:  return column_unsignd_truth;
+        default:           return constant_false;
+        }
+    }
+    else {
+        switch (n->type) {
+        case mqi_varchar:  return variable_varchar_truth;
+        case mqi_integer:  return variable_integer_truth;
+        case mqi_unsignd:  return variable_unsignd_truth;
+        default:           return constant_false;
+        }
+    }
+}
+
 /*
  * Local Variables:
  * c-basic-offset: 4
@@ -30,12 +30,56 @@
 #ifndef __MDB_COND_H__
 #define __MDB_COND_H__
 
+#include <stdbool.h>
 #include <murphy-db/mqi-types.h>
 #include <murphy-db/mdb.h>
+#include "column.h"
+
+
+typedef struct mdb_cond_node_s    mdb_cond_node_t;
+typedef struct mdb_cond_program_s mdb_cond_program_t;
+
+typedef int (*mdb_cond_func_t)(mdb_cond_node_t *, void *);
+
+typedef enum {
+    mdb_cond_expression = 0,
+    mdb_cond_column,
+    mdb_cond_variable,
+} mdb_cond_node_kind_t;
+
+struct mdb_cond_node_s {
+    mdb_cond_func_t       func;   /* truth value of the node for a row */
+    mdb_cond_node_kind_t  kind;
+    mqi_data_type_t       type;   /* type of the value of the node */
+    mqi_operator_t        op;
+    mdb_cond_node_t      *left;
+    mdb_cond_node_t      *right;
+    int                   offset; /* column offset within the row */
+    bool                  heap;   /* an out of line varchar column */
+    mqi_variable_t       *var;
+};
+
+struct mdb_cond_program_s {
+    mdb_cond_node_t *root;
+    int              nnode;
+    mdb_cond_node_t  nodes[0];
+};
 
 
 int mdb_cond_evaluate(mdb_table_t *, mqi_cond_entry_t **, void *);
 
+mdb_cond_program_t *mdb_cond_compile(mdb_table_t *, mqi_cond_entry_t *);
+mdb_cond_program_t *mdb_cond_compile_columns(mdb_column_t *, int,
+                                             mqi_cond_entry_t *);
+void mdb_cond_free(mdb_cond_program_t *);
+
+static inline int mdb_cond_execute(mdb_cond_program_t *prog, void *data)
+{
+    mdb_cond_node_t *root = prog->root;
+
+    return root->func(root, data);
+}
+
 
 #endif /* __MDB_COND_H__ */
 
@@ -44,10 +44,32 @@
 #define HASH_STATISTICS
 #endif
 
+/*
+ * The chain table grows and shrinks with the number of entries. When
+ * the load factor (entries per chain) leaves the [HASH_LOAD_MIN,
+ * HASH_LOAD_MAX] range a new chain table is allocated and the entries
+ * of the old one are migrated over a few chains at a time by the
+ * subsequent add and delete operations. Lookups never migrate, as they
+ * run under the shared read lock: while a migration is in progress they
+ * search both chain tables without changing either of them.
+ */
+#define HASH_LOAD_MAX       2   /* grow if entries > nchain * HASH_LOAD_MAX */
+#define HASH_LOAD_MIN       8   /* shrink if entries < nchain / HASH_LOAD_MIN */
+#define HASH_MIGRATE_STEP   4   /* old chains migrated per operation */
+#define HASH_MIGRATE_SCAN   64  /* max. old chains visited per operation */
+#define HASH_MAX_BITS       30
+
+#define VALID_SIZE(bits, nchain)                                        \
+    ((bits) >= 1 && (bits) <= HASH_MAX_BITS &&                          \
+     (nchain) >= (1 << ((bits)-1)) && (nchain) < (1 << (bits)))
+
+#define FOLD(h)  ((uint32_t)((h) ^ ((h) >> 32)))
+
 typedef struct mdb_hash_entry_s {
     mdb_dlist_t  clink;         /* hash link, ie. chaining */
     mdb_dlist_t  elink;         /* entry link, ie. linking all entries */
     void        *key;
+    int          klen;
     void        *data;
 } hash_entry_t;
 
@@ -61,21 +83,31 @@ typedef struct {
 #endif
 } hash_chain_t;
 
+typedef struct {
+    int           bits;
+    int           nchain;
+    hash_chain_t *chains;
+} chain_table_t;
 
 struct mdb_hash_s {
-    int                  bits;
     mdb_hash_function_t  hfunc;
     mdb_hash_compare_t   hcomp;
     mdb_hash_print_t     hprint;
     struct {
         mdb_dlist_t head;
-#ifdef HASH_STATISTICS
         int         curr;
+#ifdef HASH_STATISTICS
         int         max;
 #endif
     }                    entries;
-    int                  nchain;
-    hash_chain_t         chains[0];
+    chain_table_t        chtbl;      /* current chain table */
+    chain_table_t        old;        /* chain table being migrated, if any */
+    int                  migrate;    /* next chain of old to migrate */
+    int                  min_chain;  /* never shrink below this */
+#ifdef HASH_STATISTICS
+    int                  ngrow;      /* number of times grown */
+    int                  nshrink;    /* number of times shrunk */
+#endif
 };
 
 
@@ -118,7 +150,19 @@ static table_size_t  sizes[]          = {
     {  877, 10}, {  881, 10}, {  883, 10}, {  887, 10}, {  907, 10},
     {  911, 10}, {  919, 10}, {  929, 10}, {  937, 10}, {  941, 10},
     {  947, 10}, {  953, 10}, {  967, 10}, {  971, 10}, {  977, 10},
-    {  983, 10}, {  991, 10}, {  997, 10}, {65535, 16}
+    {  983, 10}, {  991, 10}, {  997, 10}
+};
+
+/* chain counts used when resizing: the largest prime below each 2^n */
+static table_size_t  ladder[]         = {
+    {         3,  2}, {         7,  3}, {        13,  4}, {        31,  5},
+    {        61,  6}, {       127,  7}, {       251,  8}, {       509,  9},
+    {      1021, 10}, {      2039, 11}, {      4093, 12}, {      8191, 13},
+    {     16381, 14}, {     32749, 15}, {     65521, 16}, {    131071, 17},
+    {    262139, 18}, {    524287, 19}, {   1048573, 20}, {   2097143, 21},
+    {   4194301, 22}, {   8388593, 23}, {  16777213, 24}, {  33554393, 25},
+    {  67108859, 26}, { 134217689, 27}, { 268435399, 28}, { 536870909, 29},
+    {1073741789, 30}
 };
 static uint32_t  charmap[256] = {
     /*        00  01  02  03  04  05  06  07  08  09  0a  0b  0c  0d  0e  0f */
@@ -142,7 +186,15 @@ static uint32_t  charmap[256] = {
 
 static void htable_reset(mdb_hash_t *, int);
 static table_size_t *get_table_size(int);
-static int print_chain(mdb_hash_t *, int, char *, int);
+static table_size_t *get_ladder_size(int, int);
+static int chain_table_init(chain_table_t *, table_size_t *);
+static hash_entry_t *find_entry(mdb_hash_t *, int, void *, hash_chain_t **);
+static void resize(mdb_hash_t *, table_size_t *);
+static void check_load(mdb_hash_t *);
+static void migrate(mdb_hash_t *, int);
+static int chain_length(hash_chain_t *);
+static int print_statistics(mdb_hash_t *, char *, int);
+static int print_chain(mdb_hash_t *, chain_table_t *, int, char *, int);
 
 
 mdb_hash_t *mdb_hash_table_create(int                  max_entries,
@@ -152,36 +204,32 @@ mdb_hash_t *mdb_hash_table_create(int                  max_entries,
 {
     mdb_hash_t   *htbl;
     table_size_t *ts;
-    size_t        size;
-    int           i;
 
-    MDB_CHECKARG(hfunc && hcomp && hprint &&
-                 max_entries > 1 && max_entries < 65536, NULL);
+    MDB_CHECKARG(hfunc && hcomp && hprint && max_entries > 1, NULL);
 
     if ((ts = get_table_size(max_entries)) == NULL) {
         errno = EOVERFLOW;
         return NULL;
     }
 
-    size = sizeof(mdb_hash_t) + sizeof(hash_chain_t) * ts->nchain;
-    htbl = calloc(1, size);
+    if (!(htbl = calloc(1, sizeof(mdb_hash_t)))) {
+        errno = ENOMEM;
+        return NULL;
+    }
 
-    if (!htbl) {
+    if (chain_table_init(&htbl->chtbl, ts) < 0) {
+        free(htbl);
         errno = ENOMEM;
         return NULL;
     }
 
-    htbl->bits   = ts->bits;
-    htbl->nchain = ts->nchain;
-    htbl->hfunc  = hfunc;
-    htbl->hcomp  = hcomp;
-    htbl->hprint = hprint;
+    htbl->hfunc     = hfunc;
+    htbl->hcomp     = hcomp;
+    htbl->hprint    = hprint;
+    htbl->min_chain = ts->nchain;
 
     MDB_DLIST_INIT(htbl->entries.head);
 
-    for (i = 0; i < htbl->nchain; i++)
-        MDB_DLIST_INIT(htbl->chains[i].head);
-
     return htbl;
 }
 
@@ -190,6 +238,9 @@ int mdb_hash_table_destroy(mdb_hash_t *htbl)
     MDB_CHECKARG(htbl, -1);
 
     htable_reset(htbl, 0);
+
+    free(htbl->old.chains);
+    free(htbl->chtbl.chains);
     free(htbl);
 
     return 0;
@@ -231,6 +282,7 @@ void *mdb_hash_table_iterate(mdb_hash_t *htbl,void **key_ret,void **cursor_ptr)
 
 int mdb_hash_table_print(mdb_hash_t *htbl, char *buf, int len)
 {
+    chain_table_t *ct;
     char *p, *e;
     int   i;
 
@@ -239,13 +291,17 @@ int mdb_hash_table_print(mdb_hash_t *htbl, char *buf, int len)
     e = (p = buf) + len;
     *buf = '\0';
 
-    for (i = 0;  i < htbl->nchain;  i++) {
-        if (!MDB_DLIST_EMPTY(htbl->chains[i].head)
+    p += print_statistics(htbl, p, e-p);
+
+    for (ct = &htbl->chtbl;  ct;  ct = (ct == &htbl->chtbl) ? &htbl->old:NULL) {
+        for (i = 0;  i < ct->nchain && p < e;  i++) {
+            if (!MDB_DLIST_EMPTY(ct->chains[i].head)
 #ifdef HASH_STATISTICS
-            || htbl->chains[i].entries.max > 0
+                || ct->chains[i].entries.max > 0
 #endif
-            )
-            p += print_chain(htbl, i, p, e-p);
+                )
+                p += print_chain(htbl, ct, i, p, e-p);
+        }
     }
 
     return p - buf;
@@ -255,21 +311,15 @@ int mdb_hash_add(mdb_hash_t *htbl, int klen, void *key, void *data)
 {
     hash_entry_t *entry;
     hash_chain_t *chain;
-    int           index;
 
     MDB_CHECKARG(htbl && key && klen >= 0 && data, -1);
 
-    index = htbl->hfunc(htbl->bits, htbl->nchain, klen, key);
-    chain = htbl->chains + index;
-
-    MDB_DLIST_FOR_EACH(hash_entry_t, clink, entry, &chain->head) {
-        if (htbl->hcomp(klen, key, entry->key) == 0) {
-            if (data == entry->data)
-                return 0;
-            else {
-                errno = EEXIST;
-                return -1;
-            }
+    if ((entry = find_entry(htbl, klen, key, &chain)) != NULL) {
+        if (data == entry->data)
+            return 0;
+        else {
+            errno = EEXIST;
+            return -1;
         }
     }
 
@@ -278,53 +328,53 @@ int mdb_hash_add(mdb_hash_t *htbl, int klen, void *key, void *data)
         return -1;
     }
     entry->key  = key;
+    entry->klen = klen;
     entry->data = data;
 
     MDB_DLIST_APPEND(hash_entry_t, clink, entry, &chain->head);
     MDB_DLIST_APPEND(hash_entry_t, elink, entry, &htbl->entries.head);
 
+    htbl->entries.curr++;
+
 #ifdef HASH_STATISTICS
     if (++chain->entries.curr > chain->entries.max)
         chain->entries.max = chain->entries.curr;
 
-    if (++htbl->entries.curr > htbl->entries.max)
+    if (htbl->entries.curr > htbl->entries.max)
         htbl->entries.max = htbl->entries.curr;
 #endif
 
+    check_load(htbl);
+
     return 0;
 }
 
 void *mdb_hash_delete(mdb_hash_t *htbl, int klen, void *key)
 {
     hash_entry_t *entry;
-    hash_entry_t *n;
     hash_chain_t *chain;
-    int           index;
     void         *data;
 
     MDB_CHECKARG(htbl && klen >= 0 && key, NULL);
 
-    index = htbl->hfunc(htbl->bits, htbl->nchain, klen, key);
-    chain = htbl->chains + index;
-
-    MDB_DLIST_FOR_EACH_SAFE(hash_entry_t, clink, entry,n, &chain->head) {
-        if (htbl->hcomp(klen, key, entry->key) == 0) {
-            if (!(data = entry->data))
-                break;
+    if ((entry = find_entry(htbl, klen, key, &chain)) != NULL &&
+        (data = entry->data) != NULL)
+    {
+        MDB_DLIST_UNLINK(hash_entry_t, clink, entry);
+        MDB_DLIST_UNLINK(hash_entry_t, elink, entry);
+        free(entry);
 
-            MDB_DLIST_UNLINK(hash_entry_t, clink, entry);
-            MDB_DLIST_UNLINK(hash_entry_t, elink, entry);
-            free(entry);
+        if (--htbl->entries.curr < 0)
+            htbl->entries.curr = 0;
 
 #ifdef HASH_STATISTICS
-            if (--chain->entries.curr < 0)
-                chain->entries.curr = 0;
-
-            if (--htbl->entries.curr < 0)
-                htbl->entries.curr = 0;
+        if (--chain->entries.curr < 0)
+            chain->entries.curr = 0;
 #endif
-            return data;
-        }
+
+        check_load(htbl);
+
+        return data;
     }
 
     errno = ENOENT;
@@ -334,24 +384,16 @@ void *mdb_hash_delete(mdb_hash_t *htbl, int klen, void *key)
 void *mdb_hash_get_data(mdb_hash_t *htbl, int klen, void *key)
 {
     hash_entry_t *entry;
-    hash_chain_t *chain;
-    int           index;
 
     MDB_CHECKARG(htbl && klen >= 0 && key, NULL);
 
-    index = htbl->hfunc(htbl->bits, htbl->nchain, klen, key);
-    chain = htbl->chains + index;
-
-    MDB_DLIST_FOR_EACH(hash_entry_t, clink, entry, &chain->head) {
-        if (htbl->hcomp(klen, key, entry->key) == 0)
-            return entry->data;
-    }
+    if ((entry = find_entry(htbl, klen, key, NULL)) != NULL)
+        return entry->data;
 
     errno = ENOENT;
     return NULL;
 }
 
-
 int mdb_hash_function_integer(int bits, int nchain, int klen, void *key)
 {
     return mdb_hash_function_unsignd(bits, nchain, klen, key);
@@ -362,9 +404,7 @@ int mdb_hash_function_unsignd(int bits, int nchain, int klen, void *key)
 {
     uint32_t unsignd;
 
-    if (klen != sizeof(unsignd) || !key ||
-        bits < 1 || bits > 16 ||
-        nchain < (1 << (bits-1)) || nchain >= (1 << bits))
+    if (klen != sizeof(unsignd) || !key || !VALID_SIZE(bits, nchain))
         return 0;
 
     unsignd = *(uint32_t *)key;
@@ -375,41 +415,19 @@ int mdb_hash_function_unsignd(int bits, int nchain, int klen, void *key)
 
 int mdb_hash_function_string(int bits, int nchain, int klen, void *key)
 {
-    typedef union {
-        uint64_t wide;
-        uint8_t  narrow[8];
-    } hash_t;
-
-    (void)klen;
-
     uint8_t *varchar = (uint8_t *)key;
-    int      hashval = 0;
-    hash_t   h;
-    int      shift;
-
-    if (varchar && bits >= 1 && bits <= 16 &&
-        nchain > (1 << (bits-1)) && nchain < (1 << bits))
-    {
-        uint8_t s;
-        int     i;
+    uint64_t h;
+    uint8_t  s;
 
-        for (h.wide = 0; (s = *varchar); varchar++)
-            h.wide = 33ULL * h.wide + (uint64_t)charmap[s];
+    (void)klen;
 
-        if (bits <= 8) {
-            hashval = h.narrow[0] ^ h.narrow[1] ^ h.narrow[2] ^ h.narrow[3] ^
-                      h.narrow[4] ^ h.narrow[5] ^ h.narrow[6] ^ h.narrow[7];
-        }
-        else {
-            shift = (nchain + 7) / 8;
-            for (hashval = h.narrow[0], i = 1;   i < 8;  i++)
-                hashval ^= h.narrow[i] << (i * shift);
-        }
+    if (!varchar || !VALID_SIZE(bits, nchain))
+        return 0;
 
-        hashval %= nchain;
-    }
+    for (h = 0; (s = *varchar); varchar++)
+        h = 33ULL * h + (uint64_t)charmap[s];
 
-    return hashval;
+    return (int)(FOLD(h) % (uint32_t)nchain);
 }
 
 int mdb_hash_function_pointer(int bits, int nchain, int klen, void *key)
@@ -423,7 +441,7 @@ int mdb_hash_function_pointer(int bits, int nchain, int klen, void *key)
 #if __SIZEOF_POINTER__ == 8
     hash = (int)(((uint64_t)key >> 2) & MASK(64)) % nchain;
 #else
-    hash = ((int)key >> 2) & MASK(32) % nchain;
+    hash = (((int)key >> 2) & MASK(32)) % nchain;
 #endif
 
     return hash;
@@ -437,49 +455,28 @@ int mdb_hash_function_varchar(int bits, int nchain, int klen, void *key)
 
 int mdb_hash_function_blob(int bits, int nchain, int klen, void *key)
 {
-    typedef union {
-        uint64_t wide;
-        uint8_t  narrow[8];
-    } hash_t;
-
     uint8_t *data  = (uint8_t *)key;
-    int      hashval = 0;
-    hash_t   h;
-    int      shift;
+    uint64_t h;
     int      i;
 
-    if (klen > 0 && data && bits >= 1 && bits <= 16 &&
-        nchain > (1 << (bits-1)) && nchain < (1 << bits))
-    {
-        for (i = 0, h.wide = 0;   i < klen;   i++)
-            h.wide = 33ULL * h.wide + (uint64_t)data[i];
-
-        if (bits <= 8) {
-            hashval = h.narrow[0] ^ h.narrow[1] ^ h.narrow[2] ^ h.narrow[3] ^
-                      h.narrow[4] ^ h.narrow[5] ^ h.narrow[6] ^ h.narrow[7];
-        }
-        else {
-            shift = (nchain + 7) / 8;
-            for (hashval = h.narrow[0], i = 1;   i < 8;  i++)
-                hashval ^= h.narrow[i] << (i * shift);
-        }
+    if (klen <= 0 || !data || !VALID_SIZE(bits, nchain))
+        return 0;
 
-        hashval %= nchain;
-    }
+    for (i = 0, h = 0;   i < klen;   i++)
+        h = 33ULL * h + (uint64_t)data[i];
 
-    return hashval;
+    return (int)(FOLD(h) % (uint32_t)nchain);
 }
 
-
-
 static void htable_reset(mdb_hash_t *htbl, int do_chain_statistics)
 {
     hash_entry_t *entry;
     hash_entry_t *n;
+    table_size_t *ts;
 #ifdef HASH_STATISTICS
     int i;
 #else
-    (void)do_statistics;
+    (void)do_chain_statistics;
 #endif
 
     MDB_DLIST_FOR_EACH_SAFE(hash_entry_t, elink, entry,n, &htbl->entries.head){
@@ -488,14 +485,32 @@ static void htable_reset(mdb_hash_t *htbl, int do_chain_statistics)
         free(entry);
     }
 
-#ifdef HASH_STATISTICS
-    if (do_chain_statistics) {
-        for (i = 0;   i < htbl->nchain;   i++) {
-            htbl->chains[i].entries.curr = 0;
+    htbl->entries.curr = 0;
+
+    if (htbl->old.chains) {
+        free(htbl->old.chains);
+        memset(&htbl->old, 0, sizeof(htbl->old));
+        htbl->migrate = 0;
+    }
+
+    if (!do_chain_statistics)
+        return;
+
+    /* an emptied table goes back to its initial size */
+    if (htbl->chtbl.nchain != htbl->min_chain &&
+        (ts = get_table_size(htbl->min_chain)) != NULL)
+    {
+        chain_table_t ct;
+
+        if (chain_table_init(&ct, ts) == 0) {
+            free(htbl->chtbl.chains);
+            htbl->chtbl = ct;
         }
     }
 
-    htbl->entries.curr = 0;
+#ifdef HASH_STATISTICS
+    for (i = 0;   i < htbl->chtbl.nchain;   i++)
+        htbl->chtbl.chains[i].entries.curr = 0;
 #endif
 }
 
@@ -509,6 +524,9 @@ static table_size_t *get_table_size(int max_entries)
     int iterations = 0;
 #endif
 
+    if (max_entries > sizes[max].nchain)
+        return get_ladder_size(max_entries, +1);
+
     for (;;) {
 #ifdef DEBUG
         iterations++;
@@ -537,9 +555,259 @@ static table_size_t *get_table_size(int max_entries)
     return sizes + idx;
 }
 
-static int print_chain(mdb_hash_t *htbl, int index, char *buf, int len)
+static table_size_t *get_ladder_size(int nchain, int direction)
+{
+    int dim = sizeof(ladder)/sizeof(ladder[0]);
+    int i;
+
+    if (direction > 0) {
+        for (i = 0;  i < dim;  i++) {
+            if (ladder[i].nchain >= nchain)
+                return ladder + i;
+        }
+        return ladder + (dim - 1);
+    }
+    else {
+        for (i = dim - 1;  i >= 0;  i--) {
+            if (ladder[i].nchain <= nchain)
+                return ladder + i;
+        }
+        return ladder;
+    }
+}
+
+static int chain_table_init(chain_table_t *ct, table_size_t *ts)
+{
+    int i;
+
+    if (!(ct->chains = calloc(ts->nchain, sizeof(hash_chain_t))))
+        return -1;
+
+    ct->bits   = ts->bits;
+    ct->nchain = ts->nchain;
+
+    for (i = 0;  i < ct->nchain;  i++)
+        MDB_DLIST_INIT(ct->chains[i].head);
+
+    return 0;
+}
+
+static inline hash_chain_t *get_chain(mdb_hash_t    *htbl,
+                                      chain_table_t *ct,
+                                      int            klen,
+                                      void          *key)
+{
+    return ct->chains + htbl->hfunc(ct->bits, ct->nchain, klen, key);
+}
+
+static hash_entry_t *find_entry(mdb_hash_t    *htbl,
+                                int            klen,
+                                void          *key,
+                                hash_chain_t **chain_ret)
+{
+    hash_entry_t *entry;
+    hash_chain_t *chain, *old;
+
+    chain = get_chain(htbl, &htbl->chtbl, klen, key);
+
+    if (chain_ret)
+        *chain_ret = chain;
+
+    MDB_DLIST_FOR_EACH(hash_entry_t, clink, entry, &chain->head) {
+        if (htbl->hcomp(klen, key, entry->key) == 0)
+            return entry;
+    }
+
+    if (htbl->old.chains) {
+        old = get_chain(htbl, &htbl->old, klen, key);
+
+        MDB_DLIST_FOR_EACH(hash_entry_t, clink, entry, &old->head) {
+            if (htbl->hcomp(klen, key, entry->key) == 0) {
+                if (chain_ret)
+                    *chain_ret = old;
+                return entry;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void resize(mdb_hash_t *htbl, table_size_t *ts)
+{
+    chain_table_t ct;
+
+    if (ts->nchain == htbl->chtbl.nchain)
+        return;
+
+    /* finish any ongoing migration before starting a new one */
+    if (htbl->old.chains)
+        migrate(htbl, htbl->old.nchain);
+
+    if (chain_table_init(&ct, ts) < 0)
+        return;                 /* not fatal, we just keep the old size */
+
+#ifdef HASH_STATISTICS
+    if (ts->nchain > htbl->chtbl.nchain)
+        htbl->ngrow++;
+    else
+        htbl->nshrink++;
+#endif
+
+    htbl->old     = htbl->chtbl;
+    htbl->chtbl   = ct;
+    htbl->migrate = 0;
+
+    migrate(htbl, HASH_MIGRATE_STEP);
+}
+
+static void check_load(mdb_hash_t *htbl)
+{
+    int           nchain  = htbl->chtbl.nchain;
+    int           entries = htbl->entries.curr;
+    table_size_t *ts;
+
+    if (htbl->old.chains) {
+        migrate(htbl, HASH_MIGRATE_STEP);
+
+        if (htbl->old.chains)
+            return;
+    }
+
+    if (entries > nchain * HASH_LOAD_MAX && nchain < INT_MAX / 2)
+        resize(htbl, get_ladder_size(nchain * 2, +1));
+    else if (entries < nchain / HASH_LOAD_MIN && nchain > htbl->min_chain) {
+        ts = get_ladder_size(nchain / 2, -1);
+
+        if (ts->nchain <= htbl->min_chain)
+            ts = get_table_size(htbl->min_chain);
+
+        resize(htbl, ts);
+    }
+}
+
+static void migrate(mdb_hash_t *htbl, int nchain)
+{
+    hash_chain_t *src, *dst;
+    hash_entry_t *entry, *n;
+    int           nscan;
+
+    /*
+     * Migrate nchain non-empty chains, but skip over empty ones at most
+     * HASH_MIGRATE_SCAN at a time, so a sparse table (after a shrink) is
+     * migrated quickly without making a single operation too costly.
+     */
+    nscan = nchain < HASH_MIGRATE_SCAN ? HASH_MIGRATE_SCAN : nchain;
+
+    while (nchain > 0 && nscan-- > 0 && htbl->migrate < htbl->old.nchain) {
+        src = htbl->old.chains + htbl->migrate++;
+
+        if (MDB_DLIST_EMPTY(src->head))
+            continue;
+
+        nchain--;
+
+        MDB_DLIST_FOR_EACH_SAFE(hash_entry_t, clink, entry,n, &src->head) {
+            dst = get_chain(htbl, &htbl->chtbl, entry->klen, entry->key);
+
+            MDB_DLIST_UNLINK(hash_entry_t, clink, entry);
+            MDB_DLIST_APPEND(hash_entry_t, clink, entry, &dst->head);
+
+#ifdef HASH_STATISTICS
+            if (++dst->entries.curr > dst->entries.max)
+                dst->entries.max = dst->entries.curr;
+#endif
+        }
+    }
+
+    if (htbl->migrate >= htbl->old.nchain) {
+        free(htbl->old.chains);
+        memset(&htbl->old, 0, sizeof(htbl->old));
+        htbl->migrate = 0;
+    }
+}
+
+static int chain_length(hash_chain_t *chain)
+{
+    mdb_dlist_t *link;
+    int          length;
+
+    for (length = 0, link = chain->head.next;  link != &chain->head;
+         link = link->next)
+        length++;
+
+    return length;
+}
+
+static int print_statistics(mdb_hash_t *htbl, char *buf, int len)
+{
+#define HISTOGRAM_SIZE 6
+    chain_table_t *ct = &htbl->chtbl;
+    int   histogram[HISTOGRAM_SIZE];
+    int   i, l, longest, used, total;
+    char *p, *e;
+
+    memset(histogram, 0, sizeof(histogram));
+
+    for (i = longest = used = total = 0;  i < ct->nchain;  i++) {
+        l = chain_length(ct->chains + i);
+
+        if (l > longest)
+            longest = l;
+        if (l > 0) {
+            used++;
+            total += l;
+        }
+
+        histogram[l < HISTOGRAM_SIZE ? l : HISTOGRAM_SIZE - 1]++;
+    }
+
+    e = (p = buf) + len;
+
+    p += snprintf(p, e-p, "   entries: %d, chains: %d (%d bits), "
+                  "load: %.2f\n", htbl->entries.curr, ct->nchain, ct->bits,
+                  (double)htbl->entries.curr / (double)ct->nchain);
+
+    if (p < e) {
+        p += snprintf(p, e-p, "   chain length: longest %d, average %.2f, "
+                      "%d empty\n", longest,
+                      used ? (double)total / (double)used : 0.0,
+                      ct->nchain - used);
+    }
+
+    if (p < e) {
+        p += snprintf(p, e-p, "   chain length histogram:");
+        for (i = 0;  i < HISTOGRAM_SIZE && p < e;  i++) {
+            p += snprintf(p, e-p, " %d%s:%d", i,
+                          i == HISTOGRAM_SIZE - 1 ? "+" : "", histogram[i]);
+        }
+        if (p < e)
+            p += snprintf(p, e-p, "\n");
+    }
+
+#ifdef HASH_STATISTICS
+    if (p < e) {
+        p += snprintf(p, e-p, "   max. entries: %d, resized: %d up, %d down\n",
+                      htbl->entries.max, htbl->ngrow, htbl->nshrink);
+    }
+#endif
+
+    if (htbl->old.chains && p < e) {
+        p += snprintf(p, e-p, "   migrating from %d chains: %d/%d done\n",
+                      htbl->old.nchain, htbl->migrate, htbl->old.nchain);
+    }
+
+    return (p < e ? p : e) - buf;
+#undef HISTOGRAM_SIZE
+}
+
+static int print_chain(mdb_hash_t    *htbl,
+                       chain_table_t *ct,
+                       int            index,
+                       char          *buf,
+                       int            len)
 {
-    hash_chain_t *chain = htbl->chains + index;
+    hash_chain_t *chain = ct->chains + index;
     hash_entry_t *entry;
     char *p, *e;
     char key[256];
@@ -547,10 +815,12 @@ static int print_chain(mdb_hash_t *htbl, int index, char *buf, int len)
     e = (p = buf) + len;
 
 #ifdef HASH_STATISTICS
-    p += snprintf(p, e-p, "   %05d: %d/%d\n",
-                  index, chain->entries.curr, chain->entries.max);
+    p += snprintf(p, e-p, "   %05d%s: %d/%d\n", index,
+                  ct == &htbl->old ? " (old)" : "",
+                  chain->entries.curr, chain->entries.max);
 #else
-    p += snprintf(p, e-p, "   %05d\n", index);
+    p += snprintf(p, e-p, "   %05d%s\n", index,
+                  ct == &htbl->old ? " (old)" : "");
 #endif
 
     MDB_DLIST_FOR_EACH(hash_entry_t, clink, entry, &chain->head) {
@@ -562,7 +832,7 @@ static int print_chain(mdb_hash_t *htbl, int index, char *buf, int len)
         p += snprintf(p, e-p, "      '%s' / %p\n", key, entry->data);
     }
 
-    return p - buf;
+    return (p < e ? p : e) - buf;
 }
 
 /*
@@ -48,12 +48,28 @@
 #define INDEX_HASH_CREATE(t)        MDB_HASH_TABLE_CREATE(t,100)
 #define INDEX_SEQUENCE_CREATE(t)    MDB_SEQUENCE_TABLE_CREATE(t,16)
 
+#define INDEX_HEAP_SEQUENCE_CREATE()    heap_sequence_create()
+
 #define INDEX_HASH_DROP(ix)         mdb_hash_table_destroy(ix->hash)
 #define INDEX_SEQUENCE_DROP(ix)     mdb_sequence_table_destroy(ix->sequence)
 
 #define INDEX_HASH_RESET(ix)        mdb_hash_table_reset(ix->hash)
 #define INDEX_SEQUENCE_RESET(ix)    mdb_sequence_table_reset(ix->sequence)
 
+static int  secondary_insert(mdb_table_t *, mdb_secondary_index_t *,
+                             mdb_row_t *);
+static void secondary_delete(mdb_table_t *, mdb_secondary_index_t *,
+                             mdb_row_t *);
+static void secondary_reset(mdb_secondary_index_t *);
+static void secondary_destroy(mdb_table_t *, mdb_secondary_index_t *);
+static void row_key(mdb_table_t *, mdb_secondary_index_t *, mdb_row_t *,
+                    uint8_t *);
+static mdb_sequence_t *heap_sequence_create(void);
+static int  heap_string_compare(int, void *, void *);
+static int  heap_string_print(void *, char *, int);
+static int  heap_string_copy(void *, void *);
+static void heap_string_free(void *);
+static uint32_t slot_hash(uint32_t, mdb_column_t *, const void *);
 
 
 int mdb_index_create(mdb_table_t *tbl, char **index_columns)
@@ -83,7 +99,7 @@ int mdb_index_create(mdb_table_t *tbl, char **index_columns)
         col->flags |= MQI_COLUMN_KEY;
 
         if (i == 0) {
-            type = col->type;
+            type = col->heap ? mqi_blob : col->type;
             beg  = col->offset;
             end  = beg + col->length;
         }
@@ -147,7 +163,10 @@ int mdb_index_create(mdb_table_t *tbl, char **index_columns)
         break;
     case mqi_blob:
         ix->hash = INDEX_HASH_CREATE(blob);
-        ix->sequence = INDEX_SEQUENCE_CREATE(blob);
+        if (i == 1 && tbl->columns[idxcols[0]].heap)
+            ix->sequence = INDEX_HEAP_SEQUENCE_CREATE();
+        else
+            ix->sequence = INDEX_SEQUENCE_CREATE(blob);
         break;
     default:
         free(idxcols);
@@ -160,10 +179,15 @@ int mdb_index_create(mdb_table_t *tbl, char **index_columns)
 
 void mdb_index_drop(mdb_table_t *tbl)
 {
-    mdb_index_t *ix;
+    mdb_index_t           *ix;
+    mdb_secondary_index_t *six, *n;
 
     MDB_CHECKARG(tbl,);
 
+    MDB_DLIST_FOR_EACH_SAFE(mdb_secondary_index_t, link, six,n,
+                            &tbl->secondary)
+        secondary_destroy(tbl, six);
+
     ix = &tbl->index;
 
     if (MDB_INDEX_DEFINED(ix)) {
@@ -180,10 +204,14 @@ void mdb_index_drop(mdb_table_t *tbl)
 
 void mdb_index_reset(mdb_table_t *tbl)
 {
-    mdb_index_t *ix;
+    mdb_index_t           *ix;
+    mdb_secondary_index_t *six;
 
     MDB_CHECKARG(tbl,);
 
+    MDB_DLIST_FOR_EACH(mdb_secondary_index_t, link, six, &tbl->secondary)
+        secondary_reset(six);
+
     ix = &tbl->index;
 
     if (MDB_INDEX_DEFINED(ix)) {
@@ -210,8 +238,11 @@ int mdb_index_insert(mdb_table_t   *tbl,
 
     ix = &tbl->index;
 
-    if (!MDB_INDEX_DEFINED(ix))
+    if (!MDB_INDEX_DEFINED(ix)) {
+        if (mdb_index_insert_secondary(tbl, row) < 0)
+            return -1;
         return 1;               /* fake a sucessful insertion */
+    }
 
     hash = ix->hash;
     seq  = ix->sequence;
@@ -220,6 +251,12 @@ int mdb_index_insert(mdb_table_t   *tbl,
 
     if (mdb_hash_add(hash, lgh,key, row) == 0) {
         mdb_sequence_add(seq, lgh,key, row);
+        if (mdb_index_insert_secondary(tbl, row) < 0) {
+            /* keep the primary index in line with the secondary ones */
+            mdb_hash_delete(hash, lgh,key);
+            mdb_sequence_delete(seq, lgh,key);
+            return -1;
+        }
         return 1;
     }
 
@@ -244,14 +281,26 @@ int mdb_index_insert(mdb_table_t   *tbl,
             return -1;
         }
         else {
+            mdb_index_delete_secondary(tbl, old);
+
+            mdb_hash_add(hash, lgh,key, row);
+            mdb_sequence_add(seq, lgh,key, row);
+
+            if (mdb_index_insert_secondary(tbl, row) < 0) {
+                /* put the original row back in place of the new one */
+                mdb_hash_delete(hash, lgh,key);
+                mdb_sequence_delete(seq, lgh,key);
+                mdb_hash_add(hash, lgh,key, old);
+                mdb_sequence_add(seq, lgh,key, old);
+                mdb_index_insert_secondary(tbl, old);
+                return -1;
+            }
+
             if (mdb_row_delete(tbl, old, 0,0) < 0 ||
                 mdb_log_change(tbl, txdepth, mdb_log_update,cmask,old,row) < 0)
             {
                 return -1;
             }
-
-            mdb_hash_add(hash, lgh,key, row);
-            mdb_sequence_add(seq, lgh,key, row);
         }
     }
     else { /* duplicate insertion is an error. keep the original row */
@@ -274,6 +323,8 @@ int mdb_index_delete(mdb_table_t *tbl, mdb_row_t *row)
 
     ix = &tbl->index;
 
+    mdb_index_delete_secondary(tbl, row);
+
     if (!MDB_INDEX_DEFINED(ix))
         return 0;
 
@@ -303,13 +354,305 @@ mdb_row_t *mdb_index_get_row(mdb_table_t *tbl, int idxlen, void *idxval)
     return mdb_hash_get_data(ix->hash, idxlen, idxval);
 }
 
+/*
+ * Primary keys are hashed by value into MDB_TABLE_KEY_STAMPS slots. A
+ * key and a row with the same values land in the same slot whether a
+ * string of them is stored inline or out of line, or not stored at all.
+ */
+int mdb_index_row_slot(mdb_table_t *tbl, mdb_row_t *row)
+{
+    mdb_index_t  *ix;
+    mdb_column_t *col;
+    uint32_t      hash;
+    int           i;
+
+    MDB_CHECKARG(tbl && row, -1);
+
+    ix = &tbl->index;
+
+    if (!MDB_INDEX_DEFINED(ix))
+        return -1;
+
+    for (i = 0, hash = 2166136261U;  i < ix->ncolumn;  i++) {
+        col  = tbl->columns + ix->columns[i];
+        hash = slot_hash(hash, col, mdb_column_value(col, row->data));
+    }
+
+    return hash % MDB_TABLE_KEY_STAMPS;
+}
+
+int mdb_index_key_slot(mdb_table_t *tbl, mqi_variable_t *vars)
+{
+    mdb_index_t    *ix;
+    mdb_column_t   *col;
+    mqi_variable_t *var;
+    const void     *value;
+    uint32_t        hash;
+    int             i;
+
+    MDB_CHECKARG(tbl && vars, -1);
+
+    ix = &tbl->index;
+
+    if (!MDB_INDEX_DEFINED(ix))
+        return -1;
+
+    for (i = 0, hash = 2166136261U;  i < ix->ncolumn;  i++) {
+        var = vars + i;
+        col = tbl->columns + ix->columns[i];
+
+        if (col->type != var->type) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        if (col->type == mqi_varchar) {
+            if (!(value = *var->v.varchar))
+                value = "";
+        }
+        else
+            value = var->v.generic;
+
+        hash = slot_hash(hash, col, value);
+    }
+
+    return hash % MDB_TABLE_KEY_STAMPS;
+}
+
+int mdb_index_create_secondary(mdb_table_t      *tbl,
+                               const char       *name,
+                               mqi_index_type_t  itype,
+                               char            **index_columns)
+{
+    mdb_secondary_index_t *six;
+    mdb_column_t          *col;
+    mdb_row_t             *row;
+    int                    ncolumn, length;
+    int                    i, j, idx;
+
+    MDB_CHECKARG(tbl && name && name[0] && index_columns && index_columns[0] &&
+                 (itype == mqi_index_hash || itype == mqi_index_ordered), -1);
+
+    if (mdb_index_find_secondary(tbl, name)) {
+        errno = EEXIST;
+        return -1;
+    }
+
+    for (ncolumn = 0;  index_columns[ncolumn];  ncolumn++)
+        ;
+
+    if (!(six = calloc(1, sizeof(*six)))                    ||
+        !(six->name    = strdup(name))                      ||
+        !(six->columns = calloc(ncolumn, sizeof(int)))      ||
+        !(six->koffset = calloc(ncolumn, sizeof(int)))       )
+    {
+        errno = ENOMEM;
+        goto failed;
+    }
+
+    for (i = length = 0;   i < ncolumn;   i++) {
+        idx = mdb_hash_get_data(tbl->chash, 0,index_columns[i]) - NULL;
+
+        if (!idx) {
+            errno = ENOENT;
+            goto failed;
+        }
+
+        for (j = 0;  j < i;  j++) {
+            if (six->columns[j] == idx - 1) {
+                errno = EINVAL;
+                goto failed;
+            }
+        }
+
+        col = tbl->columns + (six->columns[i] = idx - 1);
+
+        six->koffset[i] = length;
+        length += col->length;
+    }
+
+    if (length > MDB_INDEX_LENGTH_MAX) {
+        errno = EOVERFLOW;
+        goto failed;
+    }
+
+    six->itype   = itype;
+    six->length  = length;
+    six->ncolumn = ncolumn;
+    six->type    = mqi_blob;
+
+    if (ncolumn == 1 && !(col = tbl->columns + six->columns[0])->heap)
+        six->type = col->type;
+
+    switch (six->type) {
+    case mqi_varchar:
+        six->hash = INDEX_HASH_CREATE(varchar);
+        if (itype == mqi_index_ordered)
+            six->sequence = INDEX_SEQUENCE_CREATE(varchar);
+        break;
+    case mqi_integer:
+        six->hash = INDEX_HASH_CREATE(integer);
+        if (itype == mqi_index_ordered)
+            six->sequence = INDEX_SEQUENCE_CREATE(integer);
+        break;
+    case mqi_unsignd:
+        six->hash = INDEX_HASH_CREATE(unsignd);
+        if (itype == mqi_index_ordered)
+            six->sequence = INDEX_SEQUENCE_CREATE(unsignd);
+        break;
+    default:
+        six->type = mqi_blob;
+        six->hash = INDEX_HASH_CREATE(blob);
+        if (itype != mqi_index_ordered)
+            break;
+        if (ncolumn == 1 && tbl->columns[six->columns[0]].heap)
+            six->sequence = INDEX_HEAP_SEQUENCE_CREATE();
+        else
+            six->sequence = INDEX_SEQUENCE_CREATE(blob);
+        break;
+    }
+
+    if (!six->hash || (itype == mqi_index_ordered && !six->sequence)) {
+        errno = ENOMEM;
+        goto failed;
+    }
+
+    MDB_DLIST_APPEND(mdb_secondary_index_t, link, six, &tbl->secondary);
+
+    for (i = 0;  i < ncolumn;  i++)
+        tbl->columns[six->columns[i]].nindex++;
+
+    MDB_DLIST_FOR_EACH(mdb_row_t, link, row, &tbl->rows) {
+        if (secondary_insert(tbl, six, row) < 0) {
+            secondary_destroy(tbl, six);
+            return -1;
+        }
+    }
+
+    return 0;
+
+ failed:
+    if (six) {
+        if (six->hash)
+            mdb_hash_table_destroy(six->hash);
+        if (six->sequence)
+            mdb_sequence_table_destroy(six->sequence);
+        free(six->koffset);
+        free(six->columns);
+        free(six->name);
+        free(six);
+    }
+    return -1;
+}
+
+int mdb_index_drop_secondary(mdb_table_t *tbl, const char *name)
+{
+    mdb_secondary_index_t *six;
+
+    MDB_CHECKARG(tbl && name, -1);
+
+    if (!(six = mdb_index_find_secondary(tbl, name))) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    secondary_destroy(tbl, six);
+
+    return 0;
+}
+
+mdb_secondary_index_t *mdb_index_find_secondary(mdb_table_t *tbl,
+                                                const char  *name)
+{
+    mdb_secondary_index_t *six;
+
+    MDB_CHECKARG(tbl && name, NULL);
+
+    MDB_DLIST_FOR_EACH(mdb_secondary_index_t, link, six, &tbl->secondary) {
+        if (!strcmp(name, six->name))
+            return six;
+    }
+
+    return NULL;
+}
+
+int mdb_index_secondary_key(mdb_table_t           *tbl,
+                            mdb_secondary_index_t *six,
+                            mqi_variable_t        *vars,
+                            void                  *key)
+{
+    mdb_column_t       *col, kcol;
+    mqi_variable_t     *var;
+    mqi_column_desc_t   src;
+    int                 i;
+
+    MDB_CHECKARG(tbl && six && vars && key, -1);
+
+    memset(key, 0, six->length);
+    src.offset = 0;
+
+    for (i = 0;   i < six->ncolumn;   i++) {
+        var = vars + i;
+        col = tbl->columns + (src.cindex = six->columns[i]);
+
+        if (col->type != var->type) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        kcol = *col;
+        kcol.offset = six->koffset[i];
+
+        mdb_column_write_key(&kcol, key, &src, var->v.generic);
+    }
+
+    return six->length;
+}
+
+mdb_index_bucket_t *mdb_index_get_bucket(mdb_secondary_index_t *six, void *key)
+{
+    MDB_CHECKARG(six && key, NULL);
+
+    return mdb_hash_get_data(six->hash, six->length, key);
+}
+
+int mdb_index_insert_secondary(mdb_table_t *tbl, mdb_row_t *row)
+{
+    mdb_secondary_index_t *six, *done;
+
+    MDB_DLIST_FOR_EACH(mdb_secondary_index_t, link, six, &tbl->secondary) {
+        if (secondary_insert(tbl, six, row) < 0) {
+            /* on failure the row is left in none of the indexes */
+            MDB_DLIST_FOR_EACH(mdb_secondary_index_t, link, done,
+                               &tbl->secondary) {
+                if (done == six)
+                    break;
+                secondary_delete(tbl, done, row);
+            }
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void mdb_index_delete_secondary(mdb_table_t *tbl, mdb_row_t *row)
+{
+    mdb_secondary_index_t *six;
+
+    MDB_DLIST_FOR_EACH(mdb_secondary_index_t, link, six, &tbl->secondary)
+        secondary_delete(tbl, six, row);
+}
+
+
 int mdb_index_print(mdb_table_t *tbl, char *buf, int len)
 {
 #define PRINT(args...)  if (e > p) p += snprintf(p, e-p, args)
-    mdb_index_t *ix;
-    const char  *sep;
-    char        *p, *e;
-    int          i;
+    mdb_index_t           *ix;
+    mdb_secondary_index_t *six;
+    const char            *sep;
+    char                  *p, *e;
+    int                    i;
 
     MDB_CHECKARG(tbl && buf && len > 0, 0);
 
@@ -328,12 +671,243 @@ int mdb_index_print(mdb_table_t *tbl, char *buf, int len)
           "\n    %-7s   %4d   %4d\n",
           mqi_data_type_str(ix->type), ix->offset, ix->length);
 
+    MDB_DLIST_FOR_EACH(mdb_secondary_index_t, link, six, &tbl->secondary) {
+        PRINT("%s index '%s' columns: ",
+              six->itype == mqi_index_ordered ? "ordered" : "hash",
+              six->name);
+
+        for (i = 0, sep = "";   i < six->ncolumn;   i++, sep = ",")
+            PRINT("%s%02d", sep, six->columns[i]);
+
+        PRINT("\n    type %s, length %d\n",
+              mqi_data_type_str(six->type), six->length);
+    }
+
     return p - buf;
 
 #undef PRINT
 }
 
 
+static int secondary_insert(mdb_table_t           *tbl,
+                            mdb_secondary_index_t *six,
+                            mdb_row_t             *row)
+{
+    mdb_index_bucket_t  *bucket;
+    mdb_row_t          **rows;
+    uint8_t              key[MDB_INDEX_LENGTH_MAX];
+    int                  size;
+
+    row_key(tbl, six, row, key);
+
+    if (!(bucket = mdb_hash_get_data(six->hash, six->length, key))) {
+        if (!(bucket = calloc(1, sizeof(*bucket) + six->length))) {
+            errno = ENOMEM;
+            return -1;
+        }
+
+        memcpy(bucket->key, key, six->length);
+
+        if (mdb_hash_add(six->hash, six->length, bucket->key, bucket) < 0) {
+            free(bucket);
+            return -1;
+        }
+
+        if (six->sequence)
+            mdb_sequence_add(six->sequence, six->length, bucket->key, bucket);
+    }
+
+    if (bucket->nrow >= bucket->size) {
+        size = bucket->size ? bucket->size * 2 : 4;
+
+        if (!(rows = realloc(bucket->rows, sizeof(*rows) * size))) {
+            if (!bucket->nrow) {
+                mdb_hash_delete(six->hash, six->length, bucket->key);
+
+                if (six->sequence)
+                    mdb_sequence_delete(six->sequence, six->length,
+                                        bucket->key);
+
+                free(bucket);
+            }
+
+            errno = ENOMEM;
+            return -1;
+        }
+
+        bucket->rows = rows;
+        bucket->size = size;
+    }
+
+    bucket->rows[bucket->nrow++] = row;
+
+    return 0;
+}
+
+static void secondary_delete(mdb_table_t           *tbl,
+                             mdb_secondary_index_t *six,
+                             mdb_row_t             *row)
+{
+    mdb_index_bucket_t *bucket;
+    uint8_t             key[MDB_INDEX_LENGTH_MAX];
+    int                 i;
+
+    row_key(tbl, six, row, key);
+
+    if (!(bucket = mdb_hash_get_data(six->hash, six->length, key)))
+        return;
+
+    for (i = 0;  i < bucket->nrow;  i++) {
+        if (bucket->rows[i] == row) {
+            bucket->rows[i] = bucket->rows[--bucket->nrow];
+            break;
+        }
+    }
+
+    if (!bucket->nrow) {
+        mdb_hash_delete(six->hash, six->length, bucket->key);
+
+        if (six->sequence)
+            mdb_sequence_delete(six->sequence, six->length, bucket->key);
+
+        free(bucket->rows);
+        free(bucket);
+    }
+}
+
+static void secondary_reset(mdb_secondary_index_t *six)
+{
+    mdb_index_bucket_t *bucket;
+    void               *cursor;
+
+    MDB_HASH_TABLE_FOR_EACH(six->hash, bucket, cursor) {
+        free(bucket->rows);
+        free(bucket);
+    }
+
+    mdb_hash_table_reset(six->hash);
+
+    if (six->sequence)
+        mdb_sequence_table_reset(six->sequence);
+}
+
+static void secondary_destroy(mdb_table_t *tbl, mdb_secondary_index_t *six)
+{
+    int i;
+
+    secondary_reset(six);
+
+    mdb_hash_table_destroy(six->hash);
+
+    if (six->sequence)
+        mdb_sequence_table_destroy(six->sequence);
+
+    for (i = 0;  i < six->ncolumn;  i++)
+        tbl->columns[six->columns[i]].nindex--;
+
+    MDB_DLIST_UNLINK(mdb_secondary_index_t, link, six);
+
+    free(six->koffset);
+    free(six->columns);
+    free(six->name);
+    free(six);
+}
+
+static void row_key(mdb_table_t           *tbl,
+                    mdb_secondary_index_t *six,
+                    mdb_row_t             *row,
+                    uint8_t               *key)
+{
+    mdb_column_t *col;
+    int           i;
+
+    for (i = 0;  i < six->ncolumn;  i++) {
+        col = tbl->columns + six->columns[i];
+        memcpy(key + six->koffset[i], row->data + col->offset, col->length);
+    }
+}
+
+/*
+ * the key of an out of line varchar is the interned pointer; ordered
+ * indexes of such a single column still follow the strings. Cursors
+ * keep a copy of the string they are at, since the interned one may
+ * be released with its row while the scan goes on.
+ */
+static mdb_sequence_t *heap_sequence_create(void)
+{
+    mdb_sequence_t *seq;
+
+    seq = mdb_sequence_table_create(16, heap_string_compare,
+                                    heap_string_print);
+
+    if (seq)
+        mdb_sequence_table_set_key_copy(seq, heap_string_copy,
+                                        heap_string_free);
+
+    return seq;
+}
+
+static int heap_string_compare(int klen, void *key1, void *key2)
+{
+    const char *s1 = *(const char **)key1;
+    const char *s2 = *(const char **)key2;
+
+    MQI_UNUSED(klen);
+
+    return strcmp(s1 ? s1 : "", s2 ? s2 : "");
+}
+
+static int heap_string_print(void *key, char *buf, int len)
+{
+    const char *s = *(const char **)key;
+
+    return snprintf(buf, len, "%s", s ? s : "");
+}
+
+static int heap_string_copy(void *dst, void *src)
+{
+    const char *s = *(const char **)src;
+
+    if (!s) {
+        *(char **)dst = NULL;
+        return 0;
+    }
+
+    if (!(*(char **)dst = strdup(s))) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+static void heap_string_free(void *key)
+{
+    free(*(char **)key);
+}
+
+static uint32_t slot_hash(uint32_t hash, mdb_column_t *col, const void *value)
+{
+    const uint8_t *p = value;
+    int            len;
+
+    if (col->type != mqi_varchar)
+        len = col->length;
+    else {
+        len = strlen(value);
+
+        /* what an inline varchar would have been truncated to */
+        if (!col->heap && len > col->length - 1)
+            len = col->length - 1;
+    }
+
+    while (len-- > 0)
+        hash = (hash ^ *p++) * 16777619U;
+
+    return hash;
+}
+
+
 /*
  * Local Variables:
  * c-basic-offset: 4
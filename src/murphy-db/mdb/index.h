@@ -42,6 +42,12 @@
 
 #define MDB_INDEX_DEFINED(ix) ((ix)->type != mqi_unknown)
 
+#define MDB_INDEX_UPDATE_ALL        1   /* primary and secondary indexes */
+#define MDB_INDEX_UPDATE_SECONDARY  2   /* secondary indexes only */
+
+typedef struct mdb_index_bucket_s     mdb_index_bucket_t;
+typedef struct mdb_secondary_index_s  mdb_secondary_index_t;
+
 typedef struct {
     mqi_data_type_t  type;
     int              length;
@@ -52,6 +58,32 @@ typedef struct {
     int             *columns;   /* sorted */
 } mdb_index_t;
 
+/*
+ * Secondary indexes are not unique: every distinct key has a bucket
+ * holding all the rows with that key. The key of a multi-column index
+ * is the concatenation of the column values, so the columns need not
+ * be adjacent in the row.
+ */
+struct mdb_index_bucket_s {
+    int              nrow;
+    int              size;
+    mdb_row_t      **rows;
+    uint8_t          key[0];
+};
+
+struct mdb_secondary_index_s {
+    mdb_dlist_t      link;
+    char            *name;
+    mqi_index_type_t itype;
+    mqi_data_type_t  type;      /* key type */
+    int              length;    /* key length */
+    int              ncolumn;
+    int             *columns;   /* in declaration order */
+    int             *koffset;   /* offset of each column within the key */
+    mdb_hash_t      *hash;      /* key => bucket */
+    mdb_sequence_t  *sequence;  /* ordered indexes only */
+};
+
 
 int mdb_index_create(mdb_table_t *, char **);
 void mdb_index_drop(mdb_table_t *);
@@ -59,8 +91,20 @@ void mdb_index_reset(mdb_table_t *);
 int mdb_index_insert(mdb_table_t *, mdb_row_t *, mqi_bitfld_t, int);
 int mdb_index_delete(mdb_table_t *, mdb_row_t *);
 mdb_row_t *mdb_index_get_row(mdb_table_t *, int, void *);
+int mdb_index_row_slot(mdb_table_t *, mdb_row_t *);
+int mdb_index_key_slot(mdb_table_t *, mqi_variable_t *);
 int mdb_index_print(mdb_table_t *, char *, int);
 
+int mdb_index_create_secondary(mdb_table_t *, const char *, mqi_index_type_t,
+                               char **);
+int mdb_index_drop_secondary(mdb_table_t *, const char *);
+mdb_secondary_index_t *mdb_index_find_secondary(mdb_table_t *, const char *);
+int mdb_index_secondary_key(mdb_table_t *, mdb_secondary_index_t *,
+                            mqi_variable_t *, void *);
+mdb_index_bucket_t *mdb_index_get_bucket(mdb_secondary_index_t *, void *);
+int mdb_index_insert_secondary(mdb_table_t *, mdb_row_t *);
+void mdb_index_delete_secondary(mdb_table_t *, mdb_row_t *);
+
 
 #endif /* __MDB_INDEX_H__ */
 
@@ -42,6 +42,8 @@
 #include "log.h"
 #include "row.h"
 #include "table.h"
+#include "persist.h"
+#include "version.h"
 
 #ifndef LOG_STATISTICS
 #define LOG_STATISTICS
@@ -86,6 +88,8 @@ static tx_log_t *get_tx_log(uint32_t);
 static tbl_log_t *get_tbl_log(mdb_dlist_t *, mdb_dlist_t *, uint32_t,
                               mdb_table_t *);
 static void delete_tx_log(uint32_t);
+static void stamp_change(mdb_table_t *, mdb_log_type_t, mqi_bitfld_t *,
+                         mdb_row_t *, mdb_row_t *);
 
 static MDB_DLIST_HEAD(tx_head);
 
@@ -112,6 +116,12 @@ int mdb_log_change(mdb_table_t    *tbl,
 
     MDB_CHECKARG(tbl, -1);
 
+    if (tbl->persist)
+        mdb_persist_log(tbl, depth, type, before, after);
+
+    if (mdb_version_change(tbl, depth, type, before, after) < 0)
+        return -1;
+
     if (!depth)
         return 0;
 
@@ -131,6 +141,8 @@ int mdb_log_change(mdb_table_t    *tbl,
     change->before  = before;
     change->after   = after;
 
+    stamp_change(tbl, type, &colmask, before, after);
+
     switch (type) {
     case mdb_log_insert: tbl->cnt.inserts++; break;
     case mdb_log_delete: tbl->cnt.deletes++; break;
@@ -427,6 +439,7 @@ static tbl_log_t *get_tbl_log(mdb_dlist_t *vhead,
 {
     tbl_log_t *log;
     change_t  *change;
+    int        nstamp;
 
     if (!(log = (tbl_log_t *)get_last_vlog(vhead)) || depth > log->depth) {
         if ((log = (tbl_log_t *)new_log(vhead, hhead, depth, sizeof(*log)))) {
@@ -438,14 +451,22 @@ static tbl_log_t *get_tbl_log(mdb_dlist_t *vhead,
                 return NULL;
             }
 
-            if (!(change->cnt = calloc(1, sizeof(*change->cnt)))) {
+            nstamp = MDB_TABLE_NSTAMP(tbl);
+            change->cnt = calloc(1, sizeof(*change->cnt) +
+                                    sizeof(uint32_t) * nstamp);
+
+            if (!change->cnt) {
                 free(change);
                 errno = ENOMEM;
                 return NULL;
             }
 
+            /* the stamps are restored from here if nothing changes */
             change->type = mdb_log_start;
             *change->cnt = tbl->cnt;
+            change->cnt->stamps = (uint32_t *)(change->cnt + 1);
+            memcpy(change->cnt->stamps, tbl->cnt.stamps,
+                   sizeof(uint32_t) * nstamp);
             tbl->cnt.stamp++;
 
             MDB_DLIST_PREPEND(change_t, link, change, &log->changes);
@@ -478,6 +499,38 @@ static void delete_tx_log(uint32_t depth)
         delete_log(log);
 }
 
+/*
+ * inserts and deletes change every column, updates the ones in colmask;
+ * an update that moves a row to another key touches both key slots
+ */
+static void stamp_change(mdb_table_t    *tbl,
+                         mdb_log_type_t  type,
+                         mqi_bitfld_t   *colmask,
+                         mdb_row_t      *before,
+                         mdb_row_t      *after)
+{
+    uint32_t stamp = tbl->cnt.stamp;
+    int      cx, kx;
+
+    if (type == mdb_log_update) {
+        MQI_BITFLD_FOR_EACH(colmask, cx)
+            MDB_COLUMN_STAMP(tbl, cx) = stamp;
+    }
+    else {
+        for (cx = 0;  cx < tbl->ncolumn;  cx++)
+            MDB_COLUMN_STAMP(tbl, cx) = stamp;
+    }
+
+    if (!MDB_TABLE_HAS_INDEX(tbl))
+        return;
+
+    if (before && (kx = mdb_index_row_slot(tbl, before)) >= 0)
+        MDB_KEY_STAMP(tbl, kx) = stamp;
+
+    if (after && (kx = mdb_index_row_slot(tbl, after)) >= 0)
+        MDB_KEY_STAMP(tbl, kx) = stamp;
+}
+
 
 
 /*
@@ -35,10 +35,11 @@
 #include "row.h"
 
 typedef struct {
-    uint32_t stamp;
-    uint32_t inserts;
-    uint32_t deletes;
-    uint32_t updates;
+    uint32_t  stamp;
+    uint32_t  inserts;
+    uint32_t  deletes;
+    uint32_t  updates;
+    uint32_t *stamps;   /* of the columns and the primary key slots */
 } mdb_opcnt_t;
 
 #define MDB_FORWARD  true
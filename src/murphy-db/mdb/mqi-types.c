@@ -44,6 +44,45 @@ const char *mqi_data_type_str(mqi_data_type_t type)
     }
 }
 
+const char *mqi_aggregate_str(mqi_aggregate_t aggregate)
+{
+    switch (aggregate) {
+    case mqi_count:    return "count";
+    case mqi_min:      return "min";
+    case mqi_max:      return "max";
+    case mqi_sum:      return "sum";
+    case mqi_avg:      return "avg";
+    default:           return "none";
+    }
+}
+
+/*
+ * the type an aggregate produces over a column of the given type,
+ * or mqi_error if it can't be computed over such a column
+ */
+mqi_data_type_t mqi_aggregate_type(mqi_aggregate_t aggregate,
+                                   mqi_data_type_t type)
+{
+    switch (aggregate) {
+    case mqi_aggregate_none:
+    case mqi_min:
+    case mqi_max:
+        return type;
+    case mqi_count:
+        return mqi_unsignd;
+    case mqi_sum:
+        if (type == mqi_integer || type == mqi_unsignd || type == mqi_floating)
+            return type;
+        return mqi_error;
+    case mqi_avg:
+        if (type == mqi_integer || type == mqi_unsignd || type == mqi_floating)
+            return mqi_floating;
+        return mqi_error;
+    default:
+        return mqi_error;
+    }
+}
+
 int mqi_data_compare_integer(int datalen, void *data1, void *data2)
 {
     int32_t integer1;
@@ -55,8 +94,13 @@ int mqi_data_compare_integer(int datalen, void *data1, void *data2)
     integer1 = *(int32_t *)data1;
     integer2 = *(int32_t *)data2;
 
+    if (integer1 < integer2)
+        return -1;
 
-    return (integer1 - integer2);
+    if (integer1 > integer2)
+        return 1;
+
+    return 0;
 }
 
 int mqi_data_compare_unsignd(int datalen, void *data1, void *data2)
@@ -0,0 +1,762 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define _GNU_SOURCE
+#include <string.h>
+
+#include <murphy-db/assert.h>
+#include <murphy-db/list.h>
+#include "persist.h"
+#include "transaction.h"
+#include "index.h"
+#include "row.h"
+#include "table.h"
+
+#ifndef MDB_PERSIST_DIR
+#define MDB_PERSIST_DIR     "/var/lib/murphy/db"
+#endif
+
+#define WAL_SIZE_MAX        (1024 * 1024) /* checkpoint above this */
+
+#define SNAPSHOT_MAGIC      0x4d444253    /* 'MDBS' */
+#define WAL_MAGIC           0x4d44424c    /* 'MDBL' */
+#define PERSIST_VERSION     1
+
+/*
+ * Persistent tables are stored in two files in the persistence
+ * directory. <table>.snapshot is a compact image of the table: a
+ * header followed by the raw data of the rows in insertion order, so
+ * it can be mmap'ed and loaded with a memcpy per row. <table>.wal is
+ * an append-only log of the changes since the snapshot, fed from
+ * mdb_log_change(). Changes made in transactions are followed by a
+ * commit or rollback record once the transaction ends; on restore
+ * changes of transactions without one are rolled back.
+ *
+ * A checkpoint rewrites the snapshot and truncates the log. Tables are
+ * checkpointed when they are restored, when the log grows above
+ * WAL_SIZE_MAX and on request, but only while they have no pending
+ * transactional changes.
+ */
+
+typedef struct {
+    uint32_t  magic;
+    uint32_t  version;
+    uint32_t  schema;           /* hash of the column definitions */
+    uint32_t  dlgh;
+    uint32_t  nrow;             /* snapshot only */
+} file_header_t;
+
+typedef enum {
+    wal_insert = 1,             /* after image */
+    wal_delete,                 /* before image */
+    wal_update,                 /* before and after images */
+    wal_commit,
+    wal_rollback,
+} wal_type_t;
+
+typedef struct {
+    uint16_t  type;
+    uint16_t  depth;
+} wal_record_t;
+
+struct mdb_persist_s {
+    mdb_dlist_t   link;         /* persistent_tables */
+    mdb_table_t  *table;
+    char         *snapshot;     /* path of the snapshot */
+    char         *log;          /* path of the write-ahead log */
+    FILE         *wal;
+    size_t        size;         /* current size of the log */
+    uint32_t      depth;        /* deepest unterminated transaction */
+    bool          pending;      /* checkpoint requested while dirty */
+};
+
+
+static int checkpoint(mdb_persist_t *);
+static int restore_snapshot(mdb_persist_t *);
+static int replay_log(mdb_persist_t *);
+static int open_log(mdb_persist_t *);
+static int write_record(mdb_persist_t *, wal_type_t, uint32_t,
+                        mdb_row_t *, mdb_row_t *);
+static int load_row(mdb_table_t *, uint32_t, void *);
+static int unload_row(mdb_table_t *, uint32_t, void *);
+static int reload_row(mdb_table_t *, uint32_t, void *, void *);
+static mdb_row_t *find_row(mdb_table_t *, void *);
+static mqi_bitfld_t column_mask(mdb_table_t *, void *, void *);
+static void init_header(mdb_table_t *, file_header_t *, uint32_t, uint32_t);
+static uint32_t schema_hash(mdb_table_t *);
+static int make_directory(const char *);
+static char *make_path(const char *, const char *);
+
+
+static char *directory;
+static MDB_DLIST_HEAD(persistent_tables);
+
+
+int mdb_persist_set_directory(const char *path)
+{
+    char *dup;
+
+    MDB_CHECKARG(path && path[0], -1);
+
+    if (!(dup = strdup(path))) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    free(directory);
+    directory = dup;
+
+    return 0;
+}
+
+int mdb_persist_checkpoint(void)
+{
+    mdb_persist_t *p, *n;
+    int            sts = 0;
+
+    MDB_DLIST_FOR_EACH_SAFE(mdb_persist_t, link, p,n, &persistent_tables) {
+        if (mdb_persist_checkpoint_table(p->table) < 0)
+            sts = -1;
+    }
+
+    return sts;
+}
+
+int mdb_persist_table(mdb_table_t *tbl)
+{
+    const char    *dir = directory ? directory : MDB_PERSIST_DIR;
+    mdb_persist_t *p;
+    char           name[PATH_MAX];
+
+    /* row images are written as they are, string heap pointers and all */
+    MDB_CHECKARG(tbl && !strchr(tbl->name, '/') && !tbl->strings, -1);
+    MDB_PREREQUISITE(!tbl->persist && MDB_DLIST_EMPTY(tbl->rows), -1);
+
+    if (make_directory(dir) < 0)
+        return -1;
+
+    if (!(p = calloc(1, sizeof(mdb_persist_t)))) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    MDB_DLIST_INIT(p->link);
+    p->table = tbl;
+
+    snprintf(name, sizeof(name), "%s.snapshot", tbl->name);
+    p->snapshot = make_path(dir, name);
+
+    snprintf(name, sizeof(name), "%s.wal", tbl->name);
+    p->log = make_path(dir, name);
+
+    if (!p->snapshot || !p->log)
+        goto failed;
+
+    /*
+     * the table is not persistent yet so restoring it does not
+     * get logged; the restored state is then written as a new
+     * snapshot with an empty log
+     */
+    if (restore_snapshot(p) < 0 || replay_log(p) < 0)
+        goto failed;
+
+    if (checkpoint(p) < 0)
+        goto failed;
+
+    tbl->persist = p;
+    MDB_DLIST_APPEND(mdb_persist_t, link, p, &persistent_tables);
+
+    return 0;
+
+ failed:
+    if (p->wal)
+        fclose(p->wal);
+    free(p->snapshot);
+    free(p->log);
+    free(p);
+    return -1;
+}
+
+int mdb_persist_checkpoint_table(mdb_table_t *tbl)
+{
+    mdb_persist_t *p;
+
+    MDB_CHECKARG(tbl, -1);
+    MDB_PREREQUISITE((p = tbl->persist), -1);
+
+    if (p->depth) {
+        /* wait until all transactions touching the table have ended */
+        p->pending = true;
+        return 0;
+    }
+
+    return checkpoint(p);
+}
+
+int mdb_persist_table_drop(mdb_table_t *tbl)
+{
+    mdb_persist_t *p;
+
+    MDB_CHECKARG(tbl, -1);
+
+    if (!(p = tbl->persist))
+        return 0;
+
+    /*
+     * the files are kept, so the table is restored when it is
+     * created again
+     */
+    MDB_DLIST_UNLINK(mdb_persist_t, link, p);
+
+    if (p->wal)
+        fclose(p->wal);
+
+    free(p->snapshot);
+    free(p->log);
+    free(p);
+
+    tbl->persist = NULL;
+
+    return 0;
+}
+
+void mdb_persist_log(mdb_table_t    *tbl,
+                     uint32_t        depth,
+                     mdb_log_type_t  change,
+                     mdb_row_t      *before,
+                     mdb_row_t      *after)
+{
+    mdb_persist_t *p = tbl->persist;
+    wal_type_t     type;
+
+    switch (change) {
+    case mdb_log_insert:  type = wal_insert;  before = NULL;  break;
+    case mdb_log_delete:  type = wal_delete;  after  = NULL;  break;
+    case mdb_log_update:  type = wal_update;                  break;
+    default:              return;
+    }
+
+    if (write_record(p, type, depth, before, after) < 0)
+        return;
+
+    if (depth > 0) {
+        if (depth > p->depth)
+            p->depth = depth;
+    }
+    else {
+        fflush(p->wal);
+
+        if (!p->depth && (p->pending || p->size > WAL_SIZE_MAX))
+            checkpoint(p);
+    }
+}
+
+void mdb_persist_transaction_end(uint32_t depth, bool commit)
+{
+    mdb_persist_t *p, *n;
+    wal_type_t     type = commit ? wal_commit : wal_rollback;
+
+    MDB_DLIST_FOR_EACH_SAFE(mdb_persist_t, link, p,n, &persistent_tables) {
+        if (p->depth < depth)
+            continue;
+
+        write_record(p, type, depth, NULL, NULL);
+        fflush(p->wal);
+
+        /*
+         * replay opens every transaction up to the deepest one with
+         * changes, so all the enclosing ones need an end record, too
+         */
+        p->depth = depth - 1;
+
+        if (!p->depth && (p->pending || p->size > WAL_SIZE_MAX))
+            checkpoint(p);
+    }
+}
+
+
+static int checkpoint(mdb_persist_t *p)
+{
+    mdb_table_t   *tbl = p->table;
+    mdb_row_t     *row, *n;
+    file_header_t  hdr;
+    char           tmp[PATH_MAX];
+    FILE          *fp;
+    uint32_t       nrow;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", p->snapshot);
+
+    if (!(fp = fopen(tmp, "w")))
+        return -1;
+
+    nrow = 0;
+    MDB_DLIST_FOR_EACH_SAFE(mdb_row_t, link, row,n, &tbl->rows)
+        nrow++;
+
+    init_header(tbl, &hdr, SNAPSHOT_MAGIC, nrow);
+
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1)
+        goto failed;
+
+    MDB_DLIST_FOR_EACH_SAFE(mdb_row_t, link, row,n, &tbl->rows) {
+        if (fwrite(row->data, tbl->dlgh, 1, fp) != 1)
+            goto failed;
+    }
+
+    if (fflush(fp) != 0 || fsync(fileno(fp)) < 0)
+        goto failed;
+
+    fclose(fp);
+
+    if (rename(tmp, p->snapshot) < 0) {
+        unlink(tmp);
+        return -1;
+    }
+
+    p->pending = false;
+
+    /* the snapshot covers everything in the log */
+    return open_log(p);
+
+ failed:
+    fclose(fp);
+    unlink(tmp);
+    return -1;
+}
+
+static int restore_snapshot(mdb_persist_t *p)
+{
+    mdb_table_t   *tbl = p->table;
+    file_header_t  ref, *hdr;
+    struct stat    st;
+    uint8_t       *map, *data;
+    uint32_t       i;
+    int            fd;
+
+    if ((fd = open(p->snapshot, O_RDONLY)) < 0)
+        return (errno == ENOENT) ? 0 : -1;
+
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    if ((size_t)st.st_size < sizeof(file_header_t)) {
+        close(fd);
+        return 0;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+        return -1;
+
+    hdr = (file_header_t *)map;
+    init_header(tbl, &ref, SNAPSHOT_MAGIC, hdr->nrow);
+
+    /* a snapshot of a different table layout is silently dropped */
+    if (!memcmp(hdr, &ref, sizeof(ref)) &&
+        (size_t)st.st_size == sizeof(*hdr) + (size_t)hdr->nrow * tbl->dlgh)
+    {
+        data = map + sizeof(*hdr);
+
+        for (i = 0;  i < hdr->nrow;  i++, data += tbl->dlgh) {
+            if (load_row(tbl, 0, data) < 0 && errno != EEXIST) {
+                munmap(map, st.st_size);
+                return -1;
+            }
+        }
+    }
+
+    munmap(map, st.st_size);
+
+    return 0;
+}
+
+static int replay_log(mdb_persist_t *p)
+{
+    mdb_table_t   *tbl  = p->table;
+    uint32_t       base = mdb_transaction_get_depth();
+    file_header_t  ref, hdr;
+    wal_record_t   rec;
+    uint8_t       *before, *after;
+    uint32_t       depth;
+    FILE          *fp;
+    int            sts = 0;
+
+    if (!(fp = fopen(p->log, "r")))
+        return (errno == ENOENT) ? 0 : -1;
+
+    init_header(tbl, &ref, WAL_MAGIC, 0);
+
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        memcmp(&hdr, &ref, sizeof(hdr)) != 0)
+    {
+        fclose(fp);
+        return 0;
+    }
+
+    if (!(before = malloc(2 * tbl->dlgh))) {
+        fclose(fp);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    after = before + tbl->dlgh;
+
+    /*
+     * transactional changes are replayed in transactions of the same
+     * depth, on top of whatever transaction is open at the moment. A
+     * truncated or inconsistent record ends the replay.
+     */
+    while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+        depth = rec.depth ? base + rec.depth : 0;
+
+        switch (rec.type) {
+        case wal_insert:
+        case wal_delete:
+        case wal_update:
+            while (depth && mdb_transaction_get_depth() < depth)
+                mdb_transaction_begin();
+
+            if (mdb_transaction_get_depth() != (depth ? depth : base))
+                goto out;
+            break;
+
+        case wal_commit:
+        case wal_rollback:
+            if (!rec.depth || mdb_transaction_get_depth() != depth)
+                goto out;
+            break;
+
+        default:
+            goto out;
+        }
+
+        switch (rec.type) {
+        case wal_insert:
+            if (fread(after, tbl->dlgh, 1, fp) != 1)
+                goto out;
+            if (load_row(tbl, depth, after) < 0 && errno != EEXIST)
+                sts = -1;
+            break;
+
+        case wal_delete:
+            if (fread(before, tbl->dlgh, 1, fp) != 1)
+                goto out;
+            if (unload_row(tbl, depth, before) < 0)
+                sts = -1;
+            break;
+
+        case wal_update:
+            if (fread(before, tbl->dlgh, 1, fp) != 1 ||
+                fread(after , tbl->dlgh, 1, fp) != 1)
+                goto out;
+            if (reload_row(tbl, depth, before, after) < 0)
+                sts = -1;
+            break;
+
+        case wal_commit:
+            mdb_transaction_commit(depth);
+            break;
+
+        case wal_rollback:
+            mdb_transaction_rollback(depth);
+            break;
+        }
+
+        if (sts < 0)
+            break;
+    }
+
+ out:
+    /* changes of unfinished transactions did not survive */
+    while ((depth = mdb_transaction_get_depth()) > base)
+        mdb_transaction_rollback(depth);
+
+    free(before);
+    fclose(fp);
+
+    return sts;
+}
+
+static int open_log(mdb_persist_t *p)
+{
+    file_header_t hdr;
+
+    if (p->wal)
+        fclose(p->wal);
+
+    if (!(p->wal = fopen(p->log, "w")))
+        return -1;
+
+    init_header(p->table, &hdr, WAL_MAGIC, 0);
+
+    if (fwrite(&hdr, sizeof(hdr), 1, p->wal) != 1 || fflush(p->wal) != 0) {
+        fclose(p->wal);
+        p->wal = NULL;
+        return -1;
+    }
+
+    p->size = sizeof(hdr);
+
+    return 0;
+}
+
+static int write_record(mdb_persist_t *p,
+                        wal_type_t     type,
+                        uint32_t       depth,
+                        mdb_row_t     *before,
+                        mdb_row_t     *after)
+{
+    wal_record_t rec;
+    int          dlgh = p->table->dlgh;
+
+    if (!p->wal)
+        return -1;
+
+    rec.type  = type;
+    rec.depth = depth;
+
+    if (fwrite(&rec, sizeof(rec), 1, p->wal) != 1 ||
+        (before && fwrite(before->data, dlgh, 1, p->wal) != 1) ||
+        (after  && fwrite(after->data , dlgh, 1, p->wal) != 1))
+    {
+        /* stop logging; the next checkpoint starts a new log */
+        fclose(p->wal);
+        p->wal     = NULL;
+        p->pending = true;
+        return -1;
+    }
+
+    p->size += sizeof(rec) + (before ? dlgh : 0) + (after ? dlgh : 0);
+
+    return 0;
+}
+
+static int load_row(mdb_table_t *tbl, uint32_t depth, void *data)
+{
+    mdb_row_t    *row;
+    mqi_bitfld_t  cmask;
+    int           n;
+
+    if (!(row = mdb_row_create(tbl)))
+        return -1;
+
+    mdb_row_load(tbl, row, data);
+    cmask = column_mask(tbl, NULL, data);
+
+    /* a duplicate is released by the index */
+    if ((n = mdb_index_insert(tbl, row, cmask, 0)) <= 0)
+        return n;
+
+    tbl->nrow++;
+
+    return mdb_log_change(tbl, depth, mdb_log_insert, cmask, NULL, row);
+}
+
+static int unload_row(mdb_table_t *tbl, uint32_t depth, void *data)
+{
+    mdb_row_t *row;
+
+    if (!(row = find_row(tbl, data)))
+        return 0;
+
+    mdb_log_change(tbl, depth, mdb_log_delete, MQI_BITFLD_NONE, row, NULL);
+
+    return mdb_row_delete(tbl, row, 1, !depth);
+}
+
+static int reload_row(mdb_table_t *tbl,
+                      uint32_t     depth,
+                      void        *before,
+                      void        *after)
+{
+    mdb_row_t    *row, *old = NULL;
+    mqi_bitfld_t  cmask;
+
+    if (!(row = find_row(tbl, before)))
+        return 0;
+
+    if (depth > 0 && !(old = mdb_row_duplicate(tbl, row)))
+        return -1;
+
+    cmask = column_mask(tbl, row->data, after);
+
+    mdb_index_delete(tbl, row);
+    mdb_row_load(tbl, row, after);
+
+    if (mdb_index_insert(tbl, row, cmask, 0) < 0) {
+        if (old)
+            mdb_row_delete(tbl, old, 0, 1);
+        return -1;
+    }
+
+    return mdb_log_change(tbl, depth, mdb_log_update, cmask, old, row);
+}
+
+static mdb_row_t *find_row(mdb_table_t *tbl, void *data)
+{
+    mdb_index_t *ix = &tbl->index;
+    mdb_row_t   *row, *n;
+
+    if (MDB_INDEX_DEFINED(ix))
+        return mdb_index_get_row(tbl, ix->length, data + ix->offset);
+
+    MDB_DLIST_FOR_EACH_SAFE(mdb_row_t, link, row,n, &tbl->rows) {
+        if (!memcmp(row->data, data, tbl->dlgh))
+            return row;
+    }
+
+    return NULL;
+}
+
+static mqi_bitfld_t column_mask(mdb_table_t *tbl, void *before, void *after)
+{
+    mdb_column_t *col;
+    mqi_bitfld_t  cmask;
+    int           i;
+
+    mqi_bitfld_clear(&cmask);
+
+    for (i = 0;  i < tbl->ncolumn;  i++) {
+        col = tbl->columns + i;
+
+        if (!before || memcmp(before + col->offset, after + col->offset,
+                              col->length))
+            mqi_bitfld_set(&cmask, i);
+    }
+
+    return cmask;
+}
+
+static void init_header(mdb_table_t   *tbl,
+                        file_header_t *hdr,
+                        uint32_t       magic,
+                        uint32_t       nrow)
+{
+    memset(hdr, 0, sizeof(*hdr));
+
+    hdr->magic   = magic;
+    hdr->version = PERSIST_VERSION;
+    hdr->schema  = schema_hash(tbl);
+    hdr->dlgh    = tbl->dlgh;
+    hdr->nrow    = nrow;
+}
+
+static uint32_t schema_hash(mdb_table_t *tbl)
+{
+#define HASH(v) (h = (h ^ (uint32_t)(v)) * 16777619)
+
+    mdb_column_t *col;
+    uint32_t      h = 2166136261U;
+    const char   *c;
+    int           i;
+
+    HASH(tbl->ncolumn);
+
+    for (i = 0;  i < tbl->ncolumn;  i++) {
+        col = tbl->columns + i;
+
+        for (c = col->name;  *c;  c++)
+            HASH(*c);
+
+        HASH(col->type);
+        HASH(col->length);
+        HASH(col->offset);
+    }
+
+    return h;
+
+#undef HASH
+}
+
+static int make_directory(const char *path)
+{
+    char  buf[PATH_MAX];
+    char *p;
+
+    if (snprintf(buf, sizeof(buf), "%s", path) >= (int)sizeof(buf)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    for (p = buf + 1;  *p;  p++) {
+        if (*p == '/') {
+            *p = '\0';
+            if (mkdir(buf, 0700) < 0 && errno != EEXIST)
+                return -1;
+            *p = '/';
+        }
+    }
+
+    if (mkdir(buf, 0700) < 0 && errno != EEXIST)
+        return -1;
+
+    return 0;
+}
+
+static char *make_path(const char *dir, const char *name)
+{
+    char *path;
+    int   len;
+
+    len = strlen(dir) + 1 + strlen(name) + 1;
+
+    if (!(path = malloc(len))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    snprintf(path, len, "%s/%s", dir, name);
+
+    return path;
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
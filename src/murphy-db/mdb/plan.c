@@ -0,0 +1,664 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+
+#define _GNU_SOURCE
+#include <string.h>
+
+#include <murphy-db/assert.h>
+#include <murphy-db/list.h>
+#include <murphy-db/hash.h>
+#include <murphy-db/sequence.h>
+#include "column.h"
+#include "index.h"
+#include "table.h"
+#include "plan.h"
+
+#define PRINT(...)                                              \
+    do {                                                        \
+        if (p < e)                                              \
+            p += snprintf(p, e-p, __VA_ARGS__);                 \
+    } while (0)
+
+typedef struct {
+    int             column;
+    mqi_operator_t  op;
+    mqi_variable_t *var;
+} predicate_t;
+
+static int collect_predicates(mdb_table_t *, mqi_cond_entry_t *,
+                              predicate_t *, int *);
+static int term_predicate(mdb_table_t *, mqi_cond_entry_t *,
+                          mqi_cond_entry_t *, predicate_t *);
+static predicate_t *find_predicate(predicate_t *, int, int, mqi_operator_t);
+static int range_plan(mdb_table_t *, mdb_secondary_index_t *, int,
+                      predicate_t *, int, mdb_plan_t *);
+static int snapshot_bucket(mdb_plan_t *, mdb_index_bucket_t *);
+static int compare_value(mqi_data_type_t, void *, mqi_variable_t *);
+static int print_value(mqi_variable_t *, char *, int);
+static const char *operator_name(mqi_operator_t);
+
+
+int mdb_plan_create(mdb_table_t *tbl, mqi_cond_entry_t *cond, mdb_plan_t *plan)
+{
+    predicate_t            preds[MQI_COND_MAX], *pred;
+    mqi_variable_t         vars[MQI_COLUMN_MAX];
+    mdb_index_t           *ix;
+    mdb_secondary_index_t *six, *best;
+    mdb_column_t          *col;
+    mqi_column_desc_t      src;
+    void                  *data;
+    int                    npred;
+    int                    vec;
+    int                    i;
+
+    MDB_CHECKARG(tbl && plan, -1);
+
+    plan->type   = mdb_plan_scan;
+    plan->index  = NULL;
+    plan->column = -1;
+    plan->lower  = plan->upper = NULL;
+    plan->lower_incl = plan->upper_incl = 0;
+    plan->nterm  = 0;
+    plan->nused  = 0;
+    plan->klen   = 0;
+    plan->nfilter = 0;
+    plan->done   = 0;
+    plan->cursor = NULL;
+    plan->rows   = NULL;
+    plan->nrow   = plan->idx = 0;
+
+    if (!cond)
+        return 0;
+
+    if ((plan->nterm = collect_predicates(tbl, cond, preds, &npred)) < 0) {
+        plan->nterm = 1;        /* a disjunction, evaluated as a whole */
+        return 0;
+    }
+
+    /*
+     * equality on every primary index column: point lookup
+     */
+    ix = &tbl->index;
+
+    if (MDB_INDEX_DEFINED(ix)) {
+        data = plan->key - ix->offset;
+        src.offset = 0;
+
+        memset(plan->key, 0, ix->length);
+
+        for (i = 0;  i < ix->ncolumn;  i++) {
+            if (!(pred = find_predicate(preds, npred, ix->columns[i], mqi_eq)))
+                break;
+
+            col = tbl->columns + (src.cindex = ix->columns[i]);
+            mdb_column_write_key(col, data, &src, pred->var->v.generic);
+        }
+
+        if (i == ix->ncolumn) {
+            plan->type  = mdb_plan_point;
+            plan->klen  = ix->length;
+            plan->nused = ix->ncolumn;
+            return 0;
+        }
+    }
+
+    /*
+     * equality on every column of a secondary index: bucket lookup,
+     * preferring the most specific index
+     */
+    best = NULL;
+
+    MDB_DLIST_FOR_EACH(mdb_secondary_index_t, link, six, &tbl->secondary) {
+        for (i = 0;  i < six->ncolumn;  i++) {
+            if (!find_predicate(preds, npred, six->columns[i], mqi_eq))
+                break;
+        }
+
+        if (i == six->ncolumn && (!best || six->ncolumn > best->ncolumn))
+            best = six;
+    }
+
+    if (best) {
+        for (i = 0;  i < best->ncolumn;  i++) {
+            pred = find_predicate(preds, npred, best->columns[i], mqi_eq);
+            vars[i] = *pred->var;
+        }
+
+        if (mdb_index_secondary_key(tbl, best, vars, plan->key) > 0) {
+            plan->type  = mdb_plan_bucket;
+            plan->index = best;
+            plan->klen  = best->length;
+            plan->nused = best->ncolumn;
+            return 0;
+        }
+    }
+
+    /*
+     * bounds on the column of a single column numeric ordered index:
+     * range scan
+     */
+    if (MDB_INDEX_DEFINED(ix) && ix->ncolumn == 1 &&
+        range_plan(tbl, NULL, ix->columns[0], preds, npred, plan))
+        return 0;
+
+    MDB_DLIST_FOR_EACH(mdb_secondary_index_t, link, six, &tbl->secondary) {
+        if (six->itype == mqi_index_ordered && six->ncolumn == 1 &&
+            range_plan(tbl, six, six->columns[0], preds, npred, plan))
+            return 0;
+    }
+
+    /*
+     * predicates on fixed width columns of a columnar table:
+     * vectorized scan
+     */
+    if (tbl->storage.nvector > 0) {
+        for (i = 0;  i < npred && plan->nfilter < MDB_PLAN_FILTER_MAX;  i++) {
+            pred = preds + i;
+            vec  = mdb_row_storage_vector(&tbl->storage, pred->column);
+
+            if (vec >= 0) {
+                plan->filters[plan->nfilter].vector = vec;
+                plan->filters[plan->nfilter].op     = pred->op;
+                plan->filters[plan->nfilter].var    = pred->var;
+                plan->nfilter++;
+            }
+        }
+
+        if (plan->nfilter > 0) {
+            plan->type  = mdb_plan_vector;
+            plan->nused = plan->nfilter;
+        }
+    }
+
+    return 0;
+}
+
+mdb_row_t *mdb_plan_iterate(mdb_table_t *tbl, mdb_plan_t *plan)
+{
+    mdb_index_bucket_t *bucket;
+    mdb_sequence_t     *seq;
+    mdb_column_t       *col;
+    void               *data;
+    void               *key;
+    mqi_data_type_t     type;
+    int                 cmp;
+
+    MDB_CHECKARG(tbl && plan, NULL);
+
+    if (plan->done)
+        return NULL;
+
+    switch (plan->type) {
+
+    case mdb_plan_point:
+        plan->done = 1;
+        return mdb_index_get_row(tbl, plan->klen, plan->key);
+
+    case mdb_plan_bucket:
+        if (!plan->rows) {
+            bucket = mdb_index_get_bucket(plan->index, plan->key);
+
+            if (!bucket || snapshot_bucket(plan, bucket) < 0)
+                break;
+        }
+
+        if (plan->idx < plan->nrow)
+            return plan->rows[plan->idx++];
+        break;
+
+    case mdb_plan_vector:
+        if (!plan->rows) {
+            plan->nrow = mdb_row_storage_scan(&tbl->storage, plan->filters,
+                                              plan->nfilter, &plan->rows);
+            plan->idx  = 0;
+
+            if (plan->nrow <= 0)
+                break;
+        }
+
+        if (plan->idx < plan->nrow)
+            return plan->rows[plan->idx++];
+        break;
+
+    case mdb_plan_range:
+        col  = tbl->columns + plan->column;
+        type = col->type;
+        seq  = plan->index ? plan->index->sequence : tbl->index.sequence;
+
+        for (;;) {
+            if (plan->idx < plan->nrow)
+                return plan->rows[plan->idx++];
+
+            if (!plan->cursor && plan->lower) {
+                if (mdb_sequence_seek(seq, plan->klen, plan->key,
+                                      &plan->cursor) < 0)
+                    break;
+            }
+
+            if (!(data = mdb_sequence_iterate(seq, &plan->cursor)))
+                break;
+
+            if (plan->index)
+                key = ((mdb_index_bucket_t *)data)->key;
+            else
+                key = ((mdb_row_t *)data)->data + col->offset;
+
+            if (plan->lower && !plan->lower_incl &&
+                !compare_value(type, key, plan->lower))
+                continue;
+
+            if (plan->upper) {
+                cmp = compare_value(type, key, plan->upper);
+
+                if (cmp > 0 || (cmp == 0 && !plan->upper_incl))
+                    break;
+            }
+
+            if (!plan->index)
+                return (mdb_row_t *)data;
+
+            if (snapshot_bucket(plan, (mdb_index_bucket_t *)data) < 0)
+                break;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    plan->done = 1;
+
+    return NULL;
+}
+
+void mdb_plan_reset(mdb_table_t *tbl, mdb_plan_t *plan)
+{
+    mdb_sequence_t *seq;
+
+    MDB_CHECKARG(tbl && plan,);
+
+    if (plan->cursor) {
+        seq = plan->index ? plan->index->sequence : tbl->index.sequence;
+        mdb_sequence_cursor_destroy(seq, &plan->cursor);
+        plan->cursor = NULL;
+    }
+
+    free(plan->rows);
+
+    plan->rows = NULL;
+    plan->nrow = plan->idx = 0;
+    plan->done = 1;
+}
+
+int mdb_plan_print(mdb_table_t *tbl, mdb_plan_t *plan, char *buf, int len)
+{
+    mdb_index_t      *ix;
+    mdb_row_filter_t *f;
+    int          *columns;
+    int           ncolumn;
+    int           residual;
+    char          value[64];
+    char         *p, *e;
+    const char   *name;
+    int           i;
+
+    MDB_CHECKARG(tbl && plan && buf && len > 0, -1);
+
+    e = (p = buf) + len;
+    *buf = '\0';
+
+    ix = &tbl->index;
+
+    if (plan->index) {
+        columns = plan->index->columns;
+        ncolumn = plan->index->ncolumn;
+    }
+    else {
+        columns = ix->columns;
+        ncolumn = ix->ncolumn;
+    }
+
+    switch (plan->type) {
+
+    case mdb_plan_point:
+    case mdb_plan_bucket:
+        if (plan->index)
+            PRINT("access: lookup on index '%s' (", plan->index->name);
+        else
+            PRINT("access: primary index lookup (");
+
+        for (i = 0;  i < ncolumn;  i++)
+            PRINT("%s%s", i ? ", " : "", tbl->columns[columns[i]].name);
+
+        PRINT(")\n");
+        break;
+
+    case mdb_plan_range:
+        name = tbl->columns[plan->column].name;
+
+        if (plan->index)
+            PRINT("access: range scan on index '%s' (", plan->index->name);
+        else
+            PRINT("access: range scan on primary index (");
+
+        if (plan->lower) {
+            print_value(plan->lower, value, sizeof(value));
+            PRINT("%s %s %s", name, plan->lower_incl ? ">=" : ">", value);
+        }
+
+        if (plan->upper) {
+            print_value(plan->upper, value, sizeof(value));
+            PRINT("%s%s %s %s", plan->lower ? ", " : "",
+                  name, plan->upper_incl ? "<=" : "<", value);
+        }
+
+        PRINT(")\n");
+        break;
+
+    case mdb_plan_vector:
+        PRINT("access: vectorized scan of column vectors (");
+
+        for (i = 0;  i < plan->nfilter;  i++) {
+            f    = plan->filters + i;
+            name = tbl->columns[tbl->storage.vectors[f->vector].column].name;
+
+            print_value(f->var, value, sizeof(value));
+            PRINT("%s%s %s %s", i ? ", " : "", name, operator_name(f->op),
+                  value);
+        }
+
+        PRINT(")\n");
+        break;
+
+    default:
+        PRINT("access: full table scan in %s order\n",
+              MDB_INDEX_DEFINED(ix) ? "primary index" : "insertion");
+        break;
+    }
+
+    if ((residual = plan->nterm - plan->nused) > 0)
+        PRINT("filter: %d residual term%s\n", residual, residual>1 ? "s":"");
+    else
+        PRINT("filter: none\n");
+
+    return (p < e ? p : e) - buf;
+}
+
+
+static int collect_predicates(mdb_table_t      *tbl,
+                              mqi_cond_entry_t *cond,
+                              predicate_t      *preds,
+                              int              *ret_npred)
+{
+    mqi_cond_entry_t *beg, *c;
+    int               depth, nterm, npred;
+
+    /*
+     * split the condition to terms at the top level ANDs; a top level
+     * OR means there is nothing to plan for
+     */
+
+    depth = nterm = npred = 0;
+
+    for (beg = c = cond;  c - cond <= MQI_COND_MAX;  c++) {
+        if (c->type != mqi_operator)
+            continue;
+
+        switch (c->u.operator_) {
+        case mqi_begin:
+            depth++;
+            continue;
+        case mqi_end:
+            if (depth-- > 0)
+                continue;
+            break;
+        case mqi_or:
+            if (!depth)
+                return -1;
+            continue;
+        case mqi_and:
+            if (depth)
+                continue;
+            break;
+        default:
+            continue;
+        }
+
+        nterm++;
+
+        if (npred < MQI_COND_MAX && term_predicate(tbl, beg, c, preds+npred))
+            npred++;
+
+        if (c->u.operator_ == mqi_end) {
+            *ret_npred = npred;
+            return nterm;
+        }
+
+        beg = c + 1;
+    }
+
+    return -1;
+}
+
+static int term_predicate(mdb_table_t      *tbl,
+                          mqi_cond_entry_t *beg,
+                          mqi_cond_entry_t *end,
+                          predicate_t      *pred)
+{
+    static mqi_operator_t flipped[mqi_operator_max] = {
+        [ mqi_less ] = mqi_gt,
+        [ mqi_leq  ] = mqi_geq,
+        [ mqi_eq   ] = mqi_eq,
+        [ mqi_geq  ] = mqi_leq,
+        [ mqi_gt   ] = mqi_less,
+    };
+
+    mqi_variable_t *var;
+    mqi_operator_t  op;
+    int             column;
+
+    while (end - beg > 3 &&
+           beg->type     == mqi_operator && beg->u.operator_     == mqi_begin &&
+           (end-1)->type == mqi_operator && (end-1)->u.operator_ == mqi_end)
+    {
+        beg++;
+        end--;
+    }
+
+    if (end - beg != 3 || beg[1].type != mqi_operator)
+        return 0;
+
+    switch ((op = beg[1].u.operator_)) {
+    case mqi_less:
+    case mqi_leq:
+    case mqi_eq:
+    case mqi_geq:
+    case mqi_gt:
+        break;
+    default:
+        return 0;
+    }
+
+    if (beg[0].type == mqi_column && beg[2].type == mqi_variable) {
+        column = beg[0].u.column;
+        var    = &beg[2].u.variable;
+    }
+    else if (beg[0].type == mqi_variable && beg[2].type == mqi_column) {
+        column = beg[2].u.column;
+        var    = &beg[0].u.variable;
+        op     = flipped[op];
+    }
+    else
+        return 0;
+
+    if (!var->v.generic || var->type != tbl->columns[column].type)
+        return 0;
+
+    /* empty strings match any key in the index hashes */
+    if (var->type == mqi_varchar && (!*var->v.varchar || !**var->v.varchar))
+        return 0;
+
+    pred->column = column;
+    pred->op     = op;
+    pred->var    = var;
+
+    return 1;
+}
+
+static predicate_t *find_predicate(predicate_t    *preds,
+                                   int             npred,
+                                   int             column,
+                                   mqi_operator_t  op)
+{
+    int i;
+
+    for (i = 0;  i < npred;  i++) {
+        if (preds[i].column == column && preds[i].op == op)
+            return preds + i;
+    }
+
+    return NULL;
+}
+
+static int range_plan(mdb_table_t           *tbl,
+                      mdb_secondary_index_t *six,
+                      int                    column,
+                      predicate_t           *preds,
+                      int                    npred,
+                      mdb_plan_t            *plan)
+{
+    mdb_column_t *col = tbl->columns + column;
+    predicate_t  *lower, *upper;
+
+    if (col->type != mqi_integer && col->type != mqi_unsignd)
+        return 0;
+
+    if (!(lower = find_predicate(preds, npred, column, mqi_geq)))
+        lower = find_predicate(preds, npred, column, mqi_gt);
+    if (!(upper = find_predicate(preds, npred, column, mqi_leq)))
+        upper = find_predicate(preds, npred, column, mqi_less);
+
+    if (!lower && !upper)
+        return 0;
+
+    plan->type   = mdb_plan_range;
+    plan->index  = six;
+    plan->column = column;
+    plan->nused  = (lower ? 1 : 0) + (upper ? 1 : 0);
+    plan->klen   = col->length;
+
+    if (lower) {
+        plan->lower      = lower->var;
+        plan->lower_incl = (lower->op == mqi_geq);
+        memcpy(plan->key, lower->var->v.generic, col->length);
+    }
+
+    if (upper) {
+        plan->upper      = upper->var;
+        plan->upper_incl = (upper->op == mqi_leq);
+    }
+
+    return 1;
+}
+
+static int snapshot_bucket(mdb_plan_t *plan, mdb_index_bucket_t *bucket)
+{
+    mdb_row_t **rows;
+
+    /* the bucket may change under us, eg. when deleting its rows */
+
+    if (!(rows = realloc(plan->rows, sizeof(*rows) * (bucket->nrow + 1)))) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    memcpy(rows, bucket->rows, sizeof(*rows) * bucket->nrow);
+
+    plan->rows = rows;
+    plan->nrow = bucket->nrow;
+    plan->idx  = 0;
+
+    return 0;
+}
+
+static int compare_value(mqi_data_type_t type, void *key, mqi_variable_t *var)
+{
+    int32_t  i1, i2;
+    uint32_t u1, u2;
+
+    switch (type) {
+    case mqi_integer:
+        i1 = *(int32_t *)key;
+        i2 = *var->v.integer;
+        return (i1 > i2) - (i1 < i2);
+    case mqi_unsignd:
+        u1 = *(uint32_t *)key;
+        u2 = *var->v.unsignd;
+        return (u1 > u2) - (u1 < u2);
+    default:
+        return 0;
+    }
+}
+
+static int print_value(mqi_variable_t *var, char *buf, int len)
+{
+    switch (var->type) {
+    case mqi_varchar:  return snprintf(buf, len, "'%s'", *var->v.varchar);
+    case mqi_integer:  return snprintf(buf, len, "%d", *var->v.integer);
+    case mqi_unsignd:  return snprintf(buf, len, "%u", *var->v.unsignd);
+    case mqi_floating: return snprintf(buf, len, "%lf", *var->v.floating);
+    default:           return snprintf(buf, len, "?");
+    }
+}
+
+static const char *operator_name(mqi_operator_t op)
+{
+    switch (op) {
+    case mqi_less:  return "<";
+    case mqi_leq:   return "<=";
+    case mqi_eq:    return "=";
+    case mqi_geq:   return ">=";
+    case mqi_gt:    return ">";
+    default:        return "?";
+    }
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MDB_PLAN_H__
+#define __MDB_PLAN_H__
+
+#include <murphy-db/mqi-types.h>
+#include <murphy-db/mdb.h>
+
+#include "index.h"
+#include "row.h"
+
+typedef enum {
+    mdb_plan_scan = 0,          /* iterate over every row */
+    mdb_plan_point,             /* primary index lookup */
+    mdb_plan_bucket,            /* secondary index lookup */
+    mdb_plan_range,             /* ordered index range scan */
+    mdb_plan_vector,            /* vectorized scan of column vectors */
+} mdb_plan_type_t;
+
+#define MDB_PLAN_FILTER_MAX  8
+
+/*
+ * An access plan for a condition. The plan only narrows down the set of
+ * candidate rows; every candidate still needs to be checked against the
+ * full condition.
+ */
+typedef struct {
+    mdb_plan_type_t        type;
+    mdb_secondary_index_t *index;       /* NULL for the primary index */
+    int                    column;      /* range scan column */
+    mqi_variable_t        *lower;       /* range scan bounds or NULL */
+    int                    lower_incl;
+    mqi_variable_t        *upper;
+    int                    upper_incl;
+    int                    nterm;       /* number of conjunctive terms */
+    int                    nused;       /* terms covered by the index */
+    int                    klen;
+    uint8_t                key[MDB_INDEX_LENGTH_MAX];
+    int                    nfilter;     /* vectorized scan filters */
+    mdb_row_filter_t       filters[MDB_PLAN_FILTER_MAX];
+    /* iteration state */
+    int                    done;
+    void                  *cursor;
+    mdb_row_t            **rows;
+    int                    nrow;
+    int                    idx;
+} mdb_plan_t;
+
+
+int mdb_plan_create(mdb_table_t *, mqi_cond_entry_t *, mdb_plan_t *);
+mdb_row_t *mdb_plan_iterate(mdb_table_t *, mdb_plan_t *);
+void mdb_plan_reset(mdb_table_t *, mdb_plan_t *);
+int mdb_plan_print(mdb_table_t *, mdb_plan_t *, char *, int);
+
+
+#endif /* __MDB_PLAN_H__ */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
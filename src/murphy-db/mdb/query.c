@@ -0,0 +1,1282 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <murphy-db/assert.h>
+#include <murphy-db/hash.h>
+#include <murphy-db/sequence.h>
+#include "table.h"
+#include "cond.h"
+#include "plan.h"
+
+#define QUERY_ALLOC_MIN  32
+
+#define RECORD(q, idx)   ((q)->recs + (q)->size * (idx))
+
+/*
+ * The state of a query. Unordered results are written straight into
+ * the caller's buffer. Ordered ones are collected into 'recs' first;
+ * with a limit only the best 'limit' of them are kept, in a heap of
+ * record indices with the one to be dropped next on the top.
+ */
+typedef struct {
+    mdb_table_t       *tbl;
+    mqi_column_desc_t *cds;
+    mqi_data_type_t   *types;       /* result type of each column */
+    int                ncd;
+    bool               aggregated;
+    int               *group;
+    int                ngroup;
+    mqi_order_t       *order;
+    int                norder;
+    int                limit;
+    int                size;        /* length of a result record */
+    void              *results;
+    int                dim;
+    int                nresult;
+    char              *recs;
+    int               *heap;
+    int                nrec;
+    int                nalloc;
+    char              *scratch;     /* candidate for a full heap */
+} query_t;
+
+typedef struct {
+    mdb_table_t       *tbl;
+    mdb_plan_t        *plan;
+    bool               indexed;
+    void              *cursor;
+} row_iterator_t;
+
+/*
+ * A cursor hands out the matching rows one by one straight from the
+ * table. It refers to the caller's condition and column descriptors,
+ * so those must stay around until the cursor is closed, and the table
+ * must not be changed meanwhile.
+ */
+struct mdb_cursor_s {
+    mdb_table_t        *tbl;
+    mqi_cond_entry_t   *cond;
+    mqi_column_desc_t  *cds;
+    mdb_cond_program_t *prog;
+    mdb_plan_t          plan;
+    row_iterator_t      it;
+    mdb_row_t          *row;        /* the current row */
+    bool                done;
+};
+
+/*
+ * An equi-join. The outer table is scanned and the rows of the inner
+ * table with the same join column value are looked up for each outer
+ * row, either from an index on the inner join column or from a hash
+ * table built over the inner table for the duration of the join.
+ */
+typedef struct {
+    int                    nrow;
+    mdb_row_t            **rows;
+} join_run_t;
+
+typedef struct {
+    mdb_table_t           *outer;
+    mdb_column_t          *ocol;        /* join column of the outer table */
+    mdb_table_t           *inner;
+    mdb_column_t          *icol;        /* join column of the inner table */
+    bool                   swapped;     /* outer is the right table */
+    bool                   primary;     /* look up the inner primary index */
+    mdb_secondary_index_t *index;       /* or this inner secondary index */
+    mdb_row_t             *match;       /* primary index lookup result */
+    mqi_data_type_t        ktype;       /* key type of the transient hash */
+    mdb_hash_t            *hash;        /* join key => join_run_t */
+    join_run_t            *runs;
+    mdb_row_t            **rows;        /* inner rows sorted by join key */
+} join_t;
+
+
+static int query_init(query_t *, mdb_table_t *, mqi_column_desc_t *,
+                      mqi_query_t *, void *, int, int);
+static void query_reset(query_t *);
+static int query_finish(query_t *);
+static int select_rows(query_t *, mqi_cond_entry_t *, mdb_cond_program_t *,
+                       mdb_plan_t *);
+static int select_groups(query_t *, mqi_cond_entry_t *, mdb_cond_program_t *,
+                         mdb_plan_t *);
+static bool ordered_by_index(query_t *, mdb_plan_t *);
+static int row_matches(mdb_table_t *, mdb_cond_program_t *,
+                       mqi_cond_entry_t *, mdb_row_t *);
+static void iterator_init(row_iterator_t *, mdb_table_t *, mdb_plan_t *);
+static mdb_row_t *iterator_next(row_iterator_t *);
+static void iterator_reset(row_iterator_t *);
+static void *record_get(query_t *);
+static int record_put(query_t *);
+static int record_compare(const void *, const void *, query_t *);
+static int index_compare(const void *, const void *, void *);
+static int row_compare(const void *, const void *, void *);
+static int value_compare(mqi_data_type_t, int, const void *, const void *);
+static void heap_up(query_t *, int);
+static void heap_down(query_t *, int);
+static void aggregate(query_t *, mdb_row_t **, int, void *);
+static void zero_value(mqi_data_type_t, int, void *);
+static int join_init(join_t *, mdb_table_t *, int, mdb_table_t *, int);
+static void join_reset(join_t *);
+static void join_swap(join_t *);
+static bool join_index(join_t *);
+static int join_hash(join_t *);
+static int join_lookup(join_t *, mdb_row_t *, mdb_row_t ***);
+static int join_compare(const void *, const void *, void *);
+
+
+/*
+ * select with aggregates, grouping, ordering and a limit. Plain
+ * columns next to aggregates take their value from the first row
+ * of the group.
+ */
+int mdb_table_select_query(mdb_table_t       *tbl,
+                           mqi_cond_entry_t  *cond,
+                           mqi_column_desc_t *cds,
+                           mqi_query_t       *query,
+                           void              *results,
+                           int                size,
+                           int                dim)
+{
+    query_t             q;
+    mdb_plan_t          plan;
+    mdb_cond_program_t *prog;
+    int                 nresult;
+
+    MDB_CHECKARG(tbl && cds && results && size > 0 && dim > 0, -1);
+
+    if (dim > MQI_QUERY_RESULT_MAX)
+        dim = MQI_QUERY_RESULT_MAX;
+
+    if (query_init(&q, tbl, cds, query, results, size, dim) < 0)
+        return -1;
+
+    if (mdb_plan_create(tbl, cond, &plan) < 0) {
+        query_reset(&q);
+        return -1;
+    }
+
+    prog = cond ? mdb_cond_compile(tbl, cond) : NULL;
+
+    if (q.aggregated)
+        nresult = select_groups(&q, cond, prog, &plan);
+    else
+        nresult = select_rows(&q, cond, prog, &plan);
+
+    mdb_plan_reset(tbl, &plan);
+    mdb_cond_free(prog);
+    query_reset(&q);
+
+    return nresult;
+}
+
+
+mdb_cursor_t *mdb_table_cursor_open(mdb_table_t       *tbl,
+                                    mqi_cond_entry_t  *cond,
+                                    mqi_column_desc_t *cds)
+{
+    mdb_cursor_t      *cur;
+    mqi_column_desc_t *cd;
+
+    MDB_CHECKARG(tbl, NULL);
+
+    for (cd = cds;  cd && cd->cindex >= 0;  cd++) {
+        if (cd->cindex >= tbl->ncolumn ||
+            cd->aggregate != mqi_aggregate_none)
+        {
+            errno = EINVAL;
+            return NULL;
+        }
+    }
+
+    if (!(cur = calloc(1, sizeof(*cur)))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (mdb_plan_create(tbl, cond, &cur->plan) < 0) {
+        free(cur);
+        return NULL;
+    }
+
+    cur->tbl  = tbl;
+    cur->cond = cond;
+    cur->cds  = cds;
+    cur->prog = cond ? mdb_cond_compile(tbl, cond) : NULL;
+
+    iterator_init(&cur->it, tbl, &cur->plan);
+
+    return cur;
+}
+
+int mdb_cursor_next(mdb_cursor_t *cur, void *result)
+{
+    mdb_row_t *row;
+
+    MDB_CHECKARG(cur, -1);
+
+    if (cur->done)
+        return 0;
+
+    while ((row = iterator_next(&cur->it))) {
+        if (row_matches(cur->tbl, cur->prog, cur->cond, row))
+            break;
+    }
+
+    if (!(cur->row = row)) {
+        /* the iterators would start over if we went on */
+        cur->done = true;
+        return 0;
+    }
+
+    if (result)
+        mdb_cursor_read(cur, result);
+
+    return 1;
+}
+
+int mdb_cursor_read(mdb_cursor_t *cur, void *result)
+{
+    mdb_column_t      *columns;
+    mqi_column_desc_t *cd;
+
+    MDB_CHECKARG(cur && cur->row && cur->cds && result, -1);
+
+    columns = cur->tbl->columns;
+
+    for (cd = cur->cds;  cd->cindex >= 0;  cd++)
+        mdb_column_read(cd, result, columns + cd->cindex, cur->row->data);
+
+    return 0;
+}
+
+void *mdb_cursor_get_column(mdb_cursor_t *cur, int cindex)
+{
+    mdb_table_t *tbl;
+
+    MDB_CHECKARG(cur && cur->row, NULL);
+
+    tbl = cur->tbl;
+
+    MDB_CHECKARG(cindex >= 0 && cindex < tbl->ncolumn, NULL);
+
+    return mdb_column_value(tbl->columns + cindex, cur->row->data);
+}
+
+int mdb_cursor_close(mdb_cursor_t *cur)
+{
+    MDB_CHECKARG(cur, -1);
+
+    iterator_reset(&cur->it);
+    mdb_plan_reset(cur->tbl, &cur->plan);
+    mdb_cond_free(cur->prog);
+
+    free(cur);
+
+    return 0;
+}
+
+
+/*
+ * Columns of a join are numbered across the two tables: the columns
+ * of the right table follow the ones of the left table both in the
+ * condition and in the column descriptors. The condition is checked
+ * against a combined image of the two rows.
+ */
+int mdb_table_select_join(mdb_table_t       *left,
+                          int                lcol,
+                          mdb_table_t       *right,
+                          int                rcol,
+                          mqi_cond_entry_t  *cond,
+                          mqi_column_desc_t *cds,
+                          void              *results,
+                          int                size,
+                          int                dim)
+{
+    join_t              j;
+    mdb_plan_t          plan;
+    row_iterator_t      it;
+    mdb_column_t       *columns;
+    mdb_column_t       *col;
+    mdb_cond_program_t *prog;
+    mqi_column_desc_t  *cd;
+    mdb_row_t          *row, **rows, *lrow, *rrow;
+    uint8_t            *data;
+    void               *dst;
+    int                 ncolumn, roffs;
+    int                 nresult, nrow;
+    int                 i;
+
+    MDB_CHECKARG(left && right && cds && results && size > 0 && dim > 0, -1);
+    MDB_CHECKARG(lcol >= 0 && lcol < left->ncolumn &&
+                 rcol >= 0 && rcol < right->ncolumn, -1);
+
+    ncolumn = left->ncolumn + right->ncolumn;
+    roffs   = (left->dlgh + 7) & ~7;
+
+    for (cd = cds;  cd->cindex >= 0;  cd++) {
+        if (cd->cindex >= ncolumn || cd->aggregate != mqi_aggregate_none) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    if (!(columns = malloc(ncolumn * sizeof(*columns)))) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    memcpy(columns, left->columns, left->ncolumn * sizeof(*columns));
+    memcpy(columns + left->ncolumn, right->columns,
+           right->ncolumn * sizeof(*columns));
+
+    for (i = left->ncolumn;  i < ncolumn;  i++)
+        columns[i].offset += roffs;
+
+    prog = NULL;
+    data = NULL;
+
+    if (cond) {
+        if (!(prog = mdb_cond_compile_columns(columns, ncolumn, cond)))
+            goto failed;
+
+        if (!(data = calloc(1, roffs + right->dlgh))) {
+            errno = ENOMEM;
+            goto failed;
+        }
+    }
+
+    if (join_init(&j, left, lcol, right, rcol) < 0) {
+        join_reset(&j);
+        goto failed;
+    }
+
+    mdb_plan_create(j.outer, NULL, &plan);
+    iterator_init(&it, j.outer, &plan);
+
+    for (nresult = 0;  (row = iterator_next(&it));  ) {
+        nrow = join_lookup(&j, row, &rows);
+
+        for (i = 0;  i < nrow;  i++) {
+            lrow = j.swapped ? rows[i] : row;
+            rrow = j.swapped ? row : rows[i];
+
+            if (prog) {
+                memcpy(data, lrow->data, left->dlgh);
+                memcpy(data + roffs, rrow->data, right->dlgh);
+
+                if (!mdb_cond_execute(prog, data))
+                    continue;
+            }
+
+            if (nresult >= dim) {
+                errno = EOVERFLOW;
+                nresult = -1;
+                goto out;
+            }
+
+            dst = results + size * nresult++;
+
+            for (cd = cds;  cd->cindex >= 0;  cd++) {
+                if (cd->cindex < left->ncolumn) {
+                    col = left->columns + cd->cindex;
+                    mdb_column_read(cd, dst, col, lrow->data);
+                }
+                else {
+                    col = right->columns + (cd->cindex - left->ncolumn);
+                    mdb_column_read(cd, dst, col, rrow->data);
+                }
+            }
+        }
+    }
+
+ out:
+    iterator_reset(&it);
+    mdb_plan_reset(j.outer, &plan);
+    join_reset(&j);
+    mdb_cond_free(prog);
+    free(data);
+    free(columns);
+
+    return nresult;
+
+ failed:
+    mdb_cond_free(prog);
+    free(data);
+    free(columns);
+
+    return -1;
+}
+
+
+static int query_init(query_t           *q,
+                      mdb_table_t       *tbl,
+                      mqi_column_desc_t *cds,
+                      mqi_query_t       *query,
+                      void              *results,
+                      int                size,
+                      int                dim)
+{
+    mqi_column_desc_t *cd;
+    int                i;
+
+    memset(q, 0, sizeof(*q));
+
+    q->tbl     = tbl;
+    q->cds     = cds;
+    q->size    = size;
+    q->results = results;
+    q->dim     = dim;
+
+    for (cd = cds;  cd->cindex >= 0;  cd++) {
+        if (cd->cindex >= tbl->ncolumn)
+            goto invalid;
+        if (cd->aggregate != mqi_aggregate_none)
+            q->aggregated = true;
+        q->ncd++;
+    }
+
+    if (query) {
+        if ((q->group = query->group_by)) {
+            for (i = 0;  q->group[i] >= 0;  i++) {
+                if (q->group[i] >= tbl->ncolumn)
+                    goto invalid;
+            }
+            if ((q->ngroup = i) > 0)
+                q->aggregated = true;
+        }
+
+        if ((q->order = query->order_by)) {
+            for (i = 0;  q->order[i].column >= 0;  i++) {
+                if (q->order[i].column >= q->ncd)
+                    goto invalid;
+            }
+            q->norder = i;
+        }
+
+        if ((q->limit = query->limit) < 0)
+            goto invalid;
+    }
+
+    if (!(q->types = calloc(q->ncd + 1, sizeof(*q->types))))
+        return -1;
+
+    for (i = 0;  i < q->ncd;  i++) {
+        cd = cds + i;
+        q->types[i] = mqi_aggregate_type(cd->aggregate,
+                                         tbl->columns[cd->cindex].type);
+        if (q->types[i] == mqi_error) {
+            query_reset(q);
+            goto invalid;
+        }
+    }
+
+    if (q->norder && q->limit && !(q->scratch = malloc(size))) {
+        query_reset(q);
+        return -1;
+    }
+
+    return 0;
+
+ invalid:
+    errno = EINVAL;
+    return -1;
+}
+
+static void query_reset(query_t *q)
+{
+    free(q->types);
+    free(q->recs);
+    free(q->heap);
+    free(q->scratch);
+
+    q->types = NULL;
+    q->recs = q->scratch = NULL;
+    q->heap = NULL;
+    q->nrec = q->nalloc = 0;
+}
+
+static int query_finish(query_t *q)
+{
+    int i;
+
+    if (!q->norder)
+        return q->nresult;
+
+    qsort_r(q->heap, q->nrec, sizeof(*q->heap), index_compare, q);
+
+    for (i = 0;  i < q->nrec;  i++)
+        memcpy(q->results + q->size * i, RECORD(q, q->heap[i]), q->size);
+
+    return q->nrec;
+}
+
+
+static inline int row_matches(mdb_table_t        *tbl,
+                              mdb_cond_program_t *prog,
+                              mqi_cond_entry_t   *cond,
+                              mdb_row_t          *row)
+{
+    mqi_cond_entry_t *ce = cond;
+
+    if (!cond)
+        return 1;
+
+    if (prog)
+        return mdb_cond_execute(prog, row->data);
+
+    return mdb_cond_evaluate(tbl, &ce, row->data);
+}
+
+static int select_rows(query_t            *q,
+                       mqi_cond_entry_t   *cond,
+                       mdb_cond_program_t *prog,
+                       mdb_plan_t         *plan)
+{
+    mdb_column_t      *columns = q->tbl->columns;
+    mqi_column_desc_t *cd;
+    row_iterator_t     it;
+    mdb_row_t         *row;
+    void              *dst;
+    int                sts;
+
+    if (ordered_by_index(q, plan))
+        q->norder = 0;          /* the rows come in order, stop at the limit */
+
+    iterator_init(&it, q->tbl, plan);
+
+    for (sts = 0;  (row = iterator_next(&it));  ) {
+        if (!row_matches(q->tbl, prog, cond, row))
+            continue;
+
+        if (!(dst = record_get(q))) {
+            sts = -1;
+            break;
+        }
+
+        for (cd = q->cds;  cd->cindex >= 0;  cd++)
+            mdb_column_read(cd, dst, columns + cd->cindex, row->data);
+
+        if (record_put(q))
+            break;
+    }
+
+    iterator_reset(&it);
+
+    return sts < 0 ? -1 : query_finish(q);
+}
+
+static int select_groups(query_t            *q,
+                         mqi_cond_entry_t   *cond,
+                         mdb_cond_program_t *prog,
+                         mdb_plan_t         *plan)
+{
+    row_iterator_t   it;
+    mdb_row_t       *row;
+    mdb_row_t      **rows, **r;
+    int              nrow, nalloc;
+    int              beg, end;
+    void            *dst;
+    int              sts;
+
+    rows = NULL;
+    nrow = nalloc = 0;
+    sts  = 0;
+
+    iterator_init(&it, q->tbl, plan);
+
+    while ((row = iterator_next(&it))) {
+        if (!row_matches(q->tbl, prog, cond, row))
+            continue;
+
+        if (nrow >= nalloc) {
+            nalloc = nalloc ? nalloc * 2 : QUERY_ALLOC_MIN;
+
+            if (!(r = realloc(rows, sizeof(*rows) * nalloc))) {
+                errno = ENOMEM;
+                sts = -1;
+                break;
+            }
+
+            rows = r;
+        }
+
+        rows[nrow++] = row;
+    }
+
+    iterator_reset(&it);
+
+    if (sts == 0 && q->ngroup > 0 && nrow > 1)
+        qsort_r(rows, nrow, sizeof(*rows), row_compare, q);
+
+    /*
+     * without grouping all the rows, even none of them, make up
+     * a single group
+     */
+    for (beg = 0;  sts == 0;  beg = end) {
+        if (q->ngroup > 0) {
+            if (beg >= nrow)
+                break;
+
+            for (end = beg + 1;  end < nrow;  end++) {
+                if (row_compare(rows + beg, rows + end, q))
+                    break;
+            }
+        }
+        else
+            end = nrow;
+
+        if (!(dst = record_get(q))) {
+            sts = -1;
+            break;
+        }
+
+        aggregate(q, rows + beg, end - beg, dst);
+
+        if (record_put(q) || end >= nrow)
+            break;
+    }
+
+    free(rows);
+
+    return sts < 0 ? -1 : query_finish(q);
+}
+
+
+/*
+ * a single ascending key with an ordered single column index: range
+ * scans over that index produce the rows in order, and a plain scan
+ * can be turned into an unbounded range scan
+ */
+static bool ordered_by_index(query_t *q, mdb_plan_t *plan)
+{
+    mdb_table_t           *tbl = q->tbl;
+    mdb_index_t           *ix  = &tbl->index;
+    mdb_secondary_index_t *six;
+    mqi_data_type_t        type;
+    int                    cindex;
+
+    if (q->norder != 1 || q->order[0].descending)
+        return false;
+
+    cindex = q->cds[q->order[0].column].cindex;
+
+    switch (plan->type) {
+    case mdb_plan_point:  return true;
+    case mdb_plan_range:  return plan->column == cindex;
+    case mdb_plan_scan:   break;
+    default:              return false;
+    }
+
+    type = tbl->columns[cindex].type;
+
+    if (type != mqi_integer && type != mqi_unsignd)
+        return false;
+
+    if (MDB_INDEX_DEFINED(ix) && ix->ncolumn == 1 && ix->columns[0] == cindex)
+        plan->index = NULL;
+    else {
+        plan->index = NULL;
+
+        MDB_DLIST_FOR_EACH(mdb_secondary_index_t, link, six, &tbl->secondary) {
+            if (six->itype == mqi_index_ordered && six->ncolumn == 1 &&
+                six->columns[0] == cindex)
+            {
+                plan->index = six;
+                break;
+            }
+        }
+
+        if (!plan->index)
+            return false;
+    }
+
+    plan->type   = mdb_plan_range;
+    plan->column = cindex;
+
+    return true;
+}
+
+
+static void iterator_init(row_iterator_t *it, mdb_table_t *tbl,
+                          mdb_plan_t *plan)
+{
+    it->tbl     = tbl;
+    it->plan    = plan;
+    it->indexed = MDB_TABLE_HAS_INDEX(tbl);
+    it->cursor  = NULL;
+}
+
+static mdb_row_t *iterator_next(row_iterator_t *it)
+{
+    mdb_table_t *tbl = it->tbl;
+    mdb_dlist_t *head, *next;
+
+    if (it->plan->type != mdb_plan_scan)
+        return mdb_plan_iterate(tbl, it->plan);
+
+    if (it->indexed)
+        return mdb_sequence_iterate(tbl->index.sequence, &it->cursor);
+
+    head = &tbl->rows;
+    next = it->cursor ? (mdb_dlist_t *)it->cursor : head->next;
+
+    if (next == head)
+        return NULL;
+
+    it->cursor = next->next;
+
+    return MDB_LIST_RELOCATE(mdb_row_t, link, next);
+}
+
+static void iterator_reset(row_iterator_t *it)
+{
+    if (it->plan->type == mdb_plan_scan && it->indexed && it->cursor)
+        mdb_sequence_cursor_destroy(it->tbl->index.sequence, &it->cursor);
+
+    it->cursor = NULL;
+}
+
+
+static void *record_get(query_t *q)
+{
+    char *recs;
+    int  *heap;
+    int   nalloc;
+
+    if (!q->norder) {
+        if (q->nresult >= q->dim)
+            goto overflow;
+
+        return q->results + q->size * q->nresult;
+    }
+
+    if (q->limit && q->nrec >= q->limit)
+        return q->scratch;
+
+    if (q->nrec >= q->dim)
+        goto overflow;
+
+    if (q->nrec >= q->nalloc) {
+        nalloc = q->nalloc ? q->nalloc * 2 : QUERY_ALLOC_MIN;
+
+        if (q->limit && nalloc > q->limit)
+            nalloc = q->limit;
+
+        if (!(recs = realloc(q->recs, q->size * nalloc)))
+            goto nomem;
+
+        q->recs = recs;
+
+        if (!(heap = realloc(q->heap, sizeof(*heap) * nalloc)))
+            goto nomem;
+
+        q->heap   = heap;
+        q->nalloc = nalloc;
+    }
+
+    return RECORD(q, q->nrec);
+
+ overflow:
+    errno = EOVERFLOW;
+    return NULL;
+
+ nomem:
+    errno = ENOMEM;
+    return NULL;
+}
+
+/*
+ * returns non-zero once no more records are needed
+ */
+static int record_put(query_t *q)
+{
+    char *top;
+
+    if (!q->norder) {
+        q->nresult++;
+        return q->limit && q->nresult >= q->limit;
+    }
+
+    if (!q->limit || q->nrec < q->limit) {
+        q->heap[q->nrec] = q->nrec;
+        q->nrec++;
+
+        if (q->limit)
+            heap_up(q, q->nrec - 1);
+
+        return 0;
+    }
+
+    top = RECORD(q, q->heap[0]);
+
+    if (record_compare(q->scratch, top, q) < 0) {
+        memcpy(top, q->scratch, q->size);
+        heap_down(q, 0);
+    }
+
+    return 0;
+}
+
+static int record_compare(const void *a, const void *b, query_t *q)
+{
+    mqi_order_t       *o;
+    mqi_column_desc_t *cd;
+    mqi_data_type_t    type;
+    const void        *va, *vb;
+    int                cmp;
+
+    for (o = q->order;  o < q->order + q->norder;  o++) {
+        cd   = q->cds + o->column;
+        type = q->types[o->column];
+        va   = a + cd->offset;
+        vb   = b + cd->offset;
+
+        if (type == mqi_varchar) {
+            if (!(va = *(const char **)va))
+                va = "";
+            if (!(vb = *(const char **)vb))
+                vb = "";
+        }
+
+        cmp = value_compare(type, q->tbl->columns[cd->cindex].length, va, vb);
+
+        if (cmp)
+            return o->descending ? -cmp : cmp;
+    }
+
+    return 0;
+}
+
+static int index_compare(const void *a, const void *b, void *data)
+{
+    query_t *q = (query_t *)data;
+
+    return record_compare(RECORD(q, *(int *)a), RECORD(q, *(int *)b), q);
+}
+
+static int row_compare(const void *a, const void *b, void *data)
+{
+    query_t      *q  = (query_t *)data;
+    mdb_row_t    *ra = *(mdb_row_t **)a;
+    mdb_row_t    *rb = *(mdb_row_t **)b;
+    mdb_column_t *col;
+    int           cmp;
+    int           i;
+
+    for (i = 0;  i < q->ngroup;  i++) {
+        col = q->tbl->columns + q->group[i];
+        cmp = value_compare(col->type, col->length,
+                            mdb_column_value(col, ra->data),
+                            mdb_column_value(col, rb->data));
+        if (cmp)
+            return cmp;
+    }
+
+    return 0;
+}
+
+static int value_compare(mqi_data_type_t type, int length,
+                         const void *a, const void *b)
+{
+#define COMPARE(t) (*(t *)a < *(t *)b ? -1 : (*(t *)a > *(t *)b ? 1 : 0))
+
+    switch (type) {
+    case mqi_varchar:   return strcmp((const char *)a, (const char *)b);
+    case mqi_integer:   return COMPARE(int32_t);
+    case mqi_unsignd:   return COMPARE(uint32_t);
+    case mqi_floating:  return COMPARE(double);
+    case mqi_blob:      return memcmp(a, b, length);
+    default:            return 0;
+    }
+
+#undef COMPARE
+}
+
+
+static void heap_up(query_t *q, int i)
+{
+    int parent;
+    int tmp;
+
+    while (i > 0) {
+        parent = (i - 1) / 2;
+
+        if (record_compare(RECORD(q, q->heap[i]),
+                           RECORD(q, q->heap[parent]), q) <= 0)
+            break;
+
+        tmp = q->heap[i];
+        q->heap[i] = q->heap[parent];
+        q->heap[parent] = tmp;
+
+        i = parent;
+    }
+}
+
+static void heap_down(query_t *q, int i)
+{
+    int child, max;
+    int tmp;
+
+    for (;;) {
+        max = i;
+
+        for (child = 2 * i + 1;  child <= 2 * i + 2;  child++) {
+            if (child < q->nrec &&
+                record_compare(RECORD(q, q->heap[child]),
+                               RECORD(q, q->heap[max]), q) > 0)
+                max = child;
+        }
+
+        if (max == i)
+            break;
+
+        tmp = q->heap[i];
+        q->heap[i] = q->heap[max];
+        q->heap[max] = tmp;
+
+        i = max;
+    }
+}
+
+
+static void aggregate(query_t *q, mdb_row_t **rows, int nrow, void *dst)
+{
+    mqi_column_desc_t *cd;
+    mdb_column_t      *col;
+    mdb_row_t         *best;
+    void              *out;
+    void              *value;
+    int64_t            isum;
+    uint64_t           usum;
+    double             fsum;
+    int                cmp;
+    int                i, j;
+
+    for (j = 0;  j < q->ncd;  j++) {
+        cd  = q->cds + j;
+        col = q->tbl->columns + cd->cindex;
+        out = dst + cd->offset;
+
+        switch (cd->aggregate) {
+
+        case mqi_count:
+            *(uint32_t *)out = nrow;
+            break;
+
+        case mqi_min:
+        case mqi_max:
+            if (!nrow) {
+                zero_value(q->types[j], col->length, out);
+                break;
+            }
+
+            for (i = 1, best = rows[0];  i < nrow;  i++) {
+                cmp = value_compare(col->type, col->length,
+                                    mdb_column_value(col, rows[i]->data),
+                                    mdb_column_value(col, best->data));
+
+                if (cd->aggregate == mqi_min ? cmp < 0 : cmp > 0)
+                    best = rows[i];
+            }
+
+            mdb_column_read(cd, dst, col, best->data);
+            break;
+
+        case mqi_sum:
+        case mqi_avg:
+            isum = 0;
+            usum = 0;
+            fsum = 0.0;
+
+            for (i = 0;  i < nrow;  i++) {
+                value = rows[i]->data + col->offset;
+
+                switch (col->type) {
+                case mqi_integer:   isum += *(int32_t *)value;   break;
+                case mqi_unsignd:   usum += *(uint32_t *)value;  break;
+                case mqi_floating:  fsum += *(double *)value;    break;
+                default:                                         break;
+                }
+            }
+
+            if (cd->aggregate == mqi_avg) {
+                fsum += (double)isum + (double)usum;
+                *(double *)out = nrow ? fsum / nrow : 0.0;
+                break;
+            }
+
+            switch (col->type) {
+            case mqi_integer:   *(int32_t *)out  = (int32_t)isum;   break;
+            case mqi_unsignd:   *(uint32_t *)out = (uint32_t)usum;  break;
+            case mqi_floating:  *(double *)out   = fsum;            break;
+            default:                                                break;
+            }
+            break;
+
+        default:
+            if (nrow)
+                mdb_column_read(cd, dst, col, rows[0]->data);
+            else
+                zero_value(q->types[j], col->length, out);
+            break;
+        }
+    }
+}
+
+static void zero_value(mqi_data_type_t type, int length, void *out)
+{
+    switch (type) {
+    case mqi_varchar:   *(const char **)out = "";   break;
+    case mqi_integer:   *(int32_t *)out = 0;        break;
+    case mqi_unsignd:   *(uint32_t *)out = 0;       break;
+    case mqi_floating:  *(double *)out = 0.0;       break;
+    case mqi_blob:      memset(out, 0, length);     break;
+    default:                                        break;
+    }
+}
+
+
+static int join_init(join_t      *j,
+                     mdb_table_t *left,
+                     int          lcol,
+                     mdb_table_t *right,
+                     int          rcol)
+{
+    mdb_column_t *lc = left->columns + lcol;
+    mdb_column_t *rc = right->columns + rcol;
+
+    memset(j, 0, sizeof(*j));
+
+    if (lc->type != rc->type ||
+        (lc->type == mqi_blob && lc->length != rc->length))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    j->outer = left;
+    j->ocol  = lc;
+    j->inner = right;
+    j->icol  = rc;
+
+    /*
+     * prefer an index on the inner join column, then one on the outer
+     * join column; without either hash the smaller of the tables
+     */
+    if (!join_index(j)) {
+        join_swap(j);
+
+        if (!join_index(j)) {
+            if (j->inner->nrow > j->outer->nrow)
+                join_swap(j);
+
+            return join_hash(j);
+        }
+    }
+
+    return 0;
+}
+
+static void join_reset(join_t *j)
+{
+    if (j->hash)
+        mdb_hash_table_destroy(j->hash);
+
+    free(j->runs);
+    free(j->rows);
+}
+
+static void join_swap(join_t *j)
+{
+    mdb_table_t  *tbl = j->outer;
+    mdb_column_t *col = j->ocol;
+
+    j->outer   = j->inner;
+    j->ocol    = j->icol;
+    j->inner   = tbl;
+    j->icol    = col;
+    j->swapped = !j->swapped;
+}
+
+static bool join_index(join_t *j)
+{
+    mdb_table_t           *tbl    = j->inner;
+    int                    cindex = j->icol - tbl->columns;
+    mdb_secondary_index_t *six;
+
+    j->primary = MDB_TABLE_HAS_INDEX(tbl) && tbl->index.ncolumn == 1 &&
+                 tbl->index.columns[0] == cindex;
+    j->index   = NULL;
+
+    /* the index keys of out of line varchars are private to the table */
+    if (j->icol->heap || j->ocol->heap) {
+        j->primary = false;
+        return false;
+    }
+
+    if (j->primary)
+        return true;
+
+    MDB_DLIST_FOR_EACH(mdb_secondary_index_t, link, six, &tbl->secondary) {
+        if (six->ncolumn == 1 && six->columns[0] == cindex) {
+            j->index = six;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * the inner rows are sorted by the join key, so the rows of a key
+ * are a run in the sorted array; the hash maps the keys to the runs.
+ * Floating point keys are hashed and compared bitwise.
+ */
+static int join_hash(join_t *j)
+{
+    mdb_table_t  *tbl = j->inner;
+    mdb_column_t *col = j->icol;
+    mdb_row_t    *row;
+    join_run_t   *run;
+    int           nrow, max;
+    int           i;
+
+    j->ktype = (col->type == mqi_floating) ? mqi_blob : col->type;
+
+    if (!tbl->nrow)
+        return 0;
+
+    max = tbl->nrow > 1 ? tbl->nrow : 2;
+
+    switch (j->ktype) {
+    case mqi_varchar:  j->hash = MDB_HASH_TABLE_CREATE(varchar, max);  break;
+    case mqi_integer:  j->hash = MDB_HASH_TABLE_CREATE(integer, max);  break;
+    case mqi_unsignd:  j->hash = MDB_HASH_TABLE_CREATE(unsignd, max);  break;
+    case mqi_blob:     j->hash = MDB_HASH_TABLE_CREATE(blob, max);     break;
+    default:           errno = EINVAL;                                 break;
+    }
+
+    if (!j->hash)
+        return -1;
+
+    if (!(j->rows = malloc(tbl->nrow * sizeof(*j->rows))) ||
+        !(j->runs = malloc(tbl->nrow * sizeof(*j->runs))))
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    nrow = 0;
+
+    MDB_DLIST_FOR_EACH(mdb_row_t, link, row, &tbl->rows) {
+        if (nrow >= tbl->nrow)
+            break;
+        j->rows[nrow++] = row;
+    }
+
+    qsort_r(j->rows, nrow, sizeof(*j->rows), join_compare, j);
+
+    for (i = 0, run = NULL;  i < nrow;  i++) {
+        if (run && !join_compare(j->rows + i - 1, j->rows + i, j)) {
+            run->nrow++;
+            continue;
+        }
+
+        run = run ? run + 1 : j->runs;
+        run->nrow = 1;
+        run->rows = j->rows + i;
+
+        if (mdb_hash_add(j->hash, col->length,
+                         mdb_column_value(col, j->rows[i]->data), run) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+static int join_lookup(join_t *j, mdb_row_t *row, mdb_row_t ***rows)
+{
+    void               *key = row->data + j->ocol->offset;
+    mdb_index_bucket_t *bucket;
+    join_run_t         *run;
+
+    if (j->primary) {
+        if (!(j->match = mdb_index_get_row(j->inner, j->icol->length, key)))
+            return 0;
+
+        *rows = &j->match;
+        return 1;
+    }
+
+    if (j->index) {
+        if (!(bucket = mdb_index_get_bucket(j->index, key)))
+            return 0;
+
+        *rows = bucket->rows;
+        return bucket->nrow;
+    }
+
+    key = mdb_column_value(j->ocol, row->data);
+
+    if (!j->hash || !(run = mdb_hash_get_data(j->hash, j->icol->length, key)))
+        return 0;
+
+    *rows = run->rows;
+    return run->nrow;
+}
+
+static int join_compare(const void *a, const void *b, void *data)
+{
+    join_t       *j   = (join_t *)data;
+    mdb_column_t *col = j->icol;
+    mdb_row_t    *ra  = *(mdb_row_t **)a;
+    mdb_row_t    *rb  = *(mdb_row_t **)b;
+
+    return value_compare(j->ktype, col->length,
+                         mdb_column_value(col, ra->data),
+                         mdb_column_value(col, rb->data));
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
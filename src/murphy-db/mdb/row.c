@@ -42,19 +42,216 @@
 #include "table.h"
 #include "index.h"
 #include "column.h"
+#include "version.h"
 
 
 
+/*
+ * Rows are allocated from per-table pages of fixed size slots. A page
+ * keeps a bitmap of its used slots and pages with free slots are kept
+ * on a separate list, so allocating and releasing a row are O(1). Rows
+ * never move once allocated, so row pointers remain stable handles for
+ * the indexes and the transaction log.
+ *
+ * For columnar tables the fixed width columns of the rows are also
+ * kept in contiguous per-page vectors following the slots. Simple
+ * predicates on these can be evaluated for a whole page at a time.
+ */
+struct mdb_row_page_s {
+    mdb_dlist_t  link;          /* storage->pages */
+    mdb_dlist_t  partial;       /* storage->partial if not full */
+    uint64_t     used;          /* bitmap of the used slots */
+    uint8_t      slots[0];
+};
+
+static mdb_row_t *row_alloc(mdb_row_storage_t *);
+static void row_free(mdb_row_storage_t *, mdb_row_t *);
+static void row_sync_vectors(mdb_row_storage_t *, mdb_row_t *);
+static uint64_t page_filter(mdb_row_storage_t *, mdb_row_page_t *,
+                            mdb_row_filter_t *, int);
+
+
+void mdb_row_storage_init(mdb_row_storage_t *storage, int dlgh)
+{
+    int nslot;
+
+    MDB_DLIST_INIT(storage->pages);
+    MDB_DLIST_INIT(storage->partial);
+
+    storage->slot_size = (sizeof(mdb_row_t) + dlgh + 7) & ~7;
+
+    nslot = (MDB_ROW_PAGE_SIZE - sizeof(mdb_row_page_t)) / storage->slot_size;
+
+    if (nslot < 1)
+        nslot = 1;
+    if (nslot > MDB_ROW_PAGE_SLOTS)
+        nslot = MDB_ROW_PAGE_SLOTS;
+
+    storage->nslot     = nslot;
+    storage->page_size = nslot * storage->slot_size;
+    storage->npage     = 0;
+    storage->nvector   = 0;
+    storage->vectors = NULL;
+}
+
+int mdb_row_storage_set_columnar(mdb_row_storage_t *storage,
+                                 mdb_column_t      *columns,
+                                 int                ncolumn)
+{
+    mdb_row_vector_t *vectors, *v;
+    int               nvector;
+    int               vsize;
+    int               nslot;
+    int               voffset;
+    int               size;
+    int               i;
+
+    MDB_CHECKARG(storage && columns && ncolumn > 0, -1);
+    MDB_PREREQUISITE(!storage->npage && !storage->vectors, -1);
+
+    if (!(vectors = calloc(ncolumn, sizeof(mdb_row_vector_t)))) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    /* 8 byte values go first so that every vector stays aligned */
+    for (size = 8, nvector = vsize = 0;  size >= 4;  size -= 4) {
+        for (i = 0;  i < ncolumn;  i++) {
+            switch (columns[i].type) {
+            case mqi_integer:
+            case mqi_unsignd:
+            case mqi_floating:
+                if (columns[i].length != size)
+                    continue;
+                break;
+            default:
+                continue;
+            }
+
+            v = vectors + nvector++;
+
+            v->column = i;
+            v->type   = columns[i].type;
+            v->offset = columns[i].offset;
+            v->size   = size;
+
+            vsize += size;
+        }
+    }
+
+    if (!nvector) {
+        free(vectors);
+        return 0;
+    }
+
+    nslot = (MDB_ROW_PAGE_SIZE - sizeof(mdb_row_page_t)) /
+        (storage->slot_size + vsize);
+
+    if (nslot < 1)
+        nslot = 1;
+    if (nslot > MDB_ROW_PAGE_SLOTS)
+        nslot = MDB_ROW_PAGE_SLOTS;
+
+    for (i = 0, voffset = nslot * storage->slot_size;  i < nvector;  i++) {
+        vectors[i].voffset = voffset;
+        voffset += nslot * vectors[i].size;
+    }
+
+    storage->nslot     = nslot;
+    storage->page_size = voffset;
+    storage->nvector   = nvector;
+    storage->vectors   = vectors;
+
+    return 0;
+}
+
+int mdb_row_storage_vector(mdb_row_storage_t *storage, int column)
+{
+    int i;
+
+    for (i = 0;  i < storage->nvector;  i++) {
+        if (storage->vectors[i].column == column)
+            return i;
+    }
+
+    return -1;
+}
+
+int mdb_row_storage_scan(mdb_row_storage_t  *storage,
+                         mdb_row_filter_t   *filters,
+                         int                 nfilter,
+                         mdb_row_t        ***rows_ret)
+{
+    mdb_row_page_t  *page;
+    mdb_row_t       *row, **rows, **grown;
+    uint64_t         match;
+    int              nrow, nalloc;
+    int              slot;
+
+    MDB_CHECKARG(storage && filters && nfilter > 0 && rows_ret, -1);
+
+    rows = NULL;
+    nrow = nalloc = 0;
+
+    MDB_DLIST_FOR_EACH(mdb_row_page_t, link, page, &storage->pages) {
+        match = page_filter(storage, page, filters, nfilter);
+
+        while (match) {
+            slot   = __builtin_ctzll(match);
+            match &= match - 1;
+
+            row = (mdb_row_t *)(page->slots + slot * storage->slot_size);
+
+            /* skip before images and deleted rows kept for the log */
+            if (MDB_DLIST_EMPTY(row->link))
+                continue;
+
+            if (nrow >= nalloc) {
+                nalloc = nalloc ? 2 * nalloc : storage->nslot;
+
+                if (!(grown = realloc(rows, nalloc * sizeof(rows[0])))) {
+                    free(rows);
+                    errno = ENOMEM;
+                    return -1;
+                }
+
+                rows = grown;
+            }
+
+            rows[nrow++] = row;
+        }
+    }
+
+    *rows_ret = rows;
+
+    return nrow;
+}
+
+void mdb_row_storage_destroy(mdb_row_storage_t *storage)
+{
+    mdb_row_page_t *page, *n;
+
+    MDB_DLIST_FOR_EACH_SAFE(mdb_row_page_t, link, page,n, &storage->pages)
+        free(page);
+
+    MDB_DLIST_INIT(storage->pages);
+    MDB_DLIST_INIT(storage->partial);
+
+    free(storage->vectors);
+
+    storage->npage   = 0;
+    storage->nvector = 0;
+    storage->vectors = NULL;
+}
+
 mdb_row_t *mdb_row_create(mdb_table_t *tbl)
 {
     mdb_row_t *row;
 
     MDB_CHECKARG(tbl, NULL);
 
-    if (!(row = calloc(1, sizeof(mdb_row_t) + tbl->dlgh))) {
-        errno = ENOMEM;
+    if (!(row = row_alloc(&tbl->storage)))
         return NULL;
-    }
 
     MDB_DLIST_APPEND(mdb_row_t, link, row, &tbl->rows);
 
@@ -67,13 +264,13 @@ mdb_row_t *mdb_row_duplicate(mdb_table_t *tbl, mdb_row_t *row)
 
     MDB_CHECKARG(tbl && row, NULL);
 
-    if (!(dup = calloc(1, sizeof(mdb_row_t) + tbl->dlgh))) {
-        errno = ENOMEM;
+    if (!(dup = row_alloc(&tbl->storage)))
         return NULL;
-    }
 
-    MDB_DLIST_INIT(dup->link);
     memcpy(dup->data, row->data, tbl->dlgh);
+    dup->stamp = row->stamp;
+
+    mdb_row_retain_strings(tbl, dup->data);
 
     return dup;
 }
@@ -85,9 +282,7 @@ int mdb_row_delete(mdb_table_t *tbl,
 {
     int sts = 0;
 
-    (void)tbl;
-
-    MDB_CHECKARG(row, -1);
+    MDB_CHECKARG(tbl && row, -1);
 
     if (index_update && mdb_index_delete(tbl, row) < 0)
         sts = -1;
@@ -95,8 +290,10 @@ int mdb_row_delete(mdb_table_t *tbl,
     if (!MDB_DLIST_EMPTY(row->link))
         MDB_DLIST_UNLINK(mdb_row_t, link, row);
 
-    if (free_it)
-        free(row);
+    if (free_it) {
+        mdb_row_release_strings(tbl, row->data);
+        row_free(&tbl->storage, row);
+    }
     else
         MDB_DLIST_INIT(row->link);
 
@@ -120,16 +317,28 @@ int mdb_row_update(mdb_table_t       *tbl,
 
     columns = tbl->columns;
 
-    if (index_update)
+    if (index_update == MDB_INDEX_UPDATE_SECONDARY)
+        mdb_index_delete_secondary(tbl, row);
+    else if (index_update)
         mdb_index_delete(tbl, row);
 
     cmod = 0;
-    for (cmask = i = 0;  (cidx = (source_dsc = cds + i)->cindex) >= 0;  i++){
-        cmask |= (((mqi_bitfld_t)1) << cidx);
-        cmod |= mdb_column_write(columns + cidx, row->data, source_dsc, data);
+    mqi_bitfld_clear(&cmask);
+
+    /* only the columns that really changed make it to the mask */
+    for (i = 0;  (cidx = (source_dsc = cds + i)->cindex) >= 0;  i++) {
+        if (mdb_column_write(columns + cidx, row->data, source_dsc, data)) {
+            mqi_bitfld_set(&cmask, cidx);
+            cmod = 1;
+        }
     }
 
-    if (index_update)
+    if (tbl->storage.nvector)
+        row_sync_vectors(&tbl->storage, row);
+
+    if (index_update == MDB_INDEX_UPDATE_SECONDARY)
+        mdb_index_insert_secondary(tbl, row);
+    else if (index_update)
         mdb_index_insert(tbl, row, cmask, 0);
 
     if (cmask_ret)
@@ -148,14 +357,216 @@ int mdb_row_copy_over(mdb_table_t *tbl, mdb_row_t *dst, mdb_row_t *src)
     if (mdb_index_delete(tbl, dst) < 0)
         return -1;
 
+    mdb_row_retain_strings(tbl, src->data);
+    mdb_row_release_strings(tbl, dst->data);
+
     memcpy(dst->data, src->data, tbl->dlgh);
 
-    if (mdb_index_insert(tbl, dst, 0, 0) < 0)
+    if (tbl->storage.nvector)
+        row_sync_vectors(&tbl->storage, dst);
+
+    if (mdb_index_insert(tbl, dst, MQI_BITFLD_NONE, 0) < 0)
         return -1;
 
     return 0;
 }
 
+int mdb_row_load(mdb_table_t *tbl, mdb_row_t *row, void *data)
+{
+    MDB_CHECKARG(tbl && row && data, -1);
+
+    memcpy(row->data, data, tbl->dlgh);
+
+    if (tbl->storage.nvector)
+        row_sync_vectors(&tbl->storage, row);
+
+    return 0;
+}
+
+/*
+ * row images copied around take their own references to the strings
+ * of the out of line varchars
+ */
+void mdb_row_retain_strings(mdb_table_t *tbl, void *data)
+{
+    mdb_column_t *col;
+    int           i;
+
+    if (!tbl->strings)
+        return;
+
+    for (i = 0, col = tbl->columns;  i < tbl->ncolumn;  i++, col++) {
+        if (col->heap)
+            mdb_strheap_retain(col->heap, *(const char **)(data+col->offset));
+    }
+}
+
+void mdb_row_release_strings(mdb_table_t *tbl, void *data)
+{
+    mdb_column_t *col;
+    int           i;
+
+    if (!tbl->strings)
+        return;
+
+    for (i = 0, col = tbl->columns;  i < tbl->ncolumn;  i++, col++) {
+        if (col->heap)
+            mdb_strheap_release(col->heap, *(const char **)(data+col->offset));
+    }
+}
+
+static inline uint64_t page_full_mask(mdb_row_storage_t *storage)
+{
+    if (storage->nslot >= 64)
+        return ~(uint64_t)0;
+    else
+        return (((uint64_t)1) << storage->nslot) - 1;
+}
+
+static mdb_row_t *row_alloc(mdb_row_storage_t *storage)
+{
+    mdb_row_page_t *page;
+    mdb_row_t      *row;
+    int             slot;
+
+    if (!MDB_DLIST_EMPTY(storage->partial))
+        page = MDB_LIST_RELOCATE(mdb_row_page_t, partial,
+                                 storage->partial.next);
+    else {
+        page = calloc(1, sizeof(mdb_row_page_t) + storage->page_size);
+        if (!page) {
+            errno = ENOMEM;
+            return NULL;
+        }
+
+        MDB_DLIST_APPEND(mdb_row_page_t, link, page, &storage->pages);
+        MDB_DLIST_APPEND(mdb_row_page_t, partial, page, &storage->partial);
+
+        storage->npage++;
+    }
+
+    slot = __builtin_ctzll(~page->used);
+    page->used |= ((uint64_t)1) << slot;
+
+    if (page->used == page_full_mask(storage))
+        MDB_DLIST_UNLINK(mdb_row_page_t, partial, page);
+
+    row = (mdb_row_t *)(page->slots + slot * storage->slot_size);
+
+    memset(row, 0, storage->slot_size);
+    MDB_DLIST_INIT(row->link);
+    row->page = page;
+
+    return row;
+}
+
+static void row_free(mdb_row_storage_t *storage, mdb_row_t *row)
+{
+    mdb_row_page_t *page = row->page;
+    int             slot;
+    int             full;
+
+    /* the saved image of a row deleted in a transaction outlives it */
+    if (row->version)
+        row->version->row = NULL;
+
+    slot = ((uint8_t *)row - page->slots) / storage->slot_size;
+    full = (page->used == page_full_mask(storage));
+
+    page->used &= ~(((uint64_t)1) << slot);
+
+    if (full)
+        MDB_DLIST_APPEND(mdb_row_page_t, partial, page, &storage->partial);
+
+    if (!page->used && storage->partial.next != storage->partial.prev) {
+        /* release empty pages, unless it is the only one with free slots */
+        MDB_DLIST_UNLINK(mdb_row_page_t, partial, page);
+        MDB_DLIST_UNLINK(mdb_row_page_t, link, page);
+        free(page);
+
+        storage->npage--;
+    }
+}
+
+static void row_sync_vectors(mdb_row_storage_t *storage, mdb_row_t *row)
+{
+    mdb_row_page_t   *page = row->page;
+    mdb_row_vector_t *v;
+    uint8_t          *data;
+    int               slot;
+    int               i;
+
+    slot = ((uint8_t *)row - page->slots) / storage->slot_size;
+
+    for (i = 0;  i < storage->nvector;  i++) {
+        v    = storage->vectors + i;
+        data = page->slots + v->voffset + slot * v->size;
+
+        memcpy(data, row->data + v->offset, v->size);
+    }
+}
+
+/*
+ * The filters are evaluated to a byte per slot in straight loops over
+ * the vectors that the compiler can turn into SIMD code. The result is
+ * then packed into a bitmap of the matching slots.
+ */
+#define FILTER_LOOP(ctype, op)                                          \
+    do {                                                                \
+        const ctype *val = (const ctype *)vec;                          \
+        ctype        ref = *(const ctype *)f->var->v.generic;           \
+                                                                        \
+        for (i = 0;  i < nslot;  i++)                                   \
+            sel[i] &= (val[i] op ref);                                  \
+    } while (0)
+
+#define FILTER_TYPE(ctype)                                              \
+    switch (f->op) {                                                    \
+    case mqi_less:  FILTER_LOOP(ctype, < );  break;                     \
+    case mqi_leq:   FILTER_LOOP(ctype, <=);  break;                     \
+    case mqi_eq:    FILTER_LOOP(ctype, ==);  break;                     \
+    case mqi_geq:   FILTER_LOOP(ctype, >=);  break;                     \
+    case mqi_gt:    FILTER_LOOP(ctype, > );  break;                     \
+    default:        return 0;                                           \
+    }
+
+static uint64_t page_filter(mdb_row_storage_t *storage,
+                            mdb_row_page_t    *page,
+                            mdb_row_filter_t  *filters,
+                            int                nfilter)
+{
+    uint8_t           sel[MDB_ROW_PAGE_SLOTS];
+    mdb_row_filter_t *f;
+    mdb_row_vector_t *v;
+    uint8_t          *vec;
+    uint64_t          match;
+    int               nslot = storage->nslot;
+    int               i, j;
+
+    memset(sel, 1, nslot);
+
+    for (j = 0;  j < nfilter;  j++) {
+        f   = filters + j;
+        v   = storage->vectors + f->vector;
+        vec = page->slots + v->voffset;
+
+        switch (v->type) {
+        case mqi_integer:   FILTER_TYPE(int32_t);   break;
+        case mqi_unsignd:   FILTER_TYPE(uint32_t);  break;
+        case mqi_floating:  FILTER_TYPE(double);    break;
+        default:            return 0;
+        }
+    }
+
+    for (i = 0, match = 0;  i < nslot;  i++)
+        match |= ((uint64_t)sel[i]) << i;
+
+    return match & page->used;
+}
+
+#undef FILTER_TYPE
+#undef FILTER_LOOP
+
 
 /*
  * Local Variables:
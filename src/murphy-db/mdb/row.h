@@ -33,20 +33,71 @@
 #include <murphy-db/mqi-types.h>
 #include <murphy-db/list.h>
 #include <murphy-db/mdb.h>
+#include "column.h"
 
-typedef struct mdb_row_s mdb_row_t;
+#define MDB_ROW_PAGE_SIZE  16384  /* preferred size of a row storage page */
+#define MDB_ROW_PAGE_SLOTS 64     /* max. number of rows in a page */
+
+typedef struct mdb_row_s       mdb_row_t;
+typedef struct mdb_row_page_s  mdb_row_page_t;
+typedef struct mdb_version_s   mdb_version_t;
+
+/*
+ * a fixed width column kept also in a per-page column vector
+ */
+typedef struct {
+    int              column;    /* column index */
+    mqi_data_type_t  type;
+    int              offset;    /* offset of the column in the row data */
+    int              size;      /* size of a value */
+    int              voffset;   /* offset of the vector in the page */
+} mdb_row_vector_t;
+
+/*
+ * a <column vector> <relop> <variable> filter for vectorized scans
+ */
+typedef struct {
+    int              vector;
+    mqi_operator_t   op;
+    mqi_variable_t  *var;
+} mdb_row_filter_t;
+
+typedef struct {
+    mdb_dlist_t       pages;      /* all pages of the table */
+    mdb_dlist_t       partial;    /* pages with at least one free slot */
+    int               slot_size;  /* size of a row incl. its header */
+    int               nslot;      /* number of slots in a page */
+    int               page_size;  /* size of slots and vectors of a page */
+    int               npage;
+    int               nvector;    /* number of column vectors */
+    mdb_row_vector_t *vectors;    /* for columnar tables, otherwise NULL */
+} mdb_row_storage_t;
 
 struct mdb_row_s {
-    mdb_dlist_t  link;
-    uint8_t      data[0];
+    mdb_dlist_t     link;
+    mdb_row_page_t *page;       /* the page this row lives in */
+    mdb_version_t  *version;    /* while changed in a transaction */
+    uint32_t        stamp;      /* commit stamp of the current image */
+    uint32_t        unused;     /* keeps the data 8-byte aligned */
+    uint8_t         data[0];
 };
 
+void mdb_row_storage_init(mdb_row_storage_t *, int);
+int  mdb_row_storage_set_columnar(mdb_row_storage_t *, mdb_column_t *, int);
+int  mdb_row_storage_vector(mdb_row_storage_t *, int);
+int  mdb_row_storage_scan(mdb_row_storage_t *, mdb_row_filter_t *, int,
+                          mdb_row_t ***);
+void mdb_row_storage_destroy(mdb_row_storage_t *);
+
 mdb_row_t *mdb_row_create(mdb_table_t *);
 mdb_row_t *mdb_row_duplicate(mdb_table_t *, mdb_row_t *);
 int mdb_row_delete(mdb_table_t *, mdb_row_t *, int, int);
 int mdb_row_update(mdb_table_t *, mdb_row_t *, mqi_column_desc_t *,
                    void *, int, mqi_bitfld_t *);
 int mdb_row_copy_over(mdb_table_t *, mdb_row_t *, mdb_row_t *);
+int mdb_row_load(mdb_table_t *, mdb_row_t *, void *);
+void mdb_row_retain_strings(mdb_table_t *, void *);
+void mdb_row_release_strings(mdb_table_t *, void *);
 
 #endif /* __MDB_ROW_H__ */
 
@@ -43,24 +43,64 @@
 #include <murphy-db/assert.h>
 #include <murphy-db/sequence.h>
 
-typedef struct mdb_sequence_entry_s {
-    void         *key;
-    void         *data;
-} sequence_entry_t;
+#define SEQUENCE_LEVEL_MAX  16  /* 4^16 entries before degrading */
 
+/*
+ * Sequences are skip lists with a branching factor of 4. Entries are
+ * kept in key order on the doubly linked bottom level, so additions and
+ * deletions are O(log n) and nothing needs to be moved around.
+ */
+typedef struct mdb_sequence_entry_s sequence_entry_t;
+
+struct mdb_sequence_entry_s {
+    void             *key;
+    void             *data;
+    sequence_entry_t *prev;
+    int               level;
+    sequence_entry_t *next[];
+};
+
+/*
+ * Cursors do not hold on to the entries. If the sequence was modified
+ * since the last step the cursor finds its place again by a copy of the
+ * last key it has passed, so rows can safely be added or deleted while
+ * iterating. Keys that only refer to their value, like interned strings,
+ * are copied with the key copy function of the sequence instead.
+ */
+typedef struct {
+    uint32_t          stamp;
+    sequence_entry_t *entry;    /* next entry to return if not stale */
+    int               inclusive;/* relocate to key itself, not past it */
+    int               klen;
+    uint8_t           key[];
+} sequence_cursor_t;
 
 struct mdb_sequence_s {
     int                     alloc;
     mdb_sequence_compare_t  scomp;
     mdb_sequence_print_t    sprint;
+    mdb_sequence_copy_t     kcopy;
+    mdb_sequence_free_t     kfree;
 #ifdef SEQUENCE_STATISTICS
     int                     max_entry;
 #endif
-    int                     size;
     int                     nentry;
-    sequence_entry_t       *entries;
+    int                     level;
+    int                     klen;
+    uint32_t                stamp;
+    uint32_t                random;
+    sequence_entry_t       *head;
+    sequence_entry_t       *tail;
 };
 
+static sequence_cursor_t empty_cursor;
+
+static int random_level(mdb_sequence_t *);
+static sequence_entry_t *find_entry(mdb_sequence_t *, int, void *, int,
+                                    sequence_entry_t **);
+static sequence_cursor_t *cursor_create(mdb_sequence_t *, int, void *);
+static int  cursor_set_key(mdb_sequence_t *, sequence_cursor_t *, void *);
+static void cursor_free(mdb_sequence_t *, sequence_cursor_t *);
 
 
 mdb_sequence_t *mdb_sequence_table_create(int                    alloc,
@@ -76,9 +116,20 @@ mdb_sequence_t *mdb_sequence_table_create(int                    alloc,
         return NULL;
     }
 
+    seq->head = calloc(1, sizeof(sequence_entry_t) +
+                       sizeof(sequence_entry_t *) * SEQUENCE_LEVEL_MAX);
+
+    if (!seq->head) {
+        free(seq);
+        errno = ENOMEM;
+        return NULL;
+    }
+
     seq->alloc  = alloc;
     seq->scomp  = scomp;
     seq->sprint = sprint;
+    seq->level  = 1;
+    seq->random = 0x9e3779b9;
 
     return seq;
 }
@@ -87,12 +138,25 @@ int mdb_sequence_table_destroy(mdb_sequence_t *seq)
 {
     MDB_CHECKARG(seq, -1);
 
-    free(seq->entries);
+    mdb_sequence_table_reset(seq);
+    free(seq->head);
     free(seq);
 
     return 0;
 }
 
+int mdb_sequence_table_set_key_copy(mdb_sequence_t      *seq,
+                                    mdb_sequence_copy_t  kcopy,
+                                    mdb_sequence_free_t  kfree)
+{
+    MDB_CHECKARG(seq && kcopy && kfree, -1);
+
+    seq->kcopy = kcopy;
+    seq->kfree = kfree;
+
+    return 0;
+}
+
 int mdb_sequence_table_get_size(mdb_sequence_t *seq)
 {
     MDB_CHECKARG(seq, -1);
@@ -102,13 +166,21 @@ int mdb_sequence_table_get_size(mdb_sequence_t *seq)
 
 int mdb_sequence_table_reset(mdb_sequence_t *seq)
 {
+    sequence_entry_t *entry, *next;
+
     MDB_CHECKARG(seq, -1);
 
-    free(seq->entries);
+    for (entry = seq->head->next[0];  entry;  entry = next) {
+        next = entry->next[0];
+        free(entry);
+    }
+
+    memset(seq->head->next, 0, sizeof(sequence_entry_t *)*SEQUENCE_LEVEL_MAX);
 
-    seq->size    = 0;
-    seq->nentry  = 0;
-    seq->entries = NULL;
+    seq->nentry = 0;
+    seq->level  = 1;
+    seq->tail   = NULL;
+    seq->stamp++;
 
     return 0;
 }
@@ -125,9 +197,10 @@ int mdb_sequence_table_print(mdb_sequence_t *seq, char *buf, int len)
     e = (p = buf) + len;
     *buf = '\0';
 
-    for (i = 0;  i < seq->nentry && p < e;  i++) {
-        entry = seq->entries + i;
-
+    for (i = 0, entry = seq->head->next[0];
+         entry && p < e;
+         i++, entry = entry->next[0])
+    {
         seq->sprint(entry->key, key, sizeof(key));
 
         p += snprintf(p, e-p, "   %05d: '%s' / %p\n", i, key, entry->data);
@@ -138,57 +211,51 @@ int mdb_sequence_table_print(mdb_sequence_t *seq, char *buf, int len)
 
 int mdb_sequence_add(mdb_sequence_t *seq, int klen, void *key, void *data)
 {
-    sequence_entry_t *entry;
-    int               nentry;
-    size_t            old_size;
-    size_t            length;
-    int               cmp;
-    int               min, max, i;
+    sequence_entry_t *entry, *prev;
+    sequence_entry_t *update[SEQUENCE_LEVEL_MAX];
+    int               level;
+    int               l;
 
     MDB_CHECKARG(seq && key && data, -1);
 
-    nentry = seq->nentry++;
-
-    if ((nentry + 1) > seq->size) {
-        old_size = seq->size;
-        seq->size += seq->alloc;
-        length = sizeof(sequence_entry_t) * seq->size;
-
-        if (!(seq->entries = realloc(seq->entries, length))) {
-            seq->nentry = 0;
-            errno = ENOMEM;
-            return 0;
-        }
+    /* equal keys go after the existing ones */
+    find_entry(seq, klen, key, 1, update);
 
+    level = random_level(seq);
 
-        memset(seq->entries + old_size, 0, 
-               length - (old_size * sizeof(sequence_entry_t)));
+    if (!(entry = malloc(sizeof(*entry) + sizeof(entry->next[0]) * level))) {
+        errno = ENOMEM;
+        return -1;
     }
 
-    for (min = 0,  i = (max = nentry)/2;   ;    i = (min+max)/2) {
-        if (!(cmp = seq->scomp(klen, key, seq->entries[i].key)))
-            break;
+    if (level > seq->level) {
+        for (l = seq->level;  l < level;  l++)
+            update[l] = seq->head;
+        seq->level = level;
+    }
 
-        if (i == min) {
-            if (cmp > 0)
-                i = max;
-            break;
-        }
+    entry->key   = key;
+    entry->data  = data;
+    entry->level = level;
 
-        if (cmp < 0)
-            max = i;
-        else
-            min = i;
+    for (l = 0;  l < level;  l++) {
+        entry->next[l] = update[l]->next[l];
+        update[l]->next[l] = entry;
     }
 
-    entry = seq->entries + i;
+    prev = update[0];
+    entry->prev = (prev == seq->head) ? NULL : prev;
 
-    if (i < nentry) {
-        memmove(entry+1, entry, sizeof(sequence_entry_t) * (nentry - i));
-    }
+    if (entry->next[0])
+        entry->next[0]->prev = entry;
+    else
+        seq->tail = entry;
+
+    if (klen > seq->klen)
+        seq->klen = klen;
 
-    entry->key  = key;
-    entry->data = data;
+    seq->nentry++;
+    seq->stamp++;
 
 #ifdef SEQUENCE_STATISTICS
     if (seq->nentry > seq->max_entry)
@@ -201,124 +268,205 @@ int mdb_sequence_add(mdb_sequence_t *seq, int klen, void *key, void *data)
 void *mdb_sequence_delete(mdb_sequence_t *seq, int klen, void *key)
 {
     sequence_entry_t *entry;
-    int               i;
-    int               min, max;
-    int               cmp;
-    int               found;
+    sequence_entry_t *update[SEQUENCE_LEVEL_MAX];
     void             *data;
-    size_t            length;
+    int               l;
 
     MDB_CHECKARG(seq && key, NULL);
 
-    for (found = 0, min = 0, i = (max = seq->nentry)/2;  ;  i = (min+max)/2) {
-        entry = seq->entries + i;
+    entry = find_entry(seq, klen, key, 0, update);
 
-        if (!(cmp = seq->scomp(klen, key, entry->key))) {
-            found = 1;
-            break;
-        }
+    if (!entry || seq->scomp(klen, key, entry->key)) {
+        errno = ENOENT;
+        return NULL;
+    }
 
-        if (i == min) {
-            if (i != max) {
-                entry = seq->entries + max;
-                if (!seq->scomp(klen, key, entry->key))
-                    found = 1;
-            }
-            break;
-        }
+    for (l = 0;  l < entry->level;  l++)
+        update[l]->next[l] = entry->next[l];
+
+    if (entry->next[0])
+        entry->next[0]->prev = entry->prev;
+    else
+        seq->tail = entry->prev;
+
+    while (seq->level > 1 && !seq->head->next[seq->level - 1])
+        seq->level--;
 
-        if (cmp < 0)
-            max = i;
-        else
-            min = i;
+    data = entry->data;
+    free(entry);
+
+    seq->nentry--;
+    seq->stamp++;
+
+    return data;
+}
+
+void *mdb_sequence_iterate(mdb_sequence_t *seq, void **cursor_ptr)
+{
+    sequence_cursor_t *cursor;
+    sequence_entry_t  *entry;
+
+    MDB_CHECKARG(seq && cursor_ptr, NULL);
+
+    if (!(cursor = *cursor_ptr)) {
+        if (!(cursor = cursor_create(seq, 0, NULL)))
+            return NULL;
+
+        *cursor_ptr = cursor;
     }
 
-    if (!found) {
-        errno = ENOENT;
+    if (cursor == &empty_cursor)
         return NULL;
+
+    if (cursor->stamp != seq->stamp) {
+        cursor->entry = find_entry(seq, cursor->klen, cursor->key,
+                                   !cursor->inclusive, NULL);
+        cursor->stamp = seq->stamp;
     }
 
-    data = entry->data;
+    if (!(entry = cursor->entry) ||
+        (cursor->klen > 0 && cursor_set_key(seq, cursor, entry->key) < 0))
+    {
+        *cursor_ptr = &empty_cursor;
+        cursor_free(seq, cursor);
+        return NULL;
+    }
 
-    if (--seq->nentry <= 0) {
-        free(seq->entries);
+    cursor->inclusive = 0;
+    cursor->entry = entry->next[0];
 
-        seq->size    = 0;
-        seq->nentry  = 0;
-        seq->entries = NULL;
-    }
-    else {
-        if (i < seq->nentry) {
-            length = sizeof(sequence_entry_t) * (seq->nentry - i);
-            memmove(entry, entry+1, length);
-        }
+    return entry->data;
+}
 
-        if (seq->nentry <= (seq->size - seq->alloc)) {
-            length = sizeof(sequence_entry_t) * (seq->size -= seq->alloc);
+int mdb_sequence_seek(mdb_sequence_t *seq, int klen, void *key,
+                      void **cursor_ptr)
+{
+    sequence_cursor_t *cursor;
 
-            if (!(seq->entries = realloc(seq->entries, length))) {
-                seq->nentry = 0;
-                errno = ENOMEM;
-            }
-        }
+    MDB_CHECKARG(seq && klen > 0 && key && cursor_ptr, -1);
+
+    if (*cursor_ptr)
+        mdb_sequence_cursor_destroy(seq, cursor_ptr);
+
+    if (!(cursor = cursor_create(seq, klen, key))) {
+        *cursor_ptr = NULL;
+        return -1;
     }
 
-    return data;
+    *cursor_ptr = cursor;
+
+    return 0;
 }
 
+void mdb_sequence_cursor_destroy(mdb_sequence_t *seq, void **cursor)
+{
+    if (cursor && *cursor && *cursor != &empty_cursor)
+        cursor_free(seq, *cursor);
+}
 
 
-void *mdb_sequence_iterate(mdb_sequence_t *seq, void **cursor_ptr)
+static int random_level(mdb_sequence_t *seq)
 {
-    typedef struct {
-        int   index;
-        int   nentry;
-        void *entries[];
-    } cursor_t;
+    uint32_t x = seq->random;
+    int      level;
 
-    static cursor_t   empty_cursor;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
 
-    size_t            length;
-    cursor_t         *cursor;
-    int               i;
+    seq->random = x;
 
-    MDB_CHECKARG(seq && cursor_ptr, NULL);
+    for (level = 1;  (x & 3) == 0 && level < SEQUENCE_LEVEL_MAX;  x >>= 2)
+        level++;
 
-    if (!(cursor = *cursor_ptr)) {
-        length = sizeof(cursor_t) + sizeof(void *) * seq->nentry;
+    return level;
+}
 
-        if (!(cursor = malloc(length)))
-            return NULL;
+static sequence_entry_t *find_entry(mdb_sequence_t    *seq,
+                                    int                klen,
+                                    void              *key,
+                                    int                past,
+                                    sequence_entry_t **update)
+{
+    sequence_entry_t *entry, *next;
+    int               l, cmp;
 
-        cursor->index = 0;
-        cursor->nentry = seq->nentry;
+    /*
+     * find the first entry with a key greater than or equal to (past == 0)
+     * or strictly greater than (past != 0) the given key
+     */
 
-        for (i = 0;  i < seq->nentry;  i++)
-            cursor->entries[i] = seq->entries[i].data;
+    entry = seq->head;
 
-        *cursor_ptr = cursor;
+    for (l = seq->level - 1;  l >= 0;  l--) {
+        while ((next = entry->next[l])) {
+            cmp = seq->scomp(klen, key, next->key);
+
+            if (cmp < 0 || (cmp == 0 && !past))
+                break;
+
+            entry = next;
+        }
+
+        if (update)
+            update[l] = entry;
+    }
+
+    return entry->next[0];
+}
+
+static sequence_cursor_t *cursor_create(mdb_sequence_t *seq,
+                                        int             klen,
+                                        void           *key)
+{
+    sequence_cursor_t *cursor;
+    int                size;
+
+    size = (klen > seq->klen) ? klen : seq->klen;
+
+    if (!(cursor = calloc(1, sizeof(*cursor) + size))) {
+        errno = ENOMEM;
+        return NULL;
     }
 
-    if (cursor->index >= cursor->nentry) {
-        if (*cursor_ptr != &empty_cursor) {
-            *cursor_ptr = &empty_cursor;
+    cursor->stamp = seq->stamp;
+    cursor->klen  = key ? klen : size;
+
+    if (!key)
+        cursor->entry = seq->head->next[0];
+    else {
+        if (cursor_set_key(seq, cursor, key) < 0) {
             free(cursor);
+            return NULL;
         }
-        return NULL;
+        cursor->entry = find_entry(seq, klen, key, 0, NULL);
+        cursor->inclusive = 1;
     }
 
-    return (void *)cursor->entries[cursor->index++];
+    return cursor;
 }
 
-
-void mdb_sequence_cursor_destroy(mdb_sequence_t *seq, void **cursor)
+static int cursor_set_key(mdb_sequence_t    *seq,
+                          sequence_cursor_t *cursor,
+                          void              *key)
 {
-    (void)seq;
+    if (!seq->kcopy) {
+        memcpy(cursor->key, key, cursor->klen);
+        return 0;
+    }
+
+    seq->kfree(cursor->key);
 
-    if (cursor)
-        free(*cursor);
+    return seq->kcopy(cursor->key, key);
 }
 
+static void cursor_free(mdb_sequence_t *seq, sequence_cursor_t *cursor)
+{
+    if (seq && seq->kfree)
+        seq->kfree(cursor->key);
+
+    free(cursor);
+}
 
 
 
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <errno.h>
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <pthread.h>
+
+#include <murphy-db/assert.h>
+#include <murphy-db/hash.h>
+#include "strheap.h"
+
+#define STRHEAP_HASH_SIZE  64
+
+#define STRING_ENTRY(s) \
+    ((string_t *)((char *)(s) - offsetof(string_t, str)))
+
+typedef struct {
+    uint32_t  refcnt;
+    char      str[0];
+} string_t;
+
+/*
+ * the heap is shared by the writers of the table and by snapshot
+ * readers releasing the saved images, so it has a lock of its own
+ */
+struct mdb_strheap_s {
+    mdb_hash_t      *hash;      /* string => string_t */
+    int              nstring;
+    pthread_mutex_t  lock;
+};
+
+/* what looking up an unknown string gives: no row holds this pointer */
+static const char missing[1];
+
+
+mdb_strheap_t *mdb_strheap_create(void)
+{
+    mdb_strheap_t *heap;
+
+    if (!(heap = calloc(1, sizeof(mdb_strheap_t)))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (!(heap->hash = MDB_HASH_TABLE_CREATE(varchar, STRHEAP_HASH_SIZE))) {
+        free(heap);
+        return NULL;
+    }
+
+    pthread_mutex_init(&heap->lock, NULL);
+
+    return heap;
+}
+
+void mdb_strheap_destroy(mdb_strheap_t *heap)
+{
+    string_t *s;
+    void     *cursor;
+
+    if (!heap)
+        return;
+
+    MDB_HASH_TABLE_FOR_EACH(heap->hash, s, cursor)
+        free(s);
+
+    mdb_hash_table_destroy(heap->hash);
+    pthread_mutex_destroy(&heap->lock);
+
+    free(heap);
+}
+
+const char *mdb_strheap_intern(mdb_strheap_t *heap, const char *str)
+{
+    string_t *s;
+    size_t    len;
+
+    MDB_CHECKARG(heap, NULL);
+
+    if (!str || !str[0])
+        return NULL;
+
+    pthread_mutex_lock(&heap->lock);
+
+    if ((s = mdb_hash_get_data(heap->hash, 0, (void *)str)))
+        s->refcnt++;
+    else {
+        len = strlen(str) + 1;
+
+        if ((s = malloc(sizeof(string_t) + len))) {
+            s->refcnt = 1;
+            memcpy(s->str, str, len);
+
+            if (mdb_hash_add(heap->hash, 0, s->str, s) < 0) {
+                free(s);
+                s = NULL;
+            }
+            else
+                heap->nstring++;
+        }
+        else
+            errno = ENOMEM;
+    }
+
+    pthread_mutex_unlock(&heap->lock);
+
+    return s ? s->str : NULL;
+}
+
+const char *mdb_strheap_lookup(mdb_strheap_t *heap, const char *str)
+{
+    string_t *s;
+
+    MDB_CHECKARG(heap, NULL);
+
+    if (!str || !str[0])
+        return NULL;
+
+    pthread_mutex_lock(&heap->lock);
+    s = mdb_hash_get_data(heap->hash, 0, (void *)str);
+    pthread_mutex_unlock(&heap->lock);
+
+    return s ? s->str : missing;
+}
+
+void mdb_strheap_retain(mdb_strheap_t *heap, const char *str)
+{
+    if (!heap || !str)
+        return;
+
+    pthread_mutex_lock(&heap->lock);
+    STRING_ENTRY(str)->refcnt++;
+    pthread_mutex_unlock(&heap->lock);
+}
+
+void mdb_strheap_release(mdb_strheap_t *heap, const char *str)
+{
+    string_t *s;
+
+    if (!heap || !str)
+        return;
+
+    s = STRING_ENTRY(str);
+
+    pthread_mutex_lock(&heap->lock);
+
+    if (--s->refcnt == 0) {
+        mdb_hash_delete(heap->hash, 0, s->str);
+        heap->nstring--;
+        free(s);
+    }
+
+    pthread_mutex_unlock(&heap->lock);
+}
+
+int mdb_strheap_get_size(mdb_strheap_t *heap)
+{
+    MDB_CHECKARG(heap, -1);
+
+    return heap->nstring;
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __MDB_STRHEAP_H__
+#define __MDB_STRHEAP_H__
+
+/*
+ * A per-table heap of interned strings for varchar columns stored out
+ * of line. Equal strings share a single reference counted copy, so rows
+ * hold a pointer to it and two values are equal if the pointers are.
+ * The empty string is never stored, it is represented by NULL.
+ */
+typedef struct mdb_strheap_s mdb_strheap_t;
+
+mdb_strheap_t *mdb_strheap_create(void);
+void mdb_strheap_destroy(mdb_strheap_t *);
+const char *mdb_strheap_intern(mdb_strheap_t *, const char *);
+const char *mdb_strheap_lookup(mdb_strheap_t *, const char *);
+void mdb_strheap_retain(mdb_strheap_t *, const char *);
+void mdb_strheap_release(mdb_strheap_t *, const char *);
+int  mdb_strheap_get_size(mdb_strheap_t *);
+
+#endif /* __MDB_STRHEAP_H__ */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
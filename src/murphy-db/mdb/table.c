@@ -42,7 +42,9 @@
 #include "row.h"
 #include "table.h"
 #include "cond.h"
+#include "plan.h"
 #include "transaction.h"
+#include "version.h"
 
 #define TABLE_STATISTICS
 
@@ -58,13 +60,24 @@ static int         table_count;
 
 static void destroy_table(mdb_table_t *);
 static mdb_row_t *table_iterator(mdb_table_t *, table_iterator_t *);
+static mdb_row_t *plan_iterator(mdb_table_t *, mdb_plan_t *,
+                                table_iterator_t *);
 #if 0
 static int table_print_info(mdb_table_t *, char *, int);
 #endif
+static int insert_rows(mdb_table_t *, int, mqi_column_desc_t *, void **,
+                       void *, int, int);
+static int insert_single_row(mdb_table_t *, int, mqi_column_desc_t *, void *,
+                             uint32_t, int);
 static int select_conditional(mdb_table_t *, mqi_cond_entry_t *,
                               mqi_column_desc_t *,void *, int, int);
 static int select_all(mdb_table_t *, mqi_column_desc_t  *, void *, int, int);
 static int select_by_index(mdb_table_t*, int,void *, mqi_column_desc_t*,void*);
+static int select_snapshot(mdb_table_t *, mdb_snapshot_t *,
+                           mqi_cond_entry_t *, mqi_column_desc_t *, void *,
+                           int, int);
+static int read_snapshot_image(mdb_table_t *, mdb_snapshot_t *,
+                               mqi_column_desc_t *, void *, void *);
 static int update_conditional(mdb_table_t *, mqi_cond_entry_t *,
                               mqi_column_desc_t *, void *, int);
 static int update_all(mdb_table_t *, mqi_column_desc_t *, void *, int);
@@ -88,6 +101,9 @@ mdb_table_t *mdb_table_create(char *name,
     mdb_column_t     *columns;
     mdb_column_t     *col;
     mqi_column_def_t *cdef;
+    mdb_strheap_t    *strings = NULL;
+    uint32_t         *stamps;
+    int               nstring = 0;
     int               dlgh;
     int               i;
 
@@ -103,16 +119,18 @@ mdb_table_t *mdb_table_create(char *name,
         type   = cdef->type;
         length = cdef->length;
 
-        if (!cdef->name[0]) {
+        if (!cdef->name[0] || ncolumn >= MQI_COLUMN_MAX) {
             ncolumn = 0;
             break;
         }
 
         if (type == mqi_varchar) {
-            if (length < 1 || length > MDB_COLUMN_LENGTH_MAX) {
+            if (length < 0 || length > MDB_COLUMN_LENGTH_MAX) {
                 ncolumn = 0;
                 break;
             }
+            if (!length)
+                nstring++;
         }
         else if (type != mqi_integer &&
                  type != mqi_unsignd &&
@@ -131,10 +149,14 @@ mdb_table_t *mdb_table_create(char *name,
 
     length = sizeof(mdb_table_t) + sizeof(mdb_dlist_t) * ncolumn;
 
-    if (!(tbl = calloc(1, length)) ||
-        !(columns = calloc(ncolumn, sizeof(mdb_column_t))))
-    {
+    tbl     = calloc(1, length);
+    columns = calloc(ncolumn, sizeof(mdb_column_t));
+    stamps  = calloc(ncolumn + MDB_TABLE_KEY_STAMPS, sizeof(uint32_t));
+
+    if (!tbl || !columns || !stamps) {
         free(tbl);
+        free(columns);
+        free(stamps);
         errno = ENOMEM;
         return NULL;
     }
@@ -142,9 +164,21 @@ mdb_table_t *mdb_table_create(char *name,
     if (!(chash = MDB_HASH_TABLE_CREATE(varchar, 16))) {
         free(tbl);
         free(columns);
+        free(stamps);
         return NULL;
     }
 
+    if (nstring > 0 && !(strings = mdb_strheap_create())) {
+        mdb_hash_table_destroy(chash);
+        free(tbl);
+        free(columns);
+        free(stamps);
+        return NULL;
+    }
+
+    for (i = 0;  i < ncolumn + MDB_TABLE_KEY_STAMPS;  i++)
+        stamps[i] = 1;
+
     for (i = 0, dlgh = 0;  i < ncolumn;  i++) {
         cdef = cdefs  + i;
         col  = columns + i;
@@ -157,6 +191,13 @@ mdb_table_t *mdb_table_create(char *name,
         default:           length = cdef->length;      align = 2;    break;
         }
 
+        /* varchars of no declared length are kept in the string heap */
+        if (cdef->type == mqi_varchar && !cdef->length) {
+            col->heap = strings;
+            length = sizeof(char *);
+            align  = sizeof(char *);
+        }
+
         col->name   = strdup(cdef->name);
         col->type   = cdef->type;
         col->length = length;
@@ -171,13 +212,18 @@ mdb_table_t *mdb_table_create(char *name,
 
     tbl->handle    = MQI_HANDLE_INVALID;
     tbl->name      = strdup(name);
-    tbl->cnt.stamp = 1;
-    tbl->chash     = chash;
-    tbl->ncolumn   = ncolumn;
-    tbl->columns   = columns;
-    tbl->dlgh      = dlgh;
+    tbl->cnt.stamp  = 1;
+    tbl->cnt.stamps = stamps;
+    tbl->chash      = chash;
+    tbl->ncolumn    = ncolumn;
+    tbl->columns    = columns;
+    tbl->dlgh       = dlgh;
+    tbl->strings    = strings;
 
     MDB_DLIST_INIT(tbl->rows);
+    MDB_DLIST_INIT(tbl->history);
+    MDB_DLIST_INIT(tbl->secondary);
+    mdb_row_storage_init(&tbl->storage, dlgh);
     mdb_log_create(tbl);
     mdb_trigger_init(&tbl->trigger, ncolumn);
 
@@ -213,12 +259,18 @@ int mdb_table_drop(mdb_table_t *tbl)
     mdb_trigger_table_drop(tbl);
     mdb_trigger_reset(&tbl->trigger, tbl->ncolumn);
 
+    mdb_version_lock();
+
     mdb_transaction_drop_table(tbl);
+    mdb_persist_table_drop(tbl);
+    mdb_version_table_drop(tbl);
 
     mdb_hash_delete(table_hash, 0,tbl->name);
 
     destroy_table(tbl);
 
+    mdb_version_unlock();
+
     if (table_count > 1)
         table_count--;
     else {
@@ -246,7 +298,7 @@ int mdb_table_create_index(mdb_table_t *tbl, char **index_columns)
         return -1;
 
     MDB_DLIST_FOR_EACH_SAFE(mdb_row_t, link, row,n, &tbl->rows) {
-        if (mdb_index_insert(tbl, row, 0, 0) < 0) {
+        if (mdb_index_insert(tbl, row, MQI_BITFLD_NONE, 0) < 0) {
             if ((error = errno) != EEXIST)
                 return -1;
         }
@@ -260,6 +312,45 @@ int mdb_table_create_index(mdb_table_t *tbl, char **index_columns)
     return 0;
 }
 
+int mdb_table_create_secondary_index(mdb_table_t      *tbl,
+                                     const char       *name,
+                                     mqi_index_type_t  type,
+                                     char            **index_columns)
+{
+    MDB_CHECKARG(tbl && name && index_columns && index_columns[0], -1);
+
+    return mdb_index_create_secondary(tbl, name, type, index_columns);
+}
+
+int mdb_table_drop_secondary_index(mdb_table_t *tbl, const char *name)
+{
+    MDB_CHECKARG(tbl && name, -1);
+
+    return mdb_index_drop_secondary(tbl, name);
+}
+
+int mdb_table_set_columnar(mdb_table_t *tbl)
+{
+    MDB_CHECKARG(tbl, -1);
+
+    return mdb_row_storage_set_columnar(&tbl->storage, tbl->columns,
+                                        tbl->ncolumn);
+}
+
+int mdb_table_set_persistent(mdb_table_t *tbl)
+{
+    MDB_CHECKARG(tbl, -1);
+
+    return mdb_persist_table(tbl);
+}
+
+int mdb_table_checkpoint(mdb_table_t *tbl)
+{
+    MDB_CHECKARG(tbl, -1);
+
+    return mdb_persist_checkpoint_table(tbl);
+}
+
 
 int mdb_table_describe(mdb_table_t *tbl, mqi_column_def_t *defs, int len)
 {
@@ -278,7 +369,9 @@ int mdb_table_describe(mdb_table_t *tbl, mqi_column_def_t *defs, int len)
         def->length = col->length;
         def->flags  = col->flags;
 
-        if (def->type == mqi_varchar && def->length > 0)
+        if (col->heap)
+            def->length = 0;
+        else if (def->type == mqi_varchar && def->length > 0)
             def->length--;
     }
 
@@ -290,47 +383,26 @@ int mdb_table_insert(mdb_table_t        *tbl,
                      mqi_column_desc_t  *cds,
                      void              **data)
 {
-    uint32_t   txdepth = mdb_transaction_get_depth();
-    mdb_row_t    *row;
-    int           error;
-    int           nrow;
-    int           ninsert;
-    mqi_bitfld_t  cmask;
-    int           i;
+    int nrow;
 
     MDB_CHECKARG(tbl && cds && data && data[0], -1);
 
-    for (i = 0, error = 0, ninsert = 0;    data[i];    i++) {
-        if (!(row = mdb_row_create(tbl))) {
-            errno = ENOMEM;
-            return -1;
-        }
-
-        mdb_row_update(tbl, row, cds, data[i], 0, &cmask);
+    for (nrow = 0;  data[nrow];  nrow++)
+        ;
 
-        if ((nrow = mdb_index_insert(tbl, row, cmask, ignore)) < 0) {
-            if ((error = errno) != EEXIST)
-                return -1;
-
-            ninsert = -1;
-        }
-        else if (nrow > 0) {
-            tbl->nrow++;
-
-            if (mdb_log_change(tbl,txdepth,mdb_log_insert,cmask,NULL,row) < 0)
-                ninsert = -1;
-            else
-                ninsert += (ninsert >= 0) ? 1 : 0;
-        }
-
-    }
+    return insert_rows(tbl, ignore, cds, data, NULL, 0, nrow);
+}
 
-    if (error) {
-        errno = error;
-        return -1;
-    }
+int mdb_table_insert_bulk(mdb_table_t       *tbl,
+                          int                mode,
+                          mqi_column_desc_t *cds,
+                          void              *rows,
+                          int                size,
+                          int                nrow)
+{
+    MDB_CHECKARG(tbl && cds && rows && size > 0 && nrow > 0, -1);
 
-    return ninsert;
+    return insert_rows(tbl, mode, cds, NULL, rows, size, nrow);
 }
 
 int mdb_table_select(mdb_table_t       *tbl,
@@ -340,6 +412,7 @@ int mdb_table_select(mdb_table_t       *tbl,
                      int                size,
                      int                dim)
 {
+    mqi_column_desc_t *cd;
     int  ndata;
 
     MDB_CHECKARG(tbl, -1);
@@ -347,6 +420,12 @@ int mdb_table_select(mdb_table_t       *tbl,
     if (dim > MQI_QUERY_RESULT_MAX)
         dim = MQI_QUERY_RESULT_MAX;
 
+    for (cd = cds;  cd && cd->cindex >= 0;  cd++) {
+        if (cd->aggregate != mqi_aggregate_none)
+            return mdb_table_select_query(tbl, cond, cds, NULL,
+                                          results, size, dim);
+    }
+
     if (cond)
         ndata = select_conditional(tbl, cond, cds, results, size, dim);
     else
@@ -355,6 +434,28 @@ int mdb_table_select(mdb_table_t       *tbl,
     return ndata;
 }
 
+int mdb_table_select_snapshot(mdb_table_t       *tbl,
+                              mdb_snapshot_t    *snapshot,
+                              mqi_cond_entry_t  *cond,
+                              mqi_column_desc_t *cds,
+                              void              *results,
+                              int                size,
+                              int                dim)
+{
+    int ndata;
+
+    MDB_CHECKARG(tbl && snapshot && cds && results && size > 0, -1);
+
+    if (dim > MQI_QUERY_RESULT_MAX)
+        dim = MQI_QUERY_RESULT_MAX;
+
+    mdb_version_lock();
+    ndata = select_snapshot(tbl, snapshot, cond, cds, results, size, dim);
+    mdb_version_unlock();
+
+    return ndata;
+}
+
 int mdb_table_select_by_index(mdb_table_t *tbl,
                               mqi_variable_t *idxvars,
                               mqi_column_desc_t *cds,
@@ -386,12 +487,62 @@ int mdb_table_select_by_index(mdb_table_t *tbl,
             return -1;
         }
 
-        mdb_column_write(col, data, &src, var->v.generic);
+        mdb_column_write_key(col, data, &src, var->v.generic);
     }
 
     return select_by_index(tbl, idxlen,idxval, cds, result);
 }
 
+int mdb_table_select_by_secondary_index(mdb_table_t       *tbl,
+                                        const char        *name,
+                                        mqi_variable_t    *idxvars,
+                                        mqi_column_desc_t *cds,
+                                        void              *results,
+                                        int                size,
+                                        int                dim)
+{
+    mdb_secondary_index_t *six;
+    mdb_index_bucket_t    *bucket;
+    mdb_column_t          *columns;
+    mqi_column_desc_t     *result_dsc;
+    mdb_row_t             *row;
+    void                  *result;
+    uint8_t                key[MDB_INDEX_LENGTH_MAX];
+    int                    cindex;
+    int                    i, j;
+
+    MDB_CHECKARG(tbl && name && idxvars && cds && results && size > 0 &&
+                 dim > 0, -1);
+
+    if (!(six = mdb_index_find_secondary(tbl, name))) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    if (mdb_index_secondary_key(tbl, six, idxvars, key) < 0)
+        return -1;
+
+    if (!(bucket = mdb_index_get_bucket(six, key)))
+        return 0;
+
+    if (bucket->nrow > dim) {
+        errno = EOVERFLOW;
+        return -1;
+    }
+
+    columns = tbl->columns;
+
+    for (i = 0;  i < bucket->nrow;  i++) {
+        row    = bucket->rows[i];
+        result = results + (size * i);
+
+        for (j = 0;   (cindex = (result_dsc = cds + j)->cindex) >= 0;    j++)
+            mdb_column_read(result_dsc, result, columns + cindex, row->data);
+    }
+
+    return bucket->nrow;
+}
+
 int mdb_table_update(mdb_table_t       *tbl,
                      mqi_cond_entry_t  *cond,
                      mqi_column_desc_t *cds,
@@ -406,21 +557,27 @@ int mdb_table_update(mdb_table_t       *tbl,
     MDB_CHECKARG(tbl, -1);
 
 
-    if (MDB_TABLE_HAS_INDEX(tbl)) {
-        for (i = 0;   (cindex = cds[i].cindex) >= 0;    i++) {
-            col = tbl->columns + cindex;
-            if ((col->flags & MQI_COLUMN_KEY)) {
-                index_update = 1;
-                break;
-            }
+    for (i = 0;   (cindex = cds[i].cindex) >= 0;    i++) {
+        col = tbl->columns + cindex;
+
+        if ((col->flags & MQI_COLUMN_KEY) && MDB_TABLE_HAS_INDEX(tbl)) {
+            index_update = MDB_INDEX_UPDATE_ALL;
+            break;
         }
+
+        if (col->nindex > 0)
+            index_update = MDB_INDEX_UPDATE_SECONDARY;
     }
 
+    mdb_version_lock();
+
     if (cond)
         nupdate = update_conditional(tbl, cond, cds, data, index_update);
     else
         nupdate = update_all(tbl, cds, data, index_update);
 
+    mdb_version_unlock();
+
     return nupdate;
 }
 
@@ -430,14 +587,38 @@ int mdb_table_delete(mdb_table_t *tbl, mqi_cond_entry_t *cond)
 
     MDB_CHECKARG(tbl, -1);
 
+    mdb_version_lock();
+
     if (cond)
         ndelete = delete_conditional(tbl, cond);
     else
         ndelete = delete_all(tbl);
 
+    mdb_version_unlock();
+
     return ndelete;
 }
 
+int mdb_table_explain(mdb_table_t      *tbl,
+                      mqi_cond_entry_t *cond,
+                      char             *buf,
+                      int               len)
+{
+    mdb_plan_t plan;
+    int        n;
+
+    MDB_CHECKARG(tbl && buf && len > 0, -1);
+
+    if (mdb_plan_create(tbl, cond, &plan) < 0)
+        return -1;
+
+    n = mdb_plan_print(tbl, &plan, buf, len);
+
+    mdb_plan_reset(tbl, &plan);
+
+    return n;
+}
+
 mdb_table_t *mdb_table_find(char *table_name)
 {
     MDB_CHECKARG(table_name, NULL);
@@ -479,6 +660,10 @@ int mdb_table_get_column_size(mdb_table_t *tbl, int colidx)
 {
     MDB_CHECKARG(tbl && colidx >= 0 && colidx < tbl->ncolumn, -1);
 
+    /* out of line varchars have no fixed size */
+    if (tbl->columns[colidx].heap)
+        return 0;
+
     return tbl->columns[colidx].length;
 }
 
@@ -487,6 +672,44 @@ uint32_t mdb_table_get_stamp(mdb_table_t *tbl)
     return tbl->cnt.stamp;
 }
 
+uint32_t mdb_table_get_column_stamp(mdb_table_t *tbl, mqi_bitfld_t *columns)
+{
+    uint32_t stamp;
+    int      cx;
+
+    MDB_CHECKARG(tbl, MQI_STAMP_NONE);
+
+    if (!columns)
+        return tbl->cnt.stamp;
+
+    stamp = MQI_STAMP_NONE;
+
+    MQI_BITFLD_FOR_EACH(columns, cx) {
+        if (cx >= tbl->ncolumn) {
+            errno = EINVAL;
+            return MQI_STAMP_NONE;
+        }
+
+        if (MDB_COLUMN_STAMP(tbl, cx) > stamp)
+            stamp = MDB_COLUMN_STAMP(tbl, cx);
+    }
+
+    return stamp;
+}
+
+uint32_t mdb_table_get_key_stamp(mdb_table_t *tbl, mqi_variable_t *idxvars)
+{
+    int kx;
+
+    MDB_CHECKARG(tbl && idxvars, MQI_STAMP_NONE);
+    MDB_PREREQUISITE(MDB_TABLE_HAS_INDEX(tbl), MQI_STAMP_NONE);
+
+    if ((kx = mdb_index_key_slot(tbl, idxvars)) < 0)
+        return MQI_STAMP_NONE;
+
+    return MDB_KEY_STAMP(tbl, kx);
+}
+
 int mdb_table_print_rows(mdb_table_t *tbl, char *buf, int len)
 {
     mdb_row_t *row;
@@ -526,7 +749,6 @@ int mdb_table_print_rows(mdb_table_t *tbl, char *buf, int len)
 
 static void destroy_table(mdb_table_t *tbl)
 {
-    mdb_row_t    *row, *n;
     mdb_column_t *cols;
     int           i;
 
@@ -534,13 +756,15 @@ static void destroy_table(mdb_table_t *tbl)
 
     mdb_hash_table_destroy(tbl->chash);
 
-    MDB_DLIST_FOR_EACH_SAFE(mdb_row_t, link, row,n, &tbl->rows)
-        mdb_row_delete(tbl, row, 0, 1);
+    /* rows are released together with the pages holding them */
+    mdb_row_storage_destroy(&tbl->storage);
+    mdb_strheap_destroy(tbl->strings);
 
     for (i = 0, cols = tbl->columns;   i < tbl->ncolumn;    i++)
         free(cols[i].name);
 
     free(tbl->columns);
+    free(tbl->cnt.stamps);
     free(tbl->name);
     free(tbl);
 }
@@ -572,6 +796,16 @@ static mdb_row_t *table_iterator(mdb_table_t *tbl, table_iterator_t *it)
     return row;
 }
 
+static mdb_row_t *plan_iterator(mdb_table_t      *tbl,
+                                mdb_plan_t       *plan,
+                                table_iterator_t *it)
+{
+    if (plan->type == mdb_plan_scan)
+        return table_iterator(tbl, it);
+    else
+        return mdb_plan_iterate(tbl, plan);
+}
+
 #if 0
 static int table_print_info(mdb_table_t *tbl, char *buf, int len)
 {
@@ -611,6 +845,31 @@ static int table_print_info(mdb_table_t *tbl, char *buf, int len)
 #endif
 
 
+/*
+ * conditions are compiled once per statement; should that fail for
+ * some reason we fall back to interpreting them row by row
+ */
+static inline int image_matches(mdb_table_t        *tbl,
+                                mdb_cond_program_t *prog,
+                                mqi_cond_entry_t   *cond,
+                                void               *data)
+{
+    mqi_cond_entry_t *ce = cond;
+
+    if (prog)
+        return mdb_cond_execute(prog, data);
+
+    return mdb_cond_evaluate(tbl, &ce, data);
+}
+
+static inline int row_matches(mdb_table_t        *tbl,
+                              mdb_cond_program_t *prog,
+                              mqi_cond_entry_t   *cond,
+                              mdb_row_t          *row)
+{
+    return image_matches(tbl, prog, cond, row->data);
+}
+
 static int select_conditional(mdb_table_t       *tbl,
                               mqi_cond_entry_t  *cond,
                               mqi_column_desc_t *cds,
@@ -618,22 +877,30 @@ static int select_conditional(mdb_table_t       *tbl,
                               int                size,
                               int                dim)
 {
-    mdb_column_t      *columns = tbl->columns;
-    mdb_row_t         *row;
-    mqi_cond_entry_t  *ce;
-    table_iterator_t   it;
-    int                nresult;
-    void              *result;
-    mqi_column_desc_t *result_dsc;
-    int                cindex;
-    int                i;
+    mdb_column_t       *columns = tbl->columns;
+    mdb_row_t          *row;
+    mdb_cond_program_t *prog;
+    table_iterator_t    it;
+    mdb_plan_t          plan;
+    int                 nresult;
+    void               *result;
+    mqi_column_desc_t  *result_dsc;
+    int                 cindex;
+    int                 i;
+
+    if (mdb_plan_create(tbl, cond, &plan) < 0)
+        return -1;
 
-    for (it.cursor = NULL, nresult = 0;  (row = table_iterator(tbl, &it)); ) {
-        ce = cond;
-        if (mdb_cond_evaluate(tbl, &ce, row->data)) {
+    prog = mdb_cond_compile(tbl, cond);
+
+    for (it.cursor = NULL, nresult = 0;
+         (row = plan_iterator(tbl, &plan, &it));  )
+    {
+        if (row_matches(tbl, prog, cond, row)) {
             if (nresult >= dim) {
                 errno = EOVERFLOW;
-                return -1;
+                nresult = -1;
+                break;
             }
 
             result = results + (size * nresult++);
@@ -643,6 +910,9 @@ static int select_conditional(mdb_table_t       *tbl,
         }
     }
 
+    mdb_plan_reset(tbl, &plan);
+    mdb_cond_free(prog);
+
     return nresult;
 }
 
@@ -697,6 +967,206 @@ static int select_by_index(mdb_table_t       *tbl,
     return 1;
 }
 
+/*
+ * the current images of the rows committed by the stamp of the
+ * snapshot, followed by the saved images that were valid at it
+ */
+static int select_snapshot(mdb_table_t       *tbl,
+                           mdb_snapshot_t    *snapshot,
+                           mqi_cond_entry_t  *cond,
+                           mqi_column_desc_t *cds,
+                           void              *results,
+                           int                size,
+                           int                dim)
+{
+    mdb_cond_program_t *prog;
+    mdb_row_t          *row;
+    mdb_version_t      *v;
+    uint32_t            stamp;
+    int                 nresult;
+
+    stamp = mdb_snapshot_get_stamp(snapshot);
+    prog = cond ? mdb_cond_compile(tbl, cond) : NULL;
+    nresult = 0;
+
+    MDB_DLIST_FOR_EACH(mdb_row_t, link, row, &tbl->rows) {
+        if (row->stamp > stamp ||
+            (cond && !image_matches(tbl, prog, cond, row->data)))
+            continue;
+
+        if (nresult >= dim)
+            goto overflow;
+
+        if (read_snapshot_image(tbl, snapshot, cds,
+                                results + (size * nresult++), row->data) < 0)
+            goto failed;
+    }
+
+    MDB_DLIST_FOR_EACH(mdb_version_t, link, v, &tbl->history) {
+        if (!mdb_version_visible(v, stamp) ||
+            (cond && !image_matches(tbl, prog, cond, v->data)))
+            continue;
+
+        if (nresult >= dim)
+            goto overflow;
+
+        if (read_snapshot_image(tbl, snapshot, cds,
+                                results + (size * nresult++), v->data) < 0)
+            goto failed;
+    }
+
+    mdb_cond_free(prog);
+
+    return nresult;
+
+ overflow:
+    errno = EOVERFLOW;
+ failed:
+    mdb_cond_free(prog);
+    return -1;
+}
+
+/*
+ * strings are handed out as copies owned by the snapshot, the image
+ * they are read from may be changed or freed once the lock is dropped
+ */
+static int read_snapshot_image(mdb_table_t       *tbl,
+                               mdb_snapshot_t    *snapshot,
+                               mqi_column_desc_t *cds,
+                               void              *result,
+                               void              *data)
+{
+    mdb_column_t      *columns = tbl->columns;
+    mqi_column_desc_t *result_dsc;
+    char             **str;
+    int                cindex;
+    int                i;
+
+    for (i = 0;  (cindex = (result_dsc = cds + i)->cindex) >= 0;   i++) {
+        mdb_column_read(result_dsc, result, columns + cindex, data);
+
+        if (columns[cindex].type != mqi_varchar)
+            continue;
+
+        str = (char **)(result + result_dsc->offset);
+
+        if (*str && !(*str = mdb_snapshot_copy_string(snapshot, *str)))
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int insert_rows(mdb_table_t        *tbl,
+                       int                 mode,
+                       mqi_column_desc_t  *cds,
+                       void              **data,
+                       void               *rows,
+                       int                 size,
+                       int                 nrow)
+{
+    uint32_t      txdepth = mdb_transaction_get_depth();
+    int           index_update;
+    int           cindex;
+    int           error;
+    int           ninsert;
+    int           n, i;
+
+    MDB_CHECKARG(mode >= mqi_insert_strict && mode <= mqi_insert_upsert, -1);
+
+    /*
+     * the column descriptors are the same for every row, so they are
+     * checked only once per call
+     */
+    for (i = 0, index_update = 0;  (cindex = cds[i].cindex) >= 0;  i++) {
+        if (cindex >= tbl->ncolumn) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        if (tbl->columns[cindex].nindex > 0)
+            index_update = MDB_INDEX_UPDATE_SECONDARY;
+    }
+
+    mdb_version_lock();
+
+    for (i = 0, error = 0, ninsert = 0;   i < nrow;   i++) {
+        n = insert_single_row(tbl, mode, cds,
+                              data ? data[i] : rows + (i * size),
+                              txdepth, index_update);
+
+        if (n < 0) {
+            if ((error = errno) != EEXIST)
+                break;
+
+            ninsert = -1;
+        }
+        else
+            ninsert += (ninsert >= 0) ? n : 0;
+    }
+
+    mdb_version_unlock();
+
+    if (error) {
+        errno = error;
+        return -1;
+    }
+
+    return ninsert;
+}
+
+static int insert_single_row(mdb_table_t       *tbl,
+                             int                mode,
+                             mqi_column_desc_t *cds,
+                             void              *data,
+                             uint32_t           txdepth,
+                             int                index_update)
+{
+    mdb_index_t  *ix = &tbl->index;
+    mdb_row_t    *row;
+    mdb_row_t    *old;
+    mqi_bitfld_t  cmask;
+    int           nrow;
+    int           i;
+
+    if (!(row = mdb_row_create(tbl))) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    mdb_row_update(tbl, row, cds, data, 0, NULL);
+
+    /* a new row sets every column it has a value for, blank or not */
+    mqi_bitfld_clear(&cmask);
+
+    for (i = 0;  cds[i].cindex >= 0;  i++)
+        mqi_bitfld_set(&cmask, cds[i].cindex);
+
+    /*
+     * an upsert of an existing key updates the given columns of the
+     * existing row and leaves the rest of it intact
+     */
+    if (mode == mqi_insert_upsert && MDB_INDEX_DEFINED(ix) &&
+        (old = mdb_hash_get_data(ix->hash, ix->length,
+                                 (void *)row->data + ix->offset)))
+    {
+        mdb_row_delete(tbl, row, 0, 1);
+        return update_single_row(tbl, old, cds, data, index_update);
+    }
+
+    nrow = mdb_index_insert(tbl, row, cmask, mode != mqi_insert_strict);
+
+    if (nrow <= 0)
+        return nrow;
+
+    tbl->nrow++;
+
+    if (mdb_log_change(tbl, txdepth, mdb_log_insert, cmask, NULL, row) < 0)
+        return -1;
+
+    return 1;
+}
 
 static int update_conditional(mdb_table_t       *tbl,
                               mqi_cond_entry_t  *cond,
@@ -704,14 +1174,21 @@ static int update_conditional(mdb_table_t       *tbl,
                               void              *data,
                               int                index_update)
 {
-    mdb_row_t        *row;
-    mqi_cond_entry_t *ce;
-    table_iterator_t  it;
-    int               nupdate, changed;
+    mdb_row_t          *row;
+    mdb_cond_program_t *prog;
+    table_iterator_t    it;
+    mdb_plan_t          plan;
+    int                 nupdate, changed;
+
+    if (mdb_plan_create(tbl, cond, &plan) < 0)
+        return -1;
+
+    prog = mdb_cond_compile(tbl, cond);
 
-    for (it.cursor = NULL, nupdate = 0;  (row = table_iterator(tbl, &it)); ) {
-        ce = cond;
-        if (mdb_cond_evaluate(tbl, &ce, row->data)) {
+    for (it.cursor = NULL, nupdate = 0;
+         (row = plan_iterator(tbl, &plan, &it));  )
+    {
+        if (row_matches(tbl, prog, cond, row)) {
             changed = update_single_row(tbl, row, cds, data, index_update);
 
             if (changed < 0)
@@ -721,6 +1198,9 @@ static int update_conditional(mdb_table_t       *tbl,
         }
     }
 
+    mdb_plan_reset(tbl, &plan);
+    mdb_cond_free(prog);
+
     return nupdate;
 }
 
@@ -760,7 +1240,12 @@ static int update_single_row(mdb_table_t       *tbl,
     mqi_bitfld_t cmask;
     int          changed;
 
-    if (txdepth > 0 && !(before = mdb_row_duplicate(tbl, row)))
+    /*
+     * outside of transactions the original row is needed only by
+     * persistent tables and open snapshots
+     */
+    if ((txdepth > 0 || tbl->persist || mdb_version_snapshots()) &&
+        !(before = mdb_row_duplicate(tbl, row)))
         return -1;
 
     changed = mdb_row_update(tbl, row, cds, data, index_update, &cmask);
@@ -773,20 +1258,29 @@ static int update_single_row(mdb_table_t       *tbl,
     if (mdb_log_change(tbl, txdepth, mdb_log_update, cmask, before, row) < 0)
         return -1;
 
+    if (!txdepth && before)
+        mdb_row_delete(tbl, before, 0, 1);
+
     return 1;
 }
 
 static int delete_conditional(mdb_table_t *tbl, mqi_cond_entry_t *cond)
 {
-    table_iterator_t  it;
-    mdb_row_t        *row;
-    mqi_cond_entry_t *ce;
-    int               ndelete;
+    table_iterator_t    it;
+    mdb_plan_t          plan;
+    mdb_row_t          *row;
+    mdb_cond_program_t *prog;
+    int                 ndelete;
+
+    if (mdb_plan_create(tbl, cond, &plan) < 0)
+        return -1;
 
-    for (it.cursor = NULL, ndelete = 0; (row = table_iterator(tbl, &it)); )
+    prog = mdb_cond_compile(tbl, cond);
+
+    for (it.cursor = NULL, ndelete = 0;
+         (row = plan_iterator(tbl, &plan, &it));  )
     {
-        ce = cond;
-        if (mdb_cond_evaluate(tbl, &ce, row->data)) {
+        if (row_matches(tbl, prog, cond, row)) {
             if (delete_single_row(tbl, row, 1) < 0)
                 ndelete = -1;
             else
@@ -794,6 +1288,9 @@ static int delete_conditional(mdb_table_t *tbl, mqi_cond_entry_t *cond)
         }
     }
 
+    mdb_plan_reset(tbl, &plan);
+    mdb_cond_free(prog);
+
     return ndelete;
 }
 
@@ -819,8 +1316,12 @@ static int delete_single_row(mdb_table_t *tbl, mdb_row_t *row,int index_update)
 {
     uint32_t txdepth = mdb_transaction_get_depth();
 
-    mdb_row_delete(tbl, row, index_update, !txdepth);
-    mdb_log_change(tbl, txdepth, mdb_log_delete, 0, row, NULL);
+    /* the row is gone by the time a persistent table may checkpoint */
+    mdb_row_delete(tbl, row, index_update, 0);
+    mdb_log_change(tbl, txdepth, mdb_log_delete, MQI_BITFLD_NONE, row, NULL);
+
+    if (!txdepth)
+        mdb_row_delete(tbl, row, 0, 1);
 
     return 0;
 }
@@ -37,22 +37,37 @@
 #include "column.h"
 #include "log.h"
 #include "trigger.h"
+#include "persist.h"
 
 #define MDB_TABLE_HAS_INDEX(t)  MDB_INDEX_DEFINED(&t->index)
 
+/*
+ * Besides the table stamp every column, and every slot the primary
+ * keys hash to, has the stamp of the transaction that changed it last.
+ */
+#define MDB_TABLE_KEY_STAMPS    64
+#define MDB_TABLE_NSTAMP(t)     ((t)->ncolumn + MDB_TABLE_KEY_STAMPS)
+#define MDB_COLUMN_STAMP(t, cx) ((t)->cnt.stamps[(cx)])
+#define MDB_KEY_STAMP(t, kx)    ((t)->cnt.stamps[(t)->ncolumn + (kx)])
+
 struct mdb_table_s {
-    mqi_handle_t  handle;
-    char         *name;
-    mdb_index_t   index;
-    mdb_hash_t   *chash;         /* hash table for column names */
-    int           ncolumn;
-    mdb_column_t *columns;
-    int           dlgh;          /* length of row data */
-    int           nrow;
-    mdb_dlist_t   rows;
-    mdb_dlist_t   logs;         /* transaction logs */
-    mdb_opcnt_t   cnt;
-    mdb_trigger_t trigger;      /* must be the last: it has a array[0] @end  */
+    mqi_handle_t       handle;
+    char              *name;
+    mdb_index_t        index;
+    mdb_dlist_t        secondary;   /* secondary indexes */
+    mdb_hash_t        *chash;       /* hash table for column names */
+    int                ncolumn;
+    mdb_column_t      *columns;
+    int                dlgh;        /* length of row data */
+    int                nrow;
+    mdb_dlist_t        rows;
+    mdb_row_storage_t  storage;     /* pages the rows are allocated from */
+    mdb_dlist_t        logs;        /* transaction logs */
+    mdb_dlist_t        history;     /* row images kept for snapshots */
+    mdb_strheap_t     *strings;     /* for out of line varchars, or NULL */
+    mdb_persist_t     *persist;     /* for persistent tables, or NULL */
+    mdb_opcnt_t        cnt;
+    mdb_trigger_t      trigger;     /* must be the last: has array[0] @end */
 };
 
 
@@ -40,6 +40,8 @@
 #include "log.h"
 #include "index.h"
 #include "table.h"
+#include "persist.h"
+#include "version.h"
 
 #define TRANSACTION_STATISTICS
 
@@ -51,6 +53,7 @@ static int remove_row(mdb_table_t *, mdb_row_t *);
 static int add_row(mdb_table_t *, mdb_row_t *);
 static int copy_row(mdb_table_t *, mdb_row_t *, mdb_row_t *);
 static int check_stamp(mdb_log_entry_t *);
+static mdb_row_t *blank_row(mdb_table_t *);
 
 
 uint32_t mdb_transaction_begin(void)
@@ -60,7 +63,6 @@ uint32_t mdb_transaction_begin(void)
 
 int mdb_transaction_commit(uint32_t depth)
 {
-#define DATA_MAX  (MQI_COLUMN_MAX * MQI_QUERY_RESULT_MAX)
 #define CHECK_TRIGGER_START(en) do {                    \
         if (!start_triggered) {                         \
             start_triggered = true;                     \
@@ -73,9 +75,6 @@ int mdb_transaction_commit(uint32_t depth)
         }                                               \
     } while (0)
 
-
-    static uint8_t    blank[sizeof(mdb_row_t) + DATA_MAX];
-
     mdb_log_entry_t  *en;
     mdb_row_t        *before;
     mdb_row_t        *after;
@@ -85,38 +84,46 @@ int mdb_transaction_commit(uint32_t depth)
 
     MDB_CHECKARG(depth > 0 && depth == txdepth, -1);
 
-    MDB_TRANSACTION_LOG_FOR_EACH_DELETE(depth, en, MDB_BACKWARD, cursor) {
+    mdb_version_lock();
 
-        if (!(before = en->before))
-            before = (mdb_row_t *)blank;
+    MDB_TRANSACTION_LOG_FOR_EACH_DELETE(depth, en, MDB_BACKWARD, cursor) {
 
-        if (!(after = en->after))
-            after = (mdb_row_t *)blank;
+        before = en->before;
+        after  = en->after;
 
         switch (en->change) {
 
         case mdb_log_insert:
+            if (!before && !(before = blank_row(en->table))) {
+                s = -1;
+                break;
+            }
             CHECK_TRIGGER_START(en);
             mdb_trigger_row_insert(en->table, after);
             mdb_trigger_column_change(en->table, en->colmask, before, after);
+            mdb_trigger_collect(en->table, mqi_change_insert,
+                                           en->colmask, NULL, en->after);
             s = 0;
             break;
 
         case mdb_log_update:
             CHECK_TRIGGER_START(en);
             mdb_trigger_column_change(en->table, en->colmask, before, after);
+            mdb_trigger_collect(en->table, mqi_change_update,
+                                           en->colmask, en->before, en->after);
             s = destroy_row(en->table, en->before);
             break;
 
         case mdb_log_delete:
             CHECK_TRIGGER_START(en);
             mdb_trigger_row_delete(en->table, before);
+            mdb_trigger_collect(en->table, mqi_change_delete,
+                                           en->colmask, en->before, NULL);
             s = destroy_row(en->table, en->before);
             break;
 
         case mdb_log_start:
             check_stamp(en);
-            free(en->cnt);
             s = 0;
             break;
 
@@ -129,13 +136,23 @@ int mdb_transaction_commit(uint32_t depth)
             sts = s;
     }
 
+    mdb_trigger_changefeed_deliver();
+
     CHECK_TRIGGER_END();
 
     txdepth--;
 
-    return sts;
+    mdb_persist_transaction_end(depth, true);
+
+    if (!txdepth)
+        mdb_version_transaction_end();
+
+    mdb_version_unlock();
 
-#undef DATA_MAX
+    if (!txdepth)
+        mdb_trigger_batch_deliver();
+
+    return sts;
 }
 
 int mdb_transaction_rollback(uint32_t depth)
@@ -147,6 +164,8 @@ int mdb_transaction_rollback(uint32_t depth)
 
     MDB_CHECKARG(depth > 0 && depth == txdepth, -1);
 
+    mdb_version_lock();
+
     MDB_TRANSACTION_LOG_FOR_EACH_DELETE(depth, en, MDB_FORWARD, cursor) {
 
         tbl = en->table;
@@ -166,6 +185,16 @@ int mdb_transaction_rollback(uint32_t depth)
 
     txdepth--;
 
+    mdb_persist_transaction_end(depth, false);
+
+    if (!txdepth)
+        mdb_version_transaction_end();
+
+    mdb_version_unlock();
+
+    if (!txdepth)
+        mdb_trigger_batch_deliver();
+
     return sts;
 }
 
@@ -184,7 +213,7 @@ int mdb_transaction_drop_table(mdb_table_t *tbl)
         case mdb_log_insert:  s = 0;                                     break;
         case mdb_log_delete:
         case mdb_log_update:  s = destroy_row(en->table, en->before);    break;
-        case mdb_log_start:   s = 0;                                     break;
+        case mdb_log_start:   free(en->cnt); s = 0;                      break;
         default:              s = -1;                                    break;
         }
 
@@ -230,7 +259,7 @@ static int add_row(mdb_table_t *tbl, mdb_row_t *row)
 
     tbl->cnt.deletes--;
 
-    return mdb_index_insert(tbl, row, 0, 0);
+    return mdb_index_insert(tbl, row, MQI_BITFLD_NONE, 0);
 }
 
 static int copy_row(mdb_table_t *tbl, mdb_row_t *dst, mdb_row_t *src)
@@ -262,11 +291,44 @@ static int check_stamp(mdb_log_entry_t *en)
     if (tbl->cnt.inserts == en->cnt->inserts &&
         tbl->cnt.deletes == en->cnt->deletes &&
         tbl->cnt.updates == en->cnt->updates)
+    {
         tbl->cnt.stamp = en->cnt->stamp;
+        memcpy(tbl->cnt.stamps, en->cnt->stamps,
+               sizeof(uint32_t) * MDB_TABLE_NSTAMP(tbl));
+    }
+
+    free(en->cnt);
 
     return 0;
 }
 
+/*
+ * all-zero image for the missing side of a change, grown to the
+ * longest row committed so far; used under the version lock only
+ */
+static mdb_row_t *blank_row(mdb_table_t *tbl)
+{
+    static mdb_row_t *blank;
+    static int        size;
+    int               need;
+
+    need = sizeof(mdb_row_t) + tbl->dlgh;
+
+    if (need > size) {
+        free(blank);
+        size = 0;
+
+        if (!(blank = calloc(1, need))) {
+            errno = ENOMEM;
+            return NULL;
+        }
+
+        size = need;
+    }
+
+    return blank;
+}
+
 /*
  * Local Variables:
  * c-basic-offset: 4
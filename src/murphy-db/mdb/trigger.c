@@ -50,8 +50,10 @@ typedef struct select_s           select_t;
 
 typedef struct column_trigger_s   column_trigger_t;
 typedef struct row_trigger_s      row_trigger_t;
+typedef struct row_trigger_s      changefeed_trigger_t;
 typedef struct table_trigger_s    table_trigger_t;
 typedef struct transact_trigger_s transact_trigger_t;
+typedef struct change_s           change_t;
 
 struct callback_s {
     mqi_trigger_cb_t  function;
@@ -67,12 +69,14 @@ struct select_s {
 struct column_trigger_s {
     mdb_dlist_t link;
     callback_t  callback;
+    bool        batched;
     select_t    select;
 };
 
 struct row_trigger_s {
     mdb_dlist_t link;
     callback_t  callback;
+    bool        batched;
     select_t    select;
 };
 
@@ -86,36 +90,52 @@ struct transact_trigger_s {
     callback_t   callback;
 };
 
+struct change_s {
+    mqi_change_type_t  change;
+    mqi_bitfld_t       colmask;
+    mdb_row_t         *row;      /* identifies the changed row */
+    int                seqno;    /* order of the changes */
+    int                before;   /* offset of the image in pool, or -1 */
+    int                after;    /* offset of the image in pool, or -1 */
+};
 
-static int8_t lowest_bit_in[256] = {
-    /*         0   1   2   3   4   5   6   7   8   9   A   B   C   D   E   F */
-    /*        -------------------------------------------------------------- */
-    /* 00 */  -1,  0,  1,  0,  2,  0,  1,  0,  3,  0,  1,  0,  2,  0,  1,  0,
-    /* 10 */   4,  0,  1,  0,  2,  0,  1,  0,  3,  0,  1,  0,  2,  0,  1,  0,
-    /* 20 */   5,  0,  1,  0,  2,  0,  1,  0,  3,  0,  1,  0,  2,  0,  1,  0,
-    /* 30 */   4,  0,  1,  0,  2,  0,  1,  0,  3,  0,  1,  0,  2,  0,  1,  0,
-    /* 40 */   6,  0,  1,  0,  2,  0,  1,  0,  3,  0,  1,  0,  2,  0,  1,  0,
-    /* 50 */   4,  0,  1,  0,  2,  0,  1,  0,  3,  0,  1,  0,  2,  0,  1,  0,
-    /* 60 */   5,  0,  1,  0,  2,  0,  1,  0,  3,  0,  1,  0,  2,  0,  1,  0,
-    /* 70 */   4,  0,  1,  0,  2,  0,  1,  0,  3,  0,  1,  0,  2,  0,  1,  0,
-    /* 80 */   7,  0,  1,  0,  2,  0,  1,  0,  3,  0,  1,  0,  2,  0,  1,  0,
-    /* 90 */   4,  0,  1,  0,  2,  0,  1,  0,  3,  0,  1,  0,  2,  0,  1,  0,
-    /* A0 */   5,  0,  1,  0,  2,  0,  1,  0,  3,  0,  1,  0,  2,  0,  1,  0,
-    /* B0 */   4,  0,  1,  0,  2,  0,  1,  0,  3,  0,  1,  0,  2,  0,  1,  0,
-    /* C0 */   6,  0,  1,  0,  2,  0,  1,  0,  3,  0,  1,  0,  2,  0,  1,  0,
-    /* D0 */   4,  0,  1,  0,  2,  0,  1,  0,  3,  0,  1,  0,  2,  0,  1,  0,
-    /* E0 */   5,  0,  1,  0,  2,  0,  1,  0,  3,  0,  1,  0,  2,  0,  1,  0,
-    /* F0 */   4,  0,  1,  0,  2,  0,  1,  0,  3,  0,  1,  0,  2,  0,  1,  0,
+struct mdb_trigger_changes_s {
+    mdb_dlist_t   link;
+    mdb_table_t  *table;
+    int           nchange;
+    int           size;
+    change_t     *changes;
+    int           poolsiz;
+    int           poolused;
+    uint8_t      *pool;
 };
 
 
 static MDB_DLIST_HEAD(table_change_triggers);
 static MDB_DLIST_HEAD(transact_change_triggers);
+static MDB_DLIST_HEAD(changefeed_changes);
+static MDB_DLIST_HEAD(batched_changes);
 
 static int get_select_params(mdb_table_t *, mqi_column_desc_t *, int *, int *);
+static int add_column_callback(mdb_table_t *, int, bool, mqi_trigger_cb_t,
+                               void *, mqi_column_desc_t *);
+static int add_row_callback(mdb_table_t *, bool, mqi_trigger_cb_t, void *,
+                            mqi_column_desc_t *);
 static void row_change(mqi_event_type_t, mdb_table_t *, mdb_row_t *);
 static void table_change(mqi_event_type_t, mdb_table_t *);
 static void transaction_change(mqi_event_type_t);
+static void add_change(mdb_trigger_changes_t **, mdb_dlist_t *,
+                       mdb_table_t *, mqi_change_type_t, mqi_bitfld_t,
+                       mdb_row_t *, mdb_row_t *);
+static void detach_changes(mdb_dlist_t *, mdb_dlist_t *, bool);
+static int save_image(mdb_trigger_changes_t *, mdb_row_t *);
+static int compact_changes(mdb_trigger_changes_t *);
+static void changefeed_fire(mdb_trigger_changes_t *, changefeed_trigger_t *);
+static void batch_fire_rows(mdb_trigger_changes_t *, row_trigger_t *,
+                            mqi_event_type_t);
+static void batch_fire_column(mdb_trigger_changes_t *, column_trigger_t *,
+                              int, uint8_t *);
+static void free_changes(mdb_trigger_changes_t *);
 
 
 void mdb_trigger_init(mdb_trigger_t *trigger, int ncol)
@@ -126,6 +146,10 @@ void mdb_trigger_init(mdb_trigger_t *trigger, int ncol)
         return;
 
     MDB_DLIST_INIT(trigger->row_change);
+    MDB_DLIST_INIT(trigger->changefeed);
+    trigger->changes = NULL;
+    trigger->batch = NULL;
+    trigger->nbatched = 0;
 
     for (i = 0;  i < ncol;  i++)
         MDB_DLIST_INIT(trigger->column_change[i]);
@@ -146,6 +170,23 @@ void mdb_trigger_reset(mdb_trigger_t *trigger, int ncol)
         free(rt);
     }
 
+    MDB_DLIST_FOR_EACH_SAFE(row_trigger_t, link, rt,n, &trigger->changefeed) {
+        MDB_DLIST_UNLINK(row_trigger_t, link, rt);
+        free(rt);
+    }
+
+    if (trigger->changes) {
+        free_changes(trigger->changes);
+        trigger->changes = NULL;
+    }
+
+    if (trigger->batch) {
+        free_changes(trigger->batch);
+        trigger->batch = NULL;
+    }
+
+    trigger->nbatched = 0;
+
     for (i = 0;  i < ncol;  i++) {
         head = trigger-> column_change + i;
 
@@ -162,6 +203,25 @@ int mdb_trigger_add_column_callback(mdb_table_t       *tbl,
                                     mqi_trigger_cb_t   cb_function,
                                     void              *cb_data,
                                     mqi_column_desc_t *cds)
+{
+    return add_column_callback(tbl, cidx, false, cb_function, cb_data, cds);
+}
+
+int mdb_trigger_add_batched_column_callback(mdb_table_t       *tbl,
+                                            int                cidx,
+                                            mqi_trigger_cb_t   cb_function,
+                                            void              *cb_data,
+                                            mqi_column_desc_t *cds)
+{
+    return add_column_callback(tbl, cidx, true, cb_function, cb_data, cds);
+}
+
+static int add_column_callback(mdb_table_t       *tbl,
+                               int                cidx,
+                               bool               batched,
+                               mqi_trigger_cb_t   cb_function,
+                               void              *cb_data,
+                               mqi_column_desc_t *cds)
 {
     column_trigger_t *tr;
     size_t cdsiz;
@@ -186,7 +246,7 @@ int mdb_trigger_add_column_callback(mdb_table_t       *tbl,
         if (cb_function == tr->callback.function &&
             cb_data == tr->callback.user_data)
         {
-            if (cdsiz == tr->select.cdsiz) {
+            if (cdsiz == tr->select.cdsiz && batched == tr->batched) {
                 if (!cdsiz || memcmp(cds, tr->select.column, cdsiz))
                     return 0; /* silently ignore multiple registrations */
             }
@@ -206,6 +266,9 @@ int mdb_trigger_add_column_callback(mdb_table_t       *tbl,
     tr->callback.function = cb_function;
     tr->callback.user_data = cb_data;
 
+    if ((tr->batched = batched))
+        tbl->trigger.nbatched++;
+
     tr->select.length = length;
     tr->select.cdsiz = cdsiz;
 
@@ -232,6 +295,8 @@ int mdb_trigger_delete_column_callback(mdb_table_t      *tbl,
             cb_data == tr->callback.user_data)
         {
             MDB_DLIST_UNLINK(column_trigger_t, link, tr);
+            if (tr->batched)
+                tbl->trigger.nbatched--;
             free(tr);
             return 0;
         }
@@ -245,6 +310,23 @@ int mdb_trigger_add_row_callback(mdb_table_t       *tbl,
                                  mqi_trigger_cb_t   cb_function,
                                  void              *cb_data,
                                  mqi_column_desc_t *cds)
+{
+    return add_row_callback(tbl, false, cb_function, cb_data, cds);
+}
+
+int mdb_trigger_add_batched_row_callback(mdb_table_t       *tbl,
+                                         mqi_trigger_cb_t   cb_function,
+                                         void              *cb_data,
+                                         mqi_column_desc_t *cds)
+{
+    return add_row_callback(tbl, true, cb_function, cb_data, cds);
+}
+
+static int add_row_callback(mdb_table_t       *tbl,
+                            bool               batched,
+                            mqi_trigger_cb_t   cb_function,
+                            void              *cb_data,
+                            mqi_column_desc_t *cds)
 {
     row_trigger_t *tr;
     size_t cdsiz;
@@ -269,7 +351,7 @@ int mdb_trigger_add_row_callback(mdb_table_t       *tbl,
         if (cb_function == tr->callback.function &&
             cb_data == tr->callback.user_data)
         {
-            if (cdsiz == tr->select.cdsiz) {
+            if (cdsiz == tr->select.cdsiz && batched == tr->batched) {
                 if (!cdsiz || memcmp(cds, tr->select.column, cdsiz))
                     return 0; /* silently ignore multiple registrations */
             }
@@ -289,6 +371,9 @@ int mdb_trigger_add_row_callback(mdb_table_t       *tbl,
     tr->callback.function = cb_function;
     tr->callback.user_data = cb_data;
 
+    if ((tr->batched = batched))
+        tbl->trigger.nbatched++;
+
     tr->select.length = length;
     tr->select.cdsiz = cdsiz;
 
@@ -312,6 +397,92 @@ int mdb_trigger_delete_row_callback(mdb_table_t      *tbl,
             cb_data == tr->callback.user_data)
         {
             MDB_DLIST_UNLINK(row_trigger_t, link, tr);
+            if (tr->batched)
+                tbl->trigger.nbatched--;
+            free(tr);
+            return 0;
+        }
+    }
+
+    errno = ENOENT;
+    return -1;
+}
+
+
+int mdb_trigger_add_changefeed_callback(mdb_table_t       *tbl,
+                                        mqi_trigger_cb_t   cb_function,
+                                        void              *cb_data,
+                                        mqi_column_desc_t *cds)
+{
+    changefeed_trigger_t *tr;
+    size_t cdsiz;
+    int length, ncd;
+    mdb_dlist_t *head;
+
+    MDB_CHECKARG(tbl && cb_function, -1);
+
+    if (!cds)
+        ncd = length = 0;
+    else {
+        if (get_select_params(tbl, cds, &ncd, &length) < 0) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    cdsiz = sizeof(mqi_column_desc_t) * ncd;
+    head  = &tbl->trigger.changefeed;
+
+    MDB_DLIST_FOR_EACH(changefeed_trigger_t, link, tr, head) {
+        if (cb_function == tr->callback.function &&
+            cb_data == tr->callback.user_data)
+        {
+            if (cdsiz == tr->select.cdsiz) {
+                if (!cdsiz || !memcmp(cds, tr->select.column, cdsiz))
+                    return 0; /* silently ignore multiple registrations */
+            }
+
+            errno = EEXIST;
+            return -1;
+        }
+    }
+
+    if (!(tr = calloc(1, sizeof(changefeed_trigger_t) + cdsiz))) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    MDB_DLIST_APPEND(changefeed_trigger_t, link, tr, head);
+
+    tr->callback.function = cb_function;
+    tr->callback.user_data = cb_data;
+
+    tr->select.length = length;
+    tr->select.cdsiz = cdsiz;
+
+    if (ncd > 0)
+        memcpy(tr->select.column, cds, cdsiz);
+
+    return 0;
+}
+
+
+int mdb_trigger_delete_changefeed_callback(mdb_table_t      *tbl,
+                                           mqi_trigger_cb_t  cb_function,
+                                           void             *cb_data)
+{
+    changefeed_trigger_t *tr, *n;
+    mdb_dlist_t *head;
+
+    MDB_CHECKARG(tbl && cb_function, -1);
+
+    head = &tbl->trigger.changefeed;
+
+    MDB_DLIST_FOR_EACH_SAFE(changefeed_trigger_t, link, tr,n, head) {
+        if (cb_function == tr->callback.function &&
+            cb_data == tr->callback.user_data)
+        {
+            MDB_DLIST_UNLINK(changefeed_trigger_t, link, tr);
             free(tr);
             return 0;
         }
@@ -435,10 +606,9 @@ void mdb_trigger_column_change(mdb_table_t  *tbl,
     mqi_column_event_t *ce;
     int                 cx;
     int                 sx;
-    mqi_bitfld_t        mask, byte;
-    int                 i,j,k;
+    int                 k;
 
-    if (!tbl || !colmask || !before || !after)
+    if (!tbl || mqi_bitfld_is_empty(&colmask) || !before || !after)
         return;
 
     memset(&evt, 0, sizeof(evt));
@@ -454,36 +624,36 @@ void mdb_trigger_column_change(mdb_table_t  *tbl,
     if (!ce->select.data)
         return;
 
-    for (mask = colmask, i = 0;     mask != 0;     mask >>= 8, i += 8) {
-        byte = mask & 0xff;
+    ce->nrow   = 1;
+    ce->values = &ce->value;
 
-        while ((j = lowest_bit_in[byte]) >= 0) {
-            byte &= ~MQI_BIT(j);
-            cx  = i + j;
-            col = tbl->columns + cx;
-            hd  = tbl->trigger.column_change + cx;
+    MQI_BITFLD_FOR_EACH(&colmask, cx) {
+        col = tbl->columns + cx;
+        hd  = tbl->trigger.column_change + cx;
 
-            MDB_DLIST_FOR_EACH(column_trigger_t, link, tr, hd) {
-                ce->column.index = cx;
-                ce->column.name  = tbl->columns[cx].name;
+        MDB_DLIST_FOR_EACH(column_trigger_t, link, tr, hd) {
+            if (tr->batched)
+                continue;
 
-                ce->value.type = tbl->columns[cx].type;
+            ce->column.index = cx;
+            ce->column.name  = tbl->columns[cx].name;
 
-                cd.cindex = cx;
-                cd.offset = 0;
+            ce->value.type = tbl->columns[cx].type;
 
-                mdb_column_read(&cd, &ce->value.old, col, before->data);
-                mdb_column_read(&cd, &ce->value.new_, col, after->data );
+            cd.cindex = cx;
+            cd.offset = 0;
 
-                if (tr->select.length > 0) {
-                    for (k = 0; (sx = tr->select.column[k].cindex) >= 0;  k++){
-                        mdb_column_read(tr->select.column + k, ce->select.data,
-                                        tbl->columns + sx, after->data);
-                    }
-                }
+            mdb_column_read(&cd, &ce->value.old, col, before->data);
+            mdb_column_read(&cd, &ce->value.new_, col, after->data );
 
-                tr->callback.function(&evt, tr->callback.user_data);
+            if (tr->select.length > 0) {
+                for (k = 0; (sx = tr->select.column[k].cindex) >= 0;  k++){
+                    mdb_column_read(tr->select.column + k, ce->select.data,
+                                    tbl->columns + sx, after->data);
+                }
             }
+
+            tr->callback.function(&evt, tr->callback.user_data);
         }
     }
 }
@@ -524,6 +694,110 @@ void mdb_trigger_transaction_end(void)
     transaction_change(mqi_transaction_end);
 }
 
+/*
+ * The commit walks the transaction log in the order the changes were
+ * made. The changes are collected here per table; for the changefeed
+ * subscribers till the end of the commit, and for the batched triggers
+ * till the end of the outermost transaction.
+ */
+void mdb_trigger_collect(mdb_table_t       *tbl,
+                         mqi_change_type_t  change,
+                         mqi_bitfld_t       colmask,
+                         mdb_row_t         *before,
+                         mdb_row_t         *after)
+{
+    if (!tbl)
+        return;
+
+    if (!MDB_DLIST_EMPTY(tbl->trigger.changefeed)) {
+        add_change(&tbl->trigger.changes, &changefeed_changes,
+                   tbl, change, colmask, before, after);
+    }
+
+    if (tbl->trigger.nbatched > 0) {
+        add_change(&tbl->trigger.batch, &batched_changes,
+                   tbl, change, colmask, before, after);
+    }
+}
+
+void mdb_trigger_changefeed_deliver(void)
+{
+    MDB_DLIST_HEAD(pending);
+    mdb_trigger_changes_t *chs, *n;
+    changefeed_trigger_t *tr;
+    mdb_table_t *tbl;
+
+    if (MDB_DLIST_EMPTY(changefeed_changes))
+        return;
+
+    detach_changes(&changefeed_changes, &pending, false);
+
+    MDB_DLIST_FOR_EACH_SAFE(mdb_trigger_changes_t, link, chs,n, &pending) {
+        tbl = chs->table;
+
+        if (compact_changes(chs) > 0) {
+            MDB_DLIST_FOR_EACH(changefeed_trigger_t, link, tr,
+                               &tbl->trigger.changefeed)
+            {
+                changefeed_fire(chs, tr);
+            }
+        }
+
+        free_changes(chs);
+    }
+}
+
+/*
+ * Batched triggers get the net changes of the outermost transaction:
+ * one event per trigger and kind of change, with the changes of the
+ * rolled back (sub)transactions never collected in the first place.
+ */
+void mdb_trigger_batch_deliver(void)
+{
+    MDB_DLIST_HEAD(pending);
+    mdb_trigger_changes_t *chs, *n;
+    row_trigger_t *rt;
+    column_trigger_t *ct;
+    mdb_table_t *tbl;
+    uint8_t *blank;
+    int cx;
+
+    if (MDB_DLIST_EMPTY(batched_changes))
+        return;
+
+    detach_changes(&batched_changes, &pending, true);
+
+    MDB_DLIST_FOR_EACH_SAFE(mdb_trigger_changes_t, link, chs,n, &pending) {
+        tbl = chs->table;
+
+        if (compact_changes(chs) > 0) {
+            MDB_DLIST_FOR_EACH(row_trigger_t, link, rt,
+                               &tbl->trigger.row_change)
+            {
+                if (rt->batched) {
+                    batch_fire_rows(chs, rt, mqi_row_inserted);
+                    batch_fire_rows(chs, rt, mqi_row_deleted);
+                }
+            }
+
+            if ((blank = calloc(1, tbl->dlgh + 1))) {
+                for (cx = 0;  cx < tbl->ncolumn;  cx++) {
+                    MDB_DLIST_FOR_EACH(column_trigger_t, link, ct,
+                                       tbl->trigger.column_change + cx)
+                    {
+                        if (ct->batched)
+                            batch_fire_column(chs, ct, cx, blank);
+                    }
+                }
+
+                free(blank);
+            }
+        }
+
+        free_changes(chs);
+    }
+}
+
 static int get_select_params(mdb_table_t       *tbl,
                              mqi_column_desc_t *cds,
                              int               *ncd_ret,
@@ -571,7 +845,12 @@ static void row_change(mqi_event_type_t  event,
     if (!re->select.data)
         return;
 
+    re->nrow = 1;
+
     MDB_DLIST_FOR_EACH(row_trigger_t, link, tr, &tbl->trigger.row_change) {
+        if (tr->batched)
+            continue;
+
         if (tr->select.length > 0) {
             for (i = 0;  (sx = tr->select.column[i].cindex) >= 0;   i++)  {
                 mdb_column_read(tr->select.column + i, re->select.data,
@@ -618,6 +897,429 @@ static void transaction_change(mqi_event_type_t event)
     }
 }
 
+static void add_change(mdb_trigger_changes_t **chsp,
+                       mdb_dlist_t            *list,
+                       mdb_table_t            *tbl,
+                       mqi_change_type_t       change,
+                       mqi_bitfld_t            colmask,
+                       mdb_row_t              *before,
+                       mdb_row_t              *after)
+{
+    mdb_trigger_changes_t *chs;
+    change_t *ch;
+    int size;
+
+    if (!(chs = *chsp)) {
+        if (!(chs = calloc(1, sizeof(mdb_trigger_changes_t))))
+            return;
+
+        MDB_DLIST_APPEND(mdb_trigger_changes_t, link, chs, list);
+
+        chs->table = tbl;
+        *chsp = chs;
+    }
+
+    if (chs->nchange >= chs->size) {
+        size = chs->size ? chs->size * 2 : 64;
+        ch = realloc(chs->changes, sizeof(change_t) * size);
+
+        if (!ch)
+            return;
+
+        chs->changes = ch;
+        chs->size = size;
+    }
+
+    ch = chs->changes + chs->nchange;
+
+    ch->change  = change;
+    ch->colmask = colmask;
+    ch->row     = after ? after : before;
+    ch->seqno   = chs->nchange;
+    ch->before  = before ? save_image(chs, before) : -1;
+    ch->after   = after  ? save_image(chs, after)  : -1;
+
+    if ((before && ch->before < 0) || (after && ch->after < 0))
+        return;
+
+    chs->nchange++;
+}
+
+/*
+ * triggers might commit transactions of their own,
+ * so detach the collected changes before delivering them
+ */
+static void detach_changes(mdb_dlist_t *list, mdb_dlist_t *pending,
+                           bool batch)
+{
+    mdb_trigger_changes_t *chs, *n;
+
+    MDB_DLIST_FOR_EACH_SAFE(mdb_trigger_changes_t, link, chs,n, list) {
+        MDB_DLIST_UNLINK(mdb_trigger_changes_t, link, chs);
+        MDB_DLIST_APPEND(mdb_trigger_changes_t, link, chs, pending);
+
+        if (batch)
+            chs->table->trigger.batch = NULL;
+        else
+            chs->table->trigger.changes = NULL;
+    }
+}
+
+static int save_image(mdb_trigger_changes_t *chs, mdb_row_t *row)
+{
+    int      dlgh = chs->table->dlgh;
+    int      isiz = (dlgh + 7) & ~7;
+    int      size;
+    int      offs;
+    uint8_t *pool;
+
+    if (chs->poolused + isiz > chs->poolsiz) {
+        for (size = chs->poolsiz ? chs->poolsiz : 4096;
+             chs->poolused + isiz > size;
+             size *= 2)
+            ;
+
+        if (!(pool = realloc(chs->pool, size)))
+            return -1;
+
+        chs->pool = pool;
+        chs->poolsiz = size;
+    }
+
+    offs = chs->poolused;
+    chs->poolused += isiz;
+
+    memcpy(chs->pool + offs, row->data, dlgh);
+    mdb_row_retain_strings(chs->table, chs->pool + offs);
+
+    return offs;
+}
+
+static int compare_rows(const void *a, const void *b)
+{
+    const change_t *ca = (const change_t *)a;
+    const change_t *cb = (const change_t *)b;
+
+    if (ca->row != cb->row)
+        return ca->row < cb->row ? -1 : 1;
+
+    return ca->seqno - cb->seqno;
+}
+
+static int compare_seqno(const void *a, const void *b)
+{
+    return ((const change_t *)a)->seqno - ((const change_t *)b)->seqno;
+}
+
+static bool merge_change(change_t *dst, change_t *src)
+{
+    switch (dst->change) {
+
+    case mqi_change_unknown:
+        /* an insert cancelled by a delete; start over */
+        *dst = *src;
+        return true;
+
+    case mqi_change_insert:
+    case mqi_change_update:
+        if (src->change == mqi_change_update) {
+            mqi_bitfld_merge(&dst->colmask, &src->colmask);
+            dst->after = src->after;
+            return true;
+        }
+        if (src->change == mqi_change_delete) {
+            if (dst->change == mqi_change_insert)
+                dst->change = mqi_change_unknown;
+            else {
+                dst->change  = mqi_change_delete;
+                dst->colmask = src->colmask;
+                dst->after   = -1;
+            }
+            return true;
+        }
+        return false;
+
+    default:
+        return false;
+    }
+}
+
+/*
+ * fold the subsequent changes of the same row into a single one,
+ * ie. insert+update is an insert, update+delete is a delete and
+ * insert+delete is nothing at all
+ */
+static int compact_changes(mdb_trigger_changes_t *chs)
+{
+    change_t *dst, *src;
+    int n, i;
+
+    if (chs->nchange < 1)
+        return 0;
+
+    qsort(chs->changes, chs->nchange, sizeof(change_t), compare_rows);
+
+    for (n = i = 0, dst = NULL;   i < chs->nchange;   i++) {
+        src = chs->changes + i;
+
+        if (dst && dst->row == src->row && merge_change(dst, src))
+            continue;
+
+        if (dst && dst->change == mqi_change_unknown)
+            n--;
+
+        dst = chs->changes + n++;
+        *dst = *src;
+    }
+
+    if (dst && dst->change == mqi_change_unknown)
+        n--;
+
+    qsort(chs->changes, n, sizeof(change_t), compare_seqno);
+
+    return (chs->nchange = n);
+}
+
+static void changefeed_fire(mdb_trigger_changes_t *chs,
+                            changefeed_trigger_t  *tr)
+{
+    mdb_table_t            *tbl = chs->table;
+    mqi_event_t             evt;
+    mqi_changefeed_event_t *ce;
+    mqi_change_row_t       *rows, *r;
+    change_t               *ch;
+    uint8_t                *data;
+    int                     length;
+    int                     sx;
+    int                     i,j;
+
+    length = (tr->select.length + 7) & ~7;
+
+    rows = calloc(1, (sizeof(mqi_change_row_t) + length*2) * chs->nchange);
+
+    if (!rows)
+        return;
+
+    data = (uint8_t *)(rows + chs->nchange);
+
+    for (i = 0;  i < chs->nchange;  i++) {
+        ch = chs->changes + i;
+        r  = rows + i;
+
+        r->change  = ch->change;
+        r->colmask = ch->colmask;
+
+        if (tr->select.length <= 0)
+            continue;
+
+        if (ch->before >= 0) {
+            for (j = 0;  (sx = tr->select.column[j].cindex) >= 0;  j++) {
+                mdb_column_read(tr->select.column + j, data, tbl->columns+sx,
+                                chs->pool + ch->before);
+            }
+            r->before = data;
+            data += length;
+        }
+
+        if (ch->after >= 0) {
+            for (j = 0;  (sx = tr->select.column[j].cindex) >= 0;  j++) {
+                mdb_column_read(tr->select.column + j, data, tbl->columns+sx,
+                                chs->pool + ch->after);
+            }
+            r->after = data;
+            data += length;
+        }
+    }
+
+    memset(&evt, 0, sizeof(evt));
+    ce = &evt.changes;
+
+    ce->event = mqi_rows_changed;
+
+    ce->table.handle = tbl->handle;
+    ce->table.name   = tbl->name;
+
+    ce->length = tr->select.length;
+    ce->nrow   = chs->nchange;
+    ce->rows   = rows;
+
+    tr->callback.function(&evt, tr->callback.user_data);
+
+    free(rows);
+}
+
+static void batch_fire_rows(mdb_trigger_changes_t *chs,
+                            row_trigger_t         *tr,
+                            mqi_event_type_t       event)
+{
+    mdb_table_t      *tbl = chs->table;
+    mqi_change_type_t change;
+    mqi_event_t       evt;
+    mqi_row_event_t  *re;
+    change_t         *ch;
+    uint8_t          *data, *row, *image;
+    int               length;
+    int               sx;
+    int               i,j,n;
+
+    change = (event == mqi_row_inserted) ? mqi_change_insert:mqi_change_delete;
+
+    for (n = i = 0;  i < chs->nchange;  i++) {
+        if (chs->changes[i].change == change)
+            n++;
+    }
+
+    if (!n)
+        return;
+
+    length = (tr->select.length + 7) & ~7;
+
+    if (!(data = calloc(n, length ? length : 1)))
+        return;
+
+    for (row = data, i = 0;  i < chs->nchange;  i++) {
+        ch = chs->changes + i;
+
+        if (ch->change != change || !length)
+            continue;
+
+        image = chs->pool + (change == mqi_change_insert ? ch->after:ch->before);
+
+        for (j = 0;  (sx = tr->select.column[j].cindex) >= 0;  j++)
+            mdb_column_read(tr->select.column + j, row, tbl->columns+sx, image);
+
+        row += length;
+    }
+
+    memset(&evt, 0, sizeof(evt));
+    re = &evt.row;
+
+    re->event = event;
+
+    re->table.handle = tbl->handle;
+    re->table.name   = tbl->name;
+
+    re->select.length = length;
+    re->select.data   = data;
+
+    re->nrow = n;
+
+    tr->callback.function(&evt, tr->callback.user_data);
+
+    free(data);
+}
+
+static void batch_fire_column(mdb_trigger_changes_t *chs,
+                              column_trigger_t      *tr,
+                              int                    cx,
+                              uint8_t               *blank)
+{
+    mdb_table_t        *tbl = chs->table;
+    mdb_column_t       *col = tbl->columns + cx;
+    mqi_event_t         evt;
+    mqi_column_event_t *ce;
+    mqi_change_value_t *values, *v;
+    mqi_column_desc_t   cd;
+    change_t           *ch;
+    uint8_t            *data, *row, *before, *after;
+    int                 length;
+    int                 sx;
+    int                 i,j,n;
+
+    for (n = i = 0;  i < chs->nchange;  i++) {
+        ch = chs->changes + i;
+
+        if (ch->change != mqi_change_delete &&
+            mqi_bitfld_test(&ch->colmask, cx))
+            n++;
+    }
+
+    if (!n)
+        return;
+
+    length = (tr->select.length + 7) & ~7;
+    values = calloc(n, sizeof(mqi_change_value_t) + length);
+
+    if (!values)
+        return;
+
+    data = (uint8_t *)(values + n);
+
+    cd.cindex = cx;
+    cd.offset = 0;
+
+    for (v = values, row = data, i = 0;  i < chs->nchange;  i++) {
+        ch = chs->changes + i;
+
+        if (ch->change == mqi_change_delete ||
+            !mqi_bitfld_test(&ch->colmask, cx))
+            continue;
+
+        before = ch->before >= 0 ? chs->pool + ch->before : blank;
+        after  = chs->pool + ch->after;
+
+        v->type = col->type;
+
+        if (col->type == mqi_blob) {
+            v->old.generic  = before + col->offset;
+            v->new_.generic = after  + col->offset;
+        }
+        else {
+            mdb_column_read(&cd, &v->old , col, before);
+            mdb_column_read(&cd, &v->new_, col, after );
+        }
+
+        if (length > 0) {
+            for (j = 0;  (sx = tr->select.column[j].cindex) >= 0;  j++) {
+                mdb_column_read(tr->select.column + j, row, tbl->columns + sx,
+                                after);
+            }
+        }
+
+        v++;
+        row += length;
+    }
+
+    memset(&evt, 0, sizeof(evt));
+    ce = &evt.column;
+
+    ce->event = mqi_column_changed;
+
+    ce->table.handle = tbl->handle;
+    ce->table.name   = tbl->name;
+
+    ce->column.index = cx;
+    ce->column.name  = col->name;
+
+    ce->value = values[0];
+
+    ce->select.length = length;
+    ce->select.data   = length > 0 ? data : NULL;
+
+    ce->nrow   = n;
+    ce->values = values;
+
+    tr->callback.function(&evt, tr->callback.user_data);
+
+    free(values);
+}
+
+static void free_changes(mdb_trigger_changes_t *chs)
+{
+    mdb_table_t *tbl = chs->table;
+    int          isiz = (tbl->dlgh + 7) & ~7;
+    int          offs;
+
+    MDB_DLIST_UNLINK(mdb_trigger_changes_t, link, chs);
+
+    for (offs = 0;  tbl->strings && offs < chs->poolused;  offs += isiz)
+        mdb_row_release_strings(tbl, chs->pool + offs);
+
+    free(chs->changes);
+    free(chs->pool);
+    free(chs);
+}
+
 /*
  * Local Variables:
  * c-basic-offset: 4
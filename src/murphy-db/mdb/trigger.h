@@ -35,9 +35,15 @@
 
 
 
+typedef struct mdb_trigger_changes_s mdb_trigger_changes_t;
+
 typedef struct {
-    mdb_dlist_t   row_change;
-    mdb_dlist_t   column_change[0];
+    mdb_dlist_t            row_change;
+    mdb_dlist_t            changefeed;
+    mdb_trigger_changes_t *changes;   /* collected for the changefeed */
+    mdb_trigger_changes_t *batch;     /* collected for batched triggers */
+    int                    nbatched;  /* number of batched triggers */
+    mdb_dlist_t            column_change[0];
 } mdb_trigger_t;
 
 void mdb_trigger_init(mdb_trigger_t *, int);
@@ -55,6 +61,11 @@ void mdb_trigger_table_drop(mdb_table_t *);
 void mdb_trigger_transaction_start(void);
 void mdb_trigger_transaction_end(void);
 
+void mdb_trigger_collect(mdb_table_t *, mqi_change_type_t,
+                                    mqi_bitfld_t, mdb_row_t *, mdb_row_t *);
+void mdb_trigger_changefeed_deliver(void);
+void mdb_trigger_batch_deliver(void);
+
 #endif /* __MDB_TRIGGER_H__ */
 
 /*
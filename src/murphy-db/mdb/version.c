@@ -0,0 +1,402 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <pthread.h>
+
+#include <murphy-db/assert.h>
+#include "version.h"
+#include "table.h"
+
+/*
+ * Every row carries the commit stamp its current image became visible
+ * at. A change made in a transaction marks the row pending and saves
+ * the last committed image of the row, if it had one, to the history
+ * of the table. When the outermost transaction ends all pending rows
+ * and saved images get the stamp of that commit. Changes outside of
+ * transactions are committed immediately and save the superseded
+ * image only if there are open snapshots.
+ *
+ * A snapshot at stamp S sees the rows stamped at or before S plus the
+ * saved images that were valid at S. Saved images are released once
+ * no open snapshot can see them anymore. The strings a snapshot select
+ * returns are copied, as the rows they come from may change or go away
+ * as soon as the version lock is released; the copies belong to the
+ * snapshot and are freed when it is closed.
+ */
+
+typedef struct snapshot_string_s snapshot_string_t;
+
+struct snapshot_string_s {
+    snapshot_string_t *next;
+    char               str[0];
+};
+
+struct mdb_snapshot_s {
+    mdb_dlist_t         link;
+    uint32_t            stamp;
+    snapshot_string_t  *strings;    /* copies returned by selects */
+};
+
+static mdb_version_t *save_image(mdb_table_t *, mdb_row_t *, uint32_t);
+static void release(mdb_version_t *);
+static void collect(void);
+static void init_lock(void);
+
+
+static uint32_t         commit_stamp;
+static MDB_DLIST_HEAD(snapshots);       /* oldest first */
+static MDB_DLIST_HEAD(pending);         /* versions of the open transaction */
+static MDB_DLIST_HEAD(retired);         /* in the order of their 'to' stamp */
+static pthread_mutex_t  lock;
+static pthread_once_t   lock_once = PTHREAD_ONCE_INIT;
+
+
+mdb_snapshot_t *mdb_snapshot_open(void)
+{
+    mdb_snapshot_t *snapshot;
+
+    if (!(snapshot = calloc(1, sizeof(mdb_snapshot_t)))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    mdb_version_lock();
+
+    snapshot->stamp = commit_stamp;
+    MDB_DLIST_APPEND(mdb_snapshot_t, link, snapshot, &snapshots);
+
+    mdb_version_unlock();
+
+    return snapshot;
+}
+
+int mdb_snapshot_close(mdb_snapshot_t *snapshot)
+{
+    snapshot_string_t *s, *next;
+
+    MDB_CHECKARG(snapshot, -1);
+
+    mdb_version_lock();
+
+    MDB_DLIST_UNLINK(mdb_snapshot_t, link, snapshot);
+
+    for (s = snapshot->strings;  s;  s = next) {
+        next = s->next;
+        free(s);
+    }
+
+    free(snapshot);
+
+    collect();
+
+    mdb_version_unlock();
+
+    return 0;
+}
+
+uint32_t mdb_snapshot_get_stamp(mdb_snapshot_t *snapshot)
+{
+    MDB_CHECKARG(snapshot, 0);
+
+    return snapshot->stamp;
+}
+
+char *mdb_snapshot_copy_string(mdb_snapshot_t *snapshot, const char *str)
+{
+    snapshot_string_t *s;
+    size_t             len;
+
+    len = strlen(str) + 1;
+
+    if (!(s = malloc(sizeof(snapshot_string_t) + len))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    memcpy(s->str, str, len);
+
+    s->next = snapshot->strings;
+    snapshot->strings = s;
+
+    return s->str;
+}
+
+uint32_t mdb_transaction_get_stamp(void)
+{
+    uint32_t stamp;
+
+    mdb_version_lock();
+    stamp = commit_stamp;
+    mdb_version_unlock();
+
+    return stamp;
+}
+
+
+/*
+ * writers take the lock for a single statement or the end of a
+ * transaction, snapshot readers for a select; the lock is recursive
+ * as triggers fired at commit may issue further statements
+ */
+void mdb_version_lock(void)
+{
+    pthread_once(&lock_once, init_lock);
+    pthread_mutex_lock(&lock);
+}
+
+void mdb_version_unlock(void)
+{
+    pthread_mutex_unlock(&lock);
+}
+
+bool mdb_version_snapshots(void)
+{
+    return !MDB_DLIST_EMPTY(snapshots);
+}
+
+int mdb_version_change(mdb_table_t    *tbl,
+                       uint32_t        depth,
+                       mdb_log_type_t  change,
+                       mdb_row_t      *before,
+                       mdb_row_t      *after)
+{
+    mdb_version_t *v;
+    mdb_row_t     *row;
+    uint32_t       stamp;
+
+    MDB_CHECKARG(tbl, -1);
+
+    if (!depth) {
+        stamp = ++commit_stamp;
+
+        if (before && mdb_version_snapshots() && change != mdb_log_insert) {
+            if (!(v = save_image(tbl, before, before->stamp)))
+                return -1;
+
+            v->to = stamp;
+            MDB_DLIST_APPEND(mdb_version_t, queue, v, &retired);
+        }
+
+        if (after)
+            after->stamp = stamp;
+
+        collect();
+
+        return 0;
+    }
+
+    switch (change) {
+
+    case mdb_log_insert:
+        if (!(row = after) || row->version)
+            return 0;
+        v = save_image(tbl, NULL, MDB_STAMP_PENDING);
+        break;
+
+    case mdb_log_update:
+        if (!(row = after))
+            return 0;
+        if (before && before->version) {
+            /* a replaced row hands over its pending version */
+            row->version = before->version;
+            row->version->row = row;
+            before->version = NULL;
+            row->stamp = MDB_STAMP_PENDING;
+            return 0;
+        }
+        if (row->version || !before)
+            return 0;
+        v = save_image(tbl, before, before->stamp);
+        break;
+
+    case mdb_log_delete:
+        if (!(row = before) || row->version)
+            return 0;
+        v = save_image(tbl, before, before->stamp);
+        break;
+
+    default:
+        return 0;
+    }
+
+    if (!v)
+        return -1;
+
+    v->row = row;
+    v->to  = MDB_STAMP_PENDING;
+    MDB_DLIST_APPEND(mdb_version_t, queue, v, &pending);
+
+    row->version = v;
+    row->stamp   = MDB_STAMP_PENDING;
+
+    return 0;
+}
+
+void mdb_version_transaction_end(void)
+{
+    mdb_version_t *v, *n;
+    uint32_t       stamp;
+
+    if (MDB_DLIST_EMPTY(pending))
+        return;
+
+    /*
+     * changes surviving a rollback were committed by a nested
+     * transaction, so the end of the outermost one is a commit
+     */
+    stamp = ++commit_stamp;
+
+    MDB_DLIST_FOR_EACH_SAFE(mdb_version_t, queue, v,n, &pending) {
+        MDB_DLIST_UNLINK(mdb_version_t, queue, v);
+
+        if (v->row) {
+            v->row->stamp   = stamp;
+            v->row->version = NULL;
+            v->row          = NULL;
+        }
+
+        if (v->from == MDB_STAMP_PENDING || !mdb_version_snapshots())
+            release(v);
+        else {
+            v->to = stamp;
+            MDB_DLIST_APPEND(mdb_version_t, queue, v, &retired);
+        }
+    }
+
+    collect();
+}
+
+void mdb_version_table_drop(mdb_table_t *tbl)
+{
+    mdb_version_t *v, *n;
+
+    MDB_DLIST_FOR_EACH_SAFE(mdb_version_t, queue, v,n, &pending) {
+        if (v->table == tbl) {
+            if (v->row)
+                v->row->version = NULL;
+            release(v);
+        }
+    }
+
+    MDB_DLIST_FOR_EACH_SAFE(mdb_version_t, queue, v,n, &retired) {
+        if (v->table == tbl)
+            release(v);
+    }
+}
+
+bool mdb_version_visible(mdb_version_t *v, uint32_t stamp)
+{
+    return v->from <= stamp && (stamp < v->to || v->to == MDB_STAMP_PENDING);
+}
+
+
+static mdb_version_t *save_image(mdb_table_t *tbl,
+                                 mdb_row_t   *row,
+                                 uint32_t     from)
+{
+    mdb_version_t *v;
+    size_t         size;
+
+    size = sizeof(mdb_version_t) + (row ? tbl->dlgh : 0);
+
+    if (!(v = calloc(1, size))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    MDB_DLIST_INIT(v->link);
+    MDB_DLIST_INIT(v->queue);
+    v->table = tbl;
+    v->from  = from;
+
+    if (row) {
+        memcpy(v->data, row->data, tbl->dlgh);
+        mdb_row_retain_strings(tbl, v->data);
+        MDB_DLIST_APPEND(mdb_version_t, link, v, &tbl->history);
+    }
+
+    return v;
+}
+
+static void release(mdb_version_t *v)
+{
+    if (!MDB_DLIST_EMPTY(v->link)) {
+        mdb_row_release_strings(v->table, v->data);
+        MDB_DLIST_UNLINK(mdb_version_t, link, v);
+    }
+    if (!MDB_DLIST_EMPTY(v->queue))
+        MDB_DLIST_UNLINK(mdb_version_t, queue, v);
+
+    free(v);
+}
+
+static void collect(void)
+{
+    mdb_snapshot_t *oldest;
+    mdb_version_t  *v, *n;
+
+    if (MDB_DLIST_EMPTY(snapshots)) {
+        MDB_DLIST_FOR_EACH_SAFE(mdb_version_t, queue, v,n, &retired)
+            release(v);
+        return;
+    }
+
+    oldest = MDB_LIST_RELOCATE(mdb_snapshot_t, link, snapshots.next);
+
+    MDB_DLIST_FOR_EACH_SAFE(mdb_version_t, queue, v,n, &retired) {
+        if (v->to > oldest->stamp)
+            break;
+        release(v);
+    }
+}
+
+static void init_lock(void)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __MDB_VERSION_H__
+#define __MDB_VERSION_H__
+
+#include <stdbool.h>
+#include <murphy-db/list.h>
+#include <murphy-db/mdb.h>
+#include "log.h"
+#include "row.h"
+
+/** stamp of images created or superseded in an open transaction */
+#define MDB_STAMP_PENDING  (~((uint32_t)0))
+
+/*
+ * a superseded row image, visible to snapshots in [from, to)
+ */
+struct mdb_version_s {
+    mdb_dlist_t   link;         /* table->history, if it has an image */
+    mdb_dlist_t   queue;        /* pending or retired versions */
+    mdb_table_t  *table;
+    mdb_row_t    *row;          /* the row changed in a transaction */
+    uint32_t      from;
+    uint32_t      to;
+    uint8_t       data[0];
+};
+
+void mdb_version_lock(void);
+void mdb_version_unlock(void);
+bool mdb_version_snapshots(void);
+int  mdb_version_change(mdb_table_t *, uint32_t, mdb_log_type_t,
+                        mdb_row_t *, mdb_row_t *);
+void mdb_version_transaction_end(void);
+void mdb_version_table_drop(mdb_table_t *);
+bool mdb_version_visible(mdb_version_t *, uint32_t);
+char *mdb_snapshot_copy_string(mdb_snapshot_t *, const char *);
+
+
+#endif /* __MDB_VERSION_H__ */
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
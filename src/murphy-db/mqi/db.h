@@ -41,26 +41,58 @@ typedef struct {
     int (*drop_table_trigger)(mqi_trigger_cb_t, void *);
     int (*drop_row_trigger)(void *, mqi_trigger_cb_t, void *);
     int (*drop_column_trigger)(void *, int, mqi_trigger_cb_t, void *);
+    int (*create_changefeed)(void *, mqi_trigger_cb_t, void *,
+                             mqi_column_desc_t *);
+    int (*drop_changefeed)(void *, mqi_trigger_cb_t, void *);
+    int (*create_batched_row_trigger)(void *, mqi_trigger_cb_t, void *,
+                                      mqi_column_desc_t *);
+    int (*create_batched_column_trigger)(void *, int, mqi_trigger_cb_t,
+                                         void *, mqi_column_desc_t *);
     uint32_t (*begin_transaction)(void);
     int (*commit_transaction)(uint32_t);
     int (*rollback_transaction)(uint32_t);
     uint32_t (*get_transaction_id)(void);
-    void *(*create_table)(char *, char **, mqi_column_def_t *);
+    int (*set_persist_directory)(const char *);
+    int (*checkpoint)(void);
+    void *(*open_snapshot)(void);
+    int (*close_snapshot)(void *);
+    uint32_t (*get_snapshot_stamp)(void *);
+    void *(*create_table)(char *, uint32_t, char **, mqi_column_def_t *);
     int (*register_table_handle)(void *, mqi_handle_t);
     int (*create_index)(void *, char **);
+    int (*create_secondary_index)(void *, const char *, mqi_index_type_t,
+                                  char **);
+    int (*drop_secondary_index)(void *, const char *);
     int (*drop_table)(void *);
     int (*describe)(void *, mqi_column_def_t *, int);
     int (*insert_into)(void *, int, mqi_column_desc_t *, void **);
+    int (*insert_bulk)(void *, int, mqi_column_desc_t *, void *, int, int);
     int (*select)(void *, mqi_cond_entry_t *, mqi_column_desc_t *,
                   void *, int, int);
+    int (*select_query)(void *, mqi_cond_entry_t *, mqi_column_desc_t *,
+                        mqi_query_t *, void *, int, int);
+    int (*select_snapshot)(void *, void *, mqi_cond_entry_t *,
+                           mqi_column_desc_t *, void *, int, int);
     int (*select_by_index)(void *, mqi_variable_t *,
                            mqi_column_desc_t *, void *);
+    int (*select_by_secondary_index)(void *, const char *, mqi_variable_t *,
+                                     mqi_column_desc_t *, void *, int, int);
+    int (*select_join)(void *, int, void *, int, mqi_cond_entry_t *,
+                       mqi_column_desc_t *, void *, int, int);
+    void *(*cursor_open)(void *, mqi_cond_entry_t *, mqi_column_desc_t *);
+    int (*cursor_next)(void *, void *);
+    int (*cursor_read)(void *, void *);
+    void *(*cursor_get_column)(void *, int);
+    int (*cursor_close)(void *);
     int (*update)(void *, mqi_cond_entry_t *, mqi_column_desc_t *,void*);
     int (*delete_from)(void *, mqi_cond_entry_t *);
+    int (*explain)(void *, mqi_cond_entry_t *, char *, int);
     void *(*find_table)(char *);
     int (*get_column_index)(void *, char *);
     int (*get_table_size)(void *);
     uint32_t (*get_table_stamp)(void *);
+    uint32_t (*get_column_stamp)(void *, mqi_bitfld_t *);
+    uint32_t (*get_key_stamp)(void *, mqi_variable_t *);
     char *(*get_column_name)(void *, int);
     mqi_data_type_t (*get_column_type)(void *, int);
     int (*get_column_size)(void *, int);
@@ -38,6 +38,7 @@
 #include <murphy-db/assert.h>
 #include <murphy-db/handle.h>
 #include <murphy-db/mdb.h>
+#include <murphy-db/mqi.h>
 
 #include "mdb-backend.h"
 
@@ -52,26 +53,60 @@ static int      drop_transaction_trigger(mqi_trigger_cb_t, void *);
 static int      drop_table_trigger(mqi_trigger_cb_t, void *);
 static int      drop_row_trigger(void *, mqi_trigger_cb_t, void *);
 static int      drop_column_trigger(void*, int, mqi_trigger_cb_t, void *);
+static int      create_changefeed(void *, mqi_trigger_cb_t, void *,
+                                  mqi_column_desc_t *);
+static int      drop_changefeed(void *, mqi_trigger_cb_t, void *);
+static int      create_batched_row_trigger(void *, mqi_trigger_cb_t, void *,
+                                           mqi_column_desc_t *);
+static int      create_batched_column_trigger(void *, int, mqi_trigger_cb_t,
+                                              void *, mqi_column_desc_t *);
 static uint32_t begin_transaction(void);
 static int      commit_transaction(uint32_t);
 static int      rollback_transaction(uint32_t);
 static uint32_t get_transaction_id(void);
-static void *   create_table(char *, char **, mqi_column_def_t *);
+static int      set_persist_directory(const char *);
+static int      checkpoint(void);
+static void *   open_snapshot(void);
+static int      close_snapshot(void *);
+static uint32_t get_snapshot_stamp(void *);
+static void *   create_table(char *, uint32_t, char **, mqi_column_def_t *);
 static int      register_table_handle(void *, mqi_handle_t);
 static int      create_index(void *, char **);
+static int      create_secondary_index(void *, const char *, mqi_index_type_t,
+                                       char **);
+static int      drop_secondary_index(void *, const char *);
 static int      drop_table(void *);
 static int      describe(void *, mqi_column_def_t *, int);
 static int      insert_into(void *, int, mqi_column_desc_t *, void **);
+static int      insert_bulk(void *, int, mqi_column_desc_t *, void *, int, int);
 static int      select_general(void *, mqi_cond_entry_t *, mqi_column_desc_t *,
                                void *, int, int);
+static int      select_query(void *, mqi_cond_entry_t *, mqi_column_desc_t *,
+                             mqi_query_t *, void *, int, int);
+static int      select_snapshot(void *, void *, mqi_cond_entry_t *,
+                                mqi_column_desc_t *, void *, int, int);
 static int      select_by_index(void *, mqi_variable_t *, mqi_column_desc_t *,
                                  void *);
+static int      select_by_secondary_index(void *, const char *,
+                                          mqi_variable_t *,
+                                          mqi_column_desc_t *,
+                                          void *, int, int);
+static int      select_join(void *, int, void *, int, mqi_cond_entry_t *,
+                            mqi_column_desc_t *, void *, int, int);
+static void *   cursor_open(void *, mqi_cond_entry_t *, mqi_column_desc_t *);
+static int      cursor_next(void *, void *);
+static int      cursor_read(void *, void *);
+static void *   cursor_get_column(void *, int);
+static int      cursor_close(void *);
 static int      update(void *, mqi_cond_entry_t *, mqi_column_desc_t*,void*);
 static int      delete_from(void *, mqi_cond_entry_t *);
+static int      explain(void *, mqi_cond_entry_t *, char *, int);
 static void *   find_table(char *);
 static int      get_column_index(void *, char *);
 static int      get_table_size(void *);
 static uint32_t get_table_stamp(void *);
+static uint32_t get_column_stamp(void *, mqi_bitfld_t *);
+static uint32_t get_key_stamp(void *, mqi_variable_t *);
 static char *   get_column_name(void *, int);
 static mqi_data_type_t get_column_type(void *, int);
 static int      get_column_size(void *, int);
@@ -86,24 +121,48 @@ static mqi_db_functbl_t functbl = {
     drop_table_trigger,
     drop_row_trigger,
     drop_column_trigger,
+    create_changefeed,
+    drop_changefeed,
+    create_batched_row_trigger,
+    create_batched_column_trigger,
     begin_transaction,
     commit_transaction,
     rollback_transaction,
     get_transaction_id,
+    set_persist_directory,
+    checkpoint,
+    open_snapshot,
+    close_snapshot,
+    get_snapshot_stamp,
     create_table,
     register_table_handle,
     create_index,
+    create_secondary_index,
+    drop_secondary_index,
     drop_table,
     describe,
     insert_into,
+    insert_bulk,
     select_general,
+    select_query,
+    select_snapshot,
     select_by_index,
+    select_by_secondary_index,
+    select_join,
+    cursor_open,
+    cursor_next,
+    cursor_read,
+    cursor_get_column,
+    cursor_close,
     update,
     delete_from,
+    explain,
     find_table,
     get_column_index,
     get_table_size,
     get_table_stamp,
+    get_column_stamp,
+    get_key_stamp,
     get_column_name,
     get_column_type,
     get_column_size,
@@ -145,6 +204,25 @@ static int create_column_trigger(void *t,
                                          cb, data, cds);
 }
 
+static int create_batched_row_trigger(void *t,
+                                      mqi_trigger_cb_t cb,
+                                      void *data,
+                                      mqi_column_desc_t *cds)
+{
+    return mdb_trigger_add_batched_row_callback((mdb_table_t *)t,
+                                                cb, data, cds);
+}
+
+static int create_batched_column_trigger(void *t,
+                                         int colidx,
+                                         mqi_trigger_cb_t cb,
+                                         void *data,
+                                         mqi_column_desc_t *cds)
+{
+    return mdb_trigger_add_batched_column_callback((mdb_table_t *)t, colidx,
+                                                   cb, data, cds);
+}
+
 static int drop_transaction_trigger(mqi_trigger_cb_t cb, void *data)
 {
     return mdb_trigger_delete_transaction_callback(cb, data);
@@ -168,6 +246,19 @@ static int drop_column_trigger(void *t,
     return mdb_trigger_delete_column_callback((mdb_table_t *)t,colidx,cb,data);
 }
 
+static int create_changefeed(void *t,
+                             mqi_trigger_cb_t cb,
+                             void *data,
+                             mqi_column_desc_t *cds)
+{
+    return mdb_trigger_add_changefeed_callback((mdb_table_t *)t, cb,data,cds);
+}
+
+static int drop_changefeed(void *t, mqi_trigger_cb_t cb, void *data)
+{
+    return mdb_trigger_delete_changefeed_callback((mdb_table_t *)t, cb, data);
+}
+
 static uint32_t begin_transaction(void)
 {
     uint32_t depth = mdb_transaction_begin();
@@ -193,11 +284,54 @@ static uint32_t get_transaction_id(void)
     return mdb_transaction_get_depth();
 }
 
+static int set_persist_directory(const char *path)
+{
+    return mdb_persist_set_directory(path);
+}
+
+static int checkpoint(void)
+{
+    return mdb_persist_checkpoint();
+}
+
+static void *open_snapshot(void)
+{
+    return mdb_snapshot_open();
+}
+
+static int close_snapshot(void *s)
+{
+    return mdb_snapshot_close((mdb_snapshot_t *)s);
+}
+
+static uint32_t get_snapshot_stamp(void *s)
+{
+    return mdb_snapshot_get_stamp((mdb_snapshot_t *)s);
+}
+
 static void *create_table(char *name,
+                          uint32_t flags,
                           char **index_columns,
                           mqi_column_def_t *cdefs)
 {
-    return mdb_table_create(name, index_columns, cdefs);
+    mdb_table_t *tbl;
+
+    if (!(tbl = mdb_table_create(name, index_columns, cdefs)))
+        return NULL;
+
+    if ((flags & MQI_COLUMNAR) && mdb_table_set_columnar(tbl) < 0) {
+        mdb_table_drop(tbl);
+        return NULL;
+    }
+
+    if ((flags & MQI_TABLE_TYPE_MASK) == MQI_PERSISTENT &&
+        mdb_table_set_persistent(tbl) < 0)
+    {
+        mdb_table_drop(tbl);
+        return NULL;
+    }
+
+    return tbl;
 }
 
 static int register_table_handle(void *t, mqi_handle_t handle)
@@ -212,6 +346,20 @@ static int create_index(void *t, char **index_columns)
     return mdb_table_create_index((mdb_table_t *)t, index_columns);
 }
 
+static int create_secondary_index(void             *t,
+                                  const char       *name,
+                                  mqi_index_type_t  type,
+                                  char            **index_columns)
+{
+    return mdb_table_create_secondary_index((mdb_table_t *)t, name, type,
+                                            index_columns);
+}
+
+static int drop_secondary_index(void *t, const char *name)
+{
+    return mdb_table_drop_secondary_index((mdb_table_t *)t, name);
+}
+
 static int drop_table(void *t)
 {
     return mdb_table_drop((mdb_table_t *)t);
@@ -230,6 +378,17 @@ static int insert_into(void               *t,
     return mdb_table_insert((mdb_table_t *)t, ignore, cds, data);
 }
 
+static int insert_bulk(void              *t,
+                       int                mode,
+                       mqi_column_desc_t *cds,
+                       void              *rows,
+                       int                size,
+                       int                nrow)
+{
+    return mdb_table_insert_bulk((mdb_table_t *)t, mode, cds, rows, size,
+                                 nrow);
+}
+
 static int select_general(void              *t,
                           mqi_cond_entry_t  *cond,
                           mqi_column_desc_t *cds,
@@ -240,6 +399,30 @@ static int select_general(void              *t,
     return mdb_table_select((mdb_table_t *)t, cond, cds, results, size, dim);
 }
 
+static int select_query(void              *t,
+                        mqi_cond_entry_t  *cond,
+                        mqi_column_desc_t *cds,
+                        mqi_query_t       *query,
+                        void              *results,
+                        int                size,
+                        int                dim)
+{
+    return mdb_table_select_query((mdb_table_t *)t, cond, cds, query,
+                                  results, size, dim);
+}
+
+static int select_snapshot(void              *t,
+                           void              *s,
+                           mqi_cond_entry_t  *cond,
+                           mqi_column_desc_t *cds,
+                           void              *results,
+                           int                size,
+                           int                dim)
+{
+    return mdb_table_select_snapshot((mdb_table_t *)t, (mdb_snapshot_t *)s,
+                                     cond, cds, results, size, dim);
+}
+
 static int select_by_index(void              *t,
                             mqi_variable_t    *idxvars,
                             mqi_column_desc_t *cds,
@@ -248,6 +431,59 @@ static int select_by_index(void              *t,
     return mdb_table_select_by_index((mdb_table_t *)t, idxvars, cds, result);
 }
 
+static int select_by_secondary_index(void              *t,
+                                     const char        *name,
+                                     mqi_variable_t    *idxvars,
+                                     mqi_column_desc_t *cds,
+                                     void              *results,
+                                     int                size,
+                                     int                dim)
+{
+    return mdb_table_select_by_secondary_index((mdb_table_t *)t, name, idxvars,
+                                               cds, results, size, dim);
+}
+
+static int select_join(void              *l,
+                       int                lcol,
+                       void              *r,
+                       int                rcol,
+                       mqi_cond_entry_t  *cond,
+                       mqi_column_desc_t *cds,
+                       void              *results,
+                       int                size,
+                       int                dim)
+{
+    return mdb_table_select_join((mdb_table_t *)l, lcol, (mdb_table_t *)r,
+                                 rcol, cond, cds, results, size, dim);
+}
+
+static void *cursor_open(void              *t,
+                         mqi_cond_entry_t  *cond,
+                         mqi_column_desc_t *cds)
+{
+    return mdb_table_cursor_open((mdb_table_t *)t, cond, cds);
+}
+
+static int cursor_next(void *c, void *result)
+{
+    return mdb_cursor_next((mdb_cursor_t *)c, result);
+}
+
+static int cursor_read(void *c, void *result)
+{
+    return mdb_cursor_read((mdb_cursor_t *)c, result);
+}
+
+static void *cursor_get_column(void *c, int cindex)
+{
+    return mdb_cursor_get_column((mdb_cursor_t *)c, cindex);
+}
+
+static int cursor_close(void *c)
+{
+    return mdb_cursor_close((mdb_cursor_t *)c);
+}
+
 
 static int update(void              *t,
                   mqi_cond_entry_t  *cond,
@@ -262,6 +498,11 @@ static int delete_from(void *t, mqi_cond_entry_t *cond)
     return mdb_table_delete((mdb_table_t *)t, cond);
 }
 
+static int explain(void *t, mqi_cond_entry_t *cond, char *buf, int len)
+{
+    return mdb_table_explain((mdb_table_t *)t, cond, buf, len);
+}
+
 
 static void *find_table(char *table_name)
 {
@@ -284,6 +525,16 @@ static uint32_t get_table_stamp(void *t)
     return mdb_table_get_stamp((mdb_table_t *)t);
 }
 
+static uint32_t get_column_stamp(void *t, mqi_bitfld_t *columns)
+{
+    return mdb_table_get_column_stamp((mdb_table_t *)t, columns);
+}
+
+static uint32_t get_key_stamp(void *t, mqi_variable_t *key)
+{
+    return mdb_table_get_key_stamp((mdb_table_t *)t, key);
+}
+
 static char *get_column_name(void *t, int colidx)
 {
     return  mdb_table_get_column_name((mdb_table_t *)t, colidx);
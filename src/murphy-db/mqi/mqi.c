@@ -31,6 +31,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
+#include <pthread.h>
 
 #define _GNU_SOURCE
 #include <string.h>
@@ -74,14 +75,28 @@
         mqi_db_t *db;                                                       \
         if (!(t = mdb_handle_get_data(table_handle, h)) || !(db = t->db)) { \
             errno = ENOENT;                                                 \
+            mqi_unlock();                                                   \
             return errval;                                                  \
         }                                                                   \
         if (!(tbl = t->handle) || !(ftb = db->functbl)) {                   \
             errno = EIO;                                                    \
+            mqi_unlock();                                                   \
             return errval;                                                  \
         }                                                                   \
     } while(0)
 
+#define READ_LOCK(errval)                                                   \
+    do {                                                                    \
+        if (mqi_read_lock() < 0)                                            \
+            return errval;                                                  \
+    } while(0)
+
+#define WRITE_LOCK(errval)                                                  \
+    do {                                                                    \
+        if (mqi_write_lock() < 0)                                           \
+            return errval;                                                  \
+    } while(0)
+
 typedef struct {
     const char       *engine;
     uint32_t          flags;
@@ -91,6 +106,7 @@ typedef struct {
 typedef struct {
     mqi_db_t    *db;
     void        *handle;
+    uint32_t     flags;         /* MQI_PERSISTENT or MQI_TEMPORARY */
 } mqi_table_t;
 
 typedef struct {
@@ -98,8 +114,20 @@ typedef struct {
     uint32_t txid[MAX_DB];
 } mqi_transaction_t;
 
+struct mqi_snapshot_s {
+    void *snapshot[MAX_DB];
+};
+
+struct mqi_cursor_s {
+    mqi_db_functbl_t *ftb;
+    void             *cursor;
+};
+
 
 static int db_register(const char *, uint32_t, mqi_db_functbl_t *);
+static void handle_lock(void);
+static void handle_unlock(void);
+static void init_handle_lock(void);
 
 
 static int        ndb;
@@ -110,13 +138,35 @@ mdb_handle_map_t  *transact_handle;
 mqi_transaction_t  txstack[MQI_TXDEPTH_MAX];
 int                txdepth;
 
+/*
+ * a single reader/writer lock serializes writers against readers of
+ * all tables; the per-thread depth lets triggers and nested calls
+ * re-enter, and a transaction keeps the write lock until its end
+ */
+static pthread_rwlock_t  lock = PTHREAD_RWLOCK_INITIALIZER;
+static __thread int      lock_depth;
+static __thread bool     lock_write;
+
+/*
+ * snapshot readers go without the lock above, so that they are not held
+ * up by a transaction of another thread; they are serialized with the
+ * writers by the backend and only need the table to stay around
+ */
+static pthread_mutex_t   tblock;
+static pthread_once_t    tblock_once = PTHREAD_ONCE_INIT;
+
 
 int mqi_open(void)
 {
+    int sts = 0;
+
+    WRITE_LOCK(-1);
+
     if (!ndb && !dbs) {
         if (!(dbs = calloc(MAX_DB, sizeof(mqi_db_t)))) {
             errno = ENOMEM;
-            return -1;
+            sts = -1;
+            goto out;
         }
 
         table_handle = MDB_HANDLE_MAP_CREATE();
@@ -124,19 +174,25 @@ int mqi_open(void)
 
         transact_handle = MDB_HANDLE_MAP_CREATE();
 
-        if (db_register("MurphyDB", MQI_TEMPORARY, mdb_backend_init()) < 0) {
+        if (db_register("MurphyDB", MQI_TEMPORARY | MQI_PERSISTENT,
+                        mdb_backend_init()) < 0) {
             errno = EIO;
-            return -1;
+            sts = -1;
         }
     }
 
-    return 0;
+ out:
+    mqi_unlock();
+
+    return sts;
 }
 
 int mqi_close(void)
 {
     int i;
 
+    WRITE_LOCK(-1);
+
     if (ndb > 0 && dbs) {
         for (i = 0; i < ndb; i++)
             free((void *)dbs[i].engine);
@@ -155,6 +211,74 @@ int mqi_close(void)
         ndb = 0;
     }
 
+    mqi_unlock();
+
+    return 0;
+}
+
+
+int mqi_read_lock(void)
+{
+    int err;
+
+    if (lock_depth > 0) {
+        lock_depth++;
+        return 0;
+    }
+
+    if ((err = pthread_rwlock_rdlock(&lock)) != 0) {
+        errno = err;
+        return -1;
+    }
+
+    lock_depth = 1;
+    lock_write = false;
+
+    return 0;
+}
+
+
+int mqi_write_lock(void)
+{
+    int err;
+
+    if (lock_depth > 0) {
+        /* upgrading would deadlock with any other upgrading reader */
+        if (!lock_write) {
+            errno = EDEADLK;
+            return -1;
+        }
+
+        lock_depth++;
+        return 0;
+    }
+
+    if ((err = pthread_rwlock_wrlock(&lock)) != 0) {
+        errno = err;
+        return -1;
+    }
+
+    lock_depth = 1;
+    lock_write = true;
+
+    return 0;
+}
+
+
+int mqi_unlock(void)
+{
+    int err = errno;
+
+    MDB_ASSERT(lock_depth > 0, EPERM, -1);
+
+    if (--lock_depth == 0) {
+        lock_write = false;
+        pthread_rwlock_unlock(&lock);
+    }
+
+    /* we are called on error paths, so keep their errno intact */
+    errno = err;
+
     return 0;
 }
 
@@ -173,10 +297,13 @@ int mqi_show_tables(uint32_t flags, char **buf, int len)
     MDB_CHECKARG(buf && len > 0, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
+    READ_LOCK(-1);
+
     MDB_HASH_TABLE_FOR_EACH_WITH_KEY(table_name_hash, data, name, cursor) {
         if (i >= len) {
             errno = EOVERFLOW;
-            return -1;
+            i = -1;
+            break;
         }
 
         if ((h = data - NULL) == MQI_HANDLE_INVALID)
@@ -185,7 +312,7 @@ int mqi_show_tables(uint32_t flags, char **buf, int len)
         if (!(tbl = mdb_handle_get_data(table_handle, h)) || !(db = tbl->db))
             continue;
 
-        if (!(DB_TYPE(db) & flags))
+        if (!(tbl->flags & flags))
             continue;
 
         for (j = 0; j < i;  j++) {
@@ -199,6 +326,8 @@ int mqi_show_tables(uint32_t flags, char **buf, int len)
         i++;
     }
 
+    mqi_unlock();
+
     return i;
 }
 
@@ -212,6 +341,8 @@ int mqi_create_transaction_trigger(mqi_trigger_cb_t callback, void *user_data)
     MDB_CHECKARG(callback, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
+    WRITE_LOCK(-1);
+
     for (i = 0;  i < ndb;  i++) {
         db  = dbs + i;
         ftb = db->functbl;
@@ -225,10 +356,14 @@ int mqi_create_transaction_trigger(mqi_trigger_cb_t callback, void *user_data)
                 ftb->drop_transaction_trigger(callback, user_data);
             }
 
+            mqi_unlock();
+
             return -1;
         }
     }
 
+    mqi_unlock();
+
     return 0;
 }
 
@@ -241,6 +376,8 @@ int mqi_create_table_trigger(mqi_trigger_cb_t callback, void *user_data)
     MDB_CHECKARG(callback, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
+    WRITE_LOCK(-1);
+
     for (i = 0;  i < ndb;  i++) {
         db  = dbs + i;
         ftb = db->functbl;
@@ -254,10 +391,14 @@ int mqi_create_table_trigger(mqi_trigger_cb_t callback, void *user_data)
                 ftb->drop_table_trigger(callback, user_data);
             }
 
+            mqi_unlock();
+
             return -1;
         }
     }
 
+    mqi_unlock();
+
     return 0;
 }
 
@@ -269,13 +410,19 @@ int mqi_create_row_trigger(mqi_handle_t h,
 {
     mqi_db_functbl_t *ftb;
     void             *tbl;
+    int               sts;
 
     MDB_CHECKARG(h != MDB_HANDLE_INVALID && callback, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
+    WRITE_LOCK(-1);
     GET_TABLE(tbl, ftb, h, -1);
 
-    return ftb->create_row_trigger(tbl, callback, user_data, cds);
+    sts = ftb->create_row_trigger(tbl, callback, user_data, cds);
+
+    mqi_unlock();
+
+    return sts;
 }
 
 
@@ -287,13 +434,67 @@ int mqi_create_column_trigger(mqi_handle_t h,
 {
     mqi_db_functbl_t *ftb;
     void             *tbl;
+    int               sts;
+
+    MDB_CHECKARG(h != MDB_HANDLE_INVALID && callback, -1);
+    MDB_PREREQUISITE(dbs && ndb > 0, -1);
+
+    WRITE_LOCK(-1);
+    GET_TABLE(tbl, ftb, h, -1);
+
+    sts = ftb->create_column_trigger(tbl, colidx, callback, user_data, cds);
+
+    mqi_unlock();
+
+    return sts;
+}
+
+
+int mqi_create_batched_row_trigger(mqi_handle_t h,
+                                   mqi_trigger_cb_t callback,
+                                   void *user_data,
+                                   mqi_column_desc_t *cds)
+{
+    mqi_db_functbl_t *ftb;
+    void             *tbl;
+    int               sts;
+
+    MDB_CHECKARG(h != MDB_HANDLE_INVALID && callback, -1);
+    MDB_PREREQUISITE(dbs && ndb > 0, -1);
+
+    WRITE_LOCK(-1);
+    GET_TABLE(tbl, ftb, h, -1);
+
+    sts = ftb->create_batched_row_trigger(tbl, callback, user_data, cds);
+
+    mqi_unlock();
+
+    return sts;
+}
+
+
+int mqi_create_batched_column_trigger(mqi_handle_t h,
+                                      int colidx,
+                                      mqi_trigger_cb_t callback,
+                                      void *user_data,
+                                      mqi_column_desc_t *cds)
+{
+    mqi_db_functbl_t *ftb;
+    void             *tbl;
+    int               sts;
 
     MDB_CHECKARG(h != MDB_HANDLE_INVALID && callback, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
+    WRITE_LOCK(-1);
     GET_TABLE(tbl, ftb, h, -1);
 
-    return ftb->create_column_trigger(tbl, colidx, callback, user_data, cds);
+    sts = ftb->create_batched_column_trigger(tbl, colidx, callback,
+                                             user_data, cds);
+
+    mqi_unlock();
+
+    return sts;
 }
 
 
@@ -307,6 +508,8 @@ int mqi_drop_transaction_trigger(mqi_trigger_cb_t callback, void *user_data)
     MDB_CHECKARG(callback, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
+    WRITE_LOCK(-1);
+
     for (sts = 0, i = 0;  i < ndb;  i++) {
         db  = dbs + i;
         ftb = db->functbl;
@@ -315,6 +518,8 @@ int mqi_drop_transaction_trigger(mqi_trigger_cb_t callback, void *user_data)
             sts = -1;
     }
 
+    mqi_unlock();
+
     return sts;
 }
 
@@ -329,6 +534,8 @@ int mqi_drop_table_trigger(mqi_trigger_cb_t callback, void *user_data)
     MDB_CHECKARG(callback, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
+    WRITE_LOCK(-1);
+
     for (sts = 0, i = 0;  i < ndb;  i++) {
         db  = dbs + i;
         ftb = db->functbl;
@@ -337,6 +544,8 @@ int mqi_drop_table_trigger(mqi_trigger_cb_t callback, void *user_data)
             sts = -1;
     }
 
+    mqi_unlock();
+
     return sts;
 }
 
@@ -347,13 +556,19 @@ int mqi_drop_row_trigger(mqi_handle_t h,
 {
     mqi_db_functbl_t *ftb;
     void             *tbl;
+    int               sts;
 
     MDB_CHECKARG(h != MDB_HANDLE_INVALID && callback, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
+    WRITE_LOCK(-1);
     GET_TABLE(tbl, ftb, h, -1);
 
-    return ftb->drop_row_trigger(tbl, callback, user_data);
+    sts = ftb->drop_row_trigger(tbl, callback, user_data);
+
+    mqi_unlock();
+
+    return sts;
 }
 
 
@@ -364,13 +579,64 @@ int mqi_drop_column_trigger(mqi_handle_t h,
 {
     mqi_db_functbl_t *ftb;
     void             *tbl;
+    int               sts;
+
+    MDB_CHECKARG(h != MDB_HANDLE_INVALID && callback, -1);
+    MDB_PREREQUISITE(dbs && ndb > 0, -1);
+
+    WRITE_LOCK(-1);
+    GET_TABLE(tbl, ftb, h, -1);
+
+    sts = ftb->drop_column_trigger(tbl, colidx, callback, user_data);
+
+    mqi_unlock();
+
+    return sts;
+}
+
+
+int mqi_create_changefeed(mqi_handle_t h,
+                          mqi_trigger_cb_t callback,
+                          void *user_data,
+                          mqi_column_desc_t *cds)
+{
+    mqi_db_functbl_t *ftb;
+    void             *tbl;
+    int               sts;
+
+    MDB_CHECKARG(h != MDB_HANDLE_INVALID && callback, -1);
+    MDB_PREREQUISITE(dbs && ndb > 0, -1);
+
+    WRITE_LOCK(-1);
+    GET_TABLE(tbl, ftb, h, -1);
+
+    sts = ftb->create_changefeed(tbl, callback, user_data, cds);
+
+    mqi_unlock();
+
+    return sts;
+}
+
+
+int mqi_drop_changefeed(mqi_handle_t h,
+                        mqi_trigger_cb_t callback,
+                        void *user_data)
+{
+    mqi_db_functbl_t *ftb;
+    void             *tbl;
+    int               sts;
 
     MDB_CHECKARG(h != MDB_HANDLE_INVALID && callback, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
+    WRITE_LOCK(-1);
     GET_TABLE(tbl, ftb, h, -1);
 
-    return ftb->drop_column_trigger(tbl, colidx, callback, user_data);
+    sts = ftb->drop_changefeed(tbl, callback, user_data);
+
+    mqi_unlock();
+
+    return sts;
 }
 
 
@@ -383,7 +649,15 @@ mqi_handle_t mqi_begin_transaction(void)
     int                i;
 
     MDB_PREREQUISITE(dbs && ndb > 0 && transact_handle, MQI_HANDLE_INVALID);
-    MDB_ASSERT(txdepth < MQI_TXDEPTH_MAX - 1, EOVERFLOW, MQI_HANDLE_INVALID);
+
+    /* released by the commit or rollback of the transaction */
+    WRITE_LOCK(MQI_HANDLE_INVALID);
+
+    if (txdepth >= MQI_TXDEPTH_MAX - 1) {
+        mqi_unlock();
+        errno = EOVERFLOW;
+        return MQI_HANDLE_INVALID;
+    }
 
     depth = txdepth++;
     tx = txstack + depth;
@@ -412,11 +686,21 @@ int mqi_commit_transaction(mqi_handle_t h)
 
     MDB_CHECKARG(h != MQI_HANDLE_INVALID && depth < MQI_TXDEPTH_MAX, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
-    MDB_ASSERT(txdepth > 0 && depth == (uint32_t)txdepth - 1, EBADSLT, -1);
+
+    /* only the thread that started the transaction can end it */
+    MDB_ASSERT(lock_write, EPERM, -1);
+
+    WRITE_LOCK(-1);
 
     tx = txstack + depth;
 
-    MDB_ASSERT(tx->useid == useid, EBADSLT, -1);
+    if (txdepth <= 0 || depth != (uint32_t)txdepth - 1 ||
+        tx->useid != useid)
+    {
+        mqi_unlock();
+        errno = EBADSLT;
+        return -1;
+    }
 
     for (i = 0, err = 0;  i < ndb;  i++) {
         db  = dbs + i;
@@ -428,6 +712,9 @@ int mqi_commit_transaction(mqi_handle_t h)
 
     txdepth--;
 
+    mqi_unlock();
+    mqi_unlock();
+
     return err;
 }
 
@@ -443,11 +730,21 @@ int mqi_rollback_transaction(mqi_handle_t h)
 
     MDB_CHECKARG(h != MQI_HANDLE_INVALID && depth < MQI_TXDEPTH_MAX, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
-    MDB_ASSERT(txdepth > 0 && depth == (uint32_t)txdepth - 1, EBADSLT, -1);
+
+    /* only the thread that started the transaction can end it */
+    MDB_ASSERT(lock_write, EPERM, -1);
+
+    WRITE_LOCK(-1);
 
     tx = txstack + depth;
 
-    MDB_ASSERT(tx->useid == useid, EBADSLT, -1);
+    if (txdepth <= 0 || depth != (uint32_t)txdepth - 1 ||
+        tx->useid != useid)
+    {
+        mqi_unlock();
+        errno = EBADSLT;
+        return -1;
+    }
 
     for (i = 0, err = 0;  i < ndb;  i++) {
         db  = dbs + i;
@@ -459,6 +756,9 @@ int mqi_rollback_transaction(mqi_handle_t h)
 
     txdepth--;
 
+    mqi_unlock();
+    mqi_unlock();
+
     return err;
 }
 
@@ -483,125 +783,321 @@ uint32_t mqi_get_transaction_depth(void)
 }
 
 
-mqi_handle_t mqi_create_table(char *name,
-                              uint32_t flags,
-                              char **index_columns,
-                              mqi_column_def_t *cdefs)
+int mqi_set_persist_directory(const char *path)
 {
     mqi_db_t         *db;
     mqi_db_functbl_t *ftb;
-    mqi_table_t      *tbl = NULL;
-    mqi_handle_t      h = MQI_HANDLE_INVALID;
-    char             *namedup = NULL;
+    int               sts;
     int               i;
 
-    MDB_CHECKARG(name && cdefs, MQI_HANDLE_INVALID);
-    MDB_PREREQUISITE(dbs && ndb > 0, MQI_HANDLE_INVALID);
+    MDB_CHECKARG(path, -1);
+    MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
-    for (i = 0, ftb = NULL;  i < ndb;  i++) {
-        db = dbs + i;
+    WRITE_LOCK(-1);
 
-        if ((DB_TYPE(db) & flags) != 0) {
-            ftb = db->functbl;
-            break;
+    for (sts = 0, i = 0;  i < ndb;  i++) {
+        db  = dbs + i;
+        ftb = db->functbl;
+
+        if ((DB_TYPE(db) & MQI_PERSISTENT)) {
+            if ((sts = ftb->set_persist_directory(path)) < 0)
+                break;
         }
     }
 
-    MDB_ASSERT(ftb, ENOENT, MQI_HANDLE_INVALID);
-
-    if(!(tbl = calloc(1, sizeof(mqi_table_t))))
-        return MQI_HANDLE_INVALID;
+    mqi_unlock();
 
-    tbl->db = db;
-    tbl->handle = NULL;
+    return sts;
+}
 
-    if (!(namedup = strdup(name)))
-        goto cleanup;
 
-    if (!(tbl->handle = ftb->create_table(name, index_columns, cdefs)))
-        goto cleanup;
+mqi_snapshot_t *mqi_open_snapshot(void)
+{
+    mqi_snapshot_t   *s;
+    mqi_db_functbl_t *ftb;
+    int               i;
 
-    if ((h = mdb_handle_add(table_handle, tbl)) == MQI_HANDLE_INVALID)
-        goto cleanup;
+    MDB_PREREQUISITE(dbs && ndb > 0, NULL);
 
-    if (mdb_hash_add(table_name_hash, 0,namedup, NULL + h) < 0) {
-        mdb_handle_delete(table_handle, h);
-        h = MQI_HANDLE_INVALID;
+    if (!(s = calloc(1, sizeof(mqi_snapshot_t)))) {
+        errno = ENOMEM;
+        return NULL;
     }
 
-    ftb->register_table_handle(tbl->handle, h);
-
-    return h;
+    for (i = 0;  i < ndb;  i++) {
+        ftb = dbs[i].functbl;
 
- cleanup:
-    if (tbl) {
-        if (tbl->handle) {
-            mdb_handle_delete(table_handle, h);
-            ftb->drop_table(tbl->handle);
+        if (!(s->snapshot[i] = ftb->open_snapshot())) {
+            mqi_close_snapshot(s);
+            return NULL;
         }
-        mdb_hash_delete(table_name_hash, 0,name);
-        free(namedup);
-        free(tbl);
     }
 
-    return MDB_HANDLE_INVALID;
+    return s;
 }
 
 
-int mqi_create_index(mqi_handle_t h, char **index_columns)
+int mqi_close_snapshot(mqi_snapshot_t *s)
 {
     mqi_db_functbl_t *ftb;
-    void             *tbl;
+    int               i;
 
-    MDB_CHECKARG(h != MDB_HANDLE_INVALID && index_columns, -1);
+    MDB_CHECKARG(s, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
-    GET_TABLE(tbl, ftb, h, -1);
+    for (i = 0;  i < ndb;  i++) {
+        ftb = dbs[i].functbl;
+
+        if (s->snapshot[i])
+            ftb->close_snapshot(s->snapshot[i]);
+    }
+
+    free(s);
 
-    return ftb->create_index(tbl, index_columns);
+    return 0;
 }
 
-int mqi_drop_table(mqi_handle_t h)
+
+uint32_t mqi_get_snapshot_stamp(mqi_snapshot_t *s)
 {
-    mqi_table_t      *tbl;
+    MDB_CHECKARG(s, 0);
+    MDB_PREREQUISITE(dbs && ndb > 0, 0);
+
+    return dbs[0].functbl->get_snapshot_stamp(s->snapshot[0]);
+}
+
+
+int mqi_checkpoint(void)
+{
+    mqi_db_t         *db;
     mqi_db_functbl_t *ftb;
-    char             *name;
-    void             *data;
-    void             *cursor;
-    int               sts;
+    int               i;
+    int               sts = 0;
 
-    MDB_CHECKARG(h != MDB_HANDLE_INVALID, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
-    if (!(tbl = mdb_handle_delete(table_handle, h)))
-        return -1;
-
-    ftb = tbl->db->functbl;
+    WRITE_LOCK(-1);
 
-    MDB_HASH_TABLE_FOR_EACH_WITH_KEY_SAFE(table_name_hash, data,name, cursor) {
+    for (i = 0;  i < ndb;  i++) {
+        db  = dbs + i;
+        ftb = db->functbl;
+
+        if ((DB_TYPE(db) & MQI_PERSISTENT)) {
+            if (ftb->checkpoint() < 0)
+                sts = -1;
+        }
+    }
+
+    mqi_unlock();
+
+    return sts;
+}
+
+
+mqi_handle_t mqi_create_table(char *name,
+                              uint32_t flags,
+                              char **index_columns,
+                              mqi_column_def_t *cdefs)
+{
+    mqi_db_t         *db;
+    mqi_db_functbl_t *ftb;
+    mqi_table_t      *tbl = NULL;
+    mqi_handle_t      h = MQI_HANDLE_INVALID;
+    char             *namedup = NULL;
+    int               i;
+
+    MDB_CHECKARG(name && cdefs, MQI_HANDLE_INVALID);
+    MDB_PREREQUISITE(dbs && ndb > 0, MQI_HANDLE_INVALID);
+
+    for (i = 0, ftb = NULL;  i < ndb;  i++) {
+        db = dbs + i;
+
+        if ((DB_TYPE(db) & flags) != 0) {
+            ftb = db->functbl;
+            break;
+        }
+    }
+
+    MDB_ASSERT(ftb, ENOENT, MQI_HANDLE_INVALID);
+
+    WRITE_LOCK(MQI_HANDLE_INVALID);
+
+    if(!(tbl = calloc(1, sizeof(mqi_table_t)))) {
+        mqi_unlock();
+        return MQI_HANDLE_INVALID;
+    }
+
+    tbl->db = db;
+    tbl->handle = NULL;
+
+    if ((flags & MQI_TABLE_TYPE_MASK) == MQI_PERSISTENT)
+        tbl->flags = MQI_PERSISTENT;
+    else
+        tbl->flags = MQI_TEMPORARY;
+
+    if (!(namedup = strdup(name)))
+        goto cleanup;
+
+    if (!(tbl->handle = ftb->create_table(name, flags, index_columns,
+                                          cdefs)))
+        goto cleanup;
+
+    handle_lock();
+    h = mdb_handle_add(table_handle, tbl);
+    handle_unlock();
+
+    if (h == MQI_HANDLE_INVALID)
+        goto cleanup;
+
+    if (mdb_hash_add(table_name_hash, 0,namedup, NULL + h) < 0) {
+        handle_lock();
+        mdb_handle_delete(table_handle, h);
+        handle_unlock();
+        h = MQI_HANDLE_INVALID;
+    }
+
+    ftb->register_table_handle(tbl->handle, h);
+
+    mqi_unlock();
+
+    return h;
+
+ cleanup:
+    if (tbl) {
+        if (tbl->handle) {
+            handle_lock();
+            mdb_handle_delete(table_handle, h);
+            ftb->drop_table(tbl->handle);
+            handle_unlock();
+        }
+        mdb_hash_delete(table_name_hash, 0,name);
+        free(namedup);
+        free(tbl);
+    }
+
+    mqi_unlock();
+
+    return MDB_HANDLE_INVALID;
+}
+
+
+int mqi_create_index(mqi_handle_t h, char **index_columns)
+{
+    mqi_db_functbl_t *ftb;
+    void             *tbl;
+    int               sts;
+
+    MDB_CHECKARG(h != MDB_HANDLE_INVALID && index_columns, -1);
+    MDB_PREREQUISITE(dbs && ndb > 0, -1);
+
+    WRITE_LOCK(-1);
+    GET_TABLE(tbl, ftb, h, -1);
+
+    sts = ftb->create_index(tbl, index_columns);
+
+    mqi_unlock();
+
+    return sts;
+}
+
+int mqi_create_secondary_index(mqi_handle_t      h,
+                               const char       *name,
+                               mqi_index_type_t  type,
+                               char            **index_columns)
+{
+    mqi_db_functbl_t *ftb;
+    void             *tbl;
+    int               sts;
+
+    MDB_CHECKARG(h != MDB_HANDLE_INVALID && name && index_columns, -1);
+    MDB_PREREQUISITE(dbs && ndb > 0, -1);
+
+    WRITE_LOCK(-1);
+    GET_TABLE(tbl, ftb, h, -1);
+
+    sts = ftb->create_secondary_index(tbl, name, type, index_columns);
+
+    mqi_unlock();
+
+    return sts;
+}
+
+int mqi_drop_secondary_index(mqi_handle_t h, const char *name)
+{
+    mqi_db_functbl_t *ftb;
+    void             *tbl;
+    int               sts;
+
+    MDB_CHECKARG(h != MDB_HANDLE_INVALID && name, -1);
+    MDB_PREREQUISITE(dbs && ndb > 0, -1);
+
+    WRITE_LOCK(-1);
+    GET_TABLE(tbl, ftb, h, -1);
+
+    sts = ftb->drop_secondary_index(tbl, name);
+
+    mqi_unlock();
+
+    return sts;
+}
+
+int mqi_drop_table(mqi_handle_t h)
+{
+    mqi_table_t      *tbl;
+    mqi_db_functbl_t *ftb;
+    char             *name;
+    void             *data;
+    void             *cursor;
+    int               sts;
+
+    MDB_CHECKARG(h != MDB_HANDLE_INVALID, -1);
+    MDB_PREREQUISITE(dbs && ndb > 0, -1);
+
+    WRITE_LOCK(-1);
+    handle_lock();
+
+    if (!(tbl = mdb_handle_delete(table_handle, h))) {
+        handle_unlock();
+        mqi_unlock();
+        return -1;
+    }
+
+    ftb = tbl->db->functbl;
+    sts = -1;
+
+    MDB_HASH_TABLE_FOR_EACH_WITH_KEY_SAFE(table_name_hash, data,name, cursor) {
         if ((mqi_handle_t)(data - NULL) == h) {
             mdb_hash_delete(table_name_hash, 0,name);
             sts = ftb->drop_table(tbl->handle);
             free(name);
             free(tbl);
-            return sts;
+            break;
         }
     }
 
-    return -1;
+    handle_unlock();
+    mqi_unlock();
+
+    return sts;
 }
 
 int mqi_describe(mqi_handle_t h, mqi_column_def_t *defs, int len)
 {
     mqi_db_functbl_t *ftb;
     void             *tbl;
+    int               sts;
 
     MDB_CHECKARG(h != MDB_HANDLE_INVALID && defs && len > 0, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
+    READ_LOCK(-1);
     GET_TABLE(tbl, ftb, h, -1);
 
-    return ftb->describe(tbl, defs, len);
+    sts = ftb->describe(tbl, defs, len);
+
+    mqi_unlock();
+
+    return sts;
 }
 
 int mqi_insert_into(mqi_handle_t         h,
@@ -611,13 +1107,44 @@ int mqi_insert_into(mqi_handle_t         h,
 {
     mqi_db_functbl_t *ftb;
     void             *tbl;
+    int               sts;
 
     MDB_CHECKARG(h != MDB_HANDLE_INVALID && cds && data && data[0], -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
+    WRITE_LOCK(-1);
     GET_TABLE(tbl, ftb, h, -1);
 
-    return ftb->insert_into(tbl, ignore, cds, data);
+    sts = ftb->insert_into(tbl, ignore, cds, data);
+
+    mqi_unlock();
+
+    return sts;
+}
+
+int mqi_insert_bulk(mqi_handle_t       h,
+                    int                mode,
+                    mqi_column_desc_t *cds,
+                    void              *rows,
+                    int                rowsize,
+                    int                nrow)
+{
+    mqi_db_functbl_t *ftb;
+    void             *tbl;
+    int               sts;
+
+    MDB_CHECKARG(h != MDB_HANDLE_INVALID && cds && rows &&
+                 rowsize > 0 && nrow > 0, -1);
+    MDB_PREREQUISITE(dbs && ndb > 0, -1);
+
+    WRITE_LOCK(-1);
+    GET_TABLE(tbl, ftb, h, -1);
+
+    sts = ftb->insert_bulk(tbl, mode, cds, rows, rowsize, nrow);
+
+    mqi_unlock();
+
+    return sts;
 }
 
 int mqi_select(mqi_handle_t       h,
@@ -629,14 +1156,80 @@ int mqi_select(mqi_handle_t       h,
 {
     mqi_db_functbl_t *ftb;
     void             *tbl;
+    int               sts;
 
     MDB_CHECKARG(h != MDB_HANDLE_INVALID && cds &&
                  rows && rowsize > 0 && dim > 0, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
+    READ_LOCK(-1);
     GET_TABLE(tbl, ftb, h, -1);
 
-    return ftb->select(tbl, cond, cds, rows, rowsize, dim);
+    sts = ftb->select(tbl, cond, cds, rows, rowsize, dim);
+
+    mqi_unlock();
+
+    return sts;
+}
+
+int mqi_select_query(mqi_handle_t       h,
+                     mqi_cond_entry_t  *cond,
+                     mqi_column_desc_t *cds,
+                     mqi_query_t       *query,
+                     void              *rows,
+                     int                rowsize,
+                     int                dim)
+{
+    mqi_db_functbl_t *ftb;
+    void             *tbl;
+    int               sts;
+
+    MDB_CHECKARG(h != MDB_HANDLE_INVALID && cds &&
+                 rows && rowsize > 0 && dim > 0, -1);
+    MDB_PREREQUISITE(dbs && ndb > 0, -1);
+
+    READ_LOCK(-1);
+    GET_TABLE(tbl, ftb, h, -1);
+
+    sts = ftb->select_query(tbl, cond, cds, query, rows, rowsize, dim);
+
+    mqi_unlock();
+
+    return sts;
+}
+
+int mqi_select_snapshot(mqi_snapshot_t    *s,
+                        mqi_handle_t       h,
+                        mqi_cond_entry_t  *cond,
+                        mqi_column_desc_t *cds,
+                        void              *rows,
+                        int                rowsize,
+                        int                dim)
+{
+    mqi_table_t      *t;
+    mqi_db_functbl_t *ftb;
+    int               sts;
+
+    MDB_CHECKARG(s && h != MDB_HANDLE_INVALID && cds &&
+                 rows && rowsize > 0 && dim > 0, -1);
+    MDB_PREREQUISITE(dbs && ndb > 0, -1);
+
+    handle_lock();
+
+    if (!(t = mdb_handle_get_data(table_handle, h)) || !t->db) {
+        handle_unlock();
+        errno = ENOENT;
+        return -1;
+    }
+
+    ftb = t->db->functbl;
+
+    sts = ftb->select_snapshot(t->handle, s->snapshot[t->db - dbs],
+                               cond, cds, rows, rowsize, dim);
+
+    handle_unlock();
+
+    return sts;
 }
 
 int mqi_select_by_index(mqi_handle_t       h,
@@ -646,13 +1239,177 @@ int mqi_select_by_index(mqi_handle_t       h,
 {
     mqi_db_functbl_t *ftb;
     void             *tbl;
+    int               sts;
 
     MDB_CHECKARG(h != MDB_HANDLE_INVALID && idxvars && cds && result, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
+    READ_LOCK(-1);
     GET_TABLE(tbl, ftb, h, -1);
 
-    return ftb->select_by_index(tbl, idxvars, cds, result);
+    sts = ftb->select_by_index(tbl, idxvars, cds, result);
+
+    mqi_unlock();
+
+    return sts;
+}
+
+int mqi_select_by_secondary_index(mqi_handle_t       h,
+                                  const char        *name,
+                                  mqi_variable_t    *idxvars,
+                                  mqi_column_desc_t *cds,
+                                  void              *results,
+                                  int                size,
+                                  int                dim)
+{
+    mqi_db_functbl_t *ftb;
+    void             *tbl;
+    int               sts;
+
+    MDB_CHECKARG(h != MDB_HANDLE_INVALID && name && idxvars && cds &&
+                 results && size > 0 && dim > 0, -1);
+    MDB_PREREQUISITE(dbs && ndb > 0, -1);
+
+    READ_LOCK(-1);
+    GET_TABLE(tbl, ftb, h, -1);
+
+    sts = ftb->select_by_secondary_index(tbl, name, idxvars, cds,
+                                         results, size, dim);
+
+    mqi_unlock();
+
+    return sts;
+}
+
+int mqi_select_join(mqi_handle_t       left,
+                    int                lcol,
+                    mqi_handle_t       right,
+                    int                rcol,
+                    mqi_cond_entry_t  *cond,
+                    mqi_column_desc_t *cds,
+                    void              *results,
+                    int                size,
+                    int                dim)
+{
+    mqi_db_functbl_t *lftb, *rftb;
+    void             *ltbl, *rtbl;
+    int               sts;
+
+    MDB_CHECKARG(left != MDB_HANDLE_INVALID && right != MDB_HANDLE_INVALID &&
+                 cds && results && size > 0 && dim > 0, -1);
+    MDB_PREREQUISITE(dbs && ndb > 0, -1);
+
+    READ_LOCK(-1);
+    GET_TABLE(ltbl, lftb, left, -1);
+    GET_TABLE(rtbl, rftb, right, -1);
+
+    if (lftb != rftb) {
+        /* both tables need to be in the same database */
+        errno = EINVAL;
+        mqi_unlock();
+        return -1;
+    }
+
+    sts = lftb->select_join(ltbl, lcol, rtbl, rcol, cond, cds,
+                            results, size, dim);
+
+    mqi_unlock();
+
+    return sts;
+}
+
+mqi_cursor_t *mqi_select_cursor_open(mqi_handle_t       h,
+                                     mqi_cond_entry_t  *cond,
+                                     mqi_column_desc_t *cds)
+{
+    mqi_db_functbl_t *ftb;
+    void             *tbl;
+    mqi_cursor_t     *cur;
+
+    MDB_CHECKARG(h != MDB_HANDLE_INVALID, NULL);
+    MDB_PREREQUISITE(dbs && ndb > 0, NULL);
+
+    READ_LOCK(NULL);
+    GET_TABLE(tbl, ftb, h, NULL);
+
+    if (!(cur = calloc(1, sizeof(*cur)))) {
+        errno = ENOMEM;
+        mqi_unlock();
+        return NULL;
+    }
+
+    if (!(cur->cursor = ftb->cursor_open(tbl, cond, cds))) {
+        free(cur);
+        mqi_unlock();
+        return NULL;
+    }
+
+    cur->ftb = ftb;
+
+    /* the read lock is released when the cursor is closed */
+    return cur;
+}
+
+int mqi_select_cursor_next(mqi_cursor_t *cur, void *row)
+{
+    MDB_CHECKARG(cur, -1);
+
+    return cur->ftb->cursor_next(cur->cursor, row);
+}
+
+int mqi_select_cursor_read(mqi_cursor_t *cur, void *row)
+{
+    MDB_CHECKARG(cur && row, -1);
+
+    return cur->ftb->cursor_read(cur->cursor, row);
+}
+
+const void *mqi_select_cursor_get_column(mqi_cursor_t *cur, int cindex)
+{
+    MDB_CHECKARG(cur, NULL);
+
+    return cur->ftb->cursor_get_column(cur->cursor, cindex);
+}
+
+int mqi_select_cursor_close(mqi_cursor_t *cur)
+{
+    int sts;
+
+    MDB_CHECKARG(cur, -1);
+
+    sts = cur->ftb->cursor_close(cur->cursor);
+
+    free(cur);
+    mqi_unlock();
+
+    return sts;
+}
+
+int mqi_select_visit(mqi_handle_t       h,
+                     mqi_cond_entry_t  *cond,
+                     mqi_column_desc_t *cds,
+                     mqi_select_cb_t    cb,
+                     void              *user_data)
+{
+    mqi_cursor_t *cur;
+    int           nrow;
+    int           sts;
+
+    MDB_CHECKARG(cb, -1);
+
+    if (!(cur = mqi_select_cursor_open(h, cond, cds)))
+        return -1;
+
+    for (nrow = 0;  (sts = mqi_select_cursor_next(cur, NULL)) > 0;  ) {
+        nrow++;
+
+        if (!cb(cur, user_data))
+            break;
+    }
+
+    mqi_select_cursor_close(cur);
+
+    return sts < 0 ? -1 : nrow;
 }
 
 int mqi_update(mqi_handle_t       h,
@@ -662,26 +1419,57 @@ int mqi_update(mqi_handle_t       h,
 {
     mqi_db_functbl_t *ftb;
     void             *tbl;
+    int               sts;
 
     MDB_CHECKARG(h != MDB_HANDLE_INVALID && cds && data, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
+    WRITE_LOCK(-1);
     GET_TABLE(tbl, ftb, h, -1);
 
-    return ftb->update(tbl, cond, cds, data);
+    sts = ftb->update(tbl, cond, cds, data);
+
+    mqi_unlock();
+
+    return sts;
 }
 
 int mqi_delete_from(mqi_handle_t h, mqi_cond_entry_t *cond)
 {
     mqi_db_functbl_t *ftb;
     void             *tbl;
+    int               sts;
 
     MDB_CHECKARG(h != MDB_HANDLE_INVALID, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
+    WRITE_LOCK(-1);
     GET_TABLE(tbl, ftb, h, -1);
 
-    return ftb->delete_from(tbl, cond);
+    sts = ftb->delete_from(tbl, cond);
+
+    mqi_unlock();
+
+    return sts;
+}
+
+int mqi_explain(mqi_handle_t h, mqi_cond_entry_t *cond, char *buf, int len)
+{
+    mqi_db_functbl_t *ftb;
+    void             *tbl;
+    int               sts;
+
+    MDB_CHECKARG(h != MDB_HANDLE_INVALID && buf && len > 0, -1);
+    MDB_PREREQUISITE(dbs && ndb > 0, -1);
+
+    READ_LOCK(-1);
+    GET_TABLE(tbl, ftb, h, -1);
+
+    sts = ftb->explain(tbl, cond, buf, len);
+
+    mqi_unlock();
+
+    return sts;
 }
 
 mqi_handle_t mqi_get_table_handle(char *table_name)
@@ -691,7 +1479,9 @@ mqi_handle_t mqi_get_table_handle(char *table_name)
     MDB_CHECKARG(table_name, MQI_HANDLE_INVALID);
     MDB_PREREQUISITE(dbs && ndb > 0, MQI_HANDLE_INVALID);
 
+    READ_LOCK(MQI_HANDLE_INVALID);
     data = mdb_hash_get_data(table_name_hash, 0,table_name);
+    mqi_unlock();
 
     if (data != NULL)
         return data - NULL;
@@ -704,91 +1494,171 @@ int mqi_get_column_index(mqi_handle_t h, char *column_name)
 {
     mqi_db_functbl_t *ftb;
     void             *tbl;
+    int               sts;
 
     MDB_CHECKARG(h != MDB_HANDLE_INVALID && column_name, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
+    READ_LOCK(-1);
     GET_TABLE(tbl, ftb, h, -1);
 
-    return ftb->get_column_index(tbl, column_name);
+    sts = ftb->get_column_index(tbl, column_name);
+
+    mqi_unlock();
+
+    return sts;
 }
 
 int mqi_get_table_size(mqi_handle_t h)
 {
     mqi_db_functbl_t *ftb;
     void             *tbl;
+    int               sts;
 
     MDB_CHECKARG(h != MDB_HANDLE_INVALID, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
+    READ_LOCK(-1);
     GET_TABLE(tbl, ftb, h, -1);
 
-    return  ftb->get_table_size(tbl);
+    sts = ftb->get_table_size(tbl);
+
+    mqi_unlock();
+
+    return sts;
 }
 
 uint32_t mqi_get_table_stamp(mqi_handle_t h)
 {
     mqi_db_functbl_t *ftb;
     void             *tbl;
+    uint32_t          stamp;
 
     MDB_CHECKARG(h != MDB_HANDLE_INVALID, MQI_STAMP_NONE);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
+    READ_LOCK(-1);
     GET_TABLE(tbl, ftb, h, -1);
 
-    return  ftb->get_table_stamp(tbl);
+    stamp = ftb->get_table_stamp(tbl);
+
+    mqi_unlock();
+
+    return stamp;
+}
+
+uint32_t mqi_get_column_stamp(mqi_handle_t h, mqi_bitfld_t *columns)
+{
+    mqi_db_functbl_t *ftb;
+    void             *tbl;
+    uint32_t          stamp;
+
+    MDB_CHECKARG(h != MDB_HANDLE_INVALID, MQI_STAMP_NONE);
+    MDB_PREREQUISITE(dbs && ndb > 0, MQI_STAMP_NONE);
+
+    READ_LOCK(MQI_STAMP_NONE);
+    GET_TABLE(tbl, ftb, h, MQI_STAMP_NONE);
+
+    stamp = ftb->get_column_stamp(tbl, columns);
+
+    mqi_unlock();
+
+    return stamp;
+}
+
+uint32_t mqi_get_key_stamp(mqi_handle_t h, mqi_variable_t *key)
+{
+    mqi_db_functbl_t *ftb;
+    void             *tbl;
+    uint32_t          stamp;
+
+    MDB_CHECKARG(h != MDB_HANDLE_INVALID && key, MQI_STAMP_NONE);
+    MDB_PREREQUISITE(dbs && ndb > 0, MQI_STAMP_NONE);
+
+    READ_LOCK(MQI_STAMP_NONE);
+    GET_TABLE(tbl, ftb, h, MQI_STAMP_NONE);
+
+    stamp = ftb->get_key_stamp(tbl, key);
+
+    mqi_unlock();
+
+    return stamp;
 }
 
 char *mqi_get_column_name(mqi_handle_t h, int colidx)
 {
     mqi_db_functbl_t *ftb;
     void             *tbl;
+    char             *name;
 
     MDB_CHECKARG(h != MDB_HANDLE_INVALID && colidx >= 0, NULL);
     MDB_PREREQUISITE(dbs && ndb > 0, NULL);
 
+    READ_LOCK(NULL);
     GET_TABLE(tbl, ftb, h, NULL);
 
-    return  ftb->get_column_name(tbl, colidx);
+    name = ftb->get_column_name(tbl, colidx);
+
+    mqi_unlock();
+
+    return name;
 }
 
 mqi_data_type_t mqi_get_column_type(mqi_handle_t h, int colidx)
 {
     mqi_db_functbl_t *ftb;
     void             *tbl;
+    mqi_data_type_t   type;
 
     MDB_CHECKARG(h != MDB_HANDLE_INVALID && colidx >= 0, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
+    READ_LOCK(-1);
     GET_TABLE(tbl, ftb, h, -1);
 
-    return  ftb->get_column_type(tbl, colidx);
+    type = ftb->get_column_type(tbl, colidx);
+
+    mqi_unlock();
+
+    return type;
 }
 
 int mqi_get_column_size(mqi_handle_t h, int colidx)
 {
     mqi_db_functbl_t *ftb;
     void             *tbl;
+    int               sts;
 
     MDB_CHECKARG(h != MDB_HANDLE_INVALID && colidx >= 0, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
+    READ_LOCK(-1);
     GET_TABLE(tbl, ftb, h, -1);
 
-    return  ftb->get_column_size(tbl, colidx);
+    sts = ftb->get_column_size(tbl, colidx);
+
+    mqi_unlock();
+
+    return sts;
 }
 
 int mqi_print_rows(mqi_handle_t h, char *buf, int len)
 {
     mqi_db_functbl_t *ftb;
     void             *tbl;
+    int               sts;
 
     MDB_CHECKARG(h != MDB_HANDLE_INVALID && buf && len > 0, -1);
     MDB_PREREQUISITE(dbs && ndb > 0, -1);
 
+    READ_LOCK(-1);
     GET_TABLE(tbl, ftb, h, -1);
 
-    return ftb->print_rows(tbl, buf, len);
+    sts = ftb->print_rows(tbl, buf, len);
+
+    mqi_unlock();
+
+    return sts;
 }
 
 
@@ -824,6 +1694,28 @@ static int db_register(const char       *engine,
     return 0;
 }
 
+static void handle_lock(void)
+{
+    pthread_once(&tblock_once, init_handle_lock);
+    pthread_mutex_lock(&tblock);
+}
+
+static void handle_unlock(void)
+{
+    pthread_mutex_unlock(&tblock);
+}
+
+/* recursive, as dropping a table fires triggers that may select */
+static void init_handle_lock(void)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&tblock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
 /*
  * Local Variables:
  * c-basic-offset: 4
@@ -0,0 +1,647 @@
+/*
+ * Copyright (c) 2012, Intel Corporation
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *  * Neither the name of Intel Corporation nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <alloca.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include <murphy-db/assert.h>
+#include <murphy-db/mqi.h>
+#include <murphy-db/mql.h>
+#include <murphy-db/hash.h>
+#include <murphy-db/list.h>
+#include "mql-parser.h"
+
+#ifndef MQL_STATEMENT_CACHE_MAX
+#define MQL_STATEMENT_CACHE_MAX     64
+#endif
+
+#ifndef MQL_STATEMENT_CACHE_CHAINS
+#define MQL_STATEMENT_CACHE_CHAINS  64
+#endif
+
+typedef struct cache_entry_s  cache_entry_t;
+typedef struct params_s       params_t;
+
+struct cache_entry_s {
+    mdb_dlist_t      link;       /* LRU list; most recently used first */
+    char            *key;        /* normalized statement text */
+    mql_statement_t *statement;  /* NULL if the text can't be precompiled */
+    int              busy;       /* executions in progress */
+    bool             stale;      /* dropped from the cache while busy */
+};
+
+struct params_s {
+    int              nparam;
+    mqi_data_type_t  types[MQL_PARAMETER_MAX];
+    union {
+        char        *varchar;
+        int32_t      integer;
+        uint32_t     unsignd;
+        double       floating;
+    }                values[MQL_PARAMETER_MAX];
+};
+
+
+static bool has_verb(const char *, const char **);
+static bool watch_tables(void);
+static mql_result_t *exec_string(mql_result_type_t, const char *, bool);
+static int normalize(const char *, char *, char *, params_t *);
+static mql_result_t *exec_cached(cache_entry_t *, params_t *,
+                                 mql_result_type_t, bool);
+static cache_entry_t *entry_create(const char *, mql_statement_t *);
+static void entry_touch(cache_entry_t *);
+static void entry_drop(cache_entry_t *);
+static void entry_free(cache_entry_t *);
+static void evict(int);
+static void flush(void);
+static void table_event_cb(mqi_event_t *, void *);
+
+static mdb_hash_t *entries;
+static MDB_DLIST_HEAD(lru);
+static int         nentry;
+static int         maxentry = MQL_STATEMENT_CACHE_MAX;
+static bool        watching;
+static uint64_t    hits;
+static uint64_t    misses;
+static uint64_t    evictions;
+static uint64_t    invalidations;
+
+/*
+ * protects all of the above; never held while a statement is compiled
+ * or executed, as those can fire triggers that come back here
+ */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *cacheable_verbs[] = { "select", "update", "delete", NULL };
+static const char *query_verbs[] = {
+    "select", "show", "describe", "explain", NULL
+};
+
+
+mql_result_t *mql_exec_string(mql_result_type_t result_type, const char *str)
+{
+    mql_result_t *r;
+    bool          cached;
+    int           sts;
+
+    if (result_type == mql_result_dontcare)
+        result_type = mql_result_string;
+
+    MDB_CHECKARG((result_type == mql_result_event ||
+                  result_type == mql_result_columns  ||
+                  result_type == mql_result_rows ||
+                  result_type == mql_result_string  ) &&
+                 str, NULL);
+
+    /* registering for table events needs the write lock, so do it first */
+    cached = has_verb(str, cacheable_verbs) && watch_tables();
+
+    if (has_verb(str, query_verbs))
+        sts = mqi_read_lock();
+    else
+        sts = mqi_write_lock();
+
+    if (sts < 0) {
+        return mql_result_error_create(errno, "can't lock database: %s",
+                                       strerror(errno));
+    }
+
+    r = exec_string(result_type, str, cached);
+
+    mqi_unlock();
+
+    return r;
+}
+
+
+int mql_get_cache_stats(mql_cache_stats_t *stats)
+{
+    MDB_CHECKARG(stats, -1);
+
+    pthread_mutex_lock(&lock);
+
+    stats->size          = nentry;
+    stats->max           = maxentry;
+    stats->hits          = hits;
+    stats->misses        = misses;
+    stats->evictions     = evictions;
+    stats->invalidations = invalidations;
+
+    pthread_mutex_unlock(&lock);
+
+    return 0;
+}
+
+
+int mql_set_cache_size(int size)
+{
+    MDB_CHECKARG(size >= 0, -1);
+
+    pthread_mutex_lock(&lock);
+
+    maxentry = size;
+    evict(size);
+
+    pthread_mutex_unlock(&lock);
+
+    return 0;
+}
+
+
+void mql_flush_cache(void)
+{
+    pthread_mutex_lock(&lock);
+    flush();
+    pthread_mutex_unlock(&lock);
+}
+
+
+static bool has_verb(const char *str, const char **verbs)
+{
+    const char *verb;
+    size_t      len;
+    int         i;
+
+    while (isspace(*str))
+        str++;
+
+    for (i = 0;  (verb = verbs[i]) != NULL;  i++) {
+        len = strlen(verb);
+
+        if (!strncasecmp(str, verb, len) && isspace(str[len]))
+            return true;
+    }
+
+    return false;
+}
+
+
+static bool watch_tables(void)
+{
+    bool w;
+
+    pthread_mutex_lock(&lock);
+    w = watching;
+    pthread_mutex_unlock(&lock);
+
+    if (w)
+        return true;
+
+    /* without table events we could not notice stale statements */
+    if (mqi_write_lock() < 0)
+        return false;
+
+    pthread_mutex_lock(&lock);
+    w = watching;
+    pthread_mutex_unlock(&lock);
+
+    if (!w && mqi_create_table_trigger(table_event_cb, NULL) == 0) {
+        pthread_mutex_lock(&lock);
+        watching = w = true;
+        pthread_mutex_unlock(&lock);
+    }
+
+    mqi_unlock();
+
+    return w;
+}
+
+
+static mql_result_t *exec_string(mql_result_type_t  result_type,
+                                 const char        *str,
+                                 bool               cacheable)
+{
+    cache_entry_t   *e;
+    mql_statement_t *st;
+    mql_result_t    *r;
+    params_t         params;
+    size_t           len;
+    char            *key;
+    char            *pool;
+
+    if (!cacheable)
+        return mql_exec_string_parse(result_type, str);
+
+    len  = strlen(str);
+    key  = alloca(len * 2 + 1);
+    pool = alloca(len + 1);
+
+    if (normalize(str, key, pool, &params) < 0)
+        return mql_exec_string_parse(result_type, str);
+
+    pthread_mutex_lock(&lock);
+
+    if (!maxentry) {
+        pthread_mutex_unlock(&lock);
+        return mql_exec_string_parse(result_type, str);
+    }
+
+    if (!entries) {
+        entries = MDB_HASH_TABLE_CREATE(string, MQL_STATEMENT_CACHE_CHAINS);
+
+        if (!entries) {
+            pthread_mutex_unlock(&lock);
+            return mql_exec_string_parse(result_type, str);
+        }
+    }
+
+    if ((e = mdb_hash_get_data(entries, 0, key))) {
+        entry_touch(e);
+
+        /*
+         * a busy entry has its parameters bound by another call (eg. we
+         * are called from a trigger fired by the very same statement, or
+         * the statement runs in another thread)
+         */
+        if (e->statement && !e->busy) {
+            e->busy++;
+            pthread_mutex_unlock(&lock);
+
+            if ((r = exec_cached(e, &params, result_type, true)))
+                return r;
+
+            pthread_mutex_lock(&lock);
+        }
+
+        misses++;
+        pthread_mutex_unlock(&lock);
+    }
+    else {
+        misses++;
+        pthread_mutex_unlock(&lock);
+
+        st = mql_precompile(key);
+
+        pthread_mutex_lock(&lock);
+
+        /* fails if another thread has cached the statement meanwhile */
+        if (!(e = entry_create(key, st))) {
+            pthread_mutex_unlock(&lock);
+            mql_statement_free(st);
+        }
+        else if (st) {
+            e->busy++;
+            pthread_mutex_unlock(&lock);
+
+            /* no need to parse the same thing twice */
+            if ((r = exec_cached(e, &params, result_type, false)))
+                return r;
+        }
+        else
+            pthread_mutex_unlock(&lock);
+    }
+
+    return mql_exec_string_parse(result_type, str);
+}
+
+
+/*
+ * Produce the cache key of a statement: whitespace is collapsed and the
+ * literals of the WHERE clause (but not of a LIMIT following it) are
+ * replaced by parameters, the values of which are collected into
+ * 'params'. Strings are copied into 'pool', a buffer at least as long
+ * as the statement. 'key' needs to be twice as long, as a single digit
+ * literal is turned into a two character parameter.
+ */
+static int normalize(const char *str, char *key, char *pool, params_t *params)
+{
+    const char *s = str;
+    const char *e;
+    char       *k = key;
+    bool        where = false;
+    int         sign;
+    int         idx;
+    size_t      len;
+
+    params->nparam = 0;
+
+    while (*s) {
+        if (isspace(*s)) {
+            while (isspace(*s))
+                s++;
+            if (k > key && *s)
+                *k++ = ' ';
+            continue;
+        }
+
+        if (*s == '%' || *s == ';')
+            return -1;    /* parameters or multiple statements: no caching */
+
+        if (isalpha(*s)) {
+            for (e = s + 1;  isalnum(*e) || *e == '_' || *e == '-';  e++)
+                ;
+            while (e[-1] == '_' || e[-1] == '-')
+                e--;
+
+            len = e - s;
+
+            if (len == 5 && !strncasecmp(s, "where", 5))
+                where = true;
+            else if (len == 5 && (!strncasecmp(s, "group", 5) ||
+                                  !strncasecmp(s, "order", 5) ||
+                                  !strncasecmp(s, "limit", 5)))
+                where = false;
+
+            memcpy(k, s, len);
+            k += len;
+            s  = e;
+            continue;
+        }
+
+        if (!where) {
+            if (*s == '\'' || *s == '"') {
+                if (!(e = strchr(s + 1, *s)))
+                    return -1;
+
+                len = e - s + 1;
+                memcpy(k, s, len);
+                k += len;
+                s  = e + 1;
+            }
+            else
+                *k++ = *s++;
+            continue;
+        }
+
+        if (*s != '\'' && *s != '"' && !isdigit(*s)) {
+            if (*s != '+' && *s != '-')
+                *k++ = *s++;
+            else {
+                for (e = s + 1;  isspace(*e);  e++)
+                    ;
+                if (!isdigit(*e))
+                    *k++ = *s++;
+                else {
+                    sign = (*s == '-') ? -1 : 1;
+                    s = e;
+                    goto number;
+                }
+            }
+            continue;
+        }
+
+        sign = 0;
+
+    number:
+        if ((idx = params->nparam++) >= MQL_PARAMETER_MAX)
+            return -1;
+
+        if (*s == '\'' || *s == '"') {
+            if (!(e = strchr(s + 1, *s)))
+                return -1;
+
+            len = e - (s + 1);
+            memcpy(pool, s + 1, len);
+            pool[len] = '\0';
+
+            params->types[idx] = mqi_varchar;
+            params->values[idx].varchar = pool;
+
+            pool += len + 1;
+            s = e + 1;
+            k += sprintf(k, "%%s");
+            continue;
+        }
+
+        for (e = s;  isdigit(*e);  e++)
+            ;
+        if (*e == '.') {
+            for (e++;  isdigit(*e);  e++)
+                ;
+        }
+
+        if (isalpha(*e) || *e == '_')
+            return -1;    /* not a literal the scanner would accept */
+
+        if (memchr(s, '.', e - s)) {
+            params->types[idx] = mqi_floating;
+            params->values[idx].floating = strtod(s, NULL);
+            if (sign)
+                params->values[idx].floating *= sign;
+            k += sprintf(k, "%%f");
+        }
+        else if (sign) {
+            params->types[idx] = mqi_integer;
+            params->values[idx].integer = sign * strtoll(s, NULL, 10);
+            k += sprintf(k, "%%d");
+        }
+        else {
+            params->types[idx] = mqi_unsignd;
+            params->values[idx].unsignd = strtoll(s, NULL, 10);
+            k += sprintf(k, "%%u");
+        }
+
+        s = e;
+    }
+
+    *k = '\0';
+
+    return 0;
+}
+
+
+/*
+ * Execute an entry the caller has marked busy, then release it. Only
+ * the release needs the cache lock.
+ */
+static mql_result_t *exec_cached(cache_entry_t     *e,
+                                 params_t          *params,
+                                 mql_result_type_t  type,
+                                 bool               hit)
+{
+    mql_statement_t      *st = e->statement;
+    mql_statement_type_t  stype = st->type;
+    mql_result_t         *r = NULL;
+    int                   sts;
+    int                   i;
+
+    for (i = 0, sts = 0;  i < params->nparam && sts == 0;  i++) {
+        switch (params->types[i]) {
+        case mqi_varchar:
+            sts = mql_bind_value(st, i+1, mqi_varchar,
+                                 params->values[i].varchar);
+            break;
+        case mqi_integer:
+            sts = mql_bind_value(st, i+1, mqi_integer,
+                                 params->values[i].integer);
+            break;
+        case mqi_unsignd:
+            sts = mql_bind_value(st, i+1, mqi_unsignd,
+                                 params->values[i].unsignd);
+            break;
+        case mqi_floating:
+            sts = mql_bind_value(st, i+1, mqi_floating,
+                                 params->values[i].floating);
+            break;
+        default:
+            sts = -1;
+            break;
+        }
+    }
+
+    if (sts == 0) {
+        /* the parser produces string results for anything but rows */
+        if (type != mql_result_rows)
+            type = mql_result_string;
+
+        r = mql_exec_statement(type, st);
+
+        /* precompiled updates and deletes report the row count as 'error' */
+        if (r && stype != mql_statement_select &&
+            r->type == mql_result_error && !mql_result_error_get_code(r))
+        {
+            mql_result_free(r);
+            r = mql_result_success_create();
+        }
+    }
+
+    pthread_mutex_lock(&lock);
+
+    if (--e->busy == 0 && e->stale)
+        entry_free(e);
+
+    if (r && hit)
+        hits++;
+
+    pthread_mutex_unlock(&lock);
+
+    return r;
+}
+
+
+static cache_entry_t *entry_create(const char *key, mql_statement_t *st)
+{
+    cache_entry_t *e;
+
+    if (!(e = calloc(1, sizeof(cache_entry_t))))
+        return NULL;
+
+    if (!(e->key = strdup(key)) || mdb_hash_add(entries, 0, e->key, e) < 0) {
+        free(e->key);
+        free(e);
+        return NULL;
+    }
+
+    e->statement = st;
+
+    MDB_DLIST_PREPEND(cache_entry_t, link, e, &lru);
+    nentry++;
+
+    evict(maxentry);
+
+    return e;
+}
+
+
+static void entry_touch(cache_entry_t *e)
+{
+    MDB_DLIST_UNLINK(cache_entry_t, link, e);
+    MDB_DLIST_PREPEND(cache_entry_t, link, e, &lru);
+}
+
+
+static void entry_drop(cache_entry_t *e)
+{
+    mdb_hash_delete(entries, 0, e->key);
+    MDB_DLIST_UNLINK(cache_entry_t, link, e);
+    nentry--;
+
+    if (e->busy)
+        e->stale = true;
+    else
+        entry_free(e);
+}
+
+
+static void entry_free(cache_entry_t *e)
+{
+    mql_statement_free(e->statement);
+    free(e->key);
+    free(e);
+}
+
+
+static void evict(int max)
+{
+    mdb_dlist_t   *l, *prev;
+    cache_entry_t *e;
+
+    for (l = lru.prev;  l != &lru && nentry > max;  l = prev) {
+        prev = l->prev;
+        e = MDB_LIST_RELOCATE(cache_entry_t, link, l);
+
+        if (!e->busy) {
+            entry_drop(e);
+            evictions++;
+        }
+    }
+}
+
+
+static void flush(void)
+{
+    cache_entry_t *e, *n;
+
+    MDB_DLIST_FOR_EACH_SAFE(cache_entry_t, link, e, n, &lru)
+        entry_drop(e);
+}
+
+
+static void table_event_cb(mqi_event_t *evt, void *user_data)
+{
+    MQI_UNUSED(user_data);
+
+    switch (evt->event) {
+    case mqi_table_created:
+    case mqi_table_dropped:
+        pthread_mutex_lock(&lock);
+        invalidations += nentry;
+        flush();
+        pthread_mutex_unlock(&lock);
+        break;
+    default:
+        break;
+    }
+}
+
+
+/*
+ * Local Variables:
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ *
+ */
@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
 #include <alloca.h>
 #include <errno.h>
@@ -19,25 +20,26 @@
 
 #define MQL_SUCCESS                                                     \
     do {                                                                \
-        if (mode == mql_mode_exec)                                      \
-            result = mql_result_success_create();                       \
+        if (ctx->mode == mql_mode_exec)                                 \
+            ctx->result = mql_result_success_create();                  \
     } while (0)
 
 #define MQL_ERROR(code, fmt...)                                         \
     do {                                                                \
-        switch (mode) {                                                 \
+        switch (ctx->mode) {                                            \
         case mql_mode_exec:                                             \
-            result = mql_result_error_create(code, fmt);                \
+            ctx->result = mql_result_error_create(code, fmt);           \
             break;                                                      \
         case mql_mode_precompile:                                       \
             errno = code;                                               \
-            free(statement);                                            \
-            statement = NULL;                                           \
+            free(ctx->statement);                                       \
+            ctx->statement = NULL;                                      \
             break;                                                      \
         case mql_mode_parser:                                           \
-            fprintf(mqlout, "%s:%d: error: ", file, yy_mql_lineno);     \
-            fprintf(mqlout, fmt);                                       \
-            fprintf(mqlout, "\n");                                      \
+            fprintf(ctx->mqlout, "%s:%d: error: ", ctx->file,          \
+                    yy_mql_get_lineno(scanner));                        \
+            fprintf(ctx->mqlout, fmt);                                  \
+            fprintf(ctx->mqlout, "\n");                                 \
             break;                                                      \
         }                                                               \
         YYERROR;                                                        \
@@ -46,13 +48,29 @@
 
 #define SET_INPUT(t,v)                                                  \
     input_t *input;                                                     \
-    if (ninput >= MQI_COLUMN_MAX)                                       \
+    if (ctx->ninput >= MQI_COLUMN_MAX)                                  \
         MQL_ERROR(EOVERFLOW, "Too many input values\n");                \
-    input = inputs + ninput++;                                          \
+    input = ctx->inputs + ctx->ninput++;                                \
     input->type = mqi_##t;                                              \
     input->flags = 0;                                                   \
     input->value.t = (v)
 
+#define EXPLAIN_PLAN                                                    \
+    do {                                                                \
+        mqi_cond_entry_t *where;                                        \
+        char              plan[1024];                                   \
+                                                                        \
+        where = (ctx->cond == ctx->conds) ? NULL : ctx->conds;          \
+                                                                        \
+        if (mqi_explain(ctx->table, where, plan, sizeof(plan)) < 0)     \
+            MQL_ERROR(errno, "explain failed: %s", strerror(errno));    \
+                                                                        \
+        if (ctx->mode == mql_mode_exec)                                 \
+            ctx->result = mql_result_string_create_plan(plan);          \
+        else                                                            \
+            fprintf(ctx->mqlout, "%s", plan);                           \
+    } while (0)
+
 typedef enum mql_mode_e        mql_mode_t;
 typedef struct input_s         input_t;
 
@@ -73,62 +91,6 @@ struct input_s {
     }                    value;
 };
 
-extern int yy_mql_lineno;
-extern int yy_mql_lex(void);
-
-
-void yy_mql_error(const char *);
-
-static int set_select_variables(int *, mqi_data_type_t *, int *, char *,int);
-static void print_query_result(mqi_column_desc_t *, mqi_data_type_t *,
-                               int *, int, int, void *);
-
-static mqi_handle_t table;
-static uint32_t     table_flags;
-
-static char                  *trigger_name;
-static struct mql_callback_s *callback;
-
-static mqi_column_def_t   coldefs[MQI_COLUMN_MAX + 1];
-static mqi_column_def_t  *coldef = coldefs;
-
-static char              *colnams[MQI_COLUMN_MAX + 1];
-static int                ncolnam;
-
-static mqi_cond_entry_t   conds[MQI_COND_MAX + 1];
-static mqi_cond_entry_t  *cond = conds;
-static int                binds;
-
-static input_t            inputs[MQI_COLUMN_MAX];
-static int                ninput;
-
-static mqi_column_desc_t  coldescs[MQI_COLUMN_MAX + 1];
-static int                ncoldesc;
-
-static char    *strs[256];
-static int      nstr;
-
-static int32_t  ints[256];
-static int      nint;
-
-static uint32_t uints[32];
-static int      nuint;
-
-static double   floats[256];
-static int      nfloat;
-
-static mql_mode_t mode;
-
-static mql_statement_t   *statement;
-
-static mql_result_type_t  rtype;
-static mql_result_t      *result;
-
-static char        *file;
-static const char  *mqlbuf;
-static int          mqlin;
-static FILE        *mqlout;
-
 %}
 
 %union {
@@ -142,6 +104,10 @@ static FILE        *mqlout;
 
 
 %defines
+%define api.pure
+%parse-param {mql_parser_t *ctx}
+%parse-param {void *scanner}
+%lex-param   {void *scanner}
 
 %token <string>   TKN_SHOW
 %token <string>   TKN_BEGIN
@@ -155,17 +121,29 @@ static FILE        *mqlout;
 %token <string>   TKN_DELETE
 %token <string>   TKN_DROP
 %token <string>   TKN_DESCRIBE
+%token <string>   TKN_EXPLAIN
 %token <string>   TKN_TABLE
 %token <string>   TKN_TABLES
 %token <string>   TKN_INDEX
+%token <string>   TKN_HASH
+%token <string>   TKN_ORDERED
 %token <string>   TKN_ROWS
+%token <string>   TKN_CHANGES
+%token <string>   TKN_BATCHED
 %token <string>   TKN_COLUMN
 %token <string>   TKN_TRIGGER
 %token <string>   TKN_INSERT
 %token <string>   TKN_SELECT
 %token <string>   TKN_INTO
 %token <string>   TKN_FROM
+%token <string>   TKN_JOIN
 %token <string>   TKN_WHERE
+%token <string>   TKN_GROUP
+%token <string>   TKN_ORDER
+%token <string>   TKN_BY
+%token <string>   TKN_ASC
+%token <string>   TKN_DESC
+%token <string>   TKN_LIMIT
 %token <string>   TKN_VALUES
 %token <string>   TKN_SET
 %token <string>   TKN_ON
@@ -173,8 +151,10 @@ static FILE        *mqlout;
 %token <string>   TKN_OR
 %token <string>   TKN_PERSISTENT
 %token <string>   TKN_TEMPORARY
+%token <string>   TKN_COLUMNAR
 %token <string>   TKN_CALLBACK
 %token <string>   TKN_VARCHAR
+%token <string>   TKN_TEXT
 %token <string>   TKN_INTEGER
 %token <string>   TKN_UNSIGNED
 %token <string>   TKN_REAL
@@ -202,10 +182,13 @@ static FILE        *mqlout;
 %token <string>   TKN_QUOTED_STRING
 
 %type <boolean>   optional_trigger_select
+%type <boolean>   sort_order
+%type <boolean>   trigger_mode
 
 %type <integer>   insert
 %type <integer>   insert_or_replace
 %type <integer>   insert_option
+%type <integer>   table_layout
 
 %type <integer>   varchar
 %type <integer>   blob
@@ -213,6 +196,8 @@ static FILE        *mqlout;
 
 %type <floating>  floating_value
 
+%type <string>    aggregate
+
 %start statement_list
 
 %code requires {
@@ -220,8 +205,10 @@ static FILE        *mqlout;
     #include <murphy-db/mql.h>
 
     typedef struct mql_callback_s  mql_callback_t;
+    typedef struct mql_parser_s    mql_parser_t;
 
-    int yy_mql_input(void *, unsigned);
+    int yy_mql_input(mql_parser_t *, void *, unsigned);
+    char *yy_mql_copy_string(mql_parser_t *, const char *);
 
     mql_statement_t *mql_make_show_tables_statement(uint32_t);
     mql_statement_t *mql_make_describe_statement(mqi_handle_t);
@@ -229,7 +216,8 @@ static FILE        *mqlout;
                                                     char *);
     mql_statement_t *mql_make_insert_statement(mqi_handle_t, int, int,
                                                mqi_data_type_t*,
-                                               mqi_column_desc_t*, void*);
+                                               mqi_column_desc_t*, int, int,
+                                               void*);
     mql_statement_t *mql_make_update_statement(mqi_handle_t, int,
                                                mqi_cond_entry_t *, int,
                                                mqi_data_type_t *,
@@ -239,7 +227,13 @@ static FILE        *mqlout;
     mql_statement_t *mql_make_select_statement(mqi_handle_t, int, int,
                                                mqi_cond_entry_t *, int,
                                                char **, mqi_data_type_t *,
-                                               int *, mqi_column_desc_t *);
+                                               int *, mqi_column_desc_t *,
+                                               mqi_query_t *);
+    mql_statement_t *mql_make_join_statement(mqi_handle_t, int, mqi_handle_t,
+                                             int, int, int,
+                                             mqi_cond_entry_t *, int,
+                                             char **, mqi_data_type_t *,
+                                             int *, mqi_column_desc_t *);
 
     mql_result_t *mql_result_success_create(void);
     mql_result_t *mql_result_error_create(int, const char *, ...);
@@ -249,12 +243,21 @@ static FILE        *mqlout;
     mql_result_t *mql_result_event_row_change_create(mqi_event_type_t,
                                                      mqi_handle_t,
                                                      mql_result_t *);
+    mql_result_t *mql_result_event_changefeed_create(mqi_handle_t, int,
+                                                     mqi_change_row_t *,
+                                                     mql_result_t *);
     mql_result_t *mql_result_event_table_create(mqi_event_type_t,mqi_handle_t);
     mql_result_t *mql_result_event_transaction_create(mqi_event_type_t);
     mql_result_t *mql_result_columns_create(int, mqi_column_def_t *);
     mql_result_t *mql_result_rows_create(int, mqi_column_desc_t*,
                                          mqi_data_type_t*,int*,int,int,void*);
+    mql_result_t *mql_result_rows_alloc(int, mqi_column_desc_t *,
+                                        mqi_data_type_t *, int, int);
+    void *mql_result_rows_add(mql_result_t **, int);
+    void *mql_result_rows_get_row(mql_result_t *, int);
+    int mql_result_rows_truncate(mql_result_t *, int);
     mql_result_t *mql_result_string_create_table_list(int, char **);
+    mql_result_t *mql_result_string_create_plan(const char *);
     mql_result_t *mql_result_string_create_column_change(const char *,
                                                          const char *,
                                                          mqi_change_value_t *,
@@ -275,19 +278,124 @@ static FILE        *mqlout;
 
     mql_callback_t *mql_find_callback(char *);
     int mql_create_column_trigger(char *, mqi_handle_t, int,mqi_data_type_t,
-                                  mql_callback_t *,
+                                  mql_callback_t *, bool,
                                   int, char **, mqi_column_desc_t *,
                                   mqi_data_type_t *, int *,
                                   int);
-    int mql_create_row_trigger(char *, mqi_handle_t, mql_callback_t *,
+    int mql_create_row_trigger(char *, mqi_handle_t, mql_callback_t *, bool,
                                int, char **, mqi_column_desc_t *,
                                mqi_data_type_t *, int *, int);
+    int mql_create_changefeed_trigger(char *, mqi_handle_t, mql_callback_t *,
+                                      int, char **, mqi_column_desc_t *,
+                                      mqi_data_type_t *, int *, int);
     int mql_create_table_trigger(char *, mql_callback_t *);
     int mql_create_transaction_trigger(char *, mql_callback_t *);
 
     int mql_begin_transaction(char *);
     int mql_rollback_transaction(char *);
     int mql_commit_transaction(char *);
+
+    mql_result_t *mql_exec_string_parse(mql_result_type_t, const char *);
+}
+
+%code {
+    int  yy_mql_lex(YYSTYPE *, void *);
+    int  yy_mql_lex_init_extra(mql_parser_t *, void **);
+    int  yy_mql_lex_destroy(void *);
+    int  yy_mql_get_lineno(void *);
+    void yy_mql_error(mql_parser_t *, void *, const char *);
+
+    /*
+     * all the state of a single parse; the parser and the scanner are pure,
+     * so each mql_exec_xxx() call has its own on the stack
+     */
+    struct mql_parser_s {
+        mql_mode_t          mode;
+        mql_statement_t    *statement;
+        mql_result_type_t   rtype;
+        mql_result_t       *result;
+
+        char               *file;
+        const char         *mqlbuf;
+        int                 mqlin;
+        FILE               *mqlout;
+
+        mqi_handle_t        table;
+        uint32_t            table_flags;
+        mqi_index_type_t    index_type;
+        mqi_handle_t        join;           /* joined table or invalid */
+        int                 nleft;          /* number of columns of table */
+        int                 lcol;           /* join columns */
+        int                 rcol;
+
+        char               *trigger_name;
+        mql_callback_t     *callback;
+
+        mqi_column_def_t    coldefs[MQI_COLUMN_MAX + 1];
+        mqi_column_def_t   *coldef;
+
+        char               *colnams[MQI_COLUMN_MAX + 1];
+        int                 ncolnam;
+
+        mqi_aggregate_t     aggregates[MQI_COLUMN_MAX + 1];
+        char               *aggrcols[MQI_COLUMN_MAX + 1];
+        mqi_aggregate_t     aggregate;      /* of the last aggregate() */
+        char               *aggrcol;
+
+        int                 groups[MQI_COLUMN_MAX + 1];
+        int                 ngroup;
+        char               *ordnams[MQI_COLUMN_MAX + 1];
+        mqi_order_t         orders[MQI_COLUMN_MAX + 1];
+        int                 norder;
+        int                 limit;
+
+        mqi_cond_entry_t    conds[MQI_COND_MAX + 1];
+        mqi_cond_entry_t   *cond;
+        int                 binds;
+
+        input_t             inputs[MQI_COLUMN_MAX];
+        int                 ninput;
+
+        input_t            *rows;           /* values of INSERT rows */
+        int                 nrow;
+        int                 rowlen;         /* values per INSERT row */
+
+        mqi_column_desc_t   coldescs[MQI_COLUMN_MAX + 1];
+        int                 ncoldesc;
+
+        char               *strs[256];
+        int                 nstr;
+
+        int32_t             ints[256];
+        int                 nint;
+
+        uint32_t            uints[MQI_COND_MAX];
+        int                 nuint;
+
+        double              floats[256];
+        int                 nfloat;
+
+        char                ringbuf[4096];  /* identifiers and strings */
+        char               *bufptr;
+    };
+
+    static void parser_init(mql_parser_t *, mql_mode_t, mql_result_type_t);
+    static int parse(mql_parser_t *);
+    static int set_select_variables(mql_parser_t *, int *, mqi_data_type_t *,
+                                    int *, char *, int);
+    static int set_query_variables(mql_parser_t *, mqi_query_t *,
+                                   char *, int);
+    static char *set_aggregate(mql_parser_t *, const char *, char *);
+    static int column_index(mql_parser_t *, char *);
+    static char *column_name(mql_parser_t *, int);
+    static mqi_data_type_t column_type(mql_parser_t *, int);
+    static int column_size(mql_parser_t *, int);
+    static int select_join(mql_parser_t *, int, mqi_data_type_t *, int *,
+                           char *, int);
+    static int add_insert_row(mql_parser_t *);
+    static void reset_insert_rows(mql_parser_t *);
+    static void print_query_result(mql_parser_t *, mqi_column_desc_t *,
+                                   mqi_data_type_t *, int *, int, int, void *);
 }
 
 
@@ -300,8 +408,9 @@ statement_list:
 ;
 
 semicolon: TKN_SEMICOLON {
-    if (mode != mql_mode_parser) {
-        result = mql_result_error_create(EINVAL, "multiple MQL statements");
+    if (ctx->mode != mql_mode_parser) {
+        ctx->result = mql_result_error_create(EINVAL,
+                                              "multiple MQL statements");
         YYERROR;
     }
 };
@@ -319,6 +428,7 @@ statement:
 | update_statement
 | delete_statement
 | select_statement
+| explain_statement
 | error
 ;
 
@@ -339,31 +449,34 @@ show_tables: table_flags TKN_TABLES {
     char  *names[4096];
     int    n;
     
-    if (mode == mql_mode_precompile)
-        statement = mql_make_show_tables_statement(table_flags);
+    if (ctx->mode == mql_mode_precompile)
+        ctx->statement = mql_make_show_tables_statement(ctx->table_flags);
     else {
-        if ((n = mqi_show_tables(table_flags, names,MQI_DIMENSION(names))) < 0)
+        n = mqi_show_tables(ctx->table_flags, names, MQI_DIMENSION(names));
+
+        if (n < 0)
             MQL_ERROR(errno, "can't show tables: %s", strerror(errno));
         else {
-            if (mode == mql_mode_exec) {
-                switch (rtype) {
+            if (ctx->mode == mql_mode_exec) {
+                switch (ctx->rtype) {
                 case mql_result_string:
-                    result = mql_result_string_create_table_list(n, names);
+                    ctx->result = mql_result_string_create_table_list(n, names);
                     break;
                 case mql_result_list:
-                    result = mql_result_list_create(mqi_string,n,(void*)names);
+                    ctx->result = mql_result_list_create(mqi_string, n,
+                                                         (void *)names);
                     break;
                 default:
-                    result = mql_result_error_create(EINVAL,
-                                                     "can't show tables: %s",
-                                                     strerror(EINVAL));
+                    ctx->result = mql_result_error_create(EINVAL,
+                                                   "can't show tables: %s",
+                                                   strerror(EINVAL));
                     break;
                 }
             }
             else {
                 mql_result_t *r = mql_result_string_create_table_list(n,names);
 
-                fprintf(mqlout, "%s", mql_result_string_get(r));
+                fprintf(ctx->mqlout, "%s", mql_result_string_get(r));
 
                 mql_result_free(r);
             }
@@ -397,22 +510,29 @@ create_trigger_statement:
 | create_table_trigger
 | create_row_trigger
 | create_column_trigger
+| create_changefeed_trigger
 ;
 
 
 /* create table */
 
-create_table: table_flags TKN_TABLE {
-    coldef = coldefs;
+create_table: table_flags table_layout TKN_TABLE {
+    ctx->coldef = ctx->coldefs;
     
-    if (table_flags == MQI_ANY)
-        table_flags = MQI_TEMPORARY;
+    if (ctx->table_flags == MQI_ANY)
+        ctx->table_flags = MQI_TEMPORARY;
+
+    ctx->table_flags |= $2;
 };
 
 
 
 table_definition: TKN_IDENTIFIER TKN_LEFT_PAREN column_defs TKN_RIGHT_PAREN {
-    if (mqi_create_table($1, table_flags, NULL, coldefs) == MQI_HANDLE_INVALID)
+    mqi_handle_t h;
+
+    h = mqi_create_table($1, ctx->table_flags, NULL, ctx->coldefs);
+
+    if (h == MQI_HANDLE_INVALID)
         MQL_ERROR(errno, "Can't create table: %s\n", strerror(errno));
     else
         MQL_SUCCESS;
@@ -426,25 +546,26 @@ column_defs:
 
 /*#toplevel#*/
 column_def: column_name column_type {
-    memset(++coldef, 0, sizeof(mqi_column_def_t));
+    memset(++ctx->coldef, 0, sizeof(mqi_column_def_t));
 };
 
 column_name: TKN_IDENTIFIER {
-    if ((coldef - coldefs) >= MQI_COLUMN_MAX) {
+    if ((ctx->coldef - ctx->coldefs) >= MQI_COLUMN_MAX) {
         MQL_ERROR(EOVERFLOW, "Too many columns. Max %d columns allowed\n",
                   MQI_COLUMN_MAX);
     }
 
-    coldef->name = $1;
+    ctx->coldef->name = $1;
 };
 
 /*#toplevel#*/
 column_type:
-  varchar       { coldef->type = mqi_varchar;   coldef->length = $1; }
-| TKN_INTEGER   { coldef->type = mqi_integer;   coldef->length = 0;  }
-| TKN_UNSIGNED  { coldef->type = mqi_unsignd;   coldef->length = 0;  }
-| TKN_REAL      { coldef->type = mqi_floating;  coldef->length = 0;  }
-| blob          { coldef->type = mqi_blob;      coldef->length = $1; }
+  varchar       { ctx->coldef->type = mqi_varchar;   ctx->coldef->length = $1; }
+| TKN_TEXT      { ctx->coldef->type = mqi_varchar;   ctx->coldef->length = 0;  }
+| TKN_INTEGER   { ctx->coldef->type = mqi_integer;   ctx->coldef->length = 0;  }
+| TKN_UNSIGNED  { ctx->coldef->type = mqi_unsignd;   ctx->coldef->length = 0;  }
+| TKN_REAL      { ctx->coldef->type = mqi_floating;  ctx->coldef->length = 0;  }
+| blob          { ctx->coldef->type = mqi_blob;      ctx->coldef->length = $1; }
 ;
 
 varchar: TKN_VARCHAR TKN_LEFT_PAREN TKN_NUMBER TKN_RIGHT_PAREN {
@@ -457,20 +578,46 @@ blob: TKN_BLOB TKN_LEFT_PAREN TKN_NUMBER TKN_RIGHT_PAREN {
 
 /* create index */
 
-create_index: TKN_INDEX {
-    ncolnam = 0;
+create_index: index_type TKN_INDEX {
+    ctx->ncolnam = 0;
 };
 
-index_definition: TKN_ON table_name TKN_LEFT_PAREN column_list TKN_RIGHT_PAREN
+index_type:
+  /* no option */ { ctx->index_type = mqi_index_hash;    }
+| TKN_HASH        { ctx->index_type = mqi_index_hash;    }
+| TKN_ORDERED     { ctx->index_type = mqi_index_ordered; }
+;
+
+/*#toplevel#*/
+index_definition:
+  primary_index_definition
+| secondary_index_definition
+;
+
+primary_index_definition:
+  TKN_ON table_name TKN_LEFT_PAREN column_list TKN_RIGHT_PAREN
 {
-    colnams[ncolnam] = NULL;
+    ctx->colnams[ctx->ncolnam] = NULL;
 
-    if (mqi_create_index(table, colnams) < 0)
+    if (mqi_create_index(ctx->table, ctx->colnams) < 0)
         MQL_ERROR(errno, "failed to create index: %s", strerror(errno));
     else
         MQL_SUCCESS;
 };
 
+secondary_index_definition:
+  TKN_IDENTIFIER TKN_ON table_name TKN_LEFT_PAREN column_list TKN_RIGHT_PAREN
+{
+    ctx->colnams[ctx->ncolnam] = NULL;
+
+    if (mqi_create_secondary_index(ctx->table, $1, ctx->index_type,
+                                   ctx->colnams) < 0)
+        MQL_ERROR(errno, "failed to create index '%s': %s", $1,
+                  strerror(errno));
+    else
+        MQL_SUCCESS;
+};
+
 
 /* create trigger */
 
@@ -490,14 +637,18 @@ create_row_trigger: TKN_CREATE create_trigger row_trigger
 create_column_trigger: TKN_CREATE create_trigger column_trigger
 ;
 
+/*#toplevel#*/
+create_changefeed_trigger: TKN_CREATE create_trigger changefeed_trigger
+;
+
 create_trigger: TKN_TRIGGER TKN_IDENTIFIER TKN_ON {
-    if (mode != mql_mode_exec)
+    if (ctx->mode != mql_mode_exec)
         MQL_ERROR(EPERM, "only mql_exec_string() can create triggers");
     else {
-        table = MQI_HANDLE_INVALID;
-        ncolnam = 0;
-        trigger_name = $2;
-        callback = NULL;
+        ctx->table = MQI_HANDLE_INVALID;
+        ctx->ncolnam = 0;
+        ctx->trigger_name = $2;
+        ctx->callback = NULL;
     }
 };
 
@@ -505,7 +656,7 @@ create_trigger: TKN_TRIGGER TKN_IDENTIFIER TKN_ON {
 
 transaction_trigger: TKN_TRANSACTIONS callback {
 
-    if (mql_create_transaction_trigger(trigger_name, callback) < 0) {
+    if (mql_create_transaction_trigger(ctx->trigger_name, ctx->callback) < 0) {
         MQL_ERROR(errno, "failed to create transaction trigger: %s",
                   strerror(errno));
     }
@@ -516,14 +667,14 @@ transaction_trigger: TKN_TRANSACTIONS callback {
 
 table_trigger: TKN_TABLES callback {
 
-    if (mql_create_table_trigger(trigger_name, callback) < 0)
+    if (mql_create_table_trigger(ctx->trigger_name, ctx->callback) < 0)
         MQL_ERROR(errno, "failed to create table trigger: %s",strerror(errno));
     else
         MQL_SUCCESS;
 
 };
 
-row_trigger: TKN_ROWS TKN_IN table_name callback trigger_select {
+row_trigger: TKN_ROWS TKN_IN table_name callback trigger_mode trigger_select {
 
     int rowsize;
     int colsizes[MQI_COLUMN_MAX + 1];
@@ -531,14 +682,15 @@ row_trigger: TKN_ROWS TKN_IN table_name callback trigger_select {
     char errbuf[256];
     int sts;
 
-    sts = set_select_variables(&rowsize, coltypes,colsizes,
+    sts = set_select_variables(ctx, &rowsize, coltypes,colsizes,
                                errbuf, sizeof(errbuf));
     if (sts < 0)
         MQL_ERROR(errno, "%s", errbuf);
 
-    sts = mql_create_row_trigger(trigger_name, table, callback,
-                                 ncolnam,colnams,
-                                 coldescs, coltypes, colsizes,
+    sts = mql_create_row_trigger(ctx->trigger_name, ctx->table,
+                                 ctx->callback, $5,
+                                 ctx->ncolnam,ctx->colnams,
+                                 ctx->coldescs, coltypes, colsizes,
                                  rowsize);
     if (sts < 0)
         MQL_ERROR(errno, "failed to create row triger: %s",strerror(errno));
@@ -547,7 +699,7 @@ row_trigger: TKN_ROWS TKN_IN table_name callback trigger_select {
 };
 
 column_trigger: TKN_COLUMN TKN_IDENTIFIER TKN_IN table_name callback
-                optional_trigger_select
+                trigger_mode optional_trigger_select
 {
     int colidx;
     mqi_data_type_t coltype;
@@ -557,27 +709,29 @@ column_trigger: TKN_COLUMN TKN_IDENTIFIER TKN_IN table_name callback
     char errbuf[256];
     int sts;
 
-    if ((colidx  = mqi_get_column_index(table, $2))    < 0 ||
-        (coltype = mqi_get_column_type(table, colidx)) < 0  )
+    if ((colidx  = mqi_get_column_index(ctx->table, $2))    < 0 ||
+        (coltype = mqi_get_column_type(ctx->table, colidx)) < 0  )
     {
         MQL_ERROR(errno, "do not know trigger column '%s'", $2);
     }
 
-    if ($6) {
-        sts = set_select_variables(&rowsize, coltypes,colsizes,
+    if ($7) {
+        sts = set_select_variables(ctx, &rowsize, coltypes,colsizes,
                                    errbuf, sizeof(errbuf));
         if (sts < 0)
             MQL_ERROR(errno, "%s", errbuf);
 
-        sts = mql_create_column_trigger(trigger_name,
-                                        table, colidx,coltype, callback,
-                                        ncolnam,colnams,
-                                        coldescs,coltypes,colsizes,
+        sts = mql_create_column_trigger(ctx->trigger_name,
+                                        ctx->table, colidx,coltype,
+                                        ctx->callback, $6,
+                                        ctx->ncolnam,ctx->colnams,
+                                        ctx->coldescs,coltypes,colsizes,
                                         rowsize);
     }
     else {
-        sts = mql_create_column_trigger(trigger_name,
-                                        table, colidx,coltype, callback,
+        sts = mql_create_column_trigger(ctx->trigger_name,
+                                        ctx->table, colidx,coltype,
+                                        ctx->callback, $6,
                                         0,NULL,NULL,NULL,NULL, 0);
     }
 
@@ -588,8 +742,33 @@ column_trigger: TKN_COLUMN TKN_IDENTIFIER TKN_IN table_name callback
 };
 
 
+changefeed_trigger: TKN_CHANGES TKN_IN table_name callback trigger_select {
+
+    int rowsize;
+    int colsizes[MQI_COLUMN_MAX + 1];
+    mqi_data_type_t coltypes[MQI_COLUMN_MAX + 1];
+    char errbuf[256];
+    int sts;
+
+    sts = set_select_variables(ctx, &rowsize, coltypes,colsizes,
+                               errbuf, sizeof(errbuf));
+    if (sts < 0)
+        MQL_ERROR(errno, "%s", errbuf);
+
+    sts = mql_create_changefeed_trigger(ctx->trigger_name, ctx->table,
+                                        ctx->callback,
+                                        ctx->ncolnam,ctx->colnams,
+                                        ctx->coldescs, coltypes, colsizes,
+                                        rowsize);
+    if (sts < 0)
+        MQL_ERROR(errno, "failed to create changefeed: %s", strerror(errno));
+    else
+        MQL_SUCCESS;
+};
+
+
 callback: TKN_CALLBACK TKN_IDENTIFIER {
-    if (!(callback = mql_find_callback($2))) {
+    if (!(ctx->callback = mql_find_callback($2))) {
         MQL_ERROR(ENOENT, "can't find callback '%s'", $2);
     }
 };
@@ -597,6 +776,11 @@ callback: TKN_CALLBACK TKN_IDENTIFIER {
 trigger_select: TKN_SELECT columns
 ;
 
+trigger_mode:
+  /* fired for every change */   { $$ = false; }
+| TKN_BATCHED                    { $$ = true;  }
+;
+
 optional_trigger_select:
   /* no select */   { $$ = false; }
 | trigger_select    { $$ = true;  }
@@ -617,7 +801,7 @@ drop_statement:
 
 /*#toplevel#*/
 drop_table_statement: TKN_DROP TKN_TABLE  table_name {
-    if (mqi_drop_table(table) < 0)
+    if (mqi_drop_table(ctx->table) < 0)
         MQL_ERROR(errno, "failed to drop table: %s", strerror(errno));
     else
         MQL_SUCCESS;
@@ -628,8 +812,16 @@ drop_table_statement: TKN_DROP TKN_TABLE  table_name {
 /* drop index */
 
 /*#toplevel#*/
-drop_index_statement: TKN_DROP TKN_INDEX table_name {
-};
+drop_index_statement:
+  TKN_DROP TKN_INDEX table_name {
+}
+| TKN_DROP TKN_INDEX TKN_IDENTIFIER TKN_ON table_name {
+    if (mqi_drop_secondary_index(ctx->table, $3) < 0)
+        MQL_ERROR(errno, "failed to drop index '%s': %s", $3, strerror(errno));
+    else
+        MQL_SUCCESS;
+}
+;
 
 
 /***********************************
@@ -639,8 +831,9 @@ drop_index_statement: TKN_DROP TKN_INDEX table_name {
  */
 /*#toplevel#*/
 begin_statement: TKN_BEGIN transaction TKN_IDENTIFIER {
-    if (mode == mql_mode_precompile)
-        statement = mql_make_transaction_statement(mql_statement_begin, $3);
+    if (ctx->mode == mql_mode_precompile)
+        ctx->statement = mql_make_transaction_statement(mql_statement_begin,
+                                                        $3);
     else {
         if (mql_begin_transaction($3) < 0)
             MQL_ERROR(errno, "can't start transaction: %s", strerror(errno));
@@ -651,8 +844,9 @@ begin_statement: TKN_BEGIN transaction TKN_IDENTIFIER {
 
 /*#toplevel#*/
 commit_statement: TKN_COMMIT transaction TKN_IDENTIFIER {
-    if (mode == mql_mode_precompile)
-        statement = mql_make_transaction_statement(mql_statement_commit, $3);
+    if (ctx->mode == mql_mode_precompile)
+        ctx->statement = mql_make_transaction_statement(mql_statement_commit,
+                                                        $3);
     else {
         if (mql_commit_transaction($3) < 0)
             MQL_ERROR(errno, "can't commit transaction: %s", strerror(errno));
@@ -663,8 +857,9 @@ commit_statement: TKN_COMMIT transaction TKN_IDENTIFIER {
 
 /*#toplevel#*/
 rollback_statement: TKN_ROLLBACK transaction TKN_IDENTIFIER {
-    if (mode == mql_mode_precompile)
-        statement = mql_make_transaction_statement(mql_statement_rollback, $3);
+    if (ctx->mode == mql_mode_precompile)
+        ctx->statement = mql_make_transaction_statement(mql_statement_rollback,
+                                                        $3);
     else {
         if (mql_rollback_transaction($3) < 0)
             MQL_ERROR(errno, "can't rollback transaction: %s",strerror(errno));
@@ -685,31 +880,32 @@ describe_statement: TKN_DESCRIBE table_name {
     mqi_column_def_t defs[MQI_COLUMN_MAX];
     int              n;
 
-    if (mode == mql_mode_precompile)
-        statement = mql_make_describe_statement(table);
+    if (ctx->mode == mql_mode_precompile)
+        ctx->statement = mql_make_describe_statement(ctx->table);
     else {
-        if ((n = mqi_describe(table, defs, MQI_COLUMN_MAX)) < 0)
+        if ((n = mqi_describe(ctx->table, defs, MQI_COLUMN_MAX)) < 0)
             MQL_ERROR(errno, "can't describe table: %s", strerror(errno));
         else {
-            if (mode == mql_mode_exec) {
-                switch (rtype) {
+            if (ctx->mode == mql_mode_exec) {
+                switch (ctx->rtype) {
                 case mql_result_columns:
-                    result = mql_result_columns_create(n, defs);
+                    ctx->result = mql_result_columns_create(n, defs);
                     break;
                 case mql_result_string:
-                    result = mql_result_string_create_column_list(n, defs);
+                    ctx->result = mql_result_string_create_column_list(n, defs);
                     break;
                 default:
-                    result = mql_result_error_create(EINVAL, "describe failed:"
-                                                     " invalid result type %d",
-                                                     rtype);
+                    ctx->result = mql_result_error_create(EINVAL,
+                                                   "describe failed: invalid"
+                                                   " result type %d",
+                                                   ctx->rtype);
                     break;
                 }
             }
             else {
                 mql_result_t *r = mql_result_string_create_column_list(n,defs);
 
-                fprintf(mqlout, "%s", mql_result_string_get(r));
+                fprintf(ctx->mqlout, "%s", mql_result_string_get(r));
 
                 mql_result_free(r);
             }
@@ -723,8 +919,7 @@ describe_statement: TKN_DESCRIBE table_name {
  *
  */
 /*#toplevel#*/
-insert_statement: insert table_name insert_columns TKN_VALUES insert_values {
-    void              *row[2];
+insert_statement: insert table_name insert_columns TKN_VALUES insert_rows {
     char              *col;
     mqi_column_desc_t *cd;
     mqi_data_type_t    coltypes[MQI_COLUMN_MAX + 1];
@@ -732,59 +927,66 @@ insert_statement: insert table_name insert_columns TKN_VALUES insert_values {
     mqi_data_type_t    type;
     int                cindex;
     int                err;
-    int                i;
+    int                i, j;
 
-    if (!ncolnam) {
-        while ((colnams[ncolnam] = mqi_get_column_name(table, ncolnam)))
-            ncolnam++;
+    if (!ctx->ncolnam) {
+        while ((ctx->colnams[ctx->ncolnam] = mqi_get_column_name(ctx->table,
+                                                                 ctx->ncolnam)))
+            ctx->ncolnam++;
     }
 
-    if (ncolnam != ninput)
+    if (ctx->ncolnam != ctx->rowlen)
         MQL_ERROR(EINVAL, "unbalanced set of columns and values");
 
-    for (i = 0, err = 0; i < ncolnam; i++) {
-        col = colnams[i];
-        cd  = coldescs + i;
-        inp = inputs + i;
+    for (i = 0, err = 0; i < ctx->ncolnam; i++) {
+        col = ctx->colnams[i];
+        cd  = ctx->coldescs + i;
 
-        if ((cindex = mqi_get_column_index(table, col)) < 0) {
+        if ((cindex = mqi_get_column_index(ctx->table, col)) < 0) {
             MQL_ERROR(ENOENT, "know nothing about '%s'", col);
             err = 1;
             continue;
         }
 
-        type = coltypes[i] = mqi_get_column_type(table, cindex);
+        type = coltypes[i] = mqi_get_column_type(ctx->table, cindex);
 
-        if (type != inp->type) {
-            if (type != mqi_integer ||
-                inp->type != mqi_unsignd ||
-                inp->value.unsignd > INT32_MAX)
-            {
-                MQL_ERROR(EINVAL, "mismatching column and value type for '%s'",
-                          col);
-                err = 1;
-                continue;
+        for (j = 0;  j < ctx->nrow;  j++) {
+            inp = ctx->rows + (j * ctx->rowlen + i);
+
+            if (type != inp->type) {
+                if (type != mqi_integer ||
+                    inp->type != mqi_unsignd ||
+                    inp->value.unsignd > INT32_MAX)
+                {
+                    MQL_ERROR(EINVAL, "mismatching column and value type "
+                              "for '%s'", col);
+                    err = 1;
+                    break;
+                }
             }
         }
 
         cd->cindex = cindex;
-        cd->offset = (void *)&inp->value - (void *)inputs;
+        cd->offset = (void *)&ctx->rows[i].value - (void *)ctx->rows;
     }
 
-    cd = coldescs + i;
+    cd = ctx->coldescs + i;
     cd->cindex = -1;
     cd->offset = -1;
 
 
-    if (mode == mql_mode_precompile) {
-        statement = mql_make_insert_statement(table, $1, ncolnam, coltypes,
-                                              coldescs, inputs);
+    if (ctx->mode == mql_mode_precompile) {
+        ctx->statement = mql_make_insert_statement(ctx->table, $1,
+                                                   ctx->ncolnam, coltypes,
+                                                   ctx->coldescs, ctx->nrow,
+                                                   sizeof(input_t) *
+                                                   ctx->rowlen,
+                                                   ctx->rows);
     }
     else {
-        row[0] = (void *)inputs;
-        row[1] = NULL;
-
-        if (err || mqi_insert_into(table, $1, coldescs, row) < 0)
+        if (err || mqi_insert_bulk(ctx->table, $1, ctx->coldescs, ctx->rows,
+                                   sizeof(input_t) * ctx->rowlen,
+                                   ctx->nrow) < 0)
             MQL_ERROR(errno, "insert failed: %s\n", strerror(errno));
         else
             MQL_SUCCESS;
@@ -793,21 +995,23 @@ insert_statement: insert table_name insert_columns TKN_VALUES insert_values {
 
 
 insert: insert_or_replace {
-      table = MQI_HANDLE_INVALID;
-      ncolnam = 0;
-      ninput = 0;
-      ncoldesc = 0;
+      ctx->table = MQI_HANDLE_INVALID;
+      ctx->ncolnam = 0;
+      ctx->ninput = 0;
+      ctx->ncoldesc = 0;
+      reset_insert_rows(ctx);
       $$ = $1;
 };
 
 insert_or_replace:
-  TKN_INSERT insert_option TKN_INTO  { $$ = $2; }
-| TKN_REPLACE TKN_INTO               { $$ = 1;  } 
+  TKN_INSERT insert_option TKN_INTO  { $$ = $2;                 }
+| TKN_REPLACE TKN_INTO               { $$ = mqi_insert_replace; }
 ;
 
 insert_option:
-   /* no option */     { $$ = 0; }
-| TKN_OR TKN_REPLACE   { $$ = 1; }
+   /* no option */     { $$ = mqi_insert_strict;  }
+| TKN_OR TKN_REPLACE   { $$ = mqi_insert_replace; }
+| TKN_OR TKN_UPDATE    { $$ = mqi_insert_upsert;  }
 /*
 | TKN_IGNORE           { $$ = 1; }
 */
@@ -819,7 +1023,20 @@ insert_columns:
 | TKN_LEFT_PAREN column_list TKN_RIGHT_PAREN
 ;
 
-insert_values: TKN_LEFT_PAREN input_value_list TKN_RIGHT_PAREN;
+/*#toplevel#*/
+insert_rows:
+  insert_values
+| insert_rows TKN_COMMA insert_values
+;
+
+insert_values: TKN_LEFT_PAREN input_value_list TKN_RIGHT_PAREN {
+    if (add_insert_row(ctx) < 0) {
+        if (errno == EINVAL)
+            MQL_ERROR(EINVAL, "unbalanced set of columns and values");
+        else
+            MQL_ERROR(errno, "%s", strerror(errno));
+    }
+};
 
 /*#toplevel#*/
 input_value_list:
@@ -836,27 +1053,29 @@ input_value_list:
  */
 /*#toplevel#*/
 update_statement: update table_name TKN_SET assignment_list where_clause {
-    mqi_column_desc_t *cd    = coldescs + ninput;
-    mqi_cond_entry_t  *where = (cond == conds) ? NULL : conds;
+    mqi_column_desc_t *cd    = ctx->coldescs + ctx->ninput;
+    mqi_cond_entry_t  *where = (ctx->cond == ctx->conds) ? NULL : ctx->conds;
     mqi_data_type_t    coltypes[MQI_COLUMN_MAX + 1];
     int                i;
 
-    if (!ninput)
+    if (!ctx->ninput)
         MQL_ERROR(ENOMEDIUM, "No column to update");
 
     cd->cindex = -1;
     cd->offset = -1;
 
-    if (mode == mql_mode_precompile) {
-        for (i = 0;  i < ninput; i++)
-            coltypes[i] = inputs[i].type;
+    if (ctx->mode == mql_mode_precompile) {
+        for (i = 0;  i < ctx->ninput; i++)
+            coltypes[i] = ctx->inputs[i].type;
 
-        statement = mql_make_update_statement(table, cond - conds, conds,
-                                              ninput, coltypes, coldescs,
-                                              inputs);
+        ctx->statement = mql_make_update_statement(ctx->table,
+                                                   ctx->cond - ctx->conds,
+                                                   ctx->conds, ctx->ninput,
+                                                   coltypes, ctx->coldescs,
+                                                   ctx->inputs);
     }
     else {
-        if (mqi_update(table, where, coldescs, inputs) < 0)
+        if (mqi_update(ctx->table, where, ctx->coldescs, ctx->inputs) < 0)
             MQL_ERROR(errno, "update failed: %s", strerror(errno));
         else
             MQL_SUCCESS;
@@ -864,15 +1083,15 @@ update_statement: update table_name TKN_SET assignment_list where_clause {
 };
 
 update: TKN_UPDATE {
-      table = MQI_HANDLE_INVALID;
-      ninput = 0;
-      ncoldesc = 0;
-      nstr = 0;
-      nint = 0;
-      nuint = 0;
-      nfloat = 0;
-      cond = conds;
-      binds = 0;
+      ctx->table = MQI_HANDLE_INVALID;
+      ctx->ninput = 0;
+      ctx->ncoldesc = 0;
+      ctx->nstr = 0;
+      ctx->nint = 0;
+      ctx->nuint = 0;
+      ctx->nfloat = 0;
+      ctx->cond = ctx->conds;
+      ctx->binds = 0;
 };
 
 
@@ -884,20 +1103,20 @@ assignment_list:
 
 /*#toplevel#*/
 assignment: TKN_IDENTIFIER TKN_EQUAL input_value {
-    int                i   = ninput - 1;
-    input_t           *inp = inputs + i;
-    mqi_column_desc_t *cd  = coldescs + i;
+    int                i   = ctx->ninput - 1;
+    input_t           *inp = ctx->inputs + i;
+    mqi_column_desc_t *cd  = ctx->coldescs + i;
     int                cindex;
     int                offset;
     mqi_data_type_t    type;
 
-    if ((cindex = mqi_get_column_index(table, $1)) < 0)
+    if ((cindex = mqi_get_column_index(ctx->table, $1)) < 0)
         MQL_ERROR(ENOENT, "know nothing about '%s'", $1);
  
     if ((inp->flags & MQL_BINDABLE))
         offset = -(MQL_BIND_INDEX(inp->flags) + 1);
     else {
-        if ((type = mqi_get_column_type(table, cindex)) != inp->type) {
+        if ((type = mqi_get_column_type(ctx->table, cindex)) != inp->type) {
             if (type != mqi_integer ||
                 inp->type != mqi_unsignd ||
                 inp->value.unsignd > INT32_MAX)
@@ -906,7 +1125,7 @@ assignment: TKN_IDENTIFIER TKN_EQUAL input_value {
                           "for '%s'",$1);
             }
         }
-        offset = (void *)&inp->value - (void *)inputs;
+        offset = (void *)&inp->value - (void *)ctx->inputs;
     }
 
     cd->cindex = cindex;
@@ -922,12 +1141,14 @@ assignment: TKN_IDENTIFIER TKN_EQUAL input_value {
  */
 /*#toplevel#*/
 delete_statement: delete table_name where_clause {
-    mqi_cond_entry_t *where = (cond == conds) ? NULL : conds;
+    mqi_cond_entry_t *where = (ctx->cond == ctx->conds) ? NULL : ctx->conds;
 
-    if (mode == mql_mode_precompile)
-        statement = mql_make_delete_statement(table, cond - conds, where);
+    if (ctx->mode == mql_mode_precompile)
+        ctx->statement = mql_make_delete_statement(ctx->table,
+                                                   ctx->cond - ctx->conds,
+                                                   where);
     else {
-        if (mqi_delete_from(table, where) < 0)
+        if (mqi_delete_from(ctx->table, where) < 0)
             MQL_ERROR(errno, "delete failed: %s", strerror(errno));
         else
             MQL_SUCCESS;
@@ -935,13 +1156,13 @@ delete_statement: delete table_name where_clause {
 };
 
 delete: TKN_DELETE TKN_FROM {
-    table = MQI_HANDLE_INVALID;
-    nstr = 0;
-    nint = 0;
-    nuint = 0;
-    nfloat = 0;
-    cond = conds;
-    binds = 0;
+    ctx->table = MQI_HANDLE_INVALID;
+    ctx->nstr = 0;
+    ctx->nint = 0;
+    ctx->nuint = 0;
+    ctx->nfloat = 0;
+    ctx->cond = ctx->conds;
+    ctx->binds = 0;
 };
 
 /***********************************
@@ -950,85 +1171,288 @@ delete: TKN_DELETE TKN_FROM {
  *
  */
 /*#toplevel#*/
-select_statement: select columns TKN_FROM table_name where_clause {
+select_statement:
+  select select_columns TKN_FROM table_name where_clause
+  group_by_clause order_by_clause limit_clause {
     int colsizes[MQI_COLUMN_MAX + 1];
     mqi_data_type_t coltypes[MQI_COLUMN_MAX + 1];
     mqi_cond_entry_t *where;
+    mqi_query_t query;
     int rowsize;
     int tsiz;
+    int dim;
     size_t rsiz;
     void *rows;
     char errbuf[256];
     int sts;
     int n;
+    int i;
 
 
-    if ((tsiz = mqi_get_table_size(table)) < 0)
+    if ((tsiz = mqi_get_table_size(ctx->table)) < 0)
         MQL_ERROR(errno, "can't get table size: %s", strerror(errno));
 
 
-    sts = set_select_variables(&rowsize, coltypes,colsizes,
+    sts = set_select_variables(ctx, &rowsize, coltypes,colsizes,
                                errbuf, sizeof(errbuf));
     if (sts < 0)
         MQL_ERROR(errno, "%s", errbuf);
 
+    if (set_query_variables(ctx, &query, errbuf, sizeof(errbuf)) < 0)
+        MQL_ERROR(errno, "%s", errbuf);
 
-    if (mode != mql_mode_precompile && mode != mql_mode_exec && !tsiz) {
-        if (mode == mql_mode_parser)
-            fprintf(mqlout, "no rows\n");
+    /* aggregates over an empty table still produce a row */
+    for (i = 0;  i < ctx->ncolnam;  i++) {
+        if (ctx->aggregates[i] != mqi_aggregate_none && !ctx->ngroup)
+            break;
+    }
+
+    if (ctx->mode != mql_mode_precompile &&
+        ctx->mode != mql_mode_exec       && !tsiz && i == ctx->ncolnam)
+    {
+        if (ctx->mode == mql_mode_parser)
+            fprintf(ctx->mqlout, "no rows\n");
     }
     else {
-        rsiz  = tsiz * rowsize;
+        dim   = tsiz ? tsiz : 1;
+        rsiz  = dim * rowsize;
         rows  = alloca(rsiz);
-        where = (cond == conds) ? NULL : conds;
+        where = (ctx->cond == ctx->conds) ? NULL : ctx->conds;
 
-        if (mode != mql_mode_precompile) {
-            if (tsiz != 0) {
-                if ((n = mqi_select(table, where,
-                                    coldescs, rows, rowsize, tsiz)) < 0)
+        if (ctx->mode != mql_mode_precompile) {
+            if (tsiz != 0 || i < ctx->ncolnam) {
+                if ((n = mqi_select_query(ctx->table, where, ctx->coldescs,
+                                          &query, rows, rowsize, dim)) < 0)
                     MQL_ERROR(errno, "select failed: %s", strerror(errno));
             }
             else
                 n = 0;
         }
 
-        switch (mode) {
+        switch (ctx->mode) {
         case mql_mode_parser:
-            fprintf(mqlout, "Selected %d rows:\n", n);
-            print_query_result(coldescs, coltypes, colsizes, n, rowsize, rows);
+            fprintf(ctx->mqlout, "Selected %d rows:\n", n);
+            print_query_result(ctx, ctx->coldescs, coltypes, colsizes,
+                               n, rowsize, rows);
             break;
         case mql_mode_exec:
-            if (rtype == mql_result_rows) {
-                result = mql_result_rows_create(ncolnam, coldescs, coltypes,
-                                                colsizes, n, rowsize, rows);
+            if (ctx->rtype == mql_result_rows) {
+                ctx->result = mql_result_rows_create(ctx->ncolnam,
+                                                     ctx->coldescs, coltypes,
+                                                     colsizes, n, rowsize,
+                                                     rows);
             }
             else {
-                result = mql_result_string_create_row_list(ncolnam, colnams,
-                                                           coldescs, coltypes,
-                                                           colsizes,
-                                                           n, rowsize, rows);
+                ctx->result = mql_result_string_create_row_list(
+                                             ctx->ncolnam, ctx->colnams,
+                                             ctx->coldescs, coltypes, colsizes,
+                                             n, rowsize, rows);
             }
             break;
         case mql_mode_precompile:
-            statement = mql_make_select_statement(table, rowsize,
-                                                  cond - conds, where,
-                                                  ncolnam, colnams, coltypes,
-                                                  colsizes, coldescs); 
+            ctx->statement = mql_make_select_statement(ctx->table, rowsize,
+                                                       ctx->cond - ctx->conds,
+                                                       where, ctx->ncolnam,
+                                                       ctx->colnams, coltypes,
+                                                       colsizes, ctx->coldescs,
+                                                       &query);
             break;
         }
     }
+  }
+| select select_columns TKN_FROM table_name join_clause where_clause {
+    int colsizes[MQI_COLUMN_MAX + 1];
+    mqi_data_type_t coltypes[MQI_COLUMN_MAX + 1];
+    int rowsize;
+    char errbuf[256];
+    int i;
+
+    if (set_select_variables(ctx, &rowsize, coltypes, colsizes,
+                             errbuf, sizeof(errbuf)) < 0)
+        MQL_ERROR(errno, "%s", errbuf);
+
+    for (i = 0;  i < ctx->ncolnam;  i++) {
+        if (ctx->aggregates[i] != mqi_aggregate_none)
+            MQL_ERROR(EINVAL, "aggregates can't be used with JOIN");
+    }
+
+    if (select_join(ctx, rowsize, coltypes, colsizes,
+                    errbuf, sizeof(errbuf)) < 0)
+        MQL_ERROR(errno, "%s", errbuf);
+};
+
+join_clause:
+  TKN_JOIN join_table TKN_ON TKN_IDENTIFIER TKN_EQUAL TKN_IDENTIFIER {
+    int c1, c2;
+
+    if ((c1 = column_index(ctx, $4)) < 0)
+        MQL_ERROR(errno, "invalid JOIN column '%s'", $4);
+    if ((c2 = column_index(ctx, $6)) < 0)
+        MQL_ERROR(errno, "invalid JOIN column '%s'", $6);
+
+    if (c1 < ctx->nleft && c2 >= ctx->nleft) {
+        ctx->lcol = c1;
+        ctx->rcol = c2 - ctx->nleft;
+    }
+    else if (c2 < ctx->nleft && c1 >= ctx->nleft) {
+        ctx->lcol = c2;
+        ctx->rcol = c1 - ctx->nleft;
+    }
+    else
+        MQL_ERROR(EINVAL, "JOIN needs a column of both tables");
+  }
+;
+
+join_table: TKN_IDENTIFIER {
+    if ((ctx->join = mqi_get_table_handle($1)) == MQI_HANDLE_INVALID)
+        MQL_ERROR(errno, "Do not know anything about '%s'", $1);
+
+    if (ctx->join == ctx->table)
+        MQL_ERROR(EINVAL, "can't join '%s' with itself", $1);
+
+    for (ctx->nleft = 0;  mqi_get_column_name(ctx->table, ctx->nleft); )
+        ctx->nleft++;
+};
+
+select_columns:
+  TKN_STAR
+| select_column_list
+;
+
+select_column_list:
+  select_column
+| select_column_list TKN_COMMA select_column
+;
+
+select_column:
+  column
+| aggregate {
+    if (ctx->ncolnam >= MQI_COLUMN_MAX)
+        MQL_ERROR(EOVERFLOW, "Too many columns");
+
+    ctx->colnams[ctx->ncolnam] = $1;
+    ctx->aggregates[ctx->ncolnam] = ctx->aggregate;
+    ctx->aggrcols[ctx->ncolnam] = ctx->aggrcol;
+    ctx->ncolnam++;
+  }
+;
+
+aggregate:
+  TKN_IDENTIFIER TKN_LEFT_PAREN TKN_STAR TKN_RIGHT_PAREN {
+    if (!($$ = set_aggregate(ctx, $1, NULL)))
+        MQL_ERROR(EINVAL, "invalid aggregate '%s(*)'", $1);
+  }
+| TKN_IDENTIFIER TKN_LEFT_PAREN TKN_IDENTIFIER TKN_RIGHT_PAREN {
+    if (!($$ = set_aggregate(ctx, $1, $3)))
+        MQL_ERROR(EINVAL, "invalid aggregate '%s(%s)'", $1, $3);
+  }
+;
+
+group_by_clause:
+  /* no grouping */
+| TKN_GROUP TKN_BY group_column_list
+;
+
+group_column_list:
+  group_column
+| group_column_list TKN_COMMA group_column
+;
+
+group_column: TKN_IDENTIFIER {
+    int cindex;
+
+    if ((cindex = mqi_get_column_index(ctx->table, $1)) < 0)
+        MQL_ERROR(ENOENT, "know nothing about '%s'", $1);
+
+    if (ctx->ngroup >= MQI_COLUMN_MAX)
+        MQL_ERROR(EOVERFLOW, "Too many GROUP BY columns");
+
+    ctx->groups[ctx->ngroup++] = cindex;
 };
 
+order_by_clause:
+  /* no ordering */
+| TKN_ORDER TKN_BY order_column_list
+;
+
+order_column_list:
+  order_column
+| order_column_list TKN_COMMA order_column
+;
+
+order_column:
+  TKN_IDENTIFIER sort_order {
+    if (ctx->norder >= MQI_COLUMN_MAX)
+        MQL_ERROR(EOVERFLOW, "Too many ORDER BY columns");
+
+    ctx->ordnams[ctx->norder] = $1;
+    ctx->orders[ctx->norder++].descending = $2;
+  }
+| aggregate sort_order {
+    if (ctx->norder >= MQI_COLUMN_MAX)
+        MQL_ERROR(EOVERFLOW, "Too many ORDER BY columns");
+
+    ctx->ordnams[ctx->norder] = $1;
+    ctx->orders[ctx->norder++].descending = $2;
+  }
+;
+
+sort_order:
+  /* ascending */   { $$ = false; }
+| TKN_ASC           { $$ = false; }
+| TKN_DESC          { $$ = true;  }
+;
+
+limit_clause:
+  /* no limit */
+| TKN_LIMIT TKN_NUMBER {
+    if ($2 <= 0 || $2 > MQI_QUERY_RESULT_MAX)
+        MQL_ERROR(EINVAL, "invalid LIMIT %lld", $2);
+
+    ctx->limit = $2;
+  }
+;
+
+
+/***********************************
+ *
+ * Explain statement
+ *
+ */
+/*#toplevel#*/
+explain_statement:
+  explain select columns TKN_FROM table_name where_clause {
+    EXPLAIN_PLAN;
+  }
+| explain update table_name TKN_SET assignment_list where_clause {
+    EXPLAIN_PLAN;
+  }
+| explain delete table_name where_clause {
+    EXPLAIN_PLAN;
+  }
+;
+
+explain: TKN_EXPLAIN {
+    if (ctx->mode == mql_mode_precompile)
+        MQL_ERROR(EINVAL, "EXPLAIN statements can't be precompiled");
+
+    if (ctx->mode == mql_mode_exec && ctx->rtype != mql_result_string)
+        MQL_ERROR(EINVAL, "EXPLAIN needs a string result");
+};
 
 select: TKN_SELECT {
-    table = MQI_HANDLE_INVALID;
-    ncolnam = 0;
-    nstr = 0;
-    nint = 0;
-    nuint = 0;
-    nfloat = 0;
-    cond = conds;
-    binds = 0;
+    ctx->table = MQI_HANDLE_INVALID;
+    ctx->join = MQI_HANDLE_INVALID;
+    ctx->ncolnam = 0;
+    ctx->nstr = 0;
+    ctx->nint = 0;
+    ctx->nuint = 0;
+    ctx->nfloat = 0;
+    ctx->cond = ctx->conds;
+    ctx->binds = 0;
+    ctx->ngroup = 0;
+    ctx->norder = 0;
+    ctx->limit = 0;
 };
 
 columns:
@@ -1053,8 +1477,10 @@ transaction:
  *
  */
 table_name: TKN_IDENTIFIER {
-    if ((table = mqi_get_table_handle($1)) == MQI_HANDLE_INVALID)
+    if ((ctx->table = mqi_get_table_handle($1)) == MQI_HANDLE_INVALID)
         MQL_ERROR(errno, "Do not know anything about '%s'", $1);
+
+    ctx->join = MQI_HANDLE_INVALID;
 };
 
 /***********************************
@@ -1063,9 +1489,14 @@ table_name: TKN_IDENTIFIER {
  *
  */
 table_flags:
-  /* no option */ { table_flags = MQI_ANY;        }
-| TKN_PERSISTENT  { table_flags = MQI_PERSISTENT; }
-| TKN_TEMPORARY   { table_flags = MQI_TEMPORARY;  }
+  /* no option */ { ctx->table_flags = MQI_ANY;        }
+| TKN_PERSISTENT  { ctx->table_flags = MQI_PERSISTENT; }
+| TKN_TEMPORARY   { ctx->table_flags = MQI_TEMPORARY;  }
+;
+
+table_layout:
+  /* no option */ { $$ = 0;            }
+| TKN_COLUMNAR    { $$ = MQI_COLUMNAR; }
 ;
 
 /***********************************
@@ -1080,8 +1511,11 @@ column_list:
 ;
 
 column: TKN_IDENTIFIER {
-    if (ncolnam < MQI_COLUMN_MAX)
-        colnams[ncolnam++] = $1;
+    if (ctx->ncolnam < MQI_COLUMN_MAX) {
+        ctx->aggregates[ctx->ncolnam] = mqi_aggregate_none;
+        ctx->aggrcols[ctx->ncolnam] = $1;
+        ctx->colnams[ctx->ncolnam++] = $1;
+    }
     else
         MQL_ERROR(EOVERFLOW, "Too many columns");
 };
@@ -1109,18 +1543,18 @@ floating_input: TKN_FLOATING      { SET_INPUT(floating, $1);              }
 parameter_input: TKN_PARAMETER {
     input_t *input;
 
-    if (mode != mql_mode_precompile) {
+    if (ctx->mode != mql_mode_precompile) {
         MQL_ERROR(EINVAL, "parameters are allowed only in "
                   "precompilation mode");
     }
-    if (binds >= MQL_PARAMETER_MAX) {
+    if (ctx->binds >= MQL_PARAMETER_MAX) {
         MQL_ERROR(EOVERFLOW, "number of parameters exceeds %d",
                   MQL_PARAMETER_MAX);
     }
 
-    input = inputs + ninput++;
+    input = ctx->inputs + ctx->ninput++;
     input->type = $1;
-    input->flags = MQL_BINDABLE | MQL_BIND_INDEX(binds++);
+    input->flags = MQL_BINDABLE | MQL_BIND_INDEX(ctx->binds++);
 
     memset(&input->value, 0, sizeof(input->value));
 };
@@ -1135,9 +1569,9 @@ where_clause:
   /* no where clause  */ {
   }
 | TKN_WHERE conditional_expression {
-    cond->type = mqi_operator;
-    cond->u.operator_ = mqi_end;
-    cond++;
+    ctx->cond->type = mqi_operator;
+    ctx->cond->u.operator_ = mqi_end;
+    ctx->cond++;
   };
 
 
@@ -1165,99 +1599,104 @@ value:
 column_value: TKN_IDENTIFIER {
     int cx;
 
-    if (cond - conds >= MQI_COND_MAX)
+    if (ctx->cond - ctx->conds >= MQI_COND_MAX)
         MQL_ERROR(EOVERFLOW, "too complex condition");
 
-    if ((cx = mqi_get_column_index(table,$1)) < 0)
-        MQL_ERROR(ENOENT, "no column with name '%s'", $1);
+    if ((cx = column_index(ctx, $1)) < 0) {
+        if (errno == ENOENT)
+            MQL_ERROR(ENOENT, "no column with name '%s'", $1);
+        else
+            MQL_ERROR(errno, "ambiguous column name '%s'", $1);
+    }
 
-    cond->type = mqi_column;
-    cond->u.column = cx;
-    cond++;
+    ctx->cond->type = mqi_column;
+    ctx->cond->u.column = cx;
+    ctx->cond++;
 };
 
 string_variable: TKN_QUOTED_STRING {
-    if (cond - conds >= MQI_COND_MAX)
+    if (ctx->cond - ctx->conds >= MQI_COND_MAX)
         MQL_ERROR(EOVERFLOW, "too complex condition");
-    strs[nstr] = $1;
-    cond->type = mqi_variable;
-    cond->u.variable.flags = 0;
-    cond->u.variable.type = mqi_varchar;
-    cond->u.variable.v.varchar = strs + nstr++;
-    cond++;
+    ctx->strs[ctx->nstr] = $1;
+    ctx->cond->type = mqi_variable;
+    ctx->cond->u.variable.flags = 0;
+    ctx->cond->u.variable.type = mqi_varchar;
+    ctx->cond->u.variable.v.varchar = ctx->strs + ctx->nstr++;
+    ctx->cond++;
 };
 
 integer_variable: sign TKN_NUMBER {
-    if (cond - conds >= MQI_COND_MAX)
+    if (ctx->cond - ctx->conds >= MQI_COND_MAX)
         MQL_ERROR(EOVERFLOW, "too complex condition");
-    ints[nint] = $1 * $2;
-    cond->type = mqi_variable;
-    cond->u.variable.type = mqi_integer;
-    cond->u.variable.v.integer = ints + nint++;
-    cond++;
+    ctx->ints[ctx->nint] = $1 * $2;
+    ctx->cond->type = mqi_variable;
+    ctx->cond->u.variable.type = mqi_integer;
+    ctx->cond->u.variable.v.integer = ctx->ints + ctx->nint++;
+    ctx->cond++;
 };
 
 unsigned_variable: TKN_NUMBER {
-    if (cond - conds >= MQI_COND_MAX)
+    if (ctx->cond - ctx->conds >= MQI_COND_MAX)
         MQL_ERROR(EOVERFLOW, "too complex condition");
-    uints[nuint] = $1;
-    cond->type = mqi_variable;
-    cond->u.variable.flags = 0;
-    cond->u.variable.type = mqi_unsignd;
-    cond->u.variable.v.unsignd = uints + nuint++;
-    cond++;
+    ctx->uints[ctx->nuint] = $1;
+    ctx->cond->type = mqi_variable;
+    ctx->cond->u.variable.flags = 0;
+    ctx->cond->u.variable.type = mqi_unsignd;
+    ctx->cond->u.variable.v.unsignd = ctx->uints + ctx->nuint++;
+    ctx->cond++;
 };
 
 floating_variable: floating_value {
-    if (cond - conds >= MQI_COND_MAX)
+    if (ctx->cond - ctx->conds >= MQI_COND_MAX)
         MQL_ERROR(EOVERFLOW, "too complex condition");
-    floats[nfloat] = $1;
-    cond->type = mqi_variable;
-    cond->u.variable.flags = 0;
-    cond->u.variable.type = mqi_floating;
-    cond->u.variable.v.floating = floats + nfloat++;
-    cond++;
+    ctx->floats[ctx->nfloat] = $1;
+    ctx->cond->type = mqi_variable;
+    ctx->cond->u.variable.flags = 0;
+    ctx->cond->u.variable.type = mqi_floating;
+    ctx->cond->u.variable.v.floating = ctx->floats + ctx->nfloat++;
+    ctx->cond++;
 };
 
 floating_value:
-  TKN_FLOATING        { return $1;              }
-| sign TKN_FLOATING   { return (double)$1 * $2; }
+  TKN_FLOATING        { $$ = $1;              }
+| sign TKN_FLOATING   { $$ = (double)$1 * $2; }
+;
 
 
 parameter_value: TKN_PARAMETER {
-    if (mode != mql_mode_precompile) {
+    if (ctx->mode != mql_mode_precompile) {
         MQL_ERROR(EINVAL, "parameters are allowed only in "
                   "precompilation mode");
     }
-    if (binds >= MQL_PARAMETER_MAX) {
+    if (ctx->binds >= MQL_PARAMETER_MAX) {
         MQL_ERROR(EOVERFLOW, "number of parameters exceeds %d",
                   MQL_PARAMETER_MAX);
     }
-    if (cond - conds >= MQI_COND_MAX) {
+    if (ctx->cond - ctx->conds >= MQI_COND_MAX) {
         MQL_ERROR(EOVERFLOW, "too complex condition");
     }
-    cond->type = mqi_variable;
-    cond->u.variable.flags = MQL_BINDABLE | MQL_BIND_INDEX(binds++);
-    cond->u.variable.type = $1;
-    cond->u.variable.v.generic = NULL;
-    cond++;
+    ctx->cond->type = mqi_variable;
+    ctx->cond->u.variable.flags = MQL_BINDABLE | MQL_BIND_INDEX(ctx->binds++);
+    ctx->cond->u.variable.type = $1;
+    ctx->cond->u.variable.v.generic = NULL;
+    ctx->cond++;
 };
 
 expression_value:
   TKN_LEFT_PAREN  {
-    if (cond - conds >= MQI_COND_MAX)
+    if (ctx->cond - ctx->conds >= MQI_COND_MAX)
         MQL_ERROR(EOVERFLOW, "too complex condition");
-    cond->type = mqi_operator;
-    cond->u.operator_ = mqi_begin;
-    cond++;
+    ctx->cond->type = mqi_operator;
+    ctx->cond->u.operator_ = mqi_begin;
+    ctx->cond++;
   }
   conditional_expression
   TKN_RIGHT_PAREN {
-    if (cond - conds >= MQI_COND_MAX)
+    if (ctx->cond - ctx->conds >= MQI_COND_MAX)
         MQL_ERROR(EOVERFLOW, "too complex condition");
-    cond->type = mqi_operator;
-    cond->u.operator_ = mqi_end;
-    cond++;
+    ctx->cond->type = mqi_operator;
+    ctx->cond->u.operator_ = mqi_end;
+    ctx->cond++;
   }
 ;
 
@@ -1270,50 +1709,50 @@ sign:
 
 unary_operator:
   TKN_NOT {
-      cond->type = mqi_operator;
-      cond->u.operator_ = mqi_not;
-      cond++;
+      ctx->cond->type = mqi_operator;
+      ctx->cond->u.operator_ = mqi_not;
+      ctx->cond++;
   }
 ;
 
 relational_operator:
   TKN_LESS {
-      cond->type = mqi_operator;
-      cond->u.operator_ = mqi_less;
-      cond++;
+      ctx->cond->type = mqi_operator;
+      ctx->cond->u.operator_ = mqi_less;
+      ctx->cond++;
   }
 | TKN_LESS_OR_EQUAL {
-    cond->type = mqi_operator;
-    cond->u.operator_ = mqi_leq;
-    cond++;
+    ctx->cond->type = mqi_operator;
+    ctx->cond->u.operator_ = mqi_leq;
+    ctx->cond++;
   }
 | TKN_EQUAL {
-    cond->type = mqi_operator;
-    cond->u.operator_ = mqi_eq;
-    cond++;
+    ctx->cond->type = mqi_operator;
+    ctx->cond->u.operator_ = mqi_eq;
+    ctx->cond++;
   }
 | TKN_GREATER_OR_EQUAL {
-    cond->type = mqi_operator;
-    cond->u.operator_ = mqi_geq;
-    cond++;
+    ctx->cond->type = mqi_operator;
+    ctx->cond->u.operator_ = mqi_geq;
+    ctx->cond++;
   }
 | TKN_GREATER {
-    cond->type = mqi_operator;
-    cond->u.operator_ = mqi_gt;
-    cond++;
+    ctx->cond->type = mqi_operator;
+    ctx->cond->u.operator_ = mqi_gt;
+    ctx->cond++;
   }
 ;
 
 logical_operator:
   TKN_LOGICAL_AND {
-      cond->type = mqi_operator;
-      cond->u.operator_ = mqi_and;
-      cond++;
+      ctx->cond->type = mqi_operator;
+      ctx->cond->u.operator_ = mqi_and;
+      ctx->cond++;
   }
 | TKN_LOGICAL_OR {
-    cond->type = mqi_operator;
-    cond->u.operator_ = mqi_or;
-    cond++;
+    ctx->cond->type = mqi_operator;
+    ctx->cond->u.operator_ = mqi_or;
+    ctx->cond++;
   }
 ;
 
@@ -1323,43 +1762,49 @@ logical_operator:
 
 int mql_exec_file(const char *path)
 {
+    mql_parser_t ctx;
     char buf[1024];
     int sts;
 
-    mode   = mql_mode_parser;
-    rtype  = mql_result_unknown;
-    mqlbuf = NULL;
-    mqlout = stderr;
-    
+    parser_init(&ctx, mql_mode_parser, mql_result_unknown);
+    ctx.mqlout = stderr;
+
+    /* a script is executed as a whole wrt. other threads */
+    if (mqi_write_lock() < 0)
+        return -1;
+
     if (!path) {
-        mqlin = fileno(stdin);
-        sts = yy_mql_parse() ? -1 : 0;
+        ctx.mqlin = fileno(stdin);
+        sts = parse(&ctx) ? -1 : 0;
     }
     else {
         strncpy(buf, path, sizeof(buf));
         buf[sizeof(buf)-1] = '\0';
         
-        file = basename(buf);
+        ctx.file = basename(buf);
 
-        if ((mqlin = open(path, O_RDONLY)) < 0) {
+        if ((ctx.mqlin = open(path, O_RDONLY)) < 0) {
             sts = -1;
-            fprintf(mqlout, "could not open file '%s': %s\n",
+            fprintf(ctx.mqlout, "could not open file '%s': %s\n",
                     path, strerror(errno));
         }
         else {
-            sts = yy_mql_parse() ? -1 : 0;
-            close(mqlin);
+            sts = parse(&ctx) ? -1 : 0;
+            close(ctx.mqlin);
         }
     }
 
-    mqlin = -1;
-    
+    mqi_unlock();
+
     return sts;
 }
 
 
-mql_result_t *mql_exec_string(mql_result_type_t result_type, const char *str)
+mql_result_t *mql_exec_string_parse(mql_result_type_t  result_type,
+                                    const char        *str)
 {
+    mql_parser_t ctx;
+
     if (result_type == mql_result_dontcare)
         result_type = mql_result_string;
 
@@ -1369,53 +1814,56 @@ mql_result_t *mql_exec_string(mql_result_type_t result_type, const char *str)
                   result_type == mql_result_string  ) && 
                  str, NULL);
 
-    mode = mql_mode_exec;
-    result = NULL;
-    rtype  = result_type;
-    mqlbuf = str;
+    parser_init(&ctx, mql_mode_exec, result_type);
+    ctx.mqlbuf = str;
 
-    if (yy_mql_parse() && !result) {
-        result = mql_result_error_create(EIO, "Syntax error in '%s'", str);
+    if (parse(&ctx) && !ctx.result) {
+        ctx.result = mql_result_error_create(EIO, "Syntax error in '%s'", str);
     }
 
 
-    return result;
+    return ctx.result;
 }
 
 mql_statement_t *mql_precompile(const char *str)
 {
+    mql_parser_t ctx;
+
     MDB_CHECKARG(str, NULL);
 
-    mode = mql_mode_precompile;
-    rtype = mql_result_unknown;
-    statement = NULL;
-    mqlbuf = str;
-    
-    yy_mql_parse();
+    parser_init(&ctx, mql_mode_precompile, mql_result_unknown);
+    ctx.mqlbuf = str;
+
+    if (mqi_read_lock() < 0)
+        return NULL;
+
+    parse(&ctx);
 
-    return statement;
+    mqi_unlock();
+
+    return ctx.statement;
 } 
 
-int yy_mql_input(void *dst, unsigned dstlen)
+int yy_mql_input(mql_parser_t *ctx, void *dst, unsigned dstlen)
 {
     int len = 0;
 
     if (dst && dstlen > 0) {
 
-        if (mqlbuf) {
-            if ((len = strlen(mqlbuf)) < 1)
+        if (ctx->mqlbuf) {
+            if ((len = strlen(ctx->mqlbuf)) < 1)
                 len = 0;
             else if ((unsigned)len + 1 <= dstlen) {
-                memcpy(dst, mqlbuf, len + 1);
-                mqlbuf += len;
+                memcpy(dst, ctx->mqlbuf, len + 1);
+                ctx->mqlbuf += len;
             }
             else {
-                memcpy(dst, mqlbuf, dstlen);
-                mqlbuf += dstlen;
+                memcpy(dst, ctx->mqlbuf, dstlen);
+                ctx->mqlbuf += dstlen;
             }
         }
-        else if (mqlin >= 0) {
-            while ((len = read(mqlin, dst, dstlen)) < 0) {
+        else if (ctx->mqlin >= 0) {
+            while ((len = read(ctx->mqlin, dst, dstlen)) < 0) {
                 if (errno != EINTR) {
                     break;
                 }
@@ -1426,43 +1874,209 @@ int yy_mql_input(void *dst, unsigned dstlen)
     return len;
 }
 
+char *yy_mql_copy_string(mql_parser_t *ctx, const char *string)
+{
+    char       *bufend = ctx->ringbuf + sizeof(ctx->ringbuf) - 1;
+    const char *src;
+    char       *copy;
+    char        qt;
+
+    for (;;) {
+        if (ctx->bufptr >= bufend)
+            ctx->bufptr = ctx->ringbuf;
+
+        copy = ctx->bufptr;
+
+        switch (*(src = string)) {
+        case '\'':  qt = *src++;   break;
+        case '\"':  qt = *src++;   break;
+        default:    qt =  0xff;    break;
+        }
+
+        while (ctx->bufptr < bufend) {
+            if (!(*ctx->bufptr++ = *src++)) {
+                if (ctx->bufptr[-2] == qt)
+                    (--ctx->bufptr)[-1] = '\0';
+                return copy;
+            }
+        }
+    }
+}
+
+
+void yy_mql_error(mql_parser_t *ctx, void *scanner, const char *msg)
+{
+    MQI_UNUSED(scanner);
+
+    if (ctx->mode == mql_mode_parser)
+        fprintf(ctx->mqlout, "Error: '%s'\n", msg);
+}
+
+
+static void parser_init(mql_parser_t      *ctx,
+                        mql_mode_t         mode,
+                        mql_result_type_t  rtype)
+{
+    memset(ctx, 0, sizeof(*ctx));
+
+    ctx->mode   = mode;
+    ctx->rtype  = rtype;
+    ctx->mqlin  = -1;
+    ctx->table  = MQI_HANDLE_INVALID;
+    ctx->join   = MQI_HANDLE_INVALID;
+    ctx->coldef = ctx->coldefs;
+    ctx->cond   = ctx->conds;
+    ctx->bufptr = ctx->ringbuf;
+}
+
 
-void yy_mql_error(const char *msg)
+static int parse(mql_parser_t *ctx)
 {
-    if (mode == mql_mode_parser)
-        fprintf(mqlout, "Error: '%s'\n", msg);
+    void *scanner;
+    int   sts;
+
+    if (yy_mql_lex_init_extra(ctx, &scanner) != 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    sts = yy_mql_parse(ctx, scanner);
+
+    yy_mql_lex_destroy(scanner);
+
+    reset_insert_rows(ctx);
+    free(ctx->rows);
+    ctx->rows = NULL;
+
+    return sts;
+}
+
+
+/*
+ * the values of an INSERT row are moved out of the input buffer, and its
+ * strings out of the ring buffer that a long list of rows would wrap
+ */
+static int add_insert_row(mql_parser_t *ctx)
+{
+    input_t *rows;
+    input_t *inp;
+    char    *str;
+    int      err;
+    int      i;
+
+    if (ctx->nrow > 0 && ctx->ninput != ctx->rowlen) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    rows = realloc(ctx->rows, sizeof(input_t) * ctx->ninput * (ctx->nrow+1));
+
+    if (!rows) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    ctx->rows   = rows;
+    ctx->rowlen = ctx->ninput;
+
+    inp = rows + ctx->nrow++ * ctx->rowlen;
+
+    for (i = 0, err = 0;  i < ctx->ninput;  i++, inp++) {
+        *inp = ctx->inputs[i];
+
+        if (inp->type == mqi_varchar && (str = inp->value.varchar)) {
+            if (!(inp->value.varchar = strdup(str)))
+                err = ENOMEM;
+        }
+    }
+
+    ctx->ninput = 0;
+
+    if (err) {
+        errno = err;
+        return -1;
+    }
+
+    return 0;
 }
 
+static void reset_insert_rows(mql_parser_t *ctx)
+{
+    input_t *inp;
+    int      n;
 
-static int set_select_variables(int *rowsize,
+    for (inp = ctx->rows, n = ctx->nrow * ctx->rowlen;  n > 0;  inp++, n--) {
+        if (inp->type == mqi_varchar)
+            free(inp->value.varchar);
+    }
+
+    ctx->nrow   = 0;
+    ctx->rowlen = 0;
+}
+
+static int set_select_variables(mql_parser_t *ctx,
+                                int *rowsize,
                                 mqi_data_type_t *coltypes,
                                 int *colsizes,
                                 char *errbuf, int elgh)
 {
     mqi_column_desc_t *cd;
+    mqi_aggregate_t aggregate;
     int i;
     int rlgh;
     int colsize;
     int colidx;
     mqi_data_type_t coltype;
+    bool star;
 
-    if (!ncolnam) {
-        while ((colnams[ncolnam] = mqi_get_column_name(table, ncolnam)))
-            ncolnam++;
+    if ((star = !ctx->ncolnam)) {
+        while ((ctx->colnams[ctx->ncolnam] = column_name(ctx, ctx->ncolnam)))
+        {
+            ctx->aggregates[ctx->ncolnam] = mqi_aggregate_none;
+            ctx->aggrcols[ctx->ncolnam] = ctx->colnams[ctx->ncolnam];
+            ctx->ncolnam++;
+        }
     }
 
-    for (i = 0, rlgh = 0;  i < ncolnam;   i++) {
-        cd = coldescs + i;
-        
-        if ((colidx  = mqi_get_column_index(table, colnams[i])) < 0 ||
-            (colsize = mqi_get_column_size(table, colidx))      < 0 ||
-            (coltype = mqi_get_column_type(table, colidx)) == mqi_error)
+    for (i = 0, rlgh = 0;  i < ctx->ncolnam;   i++) {
+        cd = ctx->coldescs + i;
+        aggregate = ctx->aggregates[i];
+
+        /* COUNT(*) counts rows, any column does; the names of '*'
+           need not be unique in a join */
+        if (star)
+            colidx = i;
+        else if (!ctx->aggrcols[i])
+            colidx = 0;
+        else if ((colidx = column_index(ctx, ctx->aggrcols[i])) < 0)
+            colidx = -1;
+
+        if (colidx < 0 ||
+            (colsize = column_size(ctx, colidx))      < 0 ||
+            (coltype = column_type(ctx, colidx)) == mqi_error)
         {
-            snprintf(errbuf, elgh, "invalid column '%s'", colnams[i]);
+            snprintf(errbuf, elgh, "invalid column '%s'", ctx->colnams[i]);
             return -1;
         }
+
+        if (aggregate != mqi_aggregate_none) {
+            if ((coltype = mqi_aggregate_type(aggregate,coltype)) == mqi_error){
+                snprintf(errbuf, elgh, "invalid aggregate '%s'",
+                         ctx->colnams[i]);
+                errno = EINVAL;
+                return -1;
+            }
+
+            switch (coltype) {
+            case mqi_unsignd:   colsize = sizeof(uint32_t);   break;
+            case mqi_floating:  colsize = sizeof(double);     break;
+            default:                                          break;
+            }
+        }
+
         cd->cindex = colidx;
         cd->offset = rlgh;
+        cd->aggregate = aggregate;
         
         coltypes[i] = coltype;
         colsizes[i] = colsize;
@@ -1477,9 +2091,10 @@ static int set_select_variables(int *rowsize,
         }
     } /* for */
     
-    cd = coldescs + i;
+    cd = ctx->coldescs + i;
     cd->cindex = -1;
     cd->offset = -1;
+    cd->aggregate = mqi_aggregate_none;
 
     *rowsize = rlgh;
 
@@ -1487,7 +2102,241 @@ static int set_select_variables(int *rowsize,
 }
 
 
-static void print_query_result(mqi_column_desc_t *coldescs,
+/*
+ * ORDER BY columns refer to the selected ones, either by name or by
+ * the same aggregate expression
+ */
+static int set_query_variables(mql_parser_t *ctx,
+                               mqi_query_t *query,
+                               char *errbuf, int elgh)
+{
+    int i, j;
+
+    for (i = 0;  i < ctx->norder;  i++) {
+        for (j = 0;  j < ctx->ncolnam;  j++) {
+            if (!strcmp(ctx->ordnams[i], ctx->colnams[j]))
+                break;
+        }
+
+        if (j >= ctx->ncolnam) {
+            snprintf(errbuf, elgh, "ORDER BY column '%s' is not selected",
+                     ctx->ordnams[i]);
+            errno = EINVAL;
+            return -1;
+        }
+
+        ctx->orders[i].column = j;
+    }
+
+    ctx->orders[ctx->norder].column = -1;
+    ctx->groups[ctx->ngroup] = -1;
+
+    query->group_by = ctx->ngroup ? ctx->groups : NULL;
+    query->order_by = ctx->norder ? ctx->orders : NULL;
+    query->limit    = ctx->limit;
+
+    return 0;
+}
+
+
+/*
+ * the columns of a joined table follow the ones of the first table;
+ * in a join the column names are either qualified with the table name
+ * or unique across the two tables
+ */
+static int column_index(mql_parser_t *ctx, char *name)
+{
+    char          tblnam[256];
+    char         *dot;
+    mqi_handle_t  h;
+    int           l, r;
+
+    if ((dot = strchr(name, '.'))) {
+        if (dot - name >= (int)sizeof(tblnam))
+            goto not_found;
+
+        memcpy(tblnam, name, dot - name);
+        tblnam[dot - name] = '\0';
+        name = dot + 1;
+
+        if ((h = mqi_get_table_handle(tblnam)) == MQI_HANDLE_INVALID)
+            goto not_found;
+
+        if (h == ctx->table)
+            l = mqi_get_column_index(ctx->table, name);
+        else if (h == ctx->join) {
+            if ((l = mqi_get_column_index(ctx->join, name)) >= 0)
+                l += ctx->nleft;
+        }
+        else
+            l = -1;
+
+        if (l < 0)
+            goto not_found;
+
+        return l;
+    }
+
+    l = mqi_get_column_index(ctx->table, name);
+
+    if (ctx->join != MQI_HANDLE_INVALID) {
+        if ((r = mqi_get_column_index(ctx->join, name)) >= 0) {
+            if (l >= 0) {
+                errno = EINVAL;
+                return -1;
+            }
+
+            return ctx->nleft + r;
+        }
+    }
+
+    if (l < 0)
+        goto not_found;
+
+    return l;
+
+ not_found:
+    errno = ENOENT;
+    return -1;
+}
+
+static char *column_name(mql_parser_t *ctx, int cindex)
+{
+    if (ctx->join != MQI_HANDLE_INVALID && cindex >= ctx->nleft)
+        return mqi_get_column_name(ctx->join, cindex - ctx->nleft);
+
+    return mqi_get_column_name(ctx->table, cindex);
+}
+
+static mqi_data_type_t column_type(mql_parser_t *ctx, int cindex)
+{
+    if (ctx->join != MQI_HANDLE_INVALID && cindex >= ctx->nleft)
+        return mqi_get_column_type(ctx->join, cindex - ctx->nleft);
+
+    return mqi_get_column_type(ctx->table, cindex);
+}
+
+static int column_size(mql_parser_t *ctx, int cindex)
+{
+    if (ctx->join != MQI_HANDLE_INVALID && cindex >= ctx->nleft)
+        return mqi_get_column_size(ctx->join, cindex - ctx->nleft);
+
+    return mqi_get_column_size(ctx->table, cindex);
+}
+
+
+static int select_join(mql_parser_t    *ctx,
+                       int              rowsize,
+                       mqi_data_type_t *coltypes,
+                       int             *colsizes,
+                       char            *errbuf,
+                       int              elgh)
+{
+    mqi_cond_entry_t *where = (ctx->cond == ctx->conds) ? NULL : ctx->conds;
+    long long         dim;
+    int               lsiz, rsiz;
+    void             *rows;
+    int               err;
+    int               n;
+
+    if (ctx->mode == mql_mode_precompile) {
+        ctx->statement = mql_make_join_statement(ctx->table, ctx->lcol,
+                                                 ctx->join, ctx->rcol,
+                                                 rowsize,
+                                                 ctx->cond - ctx->conds,
+                                                 where, ctx->ncolnam,
+                                                 ctx->colnams, coltypes,
+                                                 colsizes, ctx->coldescs);
+        return 0;
+    }
+
+    if ((lsiz = mqi_get_table_size(ctx->table)) < 0 ||
+        (rsiz = mqi_get_table_size(ctx->join))  < 0  )
+    {
+        err = errno;
+        snprintf(errbuf, elgh, "can't get table size: %s", strerror(err));
+        errno = err;
+        return -1;
+    }
+
+    if ((dim = (long long)lsiz * rsiz) > MQI_QUERY_RESULT_MAX)
+        dim = MQI_QUERY_RESULT_MAX;
+
+    if (!(rows = malloc((dim ? dim : 1) * rowsize))) {
+        snprintf(errbuf, elgh, "select failed: %s", strerror(ENOMEM));
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if (!dim)
+        n = 0;
+    else if ((n = mqi_select_join(ctx->table, ctx->lcol, ctx->join, ctx->rcol,
+                                  where, ctx->coldescs, rows, rowsize,
+                                  dim)) < 0)
+    {
+        err = errno;
+        snprintf(errbuf, elgh, "select failed: %s", strerror(err));
+        free(rows);
+        errno = err;
+        return -1;
+    }
+
+    switch (ctx->mode) {
+    case mql_mode_parser:
+        fprintf(ctx->mqlout, "Selected %d rows:\n", n);
+        print_query_result(ctx, ctx->coldescs, coltypes, colsizes,
+                           n, rowsize, rows);
+        break;
+    case mql_mode_exec:
+        if (ctx->rtype == mql_result_rows) {
+            ctx->result = mql_result_rows_create(ctx->ncolnam, ctx->coldescs,
+                                                 coltypes, colsizes, n,
+                                                 rowsize, rows);
+        }
+        else {
+            ctx->result = mql_result_string_create_row_list(
+                                             ctx->ncolnam, ctx->colnams,
+                                             ctx->coldescs, coltypes, colsizes,
+                                             n, rowsize, rows);
+        }
+        break;
+    default:
+        break;
+    }
+
+    free(rows);
+
+    return 0;
+}
+
+
+static char *set_aggregate(mql_parser_t *ctx, const char *func, char *column)
+{
+    mqi_aggregate_t aggregate;
+    const char *name;
+    char buf[256];
+
+    for (aggregate = mqi_count;  aggregate <= mqi_avg;  aggregate++) {
+        name = mqi_aggregate_str(aggregate);
+
+        if (!strcasecmp(func, name))
+            break;
+    }
+
+    if (aggregate > mqi_avg || (!column && aggregate != mqi_count))
+        return NULL;
+
+    ctx->aggregate = aggregate;
+    ctx->aggrcol   = column;
+
+    snprintf(buf, sizeof(buf), "%s(%s)", name, column ? column : "*");
+
+    return yy_mql_copy_string(ctx, buf);
+}
+
+
+static void print_query_result(mql_parser_t      *ctx,
+                               mqi_column_desc_t *coldescs,
                                mqi_data_type_t   *coltypes,
                                int               *colsizes,
                                int                nresult,
@@ -1501,8 +2350,8 @@ static void print_query_result(mqi_column_desc_t *coldescs,
     int   clghs[MQI_COLUMN_MAX + 1];
     int   n;
 
-    for (j = 0, n = 0;  j < ncolnam;  j++) {
-        snprintf(name, sizeof(name),  "%s", colnams[j]);
+    for (j = 0, n = 0;  j < ctx->ncolnam;  j++) {
+        snprintf(name, sizeof(name),  "%s", ctx->colnams[j]);
 
         switch (coltypes[j]) {
         case mqi_varchar:   clgh = colsizes[j] - 1;  break;
@@ -1517,7 +2366,7 @@ static void print_query_result(mqi_column_desc_t *coldescs,
         if (clgh < (int)sizeof(name))
             name[clgh] = '\0';
 
-        n += fprintf(mqlout, "%s%*s", j?" ":"", clgh,name);
+        n += fprintf(ctx->mqlout, "%s%*s", j?" ":"", clgh,name);
 
     }
 
@@ -1526,18 +2375,18 @@ static void print_query_result(mqi_column_desc_t *coldescs,
     memset(name, '-', n);
     name[n] = '\0';
 
-    fprintf(mqlout, "\n%s\n", name);
+    fprintf(ctx->mqlout, "\n%s\n", name);
 
 
 
     for (i = 0, recoffs = 0;  i < nresult;  i++, recoffs += recsize) {
-        for (j = 0;  j < ncolnam;  j++) {
-            if (j) fprintf(mqlout, " ");
+        for (j = 0;  j < ctx->ncolnam;  j++) {
+            if (j) fprintf(ctx->mqlout, " ");
 
             data = results + (recoffs + coldescs[j].offset);
             clgh = clghs[j];
 
-#define PRINT(t,f) fprintf(mqlout, f, clgh, *(t *)data)
+#define PRINT(t,f) fprintf(ctx->mqlout, f, clgh, *(t *)data)
 
             switch (coltypes[j]) {
             case mqi_varchar:     PRINT(char *  , "%*s"   );    break;
@@ -1551,7 +2400,7 @@ static void print_query_result(mqi_column_desc_t *coldescs,
 #undef PRINT
 
         }
-        fprintf(mqlout, "\n");
+        fprintf(ctx->mqlout, "\n");
     }
 }
 
@@ -39,12 +39,15 @@
 #include <murphy-db/mql-result.h>
 #include "mql-parser.h"
 
+#define ROWS_ALLOC_MIN  16
+
 typedef struct column_desc_s           column_desc_t;
 typedef struct error_desc_s            error_desc_t;
 typedef struct result_error_s          result_error_t;
 typedef struct result_event_s          result_event_t;
 typedef struct result_event_colchg_s   result_event_colchg_t;
 typedef struct result_event_rowchg_s   result_event_rowchg_t;
+typedef struct result_event_changes_s  result_event_changes_t;
 typedef struct result_event_table_s    result_event_table_t;
 typedef struct result_event_transact_s result_event_transact_t;
 typedef struct result_columns_s        result_columns_t;
@@ -91,6 +94,18 @@ struct result_event_rowchg_s {
     mql_result_t         *select;
 };
 
+struct result_event_changes_s {
+    mql_result_type_t     type;
+    mqi_event_type_t      event;
+    mqi_handle_t          table;
+    mql_result_t         *select;
+    int                   nrow;
+    struct {
+        mqi_change_type_t change;
+        mqi_bitfld_t      colmask;
+    }                     rows[0];
+};
+
 struct result_event_table_s {
     mql_result_type_t     type;
     mqi_event_type_t      event;
@@ -113,6 +128,7 @@ struct result_rows_s {
     int                   rowsize;
     int                   ncol;
     int                   nrow;
+    int                   nalloc;     /* rows the data area has room for */
     void                 *data;
     column_desc_t         cols[0];
 };
@@ -140,6 +156,7 @@ struct result_list_s {
 
 static inline mqi_data_type_t get_column_type(result_rows_t *, int);
 static inline void *get_column_address(result_rows_t *, int, int);
+static inline void *get_row_address(result_rows_t *, int);
 
 
 int mql_result_is_success(mql_result_t *r)
@@ -241,6 +258,12 @@ mql_result_t *mql_result_event_get_changed_rows(mql_result_t *r)
 
     ev = (result_event_t *) r;
 
+    if (ev->event == mqi_rows_changed)
+        return ((result_event_changes_t *)ev)->select;
+
+    if (ev->event == mqi_column_changed)
+        return ((result_event_colchg_t *)ev)->select;
+
     if (ev->event != mqi_row_deleted && ev->event != mqi_row_inserted)
         return NULL;
 
@@ -249,6 +272,30 @@ mql_result_t *mql_result_event_get_changed_rows(mql_result_t *r)
     return rowchg_ev->select;
 }
 
+mqi_change_type_t mql_result_event_get_change_type(mql_result_t *r, int rowidx)
+{
+    result_event_changes_t *rslt = (result_event_changes_t *)r;
+
+    MDB_CHECKARG(rslt && rslt->type == mql_result_event &&
+                 rslt->event == mqi_rows_changed &&
+                 rowidx >= 0 && rowidx < rslt->nrow, mqi_change_unknown);
+
+    return rslt->rows[rowidx].change;
+}
+
+mqi_bitfld_t mql_result_event_get_change_mask(mql_result_t *r, int rowidx)
+{
+    static mqi_bitfld_t     none;
+
+    result_event_changes_t *rslt = (result_event_changes_t *)r;
+
+    MDB_CHECKARG(rslt && rslt->type == mql_result_event &&
+                 rslt->event == mqi_rows_changed &&
+                 rowidx >= 0 && rowidx < rslt->nrow, none);
+
+    return rslt->rows[rowidx].colmask;
+}
+
 mql_result_t *mql_result_event_column_change_create(mqi_handle_t        table,
                                                     int                 column,
                                                     mqi_change_value_t *value,
@@ -340,6 +387,40 @@ mql_result_t *mql_result_event_row_change_create(mqi_event_type_t    event,
 }
 
 
+mql_result_t *mql_result_event_changefeed_create(mqi_handle_t      table,
+                                                int               nrow,
+                                                mqi_change_row_t *rows,
+                                                mql_result_t     *select)
+{
+    result_event_changes_t *rslt;
+    size_t size;
+    int i;
+
+    MDB_CHECKARG(table != MQI_HANDLE_INVALID && nrow > 0 && rows &&
+                 select && select->type == mql_result_rows, NULL);
+
+    size = sizeof(result_event_changes_t) + sizeof(rslt->rows[0]) * nrow;
+
+    if (!(rslt = calloc(1, size))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    rslt->type   = mql_result_event;
+    rslt->event  = mqi_rows_changed;
+    rslt->table  = table;
+    rslt->select = select;
+    rslt->nrow   = nrow;
+
+    for (i = 0;  i < nrow;  i++) {
+        rslt->rows[i].change  = rows[i].change;
+        rslt->rows[i].colmask = rows[i].colmask;
+    }
+
+    return (mql_result_t *)rslt;
+}
+
+
 mql_result_t *mql_result_event_table_create(mqi_event_type_t  event,
                                             mqi_handle_t      table)
 {
@@ -477,6 +558,28 @@ mql_result_t *mql_result_rows_create(int                ncol,
                                      int                nrow,
                                      int                rowsize,
                                      void              *rows)
+{
+    mql_result_t *rslt;
+
+    MDB_CHECKARG(colsizes && rows, NULL);
+
+    rslt = mql_result_rows_alloc(ncol, coldescs, coltypes, nrow, rowsize);
+
+    if (rslt && nrow > 0)
+        memcpy(((result_rows_t *)rslt)->data, rows, rowsize * nrow);
+
+    return rslt;
+}
+
+/*
+ * rows results can also be filled in place: allocate them with room for
+ * the rows (whose content is left undefined) and add more rows on the go
+ */
+mql_result_t *mql_result_rows_alloc(int                ncol,
+                                    mqi_column_desc_t *coldescs,
+                                    mqi_data_type_t   *coltypes,
+                                    int                nrow,
+                                    int                rowsize)
 {
     result_rows_t     *rslt;
     column_desc_t     *col;
@@ -486,8 +589,8 @@ mql_result_t *mql_result_rows_create(int                ncol,
     size_t             dlgh;
     int                i;
 
-    MDB_CHECKARG(ncol >  0 && coldescs && coltypes && colsizes &&
-                 nrow >= 0 && rowsize > 0 && rows, NULL);
+    MDB_CHECKARG(ncol >  0 && coldescs && coltypes &&
+                 nrow >= 0 && rowsize > 0, NULL);
 
     offs = sizeof(column_desc_t) * ncol;
     dlgh = rowsize * nrow;
@@ -503,6 +606,7 @@ mql_result_t *mql_result_rows_create(int                ncol,
     rslt->rowsize = rowsize;
     rslt->ncol    = ncol;
     rslt->nrow    = nrow;
+    rslt->nalloc  = nrow;
     rslt->data    = rslt->cols + ncol;
 
     for (i = 0;   i < ncol;  i++) {
@@ -514,12 +618,66 @@ mql_result_t *mql_result_rows_create(int                ncol,
         col->offset = cd->offset;
     }
 
-    if (dlgh > 0)
-        memcpy(rslt->data, rows, dlgh);
-
     return (mql_result_t *)rslt;
 }
 
+void *mql_result_rows_add(mql_result_t **r, int nrow)
+{
+    result_rows_t *rslt;
+    int            nalloc;
+    size_t         size;
+
+    MDB_CHECKARG(r && *r && (*r)->type == mql_result_rows && nrow >= 0, NULL);
+
+    rslt = (result_rows_t *)*r;
+
+    if (rslt->nrow + nrow > rslt->nalloc) {
+        nalloc = rslt->nalloc ? rslt->nalloc : ROWS_ALLOC_MIN;
+
+        while (nalloc < rslt->nrow + nrow)
+            nalloc *= 2;
+
+        size = sizeof(result_rows_t) + sizeof(column_desc_t) * rslt->ncol +
+               (size_t)rslt->rowsize * nalloc;
+
+        if (!(rslt = realloc(rslt, size))) {
+            errno = ENOMEM;
+            return NULL;
+        }
+
+        rslt->nalloc = nalloc;
+        rslt->data   = rslt->cols + rslt->ncol;
+
+        *r = (mql_result_t *)rslt;
+    }
+
+    rslt->nrow += nrow;
+
+    return get_row_address(rslt, rslt->nrow - nrow);
+}
+
+void *mql_result_rows_get_row(mql_result_t *r, int rowidx)
+{
+    result_rows_t *rslt = (result_rows_t *)r;
+
+    MDB_CHECKARG(rslt && rslt->type == mql_result_rows &&
+                 rowidx >= 0 && rowidx <= rslt->nrow, NULL);
+
+    return get_row_address(rslt, rowidx);
+}
+
+int mql_result_rows_truncate(mql_result_t *r, int nrow)
+{
+    result_rows_t *rslt = (result_rows_t *)r;
+
+    MDB_CHECKARG(rslt && rslt->type == mql_result_rows &&
+                 nrow >= 0 && nrow <= rslt->nrow, -1);
+
+    rslt->nrow = nrow;
+
+    return 0;
+}
+
 
 int mql_result_rows_get_row_column_count(mql_result_t *r)
 {
@@ -744,6 +902,28 @@ mql_result_t *mql_result_string_create_table_list(int n, char **names)
     return (mql_result_t *)rslt;
 }
 
+mql_result_t *mql_result_string_create_plan(const char *plan)
+{
+    result_string_t *rslt;
+    int              len;
+
+    MDB_CHECKARG(plan, NULL);
+
+    len = strlen(plan) + 1;
+
+    if (!(rslt = calloc(1, sizeof(result_string_t) + len))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    rslt->type = mql_result_string;
+    rslt->length = len;
+
+    memcpy(rslt->string, plan, len);
+
+    return (mql_result_t *)rslt;
+}
+
 mql_result_t *mql_result_string_create_column_change(const char         *table,
                                                      const char         *col,
                                                      mqi_change_value_t *value,
@@ -870,10 +1050,17 @@ mql_result_t *mql_result_string_create_row_change(mqi_event_type_t    event,
     char            *p;
     int              i;
 
-    MDB_CHECKARG((event == mqi_row_inserted || event == mqi_row_deleted) &&
+    MDB_CHECKARG((event == mqi_row_inserted || event == mqi_row_deleted ||
+                  event == mqi_rows_changed || event == mqi_column_changed) &&
                  table && rsel && rsel->type == mql_result_string, NULL);
 
-    cstr[EVENT] = (event==mqi_row_inserted) ? "'row inserted'":"'row deleted'";
+    switch (event) {
+    case mqi_row_inserted:   cstr[EVENT] = "'row inserted'";     break;
+    case mqi_row_deleted:    cstr[EVENT] = "'row deleted'";      break;
+    case mqi_column_changed: cstr[EVENT] = "'column changed'";   break;
+    default:                 cstr[EVENT] = "'rows changed'";     break;
+    }
+
     cstr[TABLE] = table;
 
     for (i = 0;  i < FLDS;  i++)
@@ -1157,6 +1344,18 @@ mql_result_t *mql_result_string_create_row_list(int                 ncol,
         default:            cwidth = 0;                break;
         }
 
+        /* varchars of no fixed size are as wide as their longest value */
+        if (cwidth < 0) {
+            cwidth = strlen(colnams[i]) + 1;
+
+            for (j = 0, row = rows;  j < nrow;  j++, row += rowsize) {
+                column = row + coldescs[i].offset;
+
+                if ((int)strlen(*(char **)column) > cwidth)
+                    cwidth = strlen(*(char **)column);
+            }
+        }
+
         rwidth += (cwidths[i] = cwidth);
     }
 
@@ -1444,6 +1643,12 @@ void mql_result_free(mql_result_t *r)
                 if (select && select->type == mql_result_rows)
                     mql_result_free(colchg->select);
             }
+            else if (colchg->event == mqi_rows_changed) {
+                select = ((result_event_changes_t *)r)->select;
+
+                if (select && select->type == mql_result_rows)
+                    mql_result_free(select);
+            }
         }
 
         free(r);
@@ -1461,6 +1666,11 @@ static void *get_column_address(result_rows_t *rslt, int cx, int rx)
     return rslt->data + (rslt->rowsize * rx + rslt->cols[cx].offset);
 }
 
+static void *get_row_address(result_rows_t *rslt, int rx)
+{
+    return rslt->data + rslt->rowsize * rx;
+}
+
 /*
  * Local Variables:
  * c-basic-offset: 4
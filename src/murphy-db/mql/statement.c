@@ -31,7 +31,6 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
-#include <alloca.h>
 #include <errno.h>
 
 #include <murphy-db/assert.h>
@@ -70,7 +69,8 @@ typedef struct {
     int                  ignore;
     int                  ncolumn;
     mqi_column_desc_t   *columns;
-    void                *rows[2];
+    int                  nrow;
+    value_t             *rows;          /* nrow times ncolumn values */
     int                  nbind;
     value_t              values[0];
 } insert_statement_t;
@@ -102,6 +102,11 @@ typedef struct {
     mqi_data_type_t     *coltypes;
     int                 *colsizes;
     mqi_cond_entry_t    *cond;
+    mqi_query_t          query;
+    bool                 summary;    /* a single row even without rows */
+    mqi_handle_t         join;       /* right table of a join or invalid */
+    int                  lcol;       /* join column of the left table */
+    int                  rcol;       /* join column of the right table */
     int                  nbind;
     value_t              values[0];
 } select_statement_t;
@@ -126,6 +131,9 @@ static mql_result_t *exec_insert(insert_statement_t *);
 static mql_result_t *exec_update(update_statement_t *);
 static mql_result_t *exec_delete(delete_statement_t *);
 static mql_result_t *exec_select(mql_result_type_t, select_statement_t *);
+static mql_result_t *select_rows(select_statement_t *);
+static mql_result_t *select_query(select_statement_t *);
+static mql_result_t *select_join(select_statement_t *);
 
 static int bind_update_value(update_statement_t *,int,mqi_data_type_t,va_list);
 static int bind_delete_value(delete_statement_t *,int,mqi_data_type_t,va_list);
@@ -191,6 +199,8 @@ mql_statement_t *mql_make_insert_statement(mqi_handle_t       table,
                                            int                ncolumn,
                                            mqi_data_type_t   *coltypes,
                                            mqi_column_desc_t *columns,
+                                           int                nrow,
+                                           int                rowsize,
                                            void              *data)
 {
     insert_statement_t *ins;
@@ -203,14 +213,19 @@ mql_statement_t *mql_make_insert_statement(mqi_handle_t       table,
     int      nbind   = 0;
     int      nconst  = 0;
     int      poollen = 0;
+    int      i;
 
     MDB_CHECKARG(table != MQI_HANDLE_INVALID &&
-                 ncolumn > 0 && columns && data, NULL);
+                 ncolumn > 0 && columns && nrow > 0 && rowsize > 0 && data,
+                 NULL);
 
     /*
      * calculate the number of constant and bindable values
      */
-    count_column_values(columns, coltypes, data, &nbind,&nconst,&poollen);
+    for (i = 0;  i < nrow;  i++) {
+        count_column_values(columns, coltypes, data + (i * rowsize),
+                            &nbind, &nconst, &poollen);
+    }
 
     /*
      * set up the statement structure
@@ -228,20 +243,26 @@ mql_statement_t *mql_make_insert_statement(mqi_handle_t       table,
     ins->type    = mql_statement_insert;
     ins->table   = table;
     ins->ignore  = ignore;
+    ins->ncolumn = ncolumn;
     ins->columns = (mqi_column_desc_t *)(ins->values + (nbind + nconst));
-    ins->rows[0] = ins->values;
+    ins->nrow    = nrow;
+    ins->rows    = ins->values + nbind;
     ins->nbind   = nbind;
 
     strpool = (void *)(ins->columns + (ncolumn + 1));
 
     /*
-     * copy column values
+     * copy column values; every row takes ncolumn values, so the column
+     * offsets relative to the start of the row are the same for all rows
      */
     bindv  = ins->values;
-    constv = bindv + nbind;
+    constv = ins->rows;
 
-    copy_column_values(ncolumn, coltypes, columns, ins->columns,
-                       &bindv, &constv, &strpool, data, ins->values);
+    for (i = 0;  i < nrow;  i++) {
+        copy_column_values(ncolumn, coltypes, columns, ins->columns,
+                           &bindv, &constv, &strpool, data + (i * rowsize),
+                           ins->rows + (i * ncolumn));
+    }
 
     return (mql_statement_t *)ins;
 }
@@ -378,7 +399,8 @@ mql_statement_t *mql_make_select_statement(mqi_handle_t       table,
                                            char             **colnames,
                                            mqi_data_type_t   *coltypes,
                                            int               *colsizes,
-                                           mqi_column_desc_t *columns)
+                                           mqi_column_desc_t *columns,
+                                           mqi_query_t       *query)
 {
     select_statement_t *sel;
     value_t *bindv;
@@ -390,11 +412,15 @@ mql_statement_t *mql_make_select_statement(mqi_handle_t       table,
     int      ctyplgh;
     int      csizlgh;
     int      cndlgh;
+    int      grplgh;
+    int      ordlgh;
     int      datalgh;
     int      colnamlgh[MQI_COLUMN_MAX];
     int      nbind   = 0;
     int      nconst  = 0;
     int      poollen = 0;
+    int      ngroup  = 0;
+    int      norder  = 0;
     int      i;
 
     MDB_CHECKARG(table != MQI_HANDLE_INVALID &&
@@ -409,6 +435,15 @@ mql_statement_t *mql_make_select_statement(mqi_handle_t       table,
     for (i = 0;   i < ncolumn;   i++)
         poollen += (colnamlgh[i] = strlen(colnames[i]) + 1);
 
+    if (query && query->group_by) {
+        while (query->group_by[ngroup] >= 0)
+            ngroup++;
+    }
+
+    if (query && query->order_by) {
+        while (query->order_by[norder].column >= 0)
+            norder++;
+    }
 
     /*
      * set up the statement structure
@@ -419,8 +454,11 @@ mql_statement_t *mql_make_select_statement(mqi_handle_t       table,
     ctyplgh = sizeof( mqi_data_type_t ) *  ncolumn;
     csizlgh = sizeof(       int       ) *  ncolumn;
     cndlgh  = sizeof(mqi_cond_entry_t ) *  ncond;
+    grplgh  = sizeof(       int       ) * (ngroup + 1);
+    ordlgh  = sizeof(   mqi_order_t   ) * (norder + 1);
 
-    datalgh = vallgh + cdsclgh + cnamlgh + ctyplgh + csizlgh + cndlgh +poollen;
+    datalgh = vallgh + cdsclgh + cnamlgh + ctyplgh + csizlgh + cndlgh +
+              ordlgh + grplgh + poollen;
 
     if (!(sel = calloc(1, sizeof(select_statement_t) + datalgh))) {
         errno = ENOMEM;
@@ -429,6 +467,7 @@ mql_statement_t *mql_make_select_statement(mqi_handle_t       table,
 
     sel->type     = mql_statement_select;
     sel->table    = table;
+    sel->join     = MQI_HANDLE_INVALID;
     sel->rowsize  = rowsize;
     sel->ncolumn  = ncolumn;
     sel->columns  = (mqi_column_desc_t *)(sel->values + (nbind + nconst));
@@ -438,11 +477,33 @@ mql_statement_t *mql_make_select_statement(mqi_handle_t       table,
     sel->cond     = (mqi_cond_entry_t *)(sel->colsizes + ncolumn);
     sel->nbind    = nbind;
 
-    strpool = (char *)(sel->cond + ncond);
+    sel->query.order_by = (mqi_order_t *)(sel->cond + ncond);
+    sel->query.group_by = (int *)(sel->query.order_by + (norder + 1));
+    sel->query.limit    = query ? query->limit : 0;
+
+    strpool = (char *)(sel->query.group_by + (ngroup + 1));
 
     if (!ncond)
         sel->cond = NULL;
 
+    /*
+     * copy grouping and ordering
+     */
+    if (ngroup)
+        memcpy(sel->query.group_by, query->group_by, grplgh);
+    else
+        sel->query.group_by = NULL;
+
+    if (norder)
+        memcpy(sel->query.order_by, query->order_by, ordlgh);
+    else
+        sel->query.order_by = NULL;
+
+    for (i = 0;  i < ncolumn && !ngroup;  i++) {
+        if (columns[i].aggregate != mqi_aggregate_none)
+            sel->summary = true;
+    }
+
     /*
      * copy conditions and values
      */
@@ -469,6 +530,37 @@ mql_statement_t *mql_make_select_statement(mqi_handle_t       table,
     return (mql_statement_t *)sel;
 }
 
+mql_statement_t *mql_make_join_statement(mqi_handle_t       left,
+                                         int                lcol,
+                                         mqi_handle_t       right,
+                                         int                rcol,
+                                         int                rowsize,
+                                         int                ncond,
+                                         mqi_cond_entry_t  *conds,
+                                         int                ncolumn,
+                                         char             **colnames,
+                                         mqi_data_type_t   *coltypes,
+                                         int               *colsizes,
+                                         mqi_column_desc_t *columns)
+{
+    select_statement_t *sel;
+
+    MDB_CHECKARG(right != MQI_HANDLE_INVALID && lcol >= 0 && rcol >= 0, NULL);
+
+    sel = (select_statement_t *)mql_make_select_statement(left, rowsize,
+                                                          ncond, conds,
+                                                          ncolumn, colnames,
+                                                          coltypes, colsizes,
+                                                          columns, NULL);
+    if (sel) {
+        sel->join = right;
+        sel->lcol = lcol;
+        sel->rcol = rcol;
+    }
+
+    return (mql_statement_t *)sel;
+}
+
 int
 mql_bind_value(mql_statement_t *s, int id, mqi_data_type_t type, ...)
 {
@@ -508,9 +600,26 @@ mql_bind_value(mql_statement_t *s, int id, mqi_data_type_t type, ...)
 mql_result_t *mql_exec_statement(mql_result_type_t type, mql_statement_t *s)
 {
     mql_result_t *result;
+    int           sts;
 
     MDB_CHECKARG(s, NULL);
 
+    switch (s->type) {
+    case mql_statement_show_tables:
+    case mql_statement_describe:
+    case mql_statement_select:
+        sts = mqi_read_lock();
+        break;
+    default:
+        sts = mqi_write_lock();
+        break;
+    }
+
+    if (sts < 0) {
+        return mql_result_error_create(errno, "statement execution failed:"
+                                       " %s", strerror(errno));
+    }
+
     switch (s->type) {
 
     case mql_statement_show_tables:
@@ -555,9 +664,83 @@ mql_result_t *mql_exec_statement(mql_result_type_t type, mql_statement_t *s)
         break;
     }
 
+    mqi_unlock();
+
     return result;
 }
 
+int mql_exec_statement_visit(mql_statement_t *st,
+                             mql_row_cb_t     cb,
+                             void            *user_data)
+{
+    select_statement_t *s = (select_statement_t *)st;
+    mql_result_t       *row;
+    mql_result_t       *rows;
+    mqi_cursor_t       *cur;
+    void               *data;
+    int                 nrow;
+    int                 sts;
+
+    MDB_CHECKARG(st && st->type == mql_statement_select && cb, -1);
+
+    /* the callback sees the same single-row result every time */
+    if (!(row = mql_result_rows_alloc(s->ncolumn, s->columns, s->coltypes,
+                                      1, s->rowsize)))
+        return -1;
+
+    data = mql_result_rows_get_row(row, 0);
+
+    if (mqi_read_lock() < 0) {
+        mql_result_free(row);
+        return -1;
+    }
+
+    nrow = 0;
+
+    if (s->join != MQI_HANDLE_INVALID || s->query.group_by ||
+        s->query.order_by || s->summary)
+    {
+        /* these need all the rows before the first one can be told */
+        if (s->join != MQI_HANDLE_INVALID)
+            rows = select_join(s);
+        else
+            rows = select_query(s);
+
+        if (!rows)
+            sts = -1;
+        else {
+            for (sts = 0;  nrow < mql_result_rows_get_row_count(rows);  ) {
+                memcpy(data, mql_result_rows_get_row(rows, nrow++),
+                       s->rowsize);
+
+                if (!cb(row, user_data))
+                    break;
+            }
+
+            mql_result_free(rows);
+        }
+    }
+    else {
+        if (!(cur = mqi_select_cursor_open(s->table, s->cond, s->columns)))
+            sts = -1;
+        else {
+            while ((sts = mqi_select_cursor_next(cur, data)) > 0) {
+                nrow++;
+
+                if (!cb(row, user_data) || nrow == s->query.limit)
+                    break;
+            }
+
+            mqi_select_cursor_close(cur);
+        }
+    }
+
+    mqi_unlock();
+    mql_result_free(row);
+
+    return sts < 0 ? -1 : nrow;
+}
+
 
 void mql_statement_free(mql_statement_t *s)
 {
@@ -871,7 +1054,10 @@ static mql_result_t *exec_insert(insert_statement_t *i)
     mql_result_t *rslt;
     int           n;
 
-    if ((n = mqi_insert_into(i->table, i->ignore, i->columns, i->rows)) >= 0)
+    n = mqi_insert_bulk(i->table, i->ignore, i->columns, i->rows,
+                        sizeof(value_t) * i->ncolumn, i->nrow);
+
+    if (n >= 0)
         rslt = mql_result_error_create(0, "inserted %d rows", n);
     else {
         rslt = mql_result_error_create(errno, "insert error: %s",
@@ -913,50 +1099,162 @@ static mql_result_t *exec_delete(delete_statement_t *d)
 
 static mql_result_t *exec_select(mql_result_type_t type, select_statement_t *s)
 {
+    mql_result_t *rows;
     mql_result_t *rslt;
-    int           maxrow;
     int           nrow;
-    void         *rows;
 
-    if ((maxrow = mqi_get_table_size(s->table)) < 0)
-        rslt = mql_result_error_create(ENOENT, "can't access table");
-    else {
-        if (!maxrow) {
-            rows = alloca(s->rowsize);
-            nrow = 0;
-        }
+    if (type != mql_result_rows && type != mql_result_string) {
+        return mql_result_error_create(EINVAL, "select failed: invalid"
+                                       " result type %d", type);
+    }
+
+    if (s->join != MQI_HANDLE_INVALID)
+        rows = select_join(s);
+    else if (s->query.group_by || s->query.order_by || s->summary)
+        rows = select_query(s);
+    else
+        rows = select_rows(s);
+
+    if (!rows) {
+        if (errno == ENOENT)
+            return mql_result_error_create(ENOENT, "can't access table");
         else {
-            rows = alloca(maxrow * s->rowsize);
-            nrow = mqi_select(s->table, s->cond, s->columns,
-                              rows, s->rowsize, maxrow);
+            return mql_result_error_create(errno, "select error: %s",
+                                           strerror(errno));
         }
+    }
+
+    if (type == mql_result_rows)
+        return rows;
+
+    nrow = mql_result_rows_get_row_count(rows);
+    rslt = mql_result_string_create_row_list(s->ncolumn, s->colnames,
+                                             s->columns, s->coltypes,
+                                             s->colsizes, nrow, s->rowsize,
+                                             mql_result_rows_get_row(rows, 0));
+    mql_result_free(rows);
+
+    return rslt;
+}
+
+/*
+ * plain selects are streamed from the table right into the result
+ */
+static mql_result_t *select_rows(select_statement_t *s)
+{
+    mql_result_t *rows;
+    mqi_cursor_t *cur;
+    void         *data;
+    int           nrow;
+    int           sts;
+
+    if (!(rows = mql_result_rows_alloc(s->ncolumn, s->columns, s->coltypes,
+                                       0, s->rowsize)))
+        return NULL;
 
-       if (nrow < 0) {
-           rslt = mql_result_error_create(errno, "select error: %s",
-                                          strerror(errno));
+    if (!(cur = mqi_select_cursor_open(s->table, s->cond, s->columns))) {
+        mql_result_free(rows);
+        return NULL;
+    }
+
+    for (nrow = sts = 0;  !s->query.limit || nrow < s->query.limit;  nrow++) {
+        if (!(data = mql_result_rows_add(&rows, 1))) {
+            sts = -1;
+            break;
         }
-        else {
-            switch (type) {
-            case mql_result_rows:
-                rslt = mql_result_rows_create(s->ncolumn, s->columns,
-                                              s->coltypes, s->colsizes,
-                                              nrow, s->rowsize, rows);
-                break;
-            case mql_result_string:
-                rslt = mql_result_string_create_row_list(
-                                         s->ncolumn, s->colnames, s->columns,
-                                         s->coltypes, s->colsizes,
-                                         nrow, s->rowsize, rows);
-                break;
-            default:
-                rslt = mql_result_error_create(EINVAL, "select failed: invalid"
-                                               " result type %d", type);
-                break;
-            }
+
+        if ((sts = mqi_select_cursor_next(cur, data)) <= 0) {
+            mql_result_rows_truncate(rows, nrow);
+            break;
         }
     }
 
-    return rslt;
+    mqi_select_cursor_close(cur);
+
+    if (sts < 0) {
+        mql_result_free(rows);
+        return NULL;
+    }
+
+    return rows;
+}
+
+/*
+ * grouped, ordered and aggregated selects are done by the backend
+ * directly into the result
+ */
+static mql_result_t *select_query(select_statement_t *s)
+{
+    mql_result_t *rows;
+    int           maxrow;
+    int           nrow;
+
+    if ((maxrow = mqi_get_table_size(s->table)) < 0) {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    if (!maxrow && s->summary)
+        maxrow = 1;
+
+    if (!(rows = mql_result_rows_alloc(s->ncolumn, s->columns, s->coltypes,
+                                       maxrow, s->rowsize)))
+        return NULL;
+
+    if (maxrow > 0) {
+        nrow = mqi_select_query(s->table, s->cond, s->columns, &s->query,
+                                mql_result_rows_get_row(rows, 0),
+                                s->rowsize, maxrow);
+
+        if (nrow < 0) {
+            mql_result_free(rows);
+            return NULL;
+        }
+
+        mql_result_rows_truncate(rows, nrow);
+    }
+
+    return rows;
+}
+
+/*
+ * a join can produce up to the product of the table sizes
+ */
+static mql_result_t *select_join(select_statement_t *s)
+{
+    mql_result_t *rows;
+    long long     maxrow;
+    int           lsiz, rsiz;
+    int           nrow;
+
+    if ((lsiz = mqi_get_table_size(s->table)) < 0 ||
+        (rsiz = mqi_get_table_size(s->join))  < 0  )
+    {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    if ((maxrow = (long long)lsiz * rsiz) > MQI_QUERY_RESULT_MAX)
+        maxrow = MQI_QUERY_RESULT_MAX;
+
+    if (!(rows = mql_result_rows_alloc(s->ncolumn, s->columns, s->coltypes,
+                                       maxrow, s->rowsize)))
+        return NULL;
+
+    if (maxrow > 0) {
+        nrow = mqi_select_join(s->table, s->lcol, s->join, s->rcol, s->cond,
+                               s->columns, mql_result_rows_get_row(rows, 0),
+                               s->rowsize, maxrow);
+
+        if (nrow < 0) {
+            mql_result_free(rows);
+            return NULL;
+        }
+
+        mql_result_rows_truncate(rows, nrow);
+    }
+
+    return rows;
 }
 
 static int bind_update_value(update_statement_t *u,
@@ -56,6 +56,7 @@ int mql_begin_transaction(char *name)
 
     MDB_CHECKARG(name, -1);
 
+    /* this leaves us with the write lock held until commit or rollback */
     if ((h = mqi_begin_transaction()) == MQI_HANDLE_INVALID)
         return -1;
 
@@ -71,31 +72,41 @@ int mql_begin_transaction(char *name)
 int mql_rollback_transaction(char *name)
 {
     mqi_handle_t h;
+    int          sts;
 
     MDB_CHECKARG(name, -1);
 
-    if ((h = delete_handle(name)) == MQI_HANDLE_INVALID)
+    if (mqi_write_lock() < 0)
         return -1;
 
-    if (mqi_rollback_transaction(h) < 0)
-        return -1;
+    if ((h = delete_handle(name)) == MQI_HANDLE_INVALID)
+        sts = -1;
+    else
+        sts = mqi_rollback_transaction(h);
 
-    return 0;
+    mqi_unlock();
+
+    return sts < 0 ? -1 : 0;
 }
 
 int mql_commit_transaction(char *name)
 {
     mqi_handle_t h;
+    int          sts;
 
     MDB_CHECKARG(name, -1);
 
-    if ((h = delete_handle(name)) == MQI_HANDLE_INVALID)
+    if (mqi_write_lock() < 0)
         return -1;
 
-    if (mqi_commit_transaction(h) < 0)
-        return -1;
+    if ((h = delete_handle(name)) == MQI_HANDLE_INVALID)
+        sts = -1;
+    else
+        sts = mqi_commit_transaction(h);
 
-    return 0;
+    mqi_unlock();
+
+    return sts < 0 ? -1 : 0;
 }
 
 
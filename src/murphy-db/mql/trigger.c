@@ -55,6 +55,7 @@ typedef struct trigger_s             trigger_t;
 typedef struct trigger_s             transact_trigger_t;
 typedef struct trigger_s             table_trigger_t;
 typedef struct row_trigger_s         row_trigger_t;
+typedef struct row_trigger_s         changefeed_trigger_t;
 typedef struct column_trigger_s      column_trigger_t;
 
 
@@ -74,6 +75,7 @@ enum trigger_type_e {
     trigger_table,
     trigger_row,
     trigger_column,
+    trigger_changefeed,
 
     trigger_last
 };
@@ -118,6 +120,7 @@ struct column_trigger_s {
     TRIGGER_COMMON;
     mqi_handle_t table;
     column_t     column;
+    bool         batched;
     select_t     select;
     uint8_t      data[0];
 };
@@ -128,9 +131,17 @@ static mdb_hash_t *triggers;
 
 static int unref_callback(mql_callback_t *);
 static mql_callback_t *ref_callback(mql_callback_t *);
-
+static row_trigger_t *make_row_trigger(char *, trigger_type_t, mqi_handle_t,
+                                       mql_callback_t *, int, char **,
+                                       mqi_column_desc_t *, mqi_data_type_t *,
+                                       int *, int);
+
+static void *pack_rows(void *, int, int, int);
+static mql_result_t *batched_column_result(column_trigger_t *,
+                                           mqi_column_event_t *, bool);
 static void column_event_callback(mqi_event_t *, void *);
 static void row_event_callback(mqi_event_t *, void *);
+static void changefeed_event_callback(mqi_event_t *, void *);
 static void table_event_callback(mqi_event_t *, void *);
 static void transaction_event_callback(mqi_event_t *, void *);
 
@@ -147,15 +158,23 @@ int mql_register_callback(const char        *name,
                   rtype == mql_result_string ||
                   rtype == mql_result_dontcare), -1);
 
-    if (!callbacks) {
-        callbacks = MDB_HASH_TABLE_CREATE(string, MQL_CALLBACK_HASH_CHAINS);
-        MDB_PREREQUISITE(callbacks, -1);
-    }
-
     if (rtype == mql_result_dontcare)
         rtype = mql_result_event;
 
+    if (mqi_write_lock() < 0)
+        return -1;
+
+    if (!callbacks) {
+        if (!(callbacks = MDB_HASH_TABLE_CREATE(string,
+                                                MQL_CALLBACK_HASH_CHAINS))) {
+            mqi_unlock();
+            errno = EIO;
+            return -1;
+        }
+    }
+
     if (!(cb = calloc(1, sizeof(mql_callback_t)))) {
+        mqi_unlock();
         errno = ENOMEM;
         return -1;
     }
@@ -169,9 +188,12 @@ int mql_register_callback(const char        *name,
     if (!cb->name || mdb_hash_add(callbacks, 0,cb->name, cb) < 0) {
         free(cb->name);
         free(cb);
+        mqi_unlock();
         return -1;
     }
 
+    mqi_unlock();
+
     return 0;
 }
 
@@ -179,13 +201,21 @@ int mql_register_callback(const char        *name,
 int mql_unregister_callback(const char *name)
 {
     mql_callback_t *cb;
+    int             sts;
 
     MDB_CHECKARG(name, -1);
 
-    if (!(cb = mdb_hash_delete(callbacks, 0,(void *)name)))
+    if (mqi_write_lock() < 0)
         return -1;
 
-    return unref_callback(cb);
+    if (!(cb = mdb_hash_delete(callbacks, 0,(void *)name)))
+        sts = -1;
+    else
+        sts = unref_callback(cb);
+
+    mqi_unlock();
+
+    return sts;
 }
 
 
@@ -206,6 +236,7 @@ int mql_create_column_trigger(char              *name,
                               int                colidx,
                               mqi_data_type_t    coltyp,
                               mql_callback_t    *callback,
+                              bool               batched,
                               int                nselcol,
                               char             **selcolnams,
                               mqi_column_desc_t *selcoldscs,
@@ -228,6 +259,7 @@ int mql_create_column_trigger(char              *name,
     MDB_CHECKARG(name && table != MQI_HANDLE_INVALID && callback &&
                  (!nselcol || (nselcol > 0 && nselcol < MQI_COLUMN_MAX &&
                   selcoldscs && selcolsizes && rowsize > 0)), -1);
+    MDB_CHECKARG(!batched || coltyp != mqi_blob, -1);
 
     if (!triggers) {
         triggers = MDB_HASH_TABLE_CREATE(string, MQL_TRIGGER_HASH_CHAINS);
@@ -264,6 +296,8 @@ int mql_create_column_trigger(char              *name,
     tr->column.index = colidx;
     tr->column.type  = coltyp;
 
+    tr->batched = batched;
+
     if (nselcol > 0) {
         data = tr->data;
 
@@ -295,8 +329,16 @@ int mql_create_column_trigger(char              *name,
         return -1;
     }
 
-    sts = mqi_create_column_trigger(table, colidx, column_event_callback, tr,
-                                    tr->select.column.descs);
+    if (batched) {
+        sts = mqi_create_batched_column_trigger(table, colidx,
+                                                column_event_callback, tr,
+                                                tr->select.column.descs);
+    }
+    else {
+        sts = mqi_create_column_trigger(table, colidx, column_event_callback,
+                                        tr, tr->select.column.descs);
+    }
+
     return sts;
 }
 
@@ -305,6 +347,7 @@ int mql_create_column_trigger(char              *name,
 int mql_create_row_trigger(char              *name,
                            mqi_handle_t       table,
                            mql_callback_t    *callback,
+                           bool               batched,
                            int                nselcol,
                            char             **selcolnams,
                            mqi_column_desc_t *selcoldscs,
@@ -313,6 +356,58 @@ int mql_create_row_trigger(char              *name,
                            int                rowsize)
 {
     row_trigger_t *tr;
+
+    tr = make_row_trigger(name, trigger_row, table, callback,
+                          nselcol, selcolnams, selcoldscs,
+                          selcoltypes, selcolsizes, rowsize);
+    if (!tr)
+        return -1;
+
+    if (batched) {
+        return mqi_create_batched_row_trigger(table, row_event_callback, tr,
+                                              tr->select.column.descs);
+    }
+
+    return mqi_create_row_trigger(table, row_event_callback, tr,
+                                  tr->select.column.descs);
+}
+
+
+int mql_create_changefeed_trigger(char              *name,
+                                  mqi_handle_t       table,
+                                  mql_callback_t    *callback,
+                                  int                nselcol,
+                                  char             **selcolnams,
+                                  mqi_column_desc_t *selcoldscs,
+                                  mqi_data_type_t   *selcoltypes,
+                                  int               *selcolsizes,
+                                  int                rowsize)
+{
+    changefeed_trigger_t *tr;
+
+    tr = make_row_trigger(name, trigger_changefeed, table, callback,
+                          nselcol, selcolnams, selcoldscs,
+                          selcoltypes, selcolsizes, rowsize);
+    if (!tr)
+        return -1;
+
+    return mqi_create_changefeed(table, changefeed_event_callback, tr,
+                                 tr->select.column.descs);
+}
+
+
+static row_trigger_t *make_row_trigger(char              *name,
+                                       trigger_type_t     type,
+                                       mqi_handle_t       table,
+                                       mql_callback_t    *callback,
+                                       int                nselcol,
+                                       char             **selcolnams,
+                                       mqi_column_desc_t *selcoldscs,
+                                       mqi_data_type_t   *selcoltypes,
+                                       int               *selcolsizes,
+                                       int                rowsize)
+{
+    row_trigger_t *tr;
     size_t nlens[MQI_COLUMN_MAX];
     size_t asiz;
     size_t nsiz;
@@ -321,16 +416,15 @@ int mql_create_row_trigger(char              *name,
     size_t ssiz;
     size_t size;
     uint8_t *data;
-    int sts;
     int i;
 
     MDB_CHECKARG(name && table != MQI_HANDLE_INVALID && callback &&
                  nselcol > 0 && nselcol < MQI_COLUMN_MAX &&
-                 selcoldscs && selcolsizes && rowsize > 0, -1);
+                 selcoldscs && selcolsizes && rowsize > 0, NULL);
 
     if (!triggers) {
         triggers = MDB_HASH_TABLE_CREATE(string, MQL_TRIGGER_HASH_CHAINS);
-        MDB_PREREQUISITE(triggers, -1);
+        MDB_PREREQUISITE(triggers, NULL);
     }
 
     nsiz = asiz = sizeof(char *) * nselcol;
@@ -345,11 +439,11 @@ int mql_create_row_trigger(char              *name,
 
     if (!(tr = calloc(1, size))) {
         errno = ENOMEM;
-        return -1;
+        return NULL;
     }
 
     tr->name     = strdup(name);
-    tr->type     = trigger_row;
+    tr->type     = type;
     tr->callback = ref_callback(callback);
 
     tr->table = table;
@@ -380,12 +474,10 @@ int mql_create_row_trigger(char              *name,
     if (!tr->name || mdb_hash_add(triggers, 0,tr->name, tr) < 0) {
         free(tr->name);
         free(tr);
-        return -1;
+        return NULL;
     }
 
-    sts = mqi_create_row_trigger(table, row_event_callback, tr,
-                                 tr->select.column.descs);
-    return sts;
+    return tr;
 }
 
 
@@ -488,7 +580,9 @@ static void column_event_callback(mqi_event_t *evt, void *user_data)
 
     rsel = rslt = NULL;
 
-    if (tr->select.column.ncol <= 0) {
+    if (tr->batched)
+        rslt = batched_column_result(tr, ce, cb->rtype == mql_result_event);
+    else if (tr->select.column.ncol <= 0) {
         if (cb->rtype == mql_result_event) {
             rslt = mql_result_event_column_change_create(ce->table.handle,
                                                          ce->column.index,
@@ -543,6 +637,10 @@ static void column_event_callback(mqi_event_t *evt, void *user_data)
 
     if (!rslt)
         free(rsel);
+    else if (tr->batched) {
+        cb->function(rslt, cb->user_data);
+        mql_result_free(rslt);
+    }
     else {
         cb->function(rslt, cb->user_data);
         free(rslt);
@@ -550,6 +648,136 @@ static void column_event_callback(mqi_event_t *evt, void *user_data)
 }
 
 
+/*
+ * A batched column trigger gets all the changes of the column as rows,
+ * with the old and the new values leading the selected columns.
+ */
+static mql_result_t *batched_column_result(column_trigger_t   *tr,
+                                           mqi_column_event_t *ce,
+                                           bool                event)
+{
+    select_t           *s = &tr->select;
+    mql_result_t       *rsel;
+    mql_result_t       *rslt;
+    uint8_t            *data;
+    uint8_t            *row;
+    uint8_t            *sel;
+    int                 ncol;
+    char              **names;
+    mqi_column_desc_t  *descs;
+    mqi_data_type_t    *types;
+    int                *sizes;
+    int                 offs;
+    int                 rowsize;
+    int                 length;
+    int                 i;
+
+    if (ce->nrow <= 0 || !ce->values)
+        return NULL;
+
+    offs    = sizeof(mqi_change_data_t);
+    ncol    = s->column.ncol + 2;
+    rowsize = (offs * 2 + s->rowsize + offs - 1) & ~(offs - 1);
+
+    /* mdb reserves the full column length for varchars, we need a pointer */
+    length = ce->select.length < s->rowsize ? ce->select.length : s->rowsize;
+
+    names = alloca(sizeof(names[0]) * ncol);
+    descs = alloca(sizeof(descs[0]) * (ncol + 1));
+    types = alloca(sizeof(types[0]) * ncol);
+    sizes = alloca(sizeof(sizes[0]) * ncol);
+
+    for (i = 0;  i < 2;  i++) {
+        names[i] = i ? "new" : "old";
+        types[i] = tr->column.type;
+        sizes[i] = mqi_get_column_size(tr->table, tr->column.index);
+        descs[i].cindex = tr->column.index;
+        descs[i].offset = offs * i;
+    }
+
+    for (i = 2;  i < ncol;  i++) {
+        names[i] = s->column.names[i-2];
+        types[i] = s->column.types[i-2];
+        sizes[i] = s->column.sizes[i-2];
+        descs[i].cindex = s->column.descs[i-2].cindex;
+        descs[i].offset = s->column.descs[i-2].offset + offs * 2;
+    }
+
+    descs[ncol].cindex = -1;
+    descs[ncol].offset = 0;
+
+    if (!(data = calloc(ce->nrow, rowsize)))
+        return NULL;
+
+    for (i = 0;  i < ce->nrow;  i++) {
+        row = data + rowsize * i;
+
+        *(mqi_change_data_t *)(row)        = ce->values[i].old;
+        *(mqi_change_data_t *)(row + offs) = ce->values[i].new_;
+
+        if (length > 0 && ce->select.data) {
+            sel = (uint8_t *)ce->select.data + ce->select.length * i;
+            memcpy(row + offs * 2, sel, length);
+        }
+    }
+
+    rslt = NULL;
+
+    if (event) {
+        rsel = mql_result_rows_create(ncol, descs, types, sizes,
+                                      ce->nrow, rowsize, data);
+
+        if (mql_result_is_success(rsel)) {
+            rslt = mql_result_event_column_change_create(ce->table.handle,
+                                                         ce->column.index,
+                                                         &ce->value,
+                                                         rsel);
+        }
+
+        if (!rslt)
+            free(rsel);
+    }
+    else {
+        rsel = mql_result_string_create_row_list(ncol, names, descs,
+                                                 types, sizes,
+                                                 ce->nrow, rowsize, data);
+
+        if (mql_result_is_success(rsel)) {
+            rslt = mql_result_string_create_row_change(mqi_column_changed,
+                                                       ce->table.name,
+                                                       rsel);
+        }
+
+        free(rsel);
+    }
+
+    free(data);
+
+    return rslt;
+}
+
+
+/*
+ * batched events come with mdb's row length; repack them for mql
+ */
+static void *pack_rows(void *data, int nrow, int length, int rowsize)
+{
+    uint8_t *rows;
+    int      size;
+    int      i;
+
+    if (!(rows = calloc(nrow, rowsize)))
+        return NULL;
+
+    size = length < rowsize ? length : rowsize;
+
+    for (i = 0;  i < nrow;  i++)
+        memcpy(rows + rowsize * i, (uint8_t *)data + length * i, size);
+
+    return rows;
+}
+
+
 
 static void row_event_callback(mqi_event_t *evt, void *user_data)
 {
@@ -559,6 +787,8 @@ static void row_event_callback(mqi_event_t *evt, void *user_data)
     select_t        *s;
     mql_result_t    *rsel;
     mql_result_t    *rslt;
+    void            *data;
+    int              nrow;
 
     if (!evt || !user_data)
         return;
@@ -578,15 +808,26 @@ static void row_event_callback(mqi_event_t *evt, void *user_data)
 
     rsel = rslt = NULL;
 
+    if ((nrow = re->nrow) > 1) {
+        data = pack_rows(re->select.data, nrow, re->select.length, s->rowsize);
+
+        if (!data)
+            return;
+    }
+    else {
+        nrow = 1;
+        data = re->select.data;
+    }
+
 
     if (cb->rtype == mql_result_event) {
         rsel = mql_result_rows_create(s->column.ncol,
                                       s->column.descs,
                                       s->column.types,
                                       s->column.sizes,
-                                      1,
+                                      nrow,
                                       s->rowsize,
-                                      re->select.data);
+                                      data);
 
         if (mql_result_is_success(rsel)) {
             rslt = mql_result_event_row_change_create(re->event,
@@ -600,9 +841,9 @@ static void row_event_callback(mqi_event_t *evt, void *user_data)
                                                  s->column.descs,
                                                  s->column.types,
                                                  s->column.sizes,
-                                                 1,
+                                                 nrow,
                                                  s->rowsize,
-                                                 re->select.data);
+                                                 data);
 
         if (mql_result_is_success(rsel)) {
             rslt = mql_result_string_create_row_change(re->event,
@@ -611,6 +852,9 @@ static void row_event_callback(mqi_event_t *evt, void *user_data)
         }
     }
 
+    if (data != re->select.data)
+        free(data);
+
     if (!rslt)
         free(rsel);
     else {
@@ -621,6 +865,153 @@ static void row_event_callback(mqi_event_t *evt, void *user_data)
 
 
 
+static void changefeed_event_callback(mqi_event_t *evt, void *user_data)
+{
+    static const char *change_names[] = {
+        [mqi_change_unknown] = "",
+        [mqi_change_insert]  = "inserted",
+        [mqi_change_update]  = "updated",
+        [mqi_change_delete]  = "deleted",
+    };
+
+    mqi_changefeed_event_t *ce;
+    changefeed_trigger_t   *tr;
+    mql_callback_t         *cb;
+    select_t               *s;
+    mqi_change_row_t       *r;
+    mql_result_t           *rsel;
+    mql_result_t           *rslt;
+    uint8_t                *data;
+    void                   *image;
+    int                     ncol;
+    char                  **names;
+    mqi_column_desc_t      *descs;
+    mqi_data_type_t        *types;
+    int                    *sizes;
+    int                     offs;
+    int                     rowsize;
+    int                     length;
+    int                     i;
+
+    if (!evt || !user_data)
+        return;
+
+    ce = &evt->changes;
+    tr = (changefeed_trigger_t *)user_data;
+    cb = tr->callback;
+    s  = &tr->select;
+
+    if (ce->event  != mqi_rows_changed   ||
+        tr->type   != trigger_changefeed ||
+        ce->nrow   <= 0                  ||
+        (cb->rtype != mql_result_event && cb->rtype != mql_result_string))
+    {
+        return;
+    }
+
+    rsel = rslt = NULL;
+
+    /* mdb reserves the full column length for varchars, we need a pointer */
+    length = ce->length < s->rowsize ? ce->length : s->rowsize;
+
+    if (cb->rtype == mql_result_event) {
+        /*
+         * one row per change; the new image, or the old one for deletes
+         */
+        rowsize = s->rowsize;
+
+        if (!(data = calloc(ce->nrow, rowsize)))
+            return;
+
+        for (i = 0;  i < ce->nrow;  i++) {
+            r = ce->rows + i;
+
+            if ((image = r->after ? r->after : r->before))
+                memcpy(data + rowsize * i, image, length);
+        }
+
+        rsel = mql_result_rows_create(s->column.ncol,
+                                      s->column.descs,
+                                      s->column.types,
+                                      s->column.sizes,
+                                      ce->nrow,
+                                      rowsize,
+                                      data);
+
+        if (mql_result_is_success(rsel)) {
+            rslt = mql_result_event_changefeed_create(ce->table.handle,
+                                                      ce->nrow, ce->rows,
+                                                      rsel);
+        }
+    }
+    else {
+        /*
+         * the same with an extra leading column for the type of change
+         */
+        offs    = sizeof(char *);
+        rowsize = (offs + s->rowsize + offs - 1) & ~(offs - 1);
+        ncol    = s->column.ncol + 1;
+
+        names = alloca(sizeof(names[0]) * ncol);
+        descs = alloca(sizeof(descs[0]) * (ncol + 1));
+        types = alloca(sizeof(types[0]) * ncol);
+        sizes = alloca(sizeof(sizes[0]) * ncol);
+
+        names[0] = "change";
+        types[0] = mqi_varchar;
+        sizes[0] = 9;
+        descs[0].cindex = -1;
+        descs[0].offset = 0;
+
+        for (i = 1;  i < ncol;  i++) {
+            names[i] = s->column.names[i-1];
+            types[i] = s->column.types[i-1];
+            sizes[i] = s->column.sizes[i-1];
+            descs[i].cindex = s->column.descs[i-1].cindex;
+            descs[i].offset = s->column.descs[i-1].offset + offs;
+        }
+
+        descs[ncol].cindex = -1;
+        descs[ncol].offset = 0;
+
+        if (!(data = calloc(ce->nrow, rowsize)))
+            return;
+
+        for (i = 0;  i < ce->nrow;  i++) {
+            r = ce->rows + i;
+
+            *(const char **)(data + rowsize * i) = change_names[r->change];
+
+            if ((image = r->after ? r->after : r->before))
+                memcpy(data + rowsize * i + offs, image, length);
+        }
+
+        rsel = mql_result_string_create_row_list(ncol, names, descs,
+                                                 types, sizes,
+                                                 ce->nrow, rowsize, data);
+
+        if (mql_result_is_success(rsel)) {
+            rslt = mql_result_string_create_row_change(mqi_rows_changed,
+                                                       ce->table.name,
+                                                       rsel);
+        }
+
+        free(rsel);
+        rsel = NULL;
+    }
+
+    free(data);
+
+    if (!rslt)
+        free(rsel);
+    else {
+        cb->function(rslt, cb->user_data);
+        mql_result_free(rslt);
+    }
+}
+
+
+
 static void table_event_callback(mqi_event_t *evt, void *user_data)
 {
     mqi_table_event_t *te;
@@ -27,8 +27,19 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
 #include <check.h>
 
+#include <murphy-db/mqi.h>
+#include <murphy-db/mdb.h>
+#include <murphy-db/hash.h>
+#include <murphy-db/sequence.h>
+
 #ifndef LOGFILE
 #define LOGFILE  "check_libmdb.log"
 #endif
@@ -68,12 +79,398 @@ START_TEST(create_table)
 }
 END_TEST
 
+START_TEST(hash_grow_and_shrink)
+{
+#define NKEY 100000
+    mdb_hash_t *htbl;
+    uint32_t   *keys;
+    char        buf[1024];
+    int         i;
+
+    htbl = MDB_HASH_TABLE_CREATE(unsignd, 16);
+    keys = calloc(NKEY, sizeof(uint32_t));
+
+    fail_if(!htbl || !keys, "failed to create hash table");
+
+    for (i = 0;  i < NKEY;  i++) {
+        keys[i] = i * 7 + 1;
+        fail_unless(mdb_hash_add(htbl, sizeof(uint32_t), keys+i, keys+i) == 0,
+                    "failed to add key %u", keys[i]);
+    }
+
+    for (i = 0;  i < NKEY;  i++) {
+        fail_unless(mdb_hash_get_data(htbl, sizeof(uint32_t),keys+i) == keys+i,
+                    "failed to look up key %u", keys[i]);
+    }
+
+    mdb_hash_table_print(htbl, buf, sizeof(buf));
+
+    fail_unless(strstr(buf, "entries: 100000,") != NULL,
+                "wrong statistics:\n%s", buf);
+    fail_if(strstr(buf, "chains: 131071 ") == NULL &&
+            strstr(buf, "chains: 65521 ") == NULL,
+            "hash table did not grow:\n%s", buf);
+
+    for (i = 0;  i < NKEY - 3;  i++) {
+        fail_unless(mdb_hash_delete(htbl, sizeof(uint32_t), keys+i) == keys+i,
+                    "failed to delete key %u", keys[i]);
+    }
+
+    for (i = NKEY - 3;  i < NKEY;  i++) {
+        fail_unless(mdb_hash_get_data(htbl, sizeof(uint32_t),keys+i) == keys+i,
+                    "failed to look up key %u after shrinking", keys[i]);
+    }
+
+    mdb_hash_table_print(htbl, buf, sizeof(buf));
+
+    fail_unless(strstr(buf, "chains: 17 ") != NULL,
+                "hash table did not shrink:\n%s", buf);
+
+    mdb_hash_table_destroy(htbl);
+    free(keys);
+#undef NKEY
+}
+END_TEST
+
+START_TEST(sequence_100k_entries)
+{
+#define NKEY 100000
+    mdb_sequence_t  *seq;
+    uint32_t        *keys, *data, prev, seek;
+    void            *cursor;
+    int              i, j, n;
+
+    seq  = MDB_SEQUENCE_TABLE_CREATE(unsignd, 16);
+    keys = calloc(NKEY, sizeof(uint32_t));
+
+    fail_if(!seq || !keys, "failed to create sequence");
+
+    for (i = 0;  i < NKEY;  i++)
+        keys[i] = i * 2;
+
+    srand(1);
+
+    for (i = NKEY - 1;  i > 0;  i--) {
+        j = rand() % (i + 1);
+        prev = keys[i];  keys[i] = keys[j];  keys[j] = prev;
+    }
+
+    for (i = 0;  i < NKEY;  i++) {
+        fail_unless(mdb_sequence_add(seq, sizeof(uint32_t), keys+i,keys+i) == 0,
+                    "failed to add key %u", keys[i]);
+    }
+
+    fail_unless(mdb_sequence_table_get_size(seq) == NKEY,
+                "wrong sequence size %d", mdb_sequence_table_get_size(seq));
+
+    n = 0;
+    MDB_SEQUENCE_FOR_EACH(seq, data, cursor) {
+        fail_unless(*data == (uint32_t)n * 2, "key %u out of order", *data);
+        n++;
+    }
+
+    fail_unless(n == NKEY, "iterated over %d entries instead of %d", n, NKEY);
+
+    /* range scan from the middle, deleting entries as we go */
+    seek   = NKEY - 1;
+    cursor = NULL;
+
+    fail_unless(mdb_sequence_seek(seq, sizeof(uint32_t), &seek, &cursor) == 0,
+                "failed to position cursor");
+
+    for (n = 0;  (data = mdb_sequence_iterate(seq, &cursor));  n++) {
+        fail_unless(*data == seek + 1 + n * 2, "range scan returned %u", *data);
+        fail_unless(mdb_sequence_delete(seq, sizeof(uint32_t), data) == data,
+                    "failed to delete key %u while iterating", *data);
+    }
+
+    fail_unless(n == NKEY / 2, "range scan returned %d entries", n);
+    fail_unless(mdb_sequence_table_get_size(seq) == NKEY / 2,
+                "wrong sequence size %d after range deletion",
+                mdb_sequence_table_get_size(seq));
+
+    for (i = 0;  i < NKEY;  i++) {
+        if (keys[i] <= seek) {
+            fail_unless(mdb_sequence_delete(seq, sizeof(uint32_t), keys+i) ==
+                        keys+i, "failed to delete key %u", keys[i]);
+        }
+    }
+
+    fail_unless(mdb_sequence_table_get_size(seq) == 0,
+                "sequence is not empty after deleting all entries");
+
+    mdb_sequence_table_destroy(seq);
+    free(keys);
+#undef NKEY
+}
+END_TEST
+
+START_TEST(table_100k_rows)
+{
+#define NROW 100000
+#define NSEL 1000
+    typedef struct {
+        uint32_t  id;
+        char     *name;
+    } record_t;
+
+    static uint32_t half = NROW / 2;
+    static uint32_t last = NROW - NSEL;
+    static uint32_t nsel = NSEL;
+
+    MQI_COLUMN_DEFINITION_LIST(coldefs,
+        MQI_COLUMN_DEFINITION( "id"  , MQI_UNSIGNED   ),
+        MQI_COLUMN_DEFINITION( "name", MQI_VARCHAR(15) )
+    );
+    MQI_COLUMN_SELECTION_LIST(columns,
+        MQI_COLUMN_SELECTOR( 0, record_t, id   ),
+        MQI_COLUMN_SELECTOR( 1, record_t, name )
+    );
+    MQI_WHERE_CLAUSE(where_lower_half,
+        MQI_LESS( MQI_COLUMN(0), MQI_UNSIGNED_VAR(half) )
+    );
+    MQI_WHERE_CLAUSE(where_last,
+        MQI_GREATER_OR_EQUAL( MQI_COLUMN(0), MQI_UNSIGNED_VAR(last) )
+    );
+    MQI_WHERE_CLAUSE(where_first,
+        MQI_LESS( MQI_COLUMN(0), MQI_UNSIGNED_VAR(nsel) )
+    );
+
+    mdb_table_t      *tbl;
+    record_t         *records, *results;
+    void            **data;
+    int               i, n;
+
+    tbl     = mdb_table_create("rows_100k", NULL, coldefs);
+    records = calloc(NROW, sizeof(record_t));
+    results = calloc(NROW, sizeof(record_t));
+    data    = calloc(NROW + 1, sizeof(void *));
+
+    fail_if(!tbl || !records || !results || !data, "failed to create table");
+
+    for (i = 0;  i < NROW;  i++) {
+        records[i].id   = i;
+        records[i].name = (i & 1) ? "odd" : "even";
+        data[i] = records + i;
+    }
+
+    n = mdb_table_insert(tbl, 0, columns, data);
+
+    fail_unless(n == NROW, "inserted %d rows instead of %d", n, NROW);
+
+    n = mdb_table_select(tbl, where_last, columns, results,
+                         sizeof(record_t), NSEL);
+
+    fail_unless(n == NSEL, "selected %d rows instead of %d", n, NSEL);
+
+    for (i = 0;  i < n;  i++) {
+        fail_unless(results[i].id == last + i &&
+                    !strcmp(results[i].name, (i & 1) ? "odd" : "even"),
+                    "row %d is out of order or corrupted", i);
+    }
+
+    n = mdb_table_delete(tbl, where_lower_half);
+
+    fail_unless(n == NROW / 2, "deleted %d rows instead of %d", n, NROW / 2);
+
+    /* reinserting reuses the slots freed up by the deletion */
+    data[NROW / 2] = NULL;
+
+    n = mdb_table_insert(tbl, 0, columns, data);
+
+    fail_unless(n == NROW / 2, "reinserted %d rows instead of %d", n, NROW/2);
+
+    n = mdb_table_select(tbl, where_first, columns, results,
+                         sizeof(record_t), NSEL);
+
+    fail_unless(n == NSEL, "selected %d reinserted rows", n);
+
+    for (i = 0;  i < n;  i++) {
+        fail_unless(results[i].id == (uint32_t)i,
+                    "reinserted row %d is out of order", i);
+    }
+
+    mdb_table_drop(tbl);
+    free(records);
+    free(results);
+    free(data);
+#undef NSEL
+#undef NROW
+}
+END_TEST
+
+
+#define NROW  8
+
+static int column_changes[MQI_COLUMN_MAX];
+
+static void wide_column_changed(mqi_event_t *evt, void *user_data)
+{
+    MQI_UNUSED(user_data);
+
+    if (evt->event == mqi_column_changed)
+        column_changes[evt->column.column.index]++;
+}
+
+/* whether exactly the given columns triggered, once per row */
+static int triggered_only(int *cols, int ncol)
+{
+    int c, k, expected, ok;
+
+    for (c = 0, ok = 1;  c < MQI_COLUMN_MAX;  c++) {
+        for (k = 0, expected = 0;  k < ncol;  k++) {
+            if (cols[k] == c)
+                expected = NROW;
+        }
+
+        if (column_changes[c] != expected)
+            ok = 0;
+    }
+
+    memset(column_changes, 0, sizeof(column_changes));
+
+    return ok;
+}
+
+START_TEST(wide_table_updates)
+{
+    static int32_t     value;
+    static int32_t     values[4];
+    static int         mixed_columns[4] = { 5, 63, 64, MQI_COLUMN_MAX - 1 };
+
+    mqi_column_def_t   coldefs[MQI_COLUMN_MAX + 2];
+    mqi_column_desc_t  columns[MQI_COLUMN_MAX + 1];
+    mqi_column_desc_t  single[2];
+    mqi_column_desc_t  mixed[5];
+    char               names[MQI_COLUMN_MAX + 1][8];
+    char              *index[] = { "c0", NULL };
+    mdb_table_t       *tbl;
+    int32_t            records[NROW][MQI_COLUMN_MAX];
+    int32_t            results[NROW][MQI_COLUMN_MAX];
+    void              *data[NROW + 1];
+    int32_t            expected;
+    uint32_t           tx;
+    int                i, j, k, c, n;
+
+    for (i = 0;  i <= MQI_COLUMN_MAX;  i++) {
+        snprintf(names[i], sizeof(names[i]), "c%d", i);
+        coldefs[i].name   = names[i];
+        coldefs[i].type   = mqi_integer;
+        coldefs[i].length = 0;
+        coldefs[i].flags  = 0;
+    }
+    coldefs[i].name = NULL;
+
+    fail_if(mdb_table_create("too_wide", NULL, coldefs) != NULL ||
+            errno != EINVAL, "created a table of %d columns", i);
+
+    coldefs[MQI_COLUMN_MAX].name = NULL;
+
+    for (i = 0;  i < MQI_COLUMN_MAX;  i++) {
+        columns[i].cindex = i;
+        columns[i].offset = sizeof(int32_t) * i;
+    }
+    columns[i].cindex = -1;
+
+    fail_if(!(tbl = mdb_table_create("wide", index, coldefs)),
+            "failed to create a table of %d columns", MQI_COLUMN_MAX);
+
+    for (i = 0;  i < NROW;  i++) {
+        for (j = 0;  j < MQI_COLUMN_MAX;  j++)
+            records[i][j] = i * MQI_COLUMN_MAX + j;
+        data[i] = records[i];
+    }
+    data[i] = NULL;
+
+    n = mdb_table_insert(tbl, 0, columns, data);
+
+    fail_unless(n == NROW, "inserted %d rows instead of %d", n, NROW);
+
+    for (c = 0;  c < MQI_COLUMN_MAX;  c++) {
+        fail_if(mdb_trigger_add_column_callback(tbl, c, wide_column_changed,
+                                                NULL, NULL) < 0,
+                "failed to add a trigger on column %d", c);
+    }
+
+    single[0].offset = 0;
+    single[1].cindex = -1;
+
+    /* columns 33 - 128 are all above the bits of the old 32 bit mask */
+    for (c = 32;  c < MQI_COLUMN_MAX;  c++) {
+        single[0].cindex = c;
+        value = -c;
+
+        tx = mdb_transaction_begin();
+        n  = mdb_table_update(tbl, NULL, single, &value);
+        mdb_transaction_commit(tx);
+
+        fail_unless(n == NROW, "updated %d rows instead of %d in column %d",
+                    n, NROW, c);
+        fail_unless(triggered_only(&c, 1), "an update of column %d "
+                    "triggered the wrong columns", c);
+
+        /* writing the same value again is not a change */
+        tx = mdb_transaction_begin();
+        n  = mdb_table_update(tbl, NULL, single, &value);
+        mdb_transaction_commit(tx);
+
+        fail_unless(n == 0 && triggered_only(NULL, 0),
+                    "rewriting column %d with its value changed %d rows",
+                    c, n);
+    }
+
+    /* one update across both words of the column mask */
+    for (k = 0;  k < 4;  k++) {
+        mixed[k].cindex = mixed_columns[k];
+        mixed[k].offset = sizeof(int32_t) * k;
+        values[k] = 1000 + k;
+    }
+    mixed[k].cindex = -1;
+
+    tx = mdb_transaction_begin();
+    n  = mdb_table_update(tbl, NULL, mixed, values);
+    mdb_transaction_commit(tx);
+
+    fail_unless(n == NROW && triggered_only(mixed_columns, 4),
+                "an update of columns 5, 63, 64 and %d failed",
+                MQI_COLUMN_MAX - 1);
+
+    n = mdb_table_select(tbl, NULL, columns, results, sizeof(results[0]),
+                         NROW);
+
+    fail_unless(n == NROW, "selected %d rows instead of %d", n, NROW);
+
+    for (i = 0;  i < NROW;  i++) {
+        for (j = 0;  j < MQI_COLUMN_MAX;  j++) {
+            expected = j < 32 ? results[i][0] + j : -j;
+
+            for (k = 0;  k < 4;  k++) {
+                if (mixed_columns[k] == j)
+                    expected = values[k];
+            }
+
+            fail_unless(results[i][j] == expected, "column %d of row %d "
+                        "is %d instead of %d", j, results[i][0] /
+                        MQI_COLUMN_MAX, results[i][j], expected);
+        }
+    }
+
+    mdb_table_drop(tbl);
+}
+END_TEST
+
+#undef NROW
+
 
 static Suite *libmdb_suite(void)
 {
     Suite *s = suite_create("Memory Database - libmdb");
 
     ADD_TEST_CASE(s, create_table);
+    ADD_TEST_CASE(s, hash_grow_and_shrink);
+    ADD_TEST_CASE(s, sequence_100k_entries);
+    ADD_TEST_CASE(s, table_100k_rows);
+    ADD_TEST_CASE(s, wide_table_updates);
 
     return s;
 }
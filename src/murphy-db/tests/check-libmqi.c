@@ -32,6 +32,9 @@
 #include <string.h>
 #include <errno.h>
 #include <libgen.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #include <check.h>
 
@@ -48,6 +51,8 @@
 #define TABLE_TRIGGER_DATA    TRIGGER_DATA(2)
 #define ROW_TRIGGER_DATA      TRIGGER_DATA(3)
 #define COLUMN_TRIGGER_DATA   TRIGGER_DATA(4)
+#define CHANGEFEED_DATA       TRIGGER_DATA(5)
+#define BATCHED_TRIGGER_DATA  TRIGGER_DATA(6)
 
 typedef struct {
     mqi_event_type_t  event;
@@ -67,6 +72,16 @@ typedef struct {
     } col;
 } trigger_t;
 
+typedef struct {
+    int nrow;
+    struct {
+        mqi_change_type_t change;
+        mqi_bitfld_t      colmask;
+        uint32_t          before;    /* id before the change or 0 */
+        uint32_t          after;     /* id after the change or 0 */
+    } rows[8];
+} changes_t;
+
 typedef struct {
     const char  *sex;
     const char  *first_name;
@@ -129,6 +144,8 @@ static int          rows_no_in_persons = -1;
 
 static int          ntrigger;
 static trigger_t    triggers[256];
+static int          nchanges;
+static changes_t    changes[4];
 static int          nseq = 32;
 static int          nnest = MQI_TXDEPTH_MAX - 1;
 
@@ -141,6 +158,8 @@ static void   transaction_event_cb(mqi_event_t *, void *);
 static void   table_event_cb(mqi_event_t *, void *);
 static void   row_event_cb(mqi_event_t *, void *);
 static void   column_event_cb(mqi_event_t *, void *);
+static void   changefeed_cb(mqi_event_t *, void *);
+static void   batched_event_cb(mqi_event_t *, void *);
 
 
 int main(int argc, char **argv)
@@ -330,133 +349,1685 @@ START_TEST(insert_duplicate_into_persons)
 
     n = MQI_INSERT_INTO(persons, persons_insert_columns, duplicate);
 
-    fail_if(n == 1, "managed to insert a duplicate");
+    fail_if(n == 1, "managed to insert a duplicate");
+
+    fail_if(n < 0 && errno != EEXIST, "error (%s)", strerror(errno));
+}
+END_TEST
+
+START_TEST(transaction_begin)
+{
+    mqi_handle_t tx;
+
+    fail_if(txdepth >= (int)MQI_DIMENSION(transactions), "too many nested "
+            "transactions. Only %d allowed", MQI_DIMENSION(transactions));
+
+    tx = MQI_BEGIN;
+
+    fail_if(tx == MQI_HANDLE_INVALID, "error (%d)", strerror(errno));
+
+    transactions[txdepth++] = tx;
+}
+END_TEST
+
+
+START_TEST(replace_in_persons)
+{
+    static record_t  gary = {"male", "Gary","Cooper", 200, "gary@att.com"};
+    static record_t *duplicate[] = {&gary, NULL};
+
+    int n;
+
+    PREREQUISITE(insert_into_persons);
+    PREREQUISITE(transaction_begin);
+
+    n = MQI_REPLACE(persons, persons_insert_columns, duplicate);
+
+    fail_if(n < 0, "error (%s)", strerror(errno));
+
+    fail_if(n == 1, "duplicate was inserted instead of replacement");
+}
+END_TEST
+
+START_TEST(filtered_select_from_persons)
+{
+    static char     *initial = "G";
+    static uint32_t  idlimit = 200;
+
+    MQI_WHERE_CLAUSE(where,
+        MQI_GREATER( MQI_COLUMN(1), MQI_STRING_VAR(initial)   ) MQI_AND
+        MQI_GREATER( MQI_COLUMN(3), MQI_UNSIGNED_VAR(idlimit) )
+    );
+
+    query_t rows[32];
+    int n;
+
+    PREREQUISITE(replace_in_persons);
+
+    n = MQI_SELECT(persons_select_columns, persons, where, rows);
+
+    fail_if(n < 0, "error (%s)", strerror(errno));
+
+    if (verbose)
+        print_rows(n, rows);
+
+    fail_if(n != 3, "selcted %d rows but the right number would be 3", n);
+}
+END_TEST
+
+
+START_TEST(grouped_select_from_persons)
+{
+    static char *female = "female";
+    static char *empty  = "";
+
+    MQI_WHERE_CLAUSE(where_grouped,
+        MQI_EXPRESSION(
+            MQI_EQUAL( MQI_COLUMN(0), MQI_STRING_VAR(female)  ) MQI_OR
+            MQI_LESS( MQI_COLUMN(3), MQI_UNSIGNED_VAR(elvis.id) )
+        ) MQI_AND
+        MQI_NOT(
+            MQI_EXPRESSION(
+                MQI_EQUAL( MQI_COLUMN(2), MQI_STRING_VAR(tom.first_name) )
+            )
+        )
+    );
+    MQI_WHERE_CLAUSE(where_mismatch,
+        MQI_EQUAL( MQI_COLUMN(3), MQI_STRING_VAR(empty) ) MQI_OR
+        MQI_GREATER( MQI_COLUMN(1), MQI_UNSIGNED_VAR(elvis.id) )
+    );
+
+    query_t rows[32];
+    int n;
+
+    PREREQUISITE(insert_into_persons);
+
+    n = MQI_SELECT(persons_select_columns, persons, where_grouped, rows);
+
+    fail_if(n < 0, "error (%s)", strerror(errno));
+
+    if (verbose)
+        print_rows(n, rows);
+
+    fail_if(n != 2, "selected %d rows but the right number would be 2", n);
+
+    n = MQI_SELECT(persons_select_columns, persons, where_mismatch, rows);
+
+    fail_if(n != 0, "type mismatch in a condition selected %d rows", n);
+}
+END_TEST
+
+
+START_TEST(full_select_from_persons)
+{
+    query_t *r, rows[32];
+    int i, n;
+
+    PREREQUISITE(replace_in_persons);
+
+    n = MQI_SELECT(persons_select_columns, persons, MQI_ALL, rows);
+
+    fail_if(n < 0, "error (%s)", strerror(errno));
+
+    if (verbose) {
+        printf("   id first name      family name     \n");
+        printf("--------------------------------------\n");
+
+        if (!n)
+            printf("no rows\n");
+        else {
+            for (i = 0; i < n;  i++) {
+                r = rows + i;
+                printf("%5d %-15s %-15s\n", r->id,
+                       r->first_name, r->family_name);
+            }
+        }
+
+        printf("--------------------------------------\n");
+    }
+
+    fail_if(n != 6, "selcted %d rows but the right number would be 3", n);
+}
+END_TEST
+
+
+
+START_TEST(select_from_persons_by_index)
+{
+    MQI_INDEX_VALUE(index,
+        MQI_STRING_VAL(elvis.family_name)
+        MQI_STRING_VAL(elvis.first_name)
+    );
+
+    query_t row;
+    int n;
+
+    PREREQUISITE(replace_in_persons);
+
+    n = MQI_SELECT_BY_INDEX(persons_select_columns, persons, index, &row);
+
+    fail_if(n < 0, "errno (%s)", strerror(errno));
+
+    fail_if(!n, "could not select %s %s", elvis.first_name, elvis.family_name);
+
+    fail_if(strcmp(row.first_name, elvis.first_name), "mismatching first "
+            "name ('%s' vs. '%s')", elvis.first_name, row.first_name);
+
+    fail_if(strcmp(row.family_name, elvis.family_name), "mismatching family "
+            "name ('%s' vs. '%s')", elvis.family_name, row.family_name);
+
+    fail_if(row.id != elvis.id, "mismatching id (%u vs. %u)",
+            elvis.id, row.id);
+}
+END_TEST
+
+
+
+START_TEST(secondary_index_on_persons)
+{
+    MQI_INDEX_DEFINITION(by_sex_columns,
+        MQI_INDEX_COLUMN("sex")
+    );
+    MQI_INDEX_DEFINITION(by_sex_email_columns,
+        MQI_INDEX_COLUMN("sex")
+        MQI_INDEX_COLUMN("email")
+    );
+    MQI_INDEX_VALUE(female,
+        MQI_STRING_VAL(greta.sex)
+    );
+    MQI_INDEX_VALUE(chucks_mail,
+        MQI_STRING_VAL(chuck.sex)
+        MQI_STRING_VAL(chuck.email)
+    );
+    MQI_COLUMN_SELECTION_LIST(sex_column,
+        MQI_COLUMN_SELECTOR( 0, record_t, sex )
+    );
+    MQI_WHERE_CLAUSE(where_rita,
+        MQI_EQUAL( MQI_COLUMN(3), MQI_UNSIGNED_VAR(rita.id) )
+    );
+    MQI_WHERE_CLAUSE(where_greta,
+        MQI_EQUAL( MQI_COLUMN(3), MQI_UNSIGNED_VAR(greta.id) )
+    );
+
+    static record_t male = { "male", NULL, NULL, 0, NULL };
+
+    query_t rows[32];
+    int n;
+
+    PREREQUISITE(insert_into_persons);
+
+    fail_if(mqi_create_secondary_index(persons, "by_sex", mqi_index_hash,
+                                       by_sex_columns) < 0,
+            "failed to create hash index (%s)", strerror(errno));
+
+    fail_if(mqi_create_secondary_index(persons, "by_sex_email",
+                                       mqi_index_ordered,
+                                       by_sex_email_columns) < 0,
+            "failed to create ordered index on non-adjacent columns (%s)",
+            strerror(errno));
+
+    fail_unless(mqi_create_secondary_index(persons, "by_sex", mqi_index_hash,
+                                           by_sex_columns) < 0 &&
+                errno == EEXIST, "managed to create a duplicate index");
+
+    n = MQI_SELECT_BY_SECONDARY_INDEX(persons_select_columns, persons,
+                                      "by_sex", female, rows);
+    fail_if(n != 2, "expected 2 females, got %d (%s)", n, strerror(errno));
+
+    n = MQI_SELECT_BY_SECONDARY_INDEX(persons_select_columns, persons,
+                                      "by_sex_email", chucks_mail, rows);
+    fail_if(n != 1 || rows[0].id != chuck.id, "failed to find %s %s by "
+            "e-mail address", chuck.first_name, chuck.family_name);
+
+    n = MQI_UPDATE(persons, sex_column, &male, where_rita);
+    fail_if(n != 1, "failed to update sex of %s", rita.first_name);
+
+    n = MQI_SELECT_BY_SECONDARY_INDEX(persons_select_columns, persons,
+                                      "by_sex", female, rows);
+    fail_if(n != 1 || rows[0].id != greta.id, "index not updated, "
+            "got %d rows", n);
+
+    n = MQI_DELETE(persons, where_greta);
+    fail_if(n != 1, "failed to delete %s", greta.first_name);
+
+    n = MQI_SELECT_BY_SECONDARY_INDEX(persons_select_columns, persons,
+                                      "by_sex", female, rows);
+    fail_if(n != 0, "deleted row is still in the index");
+
+    fail_if(mqi_drop_secondary_index(persons, "by_sex") < 0,
+            "failed to drop index (%s)", strerror(errno));
+
+    n = MQI_SELECT_BY_SECONDARY_INDEX(persons_select_columns, persons,
+                                      "by_sex", female, rows);
+    fail_unless(n < 0 && errno == ENOENT, "dropped index is still usable");
+}
+END_TEST
+
+
+
+START_TEST(planned_queries_on_persons)
+{
+    MQI_INDEX_DEFINITION(by_id_columns,
+        MQI_INDEX_COLUMN("id")
+    );
+    MQI_WHERE_CLAUSE(where_elvis,
+        MQI_EQUAL( MQI_COLUMN(2), MQI_STRING_VAR(elvis.first_name ) ) MQI_AND
+        MQI_EQUAL( MQI_COLUMN(1), MQI_STRING_VAR(elvis.family_name) )
+    );
+    MQI_WHERE_CLAUSE(where_id_range,
+        MQI_GREATER_OR_EQUAL( MQI_COLUMN(3), MQI_UNSIGNED_VAR(elvis.id) )
+        MQI_AND
+        MQI_LESS( MQI_COLUMN(3), MQI_UNSIGNED_VAR(greta.id) )
+    );
+    MQI_WHERE_CLAUSE(where_females_below,
+        MQI_GREATER( MQI_UNSIGNED_VAR(tom.id), MQI_COLUMN(3) ) MQI_AND
+        MQI_EQUAL( MQI_COLUMN(0), MQI_STRING_VAR(rita.sex) )
+    );
+    MQI_WHERE_CLAUSE(where_either,
+        MQI_EQUAL( MQI_COLUMN(3), MQI_UNSIGNED_VAR(rita.id) ) MQI_OR
+        MQI_EQUAL( MQI_COLUMN(3), MQI_UNSIGNED_VAR(tom.id) )
+    );
+
+    query_t rows[32];
+    char    plan[256];
+    int     n;
+
+    PREREQUISITE(insert_into_persons);
+
+    fail_if(mqi_create_secondary_index(persons, "by_id", mqi_index_ordered,
+                                       by_id_columns) < 0,
+            "failed to create ordered index (%s)", strerror(errno));
+
+    fail_if(mqi_explain(persons, where_elvis, plan, sizeof(plan)) < 0,
+            "failed to explain query (%s)", strerror(errno));
+    fail_if(!strstr(plan, "primary index lookup"),
+            "primary key equality is not a point lookup:\n%s", plan);
+
+    n = MQI_SELECT(persons_select_columns, persons, where_elvis, rows);
+    fail_if(n != 1 || rows[0].id != elvis.id, "point lookup returned %d rows",
+            n);
+
+    mqi_explain(persons, where_id_range, plan, sizeof(plan));
+    fail_if(!strstr(plan, "range scan on index 'by_id' (id >= 600, id < 2000)")
+            || !strstr(plan, "filter: none"),
+            "id bounds are not a range scan:\n%s", plan);
+
+    n = MQI_SELECT(persons_select_columns, persons, where_id_range, rows);
+    fail_if(n != 3 || rows[0].id != elvis.id || rows[1].id != gary.id ||
+            rows[2].id != chuck.id, "range scan returned %d rows", n);
+
+    mqi_explain(persons, where_females_below, plan, sizeof(plan));
+    fail_if(!strstr(plan, "(id < 500)") ||
+            !strstr(plan, "filter: 1 residual term"),
+            "flipped bound is not a range scan with a filter:\n%s", plan);
+
+    n = MQI_SELECT(persons_select_columns, persons, where_females_below, rows);
+    fail_if(n != 1 || rows[0].id != rita.id,
+            "range scan with residual filter returned %d rows", n);
+
+    mqi_explain(persons, where_either, plan, sizeof(plan));
+    fail_if(!strstr(plan, "full table scan"),
+            "disjunction is not a full table scan:\n%s", plan);
+
+    n = MQI_SELECT(persons_select_columns, persons, where_either, rows);
+    fail_if(n != 2, "disjunction returned %d rows", n);
+
+    n = MQI_DELETE(persons, where_id_range);
+    fail_if(n != 3, "range delete deleted %d rows", n);
+
+    n = MQI_SELECT(persons_select_columns, persons, where_either, rows);
+    fail_if(n != 2, "range delete deleted rows out of range");
+
+    n = MQI_SELECT(persons_select_columns, persons, where_id_range, rows);
+    fail_if(n != 0, "deleted rows are still found by range scan");
+}
+END_TEST
+
+
+
+START_TEST(aggregated_queries_on_persons)
+{
+    typedef struct {
+        const char *sex;
+        uint32_t    count;
+        uint32_t    min;
+        uint32_t    max;
+        uint32_t    sum;
+        double      avg;
+    } summary_t;
+
+    MQI_INDEX_DEFINITION(by_id_columns,
+        MQI_INDEX_COLUMN("id")
+    );
+    MQI_COLUMN_SELECTION_LIST(summary_columns,
+        MQI_COLUMN_SELECTOR(           0, summary_t, sex   ),
+        MQI_AGGREGATE_SELECTOR( count, 3, summary_t, count ),
+        MQI_AGGREGATE_SELECTOR( min,   3, summary_t, min   ),
+        MQI_AGGREGATE_SELECTOR( max,   3, summary_t, max   ),
+        MQI_AGGREGATE_SELECTOR( sum,   3, summary_t, sum   ),
+        MQI_AGGREGATE_SELECTOR( avg,   3, summary_t, avg   )
+    );
+    MQI_COLUMN_SELECTION_LIST(invalid_columns,
+        MQI_AGGREGATE_SELECTOR( sum,   4, summary_t, sum   )
+    );
+    MQI_WHERE_CLAUSE(where_id_range,
+        MQI_GREATER_OR_EQUAL( MQI_COLUMN(3), MQI_UNSIGNED_VAR(elvis.id) )
+        MQI_AND
+        MQI_LESS( MQI_COLUMN(3), MQI_UNSIGNED_VAR(greta.id) )
+    );
+
+    static int         by_sex[]        = { 0, -1 };
+    static mqi_order_t sex_order[]     = { {0, false}, {-1, false} };
+    static mqi_order_t id_order[]      = { {0, false}, {-1, false} };
+    static mqi_order_t id_desc_order[] = { {0, true }, {-1, false} };
+    static mqi_order_t name_order[]    = { {1, false}, {-1, false} };
+
+    mqi_query_t grouped  = { by_sex, sex_order,     0 };
+    mqi_query_t lowest   = { NULL,   id_order,      3 };
+    mqi_query_t highest  = { NULL,   id_desc_order, 2 };
+    mqi_query_t by_name  = { NULL,   name_order,    0 };
+    summary_t   sums[4];
+    query_t     rows[32];
+    query_t     few[2];
+    int         n;
+
+    PREREQUISITE(insert_into_persons);
+
+    n = MQI_SELECT(summary_columns, persons, NULL, sums);
+    fail_if(n != 1, "aggregate select returned %d rows (%s)", n,
+            n < 0 ? strerror(errno) : "no error");
+    fail_if(sums[0].count != 6 || sums[0].min != 44 || sums[0].max != 2000 ||
+            sums[0].sum != 4944 || sums[0].avg != 824.0,
+            "wrong aggregates over the whole table");
+
+    n = MQI_SELECT_QUERY(summary_columns, persons, NULL, &grouped, sums);
+    fail_if(n != 2, "grouped select returned %d rows", n);
+    fail_if(strcmp(sums[0].sex, "female") || sums[0].count != 2 ||
+            sums[0].max != 2000 || strcmp(sums[1].sex, "male") ||
+            sums[1].count != 4 || sums[1].sum != 2900,
+            "wrong aggregates for the groups");
+
+    n = MQI_SELECT_QUERY(persons_select_columns, persons, NULL, &by_name, rows);
+    fail_if(n != 6 || strcmp(rows[0].family_name, "Cooper") ||
+            strcmp(rows[5].family_name, "Presley"),
+            "ordering by family name failed");
+
+    n = MQI_SELECT_QUERY(persons_select_columns, persons, NULL, &highest, few);
+    fail_if(n != 2 || few[0].id != greta.id || few[1].id != chuck.id,
+            "top-N select returned wrong rows");
+
+    n = MQI_SELECT_QUERY(persons_select_columns, persons, NULL, &by_name, few);
+    fail_if(n != -1 || errno != EOVERFLOW,
+            "ordered select did not overflow the result buffer");
+
+    /* the ordered index produces the lowest ids without sorting */
+    fail_if(mqi_create_secondary_index(persons, "by_id", mqi_index_ordered,
+                                       by_id_columns) < 0,
+            "failed to create ordered index (%s)", strerror(errno));
+
+    n = MQI_SELECT_QUERY(persons_select_columns, persons, NULL, &lowest, rows);
+    fail_if(n != 3 || rows[0].id != rita.id || rows[1].id != tom.id ||
+            rows[2].id != elvis.id, "index ordered select returned wrong rows");
+
+    n = MQI_SELECT_QUERY(persons_select_columns, persons, where_id_range,
+                         &lowest, rows);
+    fail_if(n != 3 || rows[0].id != elvis.id || rows[1].id != gary.id ||
+            rows[2].id != chuck.id, "range ordered select returned wrong rows");
+
+    n = MQI_SELECT(invalid_columns, persons, NULL, sums);
+    fail_if(n != -1 || errno != EINVAL, "sum of varchars did not fail");
+}
+END_TEST
+
+
+static bool visit_persons(mqi_cursor_t *cur, void *user_data)
+{
+    int *limit = (int *)user_data;
+
+    MQI_UNUSED(cur);
+
+    return --*limit > 0;
+}
+
+START_TEST(streamed_select_from_persons)
+{
+    MQI_WHERE_CLAUSE(where_male,
+        MQI_EQUAL( MQI_COLUMN(0), MQI_STRING_VAR(elvis.sex) )
+    );
+
+    mqi_cursor_t *cur;
+    query_t       row;
+    const void   *id;
+    const char   *name;
+    int           limit;
+    int           n;
+
+    PREREQUISITE(insert_into_persons);
+
+    cur = mqi_select_cursor_open(persons, where_male, persons_select_columns);
+    fail_if(!cur, "failed to open cursor (%s)", strerror(errno));
+
+    for (n = 0;  mqi_select_cursor_next(cur, &row) > 0;  n++) {
+        id   = mqi_select_cursor_get_column(cur, 3);
+        name = mqi_select_cursor_get_column(cur, 1);
+
+        fail_if(!id || *(uint32_t *)id != row.id, "wrong id column");
+        fail_if(name != row.family_name, "family name was copied");
+    }
+
+    fail_if(n != 4, "cursor returned %d rows instead of 4", n);
+    fail_if(mqi_select_cursor_next(cur, &row) != 0, "cursor started over");
+    fail_if(mqi_update(persons, where_male, persons_select_columns, &row) >= 0
+            || errno != EDEADLK, "table could be updated under a cursor");
+    fail_if(mqi_select_cursor_close(cur) < 0, "failed to close cursor");
+
+    limit = 2;
+    n = mqi_select_visit(persons, NULL, persons_select_columns,
+                         visit_persons, &limit);
+    fail_if(n != 2, "visit went on for %d rows instead of 2", n);
+
+    cur = mqi_select_cursor_open(MQI_HANDLE_INVALID, NULL, NULL);
+    fail_if(cur || errno != EINVAL, "cursor opened for an invalid table");
+}
+END_TEST
+
+
+START_TEST(joined_select_from_persons)
+{
+    typedef struct {
+        const char *title;
+        uint32_t    star;
+        int32_t     year;
+    } film_t;
+
+    typedef struct {
+        const char *first_name;
+        const char *title;
+        int32_t     year;
+    } credit_t;
+
+    MQI_COLUMN_DEFINITION_LIST(films_coldefs,
+        MQI_COLUMN_DEFINITION( "title" , MQI_VARCHAR(16) ),
+        MQI_COLUMN_DEFINITION( "star"  , MQI_UNSIGNED    ),
+        MQI_COLUMN_DEFINITION( "year"  , MQI_INTEGER     )
+    );
+    MQI_COLUMN_SELECTION_LIST(films_columns,
+        MQI_COLUMN_SELECTOR( 0, film_t, title ),
+        MQI_COLUMN_SELECTOR( 1, film_t, star  ),
+        MQI_COLUMN_SELECTOR( 2, film_t, year  )
+    );
+    /* the columns of films follow the five columns of persons */
+    MQI_COLUMN_SELECTION_LIST(credit_columns,
+        MQI_COLUMN_SELECTOR( 2, credit_t, first_name ),
+        MQI_COLUMN_SELECTOR( 5, credit_t, title      ),
+        MQI_COLUMN_SELECTOR( 7, credit_t, year       )
+    );
+
+    static film_t films[] = {
+        { "Top Gun"       ,  500, 1986 },
+        { "High Noon"     ,  700, 1952 },
+        { "Jailhouse Rock",  600, 1957 },
+        { "Gilda"         ,   44, 1946 },
+        { "Cocktail"      ,  500, 1988 },
+        { "Missing"       , 3000, 1982 },
+    };
+    static film_t *data[] = {
+        films + 0, films + 1, films + 2, films + 3, films + 4, films + 5, NULL
+    };
+    static const char *stars[] = {
+        "Tom", "Gary", "Elvis", "Rita", "Tom", NULL
+    };
+    static int32_t year = 1955;
+
+    MQI_WHERE_CLAUSE(where_recent_male,
+        MQI_GREATER( MQI_COLUMN(7), MQI_INTEGER_VAR(year) ) MQI_AND
+        MQI_EQUAL( MQI_COLUMN(0), MQI_STRING_VAR(elvis.sex) )
+    );
+
+    static char *star_index[] = { "star", NULL };
+
+    mqi_handle_t films_table;
+    credit_t     rows[16];
+    int          pass, i, j, n;
+
+    PREREQUISITE(insert_into_persons);
+
+    films_table = MQI_CREATE_TABLE("films", MQI_TEMPORARY, films_coldefs,
+                                   NULL);
+    fail_if(films_table == MQI_HANDLE_INVALID, "failed to create films "
+            "table (%s)", strerror(errno));
+
+    n = MQI_INSERT_INTO(films_table, films_columns, data);
+    fail_if(n != 6, "inserted %d films instead of 6", n);
+
+    /* first with a transient hash, then with an index on films.star */
+    for (pass = 0;  pass < 2;  pass++) {
+        n = MQI_SELECT_JOIN(credit_columns, persons, 3, films_table, 1,
+                            NULL, rows);
+        fail_if(n != 5, "join returned %d rows instead of 5 (%s)", n,
+                strerror(errno));
+
+        for (i = 0;  i < n;  i++) {
+            for (j = 0;  j < MQI_DIMENSION(films);  j++) {
+                if (!strcmp(rows[i].title, films[j].title))
+                    break;
+            }
+
+            fail_if(j >= MQI_DIMENSION(films) - 1 ||
+                    strcmp(rows[i].first_name, stars[j]) ||
+                    rows[i].year != films[j].year,
+                    "mismatching joined row '%s' '%s'",
+                    rows[i].first_name, rows[i].title);
+        }
+
+        n = MQI_SELECT_JOIN(credit_columns, persons, 3, films_table, 1,
+                            where_recent_male, rows);
+        fail_if(n != 3, "filtered join returned %d rows instead of 3", n);
+
+        for (i = 0;  i < n;  i++) {
+            fail_if(rows[i].year <= year, "join condition was ignored");
+        }
+
+        fail_if(!pass && mqi_create_secondary_index(films_table, "by_star",
+                                                    mqi_index_hash,
+                                                    star_index) < 0,
+                "failed to create index by_star (%s)", strerror(errno));
+    }
+
+    n = MQI_SELECT_JOIN(credit_columns, persons, 2, films_table, 1,
+                        NULL, rows);
+    fail_if(n >= 0 || errno != EINVAL, "joined columns of different types");
+
+    n = mqi_select_join(persons, 3, films_table, 1, NULL, credit_columns,
+                        rows, sizeof(rows[0]), 2);
+    fail_if(n >= 0 || errno != EOVERFLOW, "join overflowed the results");
+}
+END_TEST
+
+START_TEST(bulk_insert_and_upsert)
+{
+    typedef struct {
+        uint32_t    id;
+        const char *name;
+        int32_t     count;
+    } item_t;
+
+    MQI_COLUMN_DEFINITION_LIST(stock_coldefs,
+        MQI_COLUMN_DEFINITION( "id"    , MQI_UNSIGNED    ),
+        MQI_COLUMN_DEFINITION( "name"  , MQI_VARCHAR(12) ),
+        MQI_COLUMN_DEFINITION( "count" , MQI_INTEGER     )
+    );
+    MQI_INDEX_DEFINITION(stock_indexdef,
+        MQI_INDEX_COLUMN("id")
+    );
+    MQI_COLUMN_SELECTION_LIST(stock_columns,
+        MQI_COLUMN_SELECTOR( 0, item_t, id    ),
+        MQI_COLUMN_SELECTOR( 1, item_t, name  ),
+        MQI_COLUMN_SELECTOR( 2, item_t, count )
+    );
+    MQI_COLUMN_SELECTION_LIST(count_columns,
+        MQI_COLUMN_SELECTOR( 0, item_t, id    ),
+        MQI_COLUMN_SELECTOR( 2, item_t, count )
+    );
+
+    static item_t items[] = {
+        { 1, "bolt"  , 10 },
+        { 2, "nut"   , 20 },
+        { 3, "washer", 30 },
+        { 4, "screw" , 40 },
+    };
+    static item_t duplicates[] = {
+        { 5, "rivet" ,  5 },
+        { 2, "nut"   ,  0 },
+    };
+    static item_t counts[] = {
+        { 2, NULL, 25 },
+        { 4, NULL, 40 },
+        { 6, NULL, 60 },
+    };
+    static int32_t count = 25;
+
+    MQI_WHERE_CLAUSE(where_count,
+        MQI_EQUAL( MQI_COLUMN(2), MQI_INTEGER_VAR(count) )
+    );
+
+    static char *count_index[] = { "count", NULL };
+
+    mqi_handle_t stock, tx;
+    item_t       rows[8];
+    int          n;
+
+    PREREQUISITE(open_db);
+
+    stock = MQI_CREATE_TABLE("stock", MQI_TEMPORARY, stock_coldefs,
+                             stock_indexdef);
+    fail_if(stock == MQI_HANDLE_INVALID, "failed to create stock table (%s)",
+            strerror(errno));
+
+    fail_if(mqi_create_secondary_index(stock, "by_count", mqi_index_hash,
+                                       count_index) < 0,
+            "failed to create index by_count (%s)", strerror(errno));
+
+    n = MQI_INSERT_BULK(stock, mqi_insert_strict, stock_columns, items);
+    fail_if(n != 4, "bulk insert returned %d instead of 4 (%s)", n,
+            strerror(errno));
+
+    tx = MQI_BEGIN;
+    n = MQI_INSERT_BULK(stock, mqi_insert_strict, stock_columns, duplicates);
+    fail_if(n >= 0 || errno != EEXIST, "bulk insert of a duplicate key");
+    MQI_ROLLBACK(tx);
+
+    n = MQI_SELECT(stock_columns, stock, NULL, rows);
+    fail_if(n != 4, "a failed bulk insert was not rolled back");
+
+    /* one changed, one unchanged and one new row */
+    n = MQI_INSERT_BULK(stock, mqi_insert_upsert, count_columns, counts);
+    fail_if(n != 2, "upsert returned %d instead of 2 (%s)", n,
+            strerror(errno));
+    n = MQI_SELECT(stock_columns, stock, NULL, rows);
+    fail_if(n != 5, "upsert did not add a new row");
+
+    n = MQI_SELECT(stock_columns, stock, where_count, rows);
+    fail_if(n != 1 || rows[0].id != 2 || strcmp(rows[0].name, "nut"),
+            "upsert did not update the existing row in place");
+
+    fail_if(mqi_insert_bulk(stock, mqi_insert_strict, stock_columns, items,
+                            sizeof(items[0]), 0) >= 0 || errno != EINVAL,
+            "bulk insert accepted zero rows");
+
+    mqi_drop_table(stock);
+}
+END_TEST
+
+
+START_TEST(out_of_line_strings)
+{
+#define LONG_TEXT 2000
+    typedef struct {
+        const char *title;
+        const char *body;
+    } note_t;
+
+    MQI_COLUMN_DEFINITION_LIST(notes_coldefs,
+        MQI_COLUMN_DEFINITION( "title" , MQI_TEXT ),
+        MQI_COLUMN_DEFINITION( "body"  , MQI_TEXT )
+    );
+    MQI_INDEX_DEFINITION(notes_indexdef,
+        MQI_INDEX_COLUMN("title")
+    );
+    MQI_COLUMN_SELECTION_LIST(notes_columns,
+        MQI_COLUMN_SELECTOR( 0, note_t, title ),
+        MQI_COLUMN_SELECTOR( 1, note_t, body  )
+    );
+    MQI_COLUMN_SELECTION_LIST(body_column,
+        MQI_COLUMN_SELECTOR( 1, note_t, body )
+    );
+
+    static char long_body[LONG_TEXT + 1];
+    static note_t notes[] = {
+        { "first" , long_body },
+        { "second", long_body },
+        { "third" , ""        }
+    };
+    static note_t *note_ptrs[] = { notes + 0, notes + 1, notes + 2, NULL };
+    static note_t short_note = { NULL, "short" };
+    static const char *second = "second";
+
+    MQI_INDEX_VALUE(second_index,
+        MQI_STRING_VAL(second)
+    );
+    MQI_WHERE_CLAUSE(where_second,
+        MQI_EQUAL( MQI_COLUMN(0), MQI_STRING_VAR(second) )
+    );
+
+    mqi_column_def_t  defs[2];
+    mqi_snapshot_t   *snapshot;
+    mqi_handle_t      table, tx;
+    note_t            rows[4];
+    int               n;
+
+    PREREQUISITE(open_db);
+
+    memset(long_body, 'x', LONG_TEXT);
+
+    table = MQI_CREATE_TABLE("notes", MQI_TEMPORARY, notes_coldefs,
+                             notes_indexdef);
+    fail_if(table == MQI_HANDLE_INVALID, "failed to create notes table (%s)",
+            strerror(errno));
+
+    n = MQI_DESCRIBE(table, defs);
+    fail_if(n != 2 || defs[1].type != mqi_varchar || defs[1].length != 0,
+            "text column is not described as a varchar of any length");
+
+    n = MQI_INSERT_INTO(table, notes_columns, note_ptrs);
+    fail_if(n != 3, "inserted %d rows instead of 3 (%s)", n, strerror(errno));
+
+    n = MQI_SELECT_BY_INDEX(notes_columns, table, second_index, rows);
+    fail_if(n != 1, "could not select a row by a text key");
+    fail_if(strcmp(rows[0].body, long_body), "long text was truncated");
+
+    n = MQI_SELECT(notes_columns, table, where_second, rows);
+    fail_if(n != 1 || strcmp(rows[0].title, "second"),
+            "could not select a row by a text condition");
+
+    fail_if(MQI_UPDATE(table, body_column, notes + 1, where_second) != 0,
+            "rewriting the same text was taken as a change");
+
+    fail_if(!(snapshot = mqi_open_snapshot()), "failed to open snapshot (%s)",
+            strerror(errno));
+
+    tx = MQI_BEGIN;
+    fail_if(MQI_UPDATE(table, body_column, &short_note, where_second) != 1,
+            "update of a text column failed");
+    MQI_ROLLBACK(tx);
+
+    n = MQI_SELECT(notes_columns, table, where_second, rows);
+    fail_if(n != 1 || strcmp(rows[0].body, long_body),
+            "rollback did not restore the text");
+
+    fail_if(MQI_UPDATE(table, body_column, &short_note, where_second) != 1,
+            "update of a text column failed");
+    fail_if(MQI_DELETE(table, NULL) != 3, "failed to delete the notes");
+
+    n = MQI_SELECT_SNAPSHOT(snapshot, notes_columns, table, where_second,
+                            rows);
+    fail_if(n != 1 || strcmp(rows[0].body, long_body),
+            "snapshot lost the text of a deleted row");
+
+    mqi_close_snapshot(snapshot);
+
+    n = MQI_SELECT(notes_columns, table, NULL, rows);
+    fail_if(n != 0, "deleted notes are still selectable");
+
+    mqi_drop_table(table);
+#undef LONG_TEXT
+}
+END_TEST
+
+
+START_TEST(text_key_changes)
+{
+#define NKEY 10
+    typedef struct {
+        const char *key;
+        int32_t     value;
+    } keyed_t;
+
+    MQI_COLUMN_DEFINITION_LIST(keyed_coldefs,
+        MQI_COLUMN_DEFINITION( "key"   , MQI_TEXT    ),
+        MQI_COLUMN_DEFINITION( "value" , MQI_INTEGER )
+    );
+    MQI_INDEX_DEFINITION(keyed_indexdef,
+        MQI_INDEX_COLUMN("key")
+    );
+    MQI_COLUMN_SELECTION_LIST(keyed_columns,
+        MQI_COLUMN_SELECTOR( 0, keyed_t, key   ),
+        MQI_COLUMN_SELECTOR( 1, keyed_t, value )
+    );
+    MQI_COLUMN_SELECTION_LIST(key_column,
+        MQI_COLUMN_SELECTOR( 0, keyed_t, key )
+    );
+
+    static char     keys[NKEY][16];
+    static keyed_t  keyed[NKEY];
+    static keyed_t *keyed_ptrs[NKEY + 1];
+    static keyed_t  renamed = { "key-z", 0 };
+    static int32_t  five = 5, seven = 7;
+    static const char *expected[] = {
+        "key-5", "key-6", "key-8", "key-9", "key-z"
+    };
+
+    MQI_WHERE_CLAUSE(where_low,
+        MQI_LESS( MQI_COLUMN(1), MQI_INTEGER_VAR(five) )
+    );
+    MQI_WHERE_CLAUSE(where_seven,
+        MQI_EQUAL( MQI_COLUMN(1), MQI_INTEGER_VAR(seven) )
+    );
+
+    mqi_handle_t  table;
+    keyed_t       rows[NKEY];
+    int           i, n;
+
+    PREREQUISITE(open_db);
+
+    table = MQI_CREATE_TABLE("keyed", MQI_TEMPORARY, keyed_coldefs,
+                             keyed_indexdef);
+    fail_if(table == MQI_HANDLE_INVALID, "failed to create table (%s)",
+            strerror(errno));
+
+    for (i = 0;  i < NKEY;  i++) {
+        snprintf(keys[i], sizeof(keys[i]), "key-%d", i);
+        keyed[i].key   = keys[i];
+        keyed[i].value = i;
+        keyed_ptrs[i]  = keyed + i;
+    }
+    keyed_ptrs[i] = NULL;
+
+    fail_if(MQI_INSERT_INTO(table, keyed_columns, keyed_ptrs) != NKEY,
+            "failed to insert rows with text keys");
+
+    /* the scan goes on past rows whose key strings were just freed */
+    n = MQI_DELETE(table, where_low);
+    fail_if(n != 5, "deleted %d rows instead of 5", n);
+
+    n = MQI_UPDATE(table, key_column, &renamed, where_seven);
+    fail_if(n != 1, "changed the key of %d rows instead of 1", n);
+
+    n = MQI_SELECT(keyed_columns, table, NULL, rows);
+    fail_if(n != 5, "selected %d rows instead of 5", n);
+
+    for (i = 0;  i < n;  i++) {
+        fail_if(strcmp(rows[i].key, expected[i]), "row %d has key '%s' "
+                "instead of '%s'", i, rows[i].key, expected[i]);
+    }
+
+    mqi_drop_table(table);
+#undef NKEY
+}
+END_TEST
+
+
+START_TEST(column_stamps)
+{
+    typedef struct {
+        int32_t  id;
+        int32_t  volume;
+        int32_t  muted;
+    } sink_t;
+
+    MQI_COLUMN_DEFINITION_LIST(sinks_coldefs,
+        MQI_COLUMN_DEFINITION( "id"     , MQI_INTEGER ),
+        MQI_COLUMN_DEFINITION( "volume" , MQI_INTEGER ),
+        MQI_COLUMN_DEFINITION( "muted"  , MQI_INTEGER )
+    );
+    MQI_INDEX_DEFINITION(sinks_indexdef,
+        MQI_INDEX_COLUMN("id")
+    );
+    MQI_COLUMN_SELECTION_LIST(sinks_columns,
+        MQI_COLUMN_SELECTOR( 0, sink_t, id     ),
+        MQI_COLUMN_SELECTOR( 1, sink_t, volume ),
+        MQI_COLUMN_SELECTOR( 2, sink_t, muted  )
+    );
+    MQI_COLUMN_SELECTION_LIST(volume_column,
+        MQI_COLUMN_SELECTOR( 1, sink_t, volume )
+    );
+
+    static sink_t  sinks[] = { { 1, 10, 0 }, { 2, 20, 0 } };
+    static sink_t *sink_ptrs[] = { sinks + 0, sinks + 1, NULL };
+    static sink_t  louder = { 0, 50, 0 };
+    static int32_t one = 1, two = 2;
+
+    MQI_INDEX_VALUE(key_one,
+        MQI_INTEGER_VAL(one)
+    );
+    MQI_INDEX_VALUE(key_two,
+        MQI_INTEGER_VAL(two)
+    );
+    MQI_WHERE_CLAUSE(where_one,
+        MQI_EQUAL( MQI_COLUMN(0), MQI_INTEGER_VAR(one) )
+    );
+
+    mqi_bitfld_t  volume, muted;
+    mqi_handle_t  table, tx;
+    uint32_t      vstamp, mstamp, kstamp1, kstamp2;
+    int           n;
+
+    PREREQUISITE(open_db);
+
+    mqi_bitfld_clear(&volume);
+    mqi_bitfld_set(&volume, 1);
+    mqi_bitfld_clear(&muted);
+    mqi_bitfld_set(&muted, 2);
+
+    table = MQI_CREATE_TABLE("sinks", MQI_TEMPORARY, sinks_coldefs,
+                             sinks_indexdef);
+    fail_if(table == MQI_HANDLE_INVALID, "failed to create sinks table (%s)",
+            strerror(errno));
+
+    tx = MQI_BEGIN;
+    n  = MQI_INSERT_INTO(table, sinks_columns, sink_ptrs);
+    fail_if(n != 2, "inserted %d rows instead of 2 (%s)", n, strerror(errno));
+    MQI_COMMIT(tx);
+
+    vstamp  = mqi_get_column_stamp(table, &volume);
+    mstamp  = mqi_get_column_stamp(table, &muted);
+    kstamp1 = mqi_get_key_stamp(table, key_one);
+    kstamp2 = mqi_get_key_stamp(table, key_two);
+
+    fail_if(vstamp != mqi_get_table_stamp(table) || mstamp != vstamp,
+            "insert did not stamp every column");
+    fail_if(kstamp1 != vstamp || kstamp2 != vstamp,
+            "insert did not stamp the keys of the rows");
+
+    tx = MQI_BEGIN;
+    fail_if(MQI_UPDATE(table, volume_column, &louder, where_one) != 1,
+            "failed to update the volume");
+    MQI_COMMIT(tx);
+
+    fail_if(mqi_get_column_stamp(table, &volume) <= vstamp,
+            "update did not stamp the updated column");
+    fail_if(mqi_get_column_stamp(table, &muted) != mstamp,
+            "update stamped a column it did not change");
+    fail_if(mqi_get_key_stamp(table, key_one) <= kstamp1,
+            "update did not stamp the key of the row");
+    fail_if(mqi_get_key_stamp(table, key_two) != kstamp2,
+            "update stamped the key of another row");
+
+    vstamp  = mqi_get_column_stamp(table, &volume);
+    kstamp1 = mqi_get_key_stamp(table, key_one);
+
+    tx = MQI_BEGIN;
+    MQI_UPDATE(table, volume_column, &louder, where_one);
+    MQI_COMMIT(tx);
+
+    fail_if(mqi_get_column_stamp(table, &volume) != vstamp ||
+            mqi_get_key_stamp(table, key_one) != kstamp1,
+            "rewriting the same value changed the stamps");
+
+    tx = MQI_BEGIN;
+    MQI_UPDATE(table, volume_column, sinks + 0, where_one);
+    fail_if(mqi_get_column_stamp(table, &volume) <= vstamp,
+            "update did not stamp the column within the transaction");
+    MQI_ROLLBACK(tx);
+
+    fail_if(mqi_get_column_stamp(table, &volume) != vstamp ||
+            mqi_get_key_stamp(table, key_one) != kstamp1,
+            "rollback did not restore the stamps");
+
+    tx = MQI_BEGIN;
+    fail_if(MQI_DELETE(table, where_one) != 1, "failed to delete a sink");
+    MQI_COMMIT(tx);
+
+    fail_if(mqi_get_column_stamp(table, &muted) <= mstamp,
+            "delete did not stamp every column");
+    fail_if(mqi_get_key_stamp(table, key_two) != kstamp2,
+            "delete stamped the key of another row");
+
+    mqi_drop_table(table);
+}
+END_TEST
+
+
+START_TEST(columnar_table)
+{
+#define NREADING 200
+    typedef struct {
+        uint32_t  id;
+        int32_t   level;
+        double    value;
+    } reading_t;
+
+    MQI_COLUMN_DEFINITION_LIST(readings_coldefs,
+        MQI_COLUMN_DEFINITION( "id"    , MQI_UNSIGNED   ),
+        MQI_COLUMN_DEFINITION( "name"  , MQI_VARCHAR(8) ),
+        MQI_COLUMN_DEFINITION( "level" , MQI_INTEGER    ),
+        MQI_COLUMN_DEFINITION( "value" , MQI_FLOATING   )
+    );
+    MQI_INDEX_DEFINITION(readings_indexdef,
+        MQI_INDEX_COLUMN("id")
+    );
+    MQI_COLUMN_SELECTION_LIST(readings_columns,
+        MQI_COLUMN_SELECTOR( 0, reading_t, id    ),
+        MQI_COLUMN_SELECTOR( 2, reading_t, level ),
+        MQI_COLUMN_SELECTOR( 3, reading_t, value )
+    );
+    MQI_COLUMN_SELECTION_LIST(level_column,
+        MQI_COLUMN_SELECTOR( 2, reading_t, level )
+    );
+
+    static int32_t   high = 3, updated = 100;
+    static double    limit = 50.0, top = 90.0;
+    static reading_t readings[NREADING];
+    static reading_t *data[NREADING + 1];
+    static reading_t update = { 0, 100, 0.0 };
+
+    MQI_WHERE_CLAUSE(where_high_and_low,
+        MQI_GREATER_OR_EQUAL( MQI_COLUMN(2), MQI_INTEGER_VAR(high) ) MQI_AND
+        MQI_LESS( MQI_COLUMN(3), MQI_FLOATING_VAR(limit) )
+    );
+    MQI_WHERE_CLAUSE(where_top,
+        MQI_GREATER_OR_EQUAL( MQI_FLOATING_VAR(top), MQI_COLUMN(3) ) MQI_AND
+        MQI_GREATER( MQI_COLUMN(3), MQI_FLOATING_VAR(limit) )
+    );
+    MQI_WHERE_CLAUSE(where_updated,
+        MQI_EQUAL( MQI_COLUMN(2), MQI_INTEGER_VAR(updated) )
+    );
+
+    mqi_handle_t readings_table;
+    reading_t    rows[128];
+    char         plan[256];
+    int          i, n;
+
+    PREREQUISITE(open_db);
+
+    readings_table = MQI_CREATE_TABLE("readings", MQI_TEMPORARY|MQI_COLUMNAR,
+                                      readings_coldefs, readings_indexdef);
+    fail_if(readings_table == MQI_HANDLE_INVALID, "failed to create "
+            "columnar table (%s)", strerror(errno));
+
+    for (i = 0;  i < NREADING;  i++) {
+        readings[i].id    = i;
+        readings[i].level = (i % 10) - 5;
+        readings[i].value = i * 0.5;
+        data[i] = readings + i;
+    }
+
+    n = MQI_INSERT_INTO(readings_table, readings_columns, data);
+    fail_if(n != NREADING, "inserted %d rows instead of %d (%s)", n,
+            NREADING, strerror(errno));
+
+    mqi_explain(readings_table, where_high_and_low, plan, sizeof(plan));
+    fail_if(!strstr(plan, "vectorized scan") ||
+            !strstr(plan, "level >= 3") || !strstr(plan, "value < 50"),
+            "fixed-width predicates are not vectorized:\n%s", plan);
+
+    n = MQI_SELECT(readings_columns, readings_table, where_high_and_low,
+                   rows);
+    fail_if(n != 20, "vectorized scan returned %d rows instead of 20", n);
+
+    for (i = 0;  i < n;  i++) {
+        fail_if(rows[i].level < high || rows[i].value >= limit,
+                "vectorized scan returned a mismatching row (id %u)",
+                rows[i].id);
+    }
+
+    n = MQI_UPDATE(readings_table, level_column, &update, where_top);
+    fail_if(n != 80, "vectorized update changed %d rows instead of 80", n);
+
+    n = MQI_SELECT(readings_columns, readings_table, where_updated, rows);
+    fail_if(n != 80, "column vectors are out of sync after update (%d rows)",
+            n);
+
+    n = MQI_DELETE(readings_table, where_updated);
+    fail_if(n != 80, "vectorized delete removed %d rows instead of 80", n);
+
+    n = MQI_SELECT(readings_columns, readings_table, where_top, rows);
+    fail_if(n != 0, "deleted rows are still found by vectorized scan");
+
+    n = MQI_SELECT(readings_columns, readings_table, where_high_and_low,
+                   rows);
+    fail_if(n != 20, "delete removed rows out of range");
+#undef NREADING
+}
+END_TEST
+
+
+
+START_TEST(persistent_table)
+{
+    typedef struct {
+        const char *key;
+        int32_t     value;
+    } setting_t;
+
+    MQI_COLUMN_DEFINITION_LIST(settings_coldefs,
+        MQI_COLUMN_DEFINITION( "key"   , MQI_VARCHAR(16) ),
+        MQI_COLUMN_DEFINITION( "value" , MQI_INTEGER     )
+    );
+    MQI_INDEX_DEFINITION(settings_indexdef,
+        MQI_INDEX_COLUMN("key")
+    );
+    MQI_COLUMN_SELECTION_LIST(settings_columns,
+        MQI_COLUMN_SELECTOR( 0, setting_t, key   ),
+        MQI_COLUMN_SELECTOR( 1, setting_t, value )
+    );
+    MQI_COLUMN_SELECTION_LIST(value_column,
+        MQI_COLUMN_SELECTOR( 1, setting_t, value )
+    );
+
+    static setting_t  a = {"a", 1}, b = {"b", 2}, c = {"c", 3}, d = {"d", 4};
+    static setting_t  x = {"x", 9}, e = {"e", 5}, upd = {NULL, 20};
+    static setting_t *committed[] = {&a, &b, &c, &d, NULL};
+    static setting_t *rolledback[] = {&x, NULL};
+    static setting_t *later[] = {&e, NULL};
+    static setting_t  f = {"f", 6}, g = {"g", 7};
+    static setting_t *outer[] = {&f, NULL}, *inner[] = {&g, NULL};
+    static const char *key_b = "b", *key_c = "c";
+
+    MQI_WHERE_CLAUSE(where_b,
+        MQI_EQUAL( MQI_COLUMN(0), MQI_STRING_VAR(key_b) )
+    );
+    MQI_WHERE_CLAUSE(where_c,
+        MQI_EQUAL( MQI_COLUMN(0), MQI_STRING_VAR(key_c) )
+    );
+
+    char          dir[] = "/tmp/check-libmqi-XXXXXX";
+    char          path[256];
+    struct stat   st;
+    mqi_handle_t  settings, tx, txs[3];
+    setting_t     rows[16];
+    int           i, n, sum;
+
+    PREREQUISITE(open_db);
+
+    fail_if(!mkdtemp(dir), "failed to create temporary directory");
+    fail_if(mqi_set_persist_directory(dir) < 0, "failed to set persistent "
+            "storage directory (%s)", strerror(errno));
+
+    settings = MQI_CREATE_TABLE("settings", MQI_PERSISTENT,
+                                settings_coldefs, settings_indexdef);
+    fail_if(settings == MQI_HANDLE_INVALID, "failed to create persistent "
+            "table (%s)", strerror(errno));
+
+    tx = MQI_BEGIN;
+    n  = MQI_INSERT_INTO(settings, settings_columns, committed);
+    fail_if(n != 4, "inserted %d rows instead of 4", n);
+    fail_if(MQI_COMMIT(tx) < 0, "commit failed (%s)", strerror(errno));
+
+    fail_if(MQI_UPDATE(settings, value_column, &upd, where_b) != 1,
+            "failed to update persistent table");
+    fail_if(MQI_DELETE(settings, where_c) != 1,
+            "failed to delete from persistent table");
+
+    tx = MQI_BEGIN;
+    n  = MQI_INSERT_INTO(settings, settings_columns, rolledback);
+    fail_if(n != 1, "inserted %d rows instead of 1", n);
+    fail_if(MQI_ROLLBACK(tx) < 0, "rollback failed (%s)", strerror(errno));
+
+    for (i = 0;  i < 2;  i++) {
+        fail_if(mqi_drop_table(settings) < 0, "failed to drop persistent "
+                "table (%s)", strerror(errno));
+
+        settings = MQI_CREATE_TABLE("settings", MQI_PERSISTENT,
+                                    settings_coldefs, settings_indexdef);
+        fail_if(settings == MQI_HANDLE_INVALID, "failed to restore "
+                "persistent table (%s)", strerror(errno));
+
+        n = MQI_SELECT(settings_columns, settings, NULL, rows);
+        fail_if(n != 3 + i, "restored %d rows instead of %d", n, 3 + i);
+
+        n = MQI_SELECT(value_column, settings, where_b, rows);
+        fail_if(n != 1 || rows[0].value != 20, "update was not restored");
+
+        n = MQI_SELECT(value_column, settings, where_c, rows);
+        fail_if(n != 0, "deleted row was restored");
+
+        if (i == 0) {
+            fail_if(mqi_checkpoint() < 0, "checkpoint failed (%s)",
+                    strerror(errno));
+            n = MQI_INSERT_INTO(settings, settings_columns, later);
+            fail_if(n != 1, "failed to insert after checkpoint");
+        }
+    }
+
+    n = MQI_SELECT(settings_columns, settings, NULL, rows);
+    for (i = 0, sum = 0;  i < n;  i++)
+        sum += rows[i].value;
+    fail_if(sum != 1 + 20 + 4 + 5, "restored rows have wrong values");
+
+    /* well over a megabyte of log without a single transaction */
+    for (i = 0;  i < 50000;  i++) {
+        upd.value = i;
+        fail_if(MQI_UPDATE(settings, value_column, &upd, where_b) != 1,
+                "failed to update persistent table");
+    }
+
+    snprintf(path, sizeof(path), "%s/settings.wal", dir);
+    fail_if(stat(path, &st) < 0 || st.st_size >= 1024 * 1024,
+            "log was not truncated by a checkpoint");
+
+    /* changes in the outermost and innermost of three transactions */
+    txs[0] = MQI_BEGIN;
+    fail_if(MQI_INSERT_INTO(settings, settings_columns, outer) != 1,
+            "failed to insert in the outer transaction");
+    txs[1] = MQI_BEGIN;
+    txs[2] = MQI_BEGIN;
+    fail_if(MQI_INSERT_INTO(settings, settings_columns, inner) != 1,
+            "failed to insert in the inner transaction");
+
+    for (i = 2;  i >= 0;  i--)
+        fail_if(MQI_COMMIT(txs[i]) < 0, "commit failed (%s)",strerror(errno));
+
+    fail_if(mqi_drop_table(settings) < 0, "failed to drop persistent table");
+
+    settings = MQI_CREATE_TABLE("settings", MQI_PERSISTENT,
+                                settings_coldefs, settings_indexdef);
+    fail_if(settings == MQI_HANDLE_INVALID, "failed to restore "
+            "persistent table (%s)", strerror(errno));
+
+    n = MQI_SELECT(value_column, settings, where_b, rows);
+    fail_if(n != 1 || rows[0].value != 49999, "last update was not restored");
+
+    n = MQI_SELECT(settings_columns, settings, NULL, rows);
+    fail_if(n != 6, "nested transactions were not restored (%d rows)", n);
+
+    fail_if(mqi_drop_table(settings) < 0, "failed to drop persistent table");
+
+    snprintf(path, sizeof(path), "%s/settings.snapshot", dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/settings.wal", dir);
+    unlink(path);
+    rmdir(dir);
+}
+END_TEST
+
+
+
+typedef struct {
+    uint32_t  id;
+    int32_t   value;
+} counter_t;
+
+MQI_COLUMN_SELECTION_LIST(counter_columns,
+    MQI_COLUMN_SELECTOR( 0, counter_t, id    ),
+    MQI_COLUMN_SELECTOR( 1, counter_t, value )
+);
+
+typedef struct {
+    mqi_snapshot_t *snapshot;
+    mqi_handle_t    table;
+    int             sum;
+} snapshot_reader_t;
+
+static int sum_counters(mqi_snapshot_t *snapshot, mqi_handle_t table)
+{
+    counter_t rows[16];
+    int       i, n, sum;
+
+    n = MQI_SELECT_SNAPSHOT(snapshot, counter_columns, table, NULL, rows);
+
+    for (i = 0, sum = 0;  i < n;  i++)
+        sum += rows[i].value;
+
+    return n < 0 ? -1 : sum;
+}
+
+static void *snapshot_reader(void *data)
+{
+    snapshot_reader_t *reader = data;
+
+    reader->sum = sum_counters(reader->snapshot, reader->table);
+
+    return NULL;
+}
+
+START_TEST(snapshot_isolation)
+{
+    MQI_COLUMN_DEFINITION_LIST(counters_coldefs,
+        MQI_COLUMN_DEFINITION( "id"    , MQI_UNSIGNED ),
+        MQI_COLUMN_DEFINITION( "value" , MQI_INTEGER  )
+    );
+    MQI_INDEX_DEFINITION(counters_indexdef,
+        MQI_INDEX_COLUMN("id")
+    );
+    MQI_COLUMN_SELECTION_LIST(value_column,
+        MQI_COLUMN_SELECTOR( 1, counter_t, value )
+    );
+
+    static counter_t  c1 = {1, 1}, c2 = {2, 2}, c3 = {3, 3}, c4 = {4, 4};
+    static counter_t *initial[] = {&c1, &c2, &c3, NULL};
+    static counter_t *added[] = {&c4, NULL};
+    static counter_t  ten = {0, 10}, thirty = {0, 30};
+    static uint32_t   one = 1, two = 2, three = 3;
+
+    MQI_WHERE_CLAUSE(where_one,
+        MQI_EQUAL( MQI_COLUMN(0), MQI_UNSIGNED_VAR(one) )
+    );
+    MQI_WHERE_CLAUSE(where_two,
+        MQI_EQUAL( MQI_COLUMN(0), MQI_UNSIGNED_VAR(two) )
+    );
+    MQI_WHERE_CLAUSE(where_three,
+        MQI_EQUAL( MQI_COLUMN(0), MQI_UNSIGNED_VAR(three) )
+    );
+
+    mqi_handle_t       counters, tx;
+    mqi_snapshot_t    *before, *during, *after;
+    snapshot_reader_t  reader;
+    pthread_t          thread;
+    counter_t          rows[16];
+    int                n;
+
+    PREREQUISITE(open_db);
+
+    counters = MQI_CREATE_TABLE("counters", MQI_TEMPORARY,
+                                counters_coldefs, counters_indexdef);
+    fail_if(counters == MQI_HANDLE_INVALID, "failed to create table (%s)",
+            strerror(errno));
+
+    n = MQI_INSERT_INTO(counters, counter_columns, initial);
+    fail_if(n != 3, "inserted %d rows instead of 3", n);
+
+    fail_if(!(before = mqi_open_snapshot()), "failed to open snapshot (%s)",
+            strerror(errno));
+
+    tx = MQI_BEGIN;
+
+    fail_if(MQI_UPDATE(counters, value_column, &ten, where_one) != 1,
+            "update in transaction failed");
+    fail_if(MQI_DELETE(counters, where_two) != 1,
+            "delete in transaction failed");
+    fail_if(MQI_INSERT_INTO(counters, counter_columns, added) != 1,
+            "insert in transaction failed");
+
+    fail_if(!(during = mqi_open_snapshot()), "failed to open snapshot "
+            "in transaction (%s)", strerror(errno));
+
+    /* a reader on another thread while the transaction is open */
+    reader.snapshot = during;
+    reader.table    = counters;
+    reader.sum      = -1;
+
+    fail_if(pthread_create(&thread, NULL, snapshot_reader, &reader) != 0,
+            "failed to start reader thread");
+    pthread_join(thread, NULL);
+
+    fail_if(reader.sum != 1 + 2 + 3, "reader thread saw uncommitted "
+            "changes (sum %d)", reader.sum);
+    fail_if(sum_counters(before, counters) != 1 + 2 + 3,
+            "snapshot sees uncommitted changes");
+
+    n = MQI_SELECT(counter_columns, counters, NULL, rows);
+    fail_if(n != 3, "writer does not see its own changes");
+
+    fail_if(MQI_COMMIT(tx) < 0, "commit failed (%s)", strerror(errno));
+
+    fail_if(sum_counters(before, counters) != 1 + 2 + 3 ||
+            sum_counters(during, counters) != 1 + 2 + 3,
+            "snapshot sees changes committed after it was opened");
+
+    fail_if(!(after = mqi_open_snapshot()), "failed to open snapshot (%s)",
+            strerror(errno));
+    fail_if(mqi_get_snapshot_stamp(after) <= mqi_get_snapshot_stamp(before),
+            "commit did not advance the commit stamp");
+    fail_if(sum_counters(after, counters) != 10 + 3 + 4,
+            "snapshot does not see committed changes");
+
+    fail_if(MQI_UPDATE(counters, value_column, &thirty, where_three) != 1,
+            "update outside transaction failed");
+
+    fail_if(sum_counters(after, counters) != 10 + 3 + 4 ||
+            sum_counters(before, counters) != 1 + 2 + 3,
+            "snapshot sees an autocommitted change");
+
+    mqi_close_snapshot(before);
+    mqi_close_snapshot(during);
+
+    fail_if(sum_counters(after, counters) != 10 + 3 + 4,
+            "closing older snapshots released visible images");
+
+    mqi_close_snapshot(after);
+
+    fail_if(mqi_drop_table(counters) < 0, "failed to drop table");
+}
+END_TEST
+
+
+#define READER_THREADS  4
+#define READER_LOOPS    500
+#define TRANSFERS       200
+#define TRANSFER_TOTAL  1000
+
+typedef struct {
+    mqi_handle_t  table;
+    int           torn;       /* selects that saw half a transfer */
+    int           upgraded;   /* write locks granted to a reader */
+} locked_reader_t;
+
+static void *locked_reader(void *data)
+{
+    locked_reader_t *reader = data;
+    counter_t        rows[16];
+    int              i, j, n, sum;
+
+    for (i = 0;  i < READER_LOOPS;  i++) {
+        n = MQI_SELECT(counter_columns, reader->table, NULL, rows);
+
+        for (j = 0, sum = 0;  j < n;  j++)
+            sum += rows[j].value;
+
+        if (n != 2 || sum != TRANSFER_TOTAL)
+            reader->torn++;
+    }
+
+    if (mqi_read_lock() == 0) {
+        if (mqi_write_lock() == 0) {
+            reader->upgraded++;
+            mqi_unlock();
+        }
+        else if (errno != EDEADLK)
+            reader->upgraded++;
+
+        mqi_unlock();
+    }
+
+    return NULL;
+}
+
+START_TEST(concurrent_readers)
+{
+    MQI_COLUMN_DEFINITION_LIST(accounts_coldefs,
+        MQI_COLUMN_DEFINITION( "id"    , MQI_UNSIGNED ),
+        MQI_COLUMN_DEFINITION( "value" , MQI_INTEGER  )
+    );
+    MQI_INDEX_DEFINITION(accounts_indexdef,
+        MQI_INDEX_COLUMN("id")
+    );
+    MQI_COLUMN_SELECTION_LIST(value_column,
+        MQI_COLUMN_SELECTOR( 1, counter_t, value )
+    );
+
+    static counter_t  from = {1, TRANSFER_TOTAL}, to = {2, 0};
+    static counter_t *initial[] = {&from, &to, NULL};
+    static uint32_t   one = 1, two = 2;
+
+    MQI_WHERE_CLAUSE(where_from,
+        MQI_EQUAL( MQI_COLUMN(0), MQI_UNSIGNED_VAR(one) )
+    );
+    MQI_WHERE_CLAUSE(where_to,
+        MQI_EQUAL( MQI_COLUMN(0), MQI_UNSIGNED_VAR(two) )
+    );
+
+    mqi_handle_t     accounts, tx;
+    locked_reader_t  readers[READER_THREADS];
+    pthread_t        threads[READER_THREADS];
+    counter_t        value;
+    int              i;
+
+    PREREQUISITE(open_db);
+
+    accounts = MQI_CREATE_TABLE("accounts", MQI_TEMPORARY,
+                                accounts_coldefs, accounts_indexdef);
+    fail_if(accounts == MQI_HANDLE_INVALID, "failed to create table (%s)",
+            strerror(errno));
+
+    fail_if(MQI_INSERT_INTO(accounts, counter_columns, initial) != 2,
+            "failed to insert accounts");
+
+    for (i = 0;  i < READER_THREADS;  i++) {
+        memset(readers + i, 0, sizeof(readers[i]));
+        readers[i].table = accounts;
+
+        fail_if(pthread_create(threads + i, NULL, locked_reader,
+                               readers + i) != 0,
+                "failed to start reader thread");
+    }
+
+    /* move the total between the rows; readers must see only the sum */
+    for (i = 1;  i <= TRANSFERS;  i++) {
+        tx = MQI_BEGIN;
+
+        value.value = TRANSFER_TOTAL - i;
+        MQI_UPDATE(accounts, value_column, &value, where_from);
+        value.value = i;
+        MQI_UPDATE(accounts, value_column, &value, where_to);
+
+        fail_if(MQI_COMMIT(tx) < 0, "commit failed (%s)", strerror(errno));
+    }
+
+    for (i = 0;  i < READER_THREADS;  i++) {
+        pthread_join(threads[i], NULL);
+
+        fail_if(readers[i].torn, "reader %d saw %d torn transfers",
+                i, readers[i].torn);
+        fail_if(readers[i].upgraded, "reader %d could upgrade its lock", i);
+    }
 
-    fail_if(n < 0 && errno != EEXIST, "error (%s)", strerror(errno));
+    fail_if(mqi_get_transaction_depth() != 0, "transaction left open");
+    fail_if(mqi_drop_table(accounts) < 0, "failed to drop table");
 }
 END_TEST
 
-START_TEST(transaction_begin)
-{
-    mqi_handle_t tx;
-
-    fail_if(txdepth >= (int)MQI_DIMENSION(transactions), "too many nested "
-            "transactions. Only %d allowed", MQI_DIMENSION(transactions));
 
-    tx = MQI_BEGIN;
 
-    fail_if(tx == MQI_HANDLE_INVALID, "error (%d)", strerror(errno));
+#define LABELS         16
+#define LABEL_ROUNDS   200
+#define LABEL_READS    500
 
-    transactions[txdepth++] = tx;
-}
-END_TEST
+typedef struct {
+    uint32_t  id;
+    char     *name;
+    char     *note;
+} label_t;
+
+MQI_COLUMN_SELECTION_LIST(label_columns,
+    MQI_COLUMN_SELECTOR( 0, label_t, id   ),
+    MQI_COLUMN_SELECTOR( 1, label_t, name ),
+    MQI_COLUMN_SELECTOR( 2, label_t, note )
+);
 
+typedef struct {
+    mqi_snapshot_t *snapshot;
+    mqi_handle_t    table;
+    int             wrong;      /* selects that saw a changed string */
+} label_reader_t;
 
-START_TEST(replace_in_persons)
+static bool labels_intact(label_t *labels, int n)
 {
-    static record_t  gary = {"male", "Gary","Cooper", 200, "gary@att.com"};
-    static record_t *duplicate[] = {&gary, NULL};
+    char name[32], note[64];
+    int  i;
 
-    int n;
-
-    PREREQUISITE(insert_into_persons);
-    PREREQUISITE(transaction_begin);
+    if (n != LABELS)
+        return false;
 
-    n = MQI_REPLACE(persons, persons_insert_columns, duplicate);
+    for (i = 0;  i < n;  i++) {
+        snprintf(name, sizeof(name), "label-%u", labels[i].id);
+        snprintf(note, sizeof(note), "the original note of label %u",
+                 labels[i].id);
 
-    fail_if(n < 0, "error (%s)", strerror(errno));
+        if (strcmp(labels[i].name, name) || strcmp(labels[i].note, note))
+            return false;
+    }
 
-    fail_if(n == 1, "duplicate was inserted instead of replacement");
+    return true;
 }
-END_TEST
 
-START_TEST(filtered_select_from_persons)
+static void *label_reader(void *data)
 {
-    static char     *initial = "G";
-    static uint32_t  idlimit = 200;
+    label_reader_t *reader = data;
+    label_t         rows[LABELS * 2];
+    int             i, n;
 
-    MQI_WHERE_CLAUSE(where,
-        MQI_GREATER( MQI_COLUMN(1), MQI_STRING_VAR(initial)   ) MQI_AND
-        MQI_GREATER( MQI_COLUMN(3), MQI_UNSIGNED_VAR(idlimit) )
-    );
+    for (i = 0;  i < LABEL_READS;  i++) {
+        n = MQI_SELECT_SNAPSHOT(reader->snapshot, label_columns,
+                                reader->table, NULL, rows);
 
-    query_t rows[32];
-    int n;
+        if (!labels_intact(rows, n))
+            reader->wrong++;
+    }
 
-    PREREQUISITE(replace_in_persons);
+    return NULL;
+}
 
-    n = MQI_SELECT(persons_select_columns, persons, where, rows);
+START_TEST(snapshot_strings)
+{
+    MQI_COLUMN_DEFINITION_LIST(labels_coldefs,
+        MQI_COLUMN_DEFINITION( "id"   , MQI_UNSIGNED    ),
+        MQI_COLUMN_DEFINITION( "name" , MQI_VARCHAR(16) ),
+        MQI_COLUMN_DEFINITION( "note" , MQI_TEXT        )
+    );
+    MQI_INDEX_DEFINITION(labels_indexdef,
+        MQI_INDEX_COLUMN("id")
+    );
+    MQI_COLUMN_SELECTION_LIST(text_columns,
+        MQI_COLUMN_SELECTOR( 1, label_t, name ),
+        MQI_COLUMN_SELECTOR( 2, label_t, note )
+    );
 
-    fail_if(n < 0, "error (%s)", strerror(errno));
+    static char names[LABELS][16], notes[LABELS][64];
+    static label_t  labels[LABELS];
+    static label_t *rows[LABELS + 1], *deleted[2];
+    static uint32_t odd = 1;
 
-    if (verbose)
-        print_rows(n, rows);
+    MQI_WHERE_CLAUSE(where_odd,
+        MQI_EQUAL( MQI_COLUMN(0), MQI_UNSIGNED_VAR(odd) )
+    );
 
-    fail_if(n != 3, "selcted %d rows but the right number would be 3", n);
-}
-END_TEST
+    mqi_handle_t    table;
+    mqi_snapshot_t *snapshot;
+    label_reader_t  reader;
+    pthread_t       thread;
+    char            name[16], note[64];
+    label_t         held[LABELS], changed;
+    int             i, nheld, round;
 
+    PREREQUISITE(open_db);
 
-START_TEST(full_select_from_persons)
-{
-    query_t *r, rows[32];
-    int i, n;
+    table = MQI_CREATE_TABLE("labels", MQI_TEMPORARY,
+                             labels_coldefs, labels_indexdef);
+    fail_if(table == MQI_HANDLE_INVALID, "failed to create table (%s)",
+            strerror(errno));
 
-    PREREQUISITE(replace_in_persons);
+    for (i = 0;  i < LABELS;  i++) {
+        snprintf(names[i], sizeof(names[i]), "label-%d", i);
+        snprintf(notes[i], sizeof(notes[i]), "the original note of label %d",
+                 i);
 
-    n = MQI_SELECT(persons_select_columns, persons, MQI_ALL, rows);
+        labels[i].id   = i;
+        labels[i].name = names[i];
+        labels[i].note = notes[i];
+        rows[i] = labels + i;
+    }
 
-    fail_if(n < 0, "error (%s)", strerror(errno));
+    rows[LABELS] = NULL;
 
-    if (verbose) {
-        printf("   id first name      family name     \n");
-        printf("--------------------------------------\n");
+    fail_if(MQI_INSERT_INTO(table, label_columns, rows) != LABELS,
+            "failed to insert labels");
 
-        if (!n)
-            printf("no rows\n");
-        else {
-            for (i = 0; i < n;  i++) {
-                r = rows + i;
-                printf("%5d %-15s %-15s\n", r->id,
-                       r->first_name, r->family_name);
-            }
-        }
+    fail_if(!(snapshot = mqi_open_snapshot()), "failed to open snapshot (%s)",
+            strerror(errno));
 
-        printf("--------------------------------------\n");
-    }
+    /* read from the live rows, held on to until the snapshot is closed */
+    nheld = MQI_SELECT_SNAPSHOT(snapshot, label_columns, table, NULL, held);
 
-    fail_if(n != 6, "selcted %d rows but the right number would be 3", n);
-}
-END_TEST
+    fail_if(!labels_intact(held, nheld), "snapshot select failed");
 
+    memset(&reader, 0, sizeof(reader));
+    reader.snapshot = snapshot;
+    reader.table    = table;
 
+    fail_if(pthread_create(&thread, NULL, label_reader, &reader) != 0,
+            "failed to start reader thread");
 
-START_TEST(select_from_persons_by_index)
-{
-    MQI_INDEX_VALUE(index,
-        MQI_STRING_VAL(elvis.family_name)
-        MQI_STRING_VAL(elvis.first_name)
-    );
+    /* rewrite the strings in place and free rows while the reader runs */
+    changed.name = name;
+    changed.note = note;
 
-    query_t row;
-    int n;
+    for (round = 0;  round < LABEL_ROUNDS;  round++) {
+        snprintf(name, sizeof(name), "round-%d", round);
+        snprintf(note, sizeof(note), "a much longer note of round %d", round);
 
-    PREREQUISITE(replace_in_persons);
+        fail_if(MQI_UPDATE(table, text_columns, &changed, NULL) != LABELS,
+                "update failed (%s)", strerror(errno));
 
-    n = MQI_SELECT_BY_INDEX(persons_select_columns, persons, index, &row);
+        odd = 2 * (round % (LABELS / 2)) + 1;
 
-    fail_if(n < 0, "errno (%s)", strerror(errno));
+        fail_if(MQI_DELETE(table, where_odd) != 1, "delete failed (%s)",
+                strerror(errno));
+        deleted[0] = labels + odd;
 
-    fail_if(!n, "could not select %s %s", elvis.first_name, elvis.family_name);
+        fail_if(MQI_INSERT_INTO(table, label_columns, deleted) != 1,
+                "reinsert failed (%s)", strerror(errno));
+    }
 
-    fail_if(strcmp(row.first_name, elvis.first_name), "mismatching first "
-            "name ('%s' vs. '%s')", elvis.first_name, row.first_name);
+    pthread_join(thread, NULL);
 
-    fail_if(strcmp(row.family_name, elvis.family_name), "mismatching family "
-            "name ('%s' vs. '%s')", elvis.family_name, row.family_name);
+    fail_if(reader.wrong, "reader saw changed strings in %d selects",
+            reader.wrong);
+    fail_if(!labels_intact(held, nheld),
+            "strings of a snapshot select changed before it was closed");
 
-    fail_if(row.id != elvis.id, "mismatching id (%u vs. %u)",
-            elvis.id, row.id);
+    fail_if(mqi_close_snapshot(snapshot) < 0, "failed to close snapshot");
+    fail_if(mqi_drop_table(table) < 0, "failed to drop table");
 }
 END_TEST
 
@@ -788,6 +2359,261 @@ START_TEST(column_trigger)
 }
 END_TEST
 
+START_TEST(changefeed)
+{
+    MQI_WHERE_CLAUSE(where_elvis,
+        MQI_EQUAL( MQI_COLUMN(1), MQI_STRING_VAR(elvis.family_name) )
+    );
+    MQI_WHERE_CLAUSE(where_gary,
+        MQI_EQUAL( MQI_COLUMN(1), MQI_STRING_VAR(gary.family_name) )
+    );
+    MQI_WHERE_CLAUSE(where_tom,
+        MQI_EQUAL( MQI_COLUMN(1), MQI_STRING_VAR(tom.family_name) )
+    );
+    MQI_WHERE_CLAUSE(where_rita,
+        MQI_EQUAL( MQI_COLUMN(1), MQI_STRING_VAR(rita.family_name) )
+    );
+
+    MQI_COLUMN_SELECTION_LIST(id_column,
+        MQI_COLUMN_SELECTOR( 3, query_t, id )
+    );
+
+    static query_t  kalle = {1, "Korhonen", "Kalle"};
+    static query_t  tom2  = {501, NULL, NULL};
+    static uint32_t ids[] = {1100, 1, 500, 2000, 44};
+
+    mqi_handle_t trh;
+    changes_t *chs;
+    int sts;
+    int i, n;
+
+    PREREQUISITE(create_table_persons);
+
+    sts = mqi_create_changefeed(persons, changefeed_cb, CHANGEFEED_DATA,
+                                persons_select_columns);
+
+    fail_if(sts < 0, "create changefeed failed: errno (%s)", strerror(errno));
+
+    /*
+     * inserts followed by changes of the inserted rows
+     * are expected to be folded into the inserts
+     */
+    trh = mqi_begin_transaction();
+
+    fail_if(trh == MQI_HANDLE_INVALID, "begin failed: errno(%s)",
+            strerror(errno));
+
+    PREREQUISITE(insert_into_persons);
+
+    n = MQI_UPDATE(persons, persons_select_columns, &kalle, where_elvis);
+    fail_if(n != 1, "updated %d rows but supposed to just 1", n);
+
+    n = MQI_DELETE(persons, where_gary);
+    fail_if(n != 1, "deleted %d rows but supposed to just 1", n);
+
+    sts = mqi_commit_transaction(trh);
+
+    fail_if(sts < 0, "commit failed: errno (%s)", strerror(errno));
+    fail_unless(nchanges == 1, "wrong number of batches (%d vs. 1)", nchanges);
+
+    chs = changes;
+
+    fail_unless(chs->nrow == (int)MQI_DIMENSION(ids),
+                "wrong number of changes (%d vs. %d)",
+                chs->nrow, MQI_DIMENSION(ids));
+
+    for (i = 0;  i < chs->nrow;  i++) {
+        fail_unless(chs->rows[i].change == mqi_change_insert,
+                    "wrong change (%d vs. %d) @ row %d",
+                    chs->rows[i].change, mqi_change_insert, i);
+        fail_unless(chs->rows[i].after == ids[i],
+                    "wrong id (%u vs. %u) @ row %d",
+                    chs->rows[i].after, ids[i], i);
+    }
+
+    /*
+     * an update and a delete; a rolled back transaction delivers nothing
+     */
+    trh = mqi_begin_transaction();
+
+    n = MQI_DELETE(persons, where_tom);
+    fail_if(n != 1, "deleted %d rows but supposed to just 1", n);
+
+    sts = mqi_rollback_transaction(trh);
+
+    fail_if(sts < 0, "rollback failed: errno (%s)", strerror(errno));
+    fail_unless(nchanges == 1, "rollback produced a batch");
+
+    trh = mqi_begin_transaction();
+
+    n = MQI_UPDATE(persons, id_column, &tom2, where_tom);
+    fail_if(n != 1, "updated %d rows but supposed to just 1", n);
+
+    n = MQI_DELETE(persons, where_rita);
+    fail_if(n != 1, "deleted %d rows but supposed to just 1", n);
+
+    sts = mqi_commit_transaction(trh);
+
+    fail_if(sts < 0, "commit failed: errno (%s)", strerror(errno));
+    fail_unless(nchanges == 2, "wrong number of batches (%d vs. 2)", nchanges);
+
+    chs = changes + 1;
+
+    fail_unless(chs->nrow == 2, "wrong number of changes (%d vs. 2)",
+                chs->nrow);
+    fail_unless(chs->rows[0].change == mqi_change_update &&
+                mqi_bitfld_next(&chs->rows[0].colmask, 0) == 3 &&
+                mqi_bitfld_next(&chs->rows[0].colmask, 4) < 0 &&
+                chs->rows[0].before == tom.id &&
+                chs->rows[0].after == tom2.id,
+                "wrong update (%d, 0x%llx, %u, %u)", chs->rows[0].change,
+                (unsigned long long)chs->rows[0].colmask.word[0],
+                chs->rows[0].before,
+                chs->rows[0].after);
+    fail_unless(chs->rows[1].change == mqi_change_delete &&
+                chs->rows[1].before == rita.id &&
+                chs->rows[1].after == 0,
+                "wrong delete (%d, %u, %u)", chs->rows[1].change,
+                chs->rows[1].before, chs->rows[1].after);
+
+    sts = mqi_drop_changefeed(persons, changefeed_cb, CHANGEFEED_DATA);
+
+    fail_if(sts < 0, "drop changefeed failed: errno (%s)", strerror(errno));
+}
+END_TEST
+
+START_TEST(batched_triggers)
+{
+    MQI_WHERE_CLAUSE(where_tom,
+        MQI_EQUAL( MQI_COLUMN(1), MQI_STRING_VAR(tom.family_name) )
+    );
+    MQI_WHERE_CLAUSE(where_rita,
+        MQI_EQUAL( MQI_COLUMN(1), MQI_STRING_VAR(rita.family_name) )
+    );
+
+    MQI_COLUMN_SELECTION_LIST(id_column,
+        MQI_COLUMN_SELECTOR( 3, query_t, id )
+    );
+
+    static record_t  marilyn   = {"female", "Marilyn", "Monroe", 1926,
+                                  "mmo@heaven.org"};
+    static record_t *newcomer[] = {&marilyn, NULL};
+    static query_t   tom2  = {501, NULL, NULL};
+    static uint32_t  ids[] = {1926, 1100, 700, 600, 500, 2000, 44};
+
+    mqi_handle_t trh, inner;
+    changes_t *chs;
+    int sts;
+    int i, n;
+
+    PREREQUISITE(create_table_persons);
+
+    sts = mqi_create_batched_row_trigger(persons, batched_event_cb,
+                                         BATCHED_TRIGGER_DATA,
+                                         persons_select_columns);
+
+    fail_if(sts < 0, "create batched row trigger failed: errno (%s)",
+            strerror(errno));
+
+    sts = mqi_create_batched_column_trigger(persons, 3, batched_event_cb,
+                                            BATCHED_TRIGGER_DATA,
+                                            persons_select_columns);
+
+    fail_if(sts < 0, "create batched column trigger failed: errno (%s)",
+            strerror(errno));
+
+    /*
+     * nothing is delivered before the outermost commit, and the
+     * changes of the rolled back inner transaction are not delivered
+     */
+    trh = mqi_begin_transaction();
+
+    fail_if(trh == MQI_HANDLE_INVALID, "begin failed: errno(%s)",
+            strerror(errno));
+
+    PREREQUISITE(insert_into_persons);
+
+    inner = mqi_begin_transaction();
+
+    n = MQI_UPDATE(persons, id_column, &tom2, where_tom);
+    fail_if(n != 1, "updated %d rows but supposed to just 1", n);
+
+    n = MQI_DELETE(persons, where_rita);
+    fail_if(n != 1, "deleted %d rows but supposed to just 1", n);
+
+    sts = mqi_rollback_transaction(inner);
+
+    fail_if(sts < 0, "rollback failed: errno (%s)", strerror(errno));
+
+    inner = mqi_begin_transaction();
+
+    n = MQI_INSERT_INTO(persons, persons_insert_columns, newcomer);
+    fail_if(n != 1, "inserted %d rows but supposed to just 1", n);
+
+    sts = mqi_commit_transaction(inner);
+
+    fail_if(sts < 0, "commit failed: errno (%s)", strerror(errno));
+    fail_unless(nchanges == 0, "batch delivered before the outermost commit");
+
+    sts = mqi_commit_transaction(trh);
+
+    fail_if(sts < 0, "commit failed: errno (%s)", strerror(errno));
+    fail_unless(nchanges == 2, "wrong number of batches (%d vs. 2)", nchanges);
+
+    for (n = 0;  n < nchanges;  n++) {
+        chs = changes + n;
+
+        fail_unless(chs->nrow == (int)MQI_DIMENSION(ids),
+                    "wrong number of rows (%d vs. %d) in batch %d",
+                    chs->nrow, MQI_DIMENSION(ids), n);
+
+        for (i = 0;  i < chs->nrow;  i++) {
+            fail_unless(chs->rows[i].change == (n ? mqi_change_update :
+                                                    mqi_change_insert) &&
+                        chs->rows[i].before == 0 &&
+                        chs->rows[i].after == ids[i],
+                        "wrong change (%d, %u, %u) @ row %d in batch %d",
+                        chs->rows[i].change, chs->rows[i].before,
+                        chs->rows[i].after, i, n);
+        }
+    }
+
+    trh = mqi_begin_transaction();
+
+    n = MQI_UPDATE(persons, id_column, &tom2, where_tom);
+    fail_if(n != 1, "updated %d rows but supposed to just 1", n);
+
+    n = MQI_DELETE(persons, where_rita);
+    fail_if(n != 1, "deleted %d rows but supposed to just 1", n);
+
+    sts = mqi_commit_transaction(trh);
+
+    fail_if(sts < 0, "commit failed: errno (%s)", strerror(errno));
+    fail_unless(nchanges == 4, "wrong number of batches (%d vs. 4)", nchanges);
+
+    chs = changes + 2;
+
+    fail_unless(chs->nrow == 1 && chs->rows[0].change == mqi_change_delete &&
+                chs->rows[0].before == rita.id,
+                "wrong deletes (%d, %d, %u)", chs->nrow,
+                chs->rows[0].change, chs->rows[0].before);
+
+    chs = changes + 3;
+
+    fail_unless(chs->nrow == 1 && chs->rows[0].change == mqi_change_update &&
+                chs->rows[0].before == tom.id &&
+                chs->rows[0].after == tom2.id,
+                "wrong updates (%d, %d, %u, %u)", chs->nrow,
+                chs->rows[0].change, chs->rows[0].before,
+                chs->rows[0].after);
+
+    sts = mqi_drop_row_trigger(persons, batched_event_cb,
+                               BATCHED_TRIGGER_DATA);
+
+    fail_if(sts < 0, "drop row trigger failed: errno (%s)", strerror(errno));
+}
+END_TEST
+
 START_TEST(sequential_transactions)
 {
     mqi_handle_t  trh;
@@ -894,14 +2720,31 @@ static TCase *basic_tests(void)
     tcase_add_test(tc, insert_duplicate_into_persons);
     tcase_add_test(tc, replace_in_persons);
     tcase_add_test(tc, filtered_select_from_persons);
+    tcase_add_test(tc, grouped_select_from_persons);
     tcase_add_test(tc, full_select_from_persons);
     tcase_add_test(tc, select_from_persons_by_index);
+    tcase_add_test(tc, secondary_index_on_persons);
+    tcase_add_test(tc, planned_queries_on_persons);
+    tcase_add_test(tc, aggregated_queries_on_persons);
+    tcase_add_test(tc, streamed_select_from_persons);
+    tcase_add_test(tc, joined_select_from_persons);
+    tcase_add_test(tc, bulk_insert_and_upsert);
+    tcase_add_test(tc, out_of_line_strings);
+    tcase_add_test(tc, text_key_changes);
+    tcase_add_test(tc, column_stamps);
+    tcase_add_test(tc, columnar_table);
+    tcase_add_test(tc, persistent_table);
+    tcase_add_test(tc, snapshot_isolation);
+    tcase_add_test(tc, concurrent_readers);
+    tcase_add_test(tc, snapshot_strings);
     tcase_add_test(tc, update_in_persons);
     tcase_add_test(tc, delete_from_persons);
     tcase_add_test(tc, transaction_rollback);
     tcase_add_test(tc, table_trigger);
     tcase_add_test(tc, row_trigger);
     tcase_add_test(tc, column_trigger);
+    tcase_add_test(tc, changefeed);
+    tcase_add_test(tc, batched_triggers);
     tcase_add_test(tc, sequential_transactions);
     tcase_add_test(tc, nested_transactions);
 
@@ -1172,6 +3015,115 @@ static void column_event_cb(mqi_event_t *evt, void *user_data)
 #undef PRINT_VALUE
 }
 
+static void changefeed_cb(mqi_event_t *evt, void *user_data)
+{
+    mqi_changefeed_event_t *ce = &evt->changes;
+    mqi_change_row_t       *r;
+    changes_t              *chs;
+    int                     i;
+
+    if (evt->event != mqi_rows_changed || user_data != CHANGEFEED_DATA) {
+        if (verbose)
+            printf("invalid event %d for changefeed\n", evt->event);
+        return;
+    }
+
+    if (nchanges >= (int)MQI_DIMENSION(changes) ||
+        ce->nrow > (int)MQI_DIMENSION(changes[0].rows))
+    {
+        if (verbose)
+            printf("test framework error: changefeed log overflow\n");
+        return;
+    }
+
+    chs = changes + nchanges++;
+    chs->nrow = ce->nrow;
+
+    for (i = 0;  i < ce->nrow;  i++) {
+        r = ce->rows + i;
+
+        chs->rows[i].change  = r->change;
+        chs->rows[i].colmask = r->colmask;
+        chs->rows[i].before  = r->before ? ((query_t *)r->before)->id : 0;
+        chs->rows[i].after   = r->after  ? ((query_t *)r->after)->id  : 0;
+
+        if (verbose) {
+            printf("change %d: %d 0x%llx %u -> %u\n", i, r->change,
+                   (unsigned long long)r->colmask.word[0],
+                   chs->rows[i].before, chs->rows[i].after);
+        }
+    }
+}
+
+static void batched_event_cb(mqi_event_t *evt, void *user_data)
+{
+    mqi_row_event_t    *re = &evt->row;
+    mqi_column_event_t *ce = &evt->column;
+    changes_t          *chs;
+    query_t            *row;
+    int                 i;
+
+    if (user_data != BATCHED_TRIGGER_DATA) {
+        if (verbose)
+            printf("invalid user_data %p for batched trigger\n", user_data);
+        return;
+    }
+
+    if (nchanges >= (int)MQI_DIMENSION(changes) ||
+        re->nrow > (int)MQI_DIMENSION(changes[0].rows))
+    {
+        if (verbose)
+            printf("test framework error: batch log overflow\n");
+        return;
+    }
+
+    chs = changes + nchanges++;
+
+    switch (evt->event) {
+
+    case mqi_row_inserted:
+    case mqi_row_deleted:
+        chs->nrow = re->nrow;
+
+        for (i = 0;  i < re->nrow;  i++) {
+            row = (query_t *)((char *)re->select.data + re->select.length * i);
+
+            if (evt->event == mqi_row_inserted) {
+                chs->rows[i].change = mqi_change_insert;
+                chs->rows[i].after  = row->id;
+            }
+            else {
+                chs->rows[i].change = mqi_change_delete;
+                chs->rows[i].before = row->id;
+            }
+        }
+        break;
+
+    case mqi_column_changed:
+        chs->nrow = ce->nrow;
+
+        for (i = 0;  i < ce->nrow;  i++) {
+            chs->rows[i].change = mqi_change_update;
+            chs->rows[i].before = ce->values[i].old.unsignd;
+            chs->rows[i].after  = ce->values[i].new_.unsignd;
+        }
+        break;
+
+    default:
+        if (verbose)
+            printf("invalid event %d for batched trigger\n", evt->event);
+        return;
+    }
+
+    if (verbose) {
+        for (i = 0;  i < chs->nrow;  i++) {
+            printf("batch %d/%d: %d %u -> %u\n", nchanges - 1, i,
+                   chs->rows[i].change, chs->rows[i].before,
+                   chs->rows[i].after);
+        }
+    }
+}
+
 /*
  * Local Variables:
  * c-basic-offset: 4
@@ -32,6 +32,7 @@
 #include <string.h>
 #include <errno.h>
 #include <libgen.h>
+#include <pthread.h>
 
 #include <check.h>
 
@@ -50,6 +51,8 @@
 #define TABLE_TRIGGER_DATA    TRIGGER_DATA(2)
 #define ROW_TRIGGER_DATA      TRIGGER_DATA(3)
 #define COLUMN_TRIGGER_DATA   TRIGGER_DATA(4)
+#define CHANGEFEED_DATA       TRIGGER_DATA(5)
+#define BATCHED_TRIGGER_DATA  TRIGGER_DATA(6)
 
 
 typedef struct {
@@ -81,6 +84,11 @@ static int persons_nrow = MQI_DIMENSION(persons_rows);
 
 
 static int verbose;
+static int nchange_batch;
+static int nchange;
+static mqi_change_type_t changes[8];
+static int nbatched_row;
+static uint32_t batched_ids[8][2];
 static struct {
     mql_statement_t *begin;
     mql_statement_t *commit;
@@ -100,6 +108,8 @@ static void transaction_event_cb(mql_result_t *, void *);
 static void table_event_cb(mql_result_t *, void *);
 static void row_event_cb(mql_result_t *, void *);
 static void column_event_cb(mql_result_t *, void *);
+static void changefeed_event_cb(mql_result_t *, void *);
+static void batched_event_cb(mql_result_t *, void *);
 
 
 
@@ -281,6 +291,486 @@ START_TEST(make_persons)
 }
 END_TEST
 
+START_TEST(create_secondary_index_on_persons)
+{
+    static char *statements[] = {
+        "CREATE INDEX by_id ON persons (id)",
+        "CREATE ORDERED INDEX by_sex_email ON persons (sex, email)",
+        "CREATE HASH INDEX by_sex ON persons (sex)",
+        NULL
+    };
+
+    mql_result_t *r;
+    int i;
+
+    PREREQUISITE(make_persons);
+
+    for (i = 0;  statements[i];  i++) {
+        r = mql_exec_string(mql_result_string, statements[i]);
+
+        fail_unless(mql_result_is_success(r), "'%s' failed: %s",
+                    statements[i], mql_result_error_get_message(r));
+
+        mql_result_free(r);
+    }
+
+    r = mql_exec_string(mql_result_string, "DROP INDEX by_id ON persons");
+
+    fail_unless(mql_result_is_success(r), "failed to drop index: %s",
+                mql_result_error_get_message(r));
+
+    mql_result_free(r);
+
+    r = mql_exec_string(mql_result_string, "DROP INDEX by_id ON persons");
+
+    fail_if(mql_result_is_success(r), "managed to drop an index twice");
+
+    mql_result_free(r);
+}
+END_TEST
+
+START_TEST(explain_queries_on_persons)
+{
+    static struct {
+        const char *statement;
+        const char *plan;
+    } queries[] = {
+        { "EXPLAIN SELECT * FROM persons"
+          " WHERE family_name = 'Cooper' & first_name = 'Gary'",
+          "access: primary index lookup (family_name, first_name)"  },
+        { "EXPLAIN UPDATE persons SET email = 'x' WHERE sex = 'male'",
+          "access: full table scan in primary index order"          },
+        { "EXPLAIN DELETE FROM persons WHERE family_name = 'Cooper'",
+          "filter: 1 residual term"                                 },
+        { NULL, NULL }
+    };
+
+    mql_result_t *r;
+    const char   *plan;
+    int           i;
+
+    PREREQUISITE(make_persons);
+
+    for (i = 0;  queries[i].statement;  i++) {
+        r = mql_exec_string(mql_result_string, queries[i].statement);
+
+        fail_unless(mql_result_is_success(r), "'%s' failed: %s",
+                    queries[i].statement, mql_result_error_get_message(r));
+
+        plan = mql_result_string_get(r);
+
+        fail_if(!strstr(plan, queries[i].plan), "unexpected plan for '%s':"
+                "\n%s", queries[i].statement, plan);
+
+        mql_result_free(r);
+    }
+
+    fail_if(mql_precompile("EXPLAIN SELECT * FROM persons"),
+            "managed to precompile an EXPLAIN statement");
+}
+END_TEST
+
+START_TEST(columnar_table_with_real_values)
+{
+    static const char *statements[] = {
+        "CREATE TEMPORARY COLUMNAR TABLE samples ("
+        "   id     UNSIGNED,"
+        "   value  REAL    "
+        ")",
+        "INSERT INTO samples VALUES (1, 1.5)",
+        "INSERT INTO samples VALUES (2, 12.25)",
+        "INSERT INTO samples VALUES (3, 20.0)",
+        NULL
+    };
+
+    mql_result_t *r;
+    const char   *plan;
+    int           i, n;
+
+    PREREQUISITE(open_db);
+
+    for (i = 0;  statements[i];  i++) {
+        r = mql_exec_string(mql_result_string, statements[i]);
+
+        fail_unless(mql_result_is_success(r), "'%s' failed: %s",
+                    statements[i], mql_result_error_get_message(r));
+
+        mql_result_free(r);
+    }
+
+    r = mql_exec_string(mql_result_string, "EXPLAIN SELECT id FROM samples"
+                        " WHERE value > 2.5");
+
+    fail_unless(mql_result_is_success(r), "explain failed: %s",
+                mql_result_error_get_message(r));
+
+    plan = mql_result_string_get(r);
+
+    fail_if(!strstr(plan, "vectorized scan"), "real value predicate is not "
+            "vectorized:\n%s", plan);
+
+    mql_result_free(r);
+
+    r = mql_exec_string(mql_result_rows, "SELECT id FROM samples"
+                        " WHERE value > 2.5 & value <= 12.25");
+
+    fail_unless(mql_result_is_success(r), "select failed: %s",
+                mql_result_error_get_message(r));
+
+    n = mql_result_rows_get_row_count(r);
+
+    fail_if(n != 1 || mql_result_rows_get_unsigned(r, 0, 0) != 2,
+            "real value select returned %d rows", n);
+
+    mql_result_free(r);
+}
+END_TEST
+
+START_TEST(multi_row_insert_and_upsert)
+{
+    static const char *statements[] = {
+        "CREATE TEMPORARY TABLE stock ("
+        "   id     UNSIGNED,"
+        "   name   VARCHAR(16),"
+        "   count  INTEGER"
+        ")",
+        "CREATE INDEX ON stock (id)",
+        "INSERT INTO stock VALUES (1, 'bolt', 10), (2, 'nut', 20),"
+        "                         (3, 'washer', 30)",
+        "INSERT OR UPDATE INTO stock (id, count) VALUES (2, 25), (4, 40)",
+        NULL
+    };
+
+    mql_statement_t *stmnt;
+    mql_result_t    *r;
+    const char      *name;
+    char             buf[32];
+    int              i, n;
+
+    PREREQUISITE(open_db);
+
+    for (i = 0;  statements[i];  i++) {
+        r = mql_exec_string(mql_result_string, statements[i]);
+
+        fail_unless(mql_result_is_success(r), "'%s' failed: %s",
+                    statements[i], mql_result_error_get_message(r));
+
+        mql_result_free(r);
+    }
+
+    r = mql_exec_string(mql_result_string, "INSERT INTO stock VALUES"
+                        " (5, 'rivet', 5), (6, 'pin')");
+    fail_if(mql_result_is_success(r), "inserted an unbalanced row");
+    mql_result_free(r);
+
+    stmnt = mql_precompile("INSERT INTO stock VALUES (7, 'nail', 70),"
+                           " (8, 'tack', 80)");
+    fail_if(!stmnt, "precompilation error (%s)", strerror(errno));
+
+    r = mql_exec_statement(mql_result_string, stmnt);
+    fail_unless(mql_result_is_success(r), "exec error: %s",
+                mql_result_error_get_message(r));
+    mql_result_free(r);
+    mql_statement_free(stmnt);
+
+    r = mql_exec_string(mql_result_rows, "SELECT id, name, count FROM stock");
+    fail_unless(mql_result_is_success(r), "select failed: %s",
+                mql_result_error_get_message(r));
+
+    n = mql_result_rows_get_row_count(r);
+    fail_if(n != 6, "stock has %d rows instead of 6", n);
+
+    for (i = 0;  i < n;  i++) {
+        name = mql_result_rows_get_string(r, 1, i, buf, sizeof(buf));
+
+        switch (mql_result_rows_get_unsigned(r, 0, i)) {
+        case 2:
+            fail_if(strcmp(name, "nut") ||
+                    mql_result_rows_get_integer(r, 2, i) != 25,
+                    "upsert did not update the existing row in place");
+            break;
+        case 8:
+            fail_if(strcmp(name, "tack") ||
+                    mql_result_rows_get_integer(r, 2, i) != 80,
+                    "precompiled multi-row insert lost its last row");
+            break;
+        default:
+            break;
+        }
+    }
+
+    mql_result_free(r);
+}
+END_TEST
+
+START_TEST(text_columns)
+{
+#define LONG_TEXT 1500
+    static const char *statements[] = {
+        "CREATE TEMPORARY TABLE notes ("
+        "   title  TEXT,"
+        "   body   text"
+        ")",
+        "CREATE INDEX ON notes (title)",
+        "INSERT INTO notes VALUES ('beta', 'second'), ('alpha', 'first'),"
+        "                         ('gamma', 'third')",
+        NULL
+    };
+
+    mql_result_t *r;
+    const char   *text;
+    char          insert[LONG_TEXT + 64];
+    char          buf[LONG_TEXT + 1];
+    int           i, n;
+
+    PREREQUISITE(open_db);
+
+    for (i = 0;  statements[i];  i++) {
+        r = mql_exec_string(mql_result_string, statements[i]);
+
+        fail_unless(mql_result_is_success(r), "'%s' failed: %s",
+                    statements[i], mql_result_error_get_message(r));
+
+        mql_result_free(r);
+    }
+
+    n = snprintf(insert, sizeof(insert), "INSERT INTO notes VALUES "
+                 "('delta', '");
+    memset(insert + n, 'x', LONG_TEXT);
+    snprintf(insert + n + LONG_TEXT, sizeof(insert) - n - LONG_TEXT, "')");
+
+    r = mql_exec_string(mql_result_string, insert);
+    fail_unless(mql_result_is_success(r), "insert of a long text failed: %s",
+                mql_result_error_get_message(r));
+    mql_result_free(r);
+
+    r = mql_exec_string(mql_result_rows, "SELECT body FROM notes"
+                        " WHERE title = 'delta'");
+    fail_unless(mql_result_is_success(r), "select failed: %s",
+                mql_result_error_get_message(r));
+    fail_if(mql_result_rows_get_row_count(r) != 1, "text key not found");
+
+    text = mql_result_rows_get_string(r, 0, 0, buf, sizeof(buf));
+    fail_if(!text || strlen(text) != LONG_TEXT, "long text was truncated");
+    mql_result_free(r);
+
+    r = mql_exec_string(mql_result_rows, "SELECT title FROM notes"
+                        " ORDER BY title");
+    fail_unless(mql_result_is_success(r), "select failed: %s",
+                mql_result_error_get_message(r));
+    fail_if(mql_result_rows_get_row_count(r) != 4, "notes has %d rows "
+            "instead of 4", mql_result_rows_get_row_count(r));
+
+    text = mql_result_rows_get_string(r, 0, 0, buf, sizeof(buf));
+    fail_if(strcmp(text, "alpha"), "text is not ordered by value");
+    text = mql_result_rows_get_string(r, 0, 3, buf, sizeof(buf));
+    fail_if(strcmp(text, "gamma"), "text is not ordered by value");
+    mql_result_free(r);
+
+    r = mql_exec_string(mql_result_string, "SELECT * FROM notes"
+                        " WHERE title = 'alpha'");
+    fail_unless(mql_result_is_success(r), "select failed: %s",
+                mql_result_error_get_message(r));
+    fail_if(!strstr(mql_result_string_get(r), "first"),
+            "text value missing from the printed result");
+    mql_result_free(r);
+
+    r = mql_exec_string(mql_result_string, "DROP TABLE notes");
+    mql_result_free(r);
+#undef LONG_TEXT
+}
+END_TEST
+
+START_TEST(statement_cache)
+{
+    static uint32_t ids[] = { 1100, 700, 44 };
+
+    mql_cache_stats_t  st0, st;
+    mql_result_t      *r;
+    char               query[256];
+    size_t             i;
+    int                n;
+
+    PREREQUISITE(insert_into_persons);
+
+    mql_flush_cache();
+    mql_get_cache_stats(&st0);
+
+    for (i = 0;  i < MQI_DIMENSION(ids);  i++) {
+        snprintf(query, sizeof(query), "SELECT first_name FROM persons"
+                 "  WHERE id = %u", ids[i]);
+
+        r = mql_exec_string(mql_result_rows, query);
+
+        fail_unless(mql_result_is_success(r), "'%s' failed: %s",
+                    query, mql_result_error_get_message(r));
+
+        if ((n = mql_result_rows_get_row_count(r)) != 1)
+            fail("'%s' returned %d rows instead of 1", query, n);
+
+        mql_result_free(r);
+    }
+
+    mql_get_cache_stats(&st);
+
+    fail_if(st.size != 1, "%d cached statements instead of 1", st.size);
+    fail_if(st.misses != st0.misses + 1 || st.hits != st0.hits + 2,
+            "%d hits and %d misses instead of 2 and 1",
+            (int)(st.hits - st0.hits), (int)(st.misses - st0.misses));
+
+    r = mql_exec_string(mql_result_string, "CREATE TEMPORARY TABLE cached"
+                        " (id UNSIGNED)");
+
+    fail_unless(mql_result_is_success(r), "create failed: %s",
+                mql_result_error_get_message(r));
+
+    mql_result_free(r);
+
+    mql_get_cache_stats(&st);
+
+    fail_if(st.size != 0 || st.invalidations != st0.invalidations + 1,
+            "cache was not invalidated by table creation");
+}
+END_TEST
+
+#define QUERY_THREADS  4
+#define QUERY_LOOPS    200
+
+static void *query_thread(void *data)
+{
+    int          *failed = data;
+    mql_result_t *r;
+    record_t     *p;
+    char          query[256];
+    int           i;
+
+    for (i = 0;  i < QUERY_LOOPS;  i++) {
+        p = persons_rows + (i % persons_nrow);
+
+        snprintf(query, sizeof(query), "SELECT id, email FROM persons"
+                 " WHERE id = %u", p->id);
+
+        r = mql_exec_string(mql_result_rows, query);
+
+        if (!mql_result_is_success(r) ||
+            mql_result_rows_get_row_count(r) != 1 ||
+            mql_result_rows_get_unsigned(r, 0, 0) != p->id)
+            (*failed)++;
+
+        mql_result_free(r);
+
+        /* not cached, goes through the parser every time */
+        r = mql_exec_string(mql_result_string, "DESCRIBE persons");
+
+        if (!mql_result_is_success(r))
+            (*failed)++;
+
+        mql_result_free(r);
+    }
+
+    return NULL;
+}
+
+START_TEST(concurrent_queries)
+{
+    pthread_t threads[QUERY_THREADS];
+    int       failed[QUERY_THREADS];
+    int       i;
+
+    PREREQUISITE(make_persons);
+
+    for (i = 0;  i < QUERY_THREADS;  i++) {
+        failed[i] = 0;
+
+        fail_if(pthread_create(threads + i, NULL, query_thread,
+                               failed + i) != 0,
+                "failed to start query thread");
+    }
+
+    for (i = 0;  i < QUERY_THREADS;  i++) {
+        pthread_join(threads[i], NULL);
+
+        fail_if(failed[i], "%d queries failed in thread %d", failed[i], i);
+    }
+}
+END_TEST
+
+START_TEST(aggregate_queries)
+{
+    mql_result_t *r;
+    char          buf[64];
+    const char   *sex;
+    int           n;
+
+    PREREQUISITE(make_persons);
+
+    r = mql_exec_string(mql_result_rows, "SELECT sex, count(*), max(id),"
+                        " avg(id) FROM persons GROUP BY sex"
+                        " ORDER BY count(*) DESC");
+
+    fail_unless(mql_result_is_success(r), "grouped select failed: %s",
+                mql_result_error_get_message(r));
+
+    fail_if((n = mql_result_rows_get_row_count(r)) != 2,
+            "%d groups instead of 2", n);
+
+    sex = mql_result_rows_get_string(r, 0, 0, buf, sizeof(buf));
+
+    fail_if(strcmp(sex, "male") ||
+            mql_result_rows_get_unsigned(r, 1, 0) != 4 ||
+            mql_result_rows_get_unsigned(r, 2, 0) != 1100 ||
+            mql_result_rows_get_floating(r, 3, 0) != 725.0,
+            "wrong aggregates for the first group");
+
+    fail_if(mql_result_rows_get_unsigned(r, 1, 1) != 2 ||
+            mql_result_rows_get_unsigned(r, 2, 1) != 2000 ||
+            mql_result_rows_get_floating(r, 3, 1) != 1022.0,
+            "wrong aggregates for the second group");
+
+    mql_result_free(r);
+
+    r = mql_exec_string(mql_result_rows, "SELECT first_name, id FROM persons"
+                        " WHERE id > 100 ORDER BY id DESC LIMIT 2");
+
+    fail_unless(mql_result_is_success(r), "top-N select failed: %s",
+                mql_result_error_get_message(r));
+
+    fail_if(mql_result_rows_get_row_count(r) != 2 ||
+            mql_result_rows_get_unsigned(r, 1, 0) != 2000 ||
+            mql_result_rows_get_unsigned(r, 1, 1) != 1100,
+            "wrong top-N rows");
+
+    mql_result_free(r);
+
+    r = mql_exec_string(mql_result_rows, "SELECT count(*), sum(id) FROM"
+                        " persons WHERE id > 5000");
+
+    fail_unless(mql_result_is_success(r), "empty aggregate failed: %s",
+                mql_result_error_get_message(r));
+
+    fail_if(mql_result_rows_get_row_count(r) != 1 ||
+            mql_result_rows_get_unsigned(r, 0, 0) != 0 ||
+            mql_result_rows_get_unsigned(r, 1, 0) != 0,
+            "aggregates over no rows are not zero");
+
+    mql_result_free(r);
+
+    r = mql_exec_string(mql_result_rows, "SELECT sum(email) FROM persons");
+
+    fail_if(mql_result_is_success(r), "sum of varchars succeeded");
+
+    mql_result_free(r);
+
+    r = mql_exec_string(mql_result_rows, "SELECT id FROM persons"
+                        " ORDER BY email");
+
+    fail_if(mql_result_is_success(r), "ordering by an unselected column "
+            "succeeded");
+
+    mql_result_free(r);
+}
+END_TEST
+
 START_TEST(precompile_transaction_statements)
 {
 #define TRID "transaction_1"
@@ -475,6 +965,174 @@ START_TEST(exec_precompiled_full_select_from_persons)
 }
 END_TEST
 
+typedef struct {
+    int      nrow;
+    int      max;
+    uint32_t ids[16];
+} visit_t;
+
+static bool visit_row(mql_result_t *r, void *user_data)
+{
+    visit_t *v = (visit_t *)user_data;
+
+    v->ids[v->nrow++] = mql_result_rows_get_unsigned(r, 0, 0);
+
+    return v->nrow < v->max && mql_result_rows_get_row_count(r) == 1;
+}
+
+START_TEST(visit_precompiled_selects)
+{
+    mql_statement_t *stmnt;
+    mql_result_t    *r;
+    visit_t          v;
+    int              n;
+    int              i;
+
+    PREREQUISITE(make_persons);
+
+    stmnt = mql_precompile("SELECT id, first_name FROM persons"
+                           " WHERE id > 100");
+    fail_if(!stmnt, "precompilation error (%s)", strerror(errno));
+
+    memset(&v, 0, sizeof(v));
+    v.max = MQI_DIMENSION(v.ids);
+    n = mql_exec_statement_visit(stmnt, visit_row, &v);
+
+    r = mql_exec_statement(mql_result_rows, stmnt);
+    fail_unless(mql_result_is_success(r), "exec error: %s",
+                mql_result_error_get_message(r));
+
+    fail_if(n != v.nrow || n != mql_result_rows_get_row_count(r),
+            "visited %d rows instead of %d", n,
+            mql_result_rows_get_row_count(r));
+
+    for (i = 0;  i < n;  i++) {
+        fail_if(v.ids[i] != mql_result_rows_get_unsigned(r, 0, i),
+                "visited rows differ from the selected ones");
+    }
+
+    mql_result_free(r);
+
+    memset(&v, 0, sizeof(v));
+    v.max = 2;
+    n = mql_exec_statement_visit(stmnt, visit_row, &v);
+    fail_if(n != 2, "visit did not stop after 2 rows but %d", n);
+
+    mql_statement_free(stmnt);
+
+    stmnt = mql_precompile("SELECT id FROM persons ORDER BY id DESC LIMIT 3");
+    fail_if(!stmnt, "precompilation error (%s)", strerror(errno));
+
+    memset(&v, 0, sizeof(v));
+    v.max = MQI_DIMENSION(v.ids);
+    n = mql_exec_statement_visit(stmnt, visit_row, &v);
+    fail_if(n != 3 || v.ids[0] != 2000 || v.ids[1] != 1100 ||
+            v.ids[1] < v.ids[2], "ordered visit returned wrong rows");
+
+    mql_statement_free(stmnt);
+
+    stmnt = mql_precompile("SELECT id FROM persons LIMIT 2");
+    fail_if(!stmnt, "precompilation error (%s)", strerror(errno));
+
+    memset(&v, 0, sizeof(v));
+    v.max = MQI_DIMENSION(v.ids);
+    n = mql_exec_statement_visit(stmnt, visit_row, &v);
+    fail_if(n != 2, "limited visit returned %d rows", n);
+
+    r = mql_exec_statement(mql_result_rows, stmnt);
+    n = mql_result_rows_get_row_count(r);
+    fail_if(n != 2, "limited select returned %d rows", n);
+
+    mql_result_free(r);
+    mql_statement_free(stmnt);
+}
+END_TEST
+
+START_TEST(join_persons_with_awards)
+{
+    static char *statements[] = {
+        "CREATE TEMPORARY TABLE awards (id UNSIGNED, prize VARCHAR(16))",
+        "CREATE INDEX ON awards (id)",
+        "INSERT INTO awards VALUES (600, 'Grammy')",
+        "INSERT INTO awards VALUES (44, 'Oscar')",
+        "INSERT INTO awards VALUES (9999, 'Nobel')",
+        NULL
+    };
+
+    mql_statement_t *stmnt;
+    mql_result_t    *r;
+    visit_t          v;
+    const char      *prize;
+    char             buf[32];
+    uint32_t         id;
+    int              i, n;
+
+    PREREQUISITE(make_persons);
+
+    for (i = 0;  statements[i];  i++) {
+        r = mql_exec_string(mql_result_string, statements[i]);
+        fail_unless(mql_result_is_success(r), "'%s' failed: %s",
+                    statements[i], mql_result_error_get_message(r));
+        mql_result_free(r);
+    }
+
+    r = mql_exec_string(mql_result_rows, "SELECT persons.id, prize FROM"
+                        " persons JOIN awards ON persons.id = awards.id");
+    fail_unless(mql_result_is_success(r), "join failed: %s",
+                mql_result_error_get_message(r));
+
+    n = mql_result_rows_get_row_count(r);
+    fail_if(n != 2, "join returned %d rows instead of 2", n);
+
+    for (i = 0;  i < n;  i++) {
+        id    = mql_result_rows_get_unsigned(r, 0, i);
+        prize = mql_result_rows_get_string(r, 1, i, buf, sizeof(buf));
+
+        fail_if(strcmp(prize, id == 600 ? "Grammy" : "Oscar") ||
+                (id != 600 && id != 44), "mismatching joined row");
+    }
+
+    mql_result_free(r);
+
+    r = mql_exec_string(mql_result_rows, "SELECT * FROM persons JOIN awards"
+                        " ON awards.id = persons.id WHERE prize = 'Grammy'");
+    fail_unless(mql_result_is_success(r), "filtered join failed: %s",
+                mql_result_error_get_message(r));
+    fail_if(mql_result_rows_get_row_count(r) != 1 ||
+            mql_result_rows_get_row_column_count(r) != 7 ||
+            mql_result_rows_get_unsigned(r, 5, 0) != 600,
+            "filtered join returned wrong rows");
+    mql_result_free(r);
+
+    r = mql_exec_string(mql_result_rows, "SELECT prize FROM persons"
+                        " JOIN awards ON id = id");
+    fail_if(mql_result_is_success(r), "ambiguous join column accepted");
+    mql_result_free(r);
+
+    stmnt = mql_precompile("SELECT persons.id, prize FROM persons JOIN awards"
+                           " ON persons.id = awards.id WHERE sex = %s");
+    fail_if(!stmnt, "precompilation error (%s)", strerror(errno));
+
+    fail_if(mql_bind_value(stmnt, 1, mqi_string, "female") < 0,
+            "bind error (%s)", strerror(errno));
+
+    r = mql_exec_statement(mql_result_rows, stmnt);
+    fail_unless(mql_result_is_success(r), "exec error: %s",
+                mql_result_error_get_message(r));
+    fail_if(mql_result_rows_get_row_count(r) != 1 ||
+            mql_result_rows_get_unsigned(r, 0, 0) != 44,
+            "precompiled join returned wrong rows");
+    mql_result_free(r);
+
+    memset(&v, 0, sizeof(v));
+    v.max = MQI_DIMENSION(v.ids);
+    n = mql_exec_statement_visit(stmnt, visit_row, &v);
+    fail_if(n != 1 || v.ids[0] != 44, "visited join returned wrong rows");
+
+    mql_statement_free(stmnt);
+}
+END_TEST
+
 START_TEST(exec_precompiled_update_persons)
 {
     static uint32_t    id         = 2000;
@@ -766,6 +1424,20 @@ START_TEST(register_column_event_cb)
 }
 END_TEST
 
+START_TEST(register_changefeed_event_cb)
+{
+    int sts;
+
+    PREREQUISITE(make_persons);
+
+    sts = mql_register_callback("changefeed_event_cb", mql_result_event,
+                                changefeed_event_cb, CHANGEFEED_DATA);
+
+    fail_if(sts < 0, "failed to create 'changefeed_event_cb': %s",
+            strerror(errno));
+}
+END_TEST
+
 START_TEST(table_trigger)
 {
     static char *mqlstr = "CREATE TRIGGER table_trigger"
@@ -850,6 +1522,121 @@ START_TEST(column_trigger)
 END_TEST
 
 
+START_TEST(register_batched_event_cb)
+{
+    int sts;
+
+    PREREQUISITE(make_persons);
+
+    sts = mql_register_callback("batched_event_cb", mql_result_event,
+                                batched_event_cb, BATCHED_TRIGGER_DATA);
+
+    fail_if(sts < 0, "failed to create 'batched_event_cb': %s",
+            strerror(errno));
+}
+END_TEST
+
+START_TEST(batched_column_trigger)
+{
+    static char *mqlstr = "CREATE TRIGGER batched_trigger"
+                          " ON COLUMN id IN persons"
+                          " CALLBACK batched_event_cb BATCHED"
+                          " SELECT first_name, family_name";
+
+    mql_result_t *r;
+    int i;
+
+    PREREQUISITE(register_batched_event_cb);
+    PREREQUISITE(precompile_transaction_statements);
+
+    r = mql_exec_string(mql_result_dontcare, mqlstr);
+
+    fail_unless(mql_result_is_success(r),"failed to exec '%s': (%d) %s",mqlstr,
+                mql_result_error_get_code(r), mql_result_error_get_message(r));
+
+    r = mql_exec_statement(mql_result_string, persons.begin);
+
+    fail_unless(mql_result_is_success(r), "failed to begin transaction: %s",
+                strerror(errno));
+
+    r = mql_exec_string(mql_result_dontcare,
+                        "UPDATE persons SET id = 3 WHERE sex = 'female'");
+
+    fail_unless(mql_result_is_success(r), "failed to update: %s",
+                mql_result_error_get_message(r));
+
+    r = mql_exec_statement(mql_result_string, persons.commit);
+
+    fail_unless(mql_result_is_success(r), "failed to commit transaction: %s",
+                strerror(errno));
+
+    fail_unless(nchange_batch == 1, "wrong number of batches (%d vs. 1)",
+                nchange_batch);
+    fail_unless(nbatched_row == 2, "wrong number of changes (%d vs. 2)",
+                nbatched_row);
+
+    for (i = 0;  i < nbatched_row;  i++) {
+        fail_unless((batched_ids[i][0] == 2000 || batched_ids[i][0] == 44) &&
+                    batched_ids[i][1] == 3,
+                    "wrong change (%u => %u) @ row %d",
+                    batched_ids[i][0], batched_ids[i][1], i);
+    }
+}
+END_TEST
+
+START_TEST(changefeed_trigger)
+{
+    static char *mqlstr = "CREATE TRIGGER changefeed_trigger"
+                          " ON CHANGES IN persons"
+                          " CALLBACK changefeed_event_cb"
+                          " SELECT id, first_name, family_name";
+
+    static mqi_change_type_t expected[] = {
+        mqi_change_insert,      /* Veijo Baltzar */
+        mqi_change_update,      /* Greta Garbo => Marilyn Monroe */
+        mqi_change_delete       /* Tom Cruise */
+    };
+
+    mql_result_t *r;
+    int i;
+
+    PREREQUISITE(register_changefeed_event_cb);
+    PREREQUISITE(precompile_transaction_statements);
+
+    r = mql_exec_string(mql_result_dontcare, mqlstr);
+
+    fail_unless(mql_result_is_success(r),"failed to exec '%s': (%d) %s",mqlstr,
+                mql_result_error_get_code(r), mql_result_error_get_message(r));
+
+    r = mql_exec_statement(mql_result_string, persons.begin);
+
+    fail_unless(mql_result_is_success(r), "failed to begin transaction: %s",
+                strerror(errno));
+
+    PREREQUISITE(exec_precompiled_insert_into_persons);
+    PREREQUISITE(exec_precompiled_update_persons);
+    PREREQUISITE(exec_precompiled_delete_from_persons);
+
+    r = mql_exec_statement(mql_result_string, persons.commit);
+
+    fail_unless(mql_result_is_success(r), "failed to commit transaction: %s",
+                strerror(errno));
+
+    fail_unless(nchange_batch == 1, "wrong number of batches (%d vs. 1)",
+                nchange_batch);
+    fail_unless(nchange == (int)MQI_DIMENSION(expected),
+                "wrong number of changes (%d vs. %d)",
+                nchange, MQI_DIMENSION(expected));
+
+    for (i = 0;  i < nchange;  i++) {
+        fail_unless(changes[i] == expected[i],
+                    "wrong change (%d vs. %d) @ row %d",
+                    changes[i], expected[i], i);
+    }
+}
+END_TEST
+
+
 START_TEST(transaction_trigger)
 {
     static char *mqlstr = "CREATE TRIGGER transaction_trigger ON TRANSACTIONS"
@@ -888,6 +1675,14 @@ static TCase *basic_tests(void)
     tcase_add_test(tc, describe_persons);
     tcase_add_test(tc, create_index_on_persons);
     tcase_add_test(tc, insert_into_persons);
+    tcase_add_test(tc, create_secondary_index_on_persons);
+    tcase_add_test(tc, explain_queries_on_persons);
+    tcase_add_test(tc, columnar_table_with_real_values);
+    tcase_add_test(tc, multi_row_insert_and_upsert);
+    tcase_add_test(tc, text_columns);
+    tcase_add_test(tc, statement_cache);
+    tcase_add_test(tc, concurrent_queries);
+    tcase_add_test(tc, aggregate_queries);
     tcase_add_test(tc, precompile_transaction_statements);
     tcase_add_test(tc, precompile_filtered_person_select);
     tcase_add_test(tc, precompile_full_person_select);
@@ -896,6 +1691,8 @@ static TCase *basic_tests(void)
     tcase_add_test(tc, precompile_insert_into_persons);
     tcase_add_test(tc, exec_precompiled_filtered_select_from_persons);
     tcase_add_test(tc, exec_precompiled_full_select_from_persons);
+    tcase_add_test(tc, visit_precompiled_selects);
+    tcase_add_test(tc, join_persons_with_awards);
     tcase_add_test(tc, exec_precompiled_update_persons);
     tcase_add_test(tc, exec_precompiled_delete_from_persons);
     tcase_add_test(tc, exec_precompiled_insert_into_persons);
@@ -906,6 +1703,8 @@ static TCase *basic_tests(void)
     tcase_add_test(tc, table_trigger);
     tcase_add_test(tc, row_trigger);
     tcase_add_test(tc, column_trigger);
+    tcase_add_test(tc, changefeed_trigger);
+    tcase_add_test(tc, batched_column_trigger);
     tcase_add_test(tc, transaction_trigger);
 
     return tc;
@@ -976,6 +1775,69 @@ static void column_event_cb(mql_result_t *result, void *user_data)
     }
 }
 
+static void changefeed_event_cb(mql_result_t *result, void *user_data)
+{
+    mql_result_t *rows;
+    int i, n;
+
+    if (result->type != mql_result_event || user_data != CHANGEFEED_DATA ||
+        mql_result_event_get_type(result) != mqi_rows_changed)
+    {
+        if (verbose)
+            printf("%s: invalid result type %d\n", __FUNCTION__, result->type);
+        return;
+    }
+
+    rows = mql_result_event_get_changed_rows(result);
+    n    = mql_result_rows_get_row_count(rows);
+
+    nchange_batch++;
+
+    for (i = 0;  i < n && nchange < (int)MQI_DIMENSION(changes);  i++) {
+        changes[nchange++] = mql_result_event_get_change_type(result, i);
+
+        if (verbose) {
+            printf("change %d: %d %u %s %s\n", i, changes[nchange-1],
+                   mql_result_rows_get_unsigned(rows, 0, i),
+                   mql_result_rows_get_string(rows, 1, i, NULL, 0),
+                   mql_result_rows_get_string(rows, 2, i, NULL, 0));
+        }
+    }
+}
+
+static void batched_event_cb(mql_result_t *result, void *user_data)
+{
+    mql_result_t *rows;
+    int i, n;
+
+    if (result->type != mql_result_event || user_data != BATCHED_TRIGGER_DATA ||
+        mql_result_event_get_type(result) != mqi_column_changed)
+    {
+        if (verbose)
+            printf("%s: invalid result type %d\n", __FUNCTION__, result->type);
+        return;
+    }
+
+    rows = mql_result_event_get_changed_rows(result);
+    n    = mql_result_rows_get_row_count(rows);
+
+    nchange_batch++;
+
+    for (i = 0;  i < n && nbatched_row < (int)MQI_DIMENSION(batched_ids);  i++){
+        batched_ids[nbatched_row][0] = mql_result_rows_get_unsigned(rows, 0, i);
+        batched_ids[nbatched_row][1] = mql_result_rows_get_unsigned(rows, 1, i);
+        nbatched_row++;
+
+        if (verbose) {
+            printf("change %d: %u => %u %s %s\n", i,
+                   mql_result_rows_get_unsigned(rows, 0, i),
+                   mql_result_rows_get_unsigned(rows, 1, i),
+                   mql_result_rows_get_string(rows, 2, i, NULL, 0),
+                   mql_result_rows_get_string(rows, 3, i, NULL, 0));
+        }
+    }
+}
+
 /*
  * Local Variables:
  * c-basic-offset: 4
@@ -104,6 +104,9 @@ struct pep_watch_s {
     pep_proxy_t     *proxy;              /* enforcement point */
     int              id;                 /* table id within proxy */
     uint32_t         stamp;              /* last notified update stamp */
+    mqi_bitfld_t     columns;            /* columns the watch depends on */
+    int              ncolumn;            /* number of columns, 0 for all */
+    mqi_handle_t     colh;               /* table the columns were taken of */
     mrp_list_hook_t  tbl_hook;           /* hook to table watch list */
     mrp_list_hook_t  pep_hook;           /* hook to proxy watch list */
 };
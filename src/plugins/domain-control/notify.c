@@ -27,6 +27,8 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <ctype.h>
+
 #include <murphy/common/mm.h>
 #include <murphy/common/log.h>
 
@@ -47,6 +49,65 @@ static void prepare_proxy_notification(pep_proxy_t *proxy)
 }
 
 
+/*
+ * Collect the columns a watch selects or filters on, so that changes
+ * to other columns of the table do not trigger a notification. A '*'
+ * or an unknown name in the column list means the whole table.
+ */
+static void resolve_watch_columns(pep_watch_t *w)
+{
+    mqi_handle_t  h = w->table->h;
+    const char   *clause[2], *p, *b;
+    char          name[256];
+    int           i, n, cx, all;
+
+    clause[0] = w->mql_columns;
+    clause[1] = w->mql_where;
+    all       = FALSE;
+
+    mqi_bitfld_clear(&w->columns);
+    w->ncolumn = 0;
+    w->colh    = h;
+
+    for (i = 0; i < 2 && !all; i++) {
+        p = clause[i];
+
+        while (*p && !all) {
+            if (*p == '\'' || *p == '"') {
+                for (b = p++; *p && *p != *b; p++)
+                    ;
+                if (*p)
+                    p++;
+            }
+            else if (isalpha(*p) || *p == '_') {
+                for (b = p; isalnum(*p) || *p == '_'; p++)
+                    ;
+                n = snprintf(name, sizeof(name), "%.*s", (int)(p - b), b);
+
+                if (n < (int)sizeof(name) &&
+                    (cx = mqi_get_column_index(h, name)) >= 0) {
+                    if (!mqi_bitfld_test(&w->columns, cx)) {
+                        mqi_bitfld_set(&w->columns, cx);
+                        w->ncolumn++;
+                    }
+                }
+                else if (i == 0)
+                    all = TRUE;
+            }
+            else if (*p == '*' && i == 0)
+                all = TRUE;
+            else
+                p++;
+        }
+    }
+
+    if (all) {
+        mqi_bitfld_clear(&w->columns);
+        w->ncolumn = 0;
+    }
+}
+
+
 static void check_watch_notification(pep_watch_t *w)
 {
     pep_proxy_t *proxy = w->proxy;
@@ -58,10 +119,15 @@ static void check_watch_notification(pep_watch_t *w)
         update = TRUE;
     }
     else {
-        if (t->h != MQI_HANDLE_INVALID)
-            update = (w->stamp < mqi_get_table_stamp(t->h));
-        else
+        if (t->h == MQI_HANDLE_INVALID)
             update = FALSE;
+        else if (w->colh != t->h) {
+            resolve_watch_columns(w);
+            update = TRUE;
+        }
+        else
+            update = (w->stamp < mqi_get_column_stamp(t->h, w->ncolumn ?
+                                                      &w->columns : NULL));
     }
 
     proxy->notify_update |= update;
@@ -88,6 +154,8 @@ static int collect_watch_notification(pep_watch_t *w)
             mrp_debug("select from table %s failed", w->table->name);
             goto fail;
         }
+
+        w->stamp = mqi_get_table_stamp(w->table->h);
     }
 
     n = proxy->ops->update_notify(proxy, w->id, r);
@@ -415,6 +415,7 @@ int create_proxy_watch(pep_proxy_t *proxy, int id,
         w->max_rows     = max_rows;
         w->proxy        = proxy;
         w->id           = id;
+        w->colh         = MQI_HANDLE_INVALID;
 
         if (w->mql_columns == NULL || w->mql_where == NULL)
             goto fail;
@@ -470,18 +471,24 @@ static void reset_proxy_tables(pep_proxy_t *proxy)
 static int insert_into_table(pep_table_t *t,
                              mrp_domctl_value_t **rows, int nrow)
 {
-    void *data[2];
-    int   i;
+    void **data;
+    int    n, i;
 
-    data[1] = NULL;
+    if (nrow <= 0)
+        return TRUE;
 
-    for (i = 0; i < nrow; i++) {
-        data[0] = rows[i];
-        if (mqi_insert_into(t->h, 0, t->coldesc, data) != 1)
-            return FALSE;
-    }
+    /* insert all rows with a single call instead of row by row */
+    if ((data = mrp_allocz_array(void *, nrow + 1)) == NULL)
+        return FALSE;
+
+    for (i = 0; i < nrow; i++)
+        data[i] = rows[i];
+
+    n = mqi_insert_into(t->h, mqi_insert_strict, t->coldesc, data);
+
+    mrp_free(data);
 
-    return TRUE;
+    return n == nrow;
 }
 
 
@@ -27,6 +27,9 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stdio.h>
+#include <string.h>
+
 #include <murphy/common/mm.h>
 #include <murphy/common/log.h>
 #include <murphy-db/mqi.h>
@@ -38,6 +41,29 @@
 
 static int subscribe_db_events(mrp_resolver_t *r);
 static void unsubscribe_db_events(mrp_resolver_t *r);
+static void resolve_fact_columns(fact_t *f);
+
+
+/*
+ * A fact of the form $table.column[.column...] only depends on the
+ * listed columns of the table, a plain $table on all of it.
+ */
+static int fact_table_len(const char *fact)
+{
+    const char *dot = strchr(fact + 1, '.');
+
+    return dot ? (int)(dot - fact - 1) : (int)strlen(fact + 1);
+}
+
+
+static mqi_handle_t fact_table_handle(const char *fact)
+{
+    char table[256];
+
+    snprintf(table, sizeof(table), "%.*s", fact_table_len(fact), fact + 1);
+
+    return mqi_get_table_handle(table);
+}
 
 int create_fact(mrp_resolver_t *r, char *fact)
 {
@@ -57,12 +83,47 @@ int create_fact(mrp_resolver_t *r, char *fact)
 
     f = r->facts + r->nfact++;
     f->name  = mrp_strdup(fact);
-    f->table = mqi_get_table_handle(f->name + 1);
 
-    if (f->name != NULL)
-        return TRUE;
-    else
+    if (f->name == NULL)
         return FALSE;
+
+    f->table = fact_table_handle(f->name);
+    resolve_fact_columns(f);
+
+    return TRUE;
+}
+
+
+static void resolve_fact_columns(fact_t *f)
+{
+    char        column[256];
+    const char *p, *e;
+    int         len, cx;
+
+    mqi_bitfld_clear(&f->columns);
+    f->ncolumn = 0;
+
+    if (f->table == MQI_HANDLE_INVALID)
+        return;
+
+    for (p = strchr(f->name + 1, '.'); p != NULL; p = e) {
+        p++;
+        e   = strchr(p, '.');
+        len = e ? (int)(e - p) : (int)strlen(p);
+
+        snprintf(column, sizeof(column), "%.*s", len, p);
+
+        if ((cx = mqi_get_column_index(f->table, column)) < 0) {
+            mrp_log_error("Fact '%s' has no column '%s', tracking the "
+                          "whole table instead.", f->name, column);
+            mqi_bitfld_clear(&f->columns);
+            f->ncolumn = 0;
+            return;
+        }
+
+        mqi_bitfld_set(&f->columns, cx);
+        f->ncolumn++;
+    }
 }
 
 
@@ -85,8 +146,12 @@ uint32_t fact_stamp(mrp_resolver_t *r, int id)
     fact_t   *fact = r->facts + id;
     uint32_t  stamp;
 
-    if (fact->table != MQI_HANDLE_INVALID)
-        stamp = mqi_get_table_stamp(fact->table);
+    if (fact->table != MQI_HANDLE_INVALID) {
+        if (fact->ncolumn > 0)
+            stamp = mqi_get_column_stamp(fact->table, &fact->columns);
+        else
+            stamp = mqi_get_table_stamp(fact->table);
+    }
     else
         stamp = 0; /* MQI_NO_STAMP */
 
@@ -122,9 +187,10 @@ static void update_fact_table(mrp_resolver_t *r, const char *name,
     int     i;
 
     for (i = 0, f = r->facts; i < r->nfact; i++, f++) {
-        if (!strcmp(f->name + 1, name)) {
+        if (fact_table_len(f->name) == (int)strlen(name) &&
+            !strncmp(f->name + 1, name, strlen(name))) {
             f->table = tbl;
-            return;
+            resolve_fact_columns(f);
         }
     }
 }
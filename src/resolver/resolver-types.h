@@ -67,6 +67,8 @@ struct target_s {
 struct fact_s {
     char         *name;                  /* fact name */
     mqi_handle_t  table;                 /* associated DB table */
+    mqi_bitfld_t  columns;               /* tracked columns, if any */
+    int           ncolumn;               /* number of tracked columns */
     uint32_t      stamp;                 /* touch-stamp */
 };
 